@@ -511,13 +511,21 @@ int universe_init (const MxUniverseConfig &conf ) {
 
     Magnum::Vector3 tmp = conf.dim - conf.origin;
     Magnum::Vector3d length{tmp[0], tmp[1], tmp[2]};
-    Magnum::Vector3d spaceGridSize{conf.spaceGridSize[0], conf.spaceGridSize[2], conf.spaceGridSize[2]};
+    Magnum::Vector3d spaceGridSize{(double)conf.spaceGridSize[0], (double)conf.spaceGridSize[1], (double)conf.spaceGridSize[2]};
 
     Magnum::Vector3d L = length / spaceGridSize;
 
     double x[3];
 
-    double   cutoff = 0.1 * length.sum() / 3.;
+    double   cutoff = conf.cutoff;
+
+    uint32_t flags = conf.flags;
+
+    // let the engine pick the grid, starting from cells of the cutoff size
+    if(spaceGridSize.min() <= 0) {
+        L = Magnum::Vector3d{cutoff, cutoff, cutoff};
+        flags |= engine_flag_autogrid;
+    }
 
     int  k, cid, pid, nr_runners = conf.threads;
 
@@ -542,7 +550,7 @@ int universe_init (const MxUniverseConfig &conf ) {
 
     printf("main: initializing the engine... "); fflush(stdout);
     if ( engine_init( &_Engine , _origin , _dim , L.data() , cutoff , space_periodic_full ,
-            conf.maxTypes , engine_flag_none ) != 0 ) {
+            conf.maxTypes , flags ) != 0 ) {
         printf("main: engine_init failed with engine_err=%i.\n",engine_err);
         errs_dump(stdout);
         return 1;
@@ -172,6 +172,86 @@ Magnum::Vector3 MxUniverse::dim()
 
 
 
+// throws the last engine error as a python exception if result < 0
+static int universe_engine_check(int result, const char *what) {
+    if(result < 0) {
+        std::string msg = what;
+        msg += " failed: error";
+        msg += std::to_string(engine_err);
+        msg += ", ";
+        msg += engine_err_msg[-engine_err];
+        PY_CHECK(mx_error(E_FAIL, msg.c_str()));
+    }
+    return result;
+}
+
+/**
+ * gets the index of a potential in one of the engine's lists of angle or
+ * dihedral potentials, adding it with addpot if it is not in there yet.
+ * The engine keeps a reference to each potential it adds.
+ */
+static int universe_bonded_pot(py::handle pot, MxPotential **pots, int nr_pots,
+        int (*addpot)(struct engine*, struct MxPotential*), const char *what) {
+    if(!PyObject_IsInstance(pot.ptr(), (PyObject*)&MxPotential_Type)) {
+        std::string msg = what;
+        msg += " needs a Potential";
+        PY_CHECK(mx_error(E_FAIL, msg.c_str()));
+    }
+
+    for(int k = 0; k < nr_pots; k++) {
+        if(pots[k] == (MxPotential*)pot.ptr()) {
+            return k;
+        }
+    }
+
+    int result = universe_engine_check(addpot(&_Engine, (MxPotential*)pot.ptr()), what);
+    Py_INCREF(pot.ptr());
+    return result;
+}
+
+/**
+ * adds remove_<name>(handle), <name>_particles(handle) and <name>s(pid)
+ * for one kind of bonded interaction.
+ */
+static void universe_bind_bonded(py::class_<PyUniverse> &u, const std::string &name, int kind) {
+
+    u.def_static(("remove_" + name).c_str(), [kind](int hid) -> void {
+            UNIVERSE_CHECK();
+            universe_engine_check(engine_bonded_remove(&_Engine, kind, hid), "remove");
+        }
+    );
+
+    u.def_static((name + "_particles").c_str(), [kind](int hid) -> py::tuple {
+            UNIVERSE_CHECK();
+            int k = universe_engine_check(engine_bonded_lookup(&_Engine, kind, hid), "lookup");
+            switch(kind) {
+                case engine_bonded_exclusion:
+                    return py::make_tuple(_Engine.exclusions[k].i, _Engine.exclusions[k].j);
+                case engine_bonded_bond:
+                    return py::make_tuple(_Engine.bonds[k].i, _Engine.bonds[k].j);
+                case engine_bonded_angle:
+                    return py::make_tuple(_Engine.angles[k].i, _Engine.angles[k].j, _Engine.angles[k].k);
+                default:
+                    return py::make_tuple(_Engine.dihedrals[k].i, _Engine.dihedrals[k].j,
+                                          _Engine.dihedrals[k].k, _Engine.dihedrals[k].l);
+            }
+        }
+    );
+
+    u.def_static((name + "s").c_str(), [kind](int pid) -> py::list {
+            UNIVERSE_CHECK();
+            int count = universe_engine_check(engine_bonded_adjacent(&_Engine, kind, pid, NULL, 0), "adjacent");
+            std::vector<int> hids(count);
+            universe_engine_check(engine_bonded_adjacent(&_Engine, kind, pid, hids.data(), count), "adjacent");
+            py::list result;
+            for(int hid : hids) {
+                result.append(hid);
+            }
+            return result;
+        }
+    );
+}
+
 HRESULT _MxUniverse_init(PyObject* m)
 {
     py::class_<PyUniverse> u(m, "Universe");
@@ -245,6 +325,40 @@ HRESULT _MxUniverse_init(PyObject* m)
         PY_CHECK(MxUniverse_Step(until, dt));
     });
 
+    // topology editing, each add returns a handle for the remove functions
+    u.def_static("add_exclusion", [](int i, int j) -> int {
+            UNIVERSE_CHECK();
+            return universe_engine_check(engine_exclusion_add(&_Engine, i, j), "add_exclusion");
+        }
+    );
+
+    u.def_static("add_bond", [](int i, int j) -> int {
+            UNIVERSE_CHECK();
+            return universe_engine_check(engine_bond_add(&_Engine, i, j), "add_bond");
+        }
+    );
+
+    u.def_static("add_angle", [](int i, int j, int k, py::object pot) -> int {
+            UNIVERSE_CHECK();
+            int pid = universe_bonded_pot(pot, _Engine.p_angle, _Engine.nr_anglepots,
+                    engine_angle_addpot, "add_angle");
+            return universe_engine_check(engine_angle_add(&_Engine, i, j, k, pid), "add_angle");
+        }
+    );
+
+    u.def_static("add_dihedral", [](int i, int j, int k, int l, py::object pot) -> int {
+            UNIVERSE_CHECK();
+            int pid = universe_bonded_pot(pot, _Engine.p_dihedral, _Engine.nr_dihedralpots,
+                    engine_dihedral_addpot, "add_dihedral");
+            return universe_engine_check(engine_dihedral_add(&_Engine, i, j, k, l, pid), "add_dihedral");
+        }
+    );
+
+    universe_bind_bonded(u, "exclusion", engine_bonded_exclusion);
+    universe_bind_bonded(u, "bond", engine_bonded_bond);
+    universe_bind_bonded(u, "angle", engine_bonded_angle);
+    universe_bind_bonded(u, "dihedral", engine_bonded_dihedral);
+
 
 
     py::class_<MxUniverseConfig> uc(u, "Config");
@@ -369,11 +483,16 @@ CAPI_FUNC(HRESULT) MxUniverse_Init(const MxUniverseConfig &conf) {
     double origin[3] = {conf.origin[0], conf.origin[1], conf.origin[2]};
     double dim[3] = {conf.dim[0], conf.dim[1], conf.dim[2]};
     double L[3] = {conf.dim[0] / conf.spaceGridSize[0], conf.dim[1] / conf.spaceGridSize[1], conf.dim[2] / conf.spaceGridSize[2]};
+    uint32_t flags = conf.flags;
 
-
+    // let the engine pick the grid, starting from cells of the cutoff size
+    if(conf.spaceGridSize.min() <= 0) {
+        L[0] = L[1] = L[2] = conf.cutoff;
+        flags |= engine_flag_autogrid;
+    }
 
     int er = engine_init ( &_Engine , origin , dim , L ,
-            conf.cutoff, space_periodic_full , conf.maxTypes , conf.flags );
+            conf.cutoff, space_periodic_full , conf.maxTypes , flags );
 
     return S_OK;
 }
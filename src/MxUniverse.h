@@ -54,6 +54,8 @@ struct CAPI_EXPORT MxUniverse  {
 struct CAPI_EXPORT MxUniverseConfig {
     Magnum::Vector3 origin;
     Magnum::Vector3 dim;
+    /** Number of cells in each dimension, any of them <= 0 to let the
+        engine pick the grid from the potentials, see engine_autogrid. */
     Magnum::Vector3i spaceGridSize;
     Magnum::Vector3ui boundaryConditions;
     double cutoff;
@@ -0,0 +1,111 @@
+/*
+ * MxExpr.h
+ *
+ * Small arithmetic expressions, used to define forces and potentials
+ * from Python without going through the interpreter at run time.
+ */
+
+#ifndef SRC_MDCORE_SRC_MXEXPR_H_
+#define SRC_MDCORE_SRC_MXEXPR_H_
+
+#include "platform.h"
+#include "fptype.h"
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/** Number of values evaluated at once by MxExpr::eval_span. */
+#define MXEXPR_CHUNK 32
+
+/**
+ * A set of expressions over a fixed list of variables.
+ *
+ * The expressions are parsed from strings such as "-k * (x - x0)" into a
+ * single DAG in which every node is also an instruction of a straight-line
+ * program: the children of a node always come before it, identical
+ * sub-expressions are shared and constant sub-expressions are folded.
+ * Evaluating a node thus means running the program up to that node, which
+ * MxExpr::eval_span does one instruction at a time over a whole chunk of
+ * values, so that each instruction is a simple, vectorizable loop.
+ *
+ * Supported are numbers, the variables and named constants, the binary
+ * operators + - * / and ^ (or **), unary minus, and the functions exp,
+ * log, sqrt, sin, cos, tanh, abs and pow. Parsing errors throw
+ * std::invalid_argument.
+ */
+class MxExpr {
+public:
+
+    /** The instructions. */
+    enum {
+        op_const = 0,
+        op_var,
+        op_add,
+        op_sub,
+        op_mul,
+        op_div,
+        op_neg,
+        op_pow,
+        op_exp,
+        op_log,
+        op_sqrt,
+        op_sin,
+        op_cos,
+        op_tanh,
+        op_abs,
+    };
+
+    /**
+     * @param vars the names of the variables, in the order in which their
+     *      values are passed to #eval and #eval_span.
+     * @param consts named constants, substituted when parsing.
+     */
+    MxExpr(const std::vector<std::string> &vars,
+           const std::map<std::string, double> &consts = std::map<std::string, double>());
+
+    /** parse an expression, returns its node. */
+    int parse(const std::string &src);
+
+    /** the derivative of a node with respect to the variable @c var, as a new node. */
+    int derivative(int node, int var);
+
+    /** evaluate a node for one set of variable values. */
+    double eval(int node, const double *vals) const;
+
+    /**
+     * add the values of @c nr_nodes nodes, for @c n sets of variables, to
+     * @c out[k][i*out_stride]. The i-th value of variable @c v is read
+     * from @c in[v][i*in_stride[v]], a stride of zero gives a constant.
+     */
+    void eval_span(int n, const int *nodes, int nr_nodes,
+                   const FPTYPE *const *in, const int *in_stride,
+                   FPTYPE *const *out, int out_stride) const;
+
+    /** number of instructions needed to evaluate the given node. */
+    int size(int node) const { return node + 1; }
+
+private:
+
+    struct node {
+        int op, a, b;
+        double value;
+    };
+
+    std::vector<node> nodes;
+    std::vector<std::string> vars;
+    std::map<std::string, double> consts;
+    std::map<std::tuple<int, int, int, double>, int> index;
+
+    int add(int op, int a = -1, int b = -1, double value = 0.0);
+    int derivative(int node, int var, std::map<int, int> &done);
+    int derivative_of(const node &nd, int n, int da, int db, int var);
+    int constant(double value) { return add(op_const, -1, -1, value); }
+    static double apply(int op, double a, double b);
+
+    /* the recursive-descent parser. */
+    struct parser;
+};
+
+#endif /* SRC_MDCORE_SRC_MXEXPR_H_ */
@@ -25,10 +25,29 @@ enum MXFORCE_KIND {
  */
 typedef void (*MxForce_OneBodyPtr)(struct MxForce*, struct MxParticle *, FPTYPE*f);
 
+/**
+ * batched single body force function, applied to @c count particles of the
+ * same type at once. The absolute positions, velocities and forces are packed
+ * as three consecutive values per particle, the force is added to @c f.
+ */
+typedef void (*MxForce_OneBodySpanPtr)(struct MxForce*, struct MxParticleType *type,
+        int count, const FPTYPE *x, const FPTYPE *v, FPTYPE *f);
+
+/**
+ * releases the resources of a force, called before its memory is freed.
+ */
+typedef void (*MxForce_DeallocPtr)(struct MxForce*);
+
 
 struct MxForce : PyObject
 {
     MxForce_OneBodyPtr func;
+    
+    /** optional batched version of func, used instead of it if set. */
+    MxForce_OneBodySpanPtr span;
+
+    /** optional, releases whatever the force owns when it is deallocated. */
+    MxForce_DeallocPtr dealloc;
 };
 
 #endif /* SRC_MDCORE_SRC_MXFORCE_H_ */
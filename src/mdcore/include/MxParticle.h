@@ -36,6 +36,7 @@
 #define PARTICLE_FLAG_NONE              0
 #define PARTICLE_FLAG_FROZEN            1
 #define PARTICLE_FLAG_GHOST             2
+#define PARTICLE_FLAG_EXCLUDED          4
 
 
 /* default values */
@@ -123,6 +124,9 @@ struct MxParticleType : PyHeapTypeObject {
      */
     double kinetic_energy;
     
+    /** total momentum of the particles of this type, also updated each time step. */
+    double momentum[3];
+    
     double potential_energy;
     
     double target_energy;
@@ -44,6 +44,18 @@ MDCORE_BEGIN_DECLS
 #define potential_align                     64
 #define potential_ivalsmax                  320
 
+/* the on-disk table cache, bump the version if the table format changes */
+#define potential_cache_env                 "MX_POTENTIAL_CACHE"
+#define potential_cache_magic               "mxpotab"
+#define potential_cache_version             1
+#define potential_cache_keylen              512
+
+/* fit tables with at least this many intervals on several threads */
+#define potential_parallel_min              32
+
+/* the most parameters of a table queued in a batch */
+#define potential_batch_maxparams           8
+
 #define potential_escale                    (0.079577471545947667882)
 // #define potential_escale                    1.0
 
@@ -82,6 +94,17 @@ MDCORE_BEGIN_DECLS
 /** potential defined for switch */
 #define potential_flag_switch                1 << 8
 
+/** potential table is queued in a batch and not fitted yet */
+#define potential_flag_pending               1 << 9
+
+
+/* potential kinds, i.e. the closed forms the pair kernels can evaluate
+   directly instead of interpolating the table. */
+#define potential_kind_table                 0
+#define potential_kind_LJ126                 1
+#define potential_kind_Coulomb               2
+#define potential_kind_harmonic              3
+
 
 /** ID of the last error. */
 CAPI_DATA(int) potential_err;
@@ -105,6 +128,16 @@ typedef struct MxPotential : PyObject {
 	/** Nr of intervals. */
 	int n;
 
+	/** Closed form of this potential, or #potential_kind_table. */
+	int kind;
+
+	/**
+	 * Parameters of the closed form, see #potential_closed. The last one
+	 * is the smallest radius @c a, below which the potential is extended
+	 * quadratically, like the first interval of the table.
+	 */
+	FPTYPE params[4];
+
 } MxPotential;
 
 
@@ -118,6 +151,16 @@ CAPI_FUNC(int) potential_init ( struct MxPotential *p , double (*f)( double ) ,
 							   double (*fp)( double ) , double (*f6p)( double ) ,
 							   FPTYPE a , FPTYPE b , FPTYPE tol );
 
+CAPI_FUNC(int) potential_init_cached ( struct MxPotential *p , const char *name ,
+									  const double *params , int nr_params ,
+									  void (*set)( const double *params , double a , double b ) ,
+									  double (*f)( double ) , double (*fp)( double ) ,
+									  double (*f6p)( double ) , FPTYPE a , FPTYPE b , FPTYPE tol );
+
+CAPI_FUNC(int) potential_batch_begin ( void );
+CAPI_FUNC(int) potential_batch_end ( void );
+CAPI_FUNC(int) potential_build ( struct MxPotential *p );
+
 CAPI_FUNC(int) potential_getcoeffs ( double (*f)( double ) , double (*fp)( double ) ,
 									 FPTYPE *xi , int n , FPTYPE *c , FPTYPE *err );
 
@@ -153,6 +196,8 @@ CAPI_FUNC(struct MxPotential *) potential_create_harmonic_angle ( double a , dou
 																  double tol );
 CAPI_FUNC(struct MxPotential *) potential_create_harmonic_dihedral ( double K , int n ,
 																	 double delta , double tol );
+CAPI_FUNC(struct MxPotential *) potential_create_expression ( class MxExpr *expr , int node ,
+															 double a , double b , double tol );
 
 /* These functions are now all in potential_eval.h. */
 /*
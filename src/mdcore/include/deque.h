@@ -0,0 +1,76 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ * Coypright (c) 2017 Andy Somogyi (somogyie at indiana dot edu)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef INCLUDE_MDCORE_DEQUE_H_
+#define INCLUDE_MDCORE_DEQUE_H_
+#include "platform.h"
+
+MDCORE_BEGIN_DECLS
+
+/* deque error codes */
+#define deque_err_ok                    0
+#define deque_err_null                  -1
+#define deque_err_malloc                -2
+#define deque_err_full                  -3
+
+/* Some constants. */
+#define deque_cacheline                 64
+
+
+/** ID of the last error */
+CAPI_DATA(int) deque_err;
+
+
+/**
+ * The work-stealing deque structure.
+ *
+ * A Chase-Lev deque of #task pointers: the owning #runner pushes and
+ * pops at the bottom, any other #runner may steal from the top. The
+ * buffer is not grown, it has to be large enough to hold every task
+ * that can be in flight at once.
+ */
+typedef struct deque {
+
+	/* Index of the oldest entry, advanced by thieves. */
+	volatile long top;
+	char pad_top[ deque_cacheline - sizeof(long) ];
+
+	/* Index past the newest entry, only written by the owner. */
+	volatile long bottom;
+	char pad_bottom[ deque_cacheline - sizeof(long) ];
+
+	/* The circular buffer of tasks. */
+	struct task **tasks;
+
+	/* Size of the buffer minus one, the size is a power of two. */
+	long mask;
+
+} deque;
+
+
+/* Associated functions */
+int deque_init ( struct deque *d , int size );
+void deque_reset ( struct deque *d );
+void deque_free ( struct deque *d );
+int deque_push ( struct deque *d , struct task *t );
+struct task *deque_pop ( struct deque *d );
+struct task *deque_steal ( struct deque *d );
+
+MDCORE_END_DECLS
+#endif // INCLUDE_MDCORE_DEQUE_H_
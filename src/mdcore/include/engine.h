@@ -26,6 +26,11 @@
 #include "space.h"
 #include "cycle.h"
 
+/* MPI headers. */
+#ifdef WITH_MPI
+    #include <mpi.h>
+#endif
+
 
 /* engine error codes */
 #define engine_err_ok                    0
@@ -57,6 +62,7 @@
 #define engine_err_rigid                 -26
 #define engine_err_cutoff		 		 -27
 #define engine_err_nometis				 -28
+#define engine_err_spme                  -29
 
 
 /* some constants */
@@ -78,6 +84,17 @@
 #define engine_flag_sets                 16384
 #define engine_flag_nullpart             32768
 #define engine_flag_initialized          65536
+#define engine_flag_soa                  131072
+#define engine_flag_simd                 262144
+#define engine_flag_fused                524288
+#define engine_flag_verlet_list          1048576
+#define engine_flag_cluster              2097152
+#define engine_flag_nolock               4194304
+#define engine_flag_morton               8388608
+#define engine_flag_hilbert              16777216
+#define engine_flag_numa                 33554432
+#define engine_flag_autogrid             67108864
+#define engine_flag_balance              134217728
 
 #define engine_bonds_chunk               100
 #define engine_angles_chunk              100
@@ -88,13 +105,33 @@
 #define engine_maxgpu                    10
 #define engine_pshake_steps              20
 #define engine_maxKcutoff                2
+#define engine_autogrid_nrfactors        6
+#define engine_autogrid_nrprobe          3
+#define engine_autogrid_steps            2
+#define engine_autogrid_taskcost         64.0
+#define engine_autogrid_minload          2
+#define engine_balance_steps             100
+#define engine_balance_tol               1.1
+#define engine_balance_maxmoves          64
 
 #define engine_split_MPI		1
 #define engine_split_GPU		2
 
+#define engine_barrier_spin              4000
 #define engine_bonded_maxnrthreads       16
 #define engine_bonded_nrthreads          ((omp_get_num_threads()<engine_bonded_maxnrthreads)?omp_get_num_threads():engine_bonded_maxnrthreads)
 
+/** Kinds of bonded interactions, in the order in which
+    #engine_bonded_sort keeps their state. */
+enum {
+	engine_bonded_exclusion = 0,
+	engine_bonded_bond,
+	engine_bonded_angle,
+	engine_bonded_dihedral,
+	engine_bonded_last
+};
+
+
 /** Timmer IDs. */
 enum {
 	engine_timer_step = 0,
@@ -115,6 +152,7 @@ enum {
 	engine_timer_cuda_load,
 	engine_timer_cuda_unload,
 	engine_timer_cuda_dopairs,
+	engine_timer_overhead,
 	engine_timer_last
 };
 
@@ -148,6 +186,14 @@ typedef struct engine {
 
 	double temperature;
 
+	/** Kinetic energy, momentum, mass and number of all particles, as
+	    of the last call to #engine_kinetic_energy. */
+	double ekin, momentum[3], ekin_mass;
+	long ekin_count;
+
+	/** Step in which the runners last summed up the kinetic energy. */
+	long sums_time;
+
 	/** TODO, clean up this design for types and static engine. */
 	/** What is the maximum nr of types? */
 	static int max_type;
@@ -159,20 +205,32 @@ typedef struct engine {
 	/** The interaction matrix */
 	struct MxPotential **p, **p_bond, **p_angle, **p_dihedral;
 
+	/** The closed form shared by all the potentials in @c p, or
+	    #potential_kind_table, used to pick the pair kernels. */
+	int pot_kind;
+
 	/** The explicit electrostatic potential. */
 	struct MxPotential *ep;
 
+	/** The reciprocal-space part of the electrostatics, @c NULL if
+	    there is none, see #engine_spme_set. Uses the charge @c q of
+	    each particle. Only runs on a single node: #engine_spme_set
+	    refuses engines with #engine_flag_mpi or #engine_flag_cuda. */
+	struct spme *spme;
+
 	/**
 	 * vector of single body potentials for types, indexed
 	 * by type id.
 	 */
 	struct MxForce **p_singlebody;
 
-	/** Mutexes, conditions and counters for the barrier */
-	pthread_mutex_t barrier_mutex;
-	pthread_cond_t barrier_cond;
-	pthread_cond_t done_cond;
-	int barrier_count;
+	/** Counters for the spin-then-park barrier: the generation is bumped
+	    by the engine to release the runners, which then check back in. */
+	volatile int barrier_gen, barrier_in, barrier_parked;
+
+	/** The phase the runners execute once released, @c NULL to stop. */
+	int (*phase_fun)( struct runner *r , void *data );
+	void *phase_data;
 
 	/** Nr of runners */
 	int nr_runners;
@@ -180,10 +238,28 @@ typedef struct engine {
 	/** The runners */
 	struct runner *runners;
 
-	/** The queues for the runners. */
+	/** Number of CPU sockets the runners are spread over, see
+	    #engine_flag_numa. */
+	int nr_sockets;
+
+	/** Set when a new potential changes the cutoff, so that the next
+	    step picks a new cell grid, see #engine_flag_autogrid. */
+	int autogrid_pending;
+
+	/** The queues for the runners (unused since the runners steal work
+	    from each other's #deque). */
 	struct queue *queues;
 	int nr_queues;
 
+	/** Number of tasks not yet completed in the current step. */
+	volatile int tasks_left;
+
+	/** Tasks on ghost cells held back while an asynchronous exchange is
+	    in flight, and whether it is done, see #engine_nonbond_eval. */
+	struct task **halo_tasks;
+	int nr_halo, halo_size;
+	volatile int halo_ready;
+
 	/** The ID of the computational node we are on. */
 	int nodeID;
 	int nr_nodes;
@@ -191,6 +267,17 @@ typedef struct engine {
 	/** Lists of cells to exchange with other nodes. */
 	struct engine_comm *send, *recv;
 
+	/** Re-partition the cells over the nodes every @c balance_steps steps
+	    if the most loaded node has more than @c balance_tol times the mean
+	    load, see #engine_flag_balance. */
+	int balance_steps;
+	double balance_tol;
+
+	/** Measured load of each node and the ratio of the largest to the mean
+	    at the last check, and the number of cells moved then. */
+	double *balance_load, balance_imbalance;
+	int balance_moved;
+
 	/** List of bonds. */
 	struct bond *bonds;
 
@@ -227,6 +314,46 @@ typedef struct engine {
 	/** Nr. of dihedrals. */
 	int nr_dihedrals, dihedrals_size, nr_dihedralpots, dihedralpots_size;
 
+	/** Rank of each cell along a Morton curve and the cell grid it was
+	    computed for, by which the bonded interactions are sorted. */
+	int *bonded_rank, bonded_cdim[3];
+
+	/** Rank of the cell of the first particle of each bonded interaction
+	    of each kind at the last sort, the number of them that were
+	    sorted, and the number of them with all their particles on this
+	    node, which come first (see #engine_bonded_sort). */
+	int *bonded_keys[ engine_bonded_last ], bonded_keys_size[ engine_bonded_last ];
+	int bonded_nr_sorted[ engine_bonded_last ], bonded_nr_local[ engine_bonded_last ];
+
+	/** Zero if bonded interactions were added or removed since the last
+	    sort, and zero if the runners' shares have not been cut since. */
+	int bonded_sorted, bonded_split;
+
+	/** Runner owning each cell for the bonded interactions, and the
+	    first interaction of each kind in the share of each runner. */
+	int *bonded_owner, *bonded_first[ engine_bonded_last ];
+
+	/** The bonded interactions each runner shares with others. */
+	struct engine_bonded_share *bonded_shares;
+	int bonded_nr_shares;
+
+	/** Which batched bonded kernels to use, see #runner_simd_detect. */
+	int bonded_simd;
+
+	/** Handles of the bonded interactions of each kind: the position in
+	    its list of each handle, or the next free handle as @c -2-next if
+	    it is not in use, and the handle at each position of the list
+	    (see #engine_bonded_remove). */
+	int *bonded_pos[ engine_bonded_last ], *bonded_hid[ engine_bonded_last ];
+	int bonded_nr_handles[ engine_bonded_last ], bonded_handles_size[ engine_bonded_last ];
+	int bonded_free[ engine_bonded_last ];
+
+	/** The interactions of each kind that each particle is part of, as
+	    doubly linked lists through the links @c 4*handle+j of the @c j-th
+	    particle of each interaction (see #engine_bonded_adjacent). */
+	int *bonded_head[ engine_bonded_last ], bonded_head_size[ engine_bonded_last ];
+	int *bonded_next[ engine_bonded_last ], *bonded_prev[ engine_bonded_last ];
+
 	/** The Comm object for mpi. */
 #ifdef WITH_MPI
 	MPI_Comm comm;
@@ -290,6 +417,24 @@ typedef struct engine_set {
 } engine_set;
 
 
+/**
+ * The bonded interactions of a #runner that reach into the cells of
+ * other runners, see #engine_bonded_eval.
+ */
+typedef struct engine_bonded_share {
+
+	/** The interactions of each kind, their number and room for them. */
+	void *edge[ engine_bonded_last ];
+	int nr_edge[ engine_bonded_last ], edge_size[ engine_bonded_last ];
+
+	/** Their forces, indexed by particle ID and zero between steps, and
+	    the size of the buffer. */
+	FPTYPE *eff;
+	int eff_size;
+
+} engine_bonded_share;
+
+
 /**
  * Structure storing which cells to send/receive to/from another node.
  */
@@ -311,12 +456,18 @@ CAPI_FUNC(int) engine_angle_addpot ( struct engine *e , struct MxPotential *p );
 CAPI_FUNC(int) engine_angle_add ( struct engine *e , int i , int j , int k , int pid );
 CAPI_FUNC(int) engine_angle_eval ( struct engine *e );
 CAPI_FUNC(int) engine_barrier ( struct engine *e );
+CAPI_FUNC(int) engine_phase_run ( struct engine *e , int (*fun)( struct runner *r , void *data ) , void *data );
+CAPI_FUNC(int) engine_reduce_phase ( struct runner *r , void *data );
 CAPI_FUNC(int) engine_bond_addpot ( struct engine *e , struct MxPotential *p , int i , int j );
 CAPI_FUNC(int) engine_bond_add ( struct engine *e , int i , int j );
 CAPI_FUNC(int) engine_bond_eval ( struct engine *e );
+CAPI_FUNC(int) engine_bonded_adjacent ( struct engine *e , int kind , int pid , int *hids , int size );
 CAPI_FUNC(int) engine_bonded_eval ( struct engine *e );
 CAPI_FUNC(int) engine_bonded_eval_sets ( struct engine *e );
 CAPI_FUNC(int) engine_bonded_sets ( struct engine *e , int max_sets );
+CAPI_FUNC(int) engine_bonded_lookup ( struct engine *e , int kind , int hid );
+CAPI_FUNC(int) engine_bonded_remove ( struct engine *e , int kind , int hid );
+CAPI_FUNC(int) engine_bonded_sort ( struct engine *e );
 CAPI_FUNC(int) engine_dihedral_add ( struct engine *e , int i , int j , int k , int l , int pid );
 CAPI_FUNC(int) engine_dihedral_addpot ( struct engine *e , struct MxPotential *p );
 CAPI_FUNC(int) engine_dihedral_eval ( struct engine *e );
@@ -435,6 +586,9 @@ CAPI_FUNC(int) engine_setexplepot ( struct engine *e , struct MxPotential *ep );
 CAPI_FUNC(int) engine_shuffle ( struct engine *e );
 CAPI_FUNC(int) engine_split_bisect ( struct engine *e , int N );
 CAPI_FUNC(int) engine_split ( struct engine *e );
+CAPI_FUNC(int) engine_balance ( struct engine *e );
+CAPI_FUNC(int) engine_balance_set ( struct engine *e , int nr_steps , double tol );
+CAPI_FUNC(int) engine_balance_stats ( struct engine *e , double *imbalance , double *loads , int *nr_moved );
 
 CAPI_FUNC(int) engine_start ( struct engine *e , int nr_runners , int nr_queues );
 CAPI_FUNC(int) engine_step ( struct engine *e );
@@ -446,6 +600,14 @@ CAPI_FUNC(int) engine_unload_strays ( struct engine *e , double *x , double *v ,
 CAPI_FUNC(int) engine_unload ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid ,
 		double *charge , unsigned int *flags , double *epot , int N );
 CAPI_FUNC(int) engine_verlet_update ( struct engine *e );
+CAPI_FUNC(int) engine_verlet_setskin ( struct engine *e , double skin );
+CAPI_FUNC(int) engine_verlet_stats ( struct engine *e , int *nr_rebuilds , int *age , double *maxdx , long *nr_entries );
+CAPI_FUNC(int) engine_cluster_setsize ( struct engine *e , int size );
+CAPI_FUNC(int) engine_regrid ( struct engine *e , double *L , double cutoff );
+CAPI_FUNC(int) engine_autogrid ( struct engine *e , int nr_steps );
+CAPI_FUNC(int) engine_numa_stats ( struct engine *e , int *nr_sockets , double *local , double *remote );
+CAPI_FUNC(int) engine_spme_set ( struct engine *e , double kappa , int *dim , int order );
+CAPI_FUNC(int) engine_spme_eval ( struct engine *e );
 
 
 CAPI_FUNC(void) engine_dump();
@@ -23,6 +23,7 @@
 
 #include "platform.h"
 #include "cycle.h"
+#include "deque.h"
 
 /* runner error codes */
 #define runner_err_ok                    0
@@ -37,6 +38,8 @@
 #define runner_err_fifo                  -9
 #define runner_err_verlet_overflow       -10
 #define runner_err_tasktype              -11
+#define runner_err_deque                 -12
+#define runner_err_verlet_stale          -13
 
 
 /* some constants */
@@ -53,6 +56,40 @@
 #define runner_dispatch_stop             0xffffffff
 #define runner_dispatch_lookahead        20
 
+/** Number of per-runner scratch values for reductions. */
+#define runner_nracc                     4
+
+/** Entries of the per-type sums of the advance pass, see runner::sums. */
+enum {
+	runner_sum_ekin = 0,
+	runner_sum_px,
+	runner_sum_py,
+	runner_sum_pz,
+	runner_sum_count,
+	runner_nrsums
+};
+
+/** Number of failed attempts to get a task before yielding the CPU. */
+#define runner_yieldafter                64
+
+/** Maximum number of tasks a runner holds back on cell conflicts. */
+#define runner_maxdeferred               8
+
+/** Initial number of particles in each outgoing buffer of a runner. */
+#define runner_outbuf_size               16
+
+
+/** Pair kernel flavours, see #runner_simd_detect. */
+#define runner_simd_none                 0
+#define runner_simd_avx2                 1
+#define runner_simd_avx512               2
+
+/* Are the AVX2/AVX-512 pair kernels compiled in? They are built with
+   per-function target attributes and selected at runtime. */
+#if defined(__x86_64__) && defined(__GNUC__) && defined(FPTYPE_SINGLE)
+    #define RUNNER_SIMD
+#endif
+
 
 /** Timers. */
 enum {
@@ -60,6 +97,9 @@ enum {
 	runner_timer_pair,
 	runner_timer_self,
 	runner_timer_sort,
+	runner_timer_singlebody,
+	runner_timer_integrate,
+	runner_timer_spme,
 	runner_timer_count
 };
 CAPI_DATA(ticks) runner_timers[];
@@ -115,6 +155,20 @@ typedef struct runner_fifo {
 
 
 
+/** Particles leaving the cells of a #runner for cells welcomed by
+    another one, see #runner_migrate. */
+typedef struct runner_outbuf {
+
+	/** The particles and the ids of their new cells. */
+	struct MxParticle *parts;
+	int *cid;
+
+	/** Number of particles and room for them. */
+	int count, size;
+
+} runner_outbuf;
+
+
 /* the runner structure */
 typedef struct runner {
 
@@ -133,23 +187,100 @@ typedef struct runner {
 	/** Accumulated potential energy by this runner. */
 	double epot;
 
+	/** Which pair kernels to use, see #runner_simd_detect. */
+	int simd;
+
+	/** This runner's work-stealing task deque. */
+	struct deque dq;
+
+	/** Tasks taken but blocked by a cell conflict, retried first. */
+	struct task *deferred[ runner_maxdeferred ];
+	int nr_deferred;
+
+	/** Seed for picking whom to steal from. */
+	unsigned int seed;
+
+	/** Time spent in the last phase run by this runner. */
+	ticks phase_ticks;
+
+	/** Return code of the last phase run by this runner, checked by
+	    #engine_phase_run. */
+	int phase_err;
+
+	/** Scratch values reduced by the engine after a phase. */
+	double acc[ runner_nracc ];
+
+	/** Private force buffer, indexed by particle ID, and its size. */
+	FPTYPE *eff;
+	int eff_size;
+
+	/** Per particle type, @c runner_nrsums sums of m|v|^2, m v and the
+	    number of particles the runner advanced in the last step. */
+	double *sums;
+
+	/** CPU this runner is pinned to and the index of its socket, see
+	    #engine_flag_numa. */
+	int cpu, socket;
+
+	/** The runners on the same socket, @c socket_count of them starting
+	    at @c socket_first. */
+	int socket_first, socket_count;
+
+	/** Number of particles this runner read in tasks on cells owned by a
+	    runner on its own or on another socket. */
+	long long numa_local, numa_remote;
+
+	/** Outgoing particles, one buffer for each runner welcoming them. */
+	struct runner_outbuf *out;
+
 } runner;
 
 
+/** The force buffer the pair kernels of the #runner @c r write to, or
+    @c NULL if they write to the particles directly, see
+    #engine_flag_nolock. */
+#define runner_fbuf(r)                  ( ( (r)->e->flags & engine_flag_nolock ) ? (r)->eff : NULL )
+
+/** Where the force on the particle @c p goes, given the force buffer
+    @c eff from #runner_fbuf. */
+#define runner_pf(eff,p)                ( ( (eff) != NULL ) ? &(eff)[ 4*(p)->id ] : (p)->f )
+
+/** Where the potential energy of the cell @c c goes, given the force
+    buffer @c eff from #runner_fbuf. */
+#define runner_epot(r,eff,c)            ( *( ( (eff) != NULL ) ? &(r)->epot : &(c)->epot ) )
+
+
 /* associated functions */
 int runner_dopair_unsorted ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j );
 
 int runner_init ( struct runner *r , struct engine *e , int id );
 int runner_run ( struct runner *r );
+int runner_dotasks ( struct runner *r , void *data );
 void runner_sort_ascending ( unsigned int *parts , int N );
 void runner_sort_descending ( unsigned int *parts , int N );
 int runner_verlet_eval ( struct runner *r , struct space_cell *c , FPTYPE *f_out );
-int runner_verlet_fill ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , FPTYPE *pshift );
+int runner_verlet_build ( struct runner *r , struct space_cell *c );
+int runner_verlet_cells ( struct space *s , struct space_cell *c , struct space_cell **cells , FPTYPE *shift );
+int runner_cluster_pack ( struct runner *r , struct space_cell *c );
+int runner_cluster_build ( struct runner *r , struct space_cell *c );
+int runner_docluster ( struct runner *r , struct space_cell *c , FPTYPE *f_out );
 int runner_dosort ( struct runner *r , struct space_cell *c , int flags );
+int runner_dosinglebody ( struct runner *r , struct space_cell *c );
+int runner_dointegrate ( struct runner *r , struct space_cell *c );
+int runner_dospme ( struct runner *r , struct task *t );
+int runner_migrate ( struct runner *r , struct space_cell *c_dest , struct MxParticle *p );
+int runner_welcome ( struct runner *r );
 int runner_dopair ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid );
 int runner_doself ( struct runner *r , struct space_cell *cell_i );
-int runner_verlet_eval ( struct runner *r , struct space_cell *c , FPTYPE *f_out );
-int runner_verlet_fill ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , FPTYPE *pshift );
+int runner_dopair_soa ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid );
+int runner_simd_detect ( void );
+#ifdef RUNNER_SIMD
+int runner_dopair_avx2 ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid );
+int runner_doself_avx2 ( struct runner *r , struct space_cell *cell_i );
+int runner_dopair_avx512 ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid );
+int runner_doself_avx512 ( struct runner *r , struct space_cell *cell_i );
+#endif
+int runner_doself_soa ( struct runner *r , struct space_cell *cell_i );
 
 MDCORE_END_DECLS
 
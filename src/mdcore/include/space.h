@@ -53,8 +53,35 @@ MDCORE_BEGIN_DECLS
 /** Maximum number of cells per tuple. */
 #define space_maxtuples                 4
 
-/** Maximum number of interactions per particle in the Verlet list. */
-#define space_verlet_maxpairs           800
+/** Maximum number of cells paired with a cell in the neighbour lists. */
+#define space_verlet_maxcells           27
+
+/** Growth factor of the per-cell neighbour lists. */
+#define space_verlet_grow               1.25
+
+/** Number of bits of a neighbour list entry holding the particle index. */
+#define space_verlet_pidbits            16
+
+/** Largest number of particles per cluster, see #engine_flag_cluster. */
+#define space_cluster_maxsize           8
+
+/** Space-filling curves along which cells, tasks and particles can be
+    ordered, see #space_sfc_order. */
+enum {
+    space_sfc_none = 0,
+    space_sfc_morton,
+    space_sfc_hilbert
+};
+
+/** Number of bits per dimension of the particle keys within a cell. */
+#define space_sfc_partbits              5
+
+/** Largest number of bits per dimension of a curve key. */
+#define space_sfc_maxbits               10
+
+/** Number of time steps between re-sorting the particles of each cell
+    along the curve when the cells are shuffled every step. */
+#define space_sfc_resort                20
 
 
 /* some useful macros */
@@ -62,26 +89,16 @@ MDCORE_BEGIN_DECLS
     #space @c s. */
 #define space_cellid(s,i,j,k)           (  ((i)*(s)->cdim[1] + (j)) * (s)->cdim[2] + (k) )
 
+/** Pack the index @c k of a cell pair and the index @c pid of a particle
+    in the second cell into a neighbour list entry. */
+#define space_verlet_entry(k,pid)       ( ((unsigned int)(k) << space_verlet_pidbits) | (unsigned int)(pid) )
+
 /** Convert tuple ids into the pairid index. */
 #define space_pairind(i,j)              ( space_maxtuples*(i) - (i)*((i)+1)/2 + (j) )
 
 /** ID of the last error */
 CAPI_DATA(int)space_err;
 
-/** Struct for Verlet list entries. */
-struct verlet_entry {
-
-    /** The particle. */
-    struct MxParticle *p;
-
-    /** The interaction potential. */
-    struct MxPotential *pot;
-
-    /** The integer shift relative to this particle. */
-    signed char shift[3];
-
-};
-
 /** Struct for each cellpair (see #space_getpair). */
 struct cellpair {
 
@@ -170,7 +187,7 @@ typedef struct space {
     char *cells_taboo;
 
     /** Id of #runner owning each cell. */
-    char *cells_owner;
+    int *cells_owner;
 
     /** Counter for the number of swaps in every step. */
     int nr_swaps, nr_stalls;
@@ -187,18 +204,41 @@ typedef struct space {
     /** Trigger re-building the cells/sorts. */
     int verlet_rebuild;
 
+    /** Set whenever a particle changes its cell or leaves or enters the
+        space, cleared by #engine_bonded_sort. */
+    int parts_moved;
+
     /** The maximum particle displacement over all cells. */
     FPTYPE maxdx;
 
     /** Potential energy collected by the space itself. */
     double epot, epot_nonbond, epot_bond, epot_angle, epot_dihedral, epot_exclusion;
 
-    /** Data for the verlet list. */
-    struct verlet_entry *verlet_list;
-    FPTYPE *verlet_oldx, verlet_maxdx;
-    int *verlet_nrpairs;
-    int verlet_size, verlet_next;
-    pthread_mutex_t verlet_force_mutex;
+    /** Skin added to the cutoff when building the neighbour lists,
+        at most the cell edge length minus the cutoff. */
+    FPTYPE verlet_skin;
+
+    /** The cells each cell is paired with in the neighbour lists, the
+        cell itself first: the pairs of cell @c cid are
+        @c verlet_cellpairs[ verlet_celloffset[cid] ] up to, but not
+        including, @c verlet_cellpairs[ verlet_celloffset[cid+1] ]. */
+    int *verlet_celloffset, *verlet_cellpairs;
+
+    /** Number of particles per cluster in the cluster-pair lists,
+        either 4 or 8. */
+    int verlet_clustersize;
+
+    /** Number of neighbour list rebuilds and of steps since the last one. */
+    int verlet_nr_rebuilds, verlet_age;
+
+    /** Space-filling curve along which the cell lists, the tasks and the
+        particles in each cell are ordered, or #space_sfc_none. */
+    int sfc;
+
+    /** Set if the positions, velocities and forces of the particles are
+        stored in the structure-of-arrays buffers of the cells, see
+        #space_soa_init. */
+    int soa;
 
 
 
@@ -239,6 +279,9 @@ CAPI_FUNC(int) space_init ( struct space *s , const double *origin ,
                            const double *dim , double *L ,
                            double cutoff , unsigned int period );
 
+CAPI_FUNC(int) space_maketasks ( struct space *s );
+CAPI_FUNC(int) space_regrid ( struct space *s , double *L , double cutoff );
+
 CAPI_FUNC(int) space_getsid ( struct space *s , struct space_cell **ci ,
                              struct space_cell **cj , FPTYPE *shift );
 
@@ -271,18 +314,31 @@ CAPI_FUNC(int) space_addpart ( struct space *s ,  struct MxParticle *p ,
 
 
 CAPI_FUNC(int) space_prepare ( struct space *s );
+CAPI_FUNC(int) space_prepare_tasks ( struct space *s );
+CAPI_FUNC(int) space_addtasks_singlebody ( struct space *s );
+CAPI_FUNC(int) space_addtasks_integrate ( struct space *s );
+CAPI_FUNC(int) space_soa_init ( struct space *s );
+CAPI_FUNC(int) space_soa_pack ( struct space *s );
+CAPI_FUNC(int) space_soa_unpack ( struct space *s );
 CAPI_FUNC(int) space_getpos ( struct space *s , int id , FPTYPE *x );
 CAPI_FUNC(int) space_setpos ( struct space *s , int id , FPTYPE *x );
+CAPI_FUNC(int) space_getvel ( struct space *s , int id , FPTYPE *v );
+CAPI_FUNC(int) space_setvel ( struct space *s , int id , FPTYPE *v );
+CAPI_FUNC(int) space_getforce ( struct space *s , int id , FPTYPE *f );
+CAPI_FUNC(int) space_setforce ( struct space *s , int id , FPTYPE *f );
+CAPI_FUNC(int) space_settype ( struct space *s , int id , int typeId );
 CAPI_FUNC(int) space_flush ( struct space *s );
 CAPI_FUNC(int) space_flush_ghosts ( struct space *s );
 CAPI_FUNC(struct task*) space_addtask ( struct space *s , int type ,
                                        int subtype , int flags , int i , int j );
 
 
-CAPI_FUNC(int) space_verlet_init ( struct space *s , int list_global );
+CAPI_FUNC(int) space_verlet_init ( struct space *s );
+CAPI_FUNC(unsigned int) space_sfc_key ( int curve , int bits , const unsigned int *x );
+CAPI_FUNC(int) space_sfc_order ( struct space *s , int curve );
+CAPI_FUNC(int) space_sfc_sortparts ( struct space *s );
 CAPI_FUNC(int) space_gettuple ( struct space *s , struct celltuple **out , int wait );
 CAPI_FUNC(int) space_getcell ( struct space *s , struct space_cell **out );
-CAPI_FUNC(int) space_verlet_force ( struct space *s , FPTYPE *f , double epot );
 CAPI_FUNC(int) space_releasepair ( struct space *s , int ci , int cj );
 
 MDCORE_END_DECLS
@@ -45,6 +45,7 @@
 #define cell_flag_wait                  2
 #define cell_flag_waited                4
 #define cell_flag_marked                8
+#define cell_flag_soa                   16
 
 
 MDCORE_BEGIN_DECLS
@@ -117,9 +118,52 @@ typedef struct space_cell {
 	/* Sorting task for this cell. */
 	struct task *sort;
 
+	/* Integration task for this cell, only used with engine_flag_fused. */
+	struct task *integrate;
+
 	/*ID of the GPU this cell belongs to. */
 	int GPUID;
 
+	/* Structure-of-arrays storage of the positions, velocities and forces
+	   of the parts, used instead of the x, v and f of the records in
+	   parts if the cell has cell_flag_soa, see engine_flag_soa. The
+	   pid-th entry of each array belongs to parts[pid], e.g. soa_x[1][pid]
+	   is its y-coordinate, and soa_typeId[pid] is a copy of its type.
+	   Each component is a separate, aligned array of soa_size entries.
+	   Records that leave the cell, and those in the incomming buffer,
+	   carry their own x, v and f. */
+	FPTYPE *soa_x[3], *soa_v[3], *soa_f[3];
+	int *soa_typeId;
+	int soa_size;
+
+	/* Neighbour list of the particles in this cell, only used with
+	   engine_flag_verlet_list. The neighbours of the pid-th particle are
+	   nlist[ nlist_offset[pid] ] up to nlist[ nlist_offset[pid+1] - 1 ],
+	   see space_verlet_entry. nlist_count is the particle count at the
+	   time the list was built. */
+	unsigned int *nlist;
+	int *nlist_offset;
+	int nlist_size, nlist_offset_size, nlist_count;
+
+	/* Spatially compact clusters of clu_size particles of this cell, only
+	   used with engine_flag_cluster. The particles of the k-th cluster are
+	   parts[ clu_pid[ k*clu_size + m ] ] for m < clu_size, or -1 for
+	   padding, with their positions in clu_x[ (3*k + d)*clu_size + m ] for
+	   each dimension d and their bounding box, lower corner first, in
+	   clu_bb[ 6*k ] and following. Bit m of clu_excl[k] is set if the
+	   m-th particle has PARTICLE_FLAG_EXCLUDED. The clusters paired with
+	   the k-th one are clu_list[ clu_offset[k] ] up to
+	   clu_list[ clu_offset[k+1] - 1 ],
+	   see space_verlet_entry. clu_nparts is the particle count at the time
+	   the clusters were formed and clu_alloc the number of particles for
+	   which there is room. */
+	FPTYPE *clu_x, *clu_bb;
+	int *clu_pid, *clu_typeId, *clu_excl;
+	int nr_clusters, clu_size, clu_nparts, clu_alloc;
+	unsigned int *clu_list;
+	int *clu_offset;
+	int clu_list_size, clu_offset_size;
+
 } space_cell;
 
 
@@ -139,6 +183,15 @@ typedef struct space_cell {
 int space_cell_init ( struct space_cell *c , int *loc , double *origin ,
         double *dim );
 
+/**
+ * @brief Free all the buffers of a cell.
+ *
+ * @param c The #cell to free.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ */
+int space_cell_free ( struct space_cell *c );
+
 /**
  * @brief Add a particle to a cell.
  *
@@ -219,6 +272,74 @@ int space_cell_load ( struct space_cell *c , struct MxParticle *parts ,
 int space_cell_flush ( struct space_cell *c ,
         struct MxParticle **partlist , struct space_cell **celllist );
 
+/**
+ * @brief Copy the positions, velocities, forces and types of the parts
+ *      of a #cell to its structure-of-arrays buffers.
+ *
+ * @param c The #cell.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ *
+ * The SoA buffers are grown to hold at least @c c->size parts. Used to
+ * switch a cell to #cell_flag_soa, or to take back the changes made to
+ * the records after #space_cell_soa_unpack.
+ */
+int space_cell_soa_pack ( struct space_cell *c );
+
+/**
+ * @brief Copy the positions, velocities and forces in the
+ *      structure-of-arrays buffers of a #cell back to its parts.
+ *
+ * @param c The #cell.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ *
+ * Does nothing unless the cell has #cell_flag_soa.
+ */
+int space_cell_soa_unpack ( struct space_cell *c );
+
+/**
+ * @brief Copy the position, velocity and force of a single part of a
+ *      #cell with #cell_flag_soa from the SoA buffers to its record.
+ *
+ * @param c The #cell.
+ * @param pid The index of the part in @c c->parts.
+ */
+void space_cell_soa_get ( struct space_cell *c , int pid );
+
+/**
+ * @brief Copy the position, velocity, force and type of a single part
+ *      of a #cell with #cell_flag_soa from its record to the SoA buffers.
+ *
+ * @param c The #cell.
+ * @param pid The index of the part in @c c->parts.
+ */
+void space_cell_soa_put ( struct space_cell *c , int pid );
+
+/**
+ * @brief Copy an entry of the SoA buffers of a #cell to another, e.g.
+ *      when the last part fills the place of one that left.
+ *
+ * @param c The #cell.
+ * @param dst The index of the entry to overwrite.
+ * @param src The index of the entry to copy.
+ */
+void space_cell_soa_move ( struct space_cell *c , int dst , int src );
+
+/**
+ * @brief Re-allocate the particle, incomming and sortlist buffers of a
+ *      #cell from the calling thread.
+ *
+ * @param c The #cell.
+ * @param partlist A pointer to the partlist to set the part indices.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ *
+ * Used to place the buffers on the memory node of the #runner owning
+ * the cell, see #engine_flag_numa.
+ */
+int space_cell_rehome ( struct space_cell *c , struct MxParticle **partlist );
+
 MDCORE_END_DECLS
 
 #endif // INCLUDE_SPACE_CELL_H_
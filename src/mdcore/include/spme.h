@@ -2,20 +2,20 @@
  * This file is part of mdcore.
  * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
  * Coypright (c) 2017 Andy Somogyi (somogyie at indiana dot edu)
- * 
+ *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Lesser General Public License as published
  * by the Free Software Foundation, either version 3 of the License, or
  * (at your option) any later version.
- * 
+ *
  * This program is distributed in the hope that it will be useful,
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
- * 
+ *
  * You should have received a copy of the GNU Lesser General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
- * 
+ *
  ******************************************************************************/
 #ifndef INCLUDE_SPME_H_
 #define INCLUDE_SPME_H_
@@ -27,58 +27,109 @@ MDCORE_BEGIN_DECLS
 #define spme_err_ok                    0
 #define spme_err_null                  -1
 #define spme_err_malloc                -2
-#define smpe_err_nofftw3               -3
-#define spme_err_fftw                  -4
+#define spme_err_range                 -3
+#define spme_err_task                  -4
 
 
 /* some constants */
 #define spme_order                     4
-#define spme_gpc                       4
+#define spme_maxorder                  8
+#define spme_kappah                    0.3
+#define spme_chunk                     64
+#define spme_fft_maxfactors            32
+#define spme_fft_block                 8
+#define spme_maxslabs                  48
+
+
+/** Stages of the reciprocal-space tasks, stored in the task flags. */
+enum {
+	spme_task_spread = 0,
+	spme_task_forward,
+	spme_task_convolve,
+	spme_task_backward,
+	spme_task_layer,
+	spme_task_gather
+};
 
 
 /** ID of the last error */
 CAPI_DATA(int) spme_err;
 
 
+/** A one-dimensional complex FFT of a given length. */
+typedef struct spme_fft {
+
+	/** Length and its factors, in the order in which they are used. */
+	int n, nr_factors, factors[ spme_fft_maxfactors ];
+
+	/** The roots of unity @f$ e^{-2\pi i k/n} @f$, interleaved. */
+	float *w;
+
+} spme_fft;
+
+
 /** The spme structure */
 typedef struct spme {
 
-#ifdef HAVE_FFTW3
-
 	/** Grid dimensions. */
 	int dim[3];
 
-	/** Grid spacing. */
-	float h[3], ih[3];
+	/** Order of the B-splines. */
+	int order;
+
+	/** Origin of the periodic box and its grid spacing. */
+	double origin[3], h[3], ih[3];
 
 	/** SMPE parameter. */
-	float kappa;
+	double kappa;
+
+	/** The charge grid, interleaved complex, which holds the potential
+	    once the convolution is done. */
+	float *Q;
 
-	/** The charge grid. */
-	fftwf_complex *Q;
+	/** The reciprocal-space influence function. */
+	float *theta;
 
-	/** The transformed grid. */
-	fftwf_complex *E;
+	/** The transforms along each dimension. */
+	struct spme_fft fft[3];
 
-	/** The Temporary, complex grid. */
-	fftwf_complex *T;
+	/** The tasks, see #spme_maketasks, and the cell grid and margin they
+	    were made for. */
+	struct task *tasks;
+	int nr_tasks, cdim[3];
+	double margin;
 
-	/** The structure array. */
-	float *theta;
+	/** First grid plane of each slab of the spreading and the 2D
+	    transforms, and first line of each block of the convolution. */
+	int nr_slabs, *slabs, nr_blocks, *blocks;
+
+	/** Range of grid planes each layer of cells can reach. */
+	int *layer_lo, *layer_hi;
 
-	/** The fftw plan. */
-	fftwf_plan fwplan, bwplan;
+	/** Scratch space of each runner, allocated on first use. */
+	float **work;
+	int nr_work, work_size;
 
-#endif
+	/** Energy of each block of the convolution. */
+	double *epot_block;
 
 } spme;
 
 
 /* associated functions */
-int spme_init ( struct spme *s , int *dim , float *h , float kappa );
-void spme_bspline ( float *x , int N , float *b , float *dbdx );
-int spme_doconv ( struct spme *s );
-void spme_iact ( struct spme *s , struct space_cell *cp , struct space_cell *cg );
+int spme_init ( struct spme *s , double *origin , int *dim , double *h , double kappa , int order );
+void spme_free ( struct spme *s );
+int spme_maketasks ( struct spme *s , struct space *sp , int nr_runners , double margin );
+int spme_prepare ( struct spme *s );
+float *spme_work ( struct spme *s , int rid );
+int spme_layer_hits ( struct spme *s , int layer , int p0 , int p1 );
+void spme_bspline ( int order , const float *w , int N , float *b , float *dbdx );
+void spme_spread ( struct spme *s , struct space_cell *c , int p0 , int p1 );
+void spme_fft2d ( struct spme *s , int p0 , int p1 , int sign , float *work );
+double spme_convolve ( struct spme *s , int b , float *work );
+void spme_gather ( struct spme *s , struct space_cell *c );
+double spme_energy ( struct spme *s );
+double spme_doconv ( struct spme *s );
 
 MDCORE_END_DECLS
 #endif // INCLUDE_SPME_H_
@@ -41,6 +41,9 @@ enum {
 	task_type_pair,
 	task_type_sort,
 	task_type_bonded,
+	task_type_integrate,
+	task_type_singlebody,
+	task_type_spme,
 	task_type_count
 };
 
@@ -50,6 +53,7 @@ enum {
 	task_subtype_none = 0,
 	task_subtype_real,
 	task_subtype_spme,
+	task_subtype_halo,
 	task_subtype_count
 };
 
@@ -76,6 +80,10 @@ typedef struct task {
 	/** Nr of task that this task unlocks. */
 	int nr_unlock;
 
+	/** Time spent in this task, in ticks, since the last load balancing
+	    (see #engine_flag_balance). */
+	double cost;
+
 	/** List of task that this task unlocks (dependencies). */
 	struct task *unlock[ task_max_unlock ];
 
@@ -0,0 +1,434 @@
+/*
+ * MxExpr.cpp
+ *
+ * Parser, simplifier, differentiator and evaluator for MxExpr.
+ */
+
+#include <MxExpr.h>
+
+#include <alloca.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+
+struct MxExpr::parser {
+
+    MxExpr &e;
+    const std::string &src;
+    size_t pos;
+
+    parser(MxExpr &e, const std::string &src) : e(e), src(src), pos(0) {};
+
+    [[noreturn]] void fail(const std::string &msg) {
+        throw std::invalid_argument("error in expression \"" + src + "\" at position " +
+                                    std::to_string(pos) + ": " + msg);
+    }
+
+    void skip() {
+        while(pos < src.size() && isspace(src[pos])) {
+            pos++;
+        }
+    }
+
+    bool accept(const char *tok) {
+        skip();
+        size_t len = strlen(tok);
+        if(src.compare(pos, len, tok) == 0) {
+            pos += len;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(const char *tok) {
+        if(!accept(tok)) {
+            fail(std::string("expected '") + tok + "'");
+        }
+    }
+
+    // expr := term (('+' | '-') term)*
+    int expr() {
+        int a = term();
+        while(true) {
+            if(accept("+")) {
+                a = e.add(op_add, a, term());
+            }
+            else if(accept("-")) {
+                a = e.add(op_sub, a, term());
+            }
+            else {
+                return a;
+            }
+        }
+    }
+
+    // term := unary (('*' | '/') unary)*
+    int term() {
+        int a = unary();
+        while(true) {
+            skip();
+            if(src.compare(pos, 2, "**") == 0) {
+                return a;
+            }
+            if(accept("*")) {
+                a = e.add(op_mul, a, unary());
+            }
+            else if(accept("/")) {
+                a = e.add(op_div, a, unary());
+            }
+            else {
+                return a;
+            }
+        }
+    }
+
+    // unary := '-' unary | '+' unary | power
+    int unary() {
+        if(accept("-")) {
+            return e.add(op_neg, unary());
+        }
+        if(accept("+")) {
+            return unary();
+        }
+        return power();
+    }
+
+    // power := primary (('^' | '**') unary)?
+    int power() {
+        int a = primary();
+        if(accept("^") || accept("**")) {
+            return e.add(op_pow, a, unary());
+        }
+        return a;
+    }
+
+    // primary := number | name | name '(' expr (',' expr)* ')' | '(' expr ')'
+    int primary() {
+        skip();
+        if(pos >= src.size()) {
+            fail("unexpected end");
+        }
+
+        if(accept("(")) {
+            int a = expr();
+            expect(")");
+            return a;
+        }
+
+        if(isdigit(src[pos]) || src[pos] == '.') {
+            const char *start = src.c_str() + pos;
+            char *end;
+            double value = strtod(start, &end);
+            if(end == start) {
+                fail("bad number");
+            }
+            pos += end - start;
+            return e.constant(value);
+        }
+
+        if(isalpha(src[pos]) || src[pos] == '_') {
+            size_t start = pos;
+            while(pos < src.size() && (isalnum(src[pos]) || src[pos] == '_')) {
+                pos++;
+            }
+            std::string name = src.substr(start, pos - start);
+
+            if(accept("(")) {
+                static const std::map<std::string, int> funcs = {
+                    {"exp", op_exp}, {"log", op_log}, {"sqrt", op_sqrt},
+                    {"sin", op_sin}, {"cos", op_cos}, {"tanh", op_tanh},
+                    {"abs", op_abs}, {"pow", op_pow}
+                };
+                auto f = funcs.find(name);
+                if(f == funcs.end()) {
+                    fail("unknown function '" + name + "'");
+                }
+                int a = expr();
+                int b = -1;
+                if(f->second == op_pow) {
+                    expect(",");
+                    b = expr();
+                }
+                expect(")");
+                return e.add(f->second, a, b);
+            }
+
+            for(size_t v = 0; v < e.vars.size(); v++) {
+                if(e.vars[v] == name) {
+                    return e.add(op_var, v);
+                }
+            }
+            auto c = e.consts.find(name);
+            if(c != e.consts.end()) {
+                return e.constant(c->second);
+            }
+            if(name == "pi") {
+                return e.constant(M_PI);
+            }
+            fail("unknown name '" + name + "'");
+        }
+
+        fail(std::string("unexpected '") + src[pos] + "'");
+    }
+};
+
+
+MxExpr::MxExpr(const std::vector<std::string> &vars,
+               const std::map<std::string, double> &consts) :
+    vars(vars), consts(consts) {
+}
+
+
+int MxExpr::parse(const std::string &src) {
+    parser p(*this, src);
+    int a = p.expr();
+    p.skip();
+    if(p.pos != src.size()) {
+        p.fail("unexpected trailing characters");
+    }
+    return a;
+}
+
+
+double MxExpr::apply(int op, double a, double b) {
+    switch(op) {
+        case op_add: return a + b;
+        case op_sub: return a - b;
+        case op_mul: return a * b;
+        case op_div: return a / b;
+        case op_neg: return -a;
+        case op_pow: return pow(a, b);
+        case op_exp: return exp(a);
+        case op_log: return log(a);
+        case op_sqrt: return sqrt(a);
+        case op_sin: return sin(a);
+        case op_cos: return cos(a);
+        case op_tanh: return tanh(a);
+        case op_abs: return fabs(a);
+    }
+    return 0.0;
+}
+
+
+/**
+ * add a node, or return the equivalent node if there already is one.
+ * Folds constants and removes the trivial operations with 0 and 1, which
+ * keeps the derivatives small.
+ */
+int MxExpr::add(int op, int a, int b, double value) {
+
+    /* the leaves have no children, a is the variable index for op_var. */
+    bool leaf = op == op_const || op == op_var;
+    bool ca = !leaf && a >= 0 && nodes[a].op == op_const;
+    bool cb = !leaf && b >= 0 && nodes[b].op == op_const;
+    double va = ca ? nodes[a].value : 0.0;
+    double vb = cb ? nodes[b].value : 0.0;
+
+    if(ca && (b < 0 || cb)) {
+        return constant(apply(op, va, vb));
+    }
+
+    switch(op) {
+        case op_add:
+            if(ca && va == 0.0) return b;
+            if(cb && vb == 0.0) return a;
+            break;
+        case op_sub:
+            if(cb && vb == 0.0) return a;
+            if(ca && va == 0.0) return add(op_neg, b);
+            if(a == b) return constant(0.0);
+            break;
+        case op_mul:
+            if((ca && va == 0.0) || (cb && vb == 0.0)) return constant(0.0);
+            if(ca && va == 1.0) return b;
+            if(cb && vb == 1.0) return a;
+            if(ca && va == -1.0) return add(op_neg, b);
+            if(cb && vb == -1.0) return add(op_neg, a);
+            break;
+        case op_div:
+            if(ca && va == 0.0) return constant(0.0);
+            if(cb && vb == 1.0) return a;
+            break;
+        case op_neg:
+            if(nodes[a].op == op_neg) return nodes[a].a;
+            break;
+        case op_pow:
+            if(cb && vb == 0.0) return constant(1.0);
+            if(cb && vb == 1.0) return a;
+            break;
+    }
+
+    /* commutative operations get a canonical order, for sharing. */
+    if((op == op_add || op == op_mul) && a > b) {
+        std::swap(a, b);
+    }
+
+    auto key = std::make_tuple(op, a, b, value);
+    auto it = index.find(key);
+    if(it != index.end()) {
+        return it->second;
+    }
+
+    nodes.push_back({op, a, b, value});
+    index[key] = nodes.size() - 1;
+    return nodes.size() - 1;
+}
+
+
+int MxExpr::derivative(int n, int var) {
+    std::map<int, int> done;
+    return derivative(n, var, done);
+}
+
+
+/**
+ * the derivative of a node, re-using the derivatives of the shared nodes
+ * already in @c done.
+ */
+int MxExpr::derivative(int n, int var, std::map<int, int> &done) {
+
+    auto it = done.find(n);
+    if(it != done.end()) {
+        return it->second;
+    }
+
+    /* copy, the nodes may be moved by add. */
+    node nd = nodes[n];
+    int a = nd.op != op_var ? nd.a : -1, b = nd.b;
+    int da = (a >= 0) ? derivative(a, var, done) : -1;
+    int db = (b >= 0) ? derivative(b, var, done) : -1;
+
+    return done[n] = derivative_of(nd, n, da, db, var);
+}
+
+
+int MxExpr::derivative_of(const node &nd, int n, int da, int db, int var) {
+
+    int a = nd.a, b = nd.b;
+
+    switch(nd.op) {
+        case op_const:
+            return constant(0.0);
+        case op_var:
+            return constant(a == var ? 1.0 : 0.0);
+        case op_add:
+            return add(op_add, da, db);
+        case op_sub:
+            return add(op_sub, da, db);
+        case op_neg:
+            return add(op_neg, da);
+        case op_mul:
+            return add(op_add, add(op_mul, da, b), add(op_mul, a, db));
+        case op_div:
+            return add(op_div,
+                       add(op_sub, add(op_mul, da, b), add(op_mul, a, db)),
+                       add(op_mul, b, b));
+        case op_pow:
+            /* a^b * ( b' log(a) + b a' / a ), simplified for constant b. */
+            if(nodes[b].op == op_const) {
+                return add(op_mul, add(op_mul, b, add(op_pow, a, constant(nodes[b].value - 1.0))), da);
+            }
+            return add(op_mul, n,
+                       add(op_add, add(op_mul, db, add(op_log, a)),
+                           add(op_div, add(op_mul, b, da), a)));
+        case op_exp:
+            return add(op_mul, n, da);
+        case op_log:
+            return add(op_div, da, a);
+        case op_sqrt:
+            return add(op_div, da, add(op_mul, constant(2.0), n));
+        case op_sin:
+            return add(op_mul, add(op_cos, a), da);
+        case op_cos:
+            return add(op_neg, add(op_mul, add(op_sin, a), da));
+        case op_tanh:
+            return add(op_mul, add(op_sub, constant(1.0), add(op_mul, n, n)), da);
+        case op_abs:
+            return add(op_div, add(op_mul, a, da), n);
+    }
+
+    return constant(0.0);
+}
+
+
+double MxExpr::eval(int n, const double *vals) const {
+
+    double *r = (double*)alloca(sizeof(double) * (n + 1));
+
+    for(int k = 0; k <= n; k++) {
+        const node &nd = nodes[k];
+        switch(nd.op) {
+            case op_const:
+                r[k] = nd.value;
+                break;
+            case op_var:
+                r[k] = vals[nd.a];
+                break;
+            default:
+                r[k] = apply(nd.op, r[nd.a], nd.b >= 0 ? r[nd.b] : 0.0);
+        }
+    }
+
+    return r[n];
+}
+
+
+void MxExpr::eval_span(int n, const int *roots, int nr_roots,
+                       const FPTYPE *const *in, const int *in_stride,
+                       FPTYPE *const *out, int out_stride) const {
+
+    int last = 0;
+    for(int k = 0; k < nr_roots; k++) {
+        last = std::max(last, roots[k]);
+    }
+
+    /* one register of MXEXPR_CHUNK values per instruction. */
+    FPTYPE (*r)[MXEXPR_CHUNK] = (FPTYPE (*)[MXEXPR_CHUNK])alloca(sizeof(FPTYPE) * MXEXPR_CHUNK * (last + 1));
+
+    for(int first = 0; first < n; first += MXEXPR_CHUNK) {
+        int m = std::min(n - first, MXEXPR_CHUNK);
+
+        for(int k = 0; k <= last; k++) {
+            const node &nd = nodes[k];
+            FPTYPE *__restrict__ d = r[k];
+            const FPTYPE *__restrict__ x = nd.a >= 0 && nd.op != op_var ? r[nd.a] : NULL;
+            const FPTYPE *__restrict__ y = nd.b >= 0 ? r[nd.b] : NULL;
+            int l;
+
+            switch(nd.op) {
+                case op_const:
+                    for(l = 0; l < m; l++) d[l] = nd.value;
+                    break;
+                case op_var: {
+                    const FPTYPE *v = in[nd.a] + (size_t)first * in_stride[nd.a];
+                    int s = in_stride[nd.a];
+                    for(l = 0; l < m; l++) d[l] = v[l * s];
+                    break;
+                }
+                case op_add:  for(l = 0; l < m; l++) d[l] = x[l] + y[l]; break;
+                case op_sub:  for(l = 0; l < m; l++) d[l] = x[l] - y[l]; break;
+                case op_mul:  for(l = 0; l < m; l++) d[l] = x[l] * y[l]; break;
+                case op_div:  for(l = 0; l < m; l++) d[l] = x[l] / y[l]; break;
+                case op_neg:  for(l = 0; l < m; l++) d[l] = -x[l]; break;
+                case op_pow:  for(l = 0; l < m; l++) d[l] = pow(x[l], y[l]); break;
+                case op_exp:  for(l = 0; l < m; l++) d[l] = exp(x[l]); break;
+                case op_log:  for(l = 0; l < m; l++) d[l] = log(x[l]); break;
+                case op_sqrt: for(l = 0; l < m; l++) d[l] = sqrt(x[l]); break;
+                case op_sin:  for(l = 0; l < m; l++) d[l] = sin(x[l]); break;
+                case op_cos:  for(l = 0; l < m; l++) d[l] = cos(x[l]); break;
+                case op_tanh: for(l = 0; l < m; l++) d[l] = tanh(x[l]); break;
+                case op_abs:  for(l = 0; l < m; l++) d[l] = fabs(x[l]); break;
+            }
+        }
+
+        for(int k = 0; k < nr_roots; k++) {
+            FPTYPE *o = out[k] + (size_t)first * out_stride;
+            for(int l = 0; l < m; l++) {
+                o[l * out_stride] += r[roots[k]][l];
+            }
+        }
+    }
+}
@@ -9,9 +9,14 @@
 #include <engine.h>
 #include <MxParticle.h>
 #include <iostream>
+#include <memory>
 #include <MxPy.h>
+#include <MxExpr.h>
+#include <space_cell.h>
 
 static PyObject *berenderson_create(float tau);
+static PyObject *expression_create(const std::string &fx, const std::string &fy,
+        const std::string &fz, const std::map<std::string, double> &params);
 
 /**
  * force type
@@ -28,7 +33,13 @@ PyTypeObject MxForce_Type = {
     .tp_name =           "Force",
     .tp_basicsize =      sizeof(MxForce),
     .tp_itemsize =       1,
-    .tp_dealloc =        0,
+    .tp_dealloc =        [] (PyObject *o) {
+        MxForce *f = (MxForce*)o;
+        if(f->dealloc) {
+            f->dealloc(f);
+        }
+        Py_TYPE(o)->tp_free(o);
+    },
     .tp_print =          0,
     .tp_getattr =        0,
     .tp_setattr =        0,
@@ -96,8 +107,42 @@ static PyObject* py_berenderson_create(PyObject *m, PyObject *_args, PyObject *_
 
 
 
+static PyObject* py_expression_create(PyObject *m, PyObject *_args, PyObject *_kwds) {
+    try {
+        pybind11::detail::loader_life_support ls{};
+
+        std::string fx = arg<std::string>("fx", 0, _args, _kwds, "0");
+        std::string fy = arg<std::string>("fy", 1, _args, _kwds, "0");
+        std::string fz = arg<std::string>("fz", 2, _args, _kwds, "0");
+        pybind11::dict params = arg<pybind11::dict>("params", 3, _args, _kwds, pybind11::dict());
+
+        std::map<std::string, double> consts;
+        for(auto item : params) {
+            consts[item.first.cast<std::string>()] = item.second.cast<double>();
+        }
+
+        return expression_create(fx, fy, fz, consts);
+    }
+    catch (const pybind11::builtin_exception &e) {
+        e.set_error();
+        return NULL;
+    }
+    catch (const std::exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
+}
+
+
+
+
 static PyMethodDef methods[] = {
     { "berenderson_tstat", (PyCFunction)py_berenderson_create, METH_VARARGS | METH_KEYWORDS, NULL},
+    { "expression", (PyCFunction)py_expression_create, METH_VARARGS | METH_KEYWORDS,
+        "Creates a single-body force from the expressions fx, fy and fz of its\n"
+        "components, in terms of the absolute position x, y, z, the velocity\n"
+        "vx, vy, vz, the particle mass m, the time t and the constants in the\n"
+        "params dict, e.g. forces.expression(fx='-k * (x - x0)', params={'k': 1, 'x0': 5})."},
     { NULL, NULL, 0, NULL }
 };
 
@@ -154,14 +199,116 @@ static void berendsen_force(struct Berendsen* t, struct MxParticle *p, FPTYPE*f)
     f[2] += scale * p->v[2];
 }
 
+/**
+ * Batched version of berendsen_force, the scaling is the same for the
+ * whole span, so this is just f += scale * v.
+ */
+static void berendsen_force_span(struct Berendsen* t, MxParticleType *type,
+        int count, const FPTYPE *x, const FPTYPE *v, FPTYPE *f) {
+    FPTYPE scale = t->itau * ((type->target_energy / type->kinetic_energy) - 1.0);
+    int k = 0, n = 3 * count;
+
+#if defined(FPTYPE_SINGLE) && defined(__AVX__)
+    __m256 s = _mm256_set1_ps(scale);
+    for(; k + 8 <= n; k += 8) {
+        _mm256_storeu_ps(&f[k], _mm256_add_ps(_mm256_loadu_ps(&f[k]),
+                _mm256_mul_ps(s, _mm256_loadu_ps(&v[k]))));
+    }
+#elif defined(FPTYPE_SINGLE) && defined(__SSE__)
+    __m128 s = _mm_set1_ps(scale);
+    for(; k + 4 <= n; k += 4) {
+        _mm_storeu_ps(&f[k], _mm_add_ps(_mm_loadu_ps(&f[k]),
+                _mm_mul_ps(s, _mm_loadu_ps(&v[k]))));
+    }
+#elif defined(FPTYPE_DOUBLE) && defined(__AVX__)
+    __m256d s = _mm256_set1_pd(scale);
+    for(; k + 4 <= n; k += 4) {
+        _mm256_storeu_pd(&f[k], _mm256_add_pd(_mm256_loadu_pd(&f[k]),
+                _mm256_mul_pd(s, _mm256_loadu_pd(&v[k]))));
+    }
+#endif
+
+    for(; k < n; k++) {
+        f[k] += scale * v[k];
+    }
+}
+
 static PyObject *berenderson_create(float tau) {
     Berendsen *obj = (Berendsen*)PyType_GenericAlloc(&MxForce_Type,
             sizeof(Berendsen) - sizeof(MxForce));
 
     obj->func = (MxForce_OneBodyPtr)berendsen_force;
+    obj->span = (MxForce_OneBodySpanPtr)berendsen_force_span;
     obj->itau = 1/tau;
 
     return (PyObject*)obj;
 }
 
 
+/**
+ * Single-body force defined by an expression for each component, compiled
+ * into a straight-line program when the force is created.
+ */
+struct ExpressionForce : MxForce {
+    /** the compiled expressions, owned by the force, see expression_force_dealloc. */
+    MxExpr *expr;
+    int roots[3];
+};
+
+/** the variables an expression force can use, in this order. */
+static const std::vector<std::string> expression_vars = {
+    "x", "y", "z", "vx", "vy", "vz", "m", "t"
+};
+
+static void expression_force_span(struct ExpressionForce* t, MxParticleType *type,
+        int count, const FPTYPE *x, const FPTYPE *v, FPTYPE *f) {
+    FPTYPE m = type->mass;
+    FPTYPE time = _Engine.time * _Engine.dt;
+    const FPTYPE *in[8] = {&x[0], &x[1], &x[2], &v[0], &v[1], &v[2], &m, &time};
+    static const int in_stride[8] = {3, 3, 3, 3, 3, 3, 0, 0};
+    FPTYPE *out[3] = {&f[0], &f[1], &f[2]};
+
+    t->expr->eval_span(count, t->roots, 3, in, in_stride, out, 3);
+}
+
+static void expression_force(struct ExpressionForce* t, struct MxParticle *p, FPTYPE*f) {
+    MxParticleType *type = (MxParticleType*)&engine::types[p->typeId];
+    space_cell *c = _Engine.s.celllist[p->id];
+    FPTYPE x[3];
+
+    for(int k = 0; k < 3; k++) {
+        x[k] = c->origin[k] + p->x[k];
+    }
+    expression_force_span(t, type, 1, x, p->v, f);
+}
+
+static void expression_force_dealloc(struct ExpressionForce* t) {
+    delete t->expr;
+    t->expr = NULL;
+}
+
+static PyObject *expression_create(const std::string &fx, const std::string &fy,
+        const std::string &fz, const std::map<std::string, double> &params) {
+    std::unique_ptr<MxExpr> expr(new MxExpr(expression_vars, params));
+    int roots[3];
+
+    roots[0] = expr->parse(fx);
+    roots[1] = expr->parse(fy);
+    roots[2] = expr->parse(fz);
+
+    ExpressionForce *obj = (ExpressionForce*)PyType_GenericAlloc(&MxForce_Type,
+            sizeof(ExpressionForce) - sizeof(MxForce));
+    if(obj == NULL) {
+        return NULL;
+    }
+
+    obj->func = (MxForce_OneBodyPtr)expression_force;
+    obj->span = (MxForce_OneBodySpanPtr)expression_force_span;
+    obj->dealloc = (MxForce_DeallocPtr)expression_force_dealloc;
+    obj->expr = expr.release();
+    for(int k = 0; k < 3; k++) {
+        obj->roots[k] = roots[k];
+    }
+
+    return (PyObject*)obj;
+}
@@ -387,13 +387,16 @@ PyGetSetDef particle_getsets[] = {
     {
         .name = "velocity",
         .get = [](PyObject *obj, void *p) -> PyObject* {
-            Magnum::Vector3 *vec = &((MxPyParticle*)obj)->part->velocity;
+            int id = ((MxPyParticle*)obj)->part->id;
+            Magnum::Vector3 vec;
+            space_getvel(&_Engine.s, id, vec.data());
             return pybind11::cast(vec).release().ptr();
         },
         .set = [](PyObject *obj, PyObject *val, void *p) -> int {
             try {
-                Magnum::Vector3 *vec = &((MxPyParticle*)obj)->part->velocity;
-                *vec = pybind11::cast<Magnum::Vector3>(val);
+                int id = ((MxPyParticle*)obj)->part->id;
+                Magnum::Vector3 vec = pybind11::cast<Magnum::Vector3>(val);
+                space_setvel(&_Engine.s, id, vec.data());
                 return 0;
             }
             catch (const pybind11::builtin_exception &e) {
@@ -407,13 +410,16 @@ PyGetSetDef particle_getsets[] = {
     {
         .name = "force",
         .get = [](PyObject *obj, void *p) -> PyObject* {
-            Magnum::Vector3 *vec = &((MxPyParticle*)obj)->part->force;
+            int id = ((MxPyParticle*)obj)->part->id;
+            Magnum::Vector3 vec;
+            space_getforce(&_Engine.s, id, vec.data());
             return pybind11::cast(vec).release().ptr();
         },
         .set = [](PyObject *obj, PyObject *val, void *p) -> int {
             try {
-                Magnum::Vector3 *vec = &((MxPyParticle*)obj)->part->force;
-                *vec = pybind11::cast<Magnum::Vector3>(val);
+                int id = ((MxPyParticle*)obj)->part->id;
+                Magnum::Vector3 vec = pybind11::cast<Magnum::Vector3>(val);
+                space_setforce(&_Engine.s, id, vec.data());
                 return 0;
             }
             catch (const pybind11::builtin_exception &e) {
@@ -452,8 +458,8 @@ PyGetSetDef particle_getsets[] = {
         },
         .set = [](PyObject *obj, PyObject *val, void *p) -> int {
             try {
-                short *x = &((MxPyParticle*)obj)->part->typeId;
-                *x = pybind11::cast<short>(val);
+                int id = ((MxPyParticle*)obj)->part->id;
+                space_settype(&_Engine.s, id, pybind11::cast<short>(val));
                 return 0;
             }
             catch (const pybind11::builtin_exception &e) {
@@ -501,6 +507,7 @@ static int particle_init(MxPyParticle *self, PyObject *_args, PyObject *_kwds) {
         .position = {},
         .velocity = {},
         .force = {},
+        .q = (float)type->charge,
         .typeId = type->id,
         .id = _Engine.s.nr_parts
     };
@@ -25,7 +25,13 @@
 #include <float.h>
 #include <MxPotential.h>
 #include <MxPy.h>
+#include <MxExpr.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 
 /* include local headers */
@@ -51,7 +57,8 @@ struct MxPotential potential_null = {
         .a = 0.0 ,
         .b = DBL_MAX,
         potential_flag_none ,
-        1
+        1 ,
+        potential_kind_table
 };
 
 
@@ -279,8 +286,14 @@ double potential_Ewald_6p ( double r , double kappa ) {
 }
 
 
-double potential_create_harmonic_K;
-double potential_create_harmonic_r0;
+static __thread double potential_create_harmonic_K;
+static __thread double potential_create_harmonic_r0;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_harmonic_set ( const double *params , double a , double b ) {
+	potential_create_harmonic_K = params[0];
+	potential_create_harmonic_r0 = params[1];
+}
 
 /* the potential functions */
 double potential_create_harmonic_f ( double r ) {
@@ -323,22 +336,99 @@ struct MxPotential *potential_create_harmonic ( double a , double b , double K ,
     p->flags =  potential_flag_r2 | potential_flag_harmonic ;
 
 	/* fill this potential */
-	potential_create_harmonic_K = K;
-	potential_create_harmonic_r0 = r0;
-	if ( potential_init( p , &potential_create_harmonic_f , NULL , &potential_create_harmonic_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { K , r0 };
+	if ( potential_init_cached( p , "harmonic" , params , 2 , &potential_create_harmonic_set , &potential_create_harmonic_f , NULL , &potential_create_harmonic_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
 
+	/* remember the closed form */
+	p->kind = potential_kind_harmonic;
+	p->params[0] = K; p->params[1] = r0; p->params[2] = 0.0; p->params[3] = p->a;
+
 	/* return it */
 			return p;
 
 }
 
 
-double potential_create_harmonic_dihedral_K;
-int potential_create_harmonic_dihedral_n;
-double potential_create_harmonic_dihedral_delta;
+MxExpr *potential_create_expression_expr;
+int potential_create_expression_node[3];
+
+/* the potential functions */
+double potential_create_expression_f ( double r ) {
+	return potential_create_expression_expr->eval( potential_create_expression_node[0] , &r );
+}
+
+double potential_create_expression_dfdr ( double r ) {
+	return potential_create_expression_expr->eval( potential_create_expression_node[1] , &r );
+}
+
+double potential_create_expression_d6fdr6 ( double r ) {
+	return potential_create_expression_expr->eval( potential_create_expression_node[2] , &r );
+}
+
+/**
+ * @brief Creates a potential from an expression.
+ *
+ * @param expr The #MxExpr, with the distance @c r as its only variable.
+ * @param node The node of @c expr giving the potential.
+ * @param a The smallest radius for which the potential will be constructed.
+ * @param b The largest radius for which the potential will be constructed.
+ * @param tol The tolerance to which the interpolation should match the exact
+ *      potential.
+ *
+ * @return A newly-allocated #potential interpolating the expression in
+ *      @f$[a,b]@f$ or @c NULL on error (see #potential_err).
+ *
+ * The derivatives needed to build the interpolation are computed
+ * symbolically and added to @c expr. Once built, the potential is
+ * evaluated exactly like the built-in ones.
+ */
+
+struct MxPotential *potential_create_expression ( MxExpr *expr , int node , double a , double b , double tol ) {
+
+	struct MxPotential *p;
+	int k, d6;
+
+	/* allocate the potential */
+	if ((p = potential_alloc(&MxPotential_Type)) == NULL ) {
+		error(potential_err_malloc);
+		return NULL;
+	}
+
+	p->flags =  potential_flag_r2 ;
+
+	/* get the derivatives */
+	potential_create_expression_expr = expr;
+	potential_create_expression_node[0] = node;
+	potential_create_expression_node[1] = d6 = expr->derivative( node , 0 );
+	for ( k = 1 ; k < 6 ; k++ )
+		d6 = expr->derivative( d6 , 0 );
+	potential_create_expression_node[2] = d6;
+
+	/* fill this potential */
+	if ( potential_init( p , &potential_create_expression_f , &potential_create_expression_dfdr , &potential_create_expression_d6fdr6 , a , b , tol ) < 0 ) {
+		free(p);
+		return NULL;
+	}
+
+	/* return it */
+	return p;
+
+}
+
+
+static __thread double potential_create_harmonic_dihedral_K;
+static __thread int potential_create_harmonic_dihedral_n;
+static __thread double potential_create_harmonic_dihedral_delta;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_harmonic_dihedral_set ( const double *params , double a , double b ) {
+	potential_create_harmonic_dihedral_K = params[0];
+	potential_create_harmonic_dihedral_n = (int)params[1];
+	potential_create_harmonic_dihedral_delta = params[2];
+}
 
 /* the potential functions */
 double potential_create_harmonic_dihedral_f ( double r ) {
@@ -417,10 +507,8 @@ struct MxPotential *potential_create_harmonic_dihedral ( double K , int n , doub
     p->flags =   potential_flag_r | potential_flag_harmonic | potential_flag_dihedral;
 
 	/* fill this potential */
-	potential_create_harmonic_dihedral_K = K;
-	potential_create_harmonic_dihedral_n = n;
-	potential_create_harmonic_dihedral_delta = delta;
-	if ( potential_init( p , &potential_create_harmonic_dihedral_f , NULL , &potential_create_harmonic_dihedral_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { K , (double)n , delta };
+	if ( potential_init_cached( p , "harmonic_dihedral" , params , 3 , &potential_create_harmonic_dihedral_set , &potential_create_harmonic_dihedral_f , NULL , &potential_create_harmonic_dihedral_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
@@ -431,8 +519,14 @@ struct MxPotential *potential_create_harmonic_dihedral ( double K , int n , doub
 }
 
 
-double potential_create_harmonic_angle_K;
-double potential_create_harmonic_angle_theta0;
+static __thread double potential_create_harmonic_angle_K;
+static __thread double potential_create_harmonic_angle_theta0;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_harmonic_angle_set ( const double *params , double a , double b ) {
+	potential_create_harmonic_angle_K = params[0];
+	potential_create_harmonic_angle_theta0 = params[1];
+}
 
 /* the potential functions */
 double potential_create_harmonic_angle_f ( double r ) {
@@ -495,9 +589,8 @@ struct MxPotential *potential_create_harmonic_angle ( double a , double b , doub
 		right = 1.0 / ( 1.0 + sqrt(FPTYPE_EPSILON) );
 
 	/* fill this potential */
-	potential_create_harmonic_angle_K = K;
-	potential_create_harmonic_angle_theta0 = theta0;
-	if ( potential_init( p , &potential_create_harmonic_angle_f , NULL , &potential_create_harmonic_angle_d6fdr6 , left , right , tol ) < 0 ) {
+	const double params[] = { K , theta0 };
+	if ( potential_init_cached( p , "harmonic_angle" , params , 2 , &potential_create_harmonic_angle_set , &potential_create_harmonic_angle_f , NULL , &potential_create_harmonic_angle_d6fdr6 , left , right , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
@@ -508,8 +601,14 @@ struct MxPotential *potential_create_harmonic_angle ( double a , double b , doub
 }
 
 
-double potential_create_Ewald_q;
-double potential_create_Ewald_kappa;
+static __thread double potential_create_Ewald_q;
+static __thread double potential_create_Ewald_kappa;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_Ewald_set ( const double *params , double a , double b ) {
+	potential_create_Ewald_q = params[0];
+	potential_create_Ewald_kappa = params[1];
+}
 
 /* the potential functions */
 double potential_create_Ewald_f ( double r ) {
@@ -553,9 +652,8 @@ struct MxPotential *potential_create_Ewald ( double a , double b , double q , do
     p->flags =  potential_flag_r2 | potential_flag_ewald ;
 
 	/* fill this potential */
-	potential_create_Ewald_q = q;
-	potential_create_Ewald_kappa = kappa;
-	if ( potential_init( p , &potential_create_Ewald_f , &potential_create_Ewald_dfdr , &potential_create_Ewald_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { q , kappa };
+	if ( potential_init_cached( p , "Ewald" , params , 2 , &potential_create_Ewald_set , &potential_create_Ewald_f , &potential_create_Ewald_dfdr , &potential_create_Ewald_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
@@ -566,10 +664,18 @@ struct MxPotential *potential_create_Ewald ( double a , double b , double q , do
 }
 
 
-double potential_create_LJ126_Ewald_A;
-double potential_create_LJ126_Ewald_B;
-double potential_create_LJ126_Ewald_kappa;
-double potential_create_LJ126_Ewald_q;
+static __thread double potential_create_LJ126_Ewald_A;
+static __thread double potential_create_LJ126_Ewald_B;
+static __thread double potential_create_LJ126_Ewald_kappa;
+static __thread double potential_create_LJ126_Ewald_q;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_LJ126_Ewald_set ( const double *params , double a , double b ) {
+	potential_create_LJ126_Ewald_A = params[0];
+	potential_create_LJ126_Ewald_B = params[1];
+	potential_create_LJ126_Ewald_q = params[2];
+	potential_create_LJ126_Ewald_kappa = params[3];
+}
 
 /* the potential functions */
 double potential_create_LJ126_Ewald_f ( double r ) {
@@ -619,11 +725,8 @@ struct MxPotential *potential_create_LJ126_Ewald ( double a , double b , double
     p->flags =  potential_flag_r2 | potential_flag_lennard_jones |  potential_flag_ewald ;
 
 	/* fill this potential */
-	potential_create_LJ126_Ewald_A = A;
-	potential_create_LJ126_Ewald_B = B;
-	potential_create_LJ126_Ewald_kappa = kappa;
-	potential_create_LJ126_Ewald_q = q;
-	if ( potential_init( p , &potential_create_LJ126_Ewald_f , &potential_create_LJ126_Ewald_dfdr , &potential_create_LJ126_Ewald_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { A , B , q , kappa };
+	if ( potential_init_cached( p , "LJ126_Ewald" , params , 4 , &potential_create_LJ126_Ewald_set , &potential_create_LJ126_Ewald_f , &potential_create_LJ126_Ewald_dfdr , &potential_create_LJ126_Ewald_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
@@ -634,12 +737,22 @@ struct MxPotential *potential_create_LJ126_Ewald ( double a , double b , double
 }
 
 
-double potential_create_LJ126_Ewald_switch_A;
-double potential_create_LJ126_Ewald_switch_B;
-double potential_create_LJ126_Ewald_switch_kappa;
-double potential_create_LJ126_Ewald_switch_q;
-double potential_create_LJ126_Ewald_switch_s;
-double potential_create_LJ126_Ewald_switch_cutoff;
+static __thread double potential_create_LJ126_Ewald_switch_A;
+static __thread double potential_create_LJ126_Ewald_switch_B;
+static __thread double potential_create_LJ126_Ewald_switch_kappa;
+static __thread double potential_create_LJ126_Ewald_switch_q;
+static __thread double potential_create_LJ126_Ewald_switch_s;
+static __thread double potential_create_LJ126_Ewald_switch_cutoff;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_LJ126_Ewald_switch_set ( const double *params , double a , double b ) {
+	potential_create_LJ126_Ewald_switch_A = params[0];
+	potential_create_LJ126_Ewald_switch_B = params[1];
+	potential_create_LJ126_Ewald_switch_q = params[2];
+	potential_create_LJ126_Ewald_switch_kappa = params[3];
+	potential_create_LJ126_Ewald_switch_s = params[4];
+	potential_create_LJ126_Ewald_switch_cutoff = b;
+}
 
 /* the potential functions */
 double potential_create_LJ126_Ewald_switch_f ( double r ) {
@@ -691,13 +804,8 @@ struct MxPotential *potential_create_LJ126_Ewald_switch ( double a , double b ,
     p->flags =  potential_flag_r2 | potential_flag_lennard_jones | potential_flag_ewald | potential_flag_switch ;
 
 	/* fill this potential */
-	potential_create_LJ126_Ewald_switch_A = A;
-	potential_create_LJ126_Ewald_switch_B = B;
-	potential_create_LJ126_Ewald_switch_kappa = kappa;
-	potential_create_LJ126_Ewald_switch_q = q;
-	potential_create_LJ126_Ewald_switch_s = s;
-	potential_create_LJ126_Ewald_switch_cutoff = b;
-	if ( potential_init( p , &potential_create_LJ126_Ewald_switch_f , &potential_create_LJ126_Ewald_switch_dfdr , &potential_create_LJ126_Ewald_switch_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { A , B , q , kappa , s };
+	if ( potential_init_cached( p , "LJ126_Ewald_switch" , params , 5 , &potential_create_LJ126_Ewald_switch_set , &potential_create_LJ126_Ewald_switch_f , &potential_create_LJ126_Ewald_switch_dfdr , &potential_create_LJ126_Ewald_switch_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
@@ -708,8 +816,14 @@ struct MxPotential *potential_create_LJ126_Ewald_switch ( double a , double b ,
 }
 
 
-double potential_create_Coulomb_q;
-double potential_create_Coulomb_b;
+static __thread double potential_create_Coulomb_q;
+static __thread double potential_create_Coulomb_b;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_Coulomb_set ( const double *params , double a , double b ) {
+	potential_create_Coulomb_q = params[0];
+	potential_create_Coulomb_b = b;
+}
 
 /* the potential functions */
 double potential_create_Coulomb_f ( double r ) {
@@ -752,23 +866,34 @@ struct MxPotential *potential_create_Coulomb ( double a , double b , double q ,
     p->flags =  potential_flag_r2 |  potential_flag_coulomb ;
 
 	/* fill this potential */
-	potential_create_Coulomb_q = q;
-	potential_create_Coulomb_b = b;
-	if ( potential_init( p , &potential_create_Coulomb_f , &potential_create_Coulomb_dfdr , &potential_create_Coulomb_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { q };
+	if ( potential_init_cached( p , "Coulomb" , params , 1 , &potential_create_Coulomb_set , &potential_create_Coulomb_f , &potential_create_Coulomb_dfdr , &potential_create_Coulomb_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
 
+	/* remember the closed form */
+	p->kind = potential_kind_Coulomb;
+	p->params[0] = potential_escale * q; p->params[1] = 1.0 / b; p->params[2] = 0.0; p->params[3] = p->a;
+
 	/* return it */
 			return p;
 
 }
 
 
-double potential_create_LJ126_Coulomb_q;
-double potential_create_LJ126_Coulomb_b;
-double potential_create_LJ126_Coulomb_A;
-double potential_create_LJ126_Coulomb_B;
+static __thread double potential_create_LJ126_Coulomb_q;
+static __thread double potential_create_LJ126_Coulomb_b;
+static __thread double potential_create_LJ126_Coulomb_A;
+static __thread double potential_create_LJ126_Coulomb_B;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_LJ126_Coulomb_set ( const double *params , double a , double b ) {
+	potential_create_LJ126_Coulomb_A = params[0];
+	potential_create_LJ126_Coulomb_B = params[1];
+	potential_create_LJ126_Coulomb_q = params[2];
+	potential_create_LJ126_Coulomb_b = b;
+}
 
 /* the potential functions */
 double potential_create_LJ126_Coulomb_f ( double r ) {
@@ -817,11 +942,8 @@ struct MxPotential *potential_create_LJ126_Coulomb ( double a , double b , doubl
     p->flags =  potential_flag_r2 | potential_flag_coulomb | potential_flag_lennard_jones  ;
 
 	/* fill this potential */
-	potential_create_LJ126_Coulomb_q = q;
-	potential_create_LJ126_Coulomb_b = b;
-	potential_create_LJ126_Coulomb_A = A;
-	potential_create_LJ126_Coulomb_B = B;
-	if ( potential_init( p , &potential_create_LJ126_Coulomb_f , &potential_create_LJ126_Coulomb_dfdr , &potential_create_LJ126_Coulomb_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { A , B , q };
+	if ( potential_init_cached( p , "LJ126_Coulomb" , params , 3 , &potential_create_LJ126_Coulomb_set , &potential_create_LJ126_Coulomb_f , &potential_create_LJ126_Coulomb_dfdr , &potential_create_LJ126_Coulomb_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
@@ -832,8 +954,14 @@ struct MxPotential *potential_create_LJ126_Coulomb ( double a , double b , doubl
 }
 
 
-double potential_create_LJ126_A;
-double potential_create_LJ126_B;
+static __thread double potential_create_LJ126_A;
+static __thread double potential_create_LJ126_B;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_LJ126_set ( const double *params , double a , double b ) {
+	potential_create_LJ126_A = params[0];
+	potential_create_LJ126_B = params[1];
+}
 
 /* the potential functions */
 double potential_create_LJ126_f ( double r ) {
@@ -877,23 +1005,34 @@ struct MxPotential *potential_create_LJ126 ( double a , double b , double A , do
     p->flags =  potential_flag_r2  | potential_flag_lennard_jones ;
 
 	/* fill this potential */
-	potential_create_LJ126_A = A;
-	potential_create_LJ126_B = B;
-	if ( potential_init( p , &potential_create_LJ126_f , &potential_create_LJ126_dfdr , &potential_create_LJ126_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { A , B };
+	if ( potential_init_cached( p , "LJ126" , params , 2 , &potential_create_LJ126_set , &potential_create_LJ126_f , &potential_create_LJ126_dfdr , &potential_create_LJ126_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
 
+	/* remember the closed form */
+	p->kind = potential_kind_LJ126;
+	p->params[0] = A; p->params[1] = B; p->params[2] = 0.0; p->params[3] = p->a;
+
 	/* return it */
 			return p;
 
 }
 
 
-double potential_create_LJ126_switch_A;
-double potential_create_LJ126_switch_B;
-double potential_create_LJ126_switch_s;
-double potential_create_LJ126_switch_cutoff;
+static __thread double potential_create_LJ126_switch_A;
+static __thread double potential_create_LJ126_switch_B;
+static __thread double potential_create_LJ126_switch_s;
+static __thread double potential_create_LJ126_switch_cutoff;
+
+/* set the parameters of the potential functions on this thread */
+static void potential_create_LJ126_switch_set ( const double *params , double a , double b ) {
+	potential_create_LJ126_switch_A = params[0];
+	potential_create_LJ126_switch_B = params[1];
+	potential_create_LJ126_switch_s = params[2];
+	potential_create_LJ126_switch_cutoff = b;
+}
 
 /* the potential functions */
 double potential_create_LJ126_switch_f ( double r ) {
@@ -939,11 +1078,8 @@ struct MxPotential *potential_create_LJ126_switch ( double a , double b , double
     p->flags =  potential_flag_r2 | potential_flag_lennard_jones | potential_flag_switch ;
 
 	/* fill this potential */
-	potential_create_LJ126_switch_A = A;
-	potential_create_LJ126_switch_B = B;
-	potential_create_LJ126_switch_s = s;
-	potential_create_LJ126_switch_cutoff = b;
-	if ( potential_init( p , &potential_create_LJ126_switch_f , &potential_create_LJ126_switch_dfdr , &potential_create_LJ126_switch_d6fdr6 , a , b , tol ) < 0 ) {
+	const double params[] = { A , B , s };
+	if ( potential_init_cached( p , "LJ126_switch" , params , 3 , &potential_create_LJ126_switch_set , &potential_create_LJ126_switch_f , &potential_create_LJ126_switch_dfdr , &potential_create_LJ126_switch_d6fdr6 , a , b , tol ) < 0 ) {
 		free(p);
 		return NULL;
 	}
@@ -954,6 +1090,65 @@ struct MxPotential *potential_create_LJ126_switch ( double a , double b , double
 }
 
 
+/* Stretch the domain of a table ever so slightly, see #potential_init. */
+static void potential_stretch ( FPTYPE *a , FPTYPE *b ) {
+	*b += fabs(*b) * sqrt(FPTYPE_EPSILON);
+	*a -= fabs(*a) * sqrt(FPTYPE_EPSILON);
+}
+
+
+/** A table queued by #potential_init_cached while a batch is open. */
+struct potential_pending {
+	struct MxPotential *p;
+	void (*set)( const double *params , double a , double b );
+	double (*f)( double ), (*fp)( double ), (*f6p)( double );
+	double params[potential_batch_maxparams];
+	FPTYPE a, b, tol;
+	char key[potential_cache_keylen];
+	int err;
+};
+
+/* the open batch and the tables queued in it */
+static int potential_batch_open = 0;
+static struct potential_pending *potential_pending = NULL;
+static int potential_nr_pending = 0, potential_size_pending = 0;
+
+/* the parameters of the table being fitted on this thread, which the
+   threads of potential_getcoeffs set for themselves, and whether this
+   thread may start them at all */
+static __thread void (*potential_fit_set)( const double *params , double a , double b ) = NULL;
+static __thread const double *potential_fit_params = NULL;
+static __thread double potential_fit_a, potential_fit_b;
+static __thread int potential_fit_serial = 0;
+
+
+/**
+ * @brief Remove a #potential from the batch.
+ *
+ * @param p The #potential.
+ * @param job Where to copy its queued table to, or @c NULL.
+ *
+ * @return 1 if @c p was queued, 0 otherwise.
+ */
+
+static int potential_unqueue ( struct MxPotential *p , struct potential_pending *job ) {
+
+	int k;
+
+	for ( k = 0 ; k < potential_nr_pending && potential_pending[k].p != p ; k++ );
+	if ( k == potential_nr_pending )
+		return 0;
+
+	if ( job != NULL )
+		*job = potential_pending[k];
+	potential_pending[k] = potential_pending[ --potential_nr_pending ];
+	p->flags &= ~potential_flag_pending;
+
+	return 1;
+
+}
+
+
 /**
  * @brief Free the memory associated with the given potential.
  * 
@@ -966,6 +1161,10 @@ void potential_clear ( struct MxPotential *p ) {
 	if ( p == NULL )
 		return;
 
+	/* Drop it from the batch. */
+	if ( p->flags & potential_flag_pending )
+		potential_unqueue( p , NULL );
+
 	/* Clear the flags. */
 	p->flags = potential_flag_none;
 
@@ -976,6 +1175,416 @@ void potential_clear ( struct MxPotential *p ) {
 }
 
 
+/**
+ * @brief Get the name of the cache file for a potential table.
+ *
+ * @param key The key of the table.
+ * @param path A buffer of size @c size in which to store the file name.
+ * @param size The size of @c path.
+ *
+ * @return 1 if the cache is enabled and @c path was set, 0 otherwise.
+ *
+ * The cache directory is @c $MX_POTENTIAL_CACHE or, if that is not set,
+ * @c mechanica/potentials in @c $XDG_CACHE_HOME or @c ~/.cache. It is
+ * created if need be. Setting @c MX_POTENTIAL_CACHE to an empty string or
+ * to @c off disables the cache.
+ */
+
+static int potential_cache_path ( const char *key , char *path , size_t size ) {
+
+	const char *env, *home;
+	char dir[PATH_MAX], *sep;
+	unsigned long long hash = 14695981039346656037ULL;
+	int k;
+
+	/* get the cache directory */
+	if ( ( env = getenv( potential_cache_env ) ) != NULL ) {
+		if ( env[0] == '\0' || strcmp( env , "off" ) == 0 )
+			return 0;
+		snprintf( dir , sizeof(dir) , "%s" , env );
+	}
+	else if ( ( home = getenv( "XDG_CACHE_HOME" ) ) != NULL && home[0] != '\0' )
+		snprintf( dir , sizeof(dir) , "%s/mechanica/potentials" , home );
+	else if ( ( home = getenv( "HOME" ) ) != NULL && home[0] != '\0' )
+		snprintf( dir , sizeof(dir) , "%s/.cache/mechanica/potentials" , home );
+	else
+		return 0;
+
+	/* make sure it exists, one level at a time */
+	for ( sep = &dir[1] ; ; sep++ ) {
+		if ( *sep == '/' || *sep == '\0' ) {
+			char c = *sep;
+			*sep = '\0';
+			if ( mkdir( dir , 0755 ) != 0 && errno != EEXIST )
+				return 0;
+			*sep = c;
+			if ( c == '\0' )
+				break;
+		}
+	}
+
+	/* the file is named after the FNV-1a hash of the key */
+	for ( k = 0 ; key[k] != '\0' ; k++ )
+		hash = ( hash ^ (unsigned char)key[k] ) * 1099511628211ULL;
+	return snprintf( path , size , "%s/%016llx.tab" , dir , hash ) < (int)size;
+
+}
+
+
+/**
+ * @brief Load a potential table from the cache.
+ *
+ * @param p The #potential to fill.
+ * @param path The cache file.
+ * @param key The key of the table, which must match the one in the file.
+ *
+ * @return 1 if @c p was filled, 0 otherwise.
+ */
+
+static int potential_cache_load ( struct MxPotential *p , const char *path , const char *key ) {
+
+	FILE *file;
+	char magic[sizeof(potential_cache_magic)], buff[potential_cache_keylen];
+	int len, n, ok = 0;
+	double ab[2];
+	FPTYPE alpha[4], *c = NULL;
+
+	if ( ( file = fopen( path , "rb" ) ) == NULL )
+		return 0;
+
+	/* check the header and the key */
+	len = strlen( key );
+	if ( fread( magic , sizeof(magic) , 1 , file ) == 1 &&
+		 memcmp( magic , potential_cache_magic , sizeof(magic) ) == 0 &&
+		 fread( &n , sizeof(int) , 1 , file ) == 1 && n == len &&
+		 fread( buff , 1 , len , file ) == (size_t)len && memcmp( buff , key , len ) == 0 &&
+		 fread( &n , sizeof(int) , 1 , file ) == 1 && n > 0 && n <= potential_ivalsmax &&
+		 fread( ab , sizeof(double) , 2 , file ) == 2 &&
+		 fread( alpha , sizeof(FPTYPE) , 4 , file ) == 4 &&
+		 posix_memalign( (void **)&c , potential_align , sizeof(FPTYPE) * (n+1) * potential_chunk ) == 0 &&
+		 fread( c , sizeof(FPTYPE) , (n+1) * potential_chunk , file ) == (size_t)(n+1) * potential_chunk ) {
+		p->n = n;
+		p->a = ab[0]; p->b = ab[1];
+		memcpy( p->alpha , alpha , sizeof(alpha) );
+		p->c = c;
+		ok = 1;
+	}
+	else
+		free( c );
+
+	fclose( file );
+	return ok;
+
+}
+
+
+/**
+ * @brief Store a potential table in the cache.
+ *
+ * @param p The #potential.
+ * @param path The cache file.
+ * @param key The key of the table.
+ *
+ * The table is written to a temporary file which is then renamed, such
+ * that concurrent runs never see a partial table. Failures are ignored,
+ * the table will just be computed again next time.
+ */
+
+static int potential_cache_count = 0;
+
+static void potential_cache_store ( struct MxPotential *p , const char *path , const char *key ) {
+
+	FILE *file;
+	char tmp[PATH_MAX];
+	int len = strlen( key ), ok;
+	double ab[2] = { p->a , p->b };
+
+	if ( snprintf( tmp , sizeof(tmp) , "%s.%i.%i.tmp" , path , (int)getpid() ,
+				   __atomic_fetch_add( &potential_cache_count , 1 , __ATOMIC_RELAXED ) ) >= (int)sizeof(tmp) ||
+		 ( file = fopen( tmp , "wb" ) ) == NULL )
+		return;
+
+	ok = fwrite( potential_cache_magic , sizeof(potential_cache_magic) , 1 , file ) == 1 &&
+		 fwrite( &len , sizeof(int) , 1 , file ) == 1 &&
+		 fwrite( key , 1 , len , file ) == (size_t)len &&
+		 fwrite( &p->n , sizeof(int) , 1 , file ) == 1 &&
+		 fwrite( ab , sizeof(double) , 2 , file ) == 2 &&
+		 fwrite( p->alpha , sizeof(FPTYPE) , 4 , file ) == 4 &&
+		 fwrite( p->c , sizeof(FPTYPE) , (p->n+1) * potential_chunk , file ) == (size_t)(p->n+1) * potential_chunk;
+
+	if ( fclose( file ) != 0 || !ok || rename( tmp , path ) != 0 )
+		remove( tmp );
+
+}
+
+
+/**
+ * @brief Fit a table, or load it from the on-disk cache, on this thread.
+ *
+ * @param p A pointer to an empty #potential.
+ * @param key The cache key of the table, or @c NULL to not use the cache.
+ * @param params The parameters of the potential form.
+ * @param set The function setting the @c params for @c f, @c fp and
+ *      @c f6p on the calling thread, or @c NULL.
+ * @param f A pointer to the potential function to be interpolated.
+ * @param fp A pointer to the first derivative of @c f.
+ * @param f6p A pointer to the sixth derivative of @c f.
+ * @param a The smallest radius for which the potential will be constructed.
+ * @param b The largest radius for which the potential will be constructed.
+ * @param tol The absolute tolerance to which the interpolation should match
+ *      the exact potential.
+ *
+ * @return #potential_err_ok or <0 on error (see #potential_err).
+ */
+
+static int potential_fit ( struct MxPotential *p , const char *key , const double *params ,
+						   void (*set)( const double *params , double a , double b ) ,
+						   double (*f)( double ) , double (*fp)( double ) , double (*f6p)( double ) ,
+						   FPTYPE a , FPTYPE b , FPTYPE tol ) {
+
+	char path[PATH_MAX];
+	int cached, res = potential_err_ok;
+
+	/* set the parameters, here and for the threads of potential_getcoeffs */
+	if ( set != NULL )
+		set( params , a , b );
+	potential_fit_set = set;
+	potential_fit_params = params;
+	potential_fit_a = a; potential_fit_b = b;
+
+	/* try the cache, or compute and remember the table */
+	cached = key != NULL && potential_cache_path( key , path , sizeof(path) );
+	if ( !cached || !potential_cache_load( p , path , key ) ) {
+		if ( potential_init( p , f , fp , f6p , a , b , tol ) < 0 )
+			res = error(potential_err);
+		else if ( cached )
+			potential_cache_store( p , path , key );
+	}
+
+	potential_fit_set = NULL;
+	potential_fit_params = NULL;
+
+	return res;
+
+}
+
+
+/**
+ * @brief Construct a #potential from the given function, or load it from
+ *      the on-disk cache.
+ *
+ * @param p A pointer to an empty #potential.
+ * @param name The name of the potential form.
+ * @param params The parameters of the potential form.
+ * @param nr_params The number of parameters.
+ * @param set The function setting the @c params for @c f, @c fp and
+ *      @c f6p on the calling thread.
+ * @param f A pointer to the potential function to be interpolated.
+ * @param fp A pointer to the first derivative of @c f.
+ * @param f6p A pointer to the sixth derivative of @c f.
+ * @param a The smallest radius for which the potential will be constructed.
+ * @param b The largest radius for which the potential will be constructed.
+ * @param tol The absolute tolerance to which the interpolation should match
+ *      the exact potential.
+ *
+ * @return #potential_err_ok or <0 on error (see #potential_err).
+ *
+ * Same as #potential_init, but the table is looked up in the cache by
+ * @c name, @c params, @c a, @c b and @c tol first, and stored there if it
+ * had to be computed. @c name and @c params must therefore determine
+ * @c f completely.
+ *
+ * If a batch is open (see #potential_batch_begin), the table is only
+ * queued, @c p gets its bounds and #potential_flag_pending, and
+ * #potential_batch_end fits it later.
+ */
+
+int potential_init_cached ( struct MxPotential *p , const char *name , const double *params , int nr_params ,
+							void (*set)( const double *params , double a , double b ) ,
+							double (*f)( double ) , double (*fp)( double ) , double (*f6p)( double ) ,
+							FPTYPE a , FPTYPE b , FPTYPE tol ) {
+
+	char key[potential_cache_keylen];
+	struct potential_pending *job;
+	int k, len;
+
+	/* check inputs */
+	if ( p == NULL || name == NULL || ( params == NULL && nr_params > 0 ) )
+		return error(potential_err_null);
+
+	/* make the key, hex floats are exact */
+	len = snprintf( key , sizeof(key) , "%s/%i/%i/%i/%a/%a/%a" , name , potential_cache_version ,
+					(int)sizeof(FPTYPE) , potential_degree , (double)a , (double)b , (double)tol );
+	for ( k = 0 ; k < nr_params && len < (int)sizeof(key) ; k++ )
+		len += snprintf( &key[len] , sizeof(key) - len , "/%a" , params[k] );
+	if ( len >= (int)sizeof(key) )
+		key[0] = '\0';
+
+	/* fit it now unless it can be queued */
+	if ( !potential_batch_open || set == NULL || nr_params > potential_batch_maxparams )
+		return potential_fit( p , key[0] ? key : NULL , params , set , f , fp , f6p , a , b , tol );
+
+	/* make room in the batch */
+	if ( potential_nr_pending == potential_size_pending ) {
+		potential_size_pending = ( potential_size_pending == 0 ) ? 16 : 2 * potential_size_pending;
+		if ( ( job = (struct potential_pending *)realloc( potential_pending , sizeof(struct potential_pending) * potential_size_pending ) ) == NULL )
+			return error(potential_err_malloc);
+		potential_pending = job;
+	}
+
+	/* queue the table */
+	job = &potential_pending[ potential_nr_pending++ ];
+	job->p = p; job->set = set;
+	job->f = f; job->fp = fp; job->f6p = f6p;
+	for ( k = 0 ; k < nr_params ; k++ )
+		job->params[k] = params[k];
+	job->a = a; job->b = b; job->tol = tol;
+	strcpy( job->key , key );
+
+	/* set the bounds as potential_init will */
+	potential_stretch( &a , &b );
+	p->a = a; p->b = b;
+	p->c = NULL; p->n = 0;
+	p->flags |= potential_flag_pending;
+
+	return potential_err_ok;
+
+}
+
+
+/**
+ * @brief Fit the tables queued in a batch, one at a time.
+ *
+ * @param data Pointer to the index of the next table in the batch.
+ *
+ * @return @c NULL.
+ */
+
+static void *potential_batch_run ( void *data ) {
+
+	int *next = (int *)data, k;
+	struct potential_pending *job;
+
+	/* the other tables keep the processors busy */
+	potential_fit_serial = 1;
+
+	while ( ( k = __atomic_fetch_add( next , 1 , __ATOMIC_RELAXED ) ) < potential_nr_pending ) {
+		job = &potential_pending[k];
+		job->err = potential_fit( job->p , job->key[0] ? job->key : NULL , job->params , job->set ,
+								  job->f , job->fp , job->f6p , job->a , job->b , job->tol );
+	}
+
+	potential_fit_serial = 0;
+
+	return NULL;
+
+}
+
+
+/**
+ * @brief Open a batch of potential tables.
+ *
+ * @return #potential_err_ok.
+ *
+ * Until #potential_batch_end, the built-in potentials only queue their
+ * tables instead of fitting them when they are created, so that the
+ * tables of all the type pairs can be fitted at the same time.
+ */
+
+int potential_batch_begin ( void ) {
+
+	potential_batch_open = 1;
+
+	return potential_err_ok;
+
+}
+
+
+/**
+ * @brief Close the batch and fit all the tables queued in it.
+ *
+ * @return #potential_err_ok or <0 on error (see #potential_err).
+ *
+ * The tables are fitted, or read from the cache, on as many threads as
+ * there are processors, each fitting whole tables one after the other.
+ * Called by #engine_start and #engine_step, so no pending table is used.
+ */
+
+int potential_batch_end ( void ) {
+
+	struct potential_pending *job;
+	int j, k, nr_threads, next = 0, res = potential_err_ok;
+
+	/* close the batch, anything queued? */
+	potential_batch_open = 0;
+	if ( potential_nr_pending == 0 )
+		return potential_err_ok;
+
+	/* a single table may still use several threads */
+	if ( potential_nr_pending == 1 ) {
+		job = &potential_pending[0];
+		job->err = potential_fit( job->p , job->key[0] ? job->key : NULL , job->params , job->set ,
+								  job->f , job->fp , job->f6p , job->a , job->b , job->tol );
+	}
+
+	/* fit the tables, the caller doing its share last */
+	else {
+		nr_threads = sysconf( _SC_NPROCESSORS_ONLN );
+		if ( nr_threads > potential_nr_pending )
+			nr_threads = potential_nr_pending;
+		if ( nr_threads < 1 )
+			nr_threads = 1;
+		pthread_t threads[nr_threads];
+		for ( j = 1 ; j < nr_threads ; j++ )
+			if ( pthread_create( &threads[j] , NULL , &potential_batch_run , &next ) != 0 )
+				break;
+		potential_batch_run( &next );
+		for ( k = 1 ; k < j ; k++ )
+			pthread_join( threads[k] , NULL );
+	}
+
+	/* the tables are no longer pending */
+	for ( k = 0 ; k < potential_nr_pending ; k++ ) {
+		potential_pending[k].p->flags &= ~potential_flag_pending;
+		if ( potential_pending[k].err < 0 )
+			res = potential_pending[k].err;
+	}
+	potential_nr_pending = 0;
+
+	return ( res < 0 ) ? error(potential_err) : potential_err_ok;
+
+}
+
+
+/**
+ * @brief Fit the table of a pending #potential right away.
+ *
+ * @param p The #potential.
+ *
+ * @return #potential_err_ok or <0 on error (see #potential_err).
+ *
+ * Does nothing if @c p does not have #potential_flag_pending.
+ */
+
+int potential_build ( struct MxPotential *p ) {
+
+	struct potential_pending job;
+
+	if ( p == NULL )
+		return error(potential_err_null);
+
+	if ( !( p->flags & potential_flag_pending ) || !potential_unqueue( p , &job ) )
+		return potential_err_ok;
+
+	if ( potential_fit( p , job.key[0] ? job.key : NULL , job.params , job.set ,
+						job.f , job.fp , job.f6p , job.a , job.b , job.tol ) < 0 )
+		return error(potential_err);
+
+	return potential_err_ok;
+
+}
+
+
 /**
  * @brief Construct a #potential from the given function.
  *
@@ -1021,8 +1630,7 @@ int potential_init ( struct MxPotential *p , double (*f)( double ) , double (*fp
 
 	/* Stretch the domain ever so slightly to accommodate for rounding
        error when computing the index. */
-	b += fabs(b) * sqrt(FPTYPE_EPSILON);
-	a -= fabs(a) * sqrt(FPTYPE_EPSILON);
+	potential_stretch( &a , &b );
 	// printf( "potential_init: setting a=%.16e, b=%.16e.\n" , a , b );
 
 	/* set the boundaries */
@@ -1404,77 +2012,47 @@ int potential_getfp_fixend ( double (*f)( double ) , double fpa , double fpb , i
 }
 
 
+/** The work shared by the threads of #potential_getcoeffs. */
+struct potential_getcoeffs_data {
+	double (*f)( double );
+	void (*set)( const double *params , double a , double b );
+	const double *params;
+	double a, b;
+	FPTYPE *xi, *c, *coskx;
+	double *fix, *fpx;
+	int n, nr_threads, tid;
+	double err;
+};
+
+
 /**
- * @brief Compute the interpolation coefficients over a given set of nodes.
- * 
- * @param f Pointer to the function to be interpolated.
- * @param fp Pointer to the first derivative of @c f.
- * @param xi Pointer to an array of nodes between whicht the function @c f
- *      will be interpolated.
- * @param n Number of nodes in @c xi.
- * @param c Pointer to an array in which to store the interpolation
- *      coefficients.
- * @param err Pointer to a floating-point value in which an approximation of
- *      the interpolation error, relative to the maximum of f in each interval,
- *      is stored.
+ * @brief Fit every @c nr_threads-th interval, starting at @c tid.
  *
- * @return #potential_err_ok or < 0 on error (see #potential_err).
+ * @param data A #potential_getcoeffs_data, of which @c err is set.
  *
- * Compute the coefficients of the function @c f with derivative @c fp
- * over the @c n intervals between the @c xi and store an estimate of the
- * maximum locally relative interpolation error in @c err.
- *
- * The array to which @c c points must be large enough to hold at least
- * #potential_degree x @c n values of type #FPTYPE.
+ * @return @c NULL.
  */
 
-int potential_getcoeffs ( double (*f)( double ) , double (*fp)( double ) , FPTYPE *xi , int n , FPTYPE *c , FPTYPE *err ) {
+static void *potential_getcoeffs_intervals ( void *data ) {
 
-	// TODO, seriously buggy shit here!
-	// make sure all arrays are of length n+1
+	struct potential_getcoeffs_data *d = (struct potential_getcoeffs_data *)data;
+	double (*f)( double ) = d->f;
+	FPTYPE *xi = d->xi, *c = d->c, *coskx = d->coskx;
+	double *fix = d->fix, *fpx = d->fpx;
 	int i, j, k, ind;
-	double phi[7], cee[6], fa, fb, dfa, dfb, fix[n+1], fpx[n+1];
+	double phi[7], cee[6], fa, fb, dfa, dfb;
 	double h, m, w, e, err_loc, maxf, x;
 	double fx[potential_N];
-	static FPTYPE *coskx = NULL;
 
-	/* check input sanity */
-	if ( f == NULL || xi == NULL || err == NULL )
-		return error(potential_err_null);
-
-	/* Do we need to init the pre-computed cosines? */
-	if ( coskx == NULL ) {
-		if ( ( coskx = (FPTYPE *)malloc( sizeof(FPTYPE) * 7 * potential_N ) ) == NULL )
-			return error(potential_err_malloc);
-		for ( k = 0 ; k < 7 ; k++ )
-			for ( j = 0 ; j < potential_N ; j++ )
-				coskx[ k*potential_N + j ] = cos( j * k * M_PI / potential_N );
-	}
-
-	/* Get fx and fpx. */
-	for ( k = 0 ; k <= n ; k++ ) {
-		fix[k] = f( xi[k] );
-		// fpx[k] = fp( xi[k] );
-	}
-
-	/* Compute the optimal fpx. */
-	if ( fp == NULL ) {
-		if ( potential_getfp( f , n , xi , fpx ) < 0 )
-			return error(potential_err);
-	}
-	else {
-		if ( potential_getfp_fixend( f , fp(xi[0]) , fp(xi[n]) , n , xi , fpx ) < 0 )
-			return error(potential_err);
-	}
-	/* for ( k = 0 ; k <= n ; k++ )
-        printf( "potential_getcoeffs: fp[%i]=%e , fpx[%i]=%e.\n" , k , fp(xi[k]) , k , fpx[k] );
-    fflush(stdout); getchar(); */
+	/* set the parameters of f on this thread */
+	if ( d->set != NULL )
+		d->set( d->params , d->a , d->b );
 
 	/* init the maximum interpolation error */
-	*err = 0.0;
+	d->err = 0.0;
 
-	/* loop over all intervals... */
-	for ( i = 0 ; i < n ; i++ ) {
+	/* loop over this thread's intervals... */
+	for ( i = d->tid ; i < d->n ; i += d->nr_threads ) {
 
 		/* set the initial index */
 		ind = i * (potential_degree + 3);
@@ -1542,10 +2120,136 @@ int potential_getcoeffs ( double (*f)( double ) , double (*fp)( double ) , FPTYP
 			err_loc = fmax( e , err_loc );
 		}
 		err_loc /= fmax( maxf , 1.0 );
-		*err = fmax( err_loc , *err );
+		d->err = fmax( err_loc , d->err );
 
 	}
 
+	return NULL;
+
+}
+
+
+/**
+ * @brief Compute the interpolation coefficients over a given set of nodes.
+ * 
+ * @param f Pointer to the function to be interpolated.
+ * @param fp Pointer to the first derivative of @c f.
+ * @param xi Pointer to an array of nodes between whicht the function @c f
+ *      will be interpolated.
+ * @param n Number of nodes in @c xi.
+ * @param c Pointer to an array in which to store the interpolation
+ *      coefficients.
+ * @param err Pointer to a floating-point value in which an approximation of
+ *      the interpolation error, relative to the maximum of f in each interval,
+ *      is stored.
+ *
+ * @return #potential_err_ok or < 0 on error (see #potential_err).
+ *
+ * Compute the coefficients of the function @c f with derivative @c fp
+ * over the @c n intervals between the @c xi and store an estimate of the
+ * maximum locally relative interpolation error in @c err.
+ *
+ * The array to which @c c points must be large enough to hold at least
+ * #potential_degree x @c n values of type #FPTYPE.
+ *
+ * Large tables are fitted on several threads, which requires @c f to be
+ * safe to call concurrently, as is the case for all the potentials
+ * defined here, unless the table is one of a batch, see
+ * #potential_batch_end.
+ */
+
+/* the pre-computed cosines */
+static FPTYPE *potential_coskx = NULL;
+static pthread_once_t potential_coskx_once = PTHREAD_ONCE_INIT;
+
+static void potential_coskx_init ( void ) {
+
+	FPTYPE *coskx;
+	int j, k;
+
+	if ( ( coskx = (FPTYPE *)malloc( sizeof(FPTYPE) * 7 * potential_N ) ) == NULL )
+		return;
+	for ( k = 0 ; k < 7 ; k++ )
+		for ( j = 0 ; j < potential_N ; j++ )
+			coskx[ k*potential_N + j ] = cos( j * k * M_PI / potential_N );
+	potential_coskx = coskx;
+
+}
+
+
+int potential_getcoeffs ( double (*f)( double ) , double (*fp)( double ) , FPTYPE *xi , int n , FPTYPE *c , FPTYPE *err ) {
+
+	// TODO, seriously buggy shit here!
+	// make sure all arrays are of length n+1
+	int j, k, nr_threads;
+	double fix[n+1], fpx[n+1];
+	FPTYPE *coskx;
+
+	/* check input sanity */
+	if ( f == NULL || xi == NULL || err == NULL )
+		return error(potential_err_null);
+
+	/* Do we need to init the pre-computed cosines? */
+	pthread_once( &potential_coskx_once , &potential_coskx_init );
+	if ( ( coskx = potential_coskx ) == NULL )
+		return error(potential_err_malloc);
+
+	/* Get fx and fpx. */
+	for ( k = 0 ; k <= n ; k++ ) {
+		fix[k] = f( xi[k] );
+		// fpx[k] = fp( xi[k] );
+	}
+
+	/* Compute the optimal fpx. */
+	if ( fp == NULL ) {
+		if ( potential_getfp( f , n , xi , fpx ) < 0 )
+			return error(potential_err);
+	}
+	else {
+		if ( potential_getfp_fixend( f , fp(xi[0]) , fp(xi[n]) , n , xi , fpx ) < 0 )
+			return error(potential_err);
+	}
+	/* for ( k = 0 ; k <= n ; k++ )
+        printf( "potential_getcoeffs: fp[%i]=%e , fpx[%i]=%e.\n" , k , fp(xi[k]) , k , fpx[k] );
+    fflush(stdout); getchar(); */
+
+	/* how many threads are worth it? */
+	nr_threads = 1;
+	if ( n >= potential_parallel_min && !potential_fit_serial ) {
+		nr_threads = sysconf( _SC_NPROCESSORS_ONLN );
+		if ( nr_threads > n / ( potential_parallel_min / 2 ) )
+			nr_threads = n / ( potential_parallel_min / 2 );
+		if ( nr_threads < 1 )
+			nr_threads = 1;
+	}
+
+	/* fit the intervals, the caller doing its share last */
+	struct potential_getcoeffs_data data[nr_threads];
+	pthread_t threads[nr_threads];
+	for ( k = 0 ; k < nr_threads ; k++ ) {
+		data[k].f = f; data[k].xi = xi; data[k].c = c; data[k].coskx = coskx;
+		data[k].set = ( k > 0 ) ? potential_fit_set : NULL;
+		data[k].params = potential_fit_params;
+		data[k].a = potential_fit_a; data[k].b = potential_fit_b;
+		data[k].fix = fix; data[k].fpx = fpx;
+		data[k].n = n; data[k].nr_threads = nr_threads; data[k].tid = k;
+	}
+	for ( j = 1 ; j < nr_threads ; j++ )
+		if ( pthread_create( &threads[j] , NULL , &potential_getcoeffs_intervals , &data[j] ) != 0 )
+			break;
+	potential_getcoeffs_intervals( &data[0] );
+	for ( k = 1 ; k < j ; k++ )
+		pthread_join( threads[k] , NULL );
+
+	/* do the share of any thread that did not start */
+	for ( k = j ; k < nr_threads ; k++ )
+		potential_getcoeffs_intervals( &data[k] );
+
+	/* the maximum interpolation error */
+	*err = 0.0;
+	for ( k = 0 ; k < nr_threads ; k++ )
+		*err = fmax( data[k].err , *err );
+
 	/* all is well that ends well... */
 	return potential_err_ok;
 
@@ -1651,6 +2355,9 @@ static MxPotential *potential_alloc(PyTypeObject *type) {
 
     (void)PyObject_INIT(obj, type);
 
+    /* interpolated unless the constructor knows better */
+    obj->kind = potential_kind_table;
+
 
     if (PyType_IS_GC(type)) {
         assert(0 && "should not get here");
@@ -1681,6 +2388,12 @@ static PyObject *potential_call(PyObject *_self, PyObject *_args, PyObject *_kwa
         float e;
         float f;
 
+        /* a batched table may not be fitted yet */
+        if ( potential_build( self ) < 0 ) {
+            PyErr_SetString(PyExc_RuntimeError, "could not fit the potential table");
+            return NULL;
+        }
+
         potential_eval (self , r, &e, &f);
 
         return py::cast(e).release().ptr();
@@ -1782,6 +2495,35 @@ static PyObject *_coulomb(PyObject *_self, PyObject *_args, PyObject *_kwargs) {
 }
 
 
+static PyObject *_expression(PyObject *_self, PyObject *_args, PyObject *_kwargs){
+    std::cout << MX_FUNCTION << std::endl;
+    
+    try {
+        std::string f = arg<std::string>("f", 0, _args, _kwargs);
+        double min = arg<double>("min", 1, _args, _kwargs);
+        double max = arg<double>("max", 2, _args, _kwargs);
+        double tol = arg<double>("tol", 3, _args, _kwargs, 0.001 * (max-min));
+        py::dict params = arg<py::dict>("params", 4, _args, _kwargs, py::dict());
+        
+        std::map<std::string, double> consts;
+        for(auto item : params) {
+            consts[item.first.cast<std::string>()] = item.second.cast<double>();
+        }
+        
+        MxExpr expr({"r"}, consts);
+        return potential_create_expression(&expr, expr.parse(f), min, max, tol);
+    }
+    catch(py::error_already_set &e){
+        e.restore();
+        return NULL;
+    }
+    catch (const std::exception &e) {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return NULL;
+    }
+}
+
+
 static PyObject *_harmonic(PyObject *_self, PyObject *_args, PyObject *_kwargs){
     std::cout << MX_FUNCTION << std::endl;
     
@@ -1883,6 +2625,15 @@ static PyMethodDef potential_methods[] = {
         METH_VARARGS | METH_KEYWORDS | METH_STATIC,
         ""
     },
+    {
+        "expression",
+        (PyCFunction)_expression,
+        METH_VARARGS | METH_KEYWORDS | METH_STATIC,
+        "Creates a #potential from an expression in the distance r, e.g.   \n"
+        "Potential.expression('A / r^12 - B / r^6', min, max, params={'A': 1, 'B': 1}). \n"
+        "The expression is interpolated like the built-in potentials, so it \n"
+        "is just as fast to evaluate. \n"
+    },
     {
         "harmonic",
         (PyCFunction)_harmonic,
@@ -1950,6 +2701,10 @@ static PyGetSetDef potential_getset[] = {
         .name = "intervals",
         .get = [](PyObject *_obj, void *p) -> PyObject* {
             MxPotential *obj = (MxPotential*)_obj;
+            if ( potential_build( obj ) < 0 ) {
+                PyErr_SetString(PyExc_RuntimeError, "could not fit the potential table");
+                return NULL;
+            }
             return pybind11::cast(obj->n).release().ptr();
         },
         .set = [](PyObject *_obj, PyObject *val, void *p) -> int {
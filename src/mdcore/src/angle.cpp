@@ -49,7 +49,9 @@
 #include <space_cell.h>
 #include "space.h"
 #include "engine.h"
+#include "runner.h"
 #include "angle.h"
+#include "bonded_simd.h"
 
 
 /* Global variables. */
@@ -67,6 +69,133 @@ const char *angle_err_msg[2] = {
 	};
     
 
+#ifdef RUNNER_SIMD
+
+/**
+ * @brief Evaluate a list of angles in batches of @c W.
+ *
+ * @param a Pointer to an array of #angle.
+ * @param N Nr of angles in @c a.
+ * @param e Pointer to the #engine in which these angles are evaluated.
+ * @param f An array of @c 4*nr_parts forces, or @c NULL to update the
+ *      particles' own forces.
+ * @param epot_out Pointer to a double in which to aggregate the potential
+ *      energy, may be @c NULL.
+ *
+ * Does the same as #angle_eval and #angle_evalf, but gathers the rays of
+ * @c W angles at a time and computes their cosines, derivatives and
+ * potentials together.
+ */
+
+template <typename V , int W> inline static void angle_eval_batch ( struct angle *a , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+
+    int aid, pid, pjd, pkd, k, l, count, aidq[W];
+    double epot = 0.0;
+    struct space *s = &e->s;
+    struct MxParticle *pi, *pj, *pk, **partlist = s->partlist;
+    struct MxPotential *pot, **pots = e->p_angle, *potq[W];
+    FPTYPE *effi[W], *effj[W], *effk[W];
+    V rji[3], rjk[3], lim[2], inji, injk, ctheta, ee, eff, wi, wk;
+
+    /* Loop over the angles, a batch at a time. */
+    aid = 0;
+    while ( aid < N ) {
+
+        /* Gather the next batch of angles. */
+        for ( count = 0 ; aid < N && count < W ; aid++ ) {
+
+            /* Get the particles involved. */
+            pid = a[aid].i; pjd = a[aid].j; pkd = a[aid].k;
+            if ( ( pi = partlist[ pid ] ) == NULL )
+                continue;
+            if ( ( pj = partlist[ pjd ] ) == NULL )
+                continue;
+            if ( ( pk = partlist[ pkd ] ) == NULL )
+                continue;
+
+            /* Skip if all three are ghosts. */
+            if ( ( pi->flags & PARTICLE_FLAG_GHOST ) && ( pj->flags & PARTICLE_FLAG_GHOST ) && ( pk->flags & PARTICLE_FLAG_GHOST ) )
+                continue;
+
+            /* Get the potential. */
+            if ( ( pot = pots[ a[aid].pid ] ) == NULL )
+                continue;
+
+            /* Add the angle rays to the batch. */
+            bonded_simd_rel<V>( s , pid , pjd , rji , count );
+            bonded_simd_rel<V>( s , pkd , pjd , rjk , count );
+            lim[0][count] = pot->a;
+            lim[1][count] = pot->b;
+            potq[count] = pot;
+            aidq[count] = aid;
+            effi[count] = ( f != NULL ) ? &f[ 4*pid ] : pi->f;
+            effj[count] = ( f != NULL ) ? &f[ 4*pjd ] : pj->f;
+            effk[count] = ( f != NULL ) ? &f[ 4*pkd ] : pk->f;
+            count += 1;
+
+            }
+        if ( count == 0 )
+            break;
+        for ( l = count ; l < W ; l++ )
+            potq[l] = potq[0];
+        bonded_simd_pad<V,W>( rji , 3 , count );
+        bonded_simd_pad<V,W>( rjk , 3 , count );
+        bonded_simd_pad<V,W>( lim , 2 , count );
+
+        /* Compute the inverse lengths and the cosines. */
+        inji = rji[0]*rji[0] + rji[1]*rji[1] + rji[2]*rji[2];
+        injk = rjk[0]*rjk[0] + rjk[1]*rjk[1] + rjk[2]*rjk[2];
+        bonded_simd_rsqrt( &inji );
+        bonded_simd_rsqrt( &injk );
+        ctheta = ( rji[0]*rjk[0] + rji[1]*rjk[1] + rji[2]*rjk[2] ) * inji * injk;
+        ctheta = ( ctheta < -FPTYPE_ONE ) ? -FPTYPE_ONE : ctheta;
+        ctheta = ( ctheta > FPTYPE_ONE ) ? FPTYPE_ONE : ctheta;
+
+        /* Keep the cosines in the potentials' range. */
+        for ( l = 0 ; l < count ; l++ )
+            if ( ctheta[l] < lim[0][l] || ctheta[l] > lim[1][l] )
+                printf( "angle_eval[%i]: angle %i (%s-%s-%s) out of range [%e,%e], ctheta=%e.\n" ,
+                    e->nodeID , aidq[l] , e->types[ partlist[ a[aidq[l]].i ]->typeId ].name , e->types[ partlist[ a[aidq[l]].j ]->typeId ].name ,
+                    e->types[ partlist[ a[aidq[l]].k ]->typeId ].name , potq[l]->a , potq[l]->b , ctheta[l] );
+        ctheta = ( ctheta < lim[0] ) ? lim[0] : ctheta;
+        ctheta = ( ctheta > lim[1] ) ? lim[1] : ctheta;
+
+        /* Evaluate the batch. */
+        bonded_simd_eval_r( potq , &ctheta , &ee , &eff );
+
+        /* Update the forces and the energy. */
+        for ( k = 0 ; k < 3 ; k++ ) {
+            wi = eff * ( rjk[k]*injk - ctheta * rji[k]*inji ) * inji;
+            wk = eff * ( rji[k]*inji - ctheta * rjk[k]*injk ) * injk;
+            for ( l = 0 ; l < count ; l++ ) {
+                effi[l][k] -= wi[l];
+                effk[l][k] -= wk[l];
+                effj[l][k] += wi[l] + wk[l];
+                }
+            }
+        for ( l = 0 ; l < count ; l++ )
+            epot += ee[l];
+
+        } /* loop over angles. */
+
+    /* Store the potential energy. */
+    if ( epot_out != NULL )
+        *epot_out += epot;
+
+    }
+
+
+__attribute__ ((flatten,target("avx2,fma"))) static void angle_eval_avx2 ( struct angle *a , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+    angle_eval_batch<__m256,8>( a , N , e , f , epot_out );
+    }
+
+__attribute__ ((flatten,target("avx512f,avx2,fma"))) static void angle_eval_avx512 ( struct angle *a , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+    angle_eval_batch<__m512,16>( a , N , e , f , epot_out );
+    }
+
+#endif
+    
+
 /**
  * @brief Evaluate a list of angleed interactions
  *
@@ -80,7 +209,7 @@ const char *angle_err_msg[2] = {
  
 int angle_eval ( struct angle *a , int N , struct engine *e , double *epot_out ) {
 
-    int aid, pid, pjd, pkd, k, l, *loci, *locj, *lock, shift;
+    int aid, pid, pjd, pkd, k, *loci, *locj, *lock, shift;
     double h[3], epot = 0.0;
     struct space *s;
     struct MxParticle *pi, *pj, *pk, **partlist;
@@ -91,7 +220,7 @@ int angle_eval ( struct angle *a , int N , struct engine *e , double *epot_out )
     struct MxPotential **pots;
 #if defined(VECTORIZE)
     struct MxPotential *potq[VEC_SIZE];
-    int icount = 0;
+    int icount = 0, l;
     FPTYPE *effi[VEC_SIZE], *effj[VEC_SIZE], *effk[VEC_SIZE];
     FPTYPE cthetaq[VEC_SIZE] __attribute__ ((aligned (VEC_ALIGN)));
     FPTYPE ee[VEC_SIZE] __attribute__ ((aligned (VEC_ALIGN)));
@@ -104,6 +233,18 @@ int angle_eval ( struct angle *a , int N , struct engine *e , double *epot_out )
     /* Check inputs. */
     if ( a == NULL || e == NULL )
         return error(angle_err_null);
+
+#ifdef RUNNER_SIMD
+    /* Use the batched kernels if the CPU has them. */
+    if ( e->bonded_simd == runner_simd_avx512 ) {
+        angle_eval_avx512( a , N , e , NULL , epot_out );
+        return angle_err_ok;
+        }
+    else if ( e->bonded_simd == runner_simd_avx2 ) {
+        angle_eval_avx2( a , N , e , NULL , epot_out );
+        return angle_err_ok;
+        }
+#endif
         
     /* Get local copies of some variables. */
     s = &e->s;
@@ -350,6 +491,18 @@ int angle_evalf ( struct angle *a , int N , struct engine *e , FPTYPE *f , doubl
     /* Check inputs. */
     if ( a == NULL || e == NULL )
         return error(angle_err_null);
+
+#ifdef RUNNER_SIMD
+    /* Use the batched kernels if the CPU has them. */
+    if ( e->bonded_simd == runner_simd_avx512 ) {
+        angle_eval_avx512( a , N , e , f , epot_out );
+        return angle_err_ok;
+        }
+    else if ( e->bonded_simd == runner_simd_avx2 ) {
+        angle_eval_avx2( a , N , e , f , epot_out );
+        return angle_err_ok;
+        }
+#endif
         
     /* Get local copies of some variables. */
     s = &e->s;
@@ -49,7 +49,9 @@
 #include <space_cell.h>
 #include "space.h"
 #include "engine.h"
+#include "runner.h"
 #include "bond.h"
+#include "bonded_simd.h"
 
 
 /* Global variables. */
@@ -67,6 +69,120 @@ const char *bond_err_msg[2] = {
 	};
     
 
+#ifdef RUNNER_SIMD
+
+/**
+ * @brief Evaluate a list of bonds in batches of @c W.
+ *
+ * @param b Pointer to an array of #bond.
+ * @param N Nr of bonds in @c b.
+ * @param e Pointer to the #engine in which these bonds are evaluated.
+ * @param f An array of @c 4*nr_parts forces, or @c NULL to update the
+ *      particles' own forces.
+ * @param epot_out Pointer to a double in which to aggregate the potential
+ *      energy, may be @c NULL.
+ *
+ * Does the same as #bond_eval and #bond_evalf, but gathers the distance
+ * vectors of @c W bonds at a time and evaluates their potentials together.
+ */
+
+template <typename V , int W> inline static void bond_eval_batch ( struct bond *b , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+
+    int bid, pid, pjd, k, l, count, ld_pots, bidq[W];
+    double epot = 0.0;
+    struct space *s = &e->s;
+    struct MxParticle *pi, *pj, **partlist = s->partlist;
+    struct MxPotential *pot, **pots = e->p_bond, *potq[W];
+    FPTYPE *effi[W], *effj[W];
+    V dx[3], lim[2], r2, ee, eff, w;
+
+    ld_pots = e->max_type;
+
+    /* Loop over the bonds, a batch at a time. */
+    bid = 0;
+    while ( bid < N ) {
+
+        /* Gather the next batch of bonds. */
+        for ( count = 0 ; bid < N && count < W ; bid++ ) {
+
+            /* Get the particles involved. */
+            pid = b[bid].i; pjd = b[bid].j;
+            if ( ( pi = partlist[ pid ] ) == NULL )
+                continue;
+            if ( ( pj = partlist[ pjd ] ) == NULL )
+                continue;
+
+            /* Skip if both ghosts. */
+            if ( ( pi->flags & PARTICLE_FLAG_GHOST ) &&
+                 ( pj->flags & PARTICLE_FLAG_GHOST ) )
+                continue;
+
+            /* Get the potential. */
+            if ( ( pot = pots[ pj->typeId*ld_pots + pi->typeId ] ) == NULL )
+                continue;
+
+            /* Add this bond to the batch. */
+            bonded_simd_rel<V>( s , pid , pjd , dx , count );
+            lim[0][count] = pot->a*pot->a;
+            lim[1][count] = pot->b*pot->b;
+            potq[count] = pot;
+            bidq[count] = bid;
+            effi[count] = ( f != NULL ) ? &f[ 4*pid ] : pi->f;
+            effj[count] = ( f != NULL ) ? &f[ 4*pjd ] : pj->f;
+            count += 1;
+
+            }
+        if ( count == 0 )
+            break;
+        for ( l = count ; l < W ; l++ )
+            potq[l] = potq[0];
+        bonded_simd_pad<V,W>( dx , 3 , count );
+        bonded_simd_pad<V,W>( lim , 2 , count );
+
+        /* Get the squared distances and keep them in the potentials' range. */
+        r2 = dx[0]*dx[0] + dx[1]*dx[1] + dx[2]*dx[2];
+        for ( l = 0 ; l < count ; l++ )
+            if ( r2[l] < lim[0][l] || r2[l] > lim[1][l] )
+                printf( "bond_eval: bond %i (%s-%s) out of range [%e,%e], r=%e.\n" ,
+                    bidq[l] , e->types[ partlist[ b[bidq[l]].i ]->typeId ].name , e->types[ partlist[ b[bidq[l]].j ]->typeId ].name ,
+                    potq[l]->a , potq[l]->b , sqrt( r2[l] ) );
+        r2 = ( r2 < lim[0] ) ? lim[0] : r2;
+        r2 = ( r2 > lim[1] ) ? lim[1] : r2;
+
+        /* Evaluate the batch. */
+        bonded_simd_eval( potq , &r2 , &ee , &eff );
+
+        /* Update the forces and the energy. */
+        for ( k = 0 ; k < 3 ; k++ ) {
+            w = eff * dx[k];
+            for ( l = 0 ; l < count ; l++ ) {
+                effi[l][k] -= w[l];
+                effj[l][k] += w[l];
+                }
+            }
+        for ( l = 0 ; l < count ; l++ )
+            epot += ee[l];
+
+        } /* loop over bonds. */
+
+    /* Store the potential energy. */
+    if ( epot_out != NULL )
+        *epot_out += epot;
+
+    }
+
+
+__attribute__ ((flatten,target("avx2,fma"))) static void bond_eval_avx2 ( struct bond *b , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+    bond_eval_batch<__m256,8>( b , N , e , f , epot_out );
+    }
+
+__attribute__ ((flatten,target("avx512f,avx2,fma"))) static void bond_eval_avx512 ( struct bond *b , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+    bond_eval_batch<__m512,16>( b , N , e , f , epot_out );
+    }
+
+#endif
+    
+
 /**
  * @brief Evaluate a list of bonded interactoins
  *
@@ -104,6 +220,18 @@ int bond_eval ( struct bond *b , int N , struct engine *e , double *epot_out ) {
     /* Check inputs. */
     if ( b == NULL || e == NULL )
         return error(bond_err_null);
+
+#ifdef RUNNER_SIMD
+    /* Use the batched kernels if the CPU has them. */
+    if ( e->bonded_simd == runner_simd_avx512 ) {
+        bond_eval_avx512( b , N , e , NULL , epot_out );
+        return bond_err_ok;
+        }
+    else if ( e->bonded_simd == runner_simd_avx2 ) {
+        bond_eval_avx2( b , N , e , NULL , epot_out );
+        return bond_err_ok;
+        }
+#endif
         
     /* Get local copies of some variables. */
     s = &e->s;
@@ -305,6 +433,18 @@ int bond_evalf ( struct bond *b , int N , struct engine *e , FPTYPE *f , double
     /* Check inputs. */
     if ( b == NULL || e == NULL || f == NULL )
         return error(bond_err_null);
+
+#ifdef RUNNER_SIMD
+    /* Use the batched kernels if the CPU has them. */
+    if ( e->bonded_simd == runner_simd_avx512 ) {
+        bond_eval_avx512( b , N , e , f , epot_out );
+        return bond_err_ok;
+        }
+    else if ( e->bonded_simd == runner_simd_avx2 ) {
+        bond_eval_avx2( b , N , e , f , epot_out );
+        return bond_err_ok;
+        }
+#endif
         
     /* Get local copies of some variables. */
     s = &e->s;
@@ -0,0 +1,124 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* This file contains the helpers of the batched bond, angle and dihedral
+   kernels, which process eight (AVX2) or sixteen (AVX-512) interactions at
+   a time.
+
+   Each kernel is written once as a template over the vector type, using
+   only the generic vector operators, and instantiated in one entry point
+   per instruction set with the attributes "flatten" and "target". The
+   target-specific helpers below can not be always_inline, since the
+   templates themselves are compiled for the default target, and are
+   instead pulled into the entry points by "flatten".
+
+   The caller has to make sure that the CPU supports the instruction set,
+   see #runner_simd_detect and the engine's @c bonded_simd.
+*/
+
+#ifndef SRC_BONDED_SIMD_H_
+#define SRC_BONDED_SIMD_H_
+
+#ifdef RUNNER_SIMD
+
+/**
+ * @brief Replace each entry of @c x by its reciprocal square root.
+ */
+
+__attribute__ ((target("avx2,fma"))) inline static void bonded_simd_rsqrt ( __m256 *x ) {
+    *x = _mm256_div_ps( _mm256_set1_ps( 1.0f ) , _mm256_sqrt_ps( *x ) );
+    }
+
+__attribute__ ((target("avx512f,avx2,fma"))) inline static void bonded_simd_rsqrt ( __m512 *x ) {
+    *x = _mm512_div_ps( _mm512_set1_ps( 1.0f ) , _mm512_sqrt_ps( *x ) );
+    }
+
+
+/**
+ * @brief Evaluate a batch of potentials at the squared distances @c r2,
+ *      see #potential_eval_vec_8single_avx2.
+ */
+
+__attribute__ ((target("avx2,fma"))) inline static void bonded_simd_eval ( struct MxPotential **p , __m256 *r2 , __m256 *e , __m256 *f ) {
+    potential_eval_vec_8single_avx2( p , (float *)r2 , (float *)e , (float *)f );
+    }
+
+__attribute__ ((target("avx512f,avx2,fma"))) inline static void bonded_simd_eval ( struct MxPotential **p , __m512 *r2 , __m512 *e , __m512 *f ) {
+    potential_eval_vec_16single_avx512( p , (float *)r2 , (float *)e , (float *)f );
+    }
+
+
+/**
+ * @brief Evaluate a batch of potentials at the cosines @c r,
+ *      see #potential_eval_vec_8single_r_avx2.
+ */
+
+__attribute__ ((target("avx2,fma"))) inline static void bonded_simd_eval_r ( struct MxPotential **p , __m256 *r , __m256 *e , __m256 *f ) {
+    potential_eval_vec_8single_r_avx2( p , (float *)r , (float *)e , (float *)f );
+    }
+
+__attribute__ ((target("avx512f,avx2,fma"))) inline static void bonded_simd_eval_r ( struct MxPotential **p , __m512 *r , __m512 *e , __m512 *f ) {
+    potential_eval_vec_16single_r_avx512( p , (float *)r , (float *)e , (float *)f );
+    }
+
+
+/**
+ * @brief Store the position of particle @c pid relative to particle @c pjd
+ *      in lane @c l of @c dx.
+ *
+ * The particles' cells are assumed to be neighbours, possibly across the
+ * periodic boundary, as in the scalar kernels.
+ */
+
+template <typename V> __attribute__ ((always_inline)) inline static void bonded_simd_rel ( struct space *s , int pid , int pjd , V *dx , int l ) {
+
+    int k, shift, *loci = s->celllist[ pid ]->loc, *locj = s->celllist[ pjd ]->loc;
+    struct MxParticle *pi = s->partlist[ pid ], *pj = s->partlist[ pjd ];
+
+    for ( k = 0 ; k < 3 ; k++ ) {
+        shift = loci[k] - locj[k];
+        if ( shift > 1 )
+            shift = -1;
+        else if ( shift < -1 )
+            shift = 1;
+        dx[k][l] = (FPTYPE)( pi->x[k] + s->h[k]*shift ) - pj->x[k];
+        }
+
+    }
+
+
+/**
+ * @brief Fill the lanes @c count and up of the @c n vectors in @c v with
+ *      the first lane, such that a partial batch is evaluated on valid data.
+ */
+
+template <typename V , int W> __attribute__ ((always_inline)) inline static void bonded_simd_pad ( V *v , int n , int count ) {
+
+    int k, l;
+
+    for ( k = 0 ; k < n ; k++ )
+        for ( l = count ; l < W ; l++ )
+            v[k][l] = v[k][0];
+
+    }
+
+#endif
+
+#endif // SRC_BONDED_SIMD_H_
@@ -0,0 +1,226 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ * Coypright (c) 2017 Andy Somogyi (somogyie at indiana dot edu)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Include configuration header */
+#include "mdcore_config.h"
+
+/* Include some standard header files */
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Include local headers */
+#include "errs.h"
+#include "task.h"
+#include "deque.h"
+
+
+/* Global variables. */
+/** The ID of the last error. */
+int deque_err = deque_err_ok;
+
+/* the error macro. */
+#define error(id)				( deque_err = errs_register( id , deque_err_msg[-(id)] , __LINE__ , __FUNCTION__ , __FILE__ ) )
+
+/* list of error messages. */
+const char *deque_err_msg[4] = {
+	"Nothing bad happened.",
+    "An unexpected NULL pointer was encountered.",
+    "A call to malloc failed, probably due to insufficient memory.",
+    "Attempted to push onto a full deque."
+	};
+
+
+/*
+ * The memory orderings below follow Le, Pop, Cohen and Zappa Nardelli,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013.
+ */
+
+
+/**
+ * @brief Push a task onto the bottom of the deque.
+ *
+ * @param d The #deque.
+ * @param t The #task to push.
+ *
+ * @return 1 on success, 0 if the deque is full.
+ *
+ * Only the owner of the deque may call this function.
+ */
+
+int deque_push ( struct deque *d , struct task *t ) {
+
+    long b, top;
+
+    b = __atomic_load_n( &d->bottom , __ATOMIC_RELAXED );
+    top = __atomic_load_n( &d->top , __ATOMIC_ACQUIRE );
+
+    /* Is there any space left? */
+    if ( b - top > d->mask )
+        return 0;
+
+    /* Store the task and publish it. */
+    __atomic_store_n( &d->tasks[ b & d->mask ] , t , __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+    __atomic_store_n( &d->bottom , b + 1 , __ATOMIC_RELAXED );
+
+    return 1;
+
+    }
+
+
+/**
+ * @brief Pop the most recently pushed task from the deque.
+ *
+ * @param d The #deque.
+ *
+ * @return A #task or @c NULL if the deque is empty.
+ *
+ * Only the owner of the deque may call this function.
+ */
+
+struct task *deque_pop ( struct deque *d ) {
+
+    long b, top;
+    struct task *t;
+
+    /* Reserve the bottom entry. */
+    b = __atomic_load_n( &d->bottom , __ATOMIC_RELAXED ) - 1;
+    __atomic_store_n( &d->bottom , b , __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    top = __atomic_load_n( &d->top , __ATOMIC_RELAXED );
+
+    /* Was the deque empty? */
+    if ( top > b ) {
+        __atomic_store_n( &d->bottom , b + 1 , __ATOMIC_RELAXED );
+        return NULL;
+        }
+
+    /* Get the entry. */
+    t = __atomic_load_n( &d->tasks[ b & d->mask ] , __ATOMIC_RELAXED );
+
+    /* If this was the last entry, race the thieves for it. */
+    if ( top == b ) {
+        if ( !__atomic_compare_exchange_n( &d->top , &top , top + 1 , 0 , __ATOMIC_SEQ_CST , __ATOMIC_RELAXED ) )
+            t = NULL;
+        __atomic_store_n( &d->bottom , b + 1 , __ATOMIC_RELAXED );
+        }
+
+    return t;
+
+    }
+
+
+/**
+ * @brief Steal the oldest task from the deque.
+ *
+ * @param d The #deque.
+ *
+ * @return A #task or @c NULL if the deque is empty or the
+ *      steal lost a race with the owner or another thief.
+ */
+
+struct task *deque_steal ( struct deque *d ) {
+
+    long b, top;
+    struct task *t;
+
+    top = __atomic_load_n( &d->top , __ATOMIC_ACQUIRE );
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    b = __atomic_load_n( &d->bottom , __ATOMIC_ACQUIRE );
+
+    /* Anything there? */
+    if ( top >= b )
+        return NULL;
+
+    /* Get the entry and try to claim it. */
+    t = __atomic_load_n( &d->tasks[ top & d->mask ] , __ATOMIC_RELAXED );
+    if ( !__atomic_compare_exchange_n( &d->top , &top , top + 1 , 0 , __ATOMIC_SEQ_CST , __ATOMIC_RELAXED ) )
+        return NULL;
+
+    return t;
+
+    }
+
+
+/**
+ * @brief Empty the deque.
+ *
+ * @param d The #deque.
+ *
+ * Must not be called while any other thread is using the deque.
+ */
+
+void deque_reset ( struct deque *d ) {
+
+    d->top = 0;
+    d->bottom = 0;
+
+    }
+
+
+/**
+ * @brief Release the memory associated with a deque.
+ *
+ * @param d The #deque.
+ */
+
+void deque_free ( struct deque *d ) {
+
+    free( d->tasks );
+    d->tasks = NULL;
+    d->mask = -1;
+
+    }
+
+
+/**
+ * @brief Initialize a work-stealing deque.
+ *
+ * @param d The #deque to initialize.
+ * @param size The minimum number of tasks the deque should hold.
+ *
+ * @return #deque_err_ok or <0 on error (see #deque_err).
+ *
+ * The buffer is rounded up to the next power of two.
+ */
+
+int deque_init ( struct deque *d , int size ) {
+
+    long k;
+
+    /* Sanity check. */
+    if ( d == NULL )
+        return error(deque_err_null);
+
+    /* Round the size up to a power of two. */
+    for ( k = 1 ; k < size ; k <<= 1 );
+
+    /* Allocate the buffer. */
+    if ( ( d->tasks = (struct task **)malloc( sizeof(struct task *) * k ) ) == NULL )
+        return error(deque_err_malloc);
+    d->mask = k - 1;
+
+    /* Start empty. */
+    deque_reset( d );
+
+    /* Nothing to see here. */
+    return deque_err_ok;
+
+    }
@@ -49,7 +49,9 @@
 #include <space_cell.h>
 #include "space.h"
 #include "engine.h"
+#include "runner.h"
 #include "dihedral.h"
+#include "bonded_simd.h"
 
 
 /* Global variables. */
@@ -67,6 +69,192 @@ const char *dihedral_err_msg[2] = {
 	};
     
 
+#ifdef RUNNER_SIMD
+
+/**
+ * @brief Evaluate a list of dihedrals in batches of @c W.
+ *
+ * @param d Pointer to an array of #dihedral.
+ * @param N Nr of dihedrals in @c d.
+ * @param e Pointer to the #engine in which these dihedrals are evaluated.
+ * @param f An array of @c 4*nr_parts forces, or @c NULL to update the
+ *      particles' own forces.
+ * @param epot_out Pointer to a double in which to aggregate the potential
+ *      energy, may be @c NULL.
+ *
+ * Does the same as #dihedral_eval and #dihedral_evalf, but gathers the
+ * positions of @c W dihedrals at a time, relative to their particle @c j,
+ * and computes their torsion cosines, derivatives and potentials together.
+ */
+
+template <typename V , int W> inline static void dihedral_eval_batch ( struct dihedral *d , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+
+    int did, pid, pjd, pkd, pld, k, l, count, didq[W];
+    double epot = 0.0;
+    struct space *s = &e->s;
+    struct MxParticle *pi, *pj, *pk, *pl, **partlist = s->partlist;
+    struct MxPotential *pot, **pots = e->p_dihedral, *potq[W];
+    FPTYPE *effi[W], *effj[W], *effk[W], *effl[W];
+    V xi[3], xk[3], xl[3], lim[2], dxi[3], dxj[3], dxl[3], cphi, ee, eff, wi, wj, wl;
+    V t1, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19, t20, t21,
+        t22, t24, t26, t3, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39, t40,
+        t41, t42, t43, t44, t45, t46, t47, t5, t6, t7, t8, t9;
+
+    /* Loop over the dihedrals, a batch at a time. */
+    did = 0;
+    while ( did < N ) {
+
+        /* Gather the next batch of dihedrals. */
+        for ( count = 0 ; did < N && count < W ; did++ ) {
+
+            /* Get the particles involved. */
+            pid = d[did].i; pjd = d[did].j; pkd = d[did].k; pld = d[did].l;
+            if ( ( pi = partlist[ pid ] ) == NULL )
+                continue;
+            if ( ( pj = partlist[ pjd ] ) == NULL )
+                continue;
+            if ( ( pk = partlist[ pkd ] ) == NULL )
+                continue;
+            if ( ( pl = partlist[ pld ] ) == NULL )
+                continue;
+
+            /* Skip if all four are ghosts. */
+            if ( ( pi->flags & PARTICLE_FLAG_GHOST ) &&
+                 ( pj->flags & PARTICLE_FLAG_GHOST ) &&
+                 ( pk->flags & PARTICLE_FLAG_GHOST ) &&
+                 ( pl->flags & PARTICLE_FLAG_GHOST ) )
+                continue;
+
+            /* Get the potential. */
+            if ( ( pot = pots[ d[did].pid ] ) == NULL )
+                continue;
+
+            /* Add the positions relative to pj to the batch. */
+            bonded_simd_rel<V>( s , pid , pjd , xi , count );
+            bonded_simd_rel<V>( s , pkd , pjd , xk , count );
+            bonded_simd_rel<V>( s , pld , pjd , xl , count );
+            lim[0][count] = pot->a;
+            lim[1][count] = pot->b;
+            potq[count] = pot;
+            didq[count] = did;
+            effi[count] = ( f != NULL ) ? &f[ 4*pid ] : pi->f;
+            effj[count] = ( f != NULL ) ? &f[ 4*pjd ] : pj->f;
+            effk[count] = ( f != NULL ) ? &f[ 4*pkd ] : pk->f;
+            effl[count] = ( f != NULL ) ? &f[ 4*pld ] : pl->f;
+            count += 1;
+
+            }
+        if ( count == 0 )
+            break;
+        for ( l = count ; l < W ; l++ )
+            potq[l] = potq[0];
+        bonded_simd_pad<V,W>( xi , 3 , count );
+        bonded_simd_pad<V,W>( xk , 3 , count );
+        bonded_simd_pad<V,W>( xl , 3 , count );
+        bonded_simd_pad<V,W>( lim , 2 , count );
+
+        /* This is the Maple-generated code of #dihedral_eval with xj = 0. */
+        t16 = xl[2]-xk[2];
+        t17 = xl[1]-xk[1];
+        t18 = xl[0]-xk[0];
+        t10 = t18*t18+t17*t17+t16*t16;
+        t19 = xk[2];
+        t20 = xk[1];
+        t21 = xk[0];
+        t11 = t21*t21+t20*t20+t19*t19;
+        t7 = t18*t21+t17*t20+t16*t19;
+        t5 = t11*t10-t7*t7;
+        t22 = xi[2];
+        t24 = xi[1];
+        t26 = xi[0];
+        t12 = t26*t26+t24*t24+t22*t22;
+        t9 = -t26*t21-t24*t20-t22*t19;
+        t6 = t12*t11-t9*t9;
+        t3 = t6*t5;
+        t1 = t3;
+        bonded_simd_rsqrt( &t1 );
+        t8 = -t26*t18-t24*t17-t22*t16;
+        t47 = (t9*t7-t8*t11)*t1;
+        t46 = FPTYPE_TWO*t8;
+        t45 = t6*t7;
+        t44 = t9*t5;
+        t43 = t6*t10;
+        t42 = -t9-t11;
+        t41 = t22*t11;
+        t40 = t24*t11;
+        t39 = t26*t11;
+        t38 = t1*t1*t47;
+        t37 = -t7*t19+t16*t11;
+        t36 = -t7*t20+t17*t11;
+        t35 = -t7*t21+t18*t11;
+        t34 = t9*t19+t41;
+        t33 = t9*t20+t40;
+        t32 = t9*t21+t39;
+        t31 = t5*t38;
+        t30 = t6*t38;
+        t15 = xk[0]+xi[0];
+        t14 = xk[1]+xi[1];
+        t13 = xk[2]+xi[2];
+        dxi[0] = t35*t1-t32*t31;
+        dxi[1] = t36*t1-t33*t31;
+        dxi[2] = t37*t1-t34*t31;
+        dxj[0] = (t15*t7+t21*t46+t42*t18)*t1-(-t15*t44+t18*t45+(-t39-t12*t21)*t5-t21*t43)*t38;
+        dxj[1] = (t14*t7+t20*t46+t42*t17)*t1-(-t14*t44+t17*t45+(-t40-t12*t20)*t5-t20*t43)*t38;
+        dxj[2] = (t13*t7+t19*t46+t42*t16)*t1-(-t13*t44+t16*t45+(-t41-t12*t19)*t5-t19*t43)*t38;
+        dxl[0] = t32*t1-t35*t30;
+        dxl[1] = t33*t1-t36*t30;
+        dxl[2] = t34*t1-t37*t30;
+        cphi = ( t47 < -FPTYPE_ONE ) ? -FPTYPE_ONE : t47;
+        cphi = ( cphi > FPTYPE_ONE ) ? FPTYPE_ONE : cphi;
+
+        /* Keep the cosines in the potentials' range. */
+        for ( l = 0 ; l < count ; l++ )
+            if ( cphi[l] < lim[0][l] || cphi[l] > lim[1][l] )
+                printf( "dihedral_eval: dihedral %i (%s-%s-%s-%s) out of range [%e,%e], cphi=%e.\n" ,
+                    didq[l] , e->types[ partlist[ d[didq[l]].i ]->typeId ].name , e->types[ partlist[ d[didq[l]].j ]->typeId ].name ,
+                    e->types[ partlist[ d[didq[l]].k ]->typeId ].name , e->types[ partlist[ d[didq[l]].l ]->typeId ].name ,
+                    potq[l]->a , potq[l]->b , cphi[l] );
+        cphi = ( cphi < lim[0] ) ? lim[0] : cphi;
+        cphi = ( cphi > lim[1] ) ? lim[1] : cphi;
+
+        /* Evaluate the batch. */
+        bonded_simd_eval_r( potq , &cphi , &ee , &eff );
+
+        /* Update the forces and the energy. */
+        for ( k = 0 ; k < 3 ; k++ ) {
+            wi = eff * dxi[k];
+            wj = eff * dxj[k];
+            wl = eff * dxl[k];
+            for ( l = 0 ; l < count ; l++ ) {
+                effi[l][k] -= wi[l];
+                effj[l][k] -= wj[l];
+                effl[l][k] -= wl[l];
+                effk[l][k] += wi[l] + wj[l] + wl[l];
+                }
+            }
+        for ( l = 0 ; l < count ; l++ )
+            epot += ee[l];
+
+        } /* loop over dihedrals. */
+
+    /* Store the potential energy. */
+    if ( epot_out != NULL )
+        *epot_out += epot;
+
+    }
+
+
+__attribute__ ((flatten,target("avx2,fma"))) static void dihedral_eval_avx2 ( struct dihedral *d , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+    dihedral_eval_batch<__m256,8>( d , N , e , f , epot_out );
+    }
+
+__attribute__ ((flatten,target("avx512f,avx2,fma"))) static void dihedral_eval_avx512 ( struct dihedral *d , int N , struct engine *e , FPTYPE *f , double *epot_out ) {
+    dihedral_eval_batch<__m512,16>( d , N , e , f , epot_out );
+    }
+
+#endif
+    
+
 /**
  * @brief Evaluate a list of dihedraled interactions
  *
@@ -109,6 +297,18 @@ int dihedral_eval ( struct dihedral *d , int N , struct engine *e , double *epot
     /* Check inputs. */
     if ( d == NULL || e == NULL )
         return error(dihedral_err_null);
+
+#ifdef RUNNER_SIMD
+    /* Use the batched kernels if the CPU has them. */
+    if ( e->bonded_simd == runner_simd_avx512 ) {
+        dihedral_eval_avx512( d , N , e , NULL , epot_out );
+        return dihedral_err_ok;
+        }
+    else if ( e->bonded_simd == runner_simd_avx2 ) {
+        dihedral_eval_avx2( d , N , e , NULL , epot_out );
+        return dihedral_err_ok;
+        }
+#endif
         
     /* Get local copies of some variables. */
     s = &e->s;
@@ -423,6 +623,18 @@ int dihedral_evalf ( struct dihedral *d , int N , struct engine *e , FPTYPE *f ,
     /* Check inputs. */
     if ( d == NULL || e == NULL )
         return error(dihedral_err_null);
+
+#ifdef RUNNER_SIMD
+    /* Use the batched kernels if the CPU has them. */
+    if ( e->bonded_simd == runner_simd_avx512 ) {
+        dihedral_eval_avx512( d , N , e , f , epot_out );
+        return dihedral_err_ok;
+        }
+    else if ( e->bonded_simd == runner_simd_avx2 ) {
+        dihedral_eval_avx2( d , N , e , f , epot_out );
+        return dihedral_err_ok;
+        }
+#endif
         
     /* Get local copies of some variables. */
     s = &e->s;
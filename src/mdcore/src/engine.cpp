@@ -38,6 +38,18 @@
 #include <metis.h>
 #endif
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <sched.h>
+#endif
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#include <limits.h>
+
 #ifdef _OPENMP
 #include <omp.h>
 #else
@@ -54,6 +66,7 @@
 #include <space_cell.h>
 #include "task.h"
 #include "queue.h"
+#include "deque.h"
 #include "space.h"
 #include <MxPotential.h>
 #include "runner.h"
@@ -63,6 +76,7 @@
 #include "dihedral.h"
 #include "exclusion.h"
 #include "reader.h"
+#include "spme.h"
 #include "engine.h"
 #include "MxForce.h"
 
@@ -92,7 +106,7 @@ MxParticleData *engine::types = NULL;
 #define error(id)				( engine_err = errs_register( id , engine_err_msg[-(id)] , __LINE__ , __FUNCTION__ , __FILE__ ) )
 
 /* list of error messages. */
-const char *engine_err_msg[29] = {
+const char *engine_err_msg[30] = {
 		"Nothing bad happened.",
 		"An unexpected NULL pointer was encountered.",
 		"A call to malloc failed, probably due to insufficient memory.",
@@ -122,8 +136,13 @@ const char *engine_err_msg[29] = {
 		"An error occured when evaluating a rigid constraint.",
 		"Cell cutoff size doesn't work with METIS",
 		"METIS library undefined",
+		"An error occured when calling an spme function.",
 };
 
+/* Barrier helpers, see #engine_barrier. */
+static void engine_barrier_join ( struct engine *e );
+static void engine_barrier_fork ( struct engine *e );
+
 
 /**
  * @brief Re-shuffle the particles in the engine.
@@ -144,6 +163,8 @@ int engine_shuffle ( struct engine *e ) {
     for ( cid = 0 ; cid < s->nr_ghost ; cid++ ) {
 		space_cell_flush( &(s->cells[s->cid_ghost[cid]]) , s->partlist , s->celllist );
     }
+	if ( s->nr_ghost > 0 )
+		s->parts_moved = 1;
 
 	/* Shuffle the domain. */
     if ( space_shuffle_local( s ) < 0 ) {
@@ -170,6 +191,13 @@ int engine_shuffle ( struct engine *e ) {
 		}
 	}
 
+	/* Re-sort the particles along the space-filling curve, either now that
+	   the lists are re-built or every few steps. */
+	if ( s->sfc != space_sfc_none &&
+		 ( ( e->flags & engine_flag_verlet ) || e->time % space_sfc_resort == 0 ) )
+		if ( space_sfc_sortparts( s ) < 0 )
+			return error(engine_err_space);
+
 	/* return quietly */
 	return engine_err_ok;
 
@@ -196,6 +224,13 @@ int engine_timers_reset ( struct engine *e ) {
 	for ( k = 0 ; k < engine_timer_last ; k++ )
 		e->timers[k] = 0;
 
+	/* Same for the runners' socket traffic counts, if they exist yet. */
+	if ( ( e->flags & engine_flag_initialized ) && e->runners != NULL )
+		for ( k = 0 ; k < e->nr_runners ; k++ ) {
+			e->runners[k].numa_local = 0;
+			e->runners[k].numa_remote = 0;
+		}
+
 	/* What, that's it? */
 	return engine_err_ok;
 
@@ -227,8 +262,11 @@ int engine_verlet_update ( struct engine *e ) {
 	if ( !(e->flags & engine_flag_verlet) )
 		return engine_err_ok;
 
-	/* Get the skin width. */
-	skin = fmin( s->h[0] , fmin( s->h[1] , s->h[2] ) ) - s->cutoff;
+	/* Get the skin width, the sorted cell pairs use all of the cell. */
+	if ( e->flags & ( engine_flag_verlet_list | engine_flag_cluster ) )
+		skin = s->verlet_skin;
+	else
+		skin = fmin( s->h[0] , fmin( s->h[1] , s->h[2] ) ) - s->cutoff;
 
 	/* Get the maximum particle movement. */
 	if ( !s->verlet_rebuild ) {
@@ -283,6 +321,10 @@ if ( ( e->flags & engine_flag_mpi ) && ( e->nr_nodes > 1 ) ) {
 	/* Do we have to rebuild the Verlet list? */
 	if ( s->verlet_rebuild ) {
 
+		/* Keep count. */
+		s->verlet_nr_rebuilds += 1;
+		s->verlet_age = 0;
+
 		/* printf("engine_verlet_update: re-building verlet lists next step...\n");
         printf("engine_verlet_update: maxdx=%e, skin=%e.\n",maxdx,skin); */
 
@@ -323,8 +365,10 @@ if ( ( e->flags & engine_flag_mpi ) && ( e->nr_nodes > 1 ) ) {
 	}
 
 	/* Otherwise, just store the maximum displacement. */
-	else
+	else {
 		s->maxdx = maxdx;
+		s->verlet_age += 1;
+	}
 
 	/* All done! */
 	return engine_err_ok;
@@ -333,1419 +377,2848 @@ if ( ( e->flags & engine_flag_mpi ) && ( e->nr_nodes > 1 ) ) {
 
 
 /**
- * @brief Set-up the engine for distributed-memory parallel operation.
+ * @brief Set the skin of the Verlet lists.
  *
- * @param e The #engine to set-up.
+ * @param e The #engine.
+ * @param skin The distance beyond the cutoff up to which pairs are
+ *      kept in the neighbour lists.
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * This function assumes that #engine_split_bisect or some similar
- * function has already been called and that #nodeID, #nr_nodes as
- * well as the #cell @c nodeIDs have been set.
+ * Only used with #engine_flag_verlet_list and #engine_flag_cluster. The
+ * lists are re-built as soon
+ * as a particle has moved by more than half the skin, so a larger skin
+ * means fewer rebuilds but longer lists. Since only neighbouring cells are
+ * searched, the skin may not exceed the cell edge length minus the cutoff,
+ * which is also the default.
  */
-int engine_split ( struct engine *e ) {
 
-	int i, k, cid, cjd;
-	struct space_cell *ci, *cj, *ct;
-	struct space *s = &(e->s);
+int engine_verlet_setskin ( struct engine *e , double skin ) {
 
-	/* Check for nonsense inputs. */
+	struct space *s;
+
+	/* Check the inputs. */
 	if ( e == NULL )
 		return error(engine_err_null);
+	s = &e->s;
+	if ( skin < 0.0 || s->cutoff + skin > fmin( s->h[0] , fmin( s->h[1] , s->h[2] ) ) )
+		return error(engine_err_range);
 
-	/* Start by allocating and initializing the send/recv lists. */
-	if ( ( e->send = (struct engine_comm *)malloc( sizeof(struct engine_comm) * e->nr_nodes ) ) == NULL ||
-			( e->recv = (struct engine_comm *)malloc( sizeof(struct engine_comm) * e->nr_nodes ) ) == NULL )
-		return error(engine_err_malloc);
-	for ( k = 0 ; k < e->nr_nodes ; k++ ) {
-		if ( ( e->send[k].cellid = (int *)malloc( sizeof(int) * 100 ) ) == NULL )
-			return error(engine_err_malloc);
-		e->send[k].size = 100;
-		e->send[k].count = 0;
-		if ( ( e->recv[k].cellid = (int *)malloc( sizeof(int) * 100 ) ) == NULL )
-			return error(engine_err_malloc);
-		e->recv[k].size = 100;
-		e->recv[k].count = 0;
-	}
+	/* Store it and start over. */
+	s->verlet_skin = skin;
+	s->verlet_rebuild = 1;
 
-	/* Un-mark all cells. */
-	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
-		s->cells[cid].flags &= ~cell_flag_marked;
+	return engine_err_ok;
 
-	/* Loop over each cell pair... */
-	for ( i = 0 ; i < s->nr_tasks ; i++ ) {
+}
 
-		/* Is this task a pair? */
-		if ( s->tasks[i].type != task_type_pair )
-			continue;
 
-		/* Get the cells in this pair. */
-		cid = s->tasks[i].i;
-		cjd = s->tasks[i].j;
-		ci = &( s->cells[ cid ] );
-		cj = &( s->cells[ cjd ] );
+/**
+ * @brief Set the number of particles per cluster.
+ *
+ * @param e The #engine.
+ * @param size The number of particles per cluster, either 4 or 8.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Only used with #engine_flag_cluster. Larger clusters mean fewer list
+ * entries and wider tiles, but more interactions computed beyond the
+ * cutoff. The clusters are re-formed at the next step.
+ */
 
-		/* If it is a ghost-ghost pair, skip it. */
-		if ( (ci->flags & cell_flag_ghost) && (cj->flags & cell_flag_ghost) )
-			continue;
+int engine_cluster_setsize ( struct engine *e , int size ) {
 
-		/* Mark the cells. */
-		ci->flags |= cell_flag_marked;
-		cj->flags |= cell_flag_marked;
+	/* Check the inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+	if ( size != 4 && size != space_cluster_maxsize )
+		return error(engine_err_range);
 
-		/* Make cj the ghost cell and bail if both are real. */
-		if ( ci->flags & cell_flag_ghost ) {
-			ct = ci; ci = cj; cj = ct;
-			k = cid; cid = cjd; cjd = k;
-		}
-		else if ( !( cj->flags & cell_flag_ghost ) )
-			continue;
+	/* Store it and start over. */
+	e->s.verlet_clustersize = size;
+	e->s.verlet_rebuild = 1;
 
-		/* Store the communication between cid and cjd. */
-		/* Store the send, if not already there... */
-		for ( k = 0 ; k < e->send[cj->nodeID].count && e->send[cj->nodeID].cellid[k] != cid ; k++ );
-		if ( k == e->send[cj->nodeID].count ) {
-			if ( e->send[cj->nodeID].count == e->send[cj->nodeID].size ) {
-				e->send[cj->nodeID].size += 100;
-				if ( ( e->send[cj->nodeID].cellid = (int *)realloc( e->send[cj->nodeID].cellid , sizeof(int) * e->send[cj->nodeID].size ) ) == NULL )
-					return error(engine_err_malloc);
-			}
-			e->send[cj->nodeID].cellid[ e->send[cj->nodeID].count++ ] = cid;
-		}
-		/* Store the recv, if not already there... */
-		for ( k = 0 ; k < e->recv[cj->nodeID].count && e->recv[cj->nodeID].cellid[k] != cjd ; k++ );
-		if ( k == e->recv[cj->nodeID].count ) {
-			if ( e->recv[cj->nodeID].count == e->recv[cj->nodeID].size ) {
-				e->recv[cj->nodeID].size += 100;
-				if ( ( e->recv[cj->nodeID].cellid = (int *)realloc( e->recv[cj->nodeID].cellid , sizeof(int) * e->recv[cj->nodeID].size ) ) == NULL )
-					return error(engine_err_malloc);
-			}
-			e->recv[cj->nodeID].cellid[ e->recv[cj->nodeID].count++ ] = cjd;
-		}
+	return engine_err_ok;
 
-	}
+}
 
-	/* Nuke all ghost-ghost tasks. */
-	i = 0;
-	while ( i < s->nr_tasks ) {
 
-		/* Pair? */
-		if ( s->tasks[i].type == task_type_pair ) {
+/**
+ * @brief Get some statistics on the Verlet lists.
+ *
+ * @param e The #engine.
+ * @param nr_rebuilds Pointer to an int in which to store the number of
+ *      times the lists were re-built, or @c NULL.
+ * @param age Pointer to an int in which to store the number of steps since
+ *      the last rebuild, or @c NULL.
+ * @param maxdx Pointer to a double in which to store the largest particle
+ *      displacement since the last rebuild, or @c NULL.
+ * @param nr_entries Pointer to a long in which to store the total length
+ *      of the neighbour lists (see #engine_flag_verlet_list), or the total
+ *      number of cluster pairs (see #engine_flag_cluster), or @c NULL.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The average number of steps between rebuilds is @c e->time divided by
+ * the number of rebuilds.
+ */
 
-			/* Get the cells in this pair. */
-			ci = &( s->cells[ s->tasks[i].i ] );
-			cj = &( s->cells[ s->tasks[i].j ] );
+int engine_verlet_stats ( struct engine *e , int *nr_rebuilds , int *age , double *maxdx , long *nr_entries ) {
 
-			/* If it is a ghost-ghost pair, skip it. */
-			if ( (ci->flags & cell_flag_ghost) && (cj->flags & cell_flag_ghost) )
-				s->tasks[i] = s->tasks[ --(s->nr_tasks) ];
-			else
-				i += 1;
+	struct space *s;
+	struct space_cell *c;
+	long count = 0;
+	int cid;
 
+	if ( e == NULL )
+		return error(engine_err_null);
+	s = &e->s;
+
+	if ( nr_rebuilds != NULL )
+		*nr_rebuilds = s->verlet_nr_rebuilds;
+	if ( age != NULL )
+		*age = s->verlet_age;
+	if ( maxdx != NULL )
+		*maxdx = s->maxdx;
+	if ( nr_entries != NULL ) {
+		for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+			c = &s->cells[ s->cid_real[cid] ];
+			if ( c->nlist_offset != NULL )
+				count += c->nlist_offset[ c->nlist_count ];
+			if ( c->clu_offset != NULL )
+				count += c->clu_offset[ c->nr_clusters ];
 		}
+		*nr_entries = count;
+	}
 
-		/* Self? */
-		else if ( s->tasks[i].type == task_type_self ) {
+	return engine_err_ok;
 
-			/* Get the cells in this pair. */
-			ci = &( s->cells[ s->tasks[i].i ] );
+}
 
-			/* If it is a ghost-ghost pair, skip it. */
-			if ( ci->flags & cell_flag_ghost )
-				s->tasks[i] = s->tasks[ --(s->nr_tasks) ];
-			else
-				i += 1;
 
-		}
+/**
+ * @brief Get the first entry of @c cid_real owned by a #runner, see
+ *      #engine_flag_numa.
+ *
+ * The real cells are owned in contiguous blocks along @c cid_real, i.e.
+ * the runner @c rid owns the entries from @c engine_numa_first(rid) up
+ * to, but not including, @c engine_numa_first(rid+1).
+ */
 
-		/* Sort? */
-		else if ( s->tasks[i].type == task_type_sort ) {
+static inline int engine_numa_first ( int rid , int nr_real , int nr_runners ) {
 
-			/* Get the cells in this pair. */
-			ci = &( s->cells[ s->tasks[i].i ] );
+	return ( (long)rid * nr_real + nr_runners - 1 ) / nr_runners;
 
-			/* If it is a ghost-ghost pair, skip it. */
-			if ( !(ci->flags & cell_flag_marked) )
-				s->tasks[i] = s->tasks[ --(s->nr_tasks) ];
-			else
-				i += 1;
+}
 
-		}
 
+/**
+ * @brief Hand out the real and ghost cells to the runners in contiguous
+ *      blocks of their @c cid lists, see #engine_flag_numa.
+ */
+
+static void engine_numa_cells ( struct engine *e ) {
+
+	struct space *s = &e->s;
+	int k;
+
+	for ( k = 0 ; k < s->nr_real ; k++ )
+		s->cells_owner[ s->cid_real[k] ] = (long)k * e->nr_runners / s->nr_real;
+	for ( k = 0 ; k < s->nr_ghost ; k++ )
+		s->cells_owner[ s->cid_ghost[k] ] = (long)k * e->nr_runners / s->nr_ghost;
+
+}
+
+
+/**
+ * @brief Assign the runners to CPUs and sockets and the cells to the
+ *      runners.
+ *
+ * @param e The #engine, with @c e->runners allocated but not yet
+ *      initialized.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Without #engine_flag_numa, the @c i-th runner goes to the @c i-th CPU
+ * on a single socket. Otherwise, the sockets are read from the CPU
+ * topology in @c /sys and the runners are spread over them in contiguous
+ * blocks, each runner pinned to a CPU of its socket. The real and ghost
+ * cells are then handed out in contiguous blocks of their @c cid lists,
+ * so that, with #space_sfc_order, each runner owns a compact region.
+ */
+
+static int engine_numa_place ( struct engine *e ) {
+
+	struct runner *r;
+	int nr_runners = e->nr_runners, nr_cpus, nr_sockets = 1;
+	int i, k, cpu, pkg, *socket_id, *socket_cpus, *socket_count;
+	char path[100];
+	FILE *fd;
+
+	/* Default: one socket, runner i on CPU i. */
+	for ( i = 0 ; i < nr_runners ; i++ ) {
+		r = &e->runners[i];
+		r->cpu = i;
+		r->socket = 0;
+		r->socket_first = 0;
+		r->socket_count = nr_runners;
 	}
+	e->nr_sockets = 1;
+	if ( !( e->flags & engine_flag_numa ) || nr_runners == 0 )
+		return engine_err_ok;
 
-	/* Clear all task dependencies and re-link each sort task with its cell. */
-	for ( i = 0 ; i < s->nr_tasks ; i++ ) {
-		s->tasks[i].nr_unlock = 0;
-		if ( s->tasks[i].type == task_type_sort ) {
-			s->cells[ s->tasks[i].i ].sort = &s->tasks[i];
-			s->tasks[i].flags = 0;
+	/* Get the socket of each CPU, numbering them in order of appearance. */
+	if ( ( nr_cpus = sysconf( _SC_NPROCESSORS_ONLN ) ) < 1 )
+		nr_cpus = 1;
+	socket_id = (int *)alloca( sizeof(int) * nr_cpus );
+	socket_count = (int *)alloca( sizeof(int) * nr_cpus );
+	if ( ( socket_cpus = (int *)malloc( sizeof(int) * nr_cpus * nr_cpus ) ) == NULL )
+		return error(engine_err_malloc);
+	nr_sockets = 0;
+	for ( cpu = 0 ; cpu < nr_cpus ; cpu++ ) {
+		pkg = 0;
+		snprintf( path , sizeof(path) , "/sys/devices/system/cpu/cpu%i/topology/physical_package_id" , cpu );
+		if ( ( fd = fopen( path , "r" ) ) != NULL ) {
+			if ( fscanf( fd , "%i" , &pkg ) != 1 )
+				pkg = 0;
+			fclose( fd );
+		}
+		for ( k = 0 ; k < nr_sockets && socket_id[k] != pkg ; k++ );
+		if ( k == nr_sockets ) {
+			socket_id[k] = pkg;
+			socket_count[k] = 0;
+			nr_sockets += 1;
 		}
+		socket_cpus[ k*nr_cpus + socket_count[k]++ ] = cpu;
 	}
 
-	/* Run through the tasks and make each pair depend on the sorts.
-       Also set the flags for each sort. */
-	for ( k = 0 ; k < s->nr_tasks ; k++ )
-		if ( s->tasks[k].type == task_type_pair ) {
-			if ( task_addunlock( s->cells[ s->tasks[k].i ].sort , &s->tasks[k] ) != 0 ||
-					task_addunlock( s->cells[ s->tasks[k].j ].sort , &s->tasks[k] ) != 0 )
-				return error(space_err_task);
-			s->cells[ s->tasks[k].i ].sort->flags |= 1 << s->tasks[k].flags;
-			s->cells[ s->tasks[k].j ].sort->flags |= 1 << s->tasks[k].flags;
-		}
+	/* Spread the runners over the sockets in contiguous blocks. */
+	if ( nr_sockets > nr_runners )
+		nr_sockets = nr_runners;
+	for ( i = 0 ; i < nr_runners ; i++ ) {
+		r = &e->runners[i];
+		r->socket = (long)i * nr_sockets / nr_runners;
+		r->socket_first = engine_numa_first( r->socket , nr_runners , nr_sockets );
+		r->socket_count = engine_numa_first( r->socket + 1 , nr_runners , nr_sockets ) - r->socket_first;
+		r->cpu = socket_cpus[ r->socket*nr_cpus + ( i - r->socket_first ) % socket_count[ r->socket ] ];
+	}
+	e->nr_sockets = nr_sockets;
+	free( socket_cpus );
 
+	/* Hand out the cells. */
+	engine_numa_cells( e );
 
-	/* Empty unmarked cells. */
-	for ( k = 0 ; k < s->nr_cells ; k++ )
-		if ( !( s->cells[k].flags & cell_flag_marked ) )
-			space_cell_flush( &s->cells[k] , s->partlist , s->celllist );
+	/* All done. */
+	return engine_err_ok;
 
-	/* Set ghost markings on particles. */
-	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
-		if ( s->cells[cid].flags & cell_flag_ghost )
-			for ( k = 0 ; k < s->cells[cid].count ; k++ )
-				s->cells[cid].parts[k].flags |= PARTICLE_FLAG_GHOST;
+}
+
+
+/**
+ * @brief Runner phase re-allocating the buffers of the runner's own
+ *      cells from its own thread, see #space_cell_rehome.
+ */
+
+static int engine_numa_touch_phase ( struct runner *r , void *data ) {
+
+	struct space *s = &r->e->s;
+	int cid;
 
-	/* Fill the cid lists with marked, local and ghost cells. */
-	s->nr_real = 0; s->nr_ghost = 0; s->nr_marked = 0;
 	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
-		if ( s->cells[cid].flags & cell_flag_marked ) {
-			s->cid_marked[ s->nr_marked++ ] = cid;
-			if ( s->cells[cid].flags & cell_flag_ghost ) {
-				s->cells[cid].id = -s->nr_cells;
-				s->cid_ghost[ s->nr_ghost++ ] = cid;
-			}
-			else {
-				s->cells[cid].id = s->nr_real;
-				s->cid_real[ s->nr_real++ ] = cid;
-			}
-		}
+		if ( s->cells_owner[cid] == r->id && ( s->cells[cid].flags & cell_flag_marked ) )
+			if ( space_cell_rehome( &s->cells[cid] , s->partlist ) < 0 )
+				return error(engine_err_cell);
 
-	/* Done deal. */
-	return engine_err_ok;
+	return runner_err_ok;
 
 }
 
-#ifdef WITH_METIS
+
 /**
- * @brief Split the computation domain over a number of nodes using METIS graph partitioning.
+ * @brief Get an estimate of the particle data read across sockets.
  *
- *@param e The #engine to split up.
- *@param N The number of computational nodes.
- *@param flags Flag telling whether to split the space for MPI or for GPUs.
+ * @param e The #engine.
+ * @param nr_sockets Pointer to an int in which to store the number of
+ *      sockets the runners are spread over, or @c NULL.
+ * @param local Pointer to a double in which to store the number of bytes
+ *      of particle data the runners read from cells owned by a runner on
+ *      the same socket, or @c NULL.
+ * @param remote Pointer to a double in which to store the number of bytes
+ *      read from cells owned by a runner on another socket, or @c NULL.
  *
- *@return #engine_err_ok or < 0 on error (see #engine_err).
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The counts cover the non-bonded tasks run since the last call to
+ * #engine_timers_reset and are only kept with #engine_flag_numa. Each
+ * particle of each cell of a task counts as one #MxParticle read.
  */
-int engine_split_METIS ( struct engine *e, int N, int flags){
 
-	//printf("Using METIS algorithm to split the space\n");
-	int currentIndex, i,j,shiftDim,neighbor;
-	idx_t vw; //Temporary vertex Weight store
-	idx_t ew; //Temporary edge Weight store
+int engine_numa_stats ( struct engine *e , int *nr_sockets , double *local , double *remote ) {
 
+	long long nr_local = 0, nr_remote = 0;
+	int k;
 
-	//Do single GPU version ie. N = 1
-	if(N==1)
-	{
-		if( flags == engine_split_MPI )
-		{
-			for(i = 0; i < e->s.nr_cells; i++ )
-			{
-				e->s.cells[i].nodeID = 0;
+	if ( e == NULL )
+		return error(engine_err_null);
 
-			}
-		}else if ( flags == engine_split_GPU )
-		{
-			for( i = 0 ; i < e->s.nr_cells ; i++ )
-			{
-				e->s.cells[i].GPUID = 0;
-			}
+	for ( k = 0 ; e->runners != NULL && k < e->nr_runners ; k++ ) {
+		nr_local += e->runners[k].numa_local;
+		nr_remote += e->runners[k].numa_remote;
+	}
+
+	if ( nr_sockets != NULL )
+		*nr_sockets = e->nr_sockets;
+	if ( local != NULL )
+		*local = (double)nr_local * sizeof(struct MxParticle);
+	if ( remote != NULL )
+		*remote = (double)nr_remote * sizeof(struct MxParticle);
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Re-build everything the #engine keeps on top of the tasks of its
+ *      #space after these have been re-made, see #engine_regrid and
+ *      #engine_balance.
+ */
+
+static int engine_retask ( struct engine *e ) {
+
+	struct space *s = &e->s;
+	int k, cid;
+
+	/* Add back the tasks that space_init does not make. */
+	for ( k = 0 ; k < e->max_type && e->p_singlebody[k] == NULL ; k++ );
+	if ( k < e->max_type && space_addtasks_singlebody( s ) < 0 )
+		return error(engine_err_space);
+	if ( e->flags & engine_flag_fused && e->runners != NULL )
+		if ( space_addtasks_integrate( s ) < 0 )
+			return error(engine_err_space);
 
+	/* Re-make the sortlists or the neighbour-list cell pairs. */
+	if ( e->flags & engine_flag_verlet_pseudo ) {
+		for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+			if ( ( s->cells[cid].flags & cell_flag_marked ) && s->cells[cid].sortlist == NULL )
+				if ( ( s->cells[cid].sortlist = (unsigned int *)malloc( sizeof(unsigned int) * 13 * s->cells[cid].size ) ) == NULL )
+					return error(engine_err_malloc);
+	}
+	if ( e->flags & ( engine_flag_verlet_list | engine_flag_cluster ) )
+		if ( space_verlet_init( s ) < 0 )
+			return error(engine_err_space);
 
+	/* Make room for the new tasks in the runners' deques and hand out
+	   the new cells. */
+	if ( e->runners != NULL ) {
+		for ( k = 0 ; k < e->nr_runners ; k++ ) {
+			deque_free( &e->runners[k].dq );
+			if ( deque_init( &e->runners[k].dq , s->tasks_size ) != deque_err_ok )
+				return error(engine_err_runner);
+		}
+		if ( e->flags & engine_flag_numa ) {
+			engine_numa_cells( e );
+			if ( engine_phase_run( e , engine_numa_touch_phase , NULL ) < 0 )
+				return error(engine_err);
 		}
-		return engine_err_ok;
 	}
 
-	//Values to adjust weighting of edges dependent on spatial share.
-	//These values are taken from random simulations of vector distances as described in GONNET 2007.
-	float FACE = 0.50004f;
-	float EDGE = 0.16176f;
-	float CORNER = 0.036213f;
+	/* The lists have to be re-built. */
+	s->verlet_rebuild = 1;
 
-	int nr_pairs = 0;
-	for( i = 0; i < e->s.nr_tasks; i++ )
-		if(e->s.tasks[i].typeId == task_type_pair)
-			nr_pairs++;
-	nr_pairs *= 2;
-	/* Check inputs. */
-	if ( e == NULL )
-		return error(engine_err_null);
+	return engine_err_ok;
 
-	/* Check cell size >= cutoff distance*/
-	if( e->s.h[0] < e->s.cutoff || e->s.h[1] < e->s.cutoff || e->s.h[2] < e->s.cutoff)
-		return error(engine_err_cutoff);
+}
 
-	//Need to include #include <metis.h>
-	/*Allocate memory required for METIS*/
-	/*Number of cells = number of nodes. */
-	idx_t *xadj = (idx_t*) malloc((e->s.nr_cells+1) * sizeof(idx_t));
-	if(xadj == NULL) return error(engine_err_malloc);
-	/*Number of edges = number of cellpairs */
-	idx_t *adjncy = (idx_t*) malloc (nr_pairs *2 * sizeof(idx_t));
-	if(adjncy == NULL) return error(engine_err_malloc);
-	/*Vertex Weights */
-	idx_t *vwgt = (idx_t*) malloc(e->s.nr_cells * sizeof(idx_t));
-	if(vwgt == NULL) return error(engine_err_malloc);
-	/*Edge Weights */
-	idx_t *adjwgt = (idx_t*) malloc(nr_pairs * 2 * sizeof(idx_t));
-	if(adjwgt == NULL) return error(engine_err_malloc);
-	/*Number vertices */
-	idx_t *nvtxs = (idx_t*) malloc(sizeof(idx_t));
-	if(nvtxs==NULL)return 1;
-	*nvtxs = e->s.nr_cells;
-	//Number constraints
-	idx_t *ncon = (idx_t*) malloc(sizeof(idx_t));
-	if(ncon==NULL)return 1;
-	*ncon = 1;
-	//Number partitions
-	idx_t *nparts = (idx_t*) malloc(sizeof(idx_t));
-	if(nparts==NULL)return 1;
-	*nparts = N;
 
-	/*results*/
-	idx_t *objval = (idx_t*) malloc(sizeof(idx_t));
-	if(objval==NULL)return 1;
-	idx_t *MxParticle = (idx_t*) malloc(e->s.nr_cells * (sizeof(idx_t)));
-	if(MxParticle==NULL)return 1;
+/**
+ * @brief Re-build the cell grid of the #engine's #space.
+ *
+ * @param e The #engine.
+ * @param L The minimum cell edge length, in each dimension.
+ * @param cutoff The new cutoff.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The particles are moved to the new cells by #space_regrid and
+ * everything the #engine built on top of the old cells, i.e. the
+ * single-body and integration tasks, the neighbour-list cell pairs, the
+ * runners' deques and, with #engine_flag_numa, the cell owners, is
+ * re-built. May only be called between steps, and not with
+ * #engine_flag_mpi or #engine_flag_cuda.
+ */
 
-	//Loop over cell pairs and add to array if valid. Needs to be double loop.
-	currentIndex=0;
-	for(j=0; j<e->s.nr_cells; j++)
-	{
-		vw=0;
-		ew=0;
-		xadj[j]=currentIndex;
-		for(i=0; i<e->s.nr_tasks; i++)
-		{
-			if(e->s.tasks[i].typeId == task_type_sort)
-				continue;
-			shiftDim=0;
-			//If the pair involves cell j.
-			if(e->s.tasks[i].i==j || e->s.tasks[i].j==j)
-			{
+int engine_regrid ( struct engine *e , double *L , double cutoff ) {
 
+	struct space *s;
 
-				//If type = self this is a self interaction. All particles interact (n^2-n interactions)
-				//Increment vertex weight by e->s.cell[j].count ^ 2 - e->s.cell[j].count
-				if(e->s.tasks[i].typeId == task_type_self)
-				{
-					vw+= e->s.cells[j].count*e->s.cells[j].count - e->s.cells[j].count;
-				}else{
-					//Find neighbor cell index.
-					if(e->s.tasks[i].i==j)
-						neighbor = e->s.tasks[i].j;
-					else
-						neighbor = e->s.tasks[i].i;
+	/* Check the inputs. */
+	if ( e == NULL || L == NULL )
+		return error(engine_err_null);
+	if ( e->flags & ( engine_flag_mpi | engine_flag_cuda ) )
+		return error(engine_err_range);
+	s = &e->s;
 
-					//Check how many shift==0.
-					if(e->s.cells[e->s.tasks[i].i].loc[0] == e->s.cells[e->s.tasks[i].j].loc[0])
-						shiftDim++;
-					if(e->s.cells[e->s.tasks[i].i].loc[1] == e->s.cells[e->s.tasks[i].j].loc[1])
-						shiftDim++;
-					if(e->s.cells[e->s.tasks[i].i].loc[2] == e->s.cells[e->s.tasks[i].j].loc[2])
-						shiftDim++;
+	/* Make the new cells. */
+	if ( space_regrid( s , L , cutoff ) < 0 )
+		return error(engine_err_space);
 
-					//If shiftDim = 2 this is a face interaction. Add edge from j to i
-					//Edge has weight e->s.cell[j].count * e->s.cell[neighbor].count * FACE	(Estimated number of distance calculations)
-					if(shiftDim==2)
-					{
-						ew = e->s.cells[j].count * e->s.cells[neighbor].count * FACE;
-						//Vertex Weights are the sum of edge weights + self interaction
-						vw+= ew;
-						//Add an edge and the edge weight to the graph
-						adjncy[currentIndex] = neighbor;
-						adjwgt[currentIndex] = ew;
-						currentIndex++;
-					}
+	/* Re-build what depends on the tasks. */
+	if ( engine_retask( e ) < 0 )
+		return error(engine_err);
 
-					//If shiftDim = 1 this is an edge interaction. Add edge from j to i
-					//Edge has weight e->s.cell[j].count * e->s.cell[neightbor.count * EDGE (Estimated number of distance calculations)
-					if(shiftDim==1)
-					{
-						ew = e->s.cells[j].count * e->s.cells[neighbor].count * EDGE;
-						//Vertex Weights are the sum of edge weights + self interaction
-						vw+=ew;
-						//Add an edge and the edge weight to the graph
-						adjncy[currentIndex] = neighbor;
-						adjwgt[currentIndex] = ew;
-						currentIndex++;
-					}
+	/* All done. */
+	return engine_err_ok;
 
+}
 
-					//If shiftDim = 0 this is an corner interaction. Add edge from j to i
-					//Edge has weight e->s.cell[j].count * e->s.cell[neightbor.count * CORNER (Estimated number of distance calculations)
-					if(shiftDim==0)
-					{
-						ew = e->s.cells[j].count * e->s.cells[neighbor].count * CORNER;
-						//Vertex Weights are the sum of edge weights + self interaction
-						vw+=ew;
-						//Add an edge and the edge weight to the graph
-						adjncy[currentIndex] = neighbor;
-						adjwgt[currentIndex] = ew;
-						currentIndex++;
-					}
-				}
 
+/**
+ * @brief Time a few steps of the non-bonded interactions on the current
+ *      cell grid, see #engine_autogrid.
+ */
+
+static int engine_autogrid_probe ( struct engine *e , int nr_steps , ticks *dt ) {
 
-			}
+	struct space *s = &e->s;
+	ticks tic = getticks();
+	int k;
+
+	for ( k = 0 ; k < nr_steps ; k++ ) {
+		if ( space_prepare( s ) != space_err_ok )
+			return error(engine_err_space);
+		if ( e->flags & engine_flag_verlet ) {
+			if ( engine_verlet_update( e ) < 0 )
+				return error(engine_err);
 		}
-		//We now know vertex weight.
-		vwgt[j] = vw;
+		else if ( engine_shuffle( e ) < 0 )
+			return error(engine_err);
+		if ( engine_nonbond_eval( e ) < 0 )
+			return error(engine_err);
+		s->verlet_rebuild = 0;
 	}
+	*dt = getticks() - tic;
 
-	//Need to add the final thing METIS needs to xadj
-	xadj[e->s.nr_cells]=currentIndex;
+	return engine_err_ok;
 
-	//Setup METIS options
-	idx_t *options = (idx_t*) malloc(METIS_NOPTIONS * sizeof(idx_t));
-	if(options==NULL)return 1;
-	METIS_SetDefaultOptions(options);
-	options[METIS_OPTION_PTYPE]=METIS_PTYPE_KWAY;
-	options[METIS_OPTION_OBJTYPE]=METIS_OBJTYPE_CUT;
-	options[METIS_OPTION_CTYPE] = METIS_CTYPE_SHEM;
-	options[METIS_OPTION_IPTYPE]=METIS_IPTYPE_GROW;
-	options[METIS_OPTION_NCUTS] = 1;
-	options[METIS_OPTION_NSEPS] = 1;
-	options[METIS_OPTION_NUMBERING] = 0; //C-style numbering :)
-	options[METIS_OPTION_NITER] = 10;
-	options[METIS_OPTION_SEED] = 1;
-	options[METIS_OPTION_CONTIG] = 1;
-	options[METIS_OPTION_UFACTOR] = 30;
-	//	options[METIS_OPTION_DBGLVL] = METIS_DBG_INFO;
+}
 
-	//Run METIS to partition the graph
-	METIS_PartGraphKway( nvtxs , ncon , xadj , adjncy , vwgt , NULL , adjwgt , nparts , NULL , NULL , options , objval , MxParticle );
-	if( flags == engine_split_MPI )
-	{
-		for(i = 0; i < e->s.nr_cells; i++ )
-		{
-			e->s.cells[i].nodeID = MxParticle[i];
-			//Not my cell? Mark as ghost.
-			if(MxParticle[i] != e->nodeID)
-				e->s.cells[i].flags |= cell_flag_ghost;
-			e->nr_nodes = N;
 
+/**
+ * @brief Pick the cell grid of the #engine's #space from its potentials.
+ *
+ * @param e The #engine.
+ * @param nr_steps Number of steps to time each of the most promising
+ *      grids with, or zero to go by the estimate alone.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The cutoff is set to the largest range of the pairwise potentials.
+ * The candidate grids have cells of one to three times the cutoff. For
+ * each, the cost of
+ * a step is estimated from the number of particle pairs in neighbouring
+ * cells plus a fixed cost of #engine_autogrid_taskcost pairs per task,
+ * and grids with fewer than #engine_autogrid_minload cells per runner
+ * are penalised for load imbalance. If @c nr_steps is non-zero and the
+ * runners have been started, the #engine_autogrid_nrprobe cheapest grids
+ * are then timed over @c nr_steps non-bonded evaluations each. The
+ * #space is then re-gridded with #engine_regrid if the best grid is not
+ * the current one, leaving the Verlet skin at its default, i.e. the
+ * cell edge length minus the cutoff.
+ *
+ * The timed steps leave forces and energies which the next
+ * #engine_step clears. They are skipped with #engine_flag_fused, where
+ * the forces are cleared by the integration tasks instead.
+ */
+
+int engine_autogrid ( struct engine *e , int nr_steps ) {
+
+	static const double factors[ engine_autogrid_nrfactors ] = { 1.0 , 1.25 , 1.5 , 2.0 , 2.5 , 3.0 };
+	struct space *s;
+	double cutoff = 0.0, h[3], L[ engine_autogrid_nrfactors ][3], cost[ engine_autogrid_nrfactors ];
+	double density, pairs;
+	int cdim[ engine_autogrid_nrfactors ][3], order[ engine_autogrid_nrfactors ];
+	int nr_cand = 0, nr_cells, best, i, j, k;
+	ticks dt = 0, best_dt = 0, timers[ engine_timer_last ];
+
+	/* Check the inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+	if ( e->flags & ( engine_flag_mpi | engine_flag_cuda ) )
+		return error(engine_err_range);
+	s = &e->s;
+	e->autogrid_pending = 0;
+
+	/* Get the cutoff from the potentials. */
+	for ( k = 0 ; k < e->max_type * e->max_type ; k++ )
+		if ( e->p[k] != NULL )
+			cutoff = fmax( cutoff , e->p[k]->b );
+	if ( cutoff <= 0.0 )
+		cutoff = s->cutoff;
+	density = s->nr_parts / ( s->dim[0] * s->dim[1] * s->dim[2] );
+
+	/* Collect and estimate the candidate grids. */
+	for ( i = 0 ; i < engine_autogrid_nrfactors ; i++ ) {
+
+		/* Get the cell dimensions, skipping duplicates and grids too
+		   coarse for the periodic boundaries. */
+		for ( k = 0 ; k < 3 ; k++ ) {
+			cdim[nr_cand][k] = floor( s->dim[k] / ( cutoff * factors[i] ) );
+			if ( cdim[nr_cand][k] < ( ( s->period & ( space_periodic_x << k ) ) ? 3 : 1 ) )
+				break;
+			h[k] = s->dim[k] / cdim[nr_cand][k];
+			L[nr_cand][k] = h[k];
 		}
-	}else if ( flags == engine_split_GPU )
-	{
-		int part1 = 0;
-		int part2 = 0;
-		for( i = 0 ; i < e->s.nr_cells ; i++ )
-		{
-			e->s.cells[i].GPUID = MxParticle[i];
-			if(e->s.cells[i].GPUID == 0)
-				part1++;
-			else
-				part2++;
-		}
-		printf("%i  %i \n", part1, part2);
+		if ( k < 3 )
+			break;
+		for ( j = 0 ; j < nr_cand ; j++ )
+			if ( cdim[j][0] == cdim[nr_cand][0] && cdim[j][1] == cdim[nr_cand][1] && cdim[j][2] == cdim[nr_cand][2] )
+				break;
+		if ( j < nr_cand )
+			continue;
+
+		/* Pairs in neighbouring cells plus the task overheads. */
+		nr_cells = cdim[nr_cand][0] * cdim[nr_cand][1] * cdim[nr_cand][2];
+		pairs = 0.5 * s->nr_parts * density * 27.0 * h[0] * h[1] * h[2];
+		cost[nr_cand] = pairs + 14.0 * nr_cells * engine_autogrid_taskcost;
+		if ( e->nr_runners > 1 && nr_cells < engine_autogrid_minload * e->nr_runners )
+			cost[nr_cand] *= (double)( engine_autogrid_minload * e->nr_runners ) / nr_cells;
 
+		/* Without any skin, the Verlet lists are re-built every step. */
+		if ( ( e->flags & engine_flag_verlet ) && fmin( h[0] , fmin( h[1] , h[2] ) ) - cutoff < 0.1 * cutoff )
+			cost[nr_cand] *= 2.0;
+		order[nr_cand] = nr_cand;
+		nr_cand += 1;
 
 	}
+	if ( nr_cand == 0 )
+		return error(engine_err_domain);
 
-	/* Store the number of nodes. */
+	/* Sort the candidates by their estimated cost. */
+	for ( i = 1 ; i < nr_cand ; i++ )
+		for ( j = i ; j > 0 && cost[ order[j] ] < cost[ order[j-1] ] ; j-- ) {
+			k = order[j]; order[j] = order[j-1]; order[j-1] = k;
+		}
+	best = order[0];
+
+	/* Time the most promising ones? */
+	if ( nr_steps > 0 && e->runners != NULL && !( e->flags & engine_flag_fused ) && nr_cand > 1 ) {
+		memcpy( timers , e->timers , sizeof(ticks) * engine_timer_last );
+		k = s->verlet_nr_rebuilds;
+		for ( i = 0 ; i < nr_cand && i < engine_autogrid_nrprobe ; i++ ) {
+			if ( engine_regrid( e , L[ order[i] ] , cutoff ) < 0 )
+				return error(engine_err);
+			s->verlet_skin = fmin( s->h[0] , fmin( s->h[1] , s->h[2] ) ) - cutoff;
+			if ( engine_autogrid_probe( e , nr_steps , &dt ) < 0 )
+				return error(engine_err);
+			if ( i == 0 || dt < best_dt ) {
+				best = order[i];
+				best_dt = dt;
+			}
+		}
+		memcpy( e->timers , timers , sizeof(ticks) * engine_timer_last );
+		s->verlet_nr_rebuilds = k;
+	}
 
-	/*Free memory used by METIS*/
-	free(xadj);
-	free(adjncy);
-	free(vwgt);
-	free(adjwgt);
-	free(nvtxs);
-	free(ncon);
-	free(nparts);
-	free(objval);
-	free(MxParticle);
-	free(options);
-	printf("Successfully split the space\n");
+	/* Move to the best grid, if we are not on it already. */
+	if ( s->cdim[0] != cdim[best][0] || s->cdim[1] != cdim[best][1] || s->cdim[2] != cdim[best][2] || s->cutoff != cutoff ) {
+		if ( engine_regrid( e , L[best] , cutoff ) < 0 )
+			return error(engine_err);
+		s->verlet_skin = fmin( s->h[0] , fmin( s->h[1] , s->h[2] ) ) - cutoff;
+	}
 
-	/* Call it a day. */
+	/* All done. */
 	return engine_err_ok;
 
-	/* Bisect recursively */
+}
+
+
+/**
+ * @brief Set-up the engine for distributed-memory parallel operation.
+ *
+ * @param e The #engine to set-up.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * This function assumes that #engine_split_bisect or some similar
+ * function has already been called and that #nodeID, #nr_nodes as
+ * well as the #cell @c nodeIDs have been set.
+ */
+int engine_split ( struct engine *e ) {
+
+	int i, k, cid, cjd;
+	struct space_cell *ci, *cj, *ct;
+	struct space *s = &(e->s);
+
+	/* Check for nonsense inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* Start by allocating and initializing the send/recv lists. */
+	if ( ( e->send = (struct engine_comm *)malloc( sizeof(struct engine_comm) * e->nr_nodes ) ) == NULL ||
+			( e->recv = (struct engine_comm *)malloc( sizeof(struct engine_comm) * e->nr_nodes ) ) == NULL )
+		return error(engine_err_malloc);
+	for ( k = 0 ; k < e->nr_nodes ; k++ ) {
+		if ( ( e->send[k].cellid = (int *)malloc( sizeof(int) * 100 ) ) == NULL )
+			return error(engine_err_malloc);
+		e->send[k].size = 100;
+		e->send[k].count = 0;
+		if ( ( e->recv[k].cellid = (int *)malloc( sizeof(int) * 100 ) ) == NULL )
+			return error(engine_err_malloc);
+		e->recv[k].size = 100;
+		e->recv[k].count = 0;
+	}
+
+	/* Un-mark all cells. */
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+		s->cells[cid].flags &= ~cell_flag_marked;
+
+	/* Loop over each cell pair... */
+	for ( i = 0 ; i < s->nr_tasks ; i++ ) {
+
+		/* Is this task a pair? */
+		if ( s->tasks[i].type != task_type_pair )
+			continue;
+
+		/* Get the cells in this pair. */
+		cid = s->tasks[i].i;
+		cjd = s->tasks[i].j;
+		ci = &( s->cells[ cid ] );
+		cj = &( s->cells[ cjd ] );
+
+		/* If it is a ghost-ghost pair, skip it. */
+		if ( (ci->flags & cell_flag_ghost) && (cj->flags & cell_flag_ghost) )
+			continue;
+
+		/* Mark the cells. */
+		ci->flags |= cell_flag_marked;
+		cj->flags |= cell_flag_marked;
+
+		/* Make cj the ghost cell and bail if both are real. */
+		if ( ci->flags & cell_flag_ghost ) {
+			ct = ci; ci = cj; cj = ct;
+			k = cid; cid = cjd; cjd = k;
+		}
+		else if ( !( cj->flags & cell_flag_ghost ) )
+			continue;
+
+		/* Store the communication between cid and cjd. */
+		/* Store the send, if not already there... */
+		for ( k = 0 ; k < e->send[cj->nodeID].count && e->send[cj->nodeID].cellid[k] != cid ; k++ );
+		if ( k == e->send[cj->nodeID].count ) {
+			if ( e->send[cj->nodeID].count == e->send[cj->nodeID].size ) {
+				e->send[cj->nodeID].size += 100;
+				if ( ( e->send[cj->nodeID].cellid = (int *)realloc( e->send[cj->nodeID].cellid , sizeof(int) * e->send[cj->nodeID].size ) ) == NULL )
+					return error(engine_err_malloc);
+			}
+			e->send[cj->nodeID].cellid[ e->send[cj->nodeID].count++ ] = cid;
+		}
+		/* Store the recv, if not already there... */
+		for ( k = 0 ; k < e->recv[cj->nodeID].count && e->recv[cj->nodeID].cellid[k] != cjd ; k++ );
+		if ( k == e->recv[cj->nodeID].count ) {
+			if ( e->recv[cj->nodeID].count == e->recv[cj->nodeID].size ) {
+				e->recv[cj->nodeID].size += 100;
+				if ( ( e->recv[cj->nodeID].cellid = (int *)realloc( e->recv[cj->nodeID].cellid , sizeof(int) * e->recv[cj->nodeID].size ) ) == NULL )
+					return error(engine_err_malloc);
+			}
+			e->recv[cj->nodeID].cellid[ e->recv[cj->nodeID].count++ ] = cjd;
+		}
+
+	}
+
+	/* Nuke all ghost-ghost tasks. */
+	i = 0;
+	while ( i < s->nr_tasks ) {
+
+		/* Pair? */
+		if ( s->tasks[i].type == task_type_pair ) {
+
+			/* Get the cells in this pair. */
+			ci = &( s->cells[ s->tasks[i].i ] );
+			cj = &( s->cells[ s->tasks[i].j ] );
+
+			/* If it is a ghost-ghost pair, skip it. */
+			if ( (ci->flags & cell_flag_ghost) && (cj->flags & cell_flag_ghost) )
+				s->tasks[i] = s->tasks[ --(s->nr_tasks) ];
+			else
+				i += 1;
+
+		}
+
+		/* Self? */
+		else if ( s->tasks[i].type == task_type_self ) {
+
+			/* Get the cells in this pair. */
+			ci = &( s->cells[ s->tasks[i].i ] );
+
+			/* If it is a ghost-ghost pair, skip it. */
+			if ( ci->flags & cell_flag_ghost )
+				s->tasks[i] = s->tasks[ --(s->nr_tasks) ];
+			else
+				i += 1;
+
+		}
+
+		/* Sort? */
+		else if ( s->tasks[i].type == task_type_sort ) {
+
+			/* Get the cells in this pair. */
+			ci = &( s->cells[ s->tasks[i].i ] );
+
+			/* If it is a ghost-ghost pair, skip it. */
+			if ( !(ci->flags & cell_flag_marked) )
+				s->tasks[i] = s->tasks[ --(s->nr_tasks) ];
+			else
+				i += 1;
+
+		}
+
+	}
+
+	/* Clear all task dependencies and re-link each sort task with its cell.
+	   The sorts of the ghost cells gate all the tasks that need their data. */
+	for ( i = 0 ; i < s->nr_tasks ; i++ ) {
+		s->tasks[i].nr_unlock = 0;
+		if ( s->tasks[i].type == task_type_sort ) {
+			s->cells[ s->tasks[i].i ].sort = &s->tasks[i];
+			s->tasks[i].flags = 0;
+			s->tasks[i].subtype = ( s->cells[ s->tasks[i].i ].flags & cell_flag_ghost ) ? task_subtype_halo : task_subtype_none;
+		}
+	}
+
+	/* Run through the tasks and make each pair depend on the sorts.
+       Also set the flags for each sort. */
+	for ( k = 0 ; k < s->nr_tasks ; k++ )
+		if ( s->tasks[k].type == task_type_pair ) {
+			if ( task_addunlock( s->cells[ s->tasks[k].i ].sort , &s->tasks[k] ) != 0 ||
+					task_addunlock( s->cells[ s->tasks[k].j ].sort , &s->tasks[k] ) != 0 )
+				return error(space_err_task);
+			s->cells[ s->tasks[k].i ].sort->flags |= 1 << s->tasks[k].flags;
+			s->cells[ s->tasks[k].j ].sort->flags |= 1 << s->tasks[k].flags;
+		}
+
+
+	/* Empty unmarked cells. */
+	for ( k = 0 ; k < s->nr_cells ; k++ )
+		if ( !( s->cells[k].flags & cell_flag_marked ) )
+			space_cell_flush( &s->cells[k] , s->partlist , s->celllist );
+	s->parts_moved = 1;
+
+	/* Set ghost markings on particles. */
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+		if ( s->cells[cid].flags & cell_flag_ghost )
+			for ( k = 0 ; k < s->cells[cid].count ; k++ )
+				s->cells[cid].parts[k].flags |= PARTICLE_FLAG_GHOST;
+
+	/* Fill the cid lists with marked, local and ghost cells. */
+	s->nr_real = 0; s->nr_ghost = 0; s->nr_marked = 0;
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+		if ( s->cells[cid].flags & cell_flag_marked ) {
+			s->cid_marked[ s->nr_marked++ ] = cid;
+			if ( s->cells[cid].flags & cell_flag_ghost ) {
+				s->cells[cid].id = -s->nr_cells;
+				s->cid_ghost[ s->nr_ghost++ ] = cid;
+			}
+			else {
+				s->cells[cid].id = s->nr_real;
+				s->cid_real[ s->nr_real++ ] = cid;
+			}
+		}
+
+	/* Done deal. */
+	return engine_err_ok;
+
+}
+
+#ifdef WITH_MPI
+/**
+ * @brief Move the particles of the cells changing node to their new node
+ *      and re-build the ghost cells, tasks and send/recv lists.
+ *
+ * @param e The #engine.
+ * @param owner The new node of each cell.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+static int engine_balance_migrate ( struct engine *e , int *owner ) {
+
+	struct space *s = &e->s;
+	struct space_cell *c;
+	struct MxParticle *finger;
+	int *counts_out[ e->nr_nodes ], *counts_in, nr_cells_out[ e->nr_nodes ];
+	int totals_out[ e->nr_nodes ], total, nr_in;
+	struct MxParticle *buff_out[ e->nr_nodes ], *buff_in;
+	MPI_Request reqs[ 2 * e->nr_nodes ];
+	int cid, i, k;
+
+	/* Pack and send the particles of the cells we give away, one buffer
+	   per node, in the order of their cell IDs. */
+	for ( i = 0 ; i < e->nr_nodes ; i++ ) {
+		reqs[2*i] = reqs[2*i+1] = MPI_REQUEST_NULL;
+		counts_out[i] = NULL; buff_out[i] = NULL;
+		nr_cells_out[i] = 0; totals_out[i] = 0;
+		if ( i == e->nodeID )
+			continue;
+		for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+			if ( s->cells[cid].nodeID == e->nodeID && owner[cid] == i ) {
+				nr_cells_out[i] += 1;
+				totals_out[i] += s->cells[cid].count;
+			}
+		if ( nr_cells_out[i] == 0 )
+			continue;
+		if ( ( counts_out[i] = (int *)malloc( sizeof(int) * nr_cells_out[i] ) ) == NULL ||
+			 ( buff_out[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * ( totals_out[i] + 1 ) ) ) == NULL )
+			return error(engine_err_malloc);
+		finger = buff_out[i];
+		for ( k = 0 , cid = 0 ; cid < s->nr_cells ; cid++ )
+			if ( s->cells[cid].nodeID == e->nodeID && owner[cid] == i ) {
+				c = &s->cells[cid];
+				counts_out[i][k++] = c->count;
+				memcpy( finger , c->parts , sizeof(struct MxParticle) * c->count );
+				finger = &finger[ c->count ];
+			}
+		if ( MPI_Isend( counts_out[i] , nr_cells_out[i] , MPI_INT , i , e->nodeID , e->comm , &reqs[2*i] ) != MPI_SUCCESS ||
+			 MPI_Isend( buff_out[i] , totals_out[i] * sizeof(struct MxParticle) , MPI_BYTE , i , e->nr_nodes + e->nodeID , e->comm , &reqs[2*i+1] ) != MPI_SUCCESS )
+			return error(engine_err_mpi);
+	}
+
+	/* Receive the particles of the cells we take over from each node. */
+	for ( i = 0 ; i < e->nr_nodes ; i++ ) {
+		if ( i == e->nodeID )
+			continue;
+		for ( nr_in = 0 , cid = 0 ; cid < s->nr_cells ; cid++ )
+			if ( s->cells[cid].nodeID == i && owner[cid] == e->nodeID )
+				nr_in += 1;
+		if ( nr_in == 0 )
+			continue;
+		if ( ( counts_in = (int *)malloc( sizeof(int) * nr_in ) ) == NULL )
+			return error(engine_err_malloc);
+		if ( MPI_Recv( counts_in , nr_in , MPI_INT , i , i , e->comm , MPI_STATUS_IGNORE ) != MPI_SUCCESS )
+			return error(engine_err_mpi);
+		for ( total = 0 , k = 0 ; k < nr_in ; k++ )
+			total += counts_in[k];
+		if ( ( buff_in = (struct MxParticle *)malloc( sizeof(struct MxParticle) * ( total + 1 ) ) ) == NULL )
+			return error(engine_err_malloc);
+		if ( MPI_Recv( buff_in , total * sizeof(struct MxParticle) , MPI_BYTE , i , e->nr_nodes + i , e->comm , MPI_STATUS_IGNORE ) != MPI_SUCCESS )
+			return error(engine_err_mpi);
+
+		/* Replace the ghost copies with the real thing. */
+		finger = buff_in;
+		for ( k = 0 , cid = 0 ; cid < s->nr_cells ; cid++ )
+			if ( s->cells[cid].nodeID == i && owner[cid] == e->nodeID ) {
+				c = &s->cells[cid];
+				c->flags &= ~cell_flag_ghost;
+				if ( space_cell_flush( c , s->partlist , s->celllist ) < 0 ||
+					 space_cell_load( c , finger , counts_in[k] , s->partlist , s->celllist ) < 0 )
+					return error(engine_err_cell);
+				finger = &finger[ counts_in[k++] ];
+			}
+		free( counts_in );
+		free( buff_in );
+	}
+
+	/* Hand the cells to their new nodes. */
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+		s->cells[cid].nodeID = owner[cid];
+
+	/* Wait for our own sends to go through. */
+	if ( MPI_Waitall( 2 * e->nr_nodes , reqs , MPI_STATUSES_IGNORE ) != MPI_SUCCESS )
+		return error(engine_err_mpi);
+	for ( i = 0 ; i < e->nr_nodes ; i++ ) {
+		free( counts_out[i] );
+		free( buff_out[i] );
+	}
+
+	/* Drop the old send/recv lists and re-make the tasks and lists for
+	   the new ghost cells. */
+	for ( k = 0 ; k < e->nr_nodes ; k++ ) {
+		free( e->send[k].cellid );
+		free( e->recv[k].cellid );
+	}
+	free( e->send );
+	free( e->recv );
+
+	/* The tasks are made for all the cells, as in space_init, so that every
+	   node has them in the same order and engine_split builds send and recv
+	   lists that match those of the other nodes. The ghost cells are only
+	   marked afterwards. */
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+		s->cells[cid].flags &= ~cell_flag_ghost;
+	if ( space_maketasks( s ) < 0 )
+		return error(engine_err_space);
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+		if ( owner[cid] != e->nodeID )
+			s->cells[cid].flags |= cell_flag_ghost;
+	if ( engine_split( e ) < 0 || engine_retask( e ) < 0 )
+		return error(engine_err);
+	if ( s->sfc != space_sfc_none && space_sfc_order( s , s->sfc ) < 0 )
+		return error(engine_err_space);
+
+	/* All done. */
+	return engine_err_ok;
+
+}
+#endif
+
+
+/**
+ * @brief Measure the load of each node and re-partition the cells if it
+ *      is too uneven.
+ *
+ * @param e The #engine.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The load of each cell is the time the runners spent on its tasks since
+ * the last call, see #engine_flag_balance, a pair of real cells counting
+ * half for each and a pair with a ghost cell fully for the real one. The
+ * cell loads are summed over the nodes, giving the load of each node and
+ * the ratio of the largest to the mean load, see #engine_balance_stats.
+ *
+ * If that ratio exceeds @c e->balance_tol, up to #engine_balance_maxmoves
+ * cells are moved, one at a time, from the most loaded node to the
+ * neighbouring node that leaves the smaller of the two loads the lowest.
+ * Since every node sees the same loads, they all agree on the moves
+ * without further communication. The particles of the moved cells are
+ * then shipped to their new nodes and the ghost cells, tasks and send/recv
+ * lists are re-built as by #engine_split.
+ *
+ * Only the non-bonded tasks are measured. Must be called by all nodes
+ * between steps.
+ */
+
+int engine_balance ( struct engine *e ) {
+
+	struct space *s;
+	struct task *t;
+	double *load, total = 0.0, wmax, w;
+	int *owner, *count, cid, k, n, m, moves, best_c, best_m, l[3], d[3];
+
+	/* Check the inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+	s = &e->s;
+	e->balance_moved = 0;
+
+	/* Get the measured load of our real cells. */
+	if ( ( load = (double *)malloc( sizeof(double) * s->nr_cells ) ) == NULL ||
+		 ( e->balance_load = (double *)realloc( e->balance_load , sizeof(double) * e->nr_nodes ) ) == NULL ||
+		 ( count = (int *)alloca( sizeof(int) * e->nr_nodes ) ) == NULL )
+		return error(engine_err_malloc);
+	bzero( load , sizeof(double) * s->nr_cells );
+	for ( k = 0 ; k < s->nr_tasks ; k++ ) {
+		t = &s->tasks[k];
+		if ( t->type == task_type_pair ) {
+			if ( !( s->cells[t->i].flags & cell_flag_ghost ) && !( s->cells[t->j].flags & cell_flag_ghost ) ) {
+				load[t->i] += 0.5 * t->cost;
+				load[t->j] += 0.5 * t->cost;
+			}
+			else
+				load[ ( s->cells[t->i].flags & cell_flag_ghost ) ? t->j : t->i ] += t->cost;
+		}
+		else if ( !( s->cells[t->i].flags & cell_flag_ghost ) )
+			load[t->i] += t->cost;
+		t->cost = 0.0;
+	}
+
+#ifdef WITH_MPI
+	/* Every node gets every cell's load. */
+	if ( ( e->flags & engine_flag_mpi ) && e->nr_nodes > 1 )
+		if ( MPI_Allreduce( MPI_IN_PLACE , load , s->nr_cells , MPI_DOUBLE , MPI_SUM , e->comm ) != MPI_SUCCESS )
+			return error(engine_err_mpi);
+#endif
+
+	/* Sum up the load of each node. */
+	bzero( e->balance_load , sizeof(double) * e->nr_nodes );
+	bzero( count , sizeof(int) * e->nr_nodes );
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+		n = ( e->nr_nodes > 1 ) ? s->cells[cid].nodeID : 0;
+		e->balance_load[n] += load[cid];
+		count[n] += 1;
+		total += load[cid];
+	}
+	for ( wmax = 0.0 , n = 0 ; n < e->nr_nodes ; n++ )
+		wmax = fmax( wmax , e->balance_load[n] );
+	e->balance_imbalance = ( total > 0.0 ) ? wmax * e->nr_nodes / total : 1.0;
+
+	/* Is there anything to do? */
+	if ( !( e->flags & engine_flag_mpi ) || e->nr_nodes < 2 || e->balance_imbalance <= e->balance_tol ) {
+		free( load );
+		return engine_err_ok;
+	}
+
+	/* Move cells off the busiest node, one at a time. */
+	if ( ( owner = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL )
+		return error(engine_err_malloc);
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+		owner[cid] = s->cells[cid].nodeID;
+	for ( moves = 0 ; moves < engine_balance_maxmoves ; moves++ ) {
+
+		/* Get the busiest node and stop if it is busy enough. */
+		for ( n = 0 , k = 1 ; k < e->nr_nodes ; k++ )
+			if ( e->balance_load[k] > e->balance_load[n] )
+				n = k;
+		if ( e->balance_load[n] * e->nr_nodes <= e->balance_tol * total || count[n] < 2 )
+			break;
+
+		/* Find the cell on its boundary which, given to that neighbour,
+		   leaves the larger of the two loads the lowest. */
+		best_c = -1; best_m = -1; wmax = e->balance_load[n];
+		for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+			if ( owner[cid] != n || load[cid] <= 0.0 )
+				continue;
+			for ( d[0] = -1 ; d[0] <= 1 ; d[0]++ )
+				for ( d[1] = -1 ; d[1] <= 1 ; d[1]++ )
+					for ( d[2] = -1 ; d[2] <= 1 ; d[2]++ ) {
+						for ( k = 0 ; k < 3 ; k++ ) {
+							l[k] = s->cells[cid].loc[k] + d[k];
+							if ( l[k] < 0 || l[k] >= s->cdim[k] ) {
+								if ( !( s->period & ( space_periodic_x << k ) ) )
+									break;
+								l[k] = ( l[k] + s->cdim[k] ) % s->cdim[k];
+							}
+						}
+						if ( k < 3 || ( m = owner[ space_cellid( s , l[0] , l[1] , l[2] ) ] ) == n )
+							continue;
+						w = fmax( e->balance_load[n] - load[cid] , e->balance_load[m] + load[cid] );
+						if ( w < wmax ) {
+							wmax = w;
+							best_c = cid;
+							best_m = m;
+						}
+					}
+		}
+		if ( best_c < 0 )
+			break;
+
+		/* Move it. */
+		owner[best_c] = best_m;
+		e->balance_load[n] -= load[best_c];
+		e->balance_load[best_m] += load[best_c];
+		count[n] -= 1;
+		count[best_m] += 1;
+
+	}
+	e->balance_moved = moves;
+	free( load );
+
+#ifdef WITH_MPI
+	/* Move the particles and re-build the ghosts. */
+	if ( moves > 0 ) {
+		if ( e->flags & engine_flag_async )
+			if ( engine_exchange_wait( e ) < 0 )
+				return error(engine_err);
+		if ( engine_balance_migrate( e , owner ) < 0 )
+			return error(engine_err);
+	}
+#endif
+	free( owner );
+
+	/* All done. */
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Set how often and how strictly the cells are re-partitioned over
+ *      the nodes, see #engine_flag_balance.
+ *
+ * @param e The #engine.
+ * @param nr_steps Number of steps between checks of the load.
+ * @param tol Largest tolerated ratio of the most loaded node's load to
+ *      the mean, at least 1.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+int engine_balance_set ( struct engine *e , int nr_steps , double tol ) {
+
+	if ( e == NULL )
+		return error(engine_err_null);
+	if ( nr_steps < 1 || tol < 1.0 )
+		return error(engine_err_range);
+
+	e->balance_steps = nr_steps;
+	e->balance_tol = tol;
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Get the node loads measured at the last #engine_balance.
+ *
+ * @param e The #engine.
+ * @param imbalance Pointer to a double in which to store the ratio of the
+ *      largest to the mean node load, or @c NULL.
+ * @param loads Pointer to an array of @c e->nr_nodes doubles in which to
+ *      store the load of each node, in ticks, or @c NULL.
+ * @param nr_moved Pointer to an int in which to store the number of cells
+ *      moved to other nodes, or @c NULL.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+int engine_balance_stats ( struct engine *e , double *imbalance , double *loads , int *nr_moved ) {
+
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	if ( imbalance != NULL )
+		*imbalance = e->balance_imbalance;
+	if ( loads != NULL ) {
+		if ( e->balance_load != NULL )
+			memcpy( loads , e->balance_load , sizeof(double) * e->nr_nodes );
+		else
+			bzero( loads , sizeof(double) * e->nr_nodes );
+	}
+	if ( nr_moved != NULL )
+		*nr_moved = e->balance_moved;
+
+	return engine_err_ok;
+
+}
+
+
+#ifdef WITH_METIS
+/**
+ * @brief Split the computation domain over a number of nodes using METIS graph partitioning.
+ *
+ *@param e The #engine to split up.
+ *@param N The number of computational nodes.
+ *@param flags Flag telling whether to split the space for MPI or for GPUs.
+ *
+ *@return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+int engine_split_METIS ( struct engine *e, int N, int flags){
+
+	//printf("Using METIS algorithm to split the space\n");
+	int currentIndex, i,j,shiftDim,neighbor;
+	idx_t vw; //Temporary vertex Weight store
+	idx_t ew; //Temporary edge Weight store
+
+
+	//Do single GPU version ie. N = 1
+	if(N==1)
+	{
+		if( flags == engine_split_MPI )
+		{
+			for(i = 0; i < e->s.nr_cells; i++ )
+			{
+				e->s.cells[i].nodeID = 0;
+
+			}
+		}else if ( flags == engine_split_GPU )
+		{
+			for( i = 0 ; i < e->s.nr_cells ; i++ )
+			{
+				e->s.cells[i].GPUID = 0;
+			}
+
+
+		}
+		return engine_err_ok;
+	}
+
+	//Values to adjust weighting of edges dependent on spatial share.
+	//These values are taken from random simulations of vector distances as described in GONNET 2007.
+	float FACE = 0.50004f;
+	float EDGE = 0.16176f;
+	float CORNER = 0.036213f;
+
+	int nr_pairs = 0;
+	for( i = 0; i < e->s.nr_tasks; i++ )
+		if(e->s.tasks[i].typeId == task_type_pair)
+			nr_pairs++;
+	nr_pairs *= 2;
+	/* Check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* Check cell size >= cutoff distance*/
+	if( e->s.h[0] < e->s.cutoff || e->s.h[1] < e->s.cutoff || e->s.h[2] < e->s.cutoff)
+		return error(engine_err_cutoff);
+
+	//Need to include #include <metis.h>
+	/*Allocate memory required for METIS*/
+	/*Number of cells = number of nodes. */
+	idx_t *xadj = (idx_t*) malloc((e->s.nr_cells+1) * sizeof(idx_t));
+	if(xadj == NULL) return error(engine_err_malloc);
+	/*Number of edges = number of cellpairs */
+	idx_t *adjncy = (idx_t*) malloc (nr_pairs *2 * sizeof(idx_t));
+	if(adjncy == NULL) return error(engine_err_malloc);
+	/*Vertex Weights */
+	idx_t *vwgt = (idx_t*) malloc(e->s.nr_cells * sizeof(idx_t));
+	if(vwgt == NULL) return error(engine_err_malloc);
+	/*Edge Weights */
+	idx_t *adjwgt = (idx_t*) malloc(nr_pairs * 2 * sizeof(idx_t));
+	if(adjwgt == NULL) return error(engine_err_malloc);
+	/*Number vertices */
+	idx_t *nvtxs = (idx_t*) malloc(sizeof(idx_t));
+	if(nvtxs==NULL)return 1;
+	*nvtxs = e->s.nr_cells;
+	//Number constraints
+	idx_t *ncon = (idx_t*) malloc(sizeof(idx_t));
+	if(ncon==NULL)return 1;
+	*ncon = 1;
+	//Number partitions
+	idx_t *nparts = (idx_t*) malloc(sizeof(idx_t));
+	if(nparts==NULL)return 1;
+	*nparts = N;
+
+	/*results*/
+	idx_t *objval = (idx_t*) malloc(sizeof(idx_t));
+	if(objval==NULL)return 1;
+	idx_t *MxParticle = (idx_t*) malloc(e->s.nr_cells * (sizeof(idx_t)));
+	if(MxParticle==NULL)return 1;
+
+	//Loop over cell pairs and add to array if valid. Needs to be double loop.
+	currentIndex=0;
+	for(j=0; j<e->s.nr_cells; j++)
+	{
+		vw=0;
+		ew=0;
+		xadj[j]=currentIndex;
+		for(i=0; i<e->s.nr_tasks; i++)
+		{
+			if(e->s.tasks[i].typeId == task_type_sort)
+				continue;
+			shiftDim=0;
+			//If the pair involves cell j.
+			if(e->s.tasks[i].i==j || e->s.tasks[i].j==j)
+			{
+
+
+				//If type = self this is a self interaction. All particles interact (n^2-n interactions)
+				//Increment vertex weight by e->s.cell[j].count ^ 2 - e->s.cell[j].count
+				if(e->s.tasks[i].typeId == task_type_self)
+				{
+					vw+= e->s.cells[j].count*e->s.cells[j].count - e->s.cells[j].count;
+				}else{
+					//Find neighbor cell index.
+					if(e->s.tasks[i].i==j)
+						neighbor = e->s.tasks[i].j;
+					else
+						neighbor = e->s.tasks[i].i;
+
+					//Check how many shift==0.
+					if(e->s.cells[e->s.tasks[i].i].loc[0] == e->s.cells[e->s.tasks[i].j].loc[0])
+						shiftDim++;
+					if(e->s.cells[e->s.tasks[i].i].loc[1] == e->s.cells[e->s.tasks[i].j].loc[1])
+						shiftDim++;
+					if(e->s.cells[e->s.tasks[i].i].loc[2] == e->s.cells[e->s.tasks[i].j].loc[2])
+						shiftDim++;
+
+					//If shiftDim = 2 this is a face interaction. Add edge from j to i
+					//Edge has weight e->s.cell[j].count * e->s.cell[neighbor].count * FACE	(Estimated number of distance calculations)
+					if(shiftDim==2)
+					{
+						ew = e->s.cells[j].count * e->s.cells[neighbor].count * FACE;
+						//Vertex Weights are the sum of edge weights + self interaction
+						vw+= ew;
+						//Add an edge and the edge weight to the graph
+						adjncy[currentIndex] = neighbor;
+						adjwgt[currentIndex] = ew;
+						currentIndex++;
+					}
+
+					//If shiftDim = 1 this is an edge interaction. Add edge from j to i
+					//Edge has weight e->s.cell[j].count * e->s.cell[neightbor.count * EDGE (Estimated number of distance calculations)
+					if(shiftDim==1)
+					{
+						ew = e->s.cells[j].count * e->s.cells[neighbor].count * EDGE;
+						//Vertex Weights are the sum of edge weights + self interaction
+						vw+=ew;
+						//Add an edge and the edge weight to the graph
+						adjncy[currentIndex] = neighbor;
+						adjwgt[currentIndex] = ew;
+						currentIndex++;
+					}
+
+
+					//If shiftDim = 0 this is an corner interaction. Add edge from j to i
+					//Edge has weight e->s.cell[j].count * e->s.cell[neightbor.count * CORNER (Estimated number of distance calculations)
+					if(shiftDim==0)
+					{
+						ew = e->s.cells[j].count * e->s.cells[neighbor].count * CORNER;
+						//Vertex Weights are the sum of edge weights + self interaction
+						vw+=ew;
+						//Add an edge and the edge weight to the graph
+						adjncy[currentIndex] = neighbor;
+						adjwgt[currentIndex] = ew;
+						currentIndex++;
+					}
+				}
+
+
+			}
+		}
+		//We now know vertex weight.
+		vwgt[j] = vw;
+	}
+
+	//Need to add the final thing METIS needs to xadj
+	xadj[e->s.nr_cells]=currentIndex;
+
+	//Setup METIS options
+	idx_t *options = (idx_t*) malloc(METIS_NOPTIONS * sizeof(idx_t));
+	if(options==NULL)return 1;
+	METIS_SetDefaultOptions(options);
+	options[METIS_OPTION_PTYPE]=METIS_PTYPE_KWAY;
+	options[METIS_OPTION_OBJTYPE]=METIS_OBJTYPE_CUT;
+	options[METIS_OPTION_CTYPE] = METIS_CTYPE_SHEM;
+	options[METIS_OPTION_IPTYPE]=METIS_IPTYPE_GROW;
+	options[METIS_OPTION_NCUTS] = 1;
+	options[METIS_OPTION_NSEPS] = 1;
+	options[METIS_OPTION_NUMBERING] = 0; //C-style numbering :)
+	options[METIS_OPTION_NITER] = 10;
+	options[METIS_OPTION_SEED] = 1;
+	options[METIS_OPTION_CONTIG] = 1;
+	options[METIS_OPTION_UFACTOR] = 30;
+	//	options[METIS_OPTION_DBGLVL] = METIS_DBG_INFO;
+
+	//Run METIS to partition the graph
+	METIS_PartGraphKway( nvtxs , ncon , xadj , adjncy , vwgt , NULL , adjwgt , nparts , NULL , NULL , options , objval , MxParticle );
+	if( flags == engine_split_MPI )
+	{
+		for(i = 0; i < e->s.nr_cells; i++ )
+		{
+			e->s.cells[i].nodeID = MxParticle[i];
+			//Not my cell? Mark as ghost.
+			if(MxParticle[i] != e->nodeID)
+				e->s.cells[i].flags |= cell_flag_ghost;
+			e->nr_nodes = N;
+
+		}
+	}else if ( flags == engine_split_GPU )
+	{
+		int part1 = 0;
+		int part2 = 0;
+		for( i = 0 ; i < e->s.nr_cells ; i++ )
+		{
+			e->s.cells[i].GPUID = MxParticle[i];
+			if(e->s.cells[i].GPUID == 0)
+				part1++;
+			else
+				part2++;
+		}
+		printf("%i  %i \n", part1, part2);
+
+
+	}
+
+	/* Store the number of nodes. */
+
+	/*Free memory used by METIS*/
+	free(xadj);
+	free(adjncy);
+	free(vwgt);
+	free(adjwgt);
+	free(nvtxs);
+	free(ncon);
+	free(nparts);
+	free(objval);
+	free(MxParticle);
+	free(options);
+	printf("Successfully split the space\n");
+
+	/* Call it a day. */
+	return engine_err_ok;
+
+	/* Bisect recursively */
 	/* Interior, recursive function that actually does the split. */
 	int engine_split_bisect_rec( int N_min , int N_max , int x_min , int x_max , int y_min , int y_max , int z_min , int z_max , int flags) {
 
-		int i, j, k, m, Nm;
-		int hx, hy, hz;
-		unsigned int flag = 0;
-		struct space_cell *c;
+		int i, j, k, m, Nm;
+		int hx, hy, hz;
+		unsigned int flag = 0;
+		struct space_cell *c;
+
+		/* Check inputs. */
+		if ( x_max < x_min || y_max < y_min || z_max < z_min )
+			return error(engine_err_domain);
+
+		/* Is there nothing left to split? */
+		if ( N_min == N_max ) {
+
+			/* Flag as ghost or not? */
+			if( flags == engine_split_MPI )
+			{
+				if ( N_min != e->nodeID )
+					flag = cell_flag_ghost;
+
+				/* printf("engine_split_bisect: marking range [ %i..%i , %i..%i , %i..%i ] with flag %i.\n",
+                x_min, x_max, y_min, y_max, z_min, z_max, flag ); */
+
+				/* Run through the cells. */
+				for ( i = x_min ; i < x_max ; i++ )
+					for ( j = y_min ; j < y_max ; j++ )
+						for ( k = z_min ; k < z_max ; k++ ) {
+							c = &( e->s.cells[ space_cellid(&(e->s),i,j,k) ] );
+							c->flags |= flag;
+							c->nodeID = N_min;
+						}
+			}else{
+
+				for ( i = x_min ; i < x_max ; i++ )
+					for ( j = y_min ; j < y_max ; j++ )
+						for ( k = z_min ; k < z_max ; k++ ) {
+							c = &( e->s.cells[ space_cellid(&(e->s),i,j,k) ] );
+							c->GPUID = N_min;
+						}
+			}
+		}
+
+		/* Otherwise, bisect. */
+		else {
+
+			hx = x_max - x_min;
+			hy = y_max - y_min;
+			hz = z_max - z_min;
+			Nm = (N_min + N_max) / 2;
+
+			/* Is the x-axis the largest? */
+					if ( hx > hy && hx > hz ) {
+						m = (x_min + x_max) / 2;
+						if ( engine_split_bisect_rec( N_min , Nm , x_min , m , y_min , y_max , z_min , z_max , flags) < 0 ||
+								engine_split_bisect_rec( Nm+1 , N_max , m , x_max , y_min , y_max , z_min , z_max , flags) < 0 )
+							return error(engine_err);
+					}
+
+					/* Nope, maybe the y-axis? */
+					else if ( hy > hz ) {
+						m = (y_min + y_max) / 2;
+						if ( engine_split_bisect_rec( N_min , Nm , x_min , x_max , y_min , m , z_min , z_max , flags ) < 0 ||
+								engine_split_bisect_rec( Nm+1 , N_max , x_min , x_max , m , y_max , z_min , z_max , flags) < 0 )
+							return error(engine_err);
+					}
+
+					/* Then it has to be the z-axis. */
+					else {
+						m = (z_min + z_max) / 2;
+						if ( engine_split_bisect_rec( N_min , Nm , x_min , x_max , y_min , y_max , z_min , m , flags) < 0 ||
+								engine_split_bisect_rec( Nm+1 , N_max , x_min , x_max , y_min , y_max , m , z_max , flags) < 0 )
+							return error(engine_err);
+					}
+
+		}
+
+		/* So far, so good! */
+		return engine_err_ok;
+
+	}
+
+	/* Check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* Call the recursive bisection. */
+	if ( engine_split_bisect_rec( 0 , N-1 , 0 , e->s.cdim[0] , 0 , e->s.cdim[1] , 0 , e->s.cdim[2] , flags) < 0 )
+		return error(engine_err);
+
+	/* Store the number of nodes. */
+	e->nr_nodes = N;
+
+	/* Call it a day. */
+	return engine_err_ok;
+
+}
+
+#endif
+
+/* Interior, recursive function that actually does the split. */
+static int engine_split_bisect_rec(struct engine *e, int N_min , int N_max ,
+		int x_min , int x_max , int y_min , int y_max , int z_min , int z_max ) {
+
+	int i, j, k, m, Nm;
+	int hx, hy, hz;
+	unsigned int flag = 0;
+	struct space_cell *c;
+
+	/* Check inputs. */
+	if ( x_max < x_min || y_max < y_min || z_max < z_min )
+		return error(engine_err_domain);
+
+	/* Is there nothing left to split? */
+	if ( N_min == N_max ) {
+
+		/* Flag as ghost or not? */
+		if ( N_min != e->nodeID )
+			flag = cell_flag_ghost;
+
+		/* printf("engine_split_bisect: marking range [ %i..%i , %i..%i , %i..%i ] with flag %i.\n",
+            x_min, x_max, y_min, y_max, z_min, z_max, flag ); */
+
+		/* Run through the cells. */
+		for ( i = x_min ; i < x_max ; i++ )
+			for ( j = y_min ; j < y_max ; j++ )
+				for ( k = z_min ; k < z_max ; k++ ) {
+					c = &( e->s.cells[ space_cellid(&(e->s),i,j,k) ] );
+					c->flags |= flag;
+					c->nodeID = N_min;
+				}
+	}
+
+	/* Otherwise, bisect. */
+	else {
+
+		hx = x_max - x_min;
+		hy = y_max - y_min;
+		hz = z_max - z_min;
+		Nm = (N_min + N_max) / 2;
+
+		/* Is the x-axis the largest? */
+		if ( hx > hy && hx > hz ) {
+			m = (x_min + x_max) / 2;
+			if ( engine_split_bisect_rec(e, N_min , Nm , x_min , m , y_min , y_max , z_min , z_max ) < 0 ||
+					engine_split_bisect_rec(e, Nm+1 , N_max , m , x_max , y_min , y_max , z_min , z_max ) < 0 )
+				return error(engine_err);
+		}
+
+		/* Nope, maybe the y-axis? */
+		else if ( hy > hz ) {
+			m = (y_min + y_max) / 2;
+			if ( engine_split_bisect_rec(e, N_min , Nm , x_min , x_max , y_min , m , z_min , z_max ) < 0 ||
+					engine_split_bisect_rec(e, Nm+1 , N_max , x_min , x_max , m , y_max , z_min , z_max ) < 0 )
+				return error(engine_err);
+		}
+
+		/* Then it has to be the z-axis. */
+		else {
+			m = (z_min + z_max) / 2;
+			if ( engine_split_bisect_rec(e, N_min , Nm , x_min , x_max , y_min , y_max , z_min , m ) < 0 ||
+					engine_split_bisect_rec(e, Nm+1 , N_max , x_min , x_max , y_min , y_max , m , z_max ) < 0 )
+				return error(engine_err);
+		}
+
+	}
+
+	/* So far, so good! */
+	return engine_err_ok;
+
+}
+
+
+
+
+/**
+ * @brief Split the computational domain over a number of nodes using
+ *      bisection.
+ *
+ * @param e The #engine to split up.
+ * @param N The number of computational nodes.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+int engine_split_bisect ( struct engine *e , int N ) {
+
+	/* Check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* Call the recursive bisection. */
+	if ( engine_split_bisect_rec(e, 0 , N-1 , 0 , e->s.cdim[0] , 0 , e->s.cdim[1] , 0 , e->s.cdim[2] ) < 0 )
+		return error(engine_err);
+
+	/* Store the number of nodes. */
+	e->nr_nodes = N;
+
+	/* Call it a day. */
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Clear all particles from this #engine.
+ *
+ * @param e The #engine to flush.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+int engine_flush ( struct engine *e ) {
+
+	/* check input. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* Clear the space. */
+	if ( space_flush( &e->s ) < 0 )
+		return error(engine_err_space);
+
+	/* done for now. */
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Clear all particles from this #engine's ghost cells.
+ *
+ * @param e The #engine to flush.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+int engine_flush_ghosts ( struct engine *e ) {
+
+	/* check input. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* Clear the space. */
+	if ( space_flush_ghosts( &e->s ) < 0 )
+		return error(engine_err_space);
+
+	/* done for now. */
+	return engine_err_ok;
+
+}
+
+
+/** 
+ * @brief Set the explicit electrostatic potential.
+ *
+ * @param e The #engine.
+ * @param ep The electrostatic #potential.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * If @c ep is not @c NULL, the flag #engine_flag_explepot is set,
+ * otherwise it is cleared.
+ */
+
+int engine_setexplepot ( struct engine *e , struct MxPotential *ep ) {
+
+	/* check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* was a potential supplied? */
+	if ( ep != NULL ) {
+
+		/* set the flag. */
+		e->flags |= engine_flag_explepot;
+
+		/* set the potential. */
+		e->ep = ep;
+
+	}
+
+	/* otherwise, just clear the flag. */
+	else
+		e->flags &= ~engine_flag_explepot;
+
+	/* done for now. */
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Unload a set of particle data from the #engine.
+ *
+ * @param e The #engine.
+ * @param x An @c N times 3 array of the particle positions.
+ * @param v An @c N times 3 array of the particle velocities.
+ * @param type A vector of length @c N of the particle type IDs.
+ * @param pid A vector of length @c N of the particle IDs.
+ * @param vid A vector of length @c N of the particle virtual IDs.
+ * @param q A vector of length @c N of the individual particle charges.
+ * @param flags A vector of length @c N of the particle flags.
+ * @param epot A pointer to a #double in which to store the total potential energy.
+ * @param N the maximum number of particles.
+ *
+ * @return The number of particles unloaded or < 0 on
+ *      error (see #engine_err).
+ *
+ * The fields @c x, @c v, @c type, @c pid, @c vid, @c q, @c epot and/or @c flags may be NULL.
+ */
+
+int engine_unload ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , double *epot , int N ) {
+
+	struct MxParticle *p;
+	struct space_cell *c;
+	int j, k, cid, count = 0, *ind;
+	double epot_acc = 0.0;
+
+	/* check the inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+
+	/* Get the positions and velocities out of the SoA buffers. */
+	if ( space_soa_unpack( &e->s ) < 0 )
+		return error(engine_err_space);
+
+	/* Allocate and fill the indices. */
+	if ( ( ind = (int *)alloca( sizeof(int) * (e->s.nr_cells + 1) ) ) == NULL )
+		return error(engine_err_malloc);
+	ind[0] = 0;
+	for ( k = 0 ; k < e->s.nr_cells ; k++ )
+		ind[k+1] = ind[k] + e->s.cells[k].count;
+	if ( ind[e->s.nr_cells] > N )
+		return error(engine_err_range);
+
+	/* Loop over each cell. */
+#pragma omp parallel for schedule(static), private(cid,count,c,k,p,j), reduction(+:epot_acc)
+	for ( cid = 0 ; cid < e->s.nr_cells ; cid++ ) {
+
+		/* Get a hold of the cell. */
+		c = &( e->s.cells[cid] );
+		count = ind[cid];
+
+		/* Collect the potential energy if requested. */
+		epot_acc += c->epot;
+
+		/* Loop over the parts in this cell. */
+		for ( k = 0 ; k < c->count ; k++ ) {
+
+			/* Get a hold of the particle. */
+			p = &( c->parts[k] );
+
+			/* get this particle's data, where requested. */
+			if ( x != NULL )
+				for ( j = 0 ; j < 3 ; j++ )
+					x[count*3+j] = c->origin[j] + p->x[j];
+			if ( v != NULL)
+				for ( j = 0 ; j < 3 ; j++ )
+					v[count*3+j] = p->v[j];
+			if ( type != NULL )
+				type[count] = p->typeId;
+			if ( pid != NULL )
+				pid[count] = p->id;
+			if ( vid != NULL )
+				vid[count] = p->vid;
+			if ( q != NULL )
+				q[count] = p->q;
+			if ( flags != NULL )
+				flags[count] = p->flags;
+
+			/* Step-up the counter. */
+			count += 1;
+
+		}
+
+	}
+
+	/* Write back the potential energy, if requested. */
+	if ( epot != NULL )
+		*epot += epot_acc;
+
+	/* to the pub! */
+	return ind[e->s.nr_cells];
+
+}
+
+
+/**
+ * @brief Unload a set of particle data from the marked cells of an #engine
+ *
+ * @param e The #engine.
+ * @param x An @c N times 3 array of the particle positions.
+ * @param v An @c N times 3 array of the particle velocities.
+ * @param type A vector of length @c N of the particle type IDs.
+ * @param pid A vector of length @c N of the particle IDs.
+ * @param vid A vector of length @c N of the particle virtual IDs.
+ * @param q A vector of length @c N of the individual particle charges.
+ * @param flags A vector of length @c N of the particle flags.
+ * @param epot A pointer to a #double in which to store the total potential energy.
+ * @param N the maximum number of particles.
+ *
+ * @return The number of particles unloaded or < 0 on
+ *      error (see #engine_err).
+ *
+ * The fields @c x, @c v, @c type, @c pid, @c vid, @c q, @c epot and/or @c flags may be NULL.
+ */
+
+int engine_unload_marked ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , double *epot , int N ) {
 
-		/* Check inputs. */
-		if ( x_max < x_min || y_max < y_min || z_max < z_min )
-			return error(engine_err_domain);
+	struct MxParticle *p;
+	struct space_cell *c;
+	int j, k, cid, count = 0, *ind;
+	double epot_acc = 0.0;
 
-		/* Is there nothing left to split? */
-		if ( N_min == N_max ) {
+	/* check the inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
 
-			/* Flag as ghost or not? */
-			if( flags == engine_split_MPI )
-			{
-				if ( N_min != e->nodeID )
-					flag = cell_flag_ghost;
+	/* Get the positions and velocities out of the SoA buffers. */
+	if ( space_soa_unpack( &e->s ) < 0 )
+		return error(engine_err_space);
 
-				/* printf("engine_split_bisect: marking range [ %i..%i , %i..%i , %i..%i ] with flag %i.\n",
-                x_min, x_max, y_min, y_max, z_min, z_max, flag ); */
+	/* Allocate and fill the indices. */
+	if ( ( ind = (int *)alloca( sizeof(int) * (e->s.nr_cells + 1) ) ) == NULL )
+		return error(engine_err_malloc);
+	ind[0] = 0;
+	for ( k = 0 ; k < e->s.nr_cells ; k++ )
+		if ( e->s.cells[k].flags & cell_flag_marked )
+			ind[k+1] = ind[k] + e->s.cells[k].count;
+		else
+			ind[k+1] = ind[k];
+	if ( ind[e->s.nr_cells] > N )
+		return error(engine_err_range);
 
-				/* Run through the cells. */
-				for ( i = x_min ; i < x_max ; i++ )
-					for ( j = y_min ; j < y_max ; j++ )
-						for ( k = z_min ; k < z_max ; k++ ) {
-							c = &( e->s.cells[ space_cellid(&(e->s),i,j,k) ] );
-							c->flags |= flag;
-							c->nodeID = N_min;
-						}
-			}else{
+	/* Loop over each cell. */
+#pragma omp parallel for schedule(static), private(cid,count,c,k,p,j), reduction(+:epot_acc)
+	for ( cid = 0 ; cid < e->s.nr_marked ; cid++ ) {
 
-				for ( i = x_min ; i < x_max ; i++ )
-					for ( j = y_min ; j < y_max ; j++ )
-						for ( k = z_min ; k < z_max ; k++ ) {
-							c = &( e->s.cells[ space_cellid(&(e->s),i,j,k) ] );
-							c->GPUID = N_min;
-						}
-			}
-		}
+		/* Get a hold of the cell. */
+		c = &( e->s.cells[e->s.cid_marked[cid]] );
+		count = ind[e->s.cid_marked[cid]];
 
-		/* Otherwise, bisect. */
-		else {
+		/* Collect the potential energy if requested. */
+		epot_acc += c->epot;
 
-			hx = x_max - x_min;
-			hy = y_max - y_min;
-			hz = z_max - z_min;
-			Nm = (N_min + N_max) / 2;
+		/* Loop over the parts in this cell. */
+		for ( k = 0 ; k < c->count ; k++ ) {
 
-			/* Is the x-axis the largest? */
-					if ( hx > hy && hx > hz ) {
-						m = (x_min + x_max) / 2;
-						if ( engine_split_bisect_rec( N_min , Nm , x_min , m , y_min , y_max , z_min , z_max , flags) < 0 ||
-								engine_split_bisect_rec( Nm+1 , N_max , m , x_max , y_min , y_max , z_min , z_max , flags) < 0 )
-							return error(engine_err);
-					}
+			/* Get a hold of the particle. */
+			p = &( c->parts[k] );
 
-					/* Nope, maybe the y-axis? */
-					else if ( hy > hz ) {
-						m = (y_min + y_max) / 2;
-						if ( engine_split_bisect_rec( N_min , Nm , x_min , x_max , y_min , m , z_min , z_max , flags ) < 0 ||
-								engine_split_bisect_rec( Nm+1 , N_max , x_min , x_max , m , y_max , z_min , z_max , flags) < 0 )
-							return error(engine_err);
-					}
+			/* get this particle's data, where requested. */
+			if ( x != NULL )
+				for ( j = 0 ; j < 3 ; j++ )
+					x[count*3+j] = c->origin[j] + p->x[j];
+			if ( v != NULL)
+				for ( j = 0 ; j < 3 ; j++ )
+					v[count*3+j] = p->v[j];
+			if ( type != NULL )
+				type[count] = p->typeId;
+			if ( pid != NULL )
+				pid[count] = p->id;
+			if ( vid != NULL )
+				vid[count] = p->vid;
+			if ( q != NULL )
+				q[count] = p->q;
+			if ( flags != NULL )
+				flags[count] = p->flags;
 
-					/* Then it has to be the z-axis. */
-					else {
-						m = (z_min + z_max) / 2;
-						if ( engine_split_bisect_rec( N_min , Nm , x_min , x_max , y_min , y_max , z_min , m , flags) < 0 ||
-								engine_split_bisect_rec( Nm+1 , N_max , x_min , x_max , y_min , y_max , m , z_max , flags) < 0 )
-							return error(engine_err);
-					}
+			/* Step-up the counter. */
+			count += 1;
 
 		}
 
-		/* So far, so good! */
-		return engine_err_ok;
-
 	}
 
-	/* Check inputs. */
-	if ( e == NULL )
-		return error(engine_err_null);
-
-	/* Call the recursive bisection. */
-	if ( engine_split_bisect_rec( 0 , N-1 , 0 , e->s.cdim[0] , 0 , e->s.cdim[1] , 0 , e->s.cdim[2] , flags) < 0 )
-		return error(engine_err);
-
-	/* Store the number of nodes. */
-	e->nr_nodes = N;
+	/* Write back the potential energy, if requested. */
+	if ( epot != NULL )
+		*epot += epot_acc;
 
-	/* Call it a day. */
-	return engine_err_ok;
+	/* to the pub! */
+	return ind[e->s.nr_cells];
 
 }
 
-#endif
 
-/* Interior, recursive function that actually does the split. */
-static int engine_split_bisect_rec(struct engine *e, int N_min , int N_max ,
-		int x_min , int x_max , int y_min , int y_max , int z_min , int z_max ) {
+/**
+ * @brief Unload real particles that may have wandered into a ghost cell.
+ *
+ * @param e The #engine.
+ * @param x An @c N times 3 array of the particle positions.
+ * @param v An @c N times 3 array of the particle velocities.
+ * @param type A vector of length @c N of the particle type IDs.
+ * @param pid A vector of length @c N of the particle IDs.
+ * @param vid A vector of length @c N of the particle virtual IDs.
+ * @param q A vector of length @c N of the individual particle charges.
+ * @param flags A vector of length @c N of the particle flags.
+ * @param epot A pointer to a #double in which to store the total potential energy.
+ * @param N the maximum number of particles.
+ *
+ * @return The number of particles unloaded or < 0 on
+ *      error (see #engine_err).
+ *
+ * The fields @c x, @c v, @c type, @c vid, @c pid, @c q, @c epot and/or @c flags may be NULL.
+ */
 
-	int i, j, k, m, Nm;
-	int hx, hy, hz;
-	unsigned int flag = 0;
+int engine_unload_strays ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , double *epot , int N ) {
+
+	struct MxParticle *p;
 	struct space_cell *c;
+	int j, k, cid, count = 0;
+	double epot_acc = 0.0;
 
-	/* Check inputs. */
-	if ( x_max < x_min || y_max < y_min || z_max < z_min )
-		return error(engine_err_domain);
+	/* check the inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
 
-	/* Is there nothing left to split? */
-	if ( N_min == N_max ) {
+	/* Get the positions and velocities out of the SoA buffers. */
+	if ( space_soa_unpack( &e->s ) < 0 )
+		return error(engine_err_space);
 
-		/* Flag as ghost or not? */
-		if ( N_min != e->nodeID )
-			flag = cell_flag_ghost;
+	/* Loop over each cell. */
+	for ( cid = 0 ; cid < e->s.nr_real ; cid++ ) {
 
-		/* printf("engine_split_bisect: marking range [ %i..%i , %i..%i , %i..%i ] with flag %i.\n",
-            x_min, x_max, y_min, y_max, z_min, z_max, flag ); */
+		/* Get a hold of the cell. */
+		c = &( e->s.cells[e->s.cid_real[cid]] );
 
-		/* Run through the cells. */
-		for ( i = x_min ; i < x_max ; i++ )
-			for ( j = y_min ; j < y_max ; j++ )
-				for ( k = z_min ; k < z_max ; k++ ) {
-					c = &( e->s.cells[ space_cellid(&(e->s),i,j,k) ] );
-					c->flags |= flag;
-					c->nodeID = N_min;
-				}
-	}
+		/* Collect the potential energy if requested. */
+		epot_acc += c->epot;
 
-	/* Otherwise, bisect. */
-	else {
+		/* Loop over the parts in this cell. */
+		for ( k = c->count-1 ; k >= 0 && !(c->parts[k].flags & PARTICLE_FLAG_GHOST) ; k-- ) {
 
-		hx = x_max - x_min;
-		hy = y_max - y_min;
-		hz = z_max - z_min;
-		Nm = (N_min + N_max) / 2;
+			/* Get a hold of the particle. */
+			p = &( c->parts[k] );
+			if ( p->flags & PARTICLE_FLAG_GHOST )
+				continue;
 
-		/* Is the x-axis the largest? */
-		if ( hx > hy && hx > hz ) {
-			m = (x_min + x_max) / 2;
-			if ( engine_split_bisect_rec(e, N_min , Nm , x_min , m , y_min , y_max , z_min , z_max ) < 0 ||
-					engine_split_bisect_rec(e, Nm+1 , N_max , m , x_max , y_min , y_max , z_min , z_max ) < 0 )
-				return error(engine_err);
-		}
+			/* get this particle's data, where requested. */
+			if ( x != NULL )
+				for ( j = 0 ; j < 3 ; j++ )
+					x[count*3+j] = c->origin[j] + p->x[j];
+			if ( v != NULL)
+				for ( j = 0 ; j < 3 ; j++ )
+					v[count*3+j] = p->v[j];
+			if ( type != NULL )
+				type[count] = p->typeId;
+			if ( pid != NULL )
+				pid[count] = p->id;
+			if ( vid != NULL )
+				vid[count] = p->vid;
+			if ( q != NULL )
+				q[count] = p->q;
+			if ( flags != NULL )
+				flags[count] = p->flags;
 
-		/* Nope, maybe the y-axis? */
-		else if ( hy > hz ) {
-			m = (y_min + y_max) / 2;
-			if ( engine_split_bisect_rec(e, N_min , Nm , x_min , x_max , y_min , m , z_min , z_max ) < 0 ||
-					engine_split_bisect_rec(e, Nm+1 , N_max , x_min , x_max , m , y_max , z_min , z_max ) < 0 )
-				return error(engine_err);
-		}
+			/* increase the counter. */
+			count += 1;
 
-		/* Then it has to be the z-axis. */
-		else {
-			m = (z_min + z_max) / 2;
-			if ( engine_split_bisect_rec(e, N_min , Nm , x_min , x_max , y_min , y_max , z_min , m ) < 0 ||
-					engine_split_bisect_rec(e, Nm+1 , N_max , x_min , x_max , y_min , y_max , m , z_max ) < 0 )
-				return error(engine_err);
 		}
 
 	}
 
-	/* So far, so good! */
-	return engine_err_ok;
-
-}
+	/* Write back the potential energy, if requested. */
+	if ( epot != NULL )
+		*epot += epot_acc;
 
+	/* to the pub! */
+	return count;
 
+}
 
 
 /**
- * @brief Split the computational domain over a number of nodes using
- *      bisection.
+ * @brief Load a set of particle data.
  *
- * @param e The #engine to split up.
- * @param N The number of computational nodes.
+ * @param e The #engine.
+ * @param x An @c N times 3 array of the particle positions.
+ * @param v An @c N times 3 array of the particle velocities.
+ * @param type A vector of length @c N of the particle type IDs.
+ * @param pid A vector of length @c N of the particle IDs.
+ * @param vid A vector of length @c N of the particle virtual IDs.
+ * @param q A vector of length @c N of the individual particle charges.
+ * @param flags A vector of length @c N of the particle flags.
+ * @param N the number of particles to load.
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * If the parameters @c v, @c flags, @c vid or @c q are @c NULL, then
+ * these values are set to zero.
  */
 
-int engine_split_bisect ( struct engine *e , int N ) {
+int engine_load ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , int N ) {
 
-	/* Check inputs. */
-	if ( e == NULL )
+	struct MxParticle p;
+	struct space *s;
+	int j, k;
+
+	/* check the inputs. */
+	if ( e == NULL || x == NULL || type == NULL )
 		return error(engine_err_null);
 
-	/* Call the recursive bisection. */
-	if ( engine_split_bisect_rec(e, 0 , N-1 , 0 , e->s.cdim[0] , 0 , e->s.cdim[1] , 0 , e->s.cdim[2] ) < 0 )
-		return error(engine_err);
+	/* Get a handle on the space. */
+	s = &(e->s);
 
-	/* Store the number of nodes. */
-	e->nr_nodes = N;
+	/* init the velocity and charge in case not specified. */
+	p.v[0] = 0.0; p.v[1] = 0.0; p.v[2] = 0.0;
+	p.f[0] = 0.0; p.f[1] = 0.0; p.f[2] = 0.0;
+	p.q = 0.0;
+	p.flags = PARTICLE_FLAG_NONE;
 
-	/* Call it a day. */
+	/* loop over the entries. */
+	for ( j = 0 ; j < N ; j++ ) {
+
+		/* set the particle data. */
+		p.typeId = type[j];
+		if ( pid != NULL )
+			p.id = pid[j];
+		else
+			p.id = j;
+		if ( vid != NULL )
+			p.vid = vid[j];
+		if ( flags != NULL )
+			p.flags = flags[j];
+		if ( v != NULL )
+			for ( k = 0 ; k < 3 ; k++ )
+				p.v[k] = v[j*3+k];
+		if ( q != 0 )
+			p.q = q[j];
+		else if ( type[j] >= 0 && type[j] < e->nr_types )
+			p.q = e->types[ type[j] ].charge;
+
+		/* add the part to the space. */
+		if ( engine_addpart( e , &p , &x[3*j], NULL ) < 0 )
+			return error(engine_err_space);
+
+	}
+
+	/* to the pub! */
 	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Clear all particles from this #engine.
+ * @brief Load a set of particle data as ghosts
  *
- * @param e The #engine to flush.
+ * @param e The #engine.
+ * @param x An @c N times 3 array of the particle positions.
+ * @param v An @c N times 3 array of the particle velocities.
+ * @param type A vector of length @c N of the particle type IDs.
+ * @param pid A vector of length @c N of the particle IDs.
+ * @param vid A vector of length @c N of the particle virtual IDs.
+ * @param q A vector of length @c N of the individual particle charges.
+ * @param flags A vector of length @c N of the particle flags.
+ * @param N the number of particles to load.
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * If the parameters @c v, @c flags, @c vid or @c q are @c NULL, then
+ * these values are set to zero.
  */
 
-int engine_flush ( struct engine *e ) {
+int engine_load_ghosts ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , int N ) {
 
-	/* check input. */
-	if ( e == NULL )
+	struct MxParticle p;
+	struct space *s;
+	int j, k;
+
+	/* check the inputs. */
+	if ( e == NULL || x == NULL || type == NULL )
 		return error(engine_err_null);
 
-	/* Clear the space. */
-	if ( space_flush( &e->s ) < 0 )
-		return error(engine_err_space);
+	/* Get a handle on the space. */
+	s = &(e->s);
 
-	/* done for now. */
+	/* init the velocity and charge in case not specified. */
+	p.v[0] = 0.0; p.v[1] = 0.0; p.v[2] = 0.0;
+	p.f[0] = 0.0; p.f[1] = 0.0; p.f[2] = 0.0;
+	p.q = 0.0;
+	p.flags = PARTICLE_FLAG_GHOST;
+
+	/* loop over the entries. */
+	for ( j = 0 ; j < N ; j++ ) {
+
+		/* set the particle data. */
+		p.typeId = type[j];
+		if ( pid != NULL )
+			p.id = pid[j];
+		else
+			p.id = j;
+		if ( vid != NULL )
+			p.vid = vid[j];
+		if ( flags != NULL )
+			p.flags = flags[j] | PARTICLE_FLAG_GHOST;
+		if ( v != NULL )
+			for ( k = 0 ; k < 3 ; k++ )
+				p.v[k] = v[j*3+k];
+		if ( q != 0 )
+			p.q = q[j];
+		else if ( type[j] >= 0 && type[j] < e->nr_types )
+			p.q = e->types[ type[j] ].charge;
+
+		/* add the part to the space. */
+		if ( engine_addpart( e , &p , &x[3*j], NULL ) < 0 )
+			return error(engine_err_space);
+
+	}
+
+	/* to the pub! */
 	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Clear all particles from this #engine's ghost cells.
+ * @brief Look for a given type by name.
  *
- * @param e The #engine to flush.
+ * @param e The #engine.
+ * @param name The type name.
  *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * @return The type ID or < 0 on error (see #engine_err).
  */
 
-int engine_flush_ghosts ( struct engine *e ) {
+int engine_gettype ( struct engine *e , char *name ) {
 
-	/* check input. */
-	if ( e == NULL )
+	int k;
+
+	/* check for nonsense. */
+	if ( e == NULL || name == NULL )
 		return error(engine_err_null);
 
-	/* Clear the space. */
-	if ( space_flush_ghosts( &e->s ) < 0 )
-		return error(engine_err_space);
+	/* Loop over the types... */
+	for ( k = 0 ; k < e->nr_types ; k++ ) {
 
-	/* done for now. */
-	return engine_err_ok;
+		/* Compare the name. */
+		if ( strcmp( e->types[k].name , name ) == 0 )
+			return k;
+
+	}
+
+	/* Otherwise, nothing found... */
+	return engine_err_range;
 
 }
 
 
-/** 
- * @brief Set the explicit electrostatic potential.
+/**
+ * @brief Look for a given type by its second name.
  *
  * @param e The #engine.
- * @param ep The electrostatic #potential.
- *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * @param name2 The type name2.
  *
- * If @c ep is not @c NULL, the flag #engine_flag_explepot is set,
- * otherwise it is cleared.
+ * @return The type ID or < 0 on error (see #engine_err).
  */
 
-int engine_setexplepot ( struct engine *e , struct MxPotential *ep ) {
+int engine_gettype2 ( struct engine *e , char *name2 ) {
 
-	/* check inputs. */
-	if ( e == NULL )
-		return error(engine_err_null);
+	int k;
 
-	/* was a potential supplied? */
-	if ( ep != NULL ) {
+	/* check for nonsense. */
+	if ( e == NULL || name2 == NULL )
+		return error(engine_err_null);
 
-		/* set the flag. */
-		e->flags |= engine_flag_explepot;
+	/* Loop over the types... */
+	for ( k = 0 ; k < e->nr_types ; k++ ) {
 
-		/* set the potential. */
-		e->ep = ep;
+		/* Compare the name. */
+		if ( strcmp( e->types[k].name2 , name2 ) == 0 )
+			return k;
 
 	}
 
-	/* otherwise, just clear the flag. */
-	else
-		e->flags &= ~engine_flag_explepot;
-
-	/* done for now. */
-	return engine_err_ok;
+	/* Otherwise, nothing found... */
+	return engine_err_range;
 
 }
 
 
 /**
- * @brief Unload a set of particle data from the #engine.
+ * @brief Add a type definition.
  *
  * @param e The #engine.
- * @param x An @c N times 3 array of the particle positions.
- * @param v An @c N times 3 array of the particle velocities.
- * @param type A vector of length @c N of the particle type IDs.
- * @param pid A vector of length @c N of the particle IDs.
- * @param vid A vector of length @c N of the particle virtual IDs.
- * @param q A vector of length @c N of the individual particle charges.
- * @param flags A vector of length @c N of the particle flags.
- * @param epot A pointer to a #double in which to store the total potential energy.
- * @param N the maximum number of particles.
+ * @param mass The particle type mass.
+ * @param charge The particle type charge.
+ * @param name Particle name, can be @c NULL.
+ * @param name2 Particle second name, can be @c NULL.
  *
- * @return The number of particles unloaded or < 0 on
- *      error (see #engine_err).
+ * @return The type ID or < 0 on error (see #engine_err).
+ *
+ * The particle type ID must be an integer greater or equal to 0
+ * and less than the value @c max_type specified in #engine_init.
+ */
+int engine_addtype ( struct engine *e , double mass , double charge ,
+        const char *name , const char *name2 ) {
+    
+    /* check for nonsense. */
+    if ( e == NULL )
+        return error(engine_err_null);
+    if ( e->nr_types >= e->max_type )
+        return error(engine_err_range);
+    
+    MxParticleType *type = MxParticleType_ForEngine(e, mass, charge, name, name2);
+    return type != NULL ? type->id : -1;
+}
+
+/**
+ * @brief Add an interaction potential.
+ *
+ * @param e The #engine.
+ * @param p The #potential to add to the #engine.
+ * @param i ID of particle type for this interaction.
+ * @param j ID of second particle type for this interaction.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Adds the given potential for pairs of particles of type @c i and @c j,
+ * where @c i and @c j may be the same type ID.
+ *
+ * If all the potentials have the same closed form, the pair kernels
+ * evaluate it directly instead of interpolating the tables.
  *
- * The fields @c x, @c v, @c type, @c pid, @c vid, @c q, @c epot and/or @c flags may be NULL.
+ * With #engine_flag_autogrid, a change of the largest potential range
+ * makes the next #engine_step pick a new cell grid.
  */
 
-int engine_unload ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , double *epot , int N ) {
+int engine_addpot ( struct engine *e , struct MxPotential *p , int i , int j ) {
 
-	struct MxParticle *p;
-	struct space_cell *c;
-	int j, k, cid, count = 0, *ind;
-	double epot_acc = 0.0;
+	double cutoff;
+	int k;
 
-	/* check the inputs. */
+	/* check for nonsense. */
 	if ( e == NULL )
 		return error(engine_err_null);
-
-	/* Allocate and fill the indices. */
-	if ( ( ind = (int *)alloca( sizeof(int) * (e->s.nr_cells + 1) ) ) == NULL )
-		return error(engine_err_malloc);
-	ind[0] = 0;
-	for ( k = 0 ; k < e->s.nr_cells ; k++ )
-		ind[k+1] = ind[k] + e->s.cells[k].count;
-	if ( ind[e->s.nr_cells] > N )
+	if ( i < 0 || i >= e->nr_types || j < 0 || j >= e->nr_types )
 		return error(engine_err_range);
 
-	/* Loop over each cell. */
-#pragma omp parallel for schedule(static), private(cid,count,c,k,p,j), reduction(+:epot_acc)
-	for ( cid = 0 ; cid < e->s.nr_cells ; cid++ ) {
-
-		/* Get a hold of the cell. */
-		c = &( e->s.cells[cid] );
-		count = ind[cid];
-
-		/* Collect the potential energy if requested. */
-		epot_acc += c->epot;
-
-		/* Loop over the parts in this cell. */
-		for ( k = 0 ; k < c->count ; k++ ) {
-
-			/* Get a hold of the particle. */
-			p = &( c->parts[k] );
-
-			/* get this particle's data, where requested. */
-			if ( x != NULL )
-				for ( j = 0 ; j < 3 ; j++ )
-					x[count*3+j] = c->origin[j] + p->x[j];
-			if ( v != NULL)
-				for ( j = 0 ; j < 3 ; j++ )
-					v[count*3+j] = p->v[j];
-			if ( type != NULL )
-				type[count] = p->typeId;
-			if ( pid != NULL )
-				pid[count] = p->id;
-			if ( vid != NULL )
-				vid[count] = p->vid;
-			if ( q != NULL )
-				q[count] = p->q;
-			if ( flags != NULL )
-				flags[count] = p->flags;
-
-			/* Step-up the counter. */
-			count += 1;
-
-		}
+	/* store the potential. */
+	e->p[ i * e->max_type + j ] = p;
+    Py_INCREF(p);
+    
+    if ( i != j ) {
+		e->p[ j * e->max_type + i ] = p;
+        Py_INCREF(p);
+    }
 
+	/* can the pair kernels use a closed form for all the potentials? */
+	e->pot_kind = p->kind;
+	for ( k = 0 ; k < e->max_type * e->max_type ; k++ )
+		if ( e->p[k] != NULL && e->p[k]->kind != p->kind )
+			e->pot_kind = potential_kind_table;
+
+	/* Does the cell grid still fit the cutoff? */
+	if ( e->flags & engine_flag_autogrid ) {
+		for ( cutoff = 0.0 , k = 0 ; k < e->max_type * e->max_type ; k++ )
+			if ( e->p[k] != NULL )
+				cutoff = fmax( cutoff , e->p[k]->b );
+		if ( cutoff != e->s.cutoff )
+			e->autogrid_pending = 1;
 	}
 
-	/* Write back the potential energy, if requested. */
-	if ( epot != NULL )
-		*epot += epot_acc;
+	/* end on a good note. */
+	return engine_err_ok;
+}
 
-	/* to the pub! */
-	return ind[e->s.nr_cells];
+CAPI_FUNC(int) engine_addforce1 ( struct engine *e , struct MxForce *p , int i ) {
+    /* check for nonsense. */
+    if ( e == NULL )
+        return error(engine_err_null);
+    if ( i < 0 || i >= e->nr_types  )
+        return error(engine_err_range);
+        
+    /* store the force. */
+    e->p_singlebody[i] = p;
+    Py_INCREF(p);
 
+    /* make sure the runners apply it. */
+    if ( space_addtasks_singlebody( &e->s ) < 0 )
+        return error(engine_err_space);
+
+    /* end on a good note. */
+    return engine_err_ok;
 }
 
 
 /**
- * @brief Unload a set of particle data from the marked cells of an #engine
+ * @brief Start the runners in the given #engine.
  *
- * @param e The #engine.
- * @param x An @c N times 3 array of the particle positions.
- * @param v An @c N times 3 array of the particle velocities.
- * @param type A vector of length @c N of the particle type IDs.
- * @param pid A vector of length @c N of the particle IDs.
- * @param vid A vector of length @c N of the particle virtual IDs.
- * @param q A vector of length @c N of the individual particle charges.
- * @param flags A vector of length @c N of the particle flags.
- * @param epot A pointer to a #double in which to store the total potential energy.
- * @param N the maximum number of particles.
+ * @param e The #engine to start.
+ * @param nr_runners The number of runners start.
  *
- * @return The number of particles unloaded or < 0 on
- *      error (see #engine_err).
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * The fields @c x, @c v, @c type, @c pid, @c vid, @c q, @c epot and/or @c flags may be NULL.
+ * Allocates and starts the specified number of #runner. Also initializes
+ * the Verlet lists and, with #engine_flag_autogrid, picks the cell grid
+ * with #engine_autogrid. Any potential tables still queued in a batch,
+ * see #potential_batch_begin, are fitted first.
  */
 
-int engine_unload_marked ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , double *epot , int N ) {
+int engine_start ( struct engine *e , int nr_runners , int nr_queues ) {
 
-	struct MxParticle *p;
+	int cid, pid, k, i;
 	struct space_cell *c;
-	int j, k, cid, count = 0, *ind;
-	double epot_acc = 0.0;
+	struct MxParticle *p;
+	struct space *s = &e->s;
 
-	/* check the inputs. */
-	if ( e == NULL )
-		return error(engine_err_null);
+	/* Is MPI really needed? */
+	if ( e->flags & engine_flag_mpi && e->nr_nodes == 1 )
+		e->flags &= ~( engine_flag_mpi | engine_flag_async );
 
-	/* Allocate and fill the indices. */
-	if ( ( ind = (int *)alloca( sizeof(int) * (e->s.nr_cells + 1) ) ) == NULL )
-		return error(engine_err_malloc);
-	ind[0] = 0;
-	for ( k = 0 ; k < e->s.nr_cells ; k++ )
-		if ( e->s.cells[k].flags & cell_flag_marked )
-			ind[k+1] = ind[k] + e->s.cells[k].count;
-		else
-			ind[k+1] = ind[k];
-	if ( ind[e->s.nr_cells] > N )
-		return error(engine_err_range);
+	/* Fit the potential tables of the batch, if any. */
+	if ( potential_batch_end() < 0 )
+		return error(engine_err_potential);
 
-	/* Loop over each cell. */
-#pragma omp parallel for schedule(static), private(cid,count,c,k,p,j), reduction(+:epot_acc)
-	for ( cid = 0 ; cid < e->s.nr_marked ; cid++ ) {
+	/* Pick the batched bonded kernels. */
+	e->bonded_simd = ( e->flags & engine_flag_simd ) ? runner_simd_detect() : runner_simd_none;
 
-		/* Get a hold of the cell. */
-		c = &( e->s.cells[e->s.cid_marked[cid]] );
-		count = ind[e->s.cid_marked[cid]];
+#ifdef WITH_MPI
+	/* Set up async communication? */
+	if ( e->flags & engine_flag_async ) {
 
-		/* Collect the potential energy if requested. */
-		epot_acc += c->epot;
+		/* Init the mutex and condition variable for the asynchronous communication. */
+		if ( pthread_mutex_init( &e->xchg_mutex , NULL ) != 0 ||
+				pthread_cond_init( &e->xchg_cond , NULL ) != 0 ||
+				pthread_mutex_init( &e->xchg2_mutex , NULL ) != 0 ||
+				pthread_cond_init( &e->xchg2_cond , NULL ) != 0 )
+			return error(engine_err_pthread);
 
-		/* Loop over the parts in this cell. */
-		for ( k = 0 ; k < c->count ; k++ ) {
+		/* Set the exchange flags. */
+		e->xchg_started = 0;
+		e->xchg_running = 0;
+		e->xchg2_started = 0;
+		e->xchg2_running = 0;
 
-			/* Get a hold of the particle. */
-			p = &( c->parts[k] );
+		/* Start a thread with the async exchange. */
+		if ( pthread_create( &e->thread_exchg , NULL , (void *(*)(void *))engine_exchange_async_run , e ) != 0 )
+			return error(engine_err_pthread);
+		if ( pthread_create( &e->thread_exchg2 , NULL , (void *(*)(void *))engine_exchange_rigid_async_run , e ) != 0 )
+			return error(engine_err_pthread);
 
-			/* get this particle's data, where requested. */
-			if ( x != NULL )
-				for ( j = 0 ; j < 3 ; j++ )
-					x[count*3+j] = c->origin[j] + p->x[j];
-			if ( v != NULL)
-				for ( j = 0 ; j < 3 ; j++ )
-					v[count*3+j] = p->v[j];
-			if ( type != NULL )
-				type[count] = p->typeId;
-			if ( pid != NULL )
-				pid[count] = p->id;
-			if ( vid != NULL )
-				vid[count] = p->vid;
-			if ( q != NULL )
-				q[count] = p->q;
-			if ( flags != NULL )
-				flags[count] = p->flags;
+	}
+#endif
 
-			/* Step-up the counter. */
-			count += 1;
+	/* Order the cells and tasks along a space-filling curve? */
+	if ( e->flags & ( engine_flag_morton | engine_flag_hilbert ) )
+		if ( space_sfc_order( s , ( e->flags & engine_flag_hilbert ) ? space_sfc_hilbert : space_sfc_morton ) < 0 )
+			return error(engine_err_space);
 
-		}
+	/* Fill-in the Verlet lists if needed. */
+	if ( e->flags & engine_flag_verlet ) {
 
-	}
+		/* Pair up the cells for the neighbour lists. */
+		if ( e->flags & ( engine_flag_verlet_list | engine_flag_cluster ) )
+			if ( space_verlet_init( s ) < 0 )
+				return error(engine_err_space);
 
-	/* Write back the potential energy, if requested. */
-	if ( epot != NULL )
-		*epot += epot_acc;
+		/* Shuffle the domain. */
+		if ( engine_shuffle( e ) < 0 )
+			return error(engine_err);
 
-	/* to the pub! */
-	return ind[e->s.nr_cells];
+		/* Store the current positions as a reference. */
+#pragma omp parallel for schedule(static), private(cid,c,pid,p,k)
+		for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+			c = &(s->cells[s->cid_real[cid]]);
+			if ( c->oldx == NULL || c->oldx_size < c->count ) {
+				free(c->oldx);
+				c->oldx_size = c->size + 20;
+				c->oldx = (FPTYPE *)malloc( sizeof(FPTYPE) * 4 * c->oldx_size );
+			}
+			for ( pid = 0 ; pid < c->count ; pid++ ) {
+				p = &(c->parts[pid]);
+				for ( k = 0 ; k < 3 ; k++ )
+					c->oldx[ 4*pid + k ] = p->x[k];
+			}
+		}
 
-}
+		/* Re-set the Verlet rebuild flag. */
+		s->verlet_rebuild = 1;
 
+	}
 
-/**
- * @brief Unload real particles that may have wandered into a ghost cell.
- *
- * @param e The #engine.
- * @param x An @c N times 3 array of the particle positions.
- * @param v An @c N times 3 array of the particle velocities.
- * @param type A vector of length @c N of the particle type IDs.
- * @param pid A vector of length @c N of the particle IDs.
- * @param vid A vector of length @c N of the particle virtual IDs.
- * @param q A vector of length @c N of the individual particle charges.
- * @param flags A vector of length @c N of the particle flags.
- * @param epot A pointer to a #double in which to store the total potential energy.
- * @param N the maximum number of particles.
- *
- * @return The number of particles unloaded or < 0 on
- *      error (see #engine_err).
- *
- * The fields @c x, @c v, @c type, @c vid, @c pid, @c q, @c epot and/or @c flags may be NULL.
- */
+	/* Is MPI really needed? */
+	if ( e->flags & engine_flag_mpi && e->nr_nodes == 1 )
+		e->flags &= ~engine_flag_mpi;
 
-int engine_unload_strays ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , double *epot , int N ) {
+	/* Do we even need runners? */
+	if ( e->flags & engine_flag_cuda ) {
 
-	struct MxParticle *p;
-	struct space_cell *c;
-	int j, k, cid, count = 0;
-	double epot_acc = 0.0;
+		/* Set the number of runners. */
+		e->nr_runners = nr_runners;
 
-	/* check the inputs. */
-	if ( e == NULL )
-		return error(engine_err_null);
+#if defined(HAVE_CUDA) && defined(WITH_CUDA)
+		/* Load the potentials and pairs to the CUDA device. */
+		if ( engine_cuda_load( e ) < 0 )
+			return error(engine_err);
+#else
+		/* Was not compiled with CUDA support. */
+		return error(engine_err_nocuda);
+#endif
 
-	/* Loop over each cell. */
-	for ( cid = 0 ; cid < e->s.nr_real ; cid++ ) {
+	}
+	else {
 
-		/* Get a hold of the cell. */
-		c = &( e->s.cells[e->s.cid_real[cid]] );
+		/* The runners share the tasks through their own deques, the queues
+		   are no longer needed. */
+		e->nr_queues = nr_queues;
 
-		/* Collect the potential energy if requested. */
-		epot_acc += c->epot;
+		/* Integrate each cell as soon as its forces are done? */
+		if ( e->flags & engine_flag_fused && !( e->flags & engine_flag_mpi ) && nr_runners > 0 ) {
+			if ( space_addtasks_integrate( s ) < 0 )
+				return error(engine_err_space);
+			for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+				c = &(s->cells[s->cid_real[cid]]);
+				for ( pid = 0 ; pid < c->count ; pid++ )
+					for ( k = 0 ; k < 3 ; k++ )
+						c->parts[pid].f[k] = 0.0;
+			}
+		}
+		else
+			e->flags &= ~engine_flag_fused;
 
-		/* Loop over the parts in this cell. */
-		for ( k = c->count-1 ; k >= 0 && !(c->parts[k].flags & PARTICLE_FLAG_GHOST) ; k-- ) {
+		/* (Allocate the runners */
+				if ( ( e->runners = (struct runner *)malloc( sizeof(struct runner) * nr_runners )) == NULL )
+					return error(engine_err_malloc);
+				e->nr_runners = nr_runners;
 
-			/* Get a hold of the particle. */
-			p = &( c->parts[k] );
-			if ( p->flags & PARTICLE_FLAG_GHOST )
-				continue;
+				/* Place the runners on the CPUs and hand out the cells. */
+				if ( engine_numa_place( e ) < 0 )
+					return error(engine_err);
 
-			/* get this particle's data, where requested. */
-			if ( x != NULL )
-				for ( j = 0 ; j < 3 ; j++ )
-					x[count*3+j] = c->origin[j] + p->x[j];
-			if ( v != NULL)
-				for ( j = 0 ; j < 3 ; j++ )
-					v[count*3+j] = p->v[j];
-			if ( type != NULL )
-				type[count] = p->typeId;
-			if ( pid != NULL )
-				pid[count] = p->id;
-			if ( vid != NULL )
-				vid[count] = p->vid;
-			if ( q != NULL )
-				q[count] = p->q;
-			if ( flags != NULL )
-				flags[count] = p->flags;
+				/* initialize the runners. */
+				for ( i = 0 ; i < nr_runners ; i++ )
+					if ( runner_init( &e->runners[ i ] , e , i ) < 0 )
+						return error(engine_err_runner);
 
-			/* increase the counter. */
-			count += 1;
+				/* wait for the runners to be in place */
+				engine_barrier_join( e );
 
-		}
+				/* Let each runner touch the memory of its own cells first. */
+				if ( ( e->flags & engine_flag_numa ) &&
+					 engine_phase_run( e , engine_numa_touch_phase , NULL ) < 0 )
+					return error(engine_err);
 
 	}
 
-	/* Write back the potential energy, if requested. */
-	if ( epot != NULL )
-		*epot += epot_acc;
+	/* Pick the cell grid for the potentials and runners we have. */
+	if ( e->flags & engine_flag_autogrid )
+		if ( engine_autogrid( e , engine_autogrid_steps ) < 0 )
+			return error(engine_err);
 
-	/* to the pub! */
-	return count;
+	/* Get the initial kinetic energy, e.g. for thermostats. */
+	engine_kinetic_energy( e );
+
+	/* all is well... */
+	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Load a set of particle data.
- *
- * @param e The #engine.
- * @param x An @c N times 3 array of the particle positions.
- * @param v An @c N times 3 array of the particle velocities.
- * @param type A vector of length @c N of the particle type IDs.
- * @param pid A vector of length @c N of the particle IDs.
- * @param vid A vector of length @c N of the particle virtual IDs.
- * @param q A vector of length @c N of the individual particle charges.
- * @param flags A vector of length @c N of the particle flags.
- * @param N the number of particles to load.
- *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
- *
- * If the parameters @c v, @c flags, @c vid or @c q are @c NULL, then
- * these values are set to zero.
+ * @brief Runner phase adding the runners' force buffers to the particles
+ *      in every @c nr_runners-th real cell.
  */
 
-int engine_load ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , int N ) {
+int engine_reduce_phase ( struct runner *r , void *data ) {
 
-	struct MxParticle p;
-	struct space *s;
-	int j, k;
+	struct engine *e = r->e;
+	struct space *s = &e->s;
+	struct space_cell *c;
+	struct MxParticle *p;
+	FPTYPE *eff;
+	int cid, pid, gpid, j, k;
+
+	for ( cid = r->id ; cid < s->nr_real ; cid += e->nr_runners ) {
+		c = &s->cells[ s->cid_real[cid] ];
+		for ( pid = 0 ; pid < c->count ; pid++ ) {
+			p = &c->parts[ pid ];
+			gpid = p->id;
+			for ( j = 0 ; j < e->nr_runners ; j++ ) {
+				eff = &e->runners[j].eff[ 4*gpid ];
+				for ( k = 0 ; k < 3 ; k++ )
+					p->f[k] += eff[k];
+			}
+		}
+	}
 
-	/* check the inputs. */
-	if ( e == NULL || x == NULL || type == NULL )
-		return error(engine_err_null);
+	return engine_err_ok;
 
-	/* Get a handle on the space. */
-	s = &(e->s);
+}
 
-	/* init the velocity and charge in case not specified. */
-	p.v[0] = 0.0; p.v[1] = 0.0; p.v[2] = 0.0;
-	p.f[0] = 0.0; p.f[1] = 0.0; p.f[2] = 0.0;
-	p.q = 0.0;
-	p.flags = PARTICLE_FLAG_NONE;
 
-	/* loop over the entries. */
-	for ( j = 0 ; j < N ; j++ ) {
+/**
+ * @brief Make sure the force buffer of the given #runner can hold all the
+ *      particles of the #space, and clear it.
+ */
 
-		/* set the particle data. */
-		p.typeId = type[j];
-		if ( pid != NULL )
-			p.id = pid[j];
-		else
-			p.id = j;
-		if ( vid != NULL )
-			p.vid = vid[j];
-		if ( flags != NULL )
-			p.flags = flags[j];
-		if ( v != NULL )
-			for ( k = 0 ; k < 3 ; k++ )
-				p.v[k] = v[j*3+k];
-		if ( q != 0 )
-			p.q = q[j];
+static int engine_eff_clear ( struct runner *r ) {
 
-		/* add the part to the space. */
-		if ( engine_addpart( e , &p , &x[3*j], NULL ) < 0 )
-			return error(engine_err_space);
+	int size = 4 * r->e->s.size_parts;
 
+	if ( r->eff_size < size ) {
+		free( r->eff );
+		if ( ( r->eff = (FPTYPE *)malloc( sizeof(FPTYPE) * size ) ) == NULL )
+			return error(engine_err_malloc);
+		r->eff_size = size;
 	}
+	bzero( r->eff , sizeof(FPTYPE) * size );
 
-	/* to the pub! */
 	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Load a set of particle data as ghosts
- *
- * @param e The #engine.
- * @param x An @c N times 3 array of the particle positions.
- * @param v An @c N times 3 array of the particle velocities.
- * @param type A vector of length @c N of the particle type IDs.
- * @param pid A vector of length @c N of the particle IDs.
- * @param vid A vector of length @c N of the particle virtual IDs.
- * @param q A vector of length @c N of the individual particle charges.
- * @param flags A vector of length @c N of the particle flags.
- * @param N the number of particles to load.
- *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * @brief Runner phase computing the non-bonded interactions of every
+ *      @c nr_runners-th real cell from its neighbour list.
  *
- * If the parameters @c v, @c flags, @c vid or @c q are @c NULL, then
- * these values are set to zero.
+ * The lists are re-built first if needed. Forces on particles of other
+ * cells go to the runner's own force buffer (see #engine_reduce_phase).
  */
 
-int engine_load_ghosts ( struct engine *e , double *x , double *v , int *type , int *pid , int *vid , double *q , unsigned int *flags , int N ) {
-
-	struct MxParticle p;
-	struct space *s;
-	int j, k;
-
-	/* check the inputs. */
-	if ( e == NULL || x == NULL || type == NULL )
-		return error(engine_err_null);
-
-	/* Get a handle on the space. */
-	s = &(e->s);
-
-	/* init the velocity and charge in case not specified. */
-	p.v[0] = 0.0; p.v[1] = 0.0; p.v[2] = 0.0;
-	p.f[0] = 0.0; p.f[1] = 0.0; p.f[2] = 0.0;
-	p.q = 0.0;
-	p.flags = PARTICLE_FLAG_GHOST;
-
-	/* loop over the entries. */
-	for ( j = 0 ; j < N ; j++ ) {
+static int engine_verlet_phase ( struct runner *r , void *data ) {
 
-		/* set the particle data. */
-		p.typeId = type[j];
-		if ( pid != NULL )
-			p.id = pid[j];
-		else
-			p.id = j;
-		if ( vid != NULL )
-			p.vid = vid[j];
-		if ( flags != NULL )
-			p.flags = flags[j] | PARTICLE_FLAG_GHOST;
-		if ( v != NULL )
-			for ( k = 0 ; k < 3 ; k++ )
-				p.v[k] = v[j*3+k];
-		if ( q != 0 )
-			p.q = q[j];
+	struct engine *e = r->e;
+	struct space *s = &e->s;
+	struct space_cell *c;
+	int cid;
 
-		/* add the part to the space. */
-		if ( engine_addpart( e , &p , &x[3*j], NULL ) < 0 )
-			return error(engine_err_space);
+	if ( engine_eff_clear( r ) < 0 )
+		return error(engine_err);
 
+	for ( cid = r->id ; cid < s->nr_real ; cid += e->nr_runners ) {
+		c = &s->cells[ s->cid_real[cid] ];
+		if ( s->verlet_rebuild && runner_verlet_build( r , c ) < 0 )
+			return error(engine_err_runner);
+		if ( runner_verlet_eval( r , c , r->eff ) < 0 )
+			return error(engine_err_runner);
 	}
 
-	/* to the pub! */
 	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Look for a given type by name.
- *
- * @param e The #engine.
- * @param name The type name.
+ * @brief Runner phase running the non-bonded tasks without cell locks.
  *
- * @return The type ID or < 0 on error (see #engine_err).
+ * Same as #runner_dotasks, but the kernels write the forces to the
+ * runner's own force buffer and the energies to the runner, see
+ * #engine_flag_nolock.
  */
 
-int engine_gettype ( struct engine *e , char *name ) {
+static int engine_nolock_phase ( struct runner *r , void *data ) {
 
-	int k;
+	if ( engine_eff_clear( r ) < 0 )
+		return error(engine_err);
+	r->epot = 0.0;
 
-	/* check for nonsense. */
-	if ( e == NULL || name == NULL )
-		return error(engine_err_null);
+	return runner_dotasks( r , data );
 
-	/* Loop over the types... */
-	for ( k = 0 ; k < e->nr_types ; k++ ) {
+}
 
-		/* Compare the name. */
-		if ( strcmp( e->types[k].name , name ) == 0 )
-			return k;
 
-	}
+/**
+ * @brief Runner phase packing the clusters of every @c nr_runners-th cell,
+ *      ghosts included, see #runner_cluster_pack.
+ */
 
-	/* Otherwise, nothing found... */
-	return engine_err_range;
+static int engine_cluster_pack_phase ( struct runner *r , void *data ) {
+
+	struct engine *e = r->e;
+	struct space *s = &e->s;
+	int cid;
+
+	for ( cid = r->id ; cid < s->nr_cells ; cid += e->nr_runners )
+		if ( runner_cluster_pack( r , &s->cells[cid] ) < 0 )
+			return error(engine_err_runner);
+
+	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Look for a given type by its second name.
- *
- * @param e The #engine.
- * @param name2 The type name2.
+ * @brief Runner phase computing the non-bonded interactions of every
+ *      @c nr_runners-th real cell from its cluster-pair list.
  *
- * @return The type ID or < 0 on error (see #engine_err).
+ * Same as #engine_verlet_phase, but with the cluster-pair lists.
  */
 
-int engine_gettype2 ( struct engine *e , char *name2 ) {
-
-	int k;
-
-	/* check for nonsense. */
-	if ( e == NULL || name2 == NULL )
-		return error(engine_err_null);
+static int engine_cluster_phase ( struct runner *r , void *data ) {
 
-	/* Loop over the types... */
-	for ( k = 0 ; k < e->nr_types ; k++ ) {
+	struct engine *e = r->e;
+	struct space *s = &e->s;
+	struct space_cell *c;
+	int cid;
 
-		/* Compare the name. */
-		if ( strcmp( e->types[k].name2 , name2 ) == 0 )
-			return k;
+	if ( engine_eff_clear( r ) < 0 )
+		return error(engine_err);
 
+	for ( cid = r->id ; cid < s->nr_real ; cid += e->nr_runners ) {
+		c = &s->cells[ s->cid_real[cid] ];
+		if ( s->verlet_rebuild && runner_cluster_build( r , c ) < 0 )
+			return error(engine_err_runner);
+		if ( runner_docluster( r , c , r->eff ) < 0 )
+			return error(engine_err_runner);
 	}
 
-	/* Otherwise, nothing found... */
-	return engine_err_range;
+	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Add a type definition.
- *
- * @param e The #engine.
- * @param mass The particle type mass.
- * @param charge The particle type charge.
- * @param name Particle name, can be @c NULL.
- * @param name2 Particle second name, can be @c NULL.
- *
- * @return The type ID or < 0 on error (see #engine_err).
- *
- * The particle type ID must be an integer greater or equal to 0
- * and less than the value @c max_type specified in #engine_init.
+ * @brief Get the smallest grid size of at least @c n with no prime
+ *      factors other than 2, 3 and 5.
  */
-int engine_addtype ( struct engine *e , double mass , double charge ,
-        const char *name , const char *name2 ) {
-    
-    /* check for nonsense. */
-    if ( e == NULL )
-        return error(engine_err_null);
-    if ( e->nr_types >= e->max_type )
-        return error(engine_err_range);
-    
-    MxParticleType *type = MxParticleType_ForEngine(e, mass, charge, name, name2);
-    return type != NULL ? type->id : -1;
+
+static int engine_spme_gridsize ( double n ) {
+
+	int k, m;
+
+	for ( k = ( n > spme_maxorder ) ? (int)ceil( n ) : spme_maxorder ; ; k++ ) {
+		for ( m = k ; m % 2 == 0 ; m /= 2 );
+		for ( ; m % 3 == 0 ; m /= 3 );
+		for ( ; m % 5 == 0 ; m /= 5 );
+		if ( m == 1 )
+			return k;
+	}
+
 }
 
+
 /**
- * @brief Add an interaction potential.
+ * @brief Set up the reciprocal-space part of the electrostatics.
  *
  * @param e The #engine.
- * @param p The #potential to add to the #engine.
- * @param i ID of particle type for this interaction.
- * @param j ID of second particle type for this interaction.
+ * @param kappa The Ewald splitting parameter of the real-space pair
+ *      potentials between the charged types, or 0 to switch the
+ *      reciprocal-space part off.
+ * @param dim The number of grid points along each dimension, or @c NULL
+ *      to pick them from @c kappa.
+ * @param order The order of the B-splines, or 0 for #spme_order.
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * Adds the given potential for pairs of particles of type @c i and @c j,
- * where @c i and @c j may be the same type ID.
+ * Each particle carries its own charge @c q, which should match the
+ * real-space potentials of its type. The reciprocal-space forces and
+ * energy, including the self-energy of the charges, are added in each
+ * step, see #engine_nonbond_eval. Only works on a single node, i.e.
+ * without #engine_flag_mpi, and with a fully periodic domain.
  */
 
-int engine_addpot ( struct engine *e , struct MxPotential *p , int i , int j ) {
+int engine_spme_set ( struct engine *e , double kappa , int *dim , int order ) {
 
-	/* check for nonsense. */
+	struct space *s;
+	struct spme *p;
+	int k, K[3];
+	double h[3];
+
+	/* Check the inputs. */
 	if ( e == NULL )
 		return error(engine_err_null);
-	if ( i < 0 || i >= e->nr_types || j < 0 || j >= e->nr_types )
+	s = &e->s;
+
+	/* Switch it off? */
+	if ( kappa <= 0.0 ) {
+		if ( e->spme != NULL ) {
+			spme_free( e->spme );
+			free( e->spme );
+			e->spme = NULL;
+		}
+		return engine_err_ok;
+	}
+	if ( ( e->flags & ( engine_flag_mpi | engine_flag_cuda ) ) ||
+		 ( s->period & space_periodic_full ) != space_periodic_full )
 		return error(engine_err_range);
 
-	/* store the potential. */
-	e->p[ i * e->max_type + j ] = p;
-    Py_INCREF(p);
-    
-    if ( i != j ) {
-		e->p[ j * e->max_type + i ] = p;
-        Py_INCREF(p);
-    }
+	/* Pick the grid. */
+	if ( order <= 0 )
+		order = spme_order;
+	for ( k = 0 ; k < 3 ; k++ ) {
+		K[k] = ( dim != NULL && dim[k] > 0 ) ? dim[k] : engine_spme_gridsize( kappa * s->dim[k] / spme_kappah );
+		h[k] = s->dim[k] / K[k];
+	}
 
-	/* end on a good note. */
-	return engine_err_ok;
-}
+	/* Make the new one before dropping the old one. */
+	if ( ( p = (struct spme *)malloc( sizeof(struct spme) ) ) == NULL )
+		return error(engine_err_malloc);
+	if ( spme_init( p , s->origin , K , h , kappa , order ) < 0 ) {
+		spme_free( p );
+		free( p );
+		return error(engine_err_spme);
+	}
+	if ( e->spme != NULL ) {
+		spme_free( e->spme );
+		free( e->spme );
+	}
+	e->spme = p;
 
-CAPI_FUNC(int) engine_addforce1 ( struct engine *e , struct MxForce *p , int i ) {
-    /* check for nonsense. */
-    if ( e == NULL )
-        return error(engine_err_null);
-    if ( i < 0 || i >= e->nr_types  )
-        return error(engine_err_range);
-        
-    /* store the force. */
-    e->p_singlebody[i] = p;
-    Py_INCREF(p);
+	return engine_err_ok;
 
-    /* end on a good note. */
-    return engine_err_ok;
 }
 
 
 /**
- * @brief Start the runners in the given #engine.
+ * @brief Get the reciprocal-space tasks ready for a step.
  *
- * @param e The #engine to start.
- * @param nr_runners The number of runners start.
+ * @param e The #engine.
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * Allocates and starts the specified number of #runner. Also initializes
- * the Verlet lists.
+ * Re-makes the tasks if the cells or the runners have changed and makes
+ * room for them in the runners' deques.
  */
 
-int engine_start ( struct engine *e , int nr_runners , int nr_queues ) {
+static int engine_spme_prepare ( struct engine *e ) {
 
-	int cid, pid, k, i;
-	struct space_cell *c;
-	struct MxParticle *p;
 	struct space *s = &e->s;
+	struct spme *p = e->spme;
+	int k, size;
+	double margin;
+
+	/* With Verlet lists, the particles can leave their cells by up to
+	   the skin. */
+	margin = ( e->flags & ( engine_flag_verlet | engine_flag_verlet_list | engine_flag_cluster ) ) ? s->verlet_skin : 0.0;
+
+	/* Do the tasks still match the cells? */
+	if ( p->tasks == NULL || p->cdim[0] != s->cdim[0] || p->cdim[1] != s->cdim[1] || p->cdim[2] != s->cdim[2] ||
+		 p->nr_work != ( e->nr_runners > 0 ? e->nr_runners : 1 ) || p->margin != margin )
+		if ( spme_maketasks( p , s , e->nr_runners , margin ) < 0 )
+			return error(engine_err_spme);
+
+	/* Make room in the deques. */
+	size = s->nr_tasks + p->nr_tasks;
+	for ( k = 0 ; k < e->nr_runners ; k++ )
+		if ( e->runners[k].dq.mask + 1 < size ) {
+			deque_free( &e->runners[k].dq );
+			if ( deque_init( &e->runners[k].dq , size ) != deque_err_ok )
+				return error(engine_err_runner);
+		}
 
-	/* Is MPI really needed? */
-	if ( e->flags & engine_flag_mpi && e->nr_nodes == 1 )
-		e->flags &= ~( engine_flag_mpi | engine_flag_async );
+	/* Re-set the wait counters. */
+	if ( spme_prepare( p ) < 0 )
+		return error(engine_err_spme);
 
-#ifdef WITH_MPI
-	/* Set up async communication? */
-	if ( e->flags & engine_flag_async ) {
+	return engine_err_ok;
 
-		/* Init the mutex and condition variable for the asynchronous communication. */
-		if ( pthread_mutex_init( &e->xchg_mutex , NULL ) != 0 ||
-				pthread_cond_init( &e->xchg_cond , NULL ) != 0 ||
-				pthread_mutex_init( &e->xchg2_mutex , NULL ) != 0 ||
-				pthread_cond_init( &e->xchg2_cond , NULL ) != 0 )
-			return error(engine_err_pthread);
+}
 
-		/* Set the exchange flags. */
-		e->xchg_started = 0;
-		e->xchg_running = 0;
-		e->xchg2_started = 0;
-		e->xchg2_running = 0;
 
-		/* Start a thread with the async exchange. */
-		if ( pthread_create( &e->thread_exchg , NULL , (void *(*)(void *))engine_exchange_async_run , e ) != 0 )
-			return error(engine_err_pthread);
-		if ( pthread_create( &e->thread_exchg2 , NULL , (void *(*)(void *))engine_exchange_rigid_async_run , e ) != 0 )
-			return error(engine_err_pthread);
+/**
+ * @brief Remove the reciprocal-space interaction between the excluded
+ *      pairs of particles.
+ *
+ * @param e The #engine.
+ *
+ * @return The energy removed.
+ *
+ * The non-bonded kernels skip the excluded pairs (see #engine_excluded),
+ * but the reciprocal-space part still adds the smooth part
+ * @c q_i*q_j*erf(kappa*r)/r of their interaction, which is subtracted here
+ * along with its forces.
+ */
 
-	}
-#endif
+static double engine_spme_exclusions ( struct engine *e ) {
 
-	/* Fill-in the Verlet lists if needed. */
-	if ( e->flags & engine_flag_verlet ) {
+	struct space *s = &e->s;
+	struct MxParticle *pi, *pj;
+	double dx[3], r, r2, kr, qq, w, epot = 0.0;
+	int k, l;
 
-		/* Shuffle the domain. */
-		if ( engine_shuffle( e ) < 0 )
-			return error(engine_err);
+	for ( k = 0 ; k < e->nr_exclusions ; k++ ) {
 
-		/* Store the current positions as a reference. */
-#pragma omp parallel for schedule(static), private(cid,c,pid,p,k)
-		for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
-			c = &(s->cells[s->cid_real[cid]]);
-			if ( c->oldx == NULL || c->oldx_size < c->count ) {
-				free(c->oldx);
-				c->oldx_size = c->size + 20;
-				c->oldx = (FPTYPE *)malloc( sizeof(FPTYPE) * 4 * c->oldx_size );
-			}
-			for ( pid = 0 ; pid < c->count ; pid++ ) {
-				p = &(c->parts[pid]);
-				for ( k = 0 ; k < 3 ; k++ )
-					c->oldx[ 4*pid + k ] = p->x[k];
-			}
+		/* Get the particles involved. */
+		if ( ( pi = s->partlist[ e->exclusions[k].i ] ) == NULL ||
+			 ( pj = s->partlist[ e->exclusions[k].j ] ) == NULL ||
+			 ( qq = pi->q * pj->q ) == 0.0 )
+			continue;
+
+		/* Get the nearest periodic image. */
+		for ( r2 = 0.0 , l = 0 ; l < 3 ; l++ ) {
+			dx[l] = pi->x[l] + s->celllist[ pi->id ]->origin[l] - pj->x[l] - s->celllist[ pj->id ]->origin[l];
+			dx[l] -= s->dim[l] * round( dx[l] / s->dim[l] );
+			r2 += dx[l] * dx[l];
 		}
+		if ( r2 == 0.0 )
+			continue;
 
-		/* Re-set the Verlet rebuild flag. */
-		s->verlet_rebuild = 1;
+		/* Subtract the energy and the forces. */
+		r = sqrt( r2 ); kr = e->spme->kappa * r;
+		qq *= potential_escale;
+		epot += qq * erf( kr ) / r;
+		w = qq * ( 2.0 * e->spme->kappa / sqrt( M_PI ) * exp( -kr*kr ) - erf( kr ) / r ) / r2;
+		for ( l = 0 ; l < 3 ; l++ ) {
+			pi->f[l] += w * dx[l];
+			pj->f[l] -= w * dx[l];
+		}
 
 	}
 
-	/* Is MPI really needed? */
-	if ( e->flags & engine_flag_mpi && e->nr_nodes == 1 )
-		e->flags &= ~engine_flag_mpi;
+	return epot;
 
-	/* Do we even need runners? */
-	if ( e->flags & engine_flag_cuda ) {
+}
 
-		/* Set the number of runners. */
-		e->nr_runners = nr_runners;
 
-#if defined(HAVE_CUDA) && defined(WITH_CUDA)
-		/* Load the potentials and pairs to the CUDA device. */
-		if ( engine_cuda_load( e ) < 0 )
-			return error(engine_err);
-#else
-		/* Was not compiled with CUDA support. */
-		return error(engine_err_nocuda);
-#endif
+/**
+ * @brief Add the reciprocal-space energy and the self-energy of the
+ *      charges to the potential energy.
+ *
+ * Also removes the reciprocal-space interaction of the excluded pairs,
+ * see #engine_spme_exclusions.
+ */
+
+static void engine_spme_energy ( struct engine *e ) {
 
+	int cid, k;
+	double epot = spme_energy( e->spme ), q2 = 0.0;
+	struct space_cell *c;
+
+	for ( cid = 0 ; cid < e->s.nr_cells ; cid++ ) {
+		c = &e->s.cells[cid];
+		if ( c->flags & cell_flag_ghost )
+			continue;
+		for ( k = 0 ; k < c->count ; k++ )
+			q2 += c->parts[k].q * c->parts[k].q;
 	}
-	else {
+	epot -= potential_escale * e->spme->kappa / sqrt( M_PI ) * q2;
+	epot -= engine_spme_exclusions( e );
 
-		/* Allocate the queues */
-		if ( ( e->queues = (struct queue *)malloc( sizeof(struct queue) * nr_queues )) == NULL )
-			return error(engine_err_malloc);
-		e->nr_queues = nr_queues;
+	e->s.epot += epot;
+	e->s.epot_nonbond += epot;
 
-		/* Initialize  and fill the queues. */
-		for ( i = 0 ; i < e->nr_queues ; i++ )
-			if ( queue_init( &e->queues[i] , 2*s->nr_tasks/e->nr_queues , s , s->tasks ) != queue_err_ok )
-				return error(engine_err_queue);
-		for ( i = 0 ; i < s->nr_tasks ; i++ )
-			if ( queue_insert( &e->queues[ i % e->nr_queues ] , &s->tasks[i] ) < 0 )
-				return error(engine_err_queue);
+}
 
-		/* (Allocate the runners */
-				if ( ( e->runners = (struct runner *)malloc( sizeof(struct runner) * nr_runners )) == NULL )
-					return error(engine_err_malloc);
-				e->nr_runners = nr_runners;
 
-				/* initialize the runners. */
-				for ( i = 0 ; i < nr_runners ; i++ )
-					if ( runner_init( &e->runners[ i ] , e , i ) < 0 )
-						return error(engine_err_runner);
+/**
+ * @brief Compute the reciprocal-space forces in a pass of their own.
+ *
+ * @param e The #engine.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Used by #engine_nonbond_eval whenever the reciprocal-space tasks can
+ * not run alongside the non-bonded tasks.
+ */
 
-				/* wait for the runners to be in place */
-				while (e->barrier_count != e->nr_runners)
-					if (pthread_cond_wait(&e->done_cond,&e->barrier_mutex) != 0)
-						return error(engine_err_pthread);
+int engine_spme_eval ( struct engine *e ) {
+
+	struct space *s = &e->s;
+	struct spme *p = e->spme;
+	int k;
+
+	if ( p == NULL )
+		return engine_err_ok;
+	if ( engine_spme_prepare( e ) < 0 )
+		return error(engine_err);
+
+	/* The charges are spread from and the forces gathered to the
+	   particle records. */
+	if ( space_soa_unpack( s ) < 0 )
+		return error(engine_err_space);
+
+	/* No runners? Then do it all here. */
+	if ( e->nr_runners == 0 ) {
+		for ( k = 0 ; k < s->nr_cells ; k++ )
+			spme_spread( p , &s->cells[k] , 0 , p->dim[0] );
+		spme_doconv( p );
+		for ( k = 0 ; k < s->nr_cells ; k++ )
+			spme_gather( p , &s->cells[k] );
+	}
 
+	/* Otherwise, deal out the tasks that are ready and let the runners
+	   loose on them. */
+	else {
+		for ( k = 0 ; k < e->nr_runners ; k++ )
+			deque_reset( &e->runners[k].dq );
+		for ( k = 0 ; k < p->nr_tasks ; k++ )
+			if ( p->tasks[k].wait == 0 && !deque_push( &e->runners[ k % e->nr_runners ].dq , &p->tasks[k] ) )
+				return error(engine_err_runner);
+		e->tasks_left = p->nr_tasks;
+		if ( engine_phase_run( e , runner_dotasks , NULL ) < 0 )
+			return error(engine_err);
 	}
 
-	/* Set the number of runners. */
-	e->nr_runners = nr_runners;
+	engine_spme_energy( e );
+
+	if ( space_soa_pack( s ) < 0 )
+		return error(engine_err_space);
 
-	/* all is well... */
 	return engine_err_ok;
 
 }
@@ -1761,31 +3234,125 @@ int engine_start ( struct engine *e , int nr_runners , int nr_queues ) {
  * This routine advances the timestep counter by one, prepares the #space
  * for a timestep, releases the #runner's associated with the #engine
  * and waits for them to finnish.
+ *
+ * If an asynchronous exchange (see #engine_exchange_async) is still in
+ * flight, the tasks on the ghost cells are held back and the #runner's
+ * work on the interior cells until #engine_exchange_wait returns.
+ *
+ * The reciprocal-space tasks, if any (see #engine_spme_set), are dealt
+ * out along with the non-bonded tasks, or run in a pass of their own
+ * first if the runners do not work through tasks, if the fused
+ * integration tasks would move the particles under them, or if the
+ * particle data is in the SoA buffers (see #engine_flag_soa).
  */
 
 int engine_nonbond_eval ( struct engine *e ) {
 
-	int k;
+	int k, rid, halo = 0, spme = 0;
+	struct space *s = &e->s;
 
-	/* Re-set the queues. */
-	for ( k = 0 ; k < e->nr_queues ; k++ )
-		e->queues[k].next = 0;
+	/* Run the reciprocal-space tasks alongside the others if we can. */
+	if ( e->spme != NULL ) {
+		spme = ( e->nr_runners > 0 &&
+				 !( e->flags & ( engine_flag_verlet_list | engine_flag_cluster | engine_flag_nolock | engine_flag_fused | engine_flag_soa ) ) );
+		if ( spme && engine_spme_prepare( e ) < 0 )
+			return error(engine_err);
+		if ( !spme && engine_spme_eval( e ) < 0 )
+			return error(engine_err);
+	}
 
-	/* open the door for the runners */
-	e->barrier_count = -e->barrier_count;
-	if ( e->nr_runners == 1 ) {
-		if (pthread_cond_signal(&e->barrier_cond) != 0)
-			return error(engine_err_pthread);
+#ifdef WITH_MPI
+	/* Is an asynchronous exchange still in flight? Only the task runners
+	   can get on with the interior cells in the meantime. */
+	if ( ( e->flags & engine_flag_async ) && ( e->flags & engine_flag_mpi ) ) {
+		if ( e->nr_runners > 0 && !( e->flags & ( engine_flag_verlet_list | engine_flag_cluster | engine_flag_nolock ) ) )
+			halo = 1;
+		else if ( engine_exchange_wait( e ) < 0 )
+			return error(engine_err);
 	}
-	else {
-		if (pthread_cond_broadcast(&e->barrier_cond) != 0)
-			return error(engine_err_pthread);
+#endif
+
+	/* Make room for the tasks to hold back. */
+	e->nr_halo = 0;
+	e->halo_ready = 0;
+	if ( halo && e->halo_size < s->nr_tasks ) {
+		free( e->halo_tasks );
+		e->halo_size = s->tasks_size;
+		if ( ( e->halo_tasks = (struct task **)malloc( sizeof(struct task *) * e->halo_size ) ) == NULL )
+			return error(engine_err_malloc);
 	}
 
-	/* wait for the runners to come home */
-	while (e->barrier_count < e->nr_runners)
-		if (pthread_cond_wait(&e->done_cond,&e->barrier_mutex) != 0)
-			return error(engine_err_pthread);
+	/* Re-set the runners' deques and deal out the tasks that are ready,
+	   in contiguous blocks so that each runner starts on nearby cells,
+	   or to the owner of their first cell. The sorts of the ghost cells,
+	   and with them all the tasks on ghost cells, wait for the exchange. */
+	for ( k = 0 ; k < e->nr_runners ; k++ )
+		deque_reset( &e->runners[k].dq );
+	if ( e->nr_runners > 0 ) {
+		for ( k = 0 ; k < s->nr_tasks ; k++ ) {
+			if ( halo && s->tasks[k].subtype == task_subtype_halo ) {
+				s->tasks[k].wait += 1;
+				e->halo_tasks[ e->nr_halo++ ] = &s->tasks[k];
+			}
+			if ( s->tasks[k].wait == 0 ) {
+				rid = ( e->flags & engine_flag_numa ) ? s->cells_owner[ s->tasks[k].i ] : (long)k * e->nr_runners / s->nr_tasks;
+				if ( !deque_push( &e->runners[ rid ].dq , &s->tasks[k] ) )
+					return error(engine_err_runner);
+			}
+		}
+		if ( spme )
+			for ( k = 0 ; k < e->spme->nr_tasks ; k++ )
+				if ( e->spme->tasks[k].wait == 0 && !deque_push( &e->runners[ k % e->nr_runners ].dq , &e->spme->tasks[k] ) )
+					return error(engine_err_runner);
+		e->tasks_left = s->nr_tasks + ( spme ? e->spme->nr_tasks : 0 );
+	}
+
+	/* let the runners loose on the tasks, or on the neighbour lists */
+	if ( e->flags & engine_flag_verlet_list ) {
+		if ( engine_phase_run( e , engine_verlet_phase , NULL ) < 0 ||
+			 engine_phase_run( e , engine_reduce_phase , NULL ) < 0 )
+			return error(engine_err);
+	}
+	else if ( e->flags & engine_flag_cluster ) {
+		if ( engine_phase_run( e , engine_cluster_pack_phase , NULL ) < 0 ||
+			 engine_phase_run( e , engine_cluster_phase , NULL ) < 0 ||
+			 engine_phase_run( e , engine_reduce_phase , NULL ) < 0 )
+			return error(engine_err);
+	}
+	else if ( e->flags & engine_flag_nolock ) {
+		if ( engine_phase_run( e , engine_nolock_phase , NULL ) < 0 ||
+			 engine_phase_run( e , engine_reduce_phase , NULL ) < 0 )
+			return error(engine_err);
+		for ( k = 0 ; k < e->nr_runners ; k++ ) {
+			s->epot_nonbond += e->runners[k].epot;
+			s->epot += e->runners[k].epot;
+		}
+	}
+#ifdef WITH_MPI
+	/* Wait for the exchange while the runners are busy and let them
+	   release the held-back tasks, see #runner_dotasks. */
+	else if ( e->nr_halo > 0 ) {
+		e->phase_fun = runner_dotasks;
+		e->phase_data = NULL;
+		engine_barrier_fork( e );
+		if ( engine_exchange_wait( e ) < 0 ) {
+			__atomic_store_n( &e->tasks_left , 0 , __ATOMIC_RELEASE );
+			engine_barrier_join( e );
+			return error(engine_err);
+		}
+		__atomic_store_n( &e->halo_ready , 1 , __ATOMIC_RELEASE );
+		engine_barrier_join( e );
+		for ( k = 0 ; k < e->nr_runners ; k++ )
+			if ( e->runners[k].phase_err < 0 )
+				return error(engine_err_runner);
+	}
+#endif
+	else if ( engine_phase_run( e , runner_dotasks , NULL ) < 0 )
+		return error(engine_err);
+
+	/* Book the reciprocal-space energy. */
+	if ( spme )
+		engine_spme_energy( e );
 
 	/* All in a days work. */
 	return engine_err_ok;
@@ -1794,22 +3361,142 @@ int engine_nonbond_eval ( struct engine *e ) {
 
 
 /**
- * @brief Update the particle velocities and positions, re-shuffle if
- *      appropriate.
+ * @brief Add a particle's kinetic energy and momentum to the per-type sums.
+ */
+
+static inline void engine_advance_sum ( struct engine *e , int typeId , FPTYPE vx , FPTYPE vy , FPTYPE vz , double *sums ) {
+
+    double m = e->types[typeId].mass;
+    double *s = &sums[ typeId * runner_nrsums ];
+
+    s[runner_sum_ekin] += m * ( vx*vx + vy*vy + vz*vz );
+    s[runner_sum_px] += m * vx;
+    s[runner_sum_py] += m * vy;
+    s[runner_sum_pz] += m * vz;
+    s[runner_sum_count] += 1.0;
+}
+
+
+/**
+ * @brief Update the particle velocities and positions in a subset of the
+ *      real cells, from and to their SoA buffers (see #engine_flag_soa).
+ *
+ * Same as #engine_advance_cells without Verlet lists or MPI. The
+ * particles leaving their cell take their position, velocity and force
+ * along in their record.
+ */
+
+static int engine_advance_cells_soa ( struct engine *e , struct runner *r , int first , int last , int stride , double *epot , double *sums ) {
+
+    int cid, pid, k, delta[3], *type;
+    struct space_cell *c, *c_dest;
+    struct MxParticle *p;
+    struct space *s;
+    FPTYPE dt, w, h[3], *x[3], *v[3], *f[3];
+    double epot_local = 0.0;
+
+    /* Get a grip on the space. */
+    s = &(e->s);
+    dt = e->dt;
+    for ( k = 0 ; k < 3 ; k++ )
+        h[k] = s->h[k];
+
+    for ( cid = first ; cid < last ; cid += stride ) {
+        c = &(s->cells[ s->cid_real[cid] ]);
+        epot_local += c->epot;
+        for ( k = 0 ; k < 3 ; k++ ) {
+            x[k] = c->soa_x[k]; v[k] = c->soa_v[k]; f[k] = c->soa_f[k];
+        }
+        type = c->soa_typeId;
+        pid = 0;
+        while ( pid < c->count ) {
+            w = dt * engine::types[ type[pid] ].imass;
+            for ( k = 0 ; k < 3 ; k++ ) {
+                v[k][pid] += f[k][pid] * w;
+                x[k][pid] += dt * v[k][pid];
+                delta[k] = __builtin_isgreaterequal( x[k][pid] , h[k] ) - __builtin_isless( x[k][pid] , 0.0 );
+            }
+            if ( sums != NULL )
+                engine_advance_sum( e , type[pid] , v[0][pid] , v[1][pid] , v[2][pid] , sums );
+
+            /* do we have to move this particle? */
+            if ( ( delta[0] != 0 ) || ( delta[1] != 0 ) || ( delta[2] != 0 ) ) {
+                for ( k = 0 ; k < 3 ; k++ )
+                    x[k][pid] -= delta[k] * h[k];
+                space_cell_soa_get( c , pid );
+                p = &( c->parts[pid] );
+
+                c_dest = &( s->cells[ space_cellid( s ,
+                        (c->loc[0] + delta[0] + s->cdim[0]) % s->cdim[0] ,
+                        (c->loc[1] + delta[1] + s->cdim[1]) % s->cdim[1] ,
+                        (c->loc[2] + delta[2] + s->cdim[2]) % s->cdim[2] ) ] );
+
+                if ( r != NULL ) {
+                    if ( runner_migrate( r , c_dest , p ) < 0 )
+                        return error(engine_err_runner);
+                }
+                else {
+                    if ( space_cell_add_incomming( c_dest , p ) == NULL )
+                        return error(engine_err_cell);
+                    s->celllist[ p->id ] = c_dest;
+                    s->parts_moved = 1;
+                }
+
+                // move the last part in the cell to the ejected part's
+                // place, along with its SoA entry.
+                c->count -= 1;
+                if ( pid < c->count ) {
+                    c->parts[pid] = c->parts[c->count];
+                    space_cell_soa_move( c , pid , c->count );
+                    s->partlist[ c->parts[pid].id ] = &( c->parts[pid] );
+                }
+            }
+            else {
+                pid += 1;
+            }
+        }
+    }
+
+    *epot += epot_local;
+
+    return engine_err_ok;
+}
+
+
+/**
+ * @brief Update the particle velocities and positions in a subset of the
+ *      real cells.
+ *
  * @param e The #engine on which to run.
+ * @param r The #runner doing the update, or @c NULL.
+ * @param first The first entry of @c cid_real to update.
+ * @param last One past the last entry of @c cid_real to update.
+ * @param stride The stride between the entries of @c cid_real to update.
+ * @param epot Pointer to a double to which the potential energy of the
+ *      updated cells is added.
+ * @param sums Per-type sums of the kinetic energy and momentum of the
+ *      updated particles (see #runner::sums), or @c NULL.
  *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * If neither Verlet lists nor MPI are used, particles leaving their cell
+ * are moved to the outgoing buffers of @c r (see #runner_migrate), or,
+ * without a runner, to the incomming buffer of their new cell, which have
+ * to be welcomed afterwards (see #runner_welcome and #space_cell_welcome).
+ * With #engine_flag_soa, the work is left to #engine_advance_cells_soa.
  */
 
-int engine_advance ( struct engine *e ) {
+static int engine_advance_cells ( struct engine *e , struct runner *r , int first , int last , int stride , double *epot , double *sums ) {
 
-    int cid, pid, k, delta[3], step;
+    int cid, pid, k, delta[3];
     struct space_cell *c, *c_dest;
     struct MxParticle *p;
     struct space *s;
     FPTYPE dt, w, h[3];
-    double epot = 0.0, epot_local;
-    
+    double epot_local = 0.0;
+
+    /* Is the particle data in the SoA buffers? */
+    if ( e->flags & engine_flag_soa )
+        return engine_advance_cells_soa( e , r , first , last , stride , epot , sums );
+
     /* Get a grip on the space. */
     s = &(e->s);
     dt = e->dt;
@@ -1819,92 +3506,170 @@ int engine_advance ( struct engine *e ) {
     /* update the particle velocities and positions */
     if ((e->flags & engine_flag_verlet) || (e->flags & engine_flag_mpi)) {
 
-        /* Collect potential energy from ghosts. */
-        for ( cid = 0 ; cid < s->nr_ghost ; cid++ )
-            epot += s->cells[ s->cid_ghost[cid] ].epot;
-
-#pragma omp parallel private(cid,c,pid,p,w,k,epot_local)
-        {
-            step = omp_get_num_threads();
-            epot_local = 0.0;
-            for ( cid = omp_get_thread_num() ; cid < s->nr_real ; cid += step ) {
-                c = &(s->cells[ s->cid_real[cid] ]);
-                epot_local += c->epot;
-                for ( pid = 0 ; pid < c->count ; pid++ ) {
-                    p = &( c->parts[pid] );
-                    w = dt * e->types[p->typeId].imass;
-                    for ( k = 0 ; k < 3 ; k++ ) {
-                        p->v[k] += p->f[k] * w;
-                        p->x[k] += dt * p->v[k];
-                    }
+        for ( cid = first ; cid < last ; cid += stride ) {
+            c = &(s->cells[ s->cid_real[cid] ]);
+            epot_local += c->epot;
+            for ( pid = 0 ; pid < c->count ; pid++ ) {
+                p = &( c->parts[pid] );
+                w = dt * e->types[p->typeId].imass;
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    p->v[k] += p->f[k] * w;
+                    p->x[k] += dt * p->v[k];
                 }
+                if ( sums != NULL )
+                    engine_advance_sum( e , p->typeId , p->v[0] , p->v[1] , p->v[2] , sums );
             }
-#pragma omp atomic
-            epot += epot_local;
         }
     }
     else {
 
-        /* Collect potential energy from ghosts. */
-        for ( cid = 0 ; cid < s->nr_ghost ; cid++ ) {
-            epot += s->cells[ s->cid_ghost[cid] ].epot;
-        }
+        for ( cid = first ; cid < last ; cid += stride ) {
+            c = &(s->cells[ s->cid_real[cid] ]);
+            epot_local += c->epot;
+            pid = 0;
+            while ( pid < c->count ) {
+                p = &( c->parts[pid] );
+                w = dt * engine::types[p->typeId].imass;
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    p->v[k] += p->f[k] * w;
+                    p->x[k] += dt * p->v[k];
+                    delta[k] = __builtin_isgreaterequal( p->x[k] , h[k] ) - __builtin_isless( p->x[k] , 0.0 );
+                }
+                if ( sums != NULL )
+                    engine_advance_sum( e , p->typeId , p->v[0] , p->v[1] , p->v[2] , sums );
 
-#pragma omp parallel private(cid,c,pid,p,w,k,delta,c_dest,epot_local,ke)
-        {
-            step = omp_get_num_threads(); epot_local = 0.0;
-            for ( cid = omp_get_thread_num() ; cid < s->nr_real ; cid += step ) {
-                c = &(s->cells[ s->cid_real[cid] ]);
-                epot_local += c->epot;
-                pid = 0;
-                while ( pid < c->count ) {
-                    p = &( c->parts[pid] );
-                    w = dt * engine::types[p->typeId].imass;
+                /* do we have to move this particle? */
+                if ( ( delta[0] != 0 ) || ( delta[1] != 0 ) || ( delta[2] != 0 ) ) {
                     for ( k = 0 ; k < 3 ; k++ ) {
-                        p->v[k] += p->f[k] * w;
-                        p->x[k] += dt * p->v[k];
-                        delta[k] = __builtin_isgreaterequal( p->x[k] , h[k] ) - __builtin_isless( p->x[k] , 0.0 );
+                        p->x[k] -= delta[k] * h[k];
                     }
-                    
-                    /* do we have to move this particle? */
-                    if ( ( delta[0] != 0 ) || ( delta[1] != 0 ) || ( delta[2] != 0 ) ) {
-                        for ( k = 0 ; k < 3 ; k++ ) {
-                            p->x[k] -= delta[k] * h[k];
-                        }
-
-                        c_dest = &( s->cells[ space_cellid( s ,
-                                (c->loc[0] + delta[0] + s->cdim[0]) % s->cdim[0] ,
-                                (c->loc[1] + delta[1] + s->cdim[1]) % s->cdim[1] ,
-                                (c->loc[2] + delta[2] + s->cdim[2]) % s->cdim[2] ) ] );
-
-                        pthread_mutex_lock(&c_dest->cell_mutex);
-                        space_cell_add_incomming( c_dest , p );
-                        pthread_mutex_unlock(&c_dest->cell_mutex);
 
-                        s->celllist[ p->id ] = c_dest;
+                    c_dest = &( s->cells[ space_cellid( s ,
+                            (c->loc[0] + delta[0] + s->cdim[0]) % s->cdim[0] ,
+                            (c->loc[1] + delta[1] + s->cdim[1]) % s->cdim[1] ,
+                            (c->loc[2] + delta[2] + s->cdim[2]) % s->cdim[2] ) ] );
 
-                        // remove a particle from a cell. if the part was the last in the
-                        // cell, simply dec the count, otherwise, move the last part
-                        // in the cell to the ejected part's prev loc.
-                        c->count -= 1;
-                        if ( pid < c->count ) {
-                            c->parts[pid] = c->parts[c->count];
-                            s->partlist[ c->parts[pid].id ] = &( c->parts[pid] );
-                        }
+                    if ( r != NULL ) {
+                        if ( runner_migrate( r , c_dest , p ) < 0 )
+                            return error(engine_err_runner);
                     }
                     else {
-                        pid += 1;
+                        if ( space_cell_add_incomming( c_dest , p ) == NULL )
+                            return error(engine_err_cell);
+                        s->celllist[ p->id ] = c_dest;
+                        s->parts_moved = 1;
+                    }
+
+                    // remove a particle from a cell. if the part was the last in the
+                    // cell, simply dec the count, otherwise, move the last part
+                    // in the cell to the ejected part's prev loc.
+                    c->count -= 1;
+                    if ( pid < c->count ) {
+                        c->parts[pid] = c->parts[c->count];
+                        s->partlist[ c->parts[pid].id ] = &( c->parts[pid] );
                     }
                 }
+                else {
+                    pid += 1;
+                }
             }
-#pragma omp atomic
-            epot += epot_local;
         }
+    }
+
+    *epot += epot_local;
+
+    return engine_err_ok;
+}
+
+
+/**
+ * @brief Runner phase for #engine_advance, updates every
+ *      @c nr_runners-th real cell, or the runner's own cells with
+ *      #engine_flag_numa.
+ */
+
+static int engine_advance_phase ( struct runner *r , void *data ) {
+
+    struct engine *e = r->e;
+    int k, nr_real = e->s.nr_real;
+
+    r->acc[0] = 0.0;
+    for ( k = 0 ; k < e->max_type * runner_nrsums ; k++ )
+        r->sums[k] = 0.0;
+    if ( e->flags & engine_flag_numa )
+        return engine_advance_cells( e , r , engine_numa_first( r->id , nr_real , e->nr_runners ) ,
+            engine_numa_first( r->id + 1 , nr_real , e->nr_runners ) , 1 , &r->acc[0] , r->sums );
+    else
+        return engine_advance_cells( e , r , r->id , nr_real , e->nr_runners , &r->acc[0] , r->sums );
+
+}
+
 
-        /* Welcome the new particles in each cell. */
-#pragma omp parallel for schedule(static)
-        for ( cid = 0 ; cid < s->nr_marked ; cid++ )
-            space_cell_welcome( &(s->cells[ s->cid_marked[cid] ]) , s->partlist );
+/**
+ * @brief Runner phase for #engine_advance, welcomes the particles the
+ *      runners moved to this runner's cells, see #runner_welcome.
+ */
+
+static int engine_welcome_phase ( struct runner *r , void *data ) {
+
+    return runner_welcome( r );
+
+}
+
+
+/**
+ * @brief Update the particle velocities and positions, re-shuffle if
+ *      appropriate.
+ * @param e The #engine on which to run.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * If the runners have been started, the work is shared between them
+ * using #engine_phase_run, otherwise it is done by the calling thread.
+ * With #engine_flag_fused, the runners' integration tasks have already
+ * moved the particles and only the potential energy is collected and the
+ * migrated particles welcomed.
+ */
+
+int engine_advance ( struct engine *e ) {
+
+    int cid, k;
+    struct space *s;
+    double epot = 0.0;
+
+    /* Get a grip on the space. */
+    s = &(e->s);
+
+    /* Collect potential energy from ghosts. */
+    for ( cid = 0 ; cid < s->nr_ghost ; cid++ )
+        epot += s->cells[ s->cid_ghost[cid] ].epot;
+
+    /* update the particle velocities and positions, unless the runners
+       already did so in their integration tasks. */
+    if ( e->flags & engine_flag_fused ) {
+        for ( k = 0 ; k < e->nr_runners ; k++ )
+            epot += e->runners[k].acc[0];
+        e->sums_time = e->time;
+    }
+    else if ( e->runners != NULL ) {
+        if ( engine_phase_run( e , engine_advance_phase , NULL ) < 0 )
+            return error(engine_err);
+        for ( k = 0 ; k < e->nr_runners ; k++ )
+            epot += e->runners[k].acc[0];
+        e->sums_time = e->time;
+    }
+    else if ( engine_advance_cells( e , NULL , 0 , s->nr_real , 1 , &epot , NULL ) < 0 )
+        return error(engine_err);
+
+    /* Welcome the new particles in each cell. */
+    if ( !( e->flags & engine_flag_verlet ) && !( e->flags & engine_flag_mpi ) ) {
+        if ( e->runners != NULL ) {
+            if ( engine_phase_run( e , engine_welcome_phase , NULL ) < 0 )
+                return error(engine_err);
+        }
+        else
+            for ( cid = 0 ; cid < s->nr_marked ; cid++ )
+                space_cell_welcome( &(s->cells[ s->cid_marked[cid] ]) , s->partlist );
     }
 
     /* Store the accumulated potential energy. */
@@ -1916,6 +3681,52 @@ int engine_advance ( struct engine *e ) {
 }
 
 
+/**
+ * @brief Compute the bonded interactions of the current step.
+ *
+ * @param e The #engine on which to run.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The precomputed sets of #engine_flag_sets are only used without
+ * runners, the runners share the interactions by cell instead, see
+ * #engine_bonded_eval.
+ */
+
+static int engine_step_bonded ( struct engine *e ) {
+
+    ticks tic = getticks();
+    int soa = ( e->flags & engine_flag_soa ) &&
+        ( e->nr_bonds > 0 || e->nr_angles > 0 || e->nr_dihedrals > 0 || e->nr_exclusions > 0 );
+
+#ifdef WITH_MPI
+    /* The bonded interactions need all the ghosts. */
+    if ( ( e->flags & engine_flag_async ) && ( e->flags & engine_flag_mpi ) )
+        if ( engine_exchange_wait( e ) < 0 )
+            return error(engine_err);
+#endif
+
+    /* The bonded interactions work on the particle records. */
+    if ( soa && space_soa_unpack( &e->s ) < 0 )
+        return error(engine_err_space);
+
+    if ( ( e->flags & engine_flag_sets ) && e->runners == NULL ) {
+        if ( engine_bonded_eval_sets( e ) < 0 )
+            return error(engine_err);
+    }
+    else {
+        if ( engine_bonded_eval( e ) < 0 )
+            return error(engine_err);
+    }
+
+    if ( soa && space_soa_pack( &e->s ) < 0 )
+        return error(engine_err_space);
+    e->timers[engine_timer_bonded] += getticks() - tic;
+
+    return engine_err_ok;
+}
+
+
 /**
  * @brief Run the engine for a single time step.
  *
@@ -1929,22 +3740,43 @@ int engine_advance ( struct engine *e ) {
  *
  * Once all the #runner's are done, the particle velocities and positions
  * are updated and the particles are re-sorted in the #space.
+ *
+ * With #engine_flag_fused, the bonded interactions are computed first and
+ * each cell is integrated by the #runner's as soon as its non-bonded forces
+ * are done, clearing the forces for the next step on the way. Particle
+ * positions changed between steps are then only re-binned if
+ * #engine_shuffle is called explicitly.
+ *
+ * If a potential added since the last step changed the cutoff, see
+ * #engine_flag_autogrid, the cell grid is re-picked first. With
+ * #engine_flag_balance, the load of the nodes is checked every
+ * @c e->balance_steps steps, see #engine_balance.
  */
 
 int engine_step ( struct engine *e ) {
 
 	ticks tic, tic_step = getticks();
 
+	/* Fit the tables of any potentials batched since the last step. */
+	if ( potential_batch_end() < 0 )
+		return error(engine_err_potential);
+
+	/* Re-pick the cell grid if the potentials have changed. */
+	if ( e->autogrid_pending )
+		if ( engine_autogrid( e , engine_autogrid_steps ) < 0 )
+			return error(engine_err);
+
 	/* increase the time stepper */
 	e->time += 1;
 
-	// clear the energy on the types
-    // TODO: should go in prepare space for better performance
-    engine_kinetic_energy(e);
-
-	/* prepare the space, sets forces to zero */
+	/* prepare the space, sets forces to zero unless the integration
+	   tasks of the last step already did so. */
 	tic = getticks();
-	if ( space_prepare( &e->s ) != space_err_ok )
+	if ( e->flags & engine_flag_fused ) {
+		if ( space_prepare_tasks( &e->s ) != space_err_ok )
+			return error(engine_err_space);
+	}
+	else if ( space_prepare( &e->s ) != space_err_ok )
 		return error(engine_err_space);
 	e->timers[engine_timer_prepare] += getticks() - tic;
 
@@ -1966,8 +3798,8 @@ int engine_step ( struct engine *e ) {
 
 
 	/* Otherwise, if async MPI, move the particles accross the
-       node boundaries. */
-	else { // if ( e->flags & engine_flag_async ) {
+       node boundaries. The fused integration tasks already did. */
+	else if ( !( e->flags & engine_flag_fused ) ) { // if ( e->flags & engine_flag_async ) {
 		tic = getticks();
         if ( engine_shuffle( e ) < 0 ) {
 			return error(engine_err_space);
@@ -1999,12 +3831,25 @@ int engine_step ( struct engine *e ) {
 	}
 #endif
 
+	/* The fused integration tasks need all the bonded forces before the
+	   non-bonded ones are done. */
+	if ( e->flags & engine_flag_fused )
+		if ( engine_step_bonded( e ) < 0 )
+			return error(engine_err);
+
 	/* Compute the non-bonded interactions. */
 	tic = getticks();
 #if defined(HAVE_CUDA) && defined(WITH_CUDA)
 	if ( e->flags & engine_flag_cuda ) {
+		double epot_exclusion = 0.0;
 		if ( engine_nonbond_cuda( e ) < 0 )
 			return error(engine_err);
+		/* The GPU kernels do not skip the excluded pairs, so take them
+		   out again. */
+		if ( exclusion_eval( e->exclusions , e->nr_exclusions , e , &epot_exclusion ) < 0 )
+			return error(engine_err_exclusion);
+		e->s.epot += epot_exclusion;
+		e->s.epot_exclusion += epot_exclusion;
 	}
 	else
 #endif
@@ -2020,16 +3865,9 @@ int engine_step ( struct engine *e ) {
         e->s.verlet_rebuild = 0;
 
     /* Do bonded interactions. */
-    tic = getticks();
-    if ( e->flags & engine_flag_sets ) {
-        if ( engine_bonded_eval_sets( e ) < 0 )
-            return error(engine_err);
-    }
-    else {
-        if ( engine_bonded_eval( e ) < 0 )
+    if ( !( e->flags & engine_flag_fused ) )
+        if ( engine_step_bonded( e ) < 0 )
             return error(engine_err);
-    }
-    e->timers[engine_timer_bonded] += getticks() - tic;
 
     /* update the particle velocities and positions. */
     tic = getticks();
@@ -2070,14 +3908,30 @@ int engine_step ( struct engine *e ) {
 		}
 #endif
 
-		/* Resolve the constraints. */
+		/* Resolve the constraints, on the particle records. */
 		tic = getticks();
+		if ( space_soa_unpack( &e->s ) < 0 )
+			return error(engine_err_space);
 		if ( engine_rigid_eval( e ) != 0 )
 			return error(engine_err);
+		if ( space_soa_pack( &e->s ) < 0 )
+			return error(engine_err_space);
 		e->timers[engine_timer_rigid] += getticks() - tic;
 
+		/* The constraints changed the velocities the runners summed up. */
+		e->sums_time = -1;
+
 	}
 
+    /* Update the kinetic energy, from the sums of the advance pass if
+       the runners did it. */
+    engine_kinetic_energy(e);
+
+	/* Re-partition the cells over the nodes? */
+	if ( ( e->flags & engine_flag_balance ) && e->time % e->balance_steps == 0 )
+		if ( engine_balance( e ) < 0 )
+			return error(engine_err);
+
 	/* Stop the clock. */
 	e->timers[engine_timer_step] += getticks() - tic_step;
 
@@ -2087,6 +3941,95 @@ int engine_step ( struct engine *e ) {
 }
 
 
+/**
+ * @brief Wait for an integer to change its value.
+ *
+ * @param e The #engine.
+ * @param addr Pointer to the integer to watch.
+ * @param val The value to wait out.
+ *
+ * Spins for #engine_barrier_spin rounds, which is usually enough between
+ * two phases of a step, and then parks the thread on a futex (or yields
+ * on systems without one).
+ */
+
+static void engine_barrier_waitwhile ( struct engine *e , volatile int *addr , int val ) {
+
+	int k;
+
+	/* Spin a bit first. */
+	for ( k = 0 ; k < engine_barrier_spin ; k++ ) {
+		if ( __atomic_load_n( addr , __ATOMIC_ACQUIRE ) != val )
+			return;
+#ifdef __SSE__
+		_mm_pause();
+#endif
+	}
+
+	/* Park until somebody changes the value. */
+	__atomic_add_fetch( &e->barrier_parked , 1 , __ATOMIC_SEQ_CST );
+	while ( __atomic_load_n( addr , __ATOMIC_SEQ_CST ) == val ) {
+#if defined(__linux__)
+		syscall( SYS_futex , addr , FUTEX_WAIT_PRIVATE , val , NULL , NULL , 0 );
+#else
+		sched_yield();
+#endif
+	}
+	__atomic_sub_fetch( &e->barrier_parked , 1 , __ATOMIC_SEQ_CST );
+
+}
+
+
+/**
+ * @brief Wake any threads parked on an integer after changing it.
+ *
+ * @param e The #engine.
+ * @param addr Pointer to the integer that was changed.
+ */
+
+static void engine_barrier_wake ( struct engine *e , volatile int *addr ) {
+
+#if defined(__linux__)
+	if ( __atomic_load_n( &e->barrier_parked , __ATOMIC_SEQ_CST ) > 0 )
+		syscall( SYS_futex , addr , FUTEX_WAKE_PRIVATE , INT_MAX , NULL , NULL , 0 );
+#endif
+
+}
+
+
+/**
+ * @brief Wait for all the runners to check in at the barrier.
+ *
+ * @param e The #engine.
+ */
+
+static void engine_barrier_join ( struct engine *e ) {
+
+	int in;
+
+	while ( ( in = __atomic_load_n( &e->barrier_in , __ATOMIC_ACQUIRE ) ) < e->nr_runners )
+		engine_barrier_waitwhile( e , &e->barrier_in , in );
+
+}
+
+
+/**
+ * @brief Release the runners waiting at the barrier.
+ *
+ * @param e The #engine.
+ *
+ * Must only be called once all the runners have checked in.
+ */
+
+static void engine_barrier_fork ( struct engine *e ) {
+
+	__atomic_store_n( &e->barrier_in , 0 , __ATOMIC_RELAXED );
+	__atomic_add_fetch( &e->barrier_gen , 1 , __ATOMIC_SEQ_CST );
+	engine_barrier_wake( e , &e->barrier_gen );
+
+}
+
+
 /**
  * @brief Barrier routine to hold the @c runners back.
  *
@@ -2094,43 +4037,74 @@ int engine_step ( struct engine *e ) {
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * After being initialized, and after every timestep, every #runner
- * calls this routine which blocks until all the runners have returned
- * and the #engine signals the next timestep.
+ * After being initialized, and after every phase of a timestep, every
+ * #runner calls this routine which blocks until all the runners have
+ * returned and the #engine releases them into the next phase.
  */
 
 int engine_barrier ( struct engine *e ) {
 
-	/* lock the barrier mutex */
-	if (pthread_mutex_lock(&e->barrier_mutex) != 0)
-		return error(engine_err_pthread);
+	int gen = __atomic_load_n( &e->barrier_gen , __ATOMIC_ACQUIRE );
 
-	/* wait for the barrier to close */
-	while (e->barrier_count < 0)
-		if (pthread_cond_wait(&e->barrier_cond,&e->barrier_mutex) != 0)
-			return error(engine_err_pthread);
-
-	/* if i'm the last thread in, signal that the barrier is full */
-	if (++e->barrier_count == e->nr_runners) {
-		if (pthread_cond_signal(&e->done_cond) != 0)
-			return error(engine_err_pthread);
-	}
+	/* check in, the last one in wakes the engine */
+	if ( __atomic_add_fetch( &e->barrier_in , 1 , __ATOMIC_SEQ_CST ) == e->nr_runners )
+		engine_barrier_wake( e , &e->barrier_in );
 
 	/* wait for the barrier to re-open */
-	while (e->barrier_count > 0)
-		if (pthread_cond_wait(&e->barrier_cond,&e->barrier_mutex) != 0)
-			return error(engine_err_pthread);
+	engine_barrier_waitwhile( e , &e->barrier_gen , gen );
 
-	/* if i'm the last thread out, signal to those waiting to get back in */
-	if (++e->barrier_count == 0)
-		if (pthread_cond_broadcast(&e->barrier_cond) != 0)
-			return error(engine_err_pthread);
+	/* all is well... */
+	return engine_err_ok;
 
-	/* free the barrier mutex */
-	if (pthread_mutex_unlock(&e->barrier_mutex) != 0)
-		return error(engine_err_pthread);
+}
 
-	/* all is well... */
+
+/**
+ * @brief Run a phase of the time step on all the runners.
+ *
+ * @param e The #engine.
+ * @param fun The function each #runner calls, with its own #runner and
+ *      @c data as arguments.
+ * @param data Data shared by all the runners in this phase.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Releases the runners, waits for them to check back in and adds the
+ * time not spent inside @c fun by the slowest runner, i.e. the cost of
+ * waking up and collecting the runners, to #engine_timer_overhead.
+ *
+ * Fails with #engine_err_runner if @c fun failed on any of the runners.
+ */
+
+int engine_phase_run ( struct engine *e , int (*fun)( struct runner *r , void *data ) , void *data ) {
+
+	int k, err = 0;
+	ticks tic = getticks(), busy = 0;
+
+	/* make sure the inputs are ok */
+	if ( e == NULL || fun == NULL )
+		return error(engine_err_null);
+
+	/* tell the runners what to do and open the door */
+	e->phase_fun = fun;
+	e->phase_data = data;
+	engine_barrier_fork( e );
+
+	/* wait for the runners to come home */
+	engine_barrier_join( e );
+
+	/* book the fork/join overhead and collect any errors */
+	for ( k = 0 ; k < e->nr_runners ; k++ ) {
+		if ( e->runners[k].phase_ticks > busy )
+			busy = e->runners[k].phase_ticks;
+		if ( e->runners[k].phase_err < 0 )
+			err = 1;
+	}
+	e->timers[engine_timer_overhead] += getticks() - tic - busy;
+	if ( err )
+		return error(engine_err_runner);
+
+	/* All in a days work. */
 	return engine_err_ok;
 
 }
@@ -2192,9 +4166,21 @@ int engine_finalize ( struct engine *e ) {
 
 	/* Shut down the runners, if they were started. */
 	if ( e->runners != NULL ) {
+		e->phase_fun = NULL;
+		engine_barrier_fork( e );
 		for ( k = 0 ; k < e->nr_runners ; k++ )
-			if ( pthread_cancel( e->runners[k].thread ) != 0 )
+			if ( pthread_join( e->runners[k].thread , NULL ) != 0 )
 				return error(engine_err_pthread);
+		for ( k = 0 ; k < e->nr_runners ; k++ ) {
+			deque_free( &e->runners[k].dq );
+			free( e->runners[k].eff );
+			free( e->runners[k].sums );
+			for ( j = 0 ; j < e->nr_runners ; j++ ) {
+				free( e->runners[k].out[j].parts );
+				free( e->runners[k].out[j].cid );
+			}
+			free( e->runners[k].out );
+		}
 		free( e->runners );
 		free( e->queues );
 	}
@@ -2237,12 +4223,35 @@ int engine_finalize ( struct engine *e ) {
 		free( e->send );
 		free( e->recv );
 	}
+	free( e->balance_load );
+	free( e->halo_tasks );
+	if ( e->spme != NULL ) {
+		spme_free( e->spme );
+		free( e->spme );
+	}
 
 	/* Free the bonded interactions. */
 	free( e->bonds );
 	free( e->angles );
 	free( e->dihedrals );
 	free( e->exclusions );
+	free( e->bonded_rank );
+	for ( k = 0 ; k < engine_bonded_last ; k++ ) {
+		free( e->bonded_keys[k] );
+		free( e->bonded_first[k] );
+		free( e->bonded_pos[k] );
+		free( e->bonded_hid[k] );
+		free( e->bonded_head[k] );
+		free( e->bonded_next[k] );
+		free( e->bonded_prev[k] );
+	}
+	free( e->bonded_owner );
+	for ( k = 0 ; k < e->bonded_nr_shares ; k++ ) {
+		for ( j = 0 ; j < engine_bonded_last ; j++ )
+			free( e->bonded_shares[k].edge[j] );
+		free( e->bonded_shares[k].eff );
+	}
+	free( e->bonded_shares );
 	free( e->rigids );
 	free( e->part2rigid );
 
@@ -2269,7 +4278,7 @@ int engine_finalize ( struct engine *e ) {
 int engine_init ( struct engine *e , const double *origin , const double *dim , double *L ,
         double cutoff , unsigned int period , int max_type , unsigned int flags ) {
 
-    int cid;
+    int cid, k;
 
     /* make sure the inputs are ok */
     if ( e == NULL || origin == NULL || dim == NULL || L == NULL )
@@ -2288,14 +4297,38 @@ int engine_init ( struct engine *e , const double *origin , const double *dim ,
     /* Set some flag implications. */
     if ( flags & engine_flag_verlet_pseudo )
         flags |= engine_flag_verlet_pairwise;
-    if ( flags & engine_flag_verlet_pairwise )
+    if ( flags & ( engine_flag_verlet_pairwise | engine_flag_verlet_list | engine_flag_cluster ) )
         flags |= engine_flag_verlet;
     if ( flags & engine_flag_cuda )
         flags |= engine_flag_nullpart;
+    if ( flags & engine_flag_numa )
+        flags |= engine_flag_affinity;
+
+    /* The cell grid can only be changed on a single node. */
+    if ( flags & ( engine_flag_mpi | engine_flag_cuda ) )
+        flags &= ~engine_flag_autogrid;
+
+    /* The SoA layout is only used by the cell-pair runners, and only
+       with cell locks. The particles sent to other nodes are records. */
+    if ( flags & ( engine_flag_verlet | engine_flag_cuda | engine_flag_unsorted | engine_flag_nolock | engine_flag_mpi ) )
+        flags &= ~engine_flag_soa;
+
+    /* The fused integration needs the cell-pair runners to write the
+       forces directly to the particles of a single node. */
+    if ( flags & ( engine_flag_verlet | engine_flag_cuda | engine_flag_soa | engine_flag_mpi | engine_flag_nolock ) )
+        flags &= ~engine_flag_fused;
+
+    /* Without cell locks, the kernels may not copy the particles back. */
+    if ( flags & engine_flag_nolock )
+        flags &= ~engine_flag_localparts;
 
     /* Set the flags. */
     e->flags = flags;
 
+    /* Keep the particle data in the cells' SoA buffers from the start. */
+    if ( ( flags & engine_flag_soa ) && space_soa_init( &e->s ) < 0 )
+        return error(engine_err_space);
+
     /* By default there is only one node. */
     e->nr_nodes = 1;
 
@@ -2306,6 +4339,24 @@ int engine_init ( struct engine *e , const double *origin , const double *dim ,
     /* Init the runners to 0. */
     e->runners = NULL;
     e->nr_runners = 0;
+    e->nr_sockets = 1;
+    e->autogrid_pending = 0;
+
+    /* No tasks held back. */
+    e->halo_tasks = NULL;
+    e->nr_halo = 0;
+    e->halo_size = 0;
+    e->halo_ready = 0;
+
+    /* No reciprocal-space electrostatics until asked for. */
+    e->spme = NULL;
+
+    /* No load measured yet. */
+    e->balance_steps = engine_balance_steps;
+    e->balance_tol = engine_balance_tol;
+    e->balance_load = NULL;
+    e->balance_imbalance = 1.0;
+    e->balance_moved = 0;
 
     /* Start with no queues. */
     e->queues = NULL;
@@ -2345,6 +4396,36 @@ int engine_init ( struct engine *e , const double *origin , const double *dim ,
     e->nr_dihedrals = 0;
 
     
+    /* Nothing sorted yet. */
+    e->bonded_rank = NULL;
+    for ( k = 0 ; k < engine_bonded_last ; k++ ) {
+        e->bonded_keys[k] = NULL;
+        e->bonded_keys_size[k] = 0;
+        e->bonded_nr_sorted[k] = 0;
+        e->bonded_nr_local[k] = 0;
+    }
+    e->bonded_sorted = 0;
+    e->bonded_split = 0;
+    e->bonded_owner = NULL;
+    for ( k = 0 ; k < engine_bonded_last ; k++ )
+        e->bonded_first[k] = NULL;
+    e->bonded_shares = NULL;
+    e->bonded_nr_shares = 0;
+    e->bonded_simd = runner_simd_none;
+
+    /* No handles given out yet. */
+    for ( k = 0 ; k < engine_bonded_last ; k++ ) {
+        e->bonded_pos[k] = NULL;
+        e->bonded_hid[k] = NULL;
+        e->bonded_nr_handles[k] = 0;
+        e->bonded_handles_size[k] = 0;
+        e->bonded_free[k] = -1;
+        e->bonded_head[k] = NULL;
+        e->bonded_head_size[k] = 0;
+        e->bonded_next[k] = NULL;
+        e->bonded_prev[k] = NULL;
+    }
+
     /* Init the sets. */
     e->sets = NULL;
     e->nr_sets = 0;
@@ -2371,6 +4452,7 @@ int engine_init ( struct engine *e , const double *origin , const double *dim ,
     if ( ( e->p_singlebody = (MxForce **)malloc( sizeof(MxForce *) * e->max_type ) ) == NULL )
             return error(engine_err_malloc);
     bzero(e->p_singlebody, sizeof(struct MxForce *) * e->max_type );
+    e->pot_kind = potential_kind_table;
 
     /* Make sortlists? */
     if ( flags & engine_flag_verlet_pseudo ) {
@@ -2380,17 +4462,19 @@ int engine_init ( struct engine *e , const double *origin , const double *dim ,
                     return error(engine_err_malloc);
     }
 
-    /* init the barrier variables */
-    e->barrier_count = 0;
-    if ( pthread_mutex_init( &e->barrier_mutex , NULL ) != 0 ||
-            pthread_cond_init( &e->barrier_cond , NULL ) != 0 ||
-            pthread_cond_init( &e->done_cond , NULL ) != 0)
-        return error(engine_err_pthread);
+    /* The runners have not summed up any kinetic energy yet. */
+    e->sums_time = -1;
+    e->ekin = 0.0;
+    e->ekin_mass = 0.0;
+    e->ekin_count = 0;
+    e->momentum[0] = e->momentum[1] = e->momentum[2] = 0.0;
 
     /* init the barrier */
-    if (pthread_mutex_lock(&e->barrier_mutex) != 0)
-        return error(engine_err_pthread);
-    e->barrier_count = 0;
+    e->barrier_gen = 0;
+    e->barrier_in = 0;
+    e->barrier_parked = 0;
+    e->phase_fun = NULL;
+    e->phase_data = NULL;
 
     /* Init the comm arrays. */
     e->send = NULL;
@@ -2407,6 +4491,7 @@ int engine_init ( struct engine *e , const double *origin , const double *dim ,
 
 
 void engine_dump() {
+    space_soa_unpack(&_Engine.s);
     for(int cid = 0; cid < _Engine.s.nr_cells; ++cid) {
         space_cell *cell = &_Engine.s.cells[cid];
         for(int pid = 0; pid < cell->count; ++pid) {
@@ -2420,19 +4505,74 @@ void engine_dump() {
     }
 }
 
+/**
+ * @brief Update the kinetic energy and momentum of each particle type.
+ *
+ * @param e The #engine.
+ *
+ * @return The mean kinetic energy per particle over all types.
+ *
+ * If the runners advanced the particles in the current step and no
+ * constraints were resolved since, their per-type sums are reduced,
+ * otherwise all cells are swept serially.
+ * Also updates the totals used by #engine_temperature.
+ */
 double engine_kinetic_energy(struct engine *e)
 {
-    // clear the ke in the types,
+    // clear the ke and momentum in the types and the totals,
     for(int i = 0; i < engine::nr_types; ++i) {
         engine::types[i].kinetic_energy = 0;
+        for(int k = 0; k < 3; ++k) {
+            engine::types[i].momentum[k] = 0;
+        }
+    }
+    e->ekin = 0;
+    e->ekin_mass = 0;
+    e->ekin_count = 0;
+    for(int k = 0; k < 3; ++k) {
+        e->momentum[k] = 0;
     }
     
-    for(int cid = 0; cid < _Engine.s.nr_cells; ++cid) {
-        space_cell *cell = &_Engine.s.cells[cid];
-        for(int pid = 0; pid < cell->count; ++pid) {
-            MxParticle *p = &cell->parts[pid];
-            engine::types[p->typeId].kinetic_energy += engine::types[p->typeId].mass *
-                    (p->v[0] * p->v[0] + p->v[1] * p->v[1] + p->v[2] * p->v[2]);
+    // the runners already summed it up per type in the advance pass.
+    if(e->runners != NULL && e->sums_time == e->time) {
+        for(int r = 0; r < e->nr_runners; ++r) {
+            for(int i = 0; i < engine::nr_types; ++i) {
+                double *sums = &e->runners[r].sums[i * runner_nrsums];
+                engine::types[i].kinetic_energy += sums[runner_sum_ekin];
+                engine::types[i].momentum[0] += sums[runner_sum_px];
+                engine::types[i].momentum[1] += sums[runner_sum_py];
+                engine::types[i].momentum[2] += sums[runner_sum_pz];
+                e->ekin_mass += engine::types[i].mass * sums[runner_sum_count];
+                e->ekin_count += sums[runner_sum_count];
+            }
+        }
+    }
+    else {
+        for(int cid = 0; cid < e->s.nr_cells; ++cid) {
+            space_cell *cell = &e->s.cells[cid];
+            for(int pid = 0; pid < cell->count; ++pid) {
+                MxParticle *p = &cell->parts[pid];
+                MxParticleType *type = &engine::types[p->typeId];
+                FPTYPE v[3];
+                for(int k = 0; k < 3; ++k) {
+                    v[k] = (cell->flags & cell_flag_soa) ? cell->soa_v[k][pid] : p->v[k];
+                }
+                type->kinetic_energy += type->mass *
+                        (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+                for(int k = 0; k < 3; ++k) {
+                    type->momentum[k] += type->mass * v[k];
+                }
+                e->ekin_mass += type->mass;
+                e->ekin_count += 1;
+            }
+        }
+    }
+    
+    // the totals, before the per-type values get normalized.
+    for(int i = 0; i < engine::nr_types; ++i) {
+        e->ekin += 0.5 * engine::types[i].kinetic_energy;
+        for(int k = 0; k < 3; ++k) {
+            e->momentum[k] += engine::types[i].momentum[k];
         }
     }
     
@@ -2447,9 +4587,25 @@ double engine_kinetic_energy(struct engine *e)
     return engine::types[0].kinetic_energy;
 }
 
+/**
+ * @brief The temperature of the system, in units where k_B = 1.
+ *
+ * @param e The #engine.
+ *
+ * @return The temperature as of the last call to #engine_kinetic_energy,
+ *      i.e. of the last step, with the center of mass motion removed.
+ */
 double engine_temperature(struct engine *e)
 {
-    return 0;
+    double p2 = e->momentum[0] * e->momentum[0] +
+            e->momentum[1] * e->momentum[1] +
+            e->momentum[2] * e->momentum[2];
+    
+    if(e->ekin_count < 2 || e->ekin_mass <= 0) {
+        return 0;
+    }
+    
+    return 2. * (e->ekin - 0.5 * p2 / e->ekin_mass) / (3. * (e->ekin_count - 1));
 }
 
 int engine_singlebody_set(struct engine *e, struct MxForce *f, int type_id)
@@ -2466,6 +4622,11 @@ int engine_singlebody_set(struct engine *e, struct MxForce *f, int type_id)
     if(f) {
         e->p_singlebody[type_id] = f;
         Py_INCREF(f);
+        
+        // make sure the runners apply it.
+        if(space_addtasks_singlebody(&e->s) < 0) {
+            return error(engine_err_space);
+        }
     }
 
     /* all is well... */
@@ -2483,6 +4644,15 @@ int engine_addpart(struct engine *e, struct MxParticle *p, double *x,
         return error(engine_err_space);
     }
 
+    /* Is it already part of an exclusion? */
+    if(p->id < e->bonded_head_size[engine_bonded_exclusion] &&
+       e->bonded_head[engine_bonded_exclusion][p->id] >= 0) {
+        e->s.partlist[p->id]->flags |= PARTICLE_FLAG_EXCLUDED;
+    }
+    else {
+        e->s.partlist[p->id]->flags &= ~PARTICLE_FLAG_EXCLUDED;
+    }
+
     e->types[p->typeId].count++;
 
     return engine_err_ok;
@@ -75,12 +75,12 @@
 
 int engine_bonded_eval_sets ( struct engine *e ) {
 
-	double epot_bond = 0.0, epot_angle = 0.0, epot_dihedral = 0.0, epot_exclusion = 0.0;
+	double epot_bond = 0.0, epot_angle = 0.0, epot_dihedral = 0.0;
 #ifdef HAVE_OPENMP
 	int sets_taboo[ e->nr_sets];
 	int k, j, set_curr, sets_next = 0, sets_ind[ e->nr_sets ];
-	double epot_local_bond = 0.0, epot_local_angle = 0.0, epot_local_dihedral = 0.0, epot_local_exclusion = 0.0;
-	ticks toc_bonds, toc_angles, toc_dihedrals, toc_exclusions;
+	double epot_local_bond = 0.0, epot_local_angle = 0.0, epot_local_dihedral = 0.0;
+	ticks toc_bonds, toc_angles, toc_dihedrals;
 #endif
 	ticks tic;
 
@@ -92,15 +92,14 @@ int engine_bonded_eval_sets ( struct engine *e ) {
 		sets_taboo[k] = 0;
 	}
 
-#pragma omp parallel private(k,j,set_curr,epot_local_bond,epot_local_angle,epot_local_dihedral,epot_local_exclusion,toc_bonds,toc_angles,toc_dihedrals,toc_exclusions)
+#pragma omp parallel private(k,j,set_curr,epot_local_bond,epot_local_angle,epot_local_dihedral,toc_bonds,toc_angles,toc_dihedrals)
 	if ( e->nr_sets > 0 && omp_get_num_threads() > 1 ) {
 
 		/* Init local counters. */
-		toc_bonds = 0; toc_angles = 0; toc_dihedrals = 0; toc_exclusions = 0;
+		toc_bonds = 0; toc_angles = 0; toc_dihedrals = 0;
 		epot_local_bond = 0.0;
 		epot_local_angle = 0.0;
 		epot_local_dihedral = 0.0;
-		epot_local_exclusion = 0.0;
 		set_curr = -1;
 
 		/* Main loop. */
@@ -139,11 +138,8 @@ int engine_bonded_eval_sets ( struct engine *e ) {
 			if ( set_curr < 0 )
 				break;
 
-			/* Evaluate the bonded interaction in the set. */
-			/* Do exclusions. */
-			tic = getticks();
-			exclusion_eval( e->sets[set_curr].exclusions , e->sets[set_curr].nr_exclusions , e , &epot_local_exclusion );
-			toc_exclusions += getticks() - tic;
+			/* Evaluate the bonded interaction in the set, the exclusions
+			   are skipped by the non-bonded kernels. */
 
 			/* Do bonds. */
 			tic = getticks();
@@ -173,11 +169,9 @@ int engine_bonded_eval_sets ( struct engine *e ) {
 			e->timers[engine_timer_bonds] += toc_bonds;
 			e->timers[engine_timer_angles] += toc_angles;
 			e->timers[engine_timer_dihedrals] += toc_dihedrals;
-			e->timers[engine_timer_exclusions] += toc_exclusions;
 			epot_bond += epot_local_bond;
 			epot_angle += epot_local_angle;
 			epot_dihedral += epot_local_dihedral;
-			epot_exclusion += epot_local_exclusion;
 		}
 
 	}
@@ -185,11 +179,6 @@ int engine_bonded_eval_sets ( struct engine *e ) {
 	/* Otherwise, just do the sequential thing. */
 	else {
 
-		/* Do exclusions. */
-		tic = getticks();
-		exclusion_eval( e->exclusions , e->nr_exclusions , e , &epot_exclusion );
-		e->timers[engine_timer_exclusions] += getticks() - tic;
-
 		/* Do bonds. */
 		tic = getticks();
 		bond_eval( e->bonds , e->nr_bonds , e , &epot_bond );
@@ -208,12 +197,6 @@ int engine_bonded_eval_sets ( struct engine *e ) {
 	}
 #else
 
-	/* Do exclusions. */
-	tic = getticks();
-	if ( exclusion_eval( e->exclusions , e->nr_exclusions , e , &epot_exclusion ) < 0 )
-		return error(engine_err_exclusion);
-	e->timers[engine_timer_exclusions] += getticks() - tic;
-
 	/* Do bonds. */
 	tic = getticks();
 	if ( bond_eval( e->bonds , e->nr_bonds , e , &epot_bond ) < 0 )
@@ -235,11 +218,10 @@ int engine_bonded_eval_sets ( struct engine *e ) {
 #endif
 
 /* Store the potential energy. */
-	e->s.epot += epot_bond + epot_angle + epot_dihedral + epot_exclusion;
+	e->s.epot += epot_bond + epot_angle + epot_dihedral;
 	e->s.epot_bond += epot_bond;
 	e->s.epot_angle += epot_angle;
 	e->s.epot_dihedral += epot_dihedral;
-	e->s.epot_exclusion += epot_exclusion;
 
 	/* I'll be back... */
 	return engine_err_ok;
@@ -1032,6 +1014,427 @@ int engine_bonded_sets ( struct engine *e , int max_sets ) {
 
 
 
+/** Size and number of particles of each kind of bonded interaction. */
+static const int engine_bonded_size[ engine_bonded_last ] = {
+	sizeof(struct exclusion) , sizeof(struct bond) , sizeof(struct angle) , sizeof(struct dihedral) };
+static const int engine_bonded_nrids[ engine_bonded_last ] = { 2 , 2 , 3 , 4 };
+
+
+/** Get the list of the given kind of bonded interactions. */
+static void *engine_bonded_list ( struct engine *e , int kind ) {
+
+	switch ( kind ) {
+		case engine_bonded_exclusion: return e->exclusions;
+		case engine_bonded_bond: return e->bonds;
+		case engine_bonded_angle: return e->angles;
+		case engine_bonded_dihedral: return e->dihedrals;
+	}
+
+	return NULL;
+
+}
+
+
+/** Get the number of the given kind of bonded interactions. */
+static int engine_bonded_count ( struct engine *e , int kind ) {
+
+	switch ( kind ) {
+		case engine_bonded_exclusion: return e->nr_exclusions;
+		case engine_bonded_bond: return e->nr_bonds;
+		case engine_bonded_angle: return e->nr_angles;
+		case engine_bonded_dihedral: return e->nr_dihedrals;
+	}
+
+	return 0;
+
+}
+
+
+/** Get a pointer to the number of the given kind of bonded interactions. */
+static int *engine_bonded_countp ( struct engine *e , int kind ) {
+
+	switch ( kind ) {
+		case engine_bonded_exclusion: return &e->nr_exclusions;
+		case engine_bonded_bond: return &e->nr_bonds;
+		case engine_bonded_angle: return &e->nr_angles;
+		case engine_bonded_dihedral: return &e->nr_dihedrals;
+	}
+
+	return NULL;
+
+}
+
+
+/** Get the particle IDs of the bonded interaction at position @c k. */
+static int *engine_bonded_ids ( struct engine *e , int kind , int k ) {
+
+	return (int *)&( (char *)engine_bonded_list( e , kind ) )[ (size_t)k * engine_bonded_size[kind] ];
+
+}
+
+
+/**
+ * @brief Swap two bonded interactions in their list, along with their
+ *      keys and handles.
+ */
+
+static void engine_bonded_swap ( struct engine *e , int kind , int a , int b ) {
+
+	union { struct exclusion x; struct bond b; struct angle a; struct dihedral d; } temp;
+	int size = engine_bonded_size[kind], *keys = e->bonded_keys[kind], *hid = e->bonded_hid[kind], t;
+	char *items = (char *)engine_bonded_list( e , kind );
+
+	if ( a == b )
+		return;
+
+	memcpy( &temp , &items[ (size_t)a * size ] , size );
+	memcpy( &items[ (size_t)a * size ] , &items[ (size_t)b * size ] , size );
+	memcpy( &items[ (size_t)b * size ] , &temp , size );
+	if ( a < e->bonded_keys_size[kind] && b < e->bonded_keys_size[kind] ) {
+		t = keys[a]; keys[a] = keys[b]; keys[b] = t;
+	}
+	t = hid[a]; hid[a] = hid[b]; hid[b] = t;
+	e->bonded_pos[kind][ hid[a] ] = a;
+	e->bonded_pos[kind][ hid[b] ] = b;
+
+}
+
+
+/**
+ * @brief Move a bonded interaction to another position in its list,
+ *      along with its key and handle, overwriting the one there.
+ */
+
+static void engine_bonded_move ( struct engine *e , int kind , int from , int to ) {
+
+	int size = engine_bonded_size[kind], *hid = e->bonded_hid[kind];
+	char *items = (char *)engine_bonded_list( e , kind );
+
+	if ( from == to )
+		return;
+
+	memcpy( &items[ (size_t)to * size ] , &items[ (size_t)from * size ] , size );
+	if ( to < e->bonded_keys_size[kind] )
+		e->bonded_keys[kind][to] = ( from < e->bonded_keys_size[kind] ) ? e->bonded_keys[kind][from] : -1;
+	hid[to] = hid[from];
+	e->bonded_pos[kind][ hid[to] ] = to;
+
+}
+
+
+/**
+ * @brief Add a bonded interaction to the lists of its particles.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction, e.g. #engine_bonded_bond.
+ * @param hid The handle of the interaction.
+ * @param ids The IDs of its particles.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+static int engine_bonded_link ( struct engine *e , int kind , int hid , const int *ids ) {
+
+	int j, k, l, pid, size, *head, *next = e->bonded_next[kind], *prev = e->bonded_prev[kind];
+
+	for ( j = 0 ; j < engine_bonded_nrids[kind] ; j++ ) {
+
+		if ( ( pid = ids[j] ) < 0 )
+			continue;
+
+		/* Make room for this particle. */
+		if ( pid >= e->bonded_head_size[kind] ) {
+			size = pid * 1.414 + 1;
+			if ( size < e->s.size_parts )
+				size = e->s.size_parts;
+			if ( ( head = (int *)realloc( e->bonded_head[kind] , sizeof(int) * size ) ) == NULL )
+				return error(engine_err_malloc);
+			for ( k = e->bonded_head_size[kind] ; k < size ; k++ )
+				head[k] = -1;
+			e->bonded_head[kind] = head;
+			e->bonded_head_size[kind] = size;
+		}
+		head = e->bonded_head[kind];
+
+		/* Put the link first in the particle's list. */
+		l = 4*hid + j;
+		next[l] = head[pid];
+		prev[l] = -1;
+		if ( head[pid] >= 0 )
+			prev[ head[pid] ] = l;
+		head[pid] = l;
+
+		/* Let the non-bonded kernels know to look for its exclusions. */
+		if ( kind == engine_bonded_exclusion && pid < e->s.size_parts && e->s.partlist[pid] != NULL )
+			e->s.partlist[pid]->flags |= PARTICLE_FLAG_EXCLUDED;
+
+	}
+
+	/* The neighbour lists skip the excluded pairs. */
+	if ( kind == engine_bonded_exclusion )
+		e->s.verlet_rebuild = 1;
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Remove a bonded interaction from the lists of its particles.
+ */
+
+static void engine_bonded_unlink ( struct engine *e , int kind , int hid , const int *ids ) {
+
+	int j, l, *next = e->bonded_next[kind], *prev = e->bonded_prev[kind];
+
+	for ( j = 0 ; j < engine_bonded_nrids[kind] ; j++ ) {
+		if ( ids[j] < 0 )
+			continue;
+		l = 4*hid + j;
+		if ( prev[l] >= 0 )
+			next[ prev[l] ] = next[l];
+		else
+			e->bonded_head[kind][ ids[j] ] = next[l];
+		if ( next[l] >= 0 )
+			prev[ next[l] ] = prev[l];
+		if ( kind == engine_bonded_exclusion && e->bonded_head[kind][ ids[j] ] < 0 &&
+			 ids[j] < e->s.size_parts && e->s.partlist[ ids[j] ] != NULL )
+			e->s.partlist[ ids[j] ]->flags &= ~PARTICLE_FLAG_EXCLUDED;
+	}
+
+	if ( kind == engine_bonded_exclusion )
+		e->s.verlet_rebuild = 1;
+
+}
+
+
+/** Put a handle back on the list of free handles. */
+static void engine_bonded_release ( struct engine *e , int kind , int hid ) {
+
+	e->bonded_pos[kind][hid] = -2 - e->bonded_free[kind];
+	e->bonded_free[kind] = hid;
+
+}
+
+
+/**
+ * @brief Give the bonded interaction just appended to its list a handle.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction, e.g. #engine_bonded_bond.
+ *
+ * @return The handle of the interaction or < 0 on error (see #engine_err).
+ *
+ * If the lists are sorted (see #engine_bonded_sort), the interaction is
+ * moved to the end of the local ones if all its particles are on this
+ * node, with a key that will have it sorted into place at the next sort,
+ * and the runners' shares are extended to it, such that the lists need
+ * not be sorted and shared again.
+ */
+
+static int engine_bonded_added ( struct engine *e , int kind ) {
+
+	struct space *s = &e->s;
+	int N = engine_bonded_count( e , kind ), k = N - 1, nr_ids = engine_bonded_nrids[kind];
+	int hid, j, nl, size, *ids, *dummy;
+
+	/* Get a free handle, or make room for a new one. */
+	if ( ( hid = e->bonded_free[kind] ) >= 0 )
+		e->bonded_free[kind] = -2 - e->bonded_pos[kind][hid];
+	else {
+		if ( e->bonded_nr_handles[kind] == e->bonded_handles_size[kind] ) {
+			size = e->bonded_handles_size[kind] * 1.414 + 100;
+			if ( ( dummy = (int *)realloc( e->bonded_pos[kind] , sizeof(int) * size ) ) == NULL )
+				return error(engine_err_malloc);
+			e->bonded_pos[kind] = dummy;
+			if ( ( dummy = (int *)realloc( e->bonded_hid[kind] , sizeof(int) * size ) ) == NULL )
+				return error(engine_err_malloc);
+			e->bonded_hid[kind] = dummy;
+			if ( ( dummy = (int *)realloc( e->bonded_next[kind] , sizeof(int) * 4 * size ) ) == NULL )
+				return error(engine_err_malloc);
+			e->bonded_next[kind] = dummy;
+			if ( ( dummy = (int *)realloc( e->bonded_prev[kind] , sizeof(int) * 4 * size ) ) == NULL )
+				return error(engine_err_malloc);
+			e->bonded_prev[kind] = dummy;
+			e->bonded_handles_size[kind] = size;
+		}
+		hid = e->bonded_nr_handles[kind]++;
+	}
+	e->bonded_pos[kind][hid] = k;
+	e->bonded_hid[kind][k] = hid;
+	ids = engine_bonded_ids( e , kind , k );
+	if ( engine_bonded_link( e , kind , hid , ids ) < 0 )
+		return error(engine_err);
+
+	/* If the list is not sorted, it will be before it is used, and the
+	   exclusions are never sorted (see #engine_bonded_sort). */
+	if ( !e->bonded_sorted || kind == engine_bonded_exclusion )
+		return hid;
+
+	/* Make room for its key. */
+	if ( e->bonded_keys_size[kind] < N ) {
+		size = N * 1.414 + 1;
+		if ( ( dummy = (int *)realloc( e->bonded_keys[kind] , sizeof(int) * size ) ) == NULL )
+			return error(engine_err_malloc);
+		e->bonded_keys[kind] = dummy;
+		e->bonded_keys_size[kind] = size;
+	}
+
+	/* Are all its particles here? Then swap it with the first of those
+	   that are not and mark it as unsorted. */
+	for ( j = 0 ; j < nr_ids && ids[j] >= 0 && ids[j] < s->size_parts && s->partlist[ ids[j] ] != NULL ; j++ );
+	if ( j < nr_ids )
+		e->bonded_keys[kind][k] = s->nr_cells;
+	else {
+		nl = e->bonded_nr_local[kind];
+		engine_bonded_swap( e , kind , nl , k );
+		e->bonded_keys[kind][nl] = -1;
+		e->bonded_nr_local[kind] = nl + 1;
+		if ( e->bonded_split )
+			e->bonded_first[kind][ e->nr_runners ] = nl + 1;
+	}
+	e->bonded_nr_sorted[kind] = N;
+
+	return hid;
+
+}
+
+
+/**
+ * @brief Remove a bonded interaction from the engine.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction, e.g. #engine_bonded_bond.
+ * @param hid The handle of the interaction, as returned by e.g.
+ *      #engine_bond_add.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The gap is filled with the last interaction, or, if the lists are
+ * sorted (see #engine_bonded_sort), the last local one and the last one,
+ * such that this takes constant time and the lists need not be sorted
+ * and shared between the runners again. The handle may be given to a
+ * new interaction later on.
+ *
+ * The bonded sets, if any, are not updated (see #engine_bonded_sets).
+ */
+
+int engine_bonded_remove ( struct engine *e , int kind , int hid ) {
+
+	int k, r, N, nl, *count;
+
+	/* Check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+	if ( kind < 0 || kind >= engine_bonded_last || hid < 0 || hid >= e->bonded_nr_handles[kind] ||
+		 ( k = e->bonded_pos[kind][hid] ) < 0 )
+		return error(engine_err_range);
+	count = engine_bonded_countp( e , kind );
+	N = *count;
+
+	/* Take it out of its particles' lists. */
+	engine_bonded_unlink( e , kind , hid , engine_bonded_ids( e , kind , k ) );
+
+	/* Fill the gap with the last local interaction, and that one with
+	   the last one, marking the one that moved as unsorted. */
+	if ( e->bonded_sorted && kind != engine_bonded_exclusion ) {
+		nl = e->bonded_nr_local[kind];
+		if ( k < nl ) {
+			engine_bonded_move( e , kind , nl - 1 , k );
+			if ( k < nl - 1 )
+				e->bonded_keys[kind][k] = -1;
+			engine_bonded_move( e , kind , N - 1 , nl - 1 );
+			e->bonded_nr_local[kind] = nl - 1;
+			if ( e->bonded_split )
+				for ( r = 0 ; r <= e->nr_runners ; r++ )
+					if ( e->bonded_first[kind][r] > nl - 1 )
+						e->bonded_first[kind][r] = nl - 1;
+		}
+		else
+			engine_bonded_move( e , kind , N - 1 , k );
+		e->bonded_nr_sorted[kind] = N - 1;
+	}
+
+	/* Otherwise, just fill it with the last one. */
+	else {
+		engine_bonded_move( e , kind , N - 1 , k );
+		if ( k < N - 1 && k < e->bonded_nr_sorted[kind] )
+			e->bonded_keys[kind][k] = -1;
+		if ( e->bonded_nr_sorted[kind] > N - 1 )
+			e->bonded_nr_sorted[kind] = N - 1;
+	}
+
+	*count = N - 1;
+	engine_bonded_release( e , kind , hid );
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Get the position of a bonded interaction in its list.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction, e.g. #engine_bonded_bond.
+ * @param hid The handle of the interaction.
+ *
+ * @return The index of the interaction in, e.g., @c e->bonds, or < 0
+ *      on error (see #engine_err).
+ *
+ * The position is only valid until the next time interactions are
+ * added, removed or sorted.
+ */
+
+int engine_bonded_lookup ( struct engine *e , int kind , int hid ) {
+
+	/* Check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+	if ( kind < 0 || kind >= engine_bonded_last || hid < 0 || hid >= e->bonded_nr_handles[kind] ||
+		 e->bonded_pos[kind][hid] < 0 )
+		return error(engine_err_range);
+
+	return e->bonded_pos[kind][hid];
+
+}
+
+
+/**
+ * @brief Get the bonded interactions of a given kind a particle is part of.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction, e.g. #engine_bonded_bond.
+ * @param pid The ID of the particle.
+ * @param hids An array in which to store the handles of the interactions.
+ * @param size The size of @c hids.
+ *
+ * @return The number of interactions, of which at most @c size are
+ *      stored in @c hids, or < 0 on error (see #engine_err).
+ */
+
+int engine_bonded_adjacent ( struct engine *e , int kind , int pid , int *hids , int size ) {
+
+	int l, count = 0;
+
+	/* Check inputs. */
+	if ( e == NULL || ( hids == NULL && size > 0 ) )
+		return error(engine_err_null);
+	if ( kind < 0 || kind >= engine_bonded_last )
+		return error(engine_err_range);
+
+	/* Walk the particle's list. */
+	if ( pid >= 0 && pid < e->bonded_head_size[kind] )
+		for ( l = e->bonded_head[kind][pid] ; l >= 0 ; l = e->bonded_next[kind][l] ) {
+			if ( count < size )
+				hids[count] = l / 4;
+			count += 1;
+		}
+
+	return count;
+
+}
+
 /**
  * @brief Add a dihedral interaction to the engine.
  *
@@ -1042,7 +1445,8 @@ int engine_bonded_sets ( struct engine *e , int max_sets ) {
  * @param l The ID of the fourth #part.
  * @param pid Index of the #potential for this bond.
  *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * @return The handle of the new dihedral (see #engine_bonded_remove) or < 0
+ *      on error (see #engine_err).
  */
 
 int engine_dihedral_add ( struct engine *e , int i , int j , int k , int l , int pid ) {
@@ -1075,8 +1479,8 @@ int engine_dihedral_add ( struct engine *e , int i , int j , int k , int l , int
 	e->dihedrals[ e->nr_dihedrals ].pid = pid;
 	e->nr_dihedrals += 1;
 
-	/* It's the end of the world as we know it. */
-	return engine_err_ok;
+	/* Give it a handle and put it in its place. */
+	return engine_bonded_added( e , engine_bonded_dihedral );
 
 }
 
@@ -1090,7 +1494,8 @@ int engine_dihedral_add ( struct engine *e , int i , int j , int k , int l , int
  * @param k The ID of the third #part.
  * @param pid Index of the #potential for this bond.
  *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * @return The handle of the new angle (see #engine_bonded_remove) or < 0
+ *      on error (see #engine_err).
  */
 
 int engine_angle_add ( struct engine *e , int i , int j , int k , int pid ) {
@@ -1122,8 +1527,8 @@ int engine_angle_add ( struct engine *e , int i , int j , int k , int pid ) {
 	e->angles[ e->nr_angles ].pid = pid;
 	e->nr_angles += 1;
 
-	/* It's the end of the world as we know it. */
-	return engine_err_ok;
+	/* Give it a handle and put it in its place. */
+	return engine_bonded_added( e , engine_bonded_angle );
 
 }
 
@@ -1133,6 +1538,7 @@ static void exclusion_qsort (struct engine *e,  int l , int r ) {
 	int i = l, j = r;
 	int pivot_i = e->exclusions[ (l + r)/2 ].i;
 	int pivot_j = e->exclusions[ (l + r)/2 ].j;
+	int *hid = e->bonded_hid[ engine_bonded_exclusion ], htemp;
 	struct exclusion temp;
 
 	/* Too small? */
@@ -1148,6 +1554,7 @@ static void exclusion_qsort (struct engine *e,  int l , int r ) {
 					temp = e->exclusions[j];
 					e->exclusions[j] = e->exclusions[j+1];
 					e->exclusions[j+1] = temp;
+					htemp = hid[j]; hid[j] = hid[j+1]; hid[j+1] = htemp;
 				}
 				else
 					break;
@@ -1169,6 +1576,7 @@ static void exclusion_qsort (struct engine *e,  int l , int r ) {
 				temp = e->exclusions[i];
 				e->exclusions[i] = e->exclusions[j];
 				e->exclusions[j] = temp;
+				htemp = hid[i]; hid[i] = hid[j]; hid[j] = htemp;
 				i += 1;
 				j -= 1;
 			}
@@ -1191,11 +1599,20 @@ static void exclusion_qsort (struct engine *e,  int l , int r ) {
  * @param e The #engine.
  *
  * @return The number of unique exclusions or < 0 on error (see #engine_err).
+ *
+ * The handles of the duplicates that were removed are released, only
+ * the first handle of each exclusion remains valid.
  */
 
 int engine_exclusion_shrink ( struct engine *e ) {
 
-	int j, k;
+	int j, k, *hid, *pos;
+
+	/* Anything to do? */
+	if ( e->nr_exclusions == 0 )
+		return engine_err_ok;
+	hid = e->bonded_hid[ engine_bonded_exclusion ];
+	pos = e->bonded_pos[ engine_bonded_exclusion ];
 
 	/* Sort the exclusions. */
 	exclusion_qsort(e, 0 , e->nr_exclusions-1 );
@@ -1212,11 +1629,19 @@ int engine_exclusion_shrink ( struct engine *e ) {
 				e->exclusions[k].i != e->exclusions[j].i ) {
 			j += 1;
 			e->exclusions[j] = e->exclusions[k];
+			hid[j] = hid[k];
+		}
+		else {
+			engine_bonded_unlink( e , engine_bonded_exclusion , hid[k] , &e->exclusions[k].i );
+			engine_bonded_release( e , engine_bonded_exclusion , hid[k] );
 		}
 
 	/* Set the number of exclusions to j. */
 	e->nr_exclusions = j+1;
-	if ( ( e->exclusions = (struct exclusion *)realloc( e->exclusions , sizeof(struct exclusion) * e->nr_exclusions ) ) == NULL )
+	for ( k = 0 ; k < e->nr_exclusions ; k++ )
+		pos[ hid[k] ] = k;
+	e->exclusions_size = e->nr_exclusions + 1;
+	if ( ( e->exclusions = (struct exclusion *)realloc( e->exclusions , sizeof(struct exclusion) * e->exclusions_size ) ) == NULL )
 		return error(engine_err_malloc);
 
 	/* Go home. */
@@ -1232,7 +1657,8 @@ int engine_exclusion_shrink ( struct engine *e ) {
  * @param i The ID of the first #part.
  * @param j The ID of the second #part.
  *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * @return The handle of the new exclusion (see #engine_bonded_remove) or < 0
+ *      on error (see #engine_err).
  */
 
 int engine_exclusion_add ( struct engine *e , int i , int j ) {
@@ -1247,7 +1673,7 @@ int engine_exclusion_add ( struct engine *e , int i , int j ) {
 
 	/* Do we need to grow the exclusions array? */
 	if ( e->nr_exclusions == e->exclusions_size ) {
-		e->exclusions_size *= 1.414;
+		e->exclusions_size = e->exclusions_size * 1.414 + 1;
 		if ( ( dummy = (struct exclusion *)malloc( sizeof(struct exclusion) * e->exclusions_size ) ) == NULL )
 			return error(engine_err_malloc);
 		memcpy( dummy , e->exclusions , sizeof(struct exclusion) * e->nr_exclusions );
@@ -1266,8 +1692,8 @@ int engine_exclusion_add ( struct engine *e , int i , int j ) {
 	}
 	e->nr_exclusions += 1;
 
-	/* It's the end of the world as we know it. */
-	return engine_err_ok;
+	/* Give it a handle and put it in its place. */
+	return engine_bonded_added( e , engine_bonded_exclusion );
 
 }
 
@@ -1279,7 +1705,8 @@ int engine_exclusion_add ( struct engine *e , int i , int j ) {
  * @param i The ID of the first #part.
  * @param j The ID of the second #part.
  *
- * @return #engine_err_ok or < 0 on error (see #engine_err).
+ * @return The handle of the new bond (see #engine_bonded_remove) or < 0
+ *      on error (see #engine_err).
  */
 
 int engine_bond_add ( struct engine *e , int i , int j ) {
@@ -1307,181 +1734,586 @@ int engine_bond_add ( struct engine *e , int i , int j ) {
 	e->bonds[ e->nr_bonds ].j = j;
 	e->nr_bonds += 1;
 
-	/* It's the end of the world as we know it. */
+	/* Give it a handle and put it in its place. */
+	return engine_bonded_added( e , engine_bonded_bond );
+
+}
+
+
+/** Compare two 64-bit sort keys, for qsort. */
+static int engine_bonded_cmp ( const void *a , const void *b ) {
+
+	unsigned long long ka = *(const unsigned long long *)a, kb = *(const unsigned long long *)b;
+
+	return ( ka > kb ) - ( ka < kb );
+
+}
+
+
+/**
+ * @brief Rank the cells along a Morton curve.
+ *
+ * @param e The #engine.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+static int engine_bonded_rank ( struct engine *e ) {
+
+	struct space *s = &e->s;
+	int k, cid, bits;
+	unsigned int x[3];
+	unsigned long long *buff;
+
+	/* Get enough bits for the largest dimension. */
+	for ( bits = 0 ; bits < space_sfc_maxbits ; bits++ )
+		if ( ( 1 << bits ) >= s->cdim[0] && ( 1 << bits ) >= s->cdim[1] && ( 1 << bits ) >= s->cdim[2] )
+			break;
+
+	/* Sort the cells by their key. */
+	free( e->bonded_rank );
+	if ( ( e->bonded_rank = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL ||
+		 ( buff = (unsigned long long *)malloc( sizeof(unsigned long long) * s->nr_cells ) ) == NULL )
+		return error(engine_err_malloc);
+	for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+		for ( k = 0 ; k < 3 ; k++ )
+			x[k] = s->cells[cid].loc[k] & ( ( 1u << bits ) - 1 );
+		buff[cid] = ( (unsigned long long)space_sfc_key( space_sfc_morton , bits , x ) << 32 ) | (unsigned int)cid;
+	}
+	qsort( buff , s->nr_cells , sizeof(unsigned long long) , engine_bonded_cmp );
+	for ( k = 0 ; k < s->nr_cells ; k++ )
+		e->bonded_rank[ buff[k] & 0xffffffffu ] = k;
+	free( buff );
+
+	/* Remember the grid. */
+	for ( k = 0 ; k < 3 ; k++ )
+		e->bonded_cdim[k] = s->cdim[k];
+
 	return engine_err_ok;
 
 }
 
 
 /**
- * @brief Compute all bonded interactions stored in this engine.
- * 
+ * @brief Bring one list of bonded interactions back into cell order.
+ *
  * @param e The #engine.
+ * @param kind The kind of interaction, e.g. #engine_bonded_bond.
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * Does the same as #engine_bond_eval, #engine_angle_eval and
- * #engine_dihedral eval, yet all in one go to avoid excessive
- * updates of the particle forces.
+ * Only the interactions whose key changed since the last sort are taken
+ * out, sorted, and merged back in, so that a step in which few particles
+ * changed cells costs a single pass over the list.
  */
 
-int engine_bonded_eval ( struct engine *e ) {
+static int engine_bonded_resort ( struct engine *e , int kind ) {
+
+	struct space *s = &e->s;
+	char *items = (char *)engine_bonded_list( e , kind ), *moved;
+	int size = engine_bonded_size[kind], nr_ids = engine_bonded_nrids[kind], N = engine_bonded_count( e , kind );
+	int *keys, *ids, *mkeys, *mhid, *hid = e->bonded_hid[kind], k, j, a, b, key, nr_moved = 0, nr_local = 0;
+	unsigned long long *buff;
+
+	/* Make sure there is a key for each interaction. */
+	if ( e->bonded_keys_size[kind] < N ) {
+		free( e->bonded_keys[kind] );
+		e->bonded_keys_size[kind] = N * 1.414 + 1;
+		if ( ( e->bonded_keys[kind] = (int *)malloc( sizeof(int) * e->bonded_keys_size[kind] ) ) == NULL )
+			return error(engine_err_malloc);
+		e->bonded_nr_sorted[kind] = 0;
+	}
+	keys = e->bonded_keys[kind];
+	if ( ( buff = (unsigned long long *)malloc( sizeof(unsigned long long) * ( N > 0 ? N : 1 ) ) ) == NULL )
+		return error(engine_err_malloc);
+
+	/* Get the new keys, the rank of the cell of the first particle or
+	   the number of cells if any particle is not here, and take out the
+	   ones that changed. */
+	for ( k = 0 ; k < N ; k++ ) {
+		ids = (int *)&items[ (size_t)k * size ];
+		for ( j = 0 ; j < nr_ids && s->partlist[ ids[j] ] != NULL ; j++ );
+		key = ( j < nr_ids ) ? s->nr_cells : e->bonded_rank[ s->celllist[ ids[0] ] - s->cells ];
+		nr_local += ( key < s->nr_cells );
+		if ( k >= e->bonded_nr_sorted[kind] || key != keys[k] ) {
+			buff[ nr_moved++ ] = ( (unsigned long long)key << 32 ) | (unsigned int)k;
+			keys[k] = -1;
+		}
+	}
+
+	/* Sort the ones that moved and merge them back in. */
+	if ( nr_moved > 0 ) {
+		qsort( buff , nr_moved , sizeof(unsigned long long) , engine_bonded_cmp );
+		if ( ( moved = (char *)malloc( (size_t)size * nr_moved ) ) == NULL ||
+			 ( mkeys = (int *)malloc( sizeof(int) * nr_moved ) ) == NULL ||
+			 ( mhid = (int *)malloc( sizeof(int) * nr_moved ) ) == NULL )
+			return error(engine_err_malloc);
+		for ( k = 0 ; k < nr_moved ; k++ ) {
+			memcpy( &moved[ (size_t)k * size ] , &items[ (size_t)( buff[k] & 0xffffffffu ) * size ] , size );
+			mkeys[k] = buff[k] >> 32;
+			mhid[k] = hid[ buff[k] & 0xffffffffu ];
+		}
+
+		/* Close the gaps, the rest is still in order. */
+		for ( j = 0 , k = 0 ; k < N ; k++ )
+			if ( keys[k] >= 0 ) {
+				if ( j < k ) {
+					memcpy( &items[ (size_t)j * size ] , &items[ (size_t)k * size ] , size );
+					keys[j] = keys[k];
+					hid[j] = hid[k];
+				}
+				j += 1;
+			}
+
+		/* Merge from the back. */
+		for ( a = j - 1 , b = nr_moved - 1 , k = N - 1 ; b >= 0 ; k-- )
+			if ( a >= 0 && keys[a] > mkeys[b] ) {
+				memcpy( &items[ (size_t)k * size ] , &items[ (size_t)a * size ] , size );
+				hid[k] = hid[a];
+				keys[k] = keys[a--];
+			}
+			else {
+				memcpy( &items[ (size_t)k * size ] , &moved[ (size_t)b * size ] , size );
+				hid[k] = mhid[b];
+				keys[k] = mkeys[b--];
+			}
+
+		/* The handles follow their interactions. */
+		for ( k = 0 ; k < N ; k++ )
+			e->bonded_pos[kind][ hid[k] ] = k;
+
+		free( moved );
+		free( mkeys );
+		free( mhid );
+	}
+	free( buff );
+
+	e->bonded_nr_sorted[kind] = N;
+	e->bonded_nr_local[kind] = nr_local;
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Keep the bonded interactions sorted by the cell of their first
+ *      particle.
+ *
+ * @param e The #engine.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The bonds, angles and dihedrals are ordered by the rank
+ * of the cell of their first particle along a Morton curve, so that
+ * evaluating them in order walks through the cells and their particles
+ * more or less sequentially. Interactions with a particle that is not
+ * on this node are moved to the end, and only the first
+ * @c e->bonded_nr_local of each kind need to be evaluated. The
+ * exclusions are not evaluated, but skipped by the non-bonded kernels
+ * (see #engine_excluded), and are left as they are.
+ *
+ * Nothing is done unless a particle changed its cell or node (see
+ * @c parts_moved in #space), or the lists were changed other than by
+ * #engine_bonded_remove or the @c engine_*_add functions, since the last
+ * call, and then only the interactions whose first cell changed, or
+ * that were added or moved since, are moved.
+ */
+
+int engine_bonded_sort ( struct engine *e ) {
 
-	double epot_bond = 0.0, epot_angle = 0.0, epot_dihedral = 0.0, epot_exclusion = 0.0;
 	struct space *s;
-	struct dihedral dtemp;
-	struct angle atemp;
-	struct bond btemp;
-	struct exclusion etemp;
-	int nr_dihedrals = e->nr_dihedrals, nr_bonds = e->nr_bonds;
-	int nr_angles = e->nr_angles, nr_exclusions = e->nr_exclusions;
-	int i, j, k;
+	int k;
 	ticks tic;
 
-	/* Bail if there are no bonded interaction. */
-	if ( nr_bonds == 0 && nr_angles == 0 && nr_dihedrals == 0 && nr_exclusions == 0 )
+	/* Check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
+	s = &e->s;
+
+	/* Anything to do? */
+	if ( e->bonded_sorted && !s->parts_moved )
 		return engine_err_ok;
+	tic = getticks();
 
-	/* Get a handle on the space. */
-	s = &e->s;
+	/* Have the cells changed? Then start over. */
+	if ( e->bonded_rank == NULL || e->bonded_cdim[0] != s->cdim[0] ||
+		 e->bonded_cdim[1] != s->cdim[1] || e->bonded_cdim[2] != s->cdim[2] ) {
+		if ( engine_bonded_rank( e ) < 0 )
+			return error(engine_err);
+		for ( k = 0 ; k < engine_bonded_last ; k++ )
+			e->bonded_nr_sorted[k] = 0;
+	}
 
-	/* If in parallel... */
-	if ( e->nr_nodes > 1 ) {
+	/* Sort each kind but the exclusions. */
+	for ( k = engine_bonded_bond ; k < engine_bonded_last ; k++ )
+		if ( engine_bonded_resort( e , k ) < 0 )
+			return error(engine_err);
 
-		tic = getticks();
+	/* The runners' shares no longer match. */
+	s->parts_moved = 0;
+	e->bonded_sorted = 1;
+	e->bonded_split = 0;
+	e->timers[engine_timer_bonded_sort] += getticks() - tic;
 
-#pragma omp parallel for schedule(static), private(i,j,dtemp,atemp,btemp,etemp)
-		for ( k = 0 ; k < 4 ; k++ ) {
-
-			if ( k == 0 ) {
-				/* Sort the dihedrals. */
-				i = 0; j = nr_dihedrals-1;
-				while ( i < j ) {
-					while ( i < nr_dihedrals &&
-							s->partlist[e->dihedrals[i].i] != NULL &&
-							s->partlist[e->dihedrals[i].j] != NULL &&
-							s->partlist[e->dihedrals[i].k] != NULL &&
-							s->partlist[e->dihedrals[i].l] != NULL )
-						i += 1;
-					while ( j >= 0 &&
-							( s->partlist[e->dihedrals[j].i] == NULL ||
-									s->partlist[e->dihedrals[j].j] == NULL ||
-									s->partlist[e->dihedrals[j].k] == NULL ||
-									s->partlist[e->dihedrals[j].l] == NULL ) )
-						j -= 1;
-					if ( i < j ) {
-						dtemp = e->dihedrals[i];
-						e->dihedrals[i] = e->dihedrals[j];
-						e->dihedrals[j] = dtemp;
-					}
-				}
-				nr_dihedrals = i;
-			}
+	return engine_err_ok;
 
-			else if ( k == 1 ) {
-				/* Sort the angles. */
-				i = 0; j = nr_angles-1;
-				while ( i < j ) {
-					while ( i < nr_angles &&
-							s->partlist[e->angles[i].i] != NULL &&
-							s->partlist[e->angles[i].j] != NULL &&
-							s->partlist[e->angles[i].k] != NULL )
-						i += 1;
-					while ( j >= 0 &&
-							( s->partlist[e->angles[j].i] == NULL ||
-									s->partlist[e->angles[j].j] == NULL ||
-									s->partlist[e->angles[j].k] == NULL ) )
-						j -= 1;
-					if ( i < j ) {
-						atemp = e->angles[i];
-						e->angles[i] = e->angles[j];
-						e->angles[j] = atemp;
-					}
-				}
-				nr_angles = i;
-			}
+}
 
-			else if ( k == 2 ) {
-				/* Sort the bonds. */
-				i = 0; j = nr_bonds-1;
-				while ( i < j ) {
-					while ( i < nr_bonds &&
-							s->partlist[e->bonds[i].i] != NULL &&
-							s->partlist[e->bonds[i].j] != NULL )
-						i += 1;
-					while ( j >= 0 &&
-							( s->partlist[e->bonds[j].i] == NULL ||
-						      s->partlist[e->bonds[j].j] == NULL ))
-						j -= 1;
-					if ( i < j ) {
-						btemp = e->bonds[i];
-						e->bonds[i] = e->bonds[j];
-						e->bonds[j] = btemp;
-					}
-				}
-				nr_bonds = i;
+
+/**
+ * @brief Evaluate a list of bonded interactions of any kind.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction, e.g. #engine_bonded_bond.
+ * @param list The interactions.
+ * @param N The number of interactions.
+ * @param f A force buffer indexed by particle ID, or @c NULL to add the
+ *      forces to the particles directly.
+ * @param epot Where to add the potential energy.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ */
+
+static int engine_bonded_evalk ( struct engine *e , int kind , void *list , int N , FPTYPE *f , double *epot ) {
+
+	if ( N == 0 )
+		return engine_err_ok;
+
+	switch ( kind ) {
+		case engine_bonded_exclusion:
+			if ( ( f ? exclusion_evalf( (struct exclusion *)list , N , e , f , epot ) : exclusion_eval( (struct exclusion *)list , N , e , epot ) ) < 0 )
+				return error(engine_err_exclusion);
+			break;
+		case engine_bonded_bond:
+			if ( ( f ? bond_evalf( (struct bond *)list , N , e , f , epot ) : bond_eval( (struct bond *)list , N , e , epot ) ) < 0 )
+				return error(engine_err_bond);
+			break;
+		case engine_bonded_angle:
+			if ( ( f ? angle_evalf( (struct angle *)list , N , e , f , epot ) : angle_eval( (struct angle *)list , N , e , epot ) ) < 0 )
+				return error(engine_err_angle);
+			break;
+		case engine_bonded_dihedral:
+			if ( ( f ? dihedral_evalf( (struct dihedral *)list , N , e , f , epot ) : dihedral_eval( (struct dihedral *)list , N , e , epot ) ) < 0 )
+				return error(engine_err_dihedral);
+			break;
+		default:
+			return error(engine_err_range);
+	}
+
+	return engine_err_ok;
+
+}
+
+
+/** Free the runners' shares of the bonded interactions. */
+static void engine_bonded_shares_free ( struct engine *e ) {
+
+	int k, kind;
+
+	for ( k = 0 ; k < e->bonded_nr_shares ; k++ ) {
+		for ( kind = 0 ; kind < engine_bonded_last ; kind++ )
+			free( e->bonded_shares[k].edge[kind] );
+		free( e->bonded_shares[k].eff );
+	}
+	free( e->bonded_shares );
+	e->bonded_shares = NULL;
+	e->bonded_nr_shares = 0;
+
+}
+
+
+/**
+ * @brief Share the bonded interactions between the runners.
+ *
+ * @param e The #engine.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Cuts the Morton order of the cells into one contiguous range per
+ * #runner such that each gets about the same number of interactions
+ * starting in its cells. Since the interactions are sorted by the cell
+ * of their first particle (see #engine_bonded_sort), each #runner's
+ * share of each kind is a contiguous piece of the list.
+ */
+
+static int engine_bonded_split ( struct engine *e ) {
+
+	struct space *s = &e->s;
+	int nr_runners = e->nr_runners, kind, k, r, *rowner, *keys;
+	long long w, acc, total;
+
+	/* Make room for the runners' shares. */
+	if ( e->bonded_nr_shares != nr_runners ) {
+		engine_bonded_shares_free( e );
+		if ( ( e->bonded_shares = (struct engine_bonded_share *)calloc( nr_runners , sizeof(struct engine_bonded_share) ) ) == NULL )
+			return error(engine_err_malloc);
+		e->bonded_nr_shares = nr_runners;
+	}
+	free( e->bonded_owner );
+	if ( ( e->bonded_owner = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL ||
+		 ( rowner = (int *)calloc( s->nr_cells + 1 , sizeof(int) ) ) == NULL )
+		return error(engine_err_malloc);
+
+	/* Weigh the cells by the particles in the interactions starting
+	   in them. */
+	for ( total = 0 , kind = engine_bonded_bond ; kind < engine_bonded_last ; kind++ ) {
+		keys = e->bonded_keys[kind];
+		for ( k = 0 ; k < e->bonded_nr_local[kind] ; k++ )
+			if ( keys[k] >= 0 )
+				rowner[ keys[k] ] += engine_bonded_nrids[kind];
+		total += (long long)engine_bonded_nrids[kind] * e->bonded_nr_local[kind];
+	}
+
+	/* Cut the curve into even pieces, the owner of each rank is given by
+	   the weight before it. */
+	for ( acc = 0 , k = 0 ; k < s->nr_cells ; k++ ) {
+		w = rowner[k];
+		rowner[k] = ( total > 0 ) ? acc * nr_runners / total : 0;
+		if ( rowner[k] >= nr_runners )
+			rowner[k] = nr_runners - 1;
+		acc += w;
+	}
+	for ( k = 0 ; k < s->nr_cells ; k++ )
+		e->bonded_owner[k] = rowner[ e->bonded_rank[k] ];
+
+	/* Find the first interaction of each runner. */
+	for ( kind = engine_bonded_bond ; kind < engine_bonded_last ; kind++ ) {
+		free( e->bonded_first[kind] );
+		if ( ( e->bonded_first[kind] = (int *)malloc( sizeof(int) * ( nr_runners + 1 ) ) ) == NULL )
+			return error(engine_err_malloc);
+		keys = e->bonded_keys[kind];
+		for ( r = 0 , k = 0 ; k < e->bonded_nr_local[kind] ; k++ )
+			while ( keys[k] >= 0 && r <= rowner[ keys[k] ] )
+				e->bonded_first[kind][ r++ ] = k;
+		while ( r <= nr_runners )
+			e->bonded_first[kind][ r++ ] = e->bonded_nr_local[kind];
+	}
+
+	free( rowner );
+	e->bonded_split = 1;
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Runner phase evaluating the runner's share of the bonded
+ *      interactions.
+ *
+ * @param r The #runner.
+ * @param data Ignored.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The interactions with all their particles in the runner's own cells
+ * add their forces to the particles directly, no other runner touches
+ * them. The others are set aside and their forces go to the runner's
+ * #engine_bonded_share, to be collected by #engine_bonded_gather_phase.
+ * The potential energies of the bonds, angles and dihedrals are left in
+ * @c r->acc[1] to @c r->acc[3].
+ */
+
+static int engine_bonded_share_phase ( struct runner *r , void *data ) {
+
+	struct engine *e = r->e;
+	struct space *s = &e->s;
+	struct engine_bonded_share *sh = &e->bonded_shares[ r->id ];
+	int kind, k, j, run, first, last, size = 4 * s->size_parts, isize, nr_ids, *ids;
+	char *list, *edge;
+
+	/* The edge forces are kept zero between steps, see
+	   #engine_bonded_gather_phase. */
+	if ( sh->eff_size < size ) {
+		free( sh->eff );
+		if ( ( sh->eff = (FPTYPE *)calloc( size , sizeof(FPTYPE) ) ) == NULL )
+			return error(engine_err_malloc);
+		sh->eff_size = size;
+	}
+
+	for ( kind = engine_bonded_bond ; kind < engine_bonded_last ; kind++ ) {
+
+		r->acc[kind] = 0.0;
+		first = e->bonded_first[kind][ r->id ];
+		last = e->bonded_first[kind][ r->id + 1 ];
+		list = (char *)engine_bonded_list( e , kind );
+		isize = engine_bonded_size[kind];
+		nr_ids = engine_bonded_nrids[kind];
+
+		/* Make room for the interactions reaching beyond our cells. */
+		if ( sh->edge_size[kind] < last - first ) {
+			free( sh->edge[kind] );
+			sh->edge_size[kind] = ( last - first ) * 1.414 + 1;
+			if ( ( sh->edge[kind] = malloc( (size_t)isize * sh->edge_size[kind] ) ) == NULL )
+				return error(engine_err_malloc);
+		}
+		edge = (char *)sh->edge[kind];
+		sh->nr_edge[kind] = 0;
+
+		/* Evaluate runs of interactions in our own cells, set the
+		   others aside. */
+		for ( run = first , k = first ; k < last ; k++ ) {
+			ids = (int *)&list[ (size_t)k * isize ];
+			for ( j = 0 ; j < nr_ids && e->bonded_owner[ s->celllist[ ids[j] ] - s->cells ] == r->id ; j++ );
+			if ( j < nr_ids ) {
+				if ( engine_bonded_evalk( e , kind , &list[ (size_t)run * isize ] , k - run , NULL , &r->acc[kind] ) < 0 )
+					return error(engine_err);
+				memcpy( &edge[ (size_t)( sh->nr_edge[kind]++ ) * isize ] , ids , isize );
+				run = k + 1;
 			}
+		}
+		if ( engine_bonded_evalk( e , kind , &list[ (size_t)run * isize ] , last - run , NULL , &r->acc[kind] ) < 0 ||
+			 engine_bonded_evalk( e , kind , edge , sh->nr_edge[kind] , sh->eff , &r->acc[kind] ) < 0 )
+			return error(engine_err);
 
-			else if ( k == 3 ) {
-				/* Sort the exclusions. */
-				i = 0; j = nr_exclusions-1;
-				while ( i < j ) {
-					while ( i < nr_exclusions &&
-							s->partlist[e->exclusions[i].i] != NULL &&
-							s->partlist[e->exclusions[i].j] != NULL )
-						i += 1;
-					while ( j >= 0 &&
-							( s->partlist[e->exclusions[j].i] == NULL ||
-									s->partlist[e->exclusions[j].j] == NULL ) )
-						j -= 1;
-					if ( i < j ) {
-						etemp = e->exclusions[i];
-						e->exclusions[i] = e->exclusions[j];
-						e->exclusions[j] = etemp;
+	}
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Runner phase adding the forces of the interactions set aside by
+ *      #engine_bonded_share_phase to the particles in the runner's cells.
+ *
+ * @param r The #runner.
+ * @param data Ignored.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Each force is cleared once it has been added, so that the buffers are
+ * zero again for the next step without having to clear them in full.
+ */
+
+static int engine_bonded_gather_phase ( struct runner *r , void *data ) {
+
+	struct engine *e = r->e;
+	struct space *s = &e->s;
+	struct engine_bonded_share *sh;
+	struct MxParticle *p;
+	FPTYPE *eff;
+	int i, kind, k, j, m, size, nr_ids, *ids;
+
+	for ( i = 0 ; i < e->nr_runners ; i++ ) {
+		sh = &e->bonded_shares[i];
+		for ( kind = engine_bonded_bond ; kind < engine_bonded_last ; kind++ ) {
+			size = engine_bonded_size[kind];
+			nr_ids = engine_bonded_nrids[kind];
+			for ( k = 0 ; k < sh->nr_edge[kind] ; k++ ) {
+				ids = (int *)&( (char *)sh->edge[kind] )[ (size_t)k * size ];
+				for ( j = 0 ; j < nr_ids ; j++ )
+					if ( e->bonded_owner[ s->celllist[ ids[j] ] - s->cells ] == r->id ) {
+						p = s->partlist[ ids[j] ];
+						eff = &sh->eff[ 4*ids[j] ];
+						for ( m = 0 ; m < 3 ; m++ )
+							p->f[m] += eff[m];
+						for ( m = 0 ; m < 4 ; m++ )
+							eff[m] = 0.0;
 					}
-				}
-				nr_exclusions = i;
 			}
-
 		}
+	}
+
+	return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Compute all bonded interactions stored in this engine.
+ * 
+ * @param e The #engine.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Does the same as #engine_bond_eval, #engine_angle_eval and
+ * #engine_dihedral eval, yet all in one go to avoid excessive
+ * updates of the particle forces.
+ *
+ * With #engine_flag_parbonded or #engine_flag_sets, each #runner gets a contiguous range of
+ * cells along the Morton curve (see #engine_bonded_split) and evaluates
+ * the interactions starting in them. Only those reaching into the cells
+ * of another #runner go through a force buffer, so neither a conflict
+ * graph nor a full reduction over all particles is needed, and adding
+ * or removing interactions only costs a re-sort of the new ones.
+ */
+
+int engine_bonded_eval ( struct engine *e ) {
+
+	double epot_bond = 0.0, epot_angle = 0.0, epot_dihedral = 0.0;
+	struct space *s;
+	int nr_dihedrals = e->nr_dihedrals, nr_bonds = e->nr_bonds;
+	int nr_angles = e->nr_angles;
+	int k;
+	ticks tic;
+
+	/* Bail if there are no bonded interaction. The exclusions are
+	   skipped by the non-bonded kernels (see #engine_excluded). */
+	if ( nr_bonds == 0 && nr_angles == 0 && nr_dihedrals == 0 )
+		return engine_err_ok;
+
+	/* Get a handle on the space. */
+	s = &e->s;
 
-		/* Stop the clock. */
-		e->timers[engine_timer_bonded_sort] += getticks() - tic;
+	/* Sort them by cell, those not on this node last. */
+	if ( engine_bonded_sort( e ) < 0 )
+		return error(engine_err);
+	nr_bonds = e->bonded_nr_local[ engine_bonded_bond ];
+	nr_angles = e->bonded_nr_local[ engine_bonded_angle ];
+	nr_dihedrals = e->bonded_nr_local[ engine_bonded_dihedral ];
+
+
+	/* Share the work between the runners if asked to and worth it. */
+	if ( ( e->flags & ( engine_flag_parbonded | engine_flag_sets ) ) && e->runners != NULL && e->nr_runners > 1 &&
+		 nr_bonds + nr_angles + nr_dihedrals > e->nr_runners * engine_bonds_chunk ) {
+
+		/* Let each runner do the interactions in its cells, and then
+		   collect the forces of those reaching into the cells of others. */
+		if ( !e->bonded_split && engine_bonded_split( e ) < 0 )
+			return error(engine_err);
+		if ( engine_phase_run( e , engine_bonded_share_phase , NULL ) < 0 ||
+			 engine_phase_run( e , engine_bonded_gather_phase , NULL ) < 0 )
+			return error(engine_err);
+
+		/* Collect the potential energies. */
+		for ( k = 0 ; k < e->nr_runners ; k++ ) {
+			epot_bond += e->runners[k].acc[1];
+			epot_angle += e->runners[k].acc[2];
+			epot_dihedral += e->runners[k].acc[3];
+		}
 
 	}
 
+	else {
 
-	/* Do exclusions. */
-	tic = getticks();
-	if ( exclusion_eval( e->exclusions , nr_exclusions , e , &epot_exclusion ) < 0 )
-		return error(engine_err_exclusion);
-	e->timers[engine_timer_exclusions] += getticks() - tic;
+		/* Do bonds. */
+		tic = getticks();
+		if ( bond_eval( e->bonds , nr_bonds , e , &epot_bond ) < 0 )
+			return error(engine_err_bond);
+		e->timers[engine_timer_bonds] += getticks() - tic;
 
-	/* Do bonds. */
-	tic = getticks();
-	if ( bond_eval( e->bonds , nr_bonds , e , &epot_bond ) < 0 )
-		return error(engine_err_bond);
-	e->timers[engine_timer_bonds] += getticks() - tic;
+		/* Do angles. */
+		tic = getticks();
+		if ( angle_eval( e->angles , nr_angles , e , &epot_angle ) < 0 )
+			return error(engine_err_angle);
+		e->timers[engine_timer_angles] += getticks() - tic;
 
-	/* Do angles. */
-	tic = getticks();
-	if ( angle_eval( e->angles , nr_angles , e , &epot_angle ) < 0 )
-		return error(engine_err_angle);
-	e->timers[engine_timer_angles] += getticks() - tic;
+		/* Do dihedrals. */
+		tic = getticks();
+		if ( dihedral_eval( e->dihedrals , nr_dihedrals , e , &epot_dihedral ) < 0 )
+			return error(engine_err_dihedral);
+		e->timers[engine_timer_dihedrals] += getticks() - tic;
 
-	/* Do dihedrals. */
-	tic = getticks();
-	if ( dihedral_eval( e->dihedrals , nr_dihedrals , e , &epot_dihedral ) < 0 )
-		return error(engine_err_dihedral);
-	e->timers[engine_timer_dihedrals] += getticks() - tic;
+	}
 
 
 	/* Store the potential energy. */
-	s->epot += epot_bond + epot_angle + epot_dihedral + epot_exclusion;
+	s->epot += epot_bond + epot_angle + epot_dihedral;
 	s->epot_bond += epot_bond;
 	s->epot_angle += epot_angle;
 	s->epot_dihedral += epot_dihedral;
-	s->epot_exclusion += epot_exclusion;
 
 	/* I'll be back... */
 	return engine_err_ok;
@@ -1501,8 +2333,7 @@ int engine_dihedral_eval ( struct engine *e ) {
 
 	double epot = 0.0;
 	struct space *s;
-	struct dihedral temp;
-	int nr_dihedrals = e->nr_dihedrals, i, j;
+	int nr_dihedrals;
 #ifdef HAVE_OPENMP
 	FPTYPE *eff;
 	int nr_threads, cid, pid, gpid, k;
@@ -1514,30 +2345,10 @@ int engine_dihedral_eval ( struct engine *e ) {
 /* Get a handle on the space. */
 	s = &e->s;
 
-	/* Sort the dihedrals (if in parallel). */
-	if ( e->nr_nodes > 1 ) {
-		i = 0; j = nr_dihedrals-1;
-		while ( i < j ) {
-			while ( i < nr_dihedrals &&
-					s->partlist[e->dihedrals[i].i] != NULL &&
-					s->partlist[e->dihedrals[i].j] != NULL &&
-					s->partlist[e->dihedrals[i].k] != NULL &&
-					s->partlist[e->dihedrals[i].l] != NULL )
-				i += 1;
-			while ( j >= 0 &&
-					( s->partlist[e->dihedrals[j].i] == NULL ||
-							s->partlist[e->dihedrals[j].j] == NULL ||
-							s->partlist[e->dihedrals[j].k] == NULL ||
-							s->partlist[e->dihedrals[j].l] == NULL ) )
-				j -= 1;
-			if ( i < j ) {
-				temp = e->dihedrals[i];
-				e->dihedrals[i] = e->dihedrals[j];
-				e->dihedrals[j] = temp;
-			}
-		}
-		nr_dihedrals = i;
-	}
+	/* Sort them by cell, those not on this node last. */
+	if ( engine_bonded_sort( e ) < 0 )
+		return error(engine_err);
+	nr_dihedrals = e->bonded_nr_local[ engine_bonded_dihedral ];
 
 #ifdef HAVE_OPENMP
 
@@ -1608,8 +2419,7 @@ int engine_angle_eval ( struct engine *e ) {
 
 	double epot = 0.0;
 	struct space *s;
-	struct angle temp;
-	int nr_angles = e->nr_angles, i, j;
+	int nr_angles;
 #ifdef HAVE_OPENMP
 	FPTYPE *eff;
 	int nr_threads, cid, pid, gpid, k;
@@ -1621,28 +2431,10 @@ int engine_angle_eval ( struct engine *e ) {
 /* Get a handle on the space. */
 	s = &e->s;
 
-	/* Sort the angles (if in parallel). */
-	if ( e->nr_nodes > 1 ) {
-		i = 0; j = nr_angles-1;
-		while ( i < j ) {
-			while ( i < nr_angles &&
-					s->partlist[e->angles[i].i] != NULL &&
-					s->partlist[e->angles[i].j] != NULL &&
-					s->partlist[e->angles[i].k] != NULL )
-				i += 1;
-			while ( j >= 0 &&
-					( s->partlist[e->angles[j].i] == NULL ||
-							s->partlist[e->angles[j].j] == NULL ||
-							s->partlist[e->angles[j].k] == NULL ) )
-				j -= 1;
-			if ( i < j ) {
-				temp = e->angles[i];
-				e->angles[i] = e->angles[j];
-				e->angles[j] = temp;
-			}
-		}
-		nr_angles = i;
-	}
+	/* Sort them by cell, those not on this node last. */
+	if ( engine_bonded_sort( e ) < 0 )
+		return error(engine_err);
+	nr_angles = e->bonded_nr_local[ engine_bonded_angle ];
 
 #ifdef HAVE_OPENMP
 
@@ -1707,96 +2499,17 @@ int engine_angle_eval ( struct engine *e ) {
  * @param e The #engine.
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * The excluded pairs are skipped by the non-bonded kernels themselves
+ * (see #engine_excluded), so there is nothing left to subtract and this
+ * function only checks its input.
  */
 
 int engine_exclusion_eval ( struct engine *e ) {
 
-	double epot = 0.0;
-	struct space *s;
-	int nr_exclusions = e->nr_exclusions, i, j;
-	struct exclusion temp;
-#ifdef HAVE_OPENMP
-	FPTYPE *eff;
-	int nr_threads, cid, pid, gpid, k;
-	struct part *p;
-	struct cell *c;
-	double epot_local;
-#endif
-
-/* Get a handle on the space. */
-	s = &e->s;
-
-	/* Sort the exclusions (if in parallel). */
-	if ( e->nr_nodes > 1 ) {
-		i = 0; j = nr_exclusions-1;
-		while ( i < j ) {
-			while ( i < nr_exclusions &&
-					s->partlist[e->exclusions[i].i] != NULL &&
-					s->partlist[e->exclusions[i].j] != NULL )
-				i += 1;
-			while ( j >= 0 &&
-					( s->partlist[e->exclusions[j].i] == NULL ||
-							s->partlist[e->exclusions[j].j] == NULL ) )
-				j -= 1;
-			if ( i < j ) {
-				temp = e->exclusions[i];
-				e->exclusions[i] = e->exclusions[j];
-				e->exclusions[j] = temp;
-			}
-		}
-		nr_exclusions = i;
-	}
-
-#ifdef HAVE_OPENMP
-
-	/* Is it worth parallelizing? */
-#pragma omp parallel private(k,nr_threads,c,p,cid,pid,gpid,eff,epot_local)
-	if ( ( e->flags & engine_flag_parbonded ) &&
-			( ( nr_threads = omp_get_num_threads() ) > 1 ) &&
-			( nr_exclusions > engine_exclusions_chunk ) ) {
-
-		/* Init the local potential energy. */
-		epot_local = 0.0;
-
-		/* Allocate a buffer for the forces. */
-		eff = (FPTYPE *)malloc( sizeof(FPTYPE) * 4 * s->nr_parts );
-		bzero( eff , sizeof(FPTYPE) * 4 * s->nr_parts );
-
-		/* Compute the exclusioned interactions. */
-		k = omp_get_thread_num();
-		exclusion_evalf( &e->exclusions[k*nr_exclusions/nr_threads] , (k+1)*nr_exclusions/nr_threads - k*nr_exclusions/nr_threads , e , eff , &epot_local );
-
-		/* Write-back the forces (if anything was done). */
-		for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
-			c = &s->cells[ s->cid_real[cid] ];
-			pthread_mutex_lock( &c->cell_mutex );
-			for ( pid = 0 ; pid < c->count ; pid++ ) {
-				p = &c->parts[ pid ];
-				gpid = p->id;
-				for ( k = 0 ; k < 3 ; k++ )
-					p->f[k] += eff[ gpid*4 + k ];
-			}
-			pthread_mutex_unlock( &c->cell_mutex );
-		}
-		free( eff );
-
-		/* Aggregate the global potential energy. */
-#pragma omp atomic
-		epot += epot_local;
-
-	}
-
-	/* Otherwise, evaluate directly. */
-	else if ( omp_get_thread_num() == 0 )
-		exclusion_eval( e->exclusions , nr_exclusions , e , &epot );
-#else
-	if ( exclusion_eval( e->exclusions , nr_exclusions , e , &epot ) < 0 )
-		return error(engine_err_exclusion);
-#endif
-
-	/* Store the potential energy. */
-	s->epot += epot;
-	s->epot_exclusion += epot;
+	/* Check inputs. */
+	if ( e == NULL )
+		return error(engine_err_null);
 
 	/* I'll be back... */
 	return engine_err_ok;
@@ -1816,8 +2529,7 @@ int engine_bond_eval ( struct engine *e ) {
 
 	double epot = 0.0;
 	struct space *s;
-	int nr_bonds = e->nr_bonds, i, j;
-	struct bond temp;
+	int nr_bonds;
 #ifdef HAVE_OPENMP
 	FPTYPE *eff;
 	int nr_threads, cid, pid, gpid, k;
@@ -1829,26 +2541,10 @@ int engine_bond_eval ( struct engine *e ) {
 /* Get a handle on the space. */
 	s = &e->s;
 
-	/* Sort the bonds (if in parallel). */
-	if ( e->nr_nodes > 1 ) {
-		i = 0; j = nr_bonds-1;
-		while ( i < j ) {
-			while ( i < nr_bonds &&
-					s->partlist[e->bonds[i].i] != NULL &&
-					s->partlist[e->bonds[i].j] != NULL )
-				i += 1;
-			while ( j >= 0 &&
-					( s->partlist[e->bonds[j].i] == NULL ||
-							s->partlist[e->bonds[j].j] == NULL ) )
-				j -= 1;
-			if ( i < j ) {
-				temp = e->bonds[i];
-				e->bonds[i] = e->bonds[j];
-				e->bonds[j] = temp;
-			}
-		}
-		nr_bonds = i;
-	}
+	/* Sort them by cell, those not on this node last. */
+	if ( engine_bonded_sort( e ) < 0 )
+		return error(engine_err);
+	nr_bonds = e->bonded_nr_local[ engine_bonded_bond ];
 
 #ifdef HAVE_OPENMP
 
@@ -152,8 +152,8 @@ int engine_exchange_rigid ( struct engine *e ) {
     int counts[ e->nr_nodes ], next[ e->nr_nodes ];
     int totals_send[ e->nr_nodes ], totals_recv[ e->nr_nodes ];
     MPI_Request reqs_send[ e->nr_nodes ], reqs_recv[ e->nr_nodes ];
-    struct part *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ];
-    struct cell *c;
+    struct MxParticle *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ];
+    struct space_cell *c;
 
     /* Check the input. */
     if ( e == NULL )
@@ -189,7 +189,7 @@ int engine_exchange_rigid ( struct engine *e ) {
     /* Run through the cells again and fill the send buffers. */
     for ( i = 0 ; i < e->nr_nodes ; i++ )
         if ( e->send[i].count > 0 ) {
-            if ( ( buff_send[i] = (struct part *)malloc( sizeof(struct part) * totals_send[i] ) ) == NULL )
+            if ( ( buff_send[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_send[i] ) ) == NULL )
                 return error(engine_err_malloc);
             next[i] = 0;
             }
@@ -222,7 +222,7 @@ int engine_exchange_rigid ( struct engine *e ) {
             
             /* File a send. */
             /* printf( "engine_exchange[%i]: sending %i parts to node %i.\n" , e->nodeID , totals_send[i] , i ); */
-            res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct part) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send[i] );
+            res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct MxParticle) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send[i] );
             
             }
             
@@ -230,11 +230,11 @@ int engine_exchange_rigid ( struct engine *e ) {
         if ( e->recv[i].count > 0 ) {
     
             /* Allocate a buffer for the send and recv queues. */
-            buff_recv[i] = (struct part *)malloc( sizeof(struct part) * totals_recv[i] );
+            buff_recv[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_recv[i] );
 
             /* File a recv. */
             /* printf( "engine_exchange[%i]: recving %i parts from node %i.\n" , e->nodeID , totals_recv[i] , i ); */
-            res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct part) , MPI_BYTE , i , i , e->comm , &reqs_recv[i] );
+            res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct MxParticle) , MPI_BYTE , i , i , e->comm , &reqs_recv[i] );
             
             }
             
@@ -298,8 +298,8 @@ int engine_exchange_rigid_async_run ( struct engine *e ) {
     int counts[ e->nr_nodes ], next[ e->nr_nodes ];
     int totals_send[ e->nr_nodes ], totals_recv[ e->nr_nodes ];
     MPI_Request reqs_send[ e->nr_nodes ], reqs_recv[ e->nr_nodes ];
-    struct part *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ];
-    struct cell *c;
+    struct MxParticle *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ];
+    struct space_cell *c;
 
     /* Check the input. */
     if ( e == NULL )
@@ -314,7 +314,9 @@ int engine_exchange_rigid_async_run ( struct engine *e ) {
     /* Set the number of concurrent threads in this context. */
     for ( nr_neigh = 0, k = 0 ; k < e->nr_nodes ; k++ )
         nr_neigh += ( e->recv[k].count > 0 );
+#ifdef HAVE_OPENMP
     omp_set_num_threads( nr_neigh );
+#endif
         
     /* Start by acquiring the xchg_mutex. */
     if ( pthread_mutex_lock( &e->xchg2_mutex ) != 0 )
@@ -357,7 +359,7 @@ int engine_exchange_rigid_async_run ( struct engine *e ) {
         /* Run through the cells again and fill the send buffers. */
         for ( i = 0 ; i < e->nr_nodes ; i++ )
             if ( e->send[i].count > 0 ) {
-                if ( ( buff_send[i] = (struct part *)malloc( sizeof(struct part) * totals_send[i] ) ) == NULL )
+                if ( ( buff_send[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_send[i] ) ) == NULL )
                     return error(engine_err_malloc);
                 next[i] = 0;
                 }
@@ -390,7 +392,7 @@ int engine_exchange_rigid_async_run ( struct engine *e ) {
 
                 /* File a send. */
                 /* printf( "engine_exchange[%i]: sending %i parts to node %i.\n" , e->nodeID , totals_send[i] , i ); */
-                res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct part) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send[i] );
+                res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct MxParticle) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send[i] );
 
                 }
 
@@ -398,11 +400,11 @@ int engine_exchange_rigid_async_run ( struct engine *e ) {
             if ( e->recv[i].count > 0 ) {
 
                 /* Allocate a buffer for the send and recv queues. */
-                buff_recv[i] = (struct part *)malloc( sizeof(struct part) * totals_recv[i] );
+                buff_recv[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_recv[i] );
 
                 /* File a recv. */
                 /* printf( "engine_exchange[%i]: recving %i parts from node %i.\n" , e->nodeID , totals_recv[i] , i ); */
-                res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct part) , MPI_BYTE , i , i , e->comm , &reqs_recv[i] );
+                res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct MxParticle) , MPI_BYTE , i , i , e->comm , &reqs_recv[i] );
 
                 }
 
@@ -495,12 +497,12 @@ int engine_exchange_wait ( struct engine *e ) {
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * Starts a new thread which handles the particle exchange. At the
- * start of the exchange, ghost cells are marked in the taboo-list
- * and only freed once their data has been received.
+ * Starts a new thread which handles the particle exchange. The ghost
+ * cells are flushed and re-filled as their data comes in.
  *
  * The function #engine_exchange_wait can be used to wait for
- * the asynchronous communication to finish.
+ * the asynchronous communication to finish. Until then, #engine_nonbond_eval
+ * only runs the tasks that do not involve ghost cells.
  */
 
 #ifdef WITH_MPI 
@@ -511,8 +513,8 @@ int engine_exchange_async_run ( struct engine *e ) {
     int totals_send[ e->nr_nodes ], totals_recv[ e->nr_nodes ];
     MPI_Request reqs_send[ e->nr_nodes ], reqs_recv[ e->nr_nodes ];
     MPI_Request reqs_send2[ e->nr_nodes ], reqs_recv2[ e->nr_nodes ];
-    struct part *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ], *finger;
-    struct cell *c;
+    struct MxParticle *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ], *finger;
+    struct space_cell *c;
     struct space *s;
 
     /* Check the input. */
@@ -530,11 +532,6 @@ int engine_exchange_async_run ( struct engine *e ) {
         reqs_send2[k] = MPI_REQUEST_NULL;
         }
         
-    /* Set the number of concurrent threads in this context. */
-    for ( nr_neigh = 0, k = 0 ; k < e->nr_nodes ; k++ )
-        nr_neigh += ( e->recv[k].count > 0 );
-    omp_set_num_threads( nr_neigh );
-        
     /* Start by acquiring the xchg_mutex. */
     if ( pthread_mutex_lock( &e->xchg_mutex ) != 0 )
         return error(engine_err_pthread);
@@ -551,6 +548,14 @@ int engine_exchange_async_run ( struct engine *e ) {
         e->xchg_started = 0; e->xchg_running = 1;
         if ( pthread_cond_signal( &e->xchg_cond ) != 0 )
             return error(engine_err_pthread);
+
+        /* Set the number of concurrent threads in this context, the
+           recv lists may have changed since the last exchange. */
+        for ( nr_neigh = 0, k = 0 ; k < e->nr_nodes ; k++ )
+            nr_neigh += ( e->recv[k].count > 0 );
+#ifdef HAVE_OPENMP
+        omp_set_num_threads( nr_neigh );
+#endif
         
         /* Start by packing and sending/receiving a counts array for each send queue. */
         #pragma omp parallel for schedule(static), private(i,k)
@@ -602,18 +607,18 @@ int engine_exchange_async_run ( struct engine *e ) {
             if ( e->send[i].count > 0 ) {
 
                 /* Allocate a buffer for the send queue. */
-                buff_send[i] = (struct part *)malloc( sizeof(struct part) * totals_send[i] );
+                buff_send[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_send[i] );
 
                 /* Fill the send buffer. */
                 finger = buff_send[i];
                 for ( k = 0 ; k < e->send[i].count ; k++ ) {
                     c = &( s->cells[e->send[i].cellid[k]] );
-                    memcpy( finger , c->parts , sizeof(struct part) * c->count );
+                    memcpy( finger , c->parts , sizeof(struct MxParticle) * c->count );
                     finger = &( finger[ c->count ] );
                     }
 
                 /* File a send. */
-                MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct part) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send2[i] );
+                MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct MxParticle) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send2[i] );
                 /* printf( "engine_exchange[%i]: sending %i parts to node %i.\n" , e->nodeID , totals_send[i] , i ); */
 
                 }
@@ -627,10 +632,10 @@ int engine_exchange_async_run ( struct engine *e ) {
                     totals_recv[i] += counts_in[i][k];
 
                 /* Allocate a buffer for the send and recv queues. */
-                buff_recv[i] = (struct part *)malloc( sizeof(struct part) * totals_recv[i] );
+                buff_recv[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_recv[i] );
 
                 /* File a recv. */
-                MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct part) , MPI_BYTE , i , i , e->comm , &reqs_recv2[i] );
+                MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct MxParticle) , MPI_BYTE , i , i , e->comm , &reqs_recv2[i] );
                 /* printf( "engine_exchange[%i]: recving %i parts from node %i.\n" , e->nodeID , totals_recv[i] , i ); */
 
                 }
@@ -657,15 +662,7 @@ int engine_exchange_async_run ( struct engine *e ) {
                 for ( k = 0 ; k < e->recv[ind].count ; k++ ) {
                     cid = e->recv[ind].cellid[k];
                     c = &( s->cells[cid] );
-                    cell_load( c , finger , counts_in[ind][k] , s->partlist , s->celllist );
-                    
-                    /* Somewhat convoluted lock/signal/unlock dance to avoid
-                       blocking if all runners are waiting. */
-                    pthread_mutex_lock( &s->tasks_mutex );
-                    s->cells_taboo[ cid ] = 0;
-                    pthread_cond_broadcast( &s->tasks_avail );
-                    pthread_mutex_unlock( &s->tasks_mutex );
-                    
+                    space_cell_load( c , finger , counts_in[ind][k] , s->partlist , s->celllist );
                     finger = &( finger[ counts_in[ind][k] ] );
                     }
 
@@ -705,12 +702,12 @@ int engine_exchange_async_run ( struct engine *e ) {
  *
  * @return #engine_err_ok or < 0 on error (see #engine_err).
  *
- * Starts a new thread which handles the particle exchange. At the
- * start of the exchange, ghost cells are marked in the taboo-list
- * and only freed once their data has been received.
+ * Starts a new thread which handles the particle exchange. The ghost
+ * cells are flushed and re-filled as their data comes in.
  *
  * The function #engine_exchange_wait can be used to wait for
- * the asynchronous communication to finish.
+ * the asynchronous communication to finish. Until then, #engine_nonbond_eval
+ * only runs the tasks that do not involve ghost cells.
  */
 
 #ifdef WITH_MPI 
@@ -726,13 +723,14 @@ int engine_exchange_async ( struct engine *e ) {
     if ( !(e->flags & engine_flag_mpi) || e->nr_nodes <= 1 )
         return engine_err_ok;
         
-    /* Mark all the ghost cells as taboo and flush them. */
+    /* Flush the ghost cells, the tasks on them are held back until the
+       exchange is done. */
     for ( k = 0 ; k < e->s.nr_ghost ; k++ ) {
         cid = e->s.cid_ghost[k];
-        e->s.cells_taboo[ cid ] += 2;
-        if ( cell_flush( &e->s.cells[cid] , e->s.partlist , e->s.celllist ) < 0 )
+        if ( space_cell_flush( &e->s.cells[cid] , e->s.partlist , e->s.celllist ) < 0 )
             return error(engine_err_cell);
         }
+    e->s.parts_moved = 1;
             
     /* Get a hold of the exchange mutex. */
     if ( pthread_mutex_lock( &e->xchg_mutex ) != 0 )
@@ -771,8 +769,8 @@ int engine_exchange ( struct engine *e ) {
     int totals_send[ e->nr_nodes ], totals_recv[ e->nr_nodes ];
     MPI_Request reqs_send[ e->nr_nodes ], reqs_recv[ e->nr_nodes ];
     MPI_Request reqs_send2[ e->nr_nodes ], reqs_recv2[ e->nr_nodes ];
-    struct part *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ], *finger;
-    struct cell *c;
+    struct MxParticle *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ], *finger;
+    struct space_cell *c;
     struct space *s;
     
     /* Check the input. */
@@ -849,19 +847,19 @@ int engine_exchange ( struct engine *e ) {
         if ( e->send[i].count > 0 ) {
             
             /* Allocate a buffer for the send queue. */
-            buff_send[i] = (struct part *)malloc( sizeof(struct part) * totals_send[i] );
+            buff_send[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_send[i] );
 
             /* Fill the send buffer. */
             finger = buff_send[i];
             for ( k = 0 ; k < e->send[i].count ; k++ ) {
                 c = &( s->cells[e->send[i].cellid[k]] );
-                memcpy( finger , c->parts , sizeof(struct part) * c->count );
+                memcpy( finger , c->parts , sizeof(struct MxParticle) * c->count );
                 finger = &( finger[ c->count ] );
                 }
 
             /* File a send. */
             /* printf( "engine_exchange[%i]: sending %i parts to node %i.\n" , e->nodeID , totals_send[i] , i ); */
-            { res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct part) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send2[i] ); }
+            { res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct MxParticle) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send2[i] ); }
             
             }
             
@@ -874,11 +872,11 @@ int engine_exchange ( struct engine *e ) {
                 totals_recv[i] += counts_in[i][k];
 
             /* Allocate a buffer for the send and recv queues. */
-            buff_recv[i] = (struct part *)malloc( sizeof(struct part) * totals_recv[i] );
+            buff_recv[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_recv[i] );
 
             /* File a recv. */
             /* printf( "engine_exchange[%i]: recving %i parts from node %i.\n" , e->nodeID , totals_recv[i] , i ); */
-            { res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct part) , MPI_BYTE , i , i , e->comm , &reqs_recv2[i] ); }
+            { res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct MxParticle) , MPI_BYTE , i , i , e->comm , &reqs_recv2[i] ); }
             
             }
             
@@ -903,10 +901,11 @@ int engine_exchange ( struct engine *e ) {
             finger = buff_recv[ind];
             for ( k = 0 ; k < e->recv[ind].count ; k++ ) {
                 c = &( s->cells[e->recv[ind].cellid[k]] );
-                cell_flush( c , s->partlist , s->celllist );
-                cell_load( c , finger , counts_in[ind][k] , s->partlist , s->celllist );
+                space_cell_flush( c , s->partlist , s->celllist );
+                space_cell_load( c , finger , counts_in[ind][k] , s->partlist , s->celllist );
                 finger = &( finger[ counts_in[ind][k] ] );
                 }
+            s->parts_moved = 1;
                 
             }
                 
@@ -942,7 +941,7 @@ int engine_exchange ( struct engine *e ) {
         /* Welcome the parts into the respective cells. */
         #pragma omp parallel for schedule(static), private(i)
         for ( i = 0 ; i < s->nr_marked ; i++ )
-            cell_welcome( &( s->cells[ s->cid_marked[i] ] ) , s->partlist );
+            space_cell_welcome( &( s->cells[ s->cid_marked[i] ] ) , s->partlist );
     
         }
             
@@ -970,8 +969,8 @@ int engine_exchange_incomming ( struct engine *e ) {
     int totals_send[ e->nr_nodes ], totals_recv[ e->nr_nodes ];
     MPI_Request reqs_send[ e->nr_nodes ], reqs_recv[ e->nr_nodes ];
     MPI_Request reqs_send2[ e->nr_nodes ], reqs_recv2[ e->nr_nodes ];
-    struct part *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ], *finger;
-    struct cell *c;
+    struct MxParticle *buff_send[ e->nr_nodes ], *buff_recv[ e->nr_nodes ], *finger;
+    struct space_cell *c;
     struct space *s;
     
     /* Check the input. */
@@ -1048,19 +1047,19 @@ int engine_exchange_incomming ( struct engine *e ) {
         if ( e->recv[i].count > 0 ) {
             
             /* Allocate a buffer for the send queue. */
-            buff_send[i] = (struct part *)malloc( sizeof(struct part) * totals_send[i] );
+            buff_send[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_send[i] );
 
             /* Fill the send buffer. */
             finger = buff_send[i];
             for ( k = 0 ; k < e->recv[i].count ; k++ ) {
                 c = &( s->cells[e->recv[i].cellid[k]] );
-                memcpy( finger , c->incomming , sizeof(struct part) * c->incomming_count );
+                memcpy( finger , c->incomming , sizeof(struct MxParticle) * c->incomming_count );
                 finger = &( finger[ c->incomming_count ] );
                 }
 
             /* File a send. */
             /* printf( "engine_exchange[%i]: sending %i parts to node %i.\n" , e->nodeID , totals_send[i] , i ); */
-            { res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct part) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send2[i] ); }
+            { res = MPI_Isend( buff_send[i] , totals_send[i]*sizeof(struct MxParticle) , MPI_BYTE , i , e->nodeID , e->comm , &reqs_send2[i] ); }
             
             }
             
@@ -1073,11 +1072,11 @@ int engine_exchange_incomming ( struct engine *e ) {
                 totals_recv[i] += counts_in[i][k];
 
             /* Allocate a buffer for the send and recv queues. */
-            buff_recv[i] = (struct part *)malloc( sizeof(struct part) * totals_recv[i] );
+            buff_recv[i] = (struct MxParticle *)malloc( sizeof(struct MxParticle) * totals_recv[i] );
 
             /* File a recv. */
             /* printf( "engine_exchange[%i]: recving %i parts from node %i.\n" , e->nodeID , totals_recv[i] , i ); */
-            { res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct part) , MPI_BYTE , i , i , e->comm , &reqs_recv2[i] ); }
+            { res = MPI_Irecv( buff_recv[i] , totals_recv[i]*sizeof(struct MxParticle) , MPI_BYTE , i , i , e->comm , &reqs_recv2[i] ); }
             
             }
             
@@ -1103,12 +1102,13 @@ int engine_exchange_incomming ( struct engine *e ) {
             for ( k = 0 ; k < e->send[ind].count ; k++ ) {
                 c = &( s->cells[e->send[ind].cellid[k]] );
                 pthread_mutex_lock( &c->cell_mutex );
-                cell_add_incomming_multiple( c , finger , counts_in[ind][k] );
+                space_cell_add_incomming_multiple( c , finger , counts_in[ind][k] );
                 pthread_mutex_unlock( &c->cell_mutex );
                 for ( j = 0 ; j < counts_in[ind][k] ; j++ )
                     e->s.celllist[ finger[j].id ] = c;
                 finger = &( finger[ counts_in[ind][k] ] );
                 }
+            e->s.parts_moved = 1;
                 
             }
                 
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* This file contains the check for excluded pairs used by the non-bonded
+   kernels, see #engine_exclusion_add. It is kept out of engine.h since it
+   needs the full particle and exclusion structures. */
+
+#ifndef SRC_ENGINE_EXCLUDED_H_
+#define SRC_ENGINE_EXCLUDED_H_
+
+#include <MxParticle.h>
+#include "exclusion.h"
+#include "engine.h"
+
+
+/**
+ * @brief Check if the non-bonded interaction between two particles is
+ *      excluded.
+ *
+ * @param e The #engine.
+ * @param pi The first #part.
+ * @param pj The second #part.
+ *
+ * @return 1 if there is an exclusion between @c pi and @c pj, 0 otherwise.
+ *
+ * Only particles with #PARTICLE_FLAG_EXCLUDED set are part of any
+ * exclusion, so most pairs are decided by their flags alone. Otherwise,
+ * the exclusions of @c pi are looked up in its list of exclusions (see
+ * #engine_bonded_adjacent), which is kept up to date by
+ * #engine_exclusion_add and #engine_bonded_remove.
+ */
+inline static int engine_excluded ( struct engine *e , struct MxParticle *pi , struct MxParticle *pj ) {
+
+	int l, pid = pi->id, pjd = pj->id;
+	struct exclusion *ex;
+
+	if ( !( pi->flags & pj->flags & PARTICLE_FLAG_EXCLUDED ) || pid >= e->bonded_head_size[ engine_bonded_exclusion ] )
+		return 0;
+
+	/* Link 4*handle+j is the j-th particle of the exclusion. */
+	for ( l = e->bonded_head[ engine_bonded_exclusion ][ pid ] ; l >= 0 ; l = e->bonded_next[ engine_bonded_exclusion ][ l ] ) {
+		ex = &e->exclusions[ e->bonded_pos[ engine_bonded_exclusion ][ l/4 ] ];
+		if ( ( ( l & 3 ) ? ex->i : ex->j ) == pjd )
+			return 1;
+	}
+
+	return 0;
+
+}
+
+
+#endif // SRC_ENGINE_EXCLUDED_H_
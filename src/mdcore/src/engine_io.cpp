@@ -147,8 +147,8 @@ int engine_read_xplor ( struct engine *e , int xplor , double kappa , double tol
                             return error(engine_err);
 
                         /* Remove this bond. */
-                        e->nr_bonds -= 1;
-                        e->bonds[k] = e->bonds[e->nr_bonds];
+                        if ( engine_bonded_remove( e , engine_bonded_bond , e->bonded_hid[engine_bonded_bond][k] ) < 0 )
+                            return error(engine_err);
                         k -= 1;
 
                         }
@@ -706,8 +706,8 @@ int engine_read_cpf ( struct engine *e , int cpf , double kappa , double tol , i
                         return error(engine_err);
                         
                     /* Remove this bond. */
-                    e->nr_bonds -= 1;
-                    e->bonds[k] = e->bonds[e->nr_bonds];
+                    if ( engine_bonded_remove( e , engine_bonded_bond , e->bonded_hid[engine_bonded_bond][k] ) < 0 )
+                        return error(engine_err);
                     k -= 1;
                     
                     }
@@ -408,8 +408,8 @@ int exclusion_evalf ( struct exclusion *b , int N , struct engine *e , FPTYPE *f
             /* update the forces */
             for ( k = 0 ; k < 3 ; k++ ) {
                 w = eff * dx[k];
-                f[ 4*pid + k ] -= w;
-                f[ 4*pjd + k ] += w;
+                f[ 4*pid + k ] += w;
+                f[ 4*pjd + k ] -= w;
                 }
 
             /* tabulate the energy */
@@ -220,6 +220,124 @@ __attribute__ ((always_inline)) INLINE void potential_eval_expl ( struct MxPoten
     }
 
 
+/**
+ * @brief The closed forms of the analytic potential kinds.
+ *
+ * @c eval computes the energy @c v and its first two derivatives @c dv and
+ * @c ddv at the radius @c r from the parameters @c q of the #potential.
+ * It is written for any arithmetic type @c T, such that the same code is
+ * used for @c FPTYPE and for the SIMD vector types.
+ */
+
+template <int kind> struct potential_closed;
+
+/** @f$ A/r^{12} - B/r^6 @f$, with @c q = { A , B }. */
+template <> struct potential_closed<potential_kind_LJ126> {
+    template <typename T> __attribute__ ((always_inline)) static inline void eval ( const T *q , T r , T *v , T *dv , T *ddv ) {
+        T ir = 1.0f / r, ir2 = ir * ir, ir6 = ir2 * ir2 * ir2;
+        T a12 = q[0] * ir6 * ir6, b6 = q[1] * ir6;
+        *v = a12 - b6;
+        *dv = ( 6.0f * b6 - 12.0f * a12 ) * ir;
+        *ddv = ( 156.0f * a12 - 42.0f * b6 ) * ir2;
+        }
+    };
+
+/** @f$ q (1/r - 1/b) @f$, with @c q = { q , 1/b }, the charge already scaled. */
+template <> struct potential_closed<potential_kind_Coulomb> {
+    template <typename T> __attribute__ ((always_inline)) static inline void eval ( const T *q , T r , T *v , T *dv , T *ddv ) {
+        T ir = 1.0f / r, qir2 = q[0] * ir * ir;
+        *v = q[0] * ( ir - q[1] );
+        *dv = -qir2;
+        *ddv = 2.0f * qir2 * ir;
+        }
+    };
+
+/** @f$ K (r - r_0)^2 @f$, with @c q = { K , r_0 }. */
+template <> struct potential_closed<potential_kind_harmonic> {
+    template <typename T> __attribute__ ((always_inline)) static inline void eval ( const T *q , T r , T *v , T *dv , T *ddv ) {
+        T d = r - q[1];
+        *v = q[0] * d * d;
+        *dv = 2.0f * q[0] * d;
+        *ddv = 2.0f * q[0];
+        }
+    };
+
+
+/**
+ * @brief Evaluates a closed form with its quadratic extension below @c a.
+ *
+ * @param q The parameters of the closed form.
+ * @param r The radius.
+ * @param ra The radius clamped to the smallest radius @c a, i.e.
+ *      @f$\max(r,a)@f$.
+ * @param e Pointer to the interaction energy.
+ * @param f Pointer to the magnitude of the interaction force divided by r.
+ */
+
+template <int kind, typename T> __attribute__ ((always_inline)) inline void potential_closed_eval ( const T *q , T r , T ra , T *e , T *f ) {
+
+    T v, dv, ddv, d = r - ra;
+
+    potential_closed<kind>::eval( q , ra , &v , &dv , &ddv );
+    *e = v + d * ( dv + 0.5f * d * ddv );
+    *f = ( dv + d * ddv ) / r;
+
+    }
+
+
+/**
+ * @brief Evaluates the given potential at the given point, using the
+ *      closed form @c kind instead of the table.
+ *
+ * @param p The #potential to be evaluated, of kind @c kind.
+ * @param r2 The radius at which it is to be evaluated, squared.
+ * @param e Pointer to a floating-point value in which to store the
+ *      interaction energy.
+ * @param f Pointer to a floating-point value in which to store the
+ *      magnitude of the interaction force divided by r.
+ *
+ * The pair kernels are instantiated once per kind and pick the instance
+ * once per task, see #potential_kind_dispatch, such that no interaction
+ * pays for the choice. For #potential_kind_table this is just
+ * #potential_eval.
+ */
+
+template <int kind> __attribute__ ((always_inline)) inline void potential_eval_kind ( struct MxPotential *p , FPTYPE r2 , FPTYPE *e , FPTYPE *f ) {
+
+    FPTYPE r = FPTYPE_SQRT( r2 );
+
+    potential_closed_eval<kind>( p->params , r , FPTYPE_FMAX( r , p->params[3] ) , e , f );
+
+    }
+
+template <> __attribute__ ((always_inline)) inline void potential_eval_kind<potential_kind_table> ( struct MxPotential *p , FPTYPE r2 , FPTYPE *e , FPTYPE *f ) {
+
+#ifdef EXPLICIT_POTENTIALS
+    potential_eval_expl( p , r2 , e , f );
+#else
+    potential_eval( p , r2 , e , f );
+#endif
+
+    }
+
+
+/**
+ * @brief Return the instance of a kernel template for the given potential kind.
+ *
+ * @param kind One of the potential kinds, anything unknown uses the table.
+ * @param fun The kernel template, taking the kind as its only argument.
+ * @param args The parenthesized arguments of the kernel.
+ */
+
+#define potential_kind_dispatch(kind,fun,args) \
+    switch ( kind ) { \
+        case potential_kind_LJ126: return fun<potential_kind_LJ126> args; \
+        case potential_kind_Coulomb: return fun<potential_kind_Coulomb> args; \
+        case potential_kind_harmonic: return fun<potential_kind_harmonic> args; \
+        default: return fun<potential_kind_table> args; \
+        }
+
+
 /** 
  * @brief Evaluates the given potential at a set of points (interpolated).
  *
@@ -1483,3 +1601,374 @@ __attribute__ ((always_inline)) INLINE void potential_eval_vec_4double_r ( struc
     }
 
 
+
+
+
+#if defined(__x86_64__) && defined(__GNUC__) && defined(FPTYPE_SINGLE)
+
+/**
+ * @brief Load the interval transform coefficients of eight potentials,
+ *      transposed such that @c alpha0 contains the @c alpha[0] of each.
+ */
+
+__attribute__ ((always_inline,target("avx2,fma"))) INLINE void potential_alpha_8single_avx2 ( struct MxPotential **p , __m256 *alpha0 , __m256 *alpha1 , __m256 *alpha2 ) {
+
+    __m256 r0, r1, r2, r3, t0, t1, t2, t3;
+
+    r0 = _mm256_set_m128( _mm_loadu_ps( p[4]->alpha ) , _mm_loadu_ps( p[0]->alpha ) );
+    r1 = _mm256_set_m128( _mm_loadu_ps( p[5]->alpha ) , _mm_loadu_ps( p[1]->alpha ) );
+    r2 = _mm256_set_m128( _mm_loadu_ps( p[6]->alpha ) , _mm_loadu_ps( p[2]->alpha ) );
+    r3 = _mm256_set_m128( _mm_loadu_ps( p[7]->alpha ) , _mm_loadu_ps( p[3]->alpha ) );
+    t0 = _mm256_unpacklo_ps( r0 , r1 );
+    t1 = _mm256_unpacklo_ps( r2 , r3 );
+    t2 = _mm256_unpackhi_ps( r0 , r1 );
+    t3 = _mm256_unpackhi_ps( r2 , r3 );
+    *alpha0 = _mm256_shuffle_ps( t0 , t1 , 0x44 );
+    *alpha1 = _mm256_shuffle_ps( t0 , t1 , 0xee );
+    *alpha2 = _mm256_shuffle_ps( t2 , t3 , 0x44 );
+
+    }
+
+
+/**
+ * @brief Load the eight interval coefficients pointed to by each entry of
+ *      @c data, transposed such that @c c[k] contains the k-th coefficient
+ *      of each interval.
+ *
+ * This is an 8x8 transpose and thus requires @c potential_chunk to be 8.
+ */
+
+__attribute__ ((always_inline,target("avx2,fma"))) INLINE void potential_coeffs_8single_avx2 ( FPTYPE **data , __m256 *c ) {
+
+    __m256 t0, t1, t2, t3, t4, t5, t6, t7, s0, s1, s2, s3, s4, s5, s6, s7;
+
+    static_assert( potential_chunk == 8 , "potential_coeffs_8single_avx2 assumes potential_chunk == 8." );
+
+    t0 = _mm256_loadu_ps( data[0] ); t1 = _mm256_loadu_ps( data[1] );
+    t2 = _mm256_loadu_ps( data[2] ); t3 = _mm256_loadu_ps( data[3] );
+    t4 = _mm256_loadu_ps( data[4] ); t5 = _mm256_loadu_ps( data[5] );
+    t6 = _mm256_loadu_ps( data[6] ); t7 = _mm256_loadu_ps( data[7] );
+    s0 = _mm256_unpacklo_ps( t0 , t1 ); s1 = _mm256_unpackhi_ps( t0 , t1 );
+    s2 = _mm256_unpacklo_ps( t2 , t3 ); s3 = _mm256_unpackhi_ps( t2 , t3 );
+    s4 = _mm256_unpacklo_ps( t4 , t5 ); s5 = _mm256_unpackhi_ps( t4 , t5 );
+    s6 = _mm256_unpacklo_ps( t6 , t7 ); s7 = _mm256_unpackhi_ps( t6 , t7 );
+    t0 = _mm256_shuffle_ps( s0 , s2 , 0x44 ); t1 = _mm256_shuffle_ps( s0 , s2 , 0xee );
+    t2 = _mm256_shuffle_ps( s1 , s3 , 0x44 ); t3 = _mm256_shuffle_ps( s1 , s3 , 0xee );
+    t4 = _mm256_shuffle_ps( s4 , s6 , 0x44 ); t5 = _mm256_shuffle_ps( s4 , s6 , 0xee );
+    t6 = _mm256_shuffle_ps( s5 , s7 , 0x44 ); t7 = _mm256_shuffle_ps( s5 , s7 , 0xee );
+    c[0] = _mm256_permute2f128_ps( t0 , t4 , 0x20 ); c[4] = _mm256_permute2f128_ps( t0 , t4 , 0x31 );
+    c[1] = _mm256_permute2f128_ps( t1 , t5 , 0x20 ); c[5] = _mm256_permute2f128_ps( t1 , t5 , 0x31 );
+    c[2] = _mm256_permute2f128_ps( t2 , t6 , 0x20 ); c[6] = _mm256_permute2f128_ps( t2 , t6 , 0x31 );
+    c[3] = _mm256_permute2f128_ps( t3 , t7 , 0x20 ); c[7] = _mm256_permute2f128_ps( t3 , t7 , 0x31 );
+
+    }
+
+
+/** 
+ * @brief Evaluates the given potential at a set of points (interpolated).
+ *
+ * @param p Pointer to an array of pointers to the #potentials to be evaluated.
+ * @param r2 Pointer to an array of the radii at which the potentials
+ *      are to be evaluated, squared.
+ * @param e Pointer to an array of floating-point values in which to store the
+ *      interaction energies.
+ * @param f Pointer to an array of floating-point values in which to store the
+ *      magnitude of the interaction forces.
+ *
+ * Computes eight single-precision interactions simultaneously using AVX2
+ * and FMA. The table intervals are loaded whole and transposed in registers.
+ *
+ * The caller has to make sure that the CPU supports AVX2 and FMA, e.g. via
+ * #runner_simd_detect, and that every entry of @c p is a valid potential.
+ */
+
+__attribute__ ((always_inline,target("avx2,fma"))) INLINE void potential_eval_vec_8single_avx2 ( struct MxPotential *p[8] , float *r2 , float *e , float *f ) {
+
+    int j;
+    int ind[8] __attribute__ ((aligned (32)));
+    FPTYPE *data[8];
+    __m256 r, alpha0, alpha1, alpha2, x, ee, eff, c[8];
+
+    /* Get r . */
+    r = _mm256_sqrt_ps( _mm256_loadu_ps( r2 ) );
+
+    /* compute the index */
+    potential_alpha_8single_avx2( p , &alpha0 , &alpha1 , &alpha2 );
+    _mm256_store_si256( (__m256i *)ind , _mm256_cvttps_epi32( _mm256_max_ps( _mm256_setzero_ps() , _mm256_fmadd_ps( r , _mm256_fmadd_ps( r , alpha2 , alpha1 ) , alpha0 ) ) ) );
+
+    /* get the table offset */
+    for ( j = 0 ; j < 8 ; j++ )
+        data[j] = &( p[j]->c[ ind[j] * potential_chunk ] );
+    potential_coeffs_8single_avx2( data , c );
+
+    /* adjust x to the interval */
+    x = _mm256_mul_ps( _mm256_sub_ps( r , c[0] ) , c[1] );
+
+    /* compute the potential and its derivative */
+    eff = c[2];
+    ee = _mm256_fmadd_ps( eff , x , c[3] );
+    for ( j = 4 ; j < potential_chunk ; j++ ) {
+        eff = _mm256_fmadd_ps( eff , x , ee );
+        ee = _mm256_fmadd_ps( ee , x , c[j] );
+        }
+
+    /* store the result */
+    _mm256_storeu_ps( e , ee );
+    _mm256_storeu_ps( f , _mm256_mul_ps( eff , _mm256_div_ps( c[1] , r ) ) );
+
+    }
+
+
+/**
+ * @brief Evaluates the given potential at a set of points (interpolated).
+ *
+ * @param p Pointer to an array of pointers to the #potentials to be evaluated.
+ * @param r_in Pointer to an array of the points at which the potentials
+ *      are to be evaluated.
+ * @param e Pointer to an array of floating-point values in which to store the
+ *      interaction energies.
+ * @param f Pointer to an array of floating-point values in which to store the
+ *      magnitude of the interaction forces.
+ *
+ * Same as #potential_eval_vec_8single_avx2, but for potentials of the
+ * unsquared argument such as the angle and dihedral cosines, as in
+ * #potential_eval_r.
+ */
+
+__attribute__ ((always_inline,target("avx2,fma"))) INLINE void potential_eval_vec_8single_r_avx2 ( struct MxPotential *p[8] , float *r_in , float *e , float *f ) {
+
+    int j;
+    int ind[8] __attribute__ ((aligned (32)));
+    FPTYPE *data[8];
+    __m256 r, alpha0, alpha1, alpha2, x, ee, eff, c[8];
+
+    /* Get r . */
+    r = _mm256_loadu_ps( r_in );
+
+    /* compute the index */
+    potential_alpha_8single_avx2( p , &alpha0 , &alpha1 , &alpha2 );
+    _mm256_store_si256( (__m256i *)ind , _mm256_cvttps_epi32( _mm256_max_ps( _mm256_setzero_ps() , _mm256_fmadd_ps( r , _mm256_fmadd_ps( r , alpha2 , alpha1 ) , alpha0 ) ) ) );
+
+    /* get the table offset */
+    for ( j = 0 ; j < 8 ; j++ )
+        data[j] = &( p[j]->c[ ind[j] * potential_chunk ] );
+    potential_coeffs_8single_avx2( data , c );
+
+    /* adjust x to the interval */
+    x = _mm256_mul_ps( _mm256_sub_ps( r , c[0] ) , c[1] );
+
+    /* compute the potential and its derivative */
+    eff = c[2];
+    ee = _mm256_fmadd_ps( eff , x , c[3] );
+    for ( j = 4 ; j < potential_chunk ; j++ ) {
+        eff = _mm256_fmadd_ps( eff , x , ee );
+        ee = _mm256_fmadd_ps( ee , x , c[j] );
+        }
+
+    /* store the result */
+    _mm256_storeu_ps( e , ee );
+    _mm256_storeu_ps( f , _mm256_mul_ps( eff , c[1] ) );
+
+    }
+
+
+/* Concatenate two AVX registers into an AVX-512 register. */
+#define potential_concat_16single_avx512(lo,hi) \
+    _mm512_castpd_ps( _mm512_insertf64x4( _mm512_castps_pd( _mm512_castps256_ps512( lo ) ) , _mm256_castps_pd( hi ) , 1 ) )
+
+
+/** 
+ * @brief Evaluates the given potential at a set of points (interpolated).
+ *
+ * @param p Pointer to an array of pointers to the #potentials to be evaluated.
+ * @param r2 Pointer to an array of the radii at which the potentials
+ *      are to be evaluated, squared.
+ * @param e Pointer to an array of floating-point values in which to store the
+ *      interaction energies.
+ * @param f Pointer to an array of floating-point values in which to store the
+ *      magnitude of the interaction forces.
+ *
+ * Computes sixteen single-precision interactions simultaneously using
+ * AVX-512.
+ *
+ * The caller has to make sure that the CPU supports AVX-512F, e.g. via
+ * #runner_simd_detect, and that every entry of @c p is a valid potential.
+ */
+
+__attribute__ ((always_inline,target("avx512f,avx2,fma"))) INLINE void potential_eval_vec_16single_avx512 ( struct MxPotential *p[16] , float *r2 , float *e , float *f ) {
+
+    int j;
+    int ind[16] __attribute__ ((aligned (64)));
+    FPTYPE *data[16];
+    __m256 alo[3], ahi[3], clo[8], chi[8];
+    __m512 r, x, ee, eff, c[8];
+
+    /* Get r . */
+    r = _mm512_sqrt_ps( _mm512_loadu_ps( r2 ) );
+
+    /* compute the index */
+    potential_alpha_8single_avx2( &p[0] , &alo[0] , &alo[1] , &alo[2] );
+    potential_alpha_8single_avx2( &p[8] , &ahi[0] , &ahi[1] , &ahi[2] );
+    _mm512_store_si512( ind , _mm512_cvttps_epi32( _mm512_max_ps( _mm512_setzero_ps() ,
+        _mm512_fmadd_ps( r , _mm512_fmadd_ps( r , potential_concat_16single_avx512( alo[2] , ahi[2] ) , potential_concat_16single_avx512( alo[1] , ahi[1] ) ) ,
+                         potential_concat_16single_avx512( alo[0] , ahi[0] ) ) ) ) );
+
+    /* get the table offset */
+    for ( j = 0 ; j < 16 ; j++ )
+        data[j] = &( p[j]->c[ ind[j] * potential_chunk ] );
+    potential_coeffs_8single_avx2( &data[0] , clo );
+    potential_coeffs_8single_avx2( &data[8] , chi );
+    for ( j = 0 ; j < potential_chunk ; j++ )
+        c[j] = potential_concat_16single_avx512( clo[j] , chi[j] );
+
+    /* adjust x to the interval */
+    x = _mm512_mul_ps( _mm512_sub_ps( r , c[0] ) , c[1] );
+
+    /* compute the potential and its derivative */
+    eff = c[2];
+    ee = _mm512_fmadd_ps( eff , x , c[3] );
+    for ( j = 4 ; j < potential_chunk ; j++ ) {
+        eff = _mm512_fmadd_ps( eff , x , ee );
+        ee = _mm512_fmadd_ps( ee , x , c[j] );
+        }
+
+    /* store the result */
+    _mm512_storeu_ps( e , ee );
+    _mm512_storeu_ps( f , _mm512_mul_ps( eff , _mm512_div_ps( c[1] , r ) ) );
+
+    }
+
+
+/**
+ * @brief Evaluates the given potential at a set of points (interpolated).
+ *
+ * Same as #potential_eval_vec_8single_r_avx2, but sixteen wide.
+ */
+
+__attribute__ ((always_inline,target("avx512f,avx2,fma"))) INLINE void potential_eval_vec_16single_r_avx512 ( struct MxPotential *p[16] , float *r_in , float *e , float *f ) {
+
+    int j;
+    int ind[16] __attribute__ ((aligned (64)));
+    FPTYPE *data[16];
+    __m256 alo[3], ahi[3], clo[8], chi[8];
+    __m512 r, x, ee, eff, c[8];
+
+    /* Get r . */
+    r = _mm512_loadu_ps( r_in );
+
+    /* compute the index */
+    potential_alpha_8single_avx2( &p[0] , &alo[0] , &alo[1] , &alo[2] );
+    potential_alpha_8single_avx2( &p[8] , &ahi[0] , &ahi[1] , &ahi[2] );
+    _mm512_store_si512( ind , _mm512_cvttps_epi32( _mm512_max_ps( _mm512_setzero_ps() ,
+        _mm512_fmadd_ps( r , _mm512_fmadd_ps( r , potential_concat_16single_avx512( alo[2] , ahi[2] ) , potential_concat_16single_avx512( alo[1] , ahi[1] ) ) ,
+                         potential_concat_16single_avx512( alo[0] , ahi[0] ) ) ) ) );
+
+    /* get the table offset */
+    for ( j = 0 ; j < 16 ; j++ )
+        data[j] = &( p[j]->c[ ind[j] * potential_chunk ] );
+    potential_coeffs_8single_avx2( &data[0] , clo );
+    potential_coeffs_8single_avx2( &data[8] , chi );
+    for ( j = 0 ; j < potential_chunk ; j++ )
+        c[j] = potential_concat_16single_avx512( clo[j] , chi[j] );
+
+    /* adjust x to the interval */
+    x = _mm512_mul_ps( _mm512_sub_ps( r , c[0] ) , c[1] );
+
+    /* compute the potential and its derivative */
+    eff = c[2];
+    ee = _mm512_fmadd_ps( eff , x , c[3] );
+    for ( j = 4 ; j < potential_chunk ; j++ ) {
+        eff = _mm512_fmadd_ps( eff , x , ee );
+        ee = _mm512_fmadd_ps( ee , x , c[j] );
+        }
+
+    /* store the result */
+    _mm512_storeu_ps( e , ee );
+    _mm512_storeu_ps( f , _mm512_mul_ps( eff , c[1] ) );
+
+    }
+
+/**
+ * @brief Load the closed-form parameters of eight potentials, transposed
+ *      such that @c q[k] contains the @c params[k] of each.
+ */
+
+__attribute__ ((always_inline,target("avx2,fma"))) INLINE void potential_params_8single_avx2 ( struct MxPotential **p , __m256 *q ) {
+
+    __m256 r0, r1, r2, r3, t0, t1, t2, t3;
+
+    r0 = _mm256_set_m128( _mm_loadu_ps( p[4]->params ) , _mm_loadu_ps( p[0]->params ) );
+    r1 = _mm256_set_m128( _mm_loadu_ps( p[5]->params ) , _mm_loadu_ps( p[1]->params ) );
+    r2 = _mm256_set_m128( _mm_loadu_ps( p[6]->params ) , _mm_loadu_ps( p[2]->params ) );
+    r3 = _mm256_set_m128( _mm_loadu_ps( p[7]->params ) , _mm_loadu_ps( p[3]->params ) );
+    t0 = _mm256_unpacklo_ps( r0 , r1 );
+    t1 = _mm256_unpacklo_ps( r2 , r3 );
+    t2 = _mm256_unpackhi_ps( r0 , r1 );
+    t3 = _mm256_unpackhi_ps( r2 , r3 );
+    q[0] = _mm256_shuffle_ps( t0 , t1 , 0x44 );
+    q[1] = _mm256_shuffle_ps( t0 , t1 , 0xee );
+    q[2] = _mm256_shuffle_ps( t2 , t3 , 0x44 );
+    q[3] = _mm256_shuffle_ps( t2 , t3 , 0xee );
+
+    }
+
+
+/**
+ * @brief Evaluates eight potentials of the same kind at a set of points,
+ *      using their closed form (AVX2).
+ *
+ * Same as #potential_eval_vec_8single_avx2, which is what the
+ * #potential_kind_table instance calls.
+ */
+
+template <int kind> __attribute__ ((always_inline,target("avx2,fma"))) inline void potential_eval_vec_8single_avx2_kind ( struct MxPotential *p[8] , float *r2 , float *e , float *f ) {
+
+    __m256 q[4], r, ee, eff;
+
+    r = _mm256_sqrt_ps( _mm256_loadu_ps( r2 ) );
+    potential_params_8single_avx2( p , q );
+    potential_closed_eval<kind>( q , r , _mm256_max_ps( r , q[3] ) , &ee , &eff );
+    _mm256_storeu_ps( e , ee );
+    _mm256_storeu_ps( f , eff );
+
+    }
+
+template <> __attribute__ ((always_inline,target("avx2,fma"))) inline void potential_eval_vec_8single_avx2_kind<potential_kind_table> ( struct MxPotential *p[8] , float *r2 , float *e , float *f ) {
+
+    potential_eval_vec_8single_avx2( p , r2 , e , f );
+
+    }
+
+
+/**
+ * @brief Evaluates sixteen potentials of the same kind at a set of points,
+ *      using their closed form (AVX-512).
+ *
+ * Same as #potential_eval_vec_16single_avx512, which is what the
+ * #potential_kind_table instance calls.
+ */
+
+template <int kind> __attribute__ ((always_inline,target("avx512f,avx2,fma"))) inline void potential_eval_vec_16single_avx512_kind ( struct MxPotential *p[16] , float *r2 , float *e , float *f ) {
+
+    int k;
+    __m256 qlo[4], qhi[4];
+    __m512 q[4], r, ee, eff;
+
+    r = _mm512_sqrt_ps( _mm512_loadu_ps( r2 ) );
+    potential_params_8single_avx2( &p[0] , qlo );
+    potential_params_8single_avx2( &p[8] , qhi );
+    for ( k = 0 ; k < 4 ; k++ )
+        q[k] = potential_concat_16single_avx512( qlo[k] , qhi[k] );
+    potential_closed_eval<kind>( q , r , _mm512_max_ps( r , q[3] ) , &ee , &eff );
+    _mm512_storeu_ps( e , ee );
+    _mm512_storeu_ps( f , eff );
+
+    }
+
+template <> __attribute__ ((always_inline,target("avx512f,avx2,fma"))) inline void potential_eval_vec_16single_avx512_kind<potential_kind_table> ( struct MxPotential *p[16] , float *r2 , float *e , float *f ) {
+
+    potential_eval_vec_16single_avx512( p , r2 , e , f );
+
+    }
+
+#endif
@@ -86,7 +86,8 @@ struct task *queue_get ( struct queue *q , int rid , int keep ) {
     int j, k, tid = -1, ind_best = -1, score, score_best = -1, hit = 0;
     struct task *t;
     struct space *s = q->space;
-    char *cells_taboo = s->cells_taboo, *cells_owner = s->cells_owner;
+    char *cells_taboo = s->cells_taboo;
+    int *cells_owner = s->cells_owner;
 
     /* Check if the queue is empty first. */
     if ( q->next >= q->count )
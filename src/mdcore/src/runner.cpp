@@ -34,9 +34,7 @@
 #ifdef __SSE__
 #include <xmmintrin.h>
 #endif
-#ifdef HAVE_SETAFFINITY
 #include <sched.h>
-#endif
 #ifdef WITH_MPI
 #include <mpi.h>
 #endif
@@ -48,11 +46,14 @@
 #include "lock.h"
 #include <MxParticle.h>
 #include "queue.h"
+#include "deque.h"
 #include <space_cell.h>
 #include "task.h"
 #include "space.h"
 #include <MxPotential.h>
+#include "MxForce.h"
 #include "engine.h"
+#include "spme.h"
 #include "runner.h"
 
 
@@ -70,7 +71,7 @@ ticks runner_timers[runner_timer_count];
 #define error(id)				( runner_err = errs_register( id , runner_err_msg[-(id)] , __LINE__ , __FUNCTION__ , __FILE__ ) )
 
 /* list of error messages. */
-const char *runner_err_msg[12] = {
+const char *runner_err_msg[14] = {
         "Nothing bad happened.",
         "An unexpected NULL pointer was encountered.",
         "A call to malloc failed, probably due to insufficient memory.",
@@ -83,6 +84,8 @@ const char *runner_err_msg[12] = {
         "An error occured when calling an fifo function." ,
         "Error filling Verlet list: too many neighbours." ,
         "Unknown task type." ,
+        "An error occured when calling a deque function." ,
+        "The Verlet list does not match the particles in the cell." ,
 };
 
 
@@ -239,232 +242,539 @@ void runner_sort_ascending ( unsigned int *parts , int N ) {
 }
 
 
-int runner_run ( struct runner *r ) {
+/**
+ * @brief Try to lock the cells of a task.
+ *
+ * @param e The #engine in which the task lives.
+ * @param t The #task.
+ *
+ * @return 1 if all the cells of @c t are now ours, 0 otherwise.
+ *
+ * The locks are only ever tried, never waited on, so the order in
+ * which the cells are taken does not matter.
+ *
+ * With #engine_flag_nolock, the kernels write to their #runner's own
+ * force buffer, so the cells are not locked and a task only waits for
+ * cells that are still being exchanged.
+ */
 
-    struct engine *e = r->e;
-    struct space *s = &e->s;
-    int k, err = 0, acc = 0, naq, qid, myqid = e->nr_queues * r->id / e->nr_runners;
-    struct task *t = NULL;
-    struct queue *myq = &e->queues[ myqid ], *queues[ e->nr_queues ];
-    unsigned int myseed = rand() + r->id;
-    int count;
+static int runner_task_lock ( struct engine *e , struct task *t ) {
 
-    /* give a hoot */
-    printf( "runner_run: runner %i is up and running on queue %i (tasks)...\n" , r->id , myqid ); fflush(stdout);
+    char *cells_taboo = e->s.cells_taboo;
 
-    /* main loop, in which the runner should stay forever... */
-    while ( 1 ) {
+    if ( e->flags & engine_flag_nolock )
+        return ( __atomic_load_n( &cells_taboo[ t->i ] , __ATOMIC_ACQUIRE ) == 0 &&
+                 ( t->type != task_type_pair || __atomic_load_n( &cells_taboo[ t->j ] , __ATOMIC_ACQUIRE ) == 0 ) );
 
-        /* wait at the engine barrier */
-        /* printf("runner_run: runner %i waiting at barrier...\n",r->id); */
-        if ( engine_barrier(e) < 0)
-            return error(runner_err_engine);
+    if ( t->type == task_type_pair ) {
+        if ( __sync_val_compare_and_swap( &cells_taboo[ t->i ] , 0 , 1 ) != 0 )
+            return 0;
+        if ( __sync_val_compare_and_swap( &cells_taboo[ t->j ] , 0 , 1 ) != 0 ) {
+            __atomic_store_n( &cells_taboo[ t->i ] , 0 , __ATOMIC_RELEASE );
+            return 0;
+        }
+    }
+    else if ( t->type == task_type_sort || t->type == task_type_self ||
+              t->type == task_type_singlebody || t->type == task_type_integrate ) {
+        if ( __sync_val_compare_and_swap( &cells_taboo[ t->i ] , 0 , 1 ) != 0 )
+            return 0;
+    }
 
-        /* Init the reaction counter. */
-        // runner_rcount = 0;
-
-        /* Init the list of queues. */
-        for ( k = 0 ; k < e->nr_queues ; k++ )
-            queues[k] = &e->queues[k];
-        naq = e->nr_queues - 1;
-        queues[ myqid ] = queues[ naq ];
-
-        /* while i can still get a pair... */
-        /* printf("runner_run: runner %i paSSEd barrier, getting pairs...\n",r->id); */
-        while ( myq->next < myq->count || naq > 0 ) {
-
-            /* Try to get a pair from my own queue. */
-            TIMER_TIC
-            if ( myq->next == myq->count || ( t = queue_get( myq , r->id , 0 ) ) == NULL ) {
-
-                /* Clean up the list of queues. */
-                count = myq->count - myq->next;
-                for ( k = 0 ; k < naq ; k++ ) {
-                    count += queues[k]->count - queues[k]->next;
-                    if ( queues[k]->next == queues[k]->count )
-                        queues[k--] = queues[--naq];
-                }
+    return 1;
+}
 
-                /* If there are no queues left, go back to go, do not collect 200 FLOPs. */
-                if ( naq == 0 )
-                    continue;
 
-                /* Otherwise, try to grab something from a random queue. */
-                qid = rand_r( &myseed ) % naq;
-                if ( ( t = queue_get( queues[qid] , r->id , 1 ) ) != NULL ) {
+/**
+ * @brief Hold back a task whose cells could not be locked.
+ *
+ * @param r The #runner.
+ * @param t The #task.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * If there is no room left among the deferred tasks, @c t goes back
+ * onto the runner's own #deque, where others can still steal it.
+ */
 
-                    /* Add this task to my own queue. */
-                    if ( !queue_insert( myq , t ) )
-                        queue_insert( queues[qid] , t );
+static int runner_task_defer ( struct runner *r , struct task *t ) {
 
-                }
+    if ( r->nr_deferred < runner_maxdeferred )
+        r->deferred[ r->nr_deferred++ ] = t;
+    else if ( !deque_push( &r->dq , t ) )
+        return error(runner_err_deque);
 
-                /* If there are more queues than tasks, fall on sword. */
-                if ( t == NULL && count <= r->id )
-                    break;
+    return runner_err_ok;
+}
 
-            }
 
-            /* If I didn't get a task, try again, locking... */
-            if ( t == NULL ) {
+/**
+ * @brief Get a task for the given runner.
+ *
+ * @param r The #runner.
+ * @param seed Pointer to the seed for picking a victim to steal from.
+ * @param out Pointer to a #task pointer in which to store a task with no
+ *      unresolved dependencies and whose cells have been locked, or
+ *      @c NULL if none could be found.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * Tasks held back on a cell conflict are retried first, then the runner's
+ * own #deque is popped and, if that is empty, a random other runner is
+ * robbed. A task that can not be held back is lost, which is an error.
+ */
 
-                /* Lock the mutex. */
-                if ( pthread_mutex_lock( &s->tasks_mutex ) != 0 )
-                    return error(runner_err_pthread);
+static int runner_gettask ( struct runner *r , unsigned int *seed , struct task **out ) {
 
-                /* Try again to get a pair... */
-                if ( myq->next == myq->count || ( t = queue_get( myq , r->id , 0 ) ) == NULL ) {
-                    count = myq->count - myq->next;
-                    for ( k = 0 ; k < naq ; k++ ) {
-                        count += queues[k]->count - queues[k]->next;
-                        if ( queues[k]->next == queues[k]->count )
-                            queues[k--] = queues[--naq];
-                    }
-                    if ( naq != 0 ) {
-                        qid = rand_r( &myseed ) % naq;
-                        if ( ( t = queue_get( queues[qid] , r->id , 1 ) ) != NULL ) {
-                            if ( !queue_insert( myq , t ) )
-                                queue_insert( queues[qid] , t );
-                        }
-                    }
-                }
+    struct engine *e = r->e;
+    struct task *t;
+    int k, vid;
 
-                /* If no pair, wait... */
-                if ( count > 0 && t == NULL )    
-                    if ( pthread_cond_wait( &s->tasks_avail , &s->tasks_mutex ) != 0 )
-                        return error(runner_err_pthread);
+    *out = NULL;
 
-                /* Unlock the mutex. */
-                if ( pthread_mutex_unlock( &s->tasks_mutex ) != 0 )
-                    return error(runner_err_pthread);
+    /* Retry the tasks held back on a cell conflict. */
+    for ( k = 0 ; k < r->nr_deferred ; k++ )
+        if ( runner_task_lock( e , r->deferred[k] ) ) {
+            *out = r->deferred[k];
+            r->deferred[k] = r->deferred[ --r->nr_deferred ];
+            return runner_err_ok;
+        }
 
-                /* Skip back to the top of the queue if empty-handed. */
-                if ( t == NULL )
-                    continue;
+    /* Try my own deque. */
+    if ( ( t = deque_pop( &r->dq ) ) != NULL ) {
+        if ( runner_task_lock( e , t ) ) {
+            *out = t;
+            return runner_err_ok;
+        }
+        if ( runner_task_defer( r , t ) < 0 )
+            return error(runner_err);
+    }
 
+    /* Try to steal from somebody on the same socket first. */
+    if ( ( e->flags & engine_flag_numa ) && r->socket_count > 1 ) {
+        vid = rand_r( seed ) % ( r->socket_count - 1 ) + r->socket_first;
+        if ( vid >= r->id )
+            vid += 1;
+        if ( ( t = deque_steal( &e->runners[ vid ].dq ) ) != NULL ) {
+            if ( runner_task_lock( e , t ) ) {
+                *out = t;
+                return runner_err_ok;
             }
-            TIMER_TOC(runner_timer_queue);
-
-            /* Check task type... */
-            switch ( t->type ) {
-            case task_type_sort:
-                TIMER_TIC_ND
-                if ( s->verlet_rebuild && !( e->flags & engine_flag_unsorted ) )
-                    if ( runner_dosort( r , &s->cells[ t->i ] , t->flags ) < 0 )
-                        return error(runner_err);
-                s->cells_taboo[ t->i ] = 0;
-                TIMER_TOC(runner_timer_sort);
-                break;
-            case task_type_self:
-                TIMER_TIC_ND
-                if ( runner_doself( r , &s->cells[ t->i ] ) < 0 )
-                    return error(runner_err);
-                s->cells_taboo[ t->i ] = 0;
-                TIMER_TOC(runner_timer_self);
-                break;
-            case task_type_pair:
-                TIMER_TIC_ND
-                if ( e->flags & engine_flag_unsorted ) {
-                    if ( runner_dopair_unsorted( r , &s->cells[ t->i ] , &s->cells[ t->j ] ) < 0 )
-                        return error(runner_err);
+            if ( runner_task_defer( r , t ) < 0 )
+                return error(runner_err);
+        }
+    }
+
+    /* Try to steal from somebody else. */
+    if ( e->nr_runners > 1 ) {
+        vid = rand_r( seed ) % ( e->nr_runners - 1 );
+        if ( vid >= r->id )
+            vid += 1;
+        if ( ( t = deque_steal( &e->runners[ vid ].dq ) ) != NULL ) {
+            if ( runner_task_lock( e , t ) ) {
+                *out = t;
+                return runner_err_ok;
+            }
+            if ( runner_task_defer( r , t ) < 0 )
+                return error(runner_err);
+        }
+    }
+
+    /* Came up empty. */
+    return runner_err_ok;
+}
+
+
+/**
+ * @brief Apply the single-body forces to the particles of a cell.
+ *
+ * @param r The #runner computing the forces.
+ * @param c The #space_cell whose particles to update.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * The particles are grouped by type so that each #MxForce is called once
+ * per run of particles of its type. Forces that provide a batched
+ * @c span function get the packed absolute positions, velocities and
+ * forces of the run, the others are called for each particle. In a cell
+ * with #cell_flag_soa, the forces are added to its SoA buffers.
+ */
+
+int runner_dosinglebody ( struct runner *r , struct space_cell *c ) {
+
+    struct engine *e = r->e;
+    struct MxForce *psb, **psbs = e->p_singlebody;
+    struct MxParticle *p;
+    int *first, *ind;
+    int count = c->count, emt = e->max_type, soa = c->flags & cell_flag_soa;
+    int pid, tid, i, j, k, n, nr_parts = 0;
+    FPTYPE *x, *v, *f;
+
+    /* Count the particles of each type that have a force. */
+    if ( count == 0 )
+        return runner_err_ok;
+    first = (int *)alloca( sizeof(int) * ( emt + 1 ) );
+    bzero( first , sizeof(int) * ( emt + 1 ) );
+    for ( pid = 0 ; pid < count ; pid++ )
+        if ( psbs[ c->parts[pid].typeId ] != NULL ) {
+            first[ c->parts[pid].typeId + 1 ] += 1;
+            nr_parts += 1;
+        }
+    if ( nr_parts == 0 )
+        return runner_err_ok;
+
+    /* Sort their indices by type. */
+    for ( tid = 0 ; tid < emt ; tid++ )
+        first[ tid + 1 ] += first[ tid ];
+    ind = (int *)alloca( sizeof(int) * nr_parts );
+    for ( pid = 0 ; pid < count ; pid++ ) {
+        tid = c->parts[pid].typeId;
+        if ( psbs[tid] != NULL )
+            ind[ first[tid]++ ] = pid;
+    }
+
+    /* Buffers for the batched forces. */
+    x = (FPTYPE *)alloca( sizeof(FPTYPE) * 3 * nr_parts );
+    v = (FPTYPE *)alloca( sizeof(FPTYPE) * 3 * nr_parts );
+    f = (FPTYPE *)alloca( sizeof(FPTYPE) * 3 * nr_parts );
+
+    /* Apply the force of each type to its run of particles, which ends
+       at first[tid] now. */
+    for ( tid = 0 , i = 0 ; tid < emt ; tid++ ) {
+        if ( ( psb = psbs[tid] ) == NULL || ( n = first[tid] - i ) == 0 )
+            continue;
+        if ( psb->span != NULL && soa ) {
+            for ( pid = 0 ; pid < n ; pid++ ) {
+                j = ind[ i + pid ];
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    x[ 3*pid + k ] = c->origin[k] + c->soa_x[k][j];
+                    v[ 3*pid + k ] = c->soa_v[k][j];
+                    f[ 3*pid + k ] = 0.0;
                 }
-                else {
-                    if ( runner_dopair( r , &s->cells[ t->i ] , &s->cells[ t->j ] , t->flags ) < 0 )
-                        return error(runner_err);
+            }
+            psb->span( psb , &e->types[tid] , n , x , v , f );
+            for ( pid = 0 ; pid < n ; pid++ )
+                for ( k = 0 ; k < 3 ; k++ )
+                    c->soa_f[k][ ind[ i + pid ] ] += f[ 3*pid + k ];
+        }
+        else if ( psb->span != NULL ) {
+            for ( pid = 0 ; pid < n ; pid++ ) {
+                p = &c->parts[ ind[ i + pid ] ];
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    x[ 3*pid + k ] = c->origin[k] + p->x[k];
+                    v[ 3*pid + k ] = p->v[k];
+                    f[ 3*pid + k ] = 0.0;
                 }
-                s->cells_taboo[ t->i ] = 0;
-                s->cells_taboo[ t->j ] = 0;
-                TIMER_TOC(runner_timer_pair);
-                break;
-            default:
-                return error(runner_err_tasktype);
             }
+            psb->span( psb , &e->types[tid] , n , x , v , f );
+            for ( pid = 0 ; pid < n ; pid++ ) {
+                p = &c->parts[ ind[ i + pid ] ];
+                for ( k = 0 ; k < 3 ; k++ )
+                    p->f[k] += f[ 3*pid + k ];
+            }
+        }
+        else if ( soa ) {
+            /* Hand the force a current record, but only write the SoA
+               forces back, the other runners may be reading the rest. */
+            for ( pid = 0 ; pid < n ; pid++ ) {
+                j = ind[ i + pid ];
+                space_cell_soa_get( c , j );
+                p = &c->parts[j];
+                p->f[0] = 0.0; p->f[1] = 0.0; p->f[2] = 0.0;
+                psb->func( psb , p , p->f );
+                for ( k = 0 ; k < 3 ; k++ )
+                    c->soa_f[k][j] += p->f[k];
+            }
+        }
+        else {
+            for ( pid = 0 ; pid < n ; pid++ ) {
+                p = &c->parts[ ind[ i + pid ] ];
+                psb->func( psb , p , p->f );
+            }
+        }
+        i += n;
+    }
+
+    /* All is well... */
+    return runner_err_ok;
+}
+
 
-            /* Unlock any dependent tasks. */
-            for ( k = 0 ; k < t->nr_unlock ; k++ )
-                __sync_fetch_and_sub( &t->unlock[k]->wait , 1 );
+/**
+ * @brief Integrate the particles of a cell whose forces are complete.
+ *
+ * @param r The #runner computing the integration.
+ * @param c The #space_cell to integrate.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * Updates the particle velocities and positions, adds the kinetic energy
+ * and momentum to @c r->sums and the cell's potential energy to
+ * @c r->acc[0] and sets
+ * the forces to zero for the next step. Particles that leave the cell are
+ * moved to the runner's outgoing buffers, which have to be welcomed once
+ * all cells have been integrated (see #runner_welcome).
+ *
+ * This is the per-cell work of #engine_advance for #engine_flag_fused,
+ * run as soon as the last task computing forces on @c c is done.
+ */
 
-            /* Bing! */
-            if ( pthread_mutex_lock( &s->tasks_mutex ) != 0 )
-                return error(runner_err_pthread);
-            if ( pthread_cond_broadcast( &s->tasks_avail ) != 0 )
-                return error(runner_err_pthread);
-            if ( pthread_mutex_unlock( &s->tasks_mutex ) != 0 )
-                return error(runner_err_pthread);
+int runner_dointegrate ( struct runner *r , struct space_cell *c ) {
 
+    struct engine *e = r->e;
+    struct space *s = &e->s;
+    struct space_cell *c_dest;
+    struct MxParticle *p;
+    int pid, k, delta[3];
+    FPTYPE dt, w, m, v2, h[3];
+    double *sums;
+
+    /* Get a grip on the space. */
+    dt = e->dt;
+    for ( k = 0 ; k < 3 ; k++ )
+        h[k] = s->h[k];
+
+    /* Collect the cell's potential energy. */
+    r->acc[0] += c->epot;
+
+    pid = 0;
+    while ( pid < c->count ) {
+        p = &( c->parts[pid] );
+
+        /* Kick, drift and clear the forces. */
+        w = dt * e->types[p->typeId].imass;
+        v2 = 0.0;
+        for ( k = 0 ; k < 3 ; k++ ) {
+            p->v[k] += p->f[k] * w;
+            p->x[k] += dt * p->v[k];
+            p->f[k] = 0.0;
+            v2 += p->v[k] * p->v[k];
+            delta[k] = __builtin_isgreaterequal( p->x[k] , h[k] ) - __builtin_isless( p->x[k] , 0.0 );
+        }
+        m = e->types[p->typeId].mass;
+        sums = &r->sums[ p->typeId * runner_nrsums ];
+        sums[runner_sum_ekin] += m * v2;
+        sums[runner_sum_px] += m * p->v[0];
+        sums[runner_sum_py] += m * p->v[1];
+        sums[runner_sum_pz] += m * p->v[2];
+        sums[runner_sum_count] += 1.0;
+
+        /* do we have to move this particle? */
+        if ( ( delta[0] != 0 ) || ( delta[1] != 0 ) || ( delta[2] != 0 ) ) {
+            for ( k = 0 ; k < 3 ; k++ )
+                p->x[k] -= delta[k] * h[k];
+
+            c_dest = &( s->cells[ space_cellid( s ,
+                    (c->loc[0] + delta[0] + s->cdim[0]) % s->cdim[0] ,
+                    (c->loc[1] + delta[1] + s->cdim[1]) % s->cdim[1] ,
+                    (c->loc[2] + delta[2] + s->cdim[2]) % s->cdim[2] ) ] );
+
+            if ( runner_migrate( r , c_dest , p ) < 0 )
+                return error(runner_err);
+
+            /* Fill the hole with the last particle of the cell. */
+            c->count -= 1;
+            if ( pid < c->count ) {
+                c->parts[pid] = c->parts[c->count];
+                s->partlist[ c->parts[pid].id ] = &( c->parts[pid] );
+            }
         }
+        else
+            pid += 1;
+    }
 
-        /* give the reaction count */
-        // printf("runner_run: last count was %u.\n",runner_rcount);
-        r->err = acc;
+    /* All is well... */
+    return runner_err_ok;
+}
 
-        /* did things go wrong? */
-        /* printf("runner_run: runner %i done pairs.\n",r->id); fflush(stdout); */
-        if ( err < 0 )
-            return error(runner_err_space);
 
-        /* Bing! */
-        if ( pthread_mutex_lock( &s->tasks_mutex ) != 0 )
-            return error(runner_err_pthread);
-        if ( pthread_cond_broadcast( &s->tasks_avail ) != 0 )
-            return error(runner_err_pthread);
-        if ( pthread_mutex_unlock( &s->tasks_mutex ) != 0 )
-            return error(runner_err_pthread);
+/**
+ * @brief Interpolate the reciprocal-space forces onto a row of cells.
+ *
+ * @param r The #runner.
+ * @param i The index of the row along the first dimension.
+ * @param j The index of the row along the second dimension.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * The cells are locked one at a time, in whatever order the pair tasks
+ * release them, so no lock is ever waited on while holding another.
+ */
+
+static int runner_dospme_gather ( struct runner *r , int i , int j ) {
+
+    struct engine *e = r->e;
+    struct space *s = &e->s;
+    int k, cid, left = s->cdim[2], misses = 0;
+    char done[ s->cdim[2] ];
+
+    bzero( done , sizeof(char) * s->cdim[2] );
+    while ( left > 0 ) {
+        for ( k = 0 ; k < s->cdim[2] ; k++ ) {
+            cid = space_cellid( s , i , j , k );
+            if ( done[k] || __sync_val_compare_and_swap( &s->cells_taboo[cid] , 0 , 1 ) != 0 )
+                continue;
+            spme_gather( e->spme , &s->cells[cid] );
+            __atomic_store_n( &s->cells_taboo[cid] , 0 , __ATOMIC_RELEASE );
+            done[k] = 1;
+            left -= 1;
+        }
+        if ( left > 0 && ++misses % runner_yieldafter == 0 )
+            sched_yield();
     }
+
+    /* All is well... */
+    return runner_err_ok;
 }
 
 
+/**
+ * @brief Run a reciprocal-space task.
+ *
+ * @param r The #runner.
+ * @param t The #task, see #spme_maketasks.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ */
+
+int runner_dospme ( struct runner *r , struct task *t ) {
+
+    struct engine *e = r->e;
+    struct space *s = &e->s;
+    struct spme *p = e->spme;
+    int i, j, k, p0, p1, N = p->dim[1] * p->dim[2];
+    float *work = NULL;
+
+    /* Get the scratch space for the transforms. */
+    if ( t->flags == spme_task_forward || t->flags == spme_task_convolve || t->flags == spme_task_backward )
+        if ( ( work = spme_work( p , r->id ) ) == NULL )
+            return error(runner_err_malloc);
+
+    switch ( t->flags ) {
+    case spme_task_spread:
+        p0 = p->slabs[ t->i ];
+        p1 = p->slabs[ t->i + 1 ];
+        bzero( &p->Q[ 2 * p0 * N ] , sizeof(float) * 2 * ( p1 - p0 ) * N );
+        for ( i = 0 ; i < s->cdim[0] ; i++ )
+            if ( spme_layer_hits( p , i , p0 , p1 ) )
+                for ( j = 0 ; j < s->cdim[1] ; j++ )
+                    for ( k = 0 ; k < s->cdim[2] ; k++ )
+                        spme_spread( p , &s->cells[ space_cellid( s , i , j , k ) ] , p0 , p1 );
+        break;
+    case spme_task_forward:
+        spme_fft2d( p , p->slabs[ t->i ] , p->slabs[ t->i + 1 ] , -1 , work );
+        break;
+    case spme_task_convolve:
+        p->epot_block[ t->i ] = spme_convolve( p , t->i , work );
+        break;
+    case spme_task_backward:
+        spme_fft2d( p , p->slabs[ t->i ] , p->slabs[ t->i + 1 ] , 1 , work );
+        break;
+    case spme_task_layer:
+        break;
+    case spme_task_gather:
+        return runner_dospme_gather( r , t->i , t->j );
+    default:
+        return error(runner_err_tasktype);
+    }
+
+    /* All is well... */
+    return runner_err_ok;
+}
 
 
 /**
- * @brief Initialize the runner associated to the given engine.
- * 
- * @param r The #runner to be initialized.
- * @param e The #engine with which it is associated.
- * @param id The ID of this #runner.
- * 
- * @return #runner_err_ok or < 0 on error (see #runner_err).
+ * @brief Move a particle leaving its cell to an outgoing buffer of the
+ *      #runner.
+ *
+ * @param r The #runner.
+ * @param c_dest The particle's new #space_cell.
+ * @param p The particle, its position already relative to @c c_dest.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * The particle goes to the buffer of the runner welcoming @c c_dest,
+ * i.e. its owner with #engine_flag_numa or every @c nr_runners-th cell
+ * otherwise, where it waits for #runner_welcome. The buffers are private
+ * to @c r, so no cell locks are needed and the cost only grows with the
+ * number of moving particles. The particle still has to be removed from
+ * its old cell by the caller.
  */
 
-int runner_init ( struct runner *r , struct engine *e , int id ) {
+int runner_migrate ( struct runner *r , struct space_cell *c_dest , struct MxParticle *p ) {
 
-#if defined(HAVE_SETAFFINITY)
-    cpu_set_t cpuset;
-#endif
+    struct engine *e = r->e;
+    struct space *s = &e->s;
+    struct runner_outbuf *b;
+    struct MxParticle *parts;
+    int cid = c_dest - s->cells, *cids, size;
+
+    /* Get the buffer of the runner welcoming the new cell. */
+    if ( e->flags & engine_flag_numa )
+        b = &r->out[ s->cells_owner[cid] ];
+    else
+        b = &r->out[ cid % e->nr_runners ];
+
+    /* Make room for the particle. */
+    if ( b->count == b->size ) {
+        size = ( b->size == 0 ) ? runner_outbuf_size : 2 * b->size;
+        if ( ( parts = (struct MxParticle *)realloc( b->parts , sizeof(struct MxParticle) * size ) ) == NULL )
+            return error(runner_err_malloc);
+        b->parts = parts;
+        if ( ( cids = (int *)realloc( b->cid , sizeof(int) * size ) ) == NULL )
+            return error(runner_err_malloc);
+        b->cid = cids;
+        b->size = size;
+    }
 
-    /* make sure the inputs are ok */
-    if ( r == NULL || e == NULL )
-        return error(runner_err_null);
+    /* Store it. */
+    b->parts[ b->count ] = *p;
+    b->cid[ b->count ] = cid;
+    b->count += 1;
+    s->celllist[ p->id ] = c_dest;
 
-    /* remember who i'm working for */
-    r->e = e;
-    r->id = id;
+    /* All runners may set this at once, the end of the phase publishes it. */
+    __atomic_store_n( &s->parts_moved , 1 , __ATOMIC_RELAXED );
 
-    /* init the thread using tasks. */
-    if ( pthread_create( &r->thread , NULL , (void *(*)(void *))runner_run , r ) != 0 )
-        return error(runner_err_pthread);
+    /* All is well... */
+    return runner_err_ok;
+}
 
-    /* If we can, try to restrict this runner to a single CPU. */
-#if defined(HAVE_SETAFFINITY)
-    if ( e->flags & engine_flag_affinity ) {
 
-        /* Set the cpu mask to zero | r->id. */
-        CPU_ZERO( &cpuset );
-        CPU_SET( r->id , &cpuset );
+/**
+ * @brief Add the particles all runners moved to cells welcomed by this
+ *      #runner to their new cells.
+ *
+ * @param r The #runner.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * Has to run once all runners are done moving particles, see
+ * #runner_migrate. Each cell is welcomed by a single runner, so the
+ * particles can be added without locking the cells.
+ */
 
-        /* Apply this mask to the runner's pthread. */
-        if ( pthread_setaffinity_np( r->thread , sizeof(cpu_set_t) , &cpuset ) != 0 )
-            return error(runner_err_pthread);
+int runner_welcome ( struct runner *r ) {
+
+    struct engine *e = r->e;
+    struct space *s = &e->s;
+    struct runner_outbuf *b;
+    int j, k;
 
+    for ( j = 0 ; j < e->nr_runners ; j++ ) {
+        b = &e->runners[j].out[ r->id ];
+        for ( k = 0 ; k < b->count ; k++ )
+            if ( space_cell_add( &s->cells[ b->cid[k] ] , &b->parts[k] , s->partlist ) == NULL )
+                return error(runner_err_space);
+        b->count = 0;
     }
-#endif
 
-    /* all is well... */
+    /* All is well... */
     return runner_err_ok;
 }
 
+
 /**
- * @brief The #runner's main routine (for Verlet lists).
+ * @brief The #runner's main routine.
  *
  * @param r Pointer to the #runner to run.
  *
@@ -472,31 +782,23 @@ int runner_init ( struct runner *r , struct engine *e , int id ) {
  *
  * This is the main routine for the #runner. When called, it enters
  * an infinite loop in which it waits at the #engine @c r->e barrier
- * and, once having passed, checks first if the Verlet list should
- * be re-built and then proceeds to traverse the Verlet list cell-wise
- * and computes its interactions.
+ * and, once released, runs whatever phase of the time step the engine
+ * set up (see #engine_phase_run). It only leaves the loop once the
+ * engine releases it without a phase.
+ *
+ * If the phase fails, its return code is left in @c r->phase_err for the
+ * engine, any tasks left are written off so that the other runners stop
+ * waiting for them, and the runner checks back in at the barrier as
+ * usual.
  */
 
-int runner_run_verlet ( struct runner *r ) {
-
-    int res, i, ci, j, cj, k, eff_size = 0, acc = 0;
-    struct engine *e;
-    struct space *s;
-    struct celltuple *t;
-    struct space_cell *c;
-    FPTYPE shift[3], *eff = NULL;
-    int count;
-
-    /* check the inputs */
-    if ( r == NULL )
-        return error(runner_err_null);
+int runner_run ( struct runner *r ) {
 
-    /* get a pointer on the engine. */
-    e = r->e;
-    s = &(e->s);
+    struct engine *e = r->e;
+    ticks tic;
 
     /* give a hoot */
-    printf("runner_run: runner %i is up and running (Verlet)...\n",r->id); fflush(stdout);
+    printf( "runner_run: runner %i is up and running...\n" , r->id ); fflush(stdout);
 
     /* main loop, in which the runner should stay forever... */
     while ( 1 ) {
@@ -506,124 +808,284 @@ int runner_run_verlet ( struct runner *r ) {
         if ( engine_barrier(e) < 0)
             return error(runner_err_engine);
 
-        // runner_rcount = 0;
-
-        /* Does the Verlet list need to be reconstructed? */
-        if ( s->verlet_rebuild ) {
+        /* Time to go home? */
+        if ( e->phase_fun == NULL )
+            return runner_err_ok;
 
-            /* Loop over tuples. */
-            while ( 1 ) {
+        /* Run the phase, timing our share of it. */
+        tic = getticks();
+        if ( ( r->phase_err = e->phase_fun( r , e->phase_data ) ) < 0 ) {
+            error(runner_err);
+            __atomic_store_n( &e->tasks_left , 0 , __ATOMIC_RELEASE );
+            }
+        r->phase_ticks = getticks() - tic;
 
-                /* Get a tuple. */
-                if ( ( res = space_gettuple( s , &t , 1 ) ) < 0 )
-                    return r->err = runner_err_space;
+    }
 
-                /* If there were no tuples left, bail. */
-                if ( res < 1 )
-                    break;
+}
 
-                /* for each cell, prefetch the parts involved. */
-                if ( e->flags & engine_flag_prefetch )
-                    for ( i = 0 ; i < t->n ; i++ ) {
-                        c = &( s->cells[t->cellid[i]] );
-                        for ( k = 0 ; k < c->count ; k++ )
-                            acc += c->parts[k].id;
-                        }
 
-                /* Loop over all pairs in this tuple. */
-                for ( i = 0 ; i < t->n ; i++ ) {
+/**
+ * @brief Count the particles of a cell as read from the local or from a
+ *      remote socket, depending on who owns the cell.
+ */
 
-                    /* Get the cell ID. */
-                    ci = t->cellid[i];
+static inline void runner_numa_count ( struct runner *r , int cid ) {
 
-                    for ( j = i ; j < t->n ; j++ ) {
+    struct engine *e = r->e;
+    struct space *s = &e->s;
 
-                        /* Is this pair active? */
-                        if ( t->pairid[ space_pairind(i,j) ] < 0 )
-                            continue;
+    if ( e->runners[ s->cells_owner[cid] ].socket == r->socket )
+        r->numa_local += s->cells[cid].count;
+    else
+        r->numa_remote += s->cells[cid].count;
 
-                        /* Get the cell ID. */
-                        cj = t->cellid[j];
+}
 
-                        /* Compute the shift between ci and cj. */
-                        for ( k = 0 ; k < 3 ; k++ ) {
-                            shift[k] = s->cells[cj].origin[k] - s->cells[ci].origin[k];
-                            if ( shift[k] * 2 > s->dim[k] )
-                                shift[k] -= s->dim[k];
-                            else if ( shift[k] * 2 < -s->dim[k] )
-                                shift[k] += s->dim[k];
-                            }
 
-                        /* Rebuild the Verlet entries for this cell pair. */
-                        if ( runner_verlet_fill( r , &(s->cells[ci]) , &(s->cells[cj]) , shift ) < 0 )
-                            return error(runner_err);
+/**
+ * @brief Run the non-bonded tasks of the current step.
+ *
+ * @param r Pointer to the #runner.
+ * @param data Unused.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err).
+ *
+ * Gets tasks until there are none left in the step (see #runner_gettask)
+ * and executes them.
+ */
 
-                        /* release this pair */
-                        if ( space_releasepair( s , ci , cj ) < 0 )
-                            return error(runner_err_space);
+int runner_dotasks ( struct runner *r , void *data ) {
 
-                        }
+    struct engine *e = r->e;
+    struct space *s = &e->s;
+    int k, misses = 0;
+    struct task *t = NULL;
+    ticks tic_task;
+
+    /* Init the reaction counter. */
+    // runner_rcount = 0;
+
+    /* Nothing held back or integrated yet. */
+    r->nr_deferred = 0;
+    r->acc[0] = 0.0;
+    for ( k = 0 ; k < e->max_type * runner_nrsums ; k++ )
+        r->sums[k] = 0.0;
+
+    /* while there are tasks left in this step... */
+    /* printf("runner_run: runner %i paSSEd barrier, getting pairs...\n",r->id); */
+    while ( __atomic_load_n( &e->tasks_left , __ATOMIC_ACQUIRE ) > 0 ) {
+
+        /* Try to get a task, spin politely if there is none. */
+        TIMER_TIC
+        if ( runner_gettask( r , &r->seed , &t ) < 0 )
+            return error(runner_err);
+        if ( t == NULL ) {
+
+            /* Is the exchange done? Then the first runner to notice
+               releases the tasks on the ghost cells. */
+            if ( __atomic_load_n( &e->halo_ready , __ATOMIC_ACQUIRE ) &&
+                 __atomic_exchange_n( &e->halo_ready , 0 , __ATOMIC_ACQ_REL ) ) {
+                for ( k = 0 ; k < e->nr_halo ; k++ )
+                    if ( __atomic_sub_fetch( &e->halo_tasks[k]->wait , 1 , __ATOMIC_ACQ_REL ) == 0 )
+                        if ( !deque_push( &r->dq , e->halo_tasks[k] ) )
+                            return error(runner_err_deque);
+                continue;
+            }
 
-                    }
+            if ( ++misses % runner_yieldafter == 0 )
+                sched_yield();
+#ifdef __SSE__
+            else
+                _mm_pause();
+#endif
+            continue;
+        }
+        misses = 0;
+        TIMER_TOC(runner_timer_queue);
+        tic_task = getticks();
+
+        /* Check task type... */
+        switch ( t->type ) {
+        case task_type_sort:
+            TIMER_TIC_ND
+            if ( s->verlet_rebuild && !( e->flags & engine_flag_unsorted ) )
+                if ( runner_dosort( r , &s->cells[ t->i ] , t->flags ) < 0 )
+                    return error(runner_err);
+            __atomic_store_n( &s->cells_taboo[ t->i ] , 0 , __ATOMIC_RELEASE );
+            TIMER_TOC(runner_timer_sort);
+            break;
+        case task_type_self:
+            TIMER_TIC_ND
+            if ( e->flags & engine_flag_soa ) {
+                if ( runner_doself_soa( r , &s->cells[ t->i ] ) < 0 )
+                    return error(runner_err);
+            }
+#ifdef RUNNER_SIMD
+            else if ( r->simd == runner_simd_avx512 ) {
+                if ( runner_doself_avx512( r , &s->cells[ t->i ] ) < 0 )
+                    return error(runner_err);
+            }
+            else if ( r->simd == runner_simd_avx2 ) {
+                if ( runner_doself_avx2( r , &s->cells[ t->i ] ) < 0 )
+                    return error(runner_err);
+            }
+#endif
+            else if ( runner_doself( r , &s->cells[ t->i ] ) < 0 )
+                return error(runner_err);
+            __atomic_store_n( &s->cells_taboo[ t->i ] , 0 , __ATOMIC_RELEASE );
+            TIMER_TOC(runner_timer_self);
+            break;
+        case task_type_pair:
+            TIMER_TIC_ND
+            if ( e->flags & engine_flag_unsorted ) {
+                if ( runner_dopair_unsorted( r , &s->cells[ t->i ] , &s->cells[ t->j ] ) < 0 )
+                    return error(runner_err);
+            }
+            else if ( e->flags & engine_flag_soa ) {
+                if ( runner_dopair_soa( r , &s->cells[ t->i ] , &s->cells[ t->j ] , t->flags ) < 0 )
+                    return error(runner_err);
+            }
+#ifdef RUNNER_SIMD
+            else if ( r->simd == runner_simd_avx512 ) {
+                if ( runner_dopair_avx512( r , &s->cells[ t->i ] , &s->cells[ t->j ] , t->flags ) < 0 )
+                    return error(runner_err);
+            }
+            else if ( r->simd == runner_simd_avx2 ) {
+                if ( runner_dopair_avx2( r , &s->cells[ t->i ] , &s->cells[ t->j ] , t->flags ) < 0 )
+                    return error(runner_err);
+            }
+#endif
+            else {
+                if ( runner_dopair( r , &s->cells[ t->i ] , &s->cells[ t->j ] , t->flags ) < 0 )
+                    return error(runner_err);
+            }
+            __atomic_store_n( &s->cells_taboo[ t->i ] , 0 , __ATOMIC_RELEASE );
+            __atomic_store_n( &s->cells_taboo[ t->j ] , 0 , __ATOMIC_RELEASE );
+            TIMER_TOC(runner_timer_pair);
+            break;
+        case task_type_singlebody:
+            TIMER_TIC_ND
+            if ( runner_dosinglebody( r , &s->cells[ t->i ] ) < 0 )
+                return error(runner_err);
+            __atomic_store_n( &s->cells_taboo[ t->i ] , 0 , __ATOMIC_RELEASE );
+            TIMER_TOC(runner_timer_singlebody);
+            break;
+        case task_type_integrate:
+            TIMER_TIC_ND
+            if ( runner_dointegrate( r , &s->cells[ t->i ] ) < 0 )
+                return error(runner_err);
+            __atomic_store_n( &s->cells_taboo[ t->i ] , 0 , __ATOMIC_RELEASE );
+            TIMER_TOC(runner_timer_integrate);
+            break;
+        case task_type_spme:
+            TIMER_TIC_ND
+            if ( runner_dospme( r , t ) < 0 )
+                return error(runner_err);
+            TIMER_TOC(runner_timer_spme);
+            break;
+        default:
+            return error(runner_err_tasktype);
+        }
 
-                } /* loop over tuples. */
+        /* Book the time spent on the task for the load balancing. */
+        if ( e->flags & engine_flag_balance )
+            t->cost += getticks() - tic_task;
 
-            /* did anything go wrong? */
-            if ( res < 0 )
-                return error(runner_err_space);
+        /* Book the particles read from cells of either socket. */
+        if ( ( e->flags & engine_flag_numa ) && t->type != task_type_spme ) {
+            runner_numa_count( r , t->i );
+            if ( t->type == task_type_pair )
+                runner_numa_count( r , t->j );
+        }
 
-            } /* reconstruct the Verlet list. */
+        /* Unlock any dependent tasks, keeping the ones that become ready. */
+        for ( k = 0 ; k < t->nr_unlock ; k++ )
+            if ( __atomic_sub_fetch( &t->unlock[k]->wait , 1 , __ATOMIC_ACQ_REL ) == 0 )
+                if ( !deque_push( &r->dq , t->unlock[k] ) )
+                    return error(runner_err_deque);
 
-        /* Otherwise, just run through the Verlet list. */
-        else {
+        /* One less to go. */
+        __atomic_sub_fetch( &e->tasks_left , 1 , __ATOMIC_RELEASE );
 
-            /* Check if eff is large enough and re-allocate if needed. */
-            if ( eff_size < s->nr_parts ) {
+    }
 
-                /* Free old eff? */
-                if ( eff != NULL )
-                    free( eff );
+    /* all is well... */
+    return runner_err_ok;
+}
 
-                /* Allocate new eff. */
-                eff_size = s->nr_parts * 1.1;
-                if ( ( eff = (FPTYPE *)malloc( sizeof(FPTYPE) * eff_size * 4 ) ) == NULL )
-                    return error(runner_err_malloc);
 
-                }
 
-            /* Reset the force vector. */
-            bzero( eff , sizeof(FPTYPE) * s->nr_parts * 4 );
 
-            /* Re-set the potential energy. */
-            r->epot = 0.0;
+/**
+ * @brief Initialize the runner associated to the given engine.
+ * 
+ * @param r The #runner to be initialized.
+ * @param e The #engine with which it is associated.
+ * @param id The ID of this #runner.
+ * 
+ * @return #runner_err_ok or < 0 on error (see #runner_err).
+ *
+ * The CPU and socket of the runner are expected to be set already,
+ * see #engine_start.
+ */
 
-            /* While there are still chunks of the Verlet list out there... */
-            while ( ( count = space_getcell( s , &c ) ) > 0 ) {
+int runner_init ( struct runner *r , struct engine *e , int id ) {
 
-                /* Dispatch the interactions to runner_verlet_eval. */
-                runner_verlet_eval( r , c , eff );
+#if defined(HAVE_SETAFFINITY)
+    cpu_set_t cpuset;
+#endif
 
-                }
+    /* make sure the inputs are ok */
+    if ( r == NULL || e == NULL )
+        return error(runner_err_null);
 
-            /* did things go wrong? */
-            if ( count < 0 )
-                return error(runner_err_space);
+    /* remember who i'm working for */
+    r->e = e;
+    r->id = id;
 
-            /* Send the forces and energy back to the space. */
-            if ( space_verlet_force( s , eff , r->epot ) < 0 )
-                return error(runner_err_space);
+    /* if asked to, pick the widest pair kernels this CPU supports. */
+    if ( ( e->flags & engine_flag_simd ) && !( e->flags & engine_flag_localparts ) )
+        r->simd = runner_simd_detect();
+    else
+        r->simd = runner_simd_none;
+
+    /* init the task deque, large enough to hold every task. */
+    if ( deque_init( &r->dq , e->s.tasks_size ) != deque_err_ok )
+        return error(runner_err_deque);
+    r->nr_deferred = 0;
+    r->seed = rand() + id;
+    r->phase_ticks = 0;
+    r->phase_err = 0;
+    r->eff = NULL;
+    r->eff_size = 0;
+    if ( ( r->sums = (double *)calloc( e->max_type * runner_nrsums , sizeof(double) ) ) == NULL )
+        return error(runner_err_malloc);
+    r->numa_local = 0;
+    r->numa_remote = 0;
+    if ( ( r->out = (struct runner_outbuf *)calloc( e->nr_runners , sizeof(struct runner_outbuf) ) ) == NULL )
+        return error(runner_err_malloc);
 
-            }
+    /* init the thread using tasks. */
+    if ( pthread_create( &r->thread , NULL , (void *(*)(void *))runner_run , r ) != 0 )
+        return error(runner_err_pthread);
 
-        /* Print the rcount. */
-        // printf("runner_run_verlet: runner_rcount=%i.\n", runner_rcount);
-        r->err = acc;
+    /* If we can, try to restrict this runner to a single CPU. */
+#if defined(HAVE_SETAFFINITY)
+    if ( e->flags & engine_flag_affinity ) {
 
-        }
+        /* Set the cpu mask to zero | r->cpu. */
+        CPU_ZERO( &cpuset );
+        CPU_SET( r->cpu , &cpuset );
 
-    /* end well... */
-    return runner_err_ok;
+        /* Apply this mask to the runner's pthread. */
+        if ( pthread_setaffinity_np( r->thread , sizeof(cpu_set_t) , &cpuset ) != 0 )
+            return error(runner_err_pthread);
 
     }
+#endif
 
+    /* all is well... */
+    return runner_err_ok;
+}
 
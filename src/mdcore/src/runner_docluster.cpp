@@ -0,0 +1,828 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2012 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Include configuration header */
+#include "mdcore_config.h"
+
+/* Include some standard header files */
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <limits.h>
+
+/* Include some conditional headers. */
+#ifdef WITH_MPI
+    #include <mpi.h>
+#endif
+
+/* Include local headers */
+#include "cycle.h"
+#include "errs.h"
+#include "fptype.h"
+#include "lock.h"
+#include <MxParticle.h>
+#include <space_cell.h>
+#include "space.h"
+#include <MxPotential.h>
+#include "potential_eval.h"
+#include "engine.h"
+#include "engine_excluded.h"
+#include "runner.h"
+
+/* the error macro. */
+#define error(id)				( runner_err = errs_register( id , runner_err_msg[-(id)] , __LINE__ , __FUNCTION__ , __FILE__ ) )
+
+/* list of error messages. */
+extern const char *runner_err_msg[];
+
+/* Number of bits per dimension of the Morton keys used to form clusters. */
+#define runner_cluster_keybits          5
+
+
+/**
+ * @brief Interleave the bits of three cell coordinates into a Morton key.
+ */
+
+static inline unsigned int runner_cluster_key ( unsigned int i , unsigned int j , unsigned int k ) {
+
+    unsigned int b, key = 0;
+
+    for ( b = 0 ; b < runner_cluster_keybits ; b++ )
+        key |= ( ( ( i >> b ) & 1 ) << ( 3*b + 2 ) ) |
+               ( ( ( j >> b ) & 1 ) << ( 3*b + 1 ) ) |
+               ( ( ( k >> b ) & 1 ) << ( 3*b ) );
+
+    return key;
+
+    }
+
+
+/**
+ * @brief Find a potential and a radius at which it can safely be evaluated,
+ *      used to fill the lanes of a tile that are not interacting.
+ *
+ * @return 1 if the #engine has any potential at all, 0 otherwise.
+ */
+
+static int runner_cluster_default ( struct engine *e , struct MxPotential **pdef , FPTYPE *r2def ) {
+
+    int k;
+    struct MxPotential *p;
+
+    for ( k = 0 ; k < e->max_type * e->max_type ; k++ )
+        if ( ( p = e->p[k] ) != NULL ) {
+            *pdef = p;
+            *r2def = 0.25 * ( p->a + p->b ) * ( p->a + p->b );
+            return 1;
+            }
+
+    return 0;
+
+    }
+
+
+/**
+ * @brief Group the particles of the given cell into clusters and copy
+ *      their positions.
+ *
+ * @param r The #runner.
+ * @param c The #cell.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * When the neighbour lists are being re-built, the particles are sorted
+ * along a Morton curve through the cell and consecutive runs of
+ * @c verlet_clustersize particles form the clusters, the last one padded,
+ * and the bounding boxes of the clusters are computed. Otherwise only the
+ * positions and types, and which of the particles have exclusions, are
+ * copied from the particles.
+ */
+
+int runner_cluster_pack ( struct runner *r , struct space_cell *c ) {
+
+    struct space *s = &r->e->s;
+    struct MxParticle *p;
+    int k, m, d, M, pid, size, count = c->count;
+    unsigned int *keys, ind[3];
+    FPTYPE *x, *bb, scale[3];
+
+    /* Form new clusters? */
+    if ( s->verlet_rebuild ) {
+
+        /* Is the cell too crowded for the sort? */
+        if ( count > ( 1 << space_verlet_pidbits ) )
+            return error(runner_err_verlet_overflow);
+
+        /* Make sure there is room for the padded clusters. */
+        M = s->verlet_clustersize;
+        size = M * ( ( count + M - 1 ) / M );
+        if ( c->clu_alloc < size || c->clu_size != M ) {
+            free( c->clu_x ); free( c->clu_bb ); free( c->clu_pid ); free( c->clu_typeId ); free( c->clu_excl );
+            size = M * ( ( (int)( space_verlet_grow * count ) + M ) / M );
+            if ( ( c->clu_x = (FPTYPE *)malloc( sizeof(FPTYPE) * 3 * size ) ) == NULL ||
+                 ( c->clu_bb = (FPTYPE *)malloc( sizeof(FPTYPE) * 6 * ( size / M ) ) ) == NULL ||
+                 ( c->clu_pid = (int *)malloc( sizeof(int) * size ) ) == NULL ||
+                 ( c->clu_typeId = (int *)malloc( sizeof(int) * size ) ) == NULL ||
+                 ( c->clu_excl = (int *)malloc( sizeof(int) * ( size / M ) ) ) == NULL )
+                return error(runner_err_malloc);
+            c->clu_alloc = size;
+            }
+        c->clu_size = M;
+        c->nr_clusters = ( count + M - 1 ) / M;
+        c->clu_nparts = count;
+
+        /* Sort the particles by their Morton key, in place. */
+        keys = (unsigned int *)c->clu_pid;
+        for ( d = 0 ; d < 3 ; d++ )
+            scale[d] = ( 1 << runner_cluster_keybits ) / c->dim[d];
+        for ( pid = 0 ; pid < count ; pid++ ) {
+            for ( d = 0 ; d < 3 ; d++ ) {
+                k = c->parts[pid].x[d] * scale[d];
+                ind[d] = ( k < 0 ) ? 0 : ( k >= ( 1 << runner_cluster_keybits ) ) ? ( 1 << runner_cluster_keybits ) - 1 : k;
+                }
+            keys[pid] = ( (unsigned int)pid << 16 ) | runner_cluster_key( ind[0] , ind[1] , ind[2] );
+            }
+        runner_sort_ascending( keys , count );
+        for ( pid = 0 ; pid < count ; pid++ )
+            c->clu_pid[pid] = keys[pid] >> 16;
+        for ( pid = count ; pid < c->nr_clusters * M ; pid++ )
+            c->clu_pid[pid] = -1;
+
+        }
+
+    /* Were the clusters formed from these particles? */
+    else if ( c->clu_nparts != count )
+        return error(runner_err_verlet_stale);
+
+    /* Copy the positions and types, padding with the origin, and note
+       which particles have exclusions. */
+    M = c->clu_size;
+    for ( k = 0 ; k < c->nr_clusters ; k++ ) {
+        x = &c->clu_x[ 3*k*M ];
+        c->clu_excl[k] = 0;
+        for ( m = 0 ; m < M ; m++ ) {
+            if ( ( pid = c->clu_pid[ k*M + m ] ) < 0 ) {
+                x[m] = x[M+m] = x[2*M+m] = FPTYPE_ZERO;
+                c->clu_typeId[ k*M + m ] = 0;
+                continue;
+                }
+            p = &c->parts[pid];
+            x[m] = p->x[0]; x[M+m] = p->x[1]; x[2*M+m] = p->x[2];
+            c->clu_typeId[ k*M + m ] = p->typeId;
+            if ( p->flags & PARTICLE_FLAG_EXCLUDED )
+                c->clu_excl[k] |= 1 << m;
+            }
+        }
+
+    /* Get the bounding boxes of the new clusters. */
+    if ( s->verlet_rebuild )
+        for ( k = 0 ; k < c->nr_clusters ; k++ ) {
+            x = &c->clu_x[ 3*k*M ];
+            bb = &c->clu_bb[ 6*k ];
+            for ( d = 0 ; d < 3 ; d++ ) {
+                bb[d] = bb[3+d] = x[d*M];
+                for ( m = 1 ; m < M && c->clu_pid[ k*M + m ] >= 0 ; m++ ) {
+                    bb[d] = fmin( bb[d] , x[d*M+m] );
+                    bb[3+d] = fmax( bb[3+d] , x[d*M+m] );
+                    }
+                }
+            }
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Re-build the cluster-pair list of the given cell.
+ *
+ * @param r The #runner.
+ * @param c The #cell, packed with #runner_cluster_pack, as must be the
+ *      cells it is paired with.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Stores, for every cluster in @c c, the clusters in the cells paired
+ * with @c c whose bounding box is within the cutoff plus the skin of the
+ * #space of its own. Within @c c itself, only the cluster itself and the
+ * ones following it are stored, such that every pair appears only once.
+ */
+
+int runner_cluster_build ( struct runner *r , struct space_cell *c ) {
+
+    struct space *s = &r->e->s;
+    struct space_cell *cells[space_verlet_maxcells];
+    int ci, cj, d, l, nr_cells, ind, size;
+    unsigned int *list;
+    FPTYPE shift[3*space_verlet_maxcells];
+    FPTYPE rl2, r2, w, *bbi, *bbj;
+
+    /* Make sure there is room for the offsets. */
+    if ( c->clu_offset_size < c->nr_clusters + 1 ) {
+        free( c->clu_offset );
+        size = space_verlet_grow * c->nr_clusters + 1;
+        if ( ( c->clu_offset = (int *)malloc( sizeof(int) * size ) ) == NULL )
+            return error(runner_err_malloc);
+        c->clu_offset_size = size;
+        }
+
+    /* Get the paired cells and the list radius. */
+    nr_cells = runner_verlet_cells( s , c , cells , shift );
+    rl2 = ( s->cutoff + s->verlet_skin ) * ( s->cutoff + s->verlet_skin );
+
+    /* Loop over the clusters in this cell. */
+    list = c->clu_list;
+    for ( ind = 0 , ci = 0 ; ci < c->nr_clusters ; ci++ ) {
+
+        bbi = &c->clu_bb[ 6*ci ];
+        c->clu_offset[ci] = ind;
+
+        for ( l = 0 ; l < nr_cells ; l++ ) {
+            for ( cj = ( l == 0 ) ? ci : 0 ; cj < cells[l]->nr_clusters ; cj++ ) {
+
+                /* Get the distance between both bounding boxes. */
+                bbj = &cells[l]->clu_bb[ 6*cj ];
+                for ( r2 = FPTYPE_ZERO , d = 0 ; d < 3 ; d++ ) {
+                    w = fmax( bbj[d] + shift[3*l+d] - bbi[3+d] , bbi[d] - bbj[3+d] - shift[3*l+d] );
+                    if ( w > FPTYPE_ZERO )
+                        r2 += w * w;
+                    }
+                if ( r2 > rl2 )
+                    continue;
+
+                /* make room if needed and store the entry. */
+                if ( ind == c->clu_list_size ) {
+                    size = space_verlet_grow * c->clu_list_size + c->nr_clusters;
+                    if ( ( list = (unsigned int *)realloc( c->clu_list , sizeof(unsigned int) * size ) ) == NULL )
+                        return error(runner_err_malloc);
+                    c->clu_list = list;
+                    c->clu_list_size = size;
+                    }
+                list[ind] = space_verlet_entry( l , cj );
+                ind += 1;
+
+                }
+            }
+
+        }
+
+    /* Close the last row. */
+    c->clu_offset[ c->nr_clusters ] = ind;
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Add the forces on the particles of a cluster in a paired cell.
+ *
+ * The forces on particles of the cell being traversed, i.e. @c l is zero,
+ * go to the particles, all others to @c f_out.
+ */
+
+static inline void runner_cluster_addf ( struct space_cell *c , int k , int l , FPTYPE (*fj)[space_cluster_maxsize] , FPTYPE *f_out ) {
+
+    int m, d, M = c->clu_size;
+    struct MxParticle *p;
+    FPTYPE *pjf;
+
+    for ( m = 0 ; m < M && c->clu_pid[ k*M + m ] >= 0 ; m++ ) {
+        p = &c->parts[ c->clu_pid[ k*M + m ] ];
+        pjf = ( l == 0 ) ? p->f : &f_out[ 4*p->id ];
+        for ( d = 0 ; d < 3 ; d++ )
+            pjf[d] += fj[d][m];
+        }
+
+    }
+
+
+/**
+ * @brief Find the excluded pairs of particles of two clusters.
+ *
+ * @return A bitmask with bit @c i*M+j set if the @c i-th particle of the
+ *      @c ci-th cluster of @c c and the @c j-th particle of the @c jc-th
+ *      cluster of @c cj are excluded (see #engine_excluded).
+ */
+
+static inline unsigned long long runner_cluster_excluded ( struct engine *e , struct space_cell *c , int ci , struct space_cell *cj , int jc ) {
+
+    int i, j, M = c->clu_size, ei = c->clu_excl[ci], ej = cj->clu_excl[jc];
+    unsigned long long bits = 0;
+
+    for ( i = 0 ; i < M ; i++ )
+        if ( ei & ( 1 << i ) )
+            for ( j = 0 ; j < M ; j++ )
+                if ( ( ej & ( 1 << j ) ) &&
+                     engine_excluded( e , &c->parts[ c->clu_pid[ ci*M + i ] ] , &cj->parts[ cj->clu_pid[ jc*M + j ] ] ) )
+                    bits |= 1ull << ( i*M + j );
+
+    return bits;
+
+    }
+
+
+/**
+ * @brief Compute the interactions of the clusters of the given cell.
+ *
+ * @param r The #runner.
+ * @param c The #cell.
+ * @param f_out A pointer to an array of #FPTYPE, four per particle ID,
+ *        in which to aggregate the forces on particles in other cells.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Computes all @c M x @c M interactions between each cluster of @c c and
+ * the clusters in its list, masking out those beyond the cutoff, those
+ * with padding, the excluded ones (see #runner_cluster_excluded) and,
+ * within a cluster, those with @c j not below @c i.
+ * Forces and energies are distributed as in #runner_verlet_eval.
+ */
+
+template <int kind , int M> __attribute__ ((flatten)) static int runner_docluster_tile ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
+
+    struct engine *eng = r->e;
+    struct space *s = &eng->s;
+    struct space_cell *cells[space_verlet_maxcells], *cj;
+    struct MxPotential *pot, **pots = eng->p, **prow[M];
+    int ci, jc, i, j, k, l, n, ni, nj, nr_cells, emt = eng->max_type, *jtype;
+    unsigned int entry;
+    unsigned long long xbits;
+    FPTYPE shift[3*space_verlet_maxcells];
+    FPTYPE cutoff2 = s->cutoff2, r2, e, f, w, dx[3], *xi, *xj;
+    FPTYPE fi[3][space_cluster_maxsize], fj[3][space_cluster_maxsize];
+    double epot[space_verlet_maxcells];
+
+    /* Get the paired cells and some other useful things. */
+    nr_cells = runner_verlet_cells( s , c , cells , shift );
+    for ( l = 0 ; l < nr_cells ; l++ )
+        epot[l] = 0.0;
+
+    /* Loop over the clusters in this cell. */
+    for ( ci = 0 ; ci < c->nr_clusters ; ci++ ) {
+
+        xi = &c->clu_x[ 3*ci*M ];
+        ni = c->clu_nparts - ci*M;
+        for ( i = 0 ; i < M ; i++ )
+            prow[i] = &pots[ c->clu_typeId[ ci*M + i ] * emt ];
+        bzero( fi , sizeof(fi) );
+
+        /* Loop over the clusters it is paired with. */
+        for ( n = c->clu_offset[ci] ; n < c->clu_offset[ci+1] ; n++ ) {
+
+            /* unpack the entry */
+            entry = c->clu_list[n];
+            l = entry >> space_verlet_pidbits;
+            jc = entry & ( ( 1u << space_verlet_pidbits ) - 1 );
+            cj = cells[l];
+            xj = &cj->clu_x[ 3*jc*M ];
+            jtype = &cj->clu_typeId[ jc*M ];
+            nj = cj->clu_nparts - jc*M;
+            xbits = ( c->clu_excl[ci] && cj->clu_excl[jc] ) ? runner_cluster_excluded( eng , c , ci , cj , jc ) : 0;
+            bzero( fj , sizeof(fj) );
+
+            /* compute the tile */
+            for ( i = 0 ; i < M && i < ni ; i++ ) {
+                for ( j = 0 ; j < M && j < nj ; j++ ) {
+
+                    /* only the lower triangle of a cluster with itself */
+                    if ( l == 0 && jc == ci && j >= i )
+                        break;
+
+                    for ( r2 = FPTYPE_ZERO , k = 0 ; k < 3 ; k++ ) {
+                        dx[k] = xi[k*M+i] - shift[3*l+k] - xj[k*M+j];
+                        r2 += dx[k] * dx[k];
+                        }
+                    if ( r2 > cutoff2 || ( pot = prow[i][ jtype[j] ] ) == NULL || ( ( xbits >> ( i*M + j ) ) & 1 ) )
+                        continue;
+
+                    potential_eval_kind<kind>( pot , r2 , &e , &f );
+                    for ( k = 0 ; k < 3 ; k++ ) {
+                        w = f * dx[k];
+                        fi[k][i] -= w;
+                        fj[k][j] += w;
+                        }
+                    epot[l] += e;
+
+                    }
+                }
+
+            runner_cluster_addf( cj , jc , l , fj , f_out );
+
+            }
+
+        runner_cluster_addf( c , ci , 0 , fi , f_out );
+
+        }
+
+    /* Store the accumulated potential energy. */
+    for ( l = 0 ; l < nr_cells ; l++ )
+        c->epot += ( cells[l]->flags & cell_flag_ghost ) ? 0.5 * epot[l] : epot[l];
+
+    /* All has gone well. */
+    return runner_err_ok;
+
+    }
+
+
+#ifdef RUNNER_SIMD
+
+/* Load the coordinates of a cluster into the low lanes of a register. */
+#define runner_cluster_load_avx2(M,x) \
+    ( ( (M) == 8 ) ? _mm256_loadu_ps( x ) : _mm256_castps128_ps256( _mm_loadu_ps( x ) ) )
+#define runner_cluster_load_avx512(M,x) \
+    ( ( (M) == 8 ) ? _mm512_castps256_ps512( _mm256_loadu_ps( x ) ) : _mm512_castps128_ps512( _mm_loadu_ps( x ) ) )
+
+
+/**
+ * @brief Compute the interactions of the clusters of the given cell (AVX2).
+ *
+ * Same as #runner_docluster_tile, but the tiles are computed eight
+ * interactions at a time, @c 8/M rows of the tile per register. The
+ * coordinates of both clusters are loaded once per tile and spread over
+ * the lanes with permutes.
+ */
+
+template <int kind , int M> __attribute__ ((target("avx2,fma"))) static int runner_docluster_avx2_tile ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
+
+    const int G = M * M / 8;
+    struct engine *eng = r->e;
+    struct space *s = &eng->s;
+    struct space_cell *cells[space_verlet_maxcells], *cj;
+    struct MxPotential *pdef, *pot, *potq[8], **pots = eng->p, **prow[M];
+    int ci, jc, g, k, l, m, n, ni, nj, bits, nr_cells, emt = eng->max_type, *jtype;
+    int ind[8] __attribute__ ((aligned (32)));
+    unsigned int entry;
+    unsigned long long xbits;
+    FPTYPE shift[3*space_verlet_maxcells], r2def;
+    float r2l[8] __attribute__ ((aligned (32)));
+    float r2q[8] __attribute__ ((aligned (32)));
+    float e[8] __attribute__ ((aligned (32)));
+    float f[8] __attribute__ ((aligned (32)));
+    float fil[3][M*M] __attribute__ ((aligned (32)));
+    float fjl[3][8] __attribute__ ((aligned (32)));
+    FPTYPE fi[3][space_cluster_maxsize], fj[3][space_cluster_maxsize];
+    double epot[space_verlet_maxcells];
+    __m256i vi[G], vj, lanebits;
+    __m256 xci[3], xi[3], xj[3], dx[3], r2, mask, fv, w, ftile[3], etile, cutoff2;
+
+    /* Is there anything to interact with? */
+    if ( !runner_cluster_default( eng , &pdef , &r2def ) )
+        return runner_err_ok;
+
+    /* Get the paired cells and some other useful things. */
+    nr_cells = runner_verlet_cells( s , c , cells , shift );
+    for ( l = 0 ; l < nr_cells ; l++ )
+        epot[l] = 0.0;
+    cutoff2 = _mm256_set1_ps( s->cutoff2 );
+    lanebits = _mm256_setr_epi32( 1 , 2 , 4 , 8 , 16 , 32 , 64 , 128 );
+
+    /* Lane k of the g-th register holds the interaction of particle
+       (8*g + k) / M of the first cluster with particle k % M of the
+       second, i.e. bit 8*g + k of the excluded pairs. */
+    for ( k = 0 ; k < 8 ; k++ )
+        ind[k] = k % M;
+    vj = _mm256_load_si256( (__m256i *)ind );
+    for ( g = 0 ; g < G ; g++ ) {
+        for ( k = 0 ; k < 8 ; k++ )
+            ind[k] = ( 8*g + k ) / M;
+        vi[g] = _mm256_load_si256( (__m256i *)ind );
+        }
+
+    /* Loop over the clusters in this cell. */
+    for ( ci = 0 ; ci < c->nr_clusters ; ci++ ) {
+
+        for ( k = 0 ; k < 3 ; k++ )
+            xci[k] = runner_cluster_load_avx2( M , &c->clu_x[ (3*ci + k)*M ] );
+        ni = c->clu_nparts - ci*M;
+        for ( m = 0 ; m < M ; m++ )
+            prow[m] = &pots[ c->clu_typeId[ ci*M + m ] * emt ];
+        bzero( fil , sizeof(fil) );
+
+        /* Loop over the clusters it is paired with. */
+        for ( n = c->clu_offset[ci] ; n < c->clu_offset[ci+1] ; n++ ) {
+
+            /* unpack the entry */
+            entry = c->clu_list[n];
+            l = entry >> space_verlet_pidbits;
+            jc = entry & ( ( 1u << space_verlet_pidbits ) - 1 );
+            cj = cells[l];
+            jtype = &cj->clu_typeId[ jc*M ];
+            nj = cj->clu_nparts - jc*M;
+            xbits = ( c->clu_excl[ci] && cj->clu_excl[jc] ) ? runner_cluster_excluded( eng , c , ci , cj , jc ) : 0;
+            for ( k = 0 ; k < 3 ; k++ ) {
+                xi[k] = _mm256_sub_ps( xci[k] , _mm256_set1_ps( shift[3*l+k] ) );
+                xj[k] = runner_cluster_load_avx2( M , &cj->clu_x[ (3*jc + k)*M ] );
+                xj[k] = _mm256_permutevar8x32_ps( xj[k] , vj );
+                ftile[k] = _mm256_setzero_ps();
+                }
+            etile = _mm256_setzero_ps();
+
+            /* compute the tile */
+            for ( g = 0 ; g < G ; g++ ) {
+
+                /* get the distances and mask out what is not interacting */
+                for ( k = 0 ; k < 3 ; k++ )
+                    dx[k] = _mm256_sub_ps( _mm256_permutevar8x32_ps( xi[k] , vi[g] ) , xj[k] );
+                r2 = _mm256_fmadd_ps( dx[0] , dx[0] , _mm256_fmadd_ps( dx[1] , dx[1] , _mm256_mul_ps( dx[2] , dx[2] ) ) );
+                mask = _mm256_and_ps( _mm256_cmp_ps( r2 , cutoff2 , _CMP_LE_OQ ) ,
+                                      _mm256_castsi256_ps( _mm256_and_si256( _mm256_cmpgt_epi32( _mm256_set1_epi32( ni ) , vi[g] ) ,
+                                                                             _mm256_cmpgt_epi32( _mm256_set1_epi32( nj ) , vj ) ) ) );
+                if ( l == 0 && jc == ci )
+                    mask = _mm256_and_ps( mask , _mm256_castsi256_ps( _mm256_cmpgt_epi32( vi[g] , vj ) ) );
+                if ( ( bits = _mm256_movemask_ps( mask ) & ~(int)( ( xbits >> 8*g ) & 0xff ) ) == 0 )
+                    continue;
+
+                /* fetch the potentials, filling the other lanes */
+                _mm256_store_ps( r2l , r2 );
+                for ( k = 0 ; k < 8 ; k++ ) {
+                    if ( ( bits & ( 1 << k ) ) && ( pot = prow[ ( 8*g + k ) / M ][ jtype[ k % M ] ] ) != NULL ) {
+                        potq[k] = pot;
+                        r2q[k] = r2l[k];
+                        }
+                    else {
+                        bits &= ~( 1 << k );
+                        potq[k] = pdef;
+                        r2q[k] = r2def;
+                        }
+                    }
+                if ( bits == 0 )
+                    continue;
+
+                /* evaluate the interactions */
+                potential_eval_vec_8single_avx2_kind<kind>( potq , r2q , e , f );
+                mask = _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_and_si256( _mm256_set1_epi32( bits ) , lanebits ) , _mm256_setzero_si256() ) );
+                fv = _mm256_and_ps( _mm256_load_ps( f ) , mask );
+                etile = _mm256_add_ps( etile , _mm256_and_ps( _mm256_load_ps( e ) , mask ) );
+
+                /* pif -= w and pjf += w, as in runner_doself */
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    w = _mm256_mul_ps( fv , dx[k] );
+                    _mm256_store_ps( &fil[k][8*g] , _mm256_sub_ps( _mm256_load_ps( &fil[k][8*g] ) , w ) );
+                    ftile[k] = _mm256_add_ps( ftile[k] , w );
+                    }
+
+                }
+
+            /* collect the forces on the second cluster and the energy */
+            for ( k = 0 ; k < 3 ; k++ ) {
+                _mm256_store_ps( fjl[k] , ftile[k] );
+                for ( m = 0 ; m < M ; m++ )
+                    for ( fj[k][m] = FPTYPE_ZERO , g = m ; g < 8 ; g += M )
+                        fj[k][m] += fjl[k][g];
+                }
+            runner_cluster_addf( cj , jc , l , fj , f_out );
+            _mm256_store_ps( e , etile );
+            for ( k = 0 ; k < 8 ; k++ )
+                epot[l] += e[k];
+
+            }
+
+        /* collect the forces on this cluster */
+        for ( k = 0 ; k < 3 ; k++ )
+            for ( m = 0 ; m < M ; m++ )
+                for ( fi[k][m] = FPTYPE_ZERO , g = 0 ; g < M ; g++ )
+                    fi[k][m] += fil[k][ m*M + g ];
+        runner_cluster_addf( c , ci , 0 , fi , f_out );
+
+        }
+
+    /* Store the accumulated potential energy. */
+    for ( l = 0 ; l < nr_cells ; l++ )
+        c->epot += ( cells[l]->flags & cell_flag_ghost ) ? 0.5 * epot[l] : epot[l];
+
+    /* All has gone well. */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Compute the interactions of the clusters of the given cell
+ *      (AVX-512).
+ *
+ * Same as #runner_docluster_avx2_tile, but sixteen wide.
+ */
+
+template <int kind , int M> __attribute__ ((target("avx512f,avx2,fma"))) static int runner_docluster_avx512_tile ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
+
+    const int G = M * M / 16;
+    struct engine *eng = r->e;
+    struct space *s = &eng->s;
+    struct space_cell *cells[space_verlet_maxcells], *cj;
+    struct MxPotential *pdef, *pot, *potq[16], **pots = eng->p, **prow[M];
+    int ci, jc, g, k, l, m, n, ni, nj, nr_cells, emt = eng->max_type, *jtype;
+    int ind[16] __attribute__ ((aligned (64)));
+    unsigned int entry;
+    unsigned long long xbits;
+    __mmask16 bits;
+    FPTYPE shift[3*space_verlet_maxcells], r2def;
+    float r2l[16] __attribute__ ((aligned (64)));
+    float r2q[16] __attribute__ ((aligned (64)));
+    float e[16] __attribute__ ((aligned (64)));
+    float f[16] __attribute__ ((aligned (64)));
+    float fil[3][M*M] __attribute__ ((aligned (64)));
+    float fjl[3][16] __attribute__ ((aligned (64)));
+    FPTYPE fi[3][space_cluster_maxsize], fj[3][space_cluster_maxsize];
+    double epot[space_verlet_maxcells];
+    __m512i vi[G], vj;
+    __m512 xci[3], xi[3], xj[3], dx[3], r2, fv, w, ftile[3], etile, cutoff2;
+
+    /* Is there anything to interact with? */
+    if ( !runner_cluster_default( eng , &pdef , &r2def ) )
+        return runner_err_ok;
+
+    /* Get the paired cells and some other useful things. */
+    nr_cells = runner_verlet_cells( s , c , cells , shift );
+    for ( l = 0 ; l < nr_cells ; l++ )
+        epot[l] = 0.0;
+    cutoff2 = _mm512_set1_ps( s->cutoff2 );
+
+    /* Lane k of the g-th register holds the interaction of particle
+       (16*g + k) / M of the first cluster with particle k % M of the
+       second, i.e. bit 16*g + k of the excluded pairs. */
+    for ( k = 0 ; k < 16 ; k++ )
+        ind[k] = k % M;
+    vj = _mm512_load_si512( ind );
+    for ( g = 0 ; g < G ; g++ ) {
+        for ( k = 0 ; k < 16 ; k++ )
+            ind[k] = ( 16*g + k ) / M;
+        vi[g] = _mm512_load_si512( ind );
+        }
+
+    /* Loop over the clusters in this cell. */
+    for ( ci = 0 ; ci < c->nr_clusters ; ci++ ) {
+
+        for ( k = 0 ; k < 3 ; k++ )
+            xci[k] = runner_cluster_load_avx512( M , &c->clu_x[ (3*ci + k)*M ] );
+        ni = c->clu_nparts - ci*M;
+        for ( m = 0 ; m < M ; m++ )
+            prow[m] = &pots[ c->clu_typeId[ ci*M + m ] * emt ];
+        bzero( fil , sizeof(fil) );
+
+        /* Loop over the clusters it is paired with. */
+        for ( n = c->clu_offset[ci] ; n < c->clu_offset[ci+1] ; n++ ) {
+
+            /* unpack the entry */
+            entry = c->clu_list[n];
+            l = entry >> space_verlet_pidbits;
+            jc = entry & ( ( 1u << space_verlet_pidbits ) - 1 );
+            cj = cells[l];
+            jtype = &cj->clu_typeId[ jc*M ];
+            nj = cj->clu_nparts - jc*M;
+            xbits = ( c->clu_excl[ci] && cj->clu_excl[jc] ) ? runner_cluster_excluded( eng , c , ci , cj , jc ) : 0;
+            for ( k = 0 ; k < 3 ; k++ ) {
+                xi[k] = _mm512_sub_ps( xci[k] , _mm512_set1_ps( shift[3*l+k] ) );
+                xj[k] = runner_cluster_load_avx512( M , &cj->clu_x[ (3*jc + k)*M ] );
+                xj[k] = _mm512_permutexvar_ps( vj , xj[k] );
+                ftile[k] = _mm512_setzero_ps();
+                }
+            etile = _mm512_setzero_ps();
+
+            /* compute the tile */
+            for ( g = 0 ; g < G ; g++ ) {
+
+                /* get the distances and mask out what is not interacting */
+                for ( k = 0 ; k < 3 ; k++ )
+                    dx[k] = _mm512_sub_ps( _mm512_permutexvar_ps( vi[g] , xi[k] ) , xj[k] );
+                r2 = _mm512_fmadd_ps( dx[0] , dx[0] , _mm512_fmadd_ps( dx[1] , dx[1] , _mm512_mul_ps( dx[2] , dx[2] ) ) );
+                bits = _mm512_cmp_ps_mask( r2 , cutoff2 , _CMP_LE_OQ ) &
+                       _mm512_cmpgt_epi32_mask( _mm512_set1_epi32( ni ) , vi[g] ) &
+                       _mm512_cmpgt_epi32_mask( _mm512_set1_epi32( nj ) , vj );
+                if ( l == 0 && jc == ci )
+                    bits &= _mm512_cmpgt_epi32_mask( vi[g] , vj );
+                bits &= ~(__mmask16)( ( xbits >> 16*g ) & 0xffff );
+                if ( bits == 0 )
+                    continue;
+
+                /* fetch the potentials, filling the other lanes */
+                _mm512_store_ps( r2l , r2 );
+                for ( k = 0 ; k < 16 ; k++ ) {
+                    if ( ( bits & ( 1 << k ) ) && ( pot = prow[ ( 16*g + k ) / M ][ jtype[ k % M ] ] ) != NULL ) {
+                        potq[k] = pot;
+                        r2q[k] = r2l[k];
+                        }
+                    else {
+                        bits &= ~( 1 << k );
+                        potq[k] = pdef;
+                        r2q[k] = r2def;
+                        }
+                    }
+                if ( bits == 0 )
+                    continue;
+
+                /* evaluate the interactions */
+                potential_eval_vec_16single_avx512_kind<kind>( potq , r2q , e , f );
+                fv = _mm512_maskz_mov_ps( bits , _mm512_load_ps( f ) );
+                etile = _mm512_mask_add_ps( etile , bits , etile , _mm512_load_ps( e ) );
+
+                /* pif -= w and pjf += w, as in runner_doself */
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    w = _mm512_mul_ps( fv , dx[k] );
+                    _mm512_store_ps( &fil[k][16*g] , _mm512_sub_ps( _mm512_load_ps( &fil[k][16*g] ) , w ) );
+                    ftile[k] = _mm512_add_ps( ftile[k] , w );
+                    }
+
+                }
+
+            /* collect the forces on the second cluster and the energy */
+            for ( k = 0 ; k < 3 ; k++ ) {
+                _mm512_store_ps( fjl[k] , ftile[k] );
+                for ( m = 0 ; m < M ; m++ )
+                    for ( fj[k][m] = FPTYPE_ZERO , g = m ; g < 16 ; g += M )
+                        fj[k][m] += fjl[k][g];
+                }
+            runner_cluster_addf( cj , jc , l , fj , f_out );
+            epot[l] += _mm512_reduce_add_ps( etile );
+
+            }
+
+        /* collect the forces on this cluster */
+        for ( k = 0 ; k < 3 ; k++ )
+            for ( m = 0 ; m < M ; m++ )
+                for ( fi[k][m] = FPTYPE_ZERO , g = 0 ; g < M ; g++ )
+                    fi[k][m] += fil[k][ m*M + g ];
+        runner_cluster_addf( c , ci , 0 , fi , f_out );
+
+        }
+
+    /* Store the accumulated potential energy. */
+    for ( l = 0 ; l < nr_cells ; l++ )
+        c->epot += ( cells[l]->flags & cell_flag_ghost ) ? 0.5 * epot[l] : epot[l];
+
+    /* All has gone well. */
+    return runner_err_ok;
+
+    }
+
+#endif
+
+
+/**
+ * @brief Pick the tile kernel for the cluster size and the CPU.
+ */
+
+template <int kind> static int runner_docluster_kind ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
+
+#ifdef RUNNER_SIMD
+    if ( r->simd == runner_simd_avx512 )
+        return ( c->clu_size == 4 ) ? runner_docluster_avx512_tile<kind,4>( r , c , f_out ) :
+                                      runner_docluster_avx512_tile<kind,8>( r , c , f_out );
+    if ( r->simd == runner_simd_avx2 )
+        return ( c->clu_size == 4 ) ? runner_docluster_avx2_tile<kind,4>( r , c , f_out ) :
+                                      runner_docluster_avx2_tile<kind,8>( r , c , f_out );
+#endif
+
+    return ( c->clu_size == 4 ) ? runner_docluster_tile<kind,4>( r , c , f_out ) :
+                                  runner_docluster_tile<kind,8>( r , c , f_out );
+
+    }
+
+
+/**
+ * @brief Compute the interactions of the clusters of the given cell.
+ *
+ * @param r The #runner.
+ * @param c The #cell, packed with #runner_cluster_pack and with its list
+ *      built by #runner_cluster_build.
+ * @param f_out A pointer to an array of #FPTYPE, four per particle ID,
+ *        in which to aggregate the forces on particles in other cells.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Calls the tile kernel for the closed form shared by all the potentials
+ * of the #engine, using the widest SIMD instructions available.
+ */
+
+int runner_docluster ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
+
+    /* Were the clusters formed from these particles? */
+    if ( c->clu_nparts != c->count )
+        return error(runner_err_verlet_stale);
+    if ( c->nr_clusters == 0 )
+        return runner_err_ok;
+
+    potential_kind_dispatch( r->e->pot_kind , runner_docluster_kind , ( r , c , f_out ) );
+
+    }
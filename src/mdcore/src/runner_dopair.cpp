@@ -49,6 +49,7 @@
 #include <MxPotential.h>
 #include "potential_eval.h"
 #include "engine.h"
+#include "engine_excluded.h"
 #include "runner.h"
 #include "MxForce.h"
 
@@ -75,9 +76,12 @@ extern unsigned int runner_rcount;
  * the paritcles in @c cell_j. @c cell_i and @c cell_j may be the same cell.
  *
  * @sa #runner_sortedpair.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
  */
 
-__attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+template <int kind> __attribute__ ((flatten)) static int runner_dopair_kind ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
 
     struct MxParticle *part_i, *part_j;
     struct space *s;
@@ -90,7 +94,7 @@ __attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_ce
     unsigned int *iparts, *jparts;
     FPTYPE dscale;
     FPTYPE shift[3], nshift, bias;
-    FPTYPE *pif;
+    FPTYPE *pif, *pjf, *eff = runner_fbuf( r );
     int pid, count_i, count_j;
     double epot = 0.0;
 #if defined(VECTORIZE)
@@ -164,7 +168,7 @@ __attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_ce
         pix[1] = part_i->x[1] - shift[1];
         pix[2] = part_i->x[2] - shift[2];
         pioff = part_i->typeId * emt;
-        pif = &( part_i->f[0] );
+        pif = runner_pf( eff , part_i );
 
         /* loop over the left particles */
         for ( j = count_j-1 ; j >= 0 && (jparts[j] & 0xffff) + dnshift - (iparts[i] & 0xffff) < dmaxdist ; j-- ) {
@@ -183,6 +187,10 @@ __attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_ce
             /* is this within cutoff? */
             if ( r2 > cutoff2 )
                 continue;
+
+            /* is this pair excluded? */
+            if ( engine_excluded( eng , part_i , part_j ) )
+                continue;
             // runner_rcount += 1;
 
             #if defined(VECTORIZE)
@@ -192,7 +200,7 @@ __attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_ce
                 dxq[icount*3+1] = dx[1];
                 dxq[icount*3+2] = dx[2];
                 effi[icount] = pif;
-                effj[icount] = part_j->f;
+                effj[icount] = runner_pf( eff , part_j );
                 potq[icount] = pot;
                 icount += 1;
 
@@ -229,17 +237,14 @@ __attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_ce
                     }
             #else
                 /* evaluate the interaction */
-                #ifdef EXPLICIT_POTENTIALS
-                    potential_eval_expl( pot , r2 , &e , &f );
-                #else
-                    potential_eval( pot , r2 , &e , &f );
-                #endif
+                potential_eval_kind<kind>( pot , r2 , &e , &f );
 
                 /* update the forces */
+                pjf = runner_pf( eff , part_j );
                 for ( k = 0 ; k < 3 ; k++ ) {
                     w = f * dx[k];
-                    part_j->f[k] -= w;
-                    pif[k] += w;
+                    pif[k] -= w;
+                    pjf[k] += w;
                     }
 
                 /* tabulate the energy */
@@ -291,9 +296,9 @@ __attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_ce
         
     /* Store the potential energy to cell_i. */
     if ( cell_j->flags & cell_flag_ghost || cell_i->flags & cell_flag_ghost )
-        cell_i->epot += 0.5 * epot;
+        runner_epot( r , eff , cell_i ) += 0.5 * epot;
     else
-        cell_i->epot += epot;
+        runner_epot( r , eff , cell_i ) += epot;
         
     /* Write local data back if needed. */
     if ( r->e->flags & engine_flag_localparts ) {
@@ -325,9 +330,12 @@ __attribute__ ((flatten)) int runner_dopair ( struct runner *r , struct space_ce
  * @param cell_i The first cell.
  *
  * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
  */
 
-__attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_cell *c ) {
+template <int kind> __attribute__ ((flatten)) static int runner_doself_kind ( struct runner *r , struct space_cell *c ) {
 
     struct MxParticle *part_i, *part_j;
     struct space *s;
@@ -336,12 +344,10 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
     struct MxParticle *parts;
     double epot = 0.0;
     struct MxPotential *pot, **pots;
-    // single body force and forces
-    MxForce *psb, **psbs;
     struct engine *eng;
     int emt, pioff;
     FPTYPE cutoff2, r2, w;
-    FPTYPE *pif;
+    FPTYPE *pif, *pjf, *eff = runner_fbuf( r );
 #if defined(VECTORIZE)
     struct MxPotential *potq[VEC_SIZE];
     int icount = 0, l;
@@ -366,7 +372,6 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
     emt = eng->max_type;
     s = &(eng->s);
     pots = eng->p;
-    psbs = eng->p_singlebody;
     cutoff2 = s->cutoff2;
     pix[3] = FPTYPE_ZERO;
     
@@ -379,15 +384,6 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
         parts = c->parts;
     }
 
-    // Because of loop indexing over all particles starting at one,
-    // do the first single-body force calculation here.
-    part_i = &(parts[0]);
-    psb = psbs[part_i->typeId];
-    if(psb) {
-        psb->func(psb, part_i, part_i->f);
-    }
-
-        
     // loop over all particles , indexing here only calculates pairwise
     // interactions, and avoids self-interactions.
     for ( i = 1 ; i < count ; i++ ) {
@@ -398,13 +394,7 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
         pix[1] = part_i->x[1];
         pix[2] = part_i->x[2];
         pioff = part_i->typeId * emt;
-        pif = &( part_i->f[0] );
-
-        // calculate single body force if any
-        psb = psbs[part_i->typeId];
-        if(psb) {
-            psb->func(psb, part_i, part_i->f);
-        }
+        pif = runner_pf( eff , part_i );
 
         /* loop over all other particles */
         for ( j = 0 ; j < i ; j++ ) {
@@ -430,6 +420,10 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
             if(r2 > (pot->b * pot->b) ) {
                 continue;
             }
+
+            /* is this pair excluded? */
+            if ( engine_excluded( eng , part_i , part_j ) )
+                continue;
             // runner_rcount += 1;
 
             #if defined(VECTORIZE)
@@ -439,7 +433,7 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
                 dxq[icount*3+1] = dx[1];
                 dxq[icount*3+2] = dx[2];
                 effi[icount] = pif;
-                effj[icount] = part_j->f;
+                effj[icount] = runner_pf( eff , part_j );
                 potq[icount] = pot;
                 icount += 1;
 
@@ -477,17 +471,14 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
                     }
             #else
                 /* evaluate the interaction */
-                #ifdef EXPLICIT_POTENTIALS
-                    potential_eval_expl( pot , r2 , &e , &f );
-                #else
-                    potential_eval( pot , r2 , &e , &f );
-                #endif
+                potential_eval_kind<kind>( pot , r2 , &e , &f );
 
                 /* update the forces */
+                pjf = runner_pf( eff , part_j );
                 for ( k = 0 ; k < 3 ; k++ ) {
                     w = f * dx[k];
                     pif[k] -= w;
-                    part_j->f[k] += w;
+                    pjf[k] += w;
                 }
 
                 /* tabulate the energy */
@@ -550,7 +541,7 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
         }
         
     /* Store the potential energy to c. */
-    c->epot += epot;
+    runner_epot( r , eff , c ) += epot;
         
     /* since nothing bad happened to us... */
     return runner_err_ok;
@@ -573,13 +564,16 @@ __attribute__ ((flatten)) int runner_doself ( struct runner *r , struct space_ce
  * the paritcles in @c cell_j. @c cell_i and @c cell_j may be the same cell.
  *
  * @sa #runner_sortedpair.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
  */
 
-__attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j ) {
+template <int kind> __attribute__ ((flatten)) static int runner_dopair_unsorted_kind ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j ) {
 
     int i, j, k, emt, pioff, count_i, count_j;
     FPTYPE cutoff2, r2, w, shift[3];
-    FPTYPE *pif;
+    FPTYPE *pif, *pjf, *eff = runner_fbuf( r );
     double epot = 0.0;
     struct engine *eng;
     struct MxParticle *part_i, *part_j, *parts_i, *parts_j;
@@ -645,7 +639,7 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
             pix[0] = part_i->x[0];
             pix[1] = part_i->x[1];
             pix[2] = part_i->x[2];
-            pif = part_i->f;
+            pif = runner_pf( eff , part_i );
             pioff = part_i->typeId * emt;
         
             /* loop over all other particles */
@@ -666,6 +660,10 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
                 pot = eng->p[ pioff + part_j->typeId ];
                 if ( pot == NULL )
                     continue;
+
+                /* is this pair excluded? */
+                if ( engine_excluded( eng , part_i , part_j ) )
+                    continue;
                     
                 #if defined(VECTORIZE)
                     /* add this interaction to the interaction queue. */
@@ -674,7 +672,7 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
                     dxq[icount*3+1] = dx[1];
                     dxq[icount*3+2] = dx[2];
                     effi[icount] = pif;
-                    effj[icount] = part_j->f;
+                    effj[icount] = runner_pf( eff , part_j );
                     potq[icount] = pot;
                     icount += 1;
 
@@ -711,17 +709,14 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
                         }
                 #else
                     /* evaluate the interaction */
-                    #ifdef EXPLICIT_POTENTIALS
-                        potential_eval_expl( pot , r2 , &e , &f );
-                    #else
-                        potential_eval( pot , r2 , &e , &f );
-                    #endif
+                    potential_eval_kind<kind>( pot , r2 , &e , &f );
 
                     /* update the forces */
+                    pjf = runner_pf( eff , part_j );
                     for ( k = 0 ; k < 3 ; k++ ) {
                         w = f * dx[k];
-                        part_i->f[k] -= w;
-                        part_j->f[k] += w;
+                        pif[k] -= w;
+                        pjf[k] += w;
                         }
 
                     /* tabulate the energy */
@@ -745,7 +740,7 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
             pix[0] = part_i->x[0] - shift[0];
             pix[1] = part_i->x[1] - shift[1];
             pix[2] = part_i->x[2] - shift[2];
-            pif = part_i->f;
+            pif = runner_pf( eff , part_i );
             pioff = part_i->typeId * emt;
             
             /* loop over all other particles */
@@ -766,6 +761,10 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
                 pot = eng->p[ pioff + part_j->typeId ];
                 if ( pot == NULL )
                     continue;
+
+                /* is this pair excluded? */
+                if ( engine_excluded( eng , part_i , part_j ) )
+                    continue;
                     
                 #if defined(VECTORIZE)
                     /* add this interaction to the interaction queue. */
@@ -774,7 +773,7 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
                     dxq[icount*3+1] = dx[1];
                     dxq[icount*3+2] = dx[2];
                     effi[icount] = pif;
-                    effj[icount] = part_j->f;
+                    effj[icount] = runner_pf( eff , part_j );
                     potq[icount] = pot;
                     icount += 1;
 
@@ -811,17 +810,14 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
                         }
                 #else
                     /* evaluate the interaction */
-                    #ifdef EXPLICIT_POTENTIALS
-                        potential_eval_expl( pot , r2 , &e , &f );
-                    #else
-                        potential_eval( pot , r2 , &e , &f );
-                    #endif
+                    potential_eval_kind<kind>( pot , r2 , &e , &f );
 
                     /* update the forces */
+                    pjf = runner_pf( eff , part_j );
                     for ( k = 0 ; k < 3 ; k++ ) {
                         w = f * dx[k];
-                        part_i->f[k] -= w;
-                        part_j->f[k] += w;
+                        pif[k] -= w;
+                        pjf[k] += w;
                         }
 
                     /* tabulate the energy */
@@ -891,9 +887,9 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
         
     /* Store the potential energy to cell_i. */
     if ( cell_j->flags & cell_flag_ghost || cell_i->flags & cell_flag_ghost )
-        cell_i->epot += 0.5 * epot;
+        runner_epot( r , eff , cell_i ) += 0.5 * epot;
     else
-        cell_i->epot += epot;
+        runner_epot( r , eff , cell_i ) += epot;
         
     /* all is well that ends ok */
     return runner_err_ok;
@@ -902,3 +898,368 @@ __attribute__ ((flatten)) int runner_dopair_unsorted ( struct runner *r , struct
 
 
 
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair using the
+ *      structure-of-arrays particle buffers.
+ *
+ * @param r The #runner computing the pair.
+ * @param cell_i The first cell.
+ * @param cell_j The second cell.
+ * @param sid The sort ID of the pair.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Same as #runner_dopair, but reads the positions and types from, and
+ * accumulates the forces into, the SoA buffers set up by
+ * #space_cell_soa_pack.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
+ */
+
+template <int kind> __attribute__ ((flatten)) static int runner_dopair_soa_kind ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+
+    struct space *s;
+    int i, j, k, pid, pjd;
+    struct MxPotential *pot, **pots;
+    struct engine *eng;
+    int emt, pioff, dmaxdist, dnshift;
+    FPTYPE cutoff, cutoff2, r2, w;
+    unsigned int *iparts, *jparts;
+    FPTYPE dscale;
+    FPTYPE shift[3], nshift, bias;
+    FPTYPE *xi[3], *xj[3], *fi[3], *fj[3], *xjs[3], *fjs[3], *r2s;
+    int *typei, *typej, *typejs;
+    FPTYPE pix[3], pif[3], dx[3];
+    int count_i, count_j, excl_i, jmin, jlo;
+    FPTYPE e, f;
+    double epot = 0.0;
+
+    /* break early if one of the cells is empty */
+    if ( cell_i->count == 0 || cell_j->count == 0 )
+        return runner_err_ok;
+
+    /* get the space and cutoff */
+    eng = r->e;
+    emt = eng->max_type;
+    s = &(eng->s);
+    pots = eng->p;
+    cutoff = s->cutoff;
+    cutoff2 = cutoff*cutoff;
+    bias = sqrt( s->h[0]*s->h[0] + s->h[1]*s->h[1] + s->h[2]*s->h[2] );
+    dscale = (FPTYPE)SHRT_MAX / (2 * bias );
+    dmaxdist = 2 + dscale * (cutoff + 2*s->maxdx);
+
+    /* Get the sort ID. */
+    sid = space_getsid( s , &cell_i , &cell_j , shift );
+
+    /* Get the counts and the particle data. */
+    count_i = cell_i->count;
+    count_j = cell_j->count;
+    for ( k = 0 ; k < 3 ; k++ ) {
+        xi[k] = cell_i->soa_x[k]; fi[k] = cell_i->soa_f[k];
+        xj[k] = cell_j->soa_x[k]; fj[k] = cell_j->soa_f[k];
+        }
+    typei = cell_i->soa_typeId;
+    typej = cell_j->soa_typeId;
+
+    /* Get the discretized shift norm. */
+    nshift = sqrt( shift[0]*shift[0] + shift[1]*shift[1] + shift[2]*shift[2] );
+    dnshift = dscale * nshift;
+
+    /* Get the pointers to the left and right particle data. */
+    iparts = &cell_i->sortlist[ count_i * sid ];
+    jparts = &cell_j->sortlist[ count_j * sid ];
+
+    /* Copy the particles of cell_j within reach of the first particle in
+       cell_i, in their sorted order, such that the inner loop runs over
+       contiguous data. */
+    for ( jmin = count_j ; jmin > 0 && (jparts[jmin-1] & 0xffff) + dnshift - (iparts[0] & 0xffff) < dmaxdist ; jmin-- );
+    if ( jmin == count_j )
+        return runner_err_ok;
+    for ( k = 0 ; k < 3 ; k++ ) {
+        xjs[k] = (FPTYPE *)alloca( sizeof(FPTYPE) * count_j );
+        fjs[k] = (FPTYPE *)alloca( sizeof(FPTYPE) * count_j );
+        }
+    typejs = (int *)alloca( sizeof(int) * count_j );
+    r2s = (FPTYPE *)alloca( sizeof(FPTYPE) * count_j );
+    for ( j = jmin ; j < count_j ; j++ ) {
+        pjd = jparts[j] >> 16;
+        for ( k = 0 ; k < 3 ; k++ ) {
+            xjs[k][j] = xj[k][pjd];
+            fjs[k][j] = FPTYPE_ZERO;
+            }
+        typejs[j] = typej[pjd];
+        }
+
+    /* loop over the sorted list of particles in i */
+    for ( i = 0 ; i < count_i ; i++ ) {
+
+        /* Quit early? */
+        if ( (jparts[count_j-1] & 0xffff) + dnshift - (iparts[i] & 0xffff) > dmaxdist )
+            break;
+
+        /* get a handle on this particle */
+        pid = iparts[i] >> 16;
+        for ( k = 0 ; k < 3 ; k++ ) {
+            pix[k] = xi[k][pid] - shift[k];
+            pif[k] = FPTYPE_ZERO;
+            }
+        pioff = typei[pid] * emt;
+        excl_i = cell_i->parts[pid].flags & PARTICLE_FLAG_EXCLUDED;
+
+        /* get the left particles within reach */
+        for ( jlo = count_j ; jlo > 0 && (jparts[jlo-1] & 0xffff) + dnshift - (iparts[i] & 0xffff) < dmaxdist ; jlo-- );
+
+        /* get all the distances first, this loop vectorizes */
+        for ( j = jlo ; j < count_j ; j++ )
+            r2s[j] = (pix[0] - xjs[0][j]) * (pix[0] - xjs[0][j]) +
+                     (pix[1] - xjs[1][j]) * (pix[1] - xjs[1][j]) +
+                     (pix[2] - xjs[2][j]) * (pix[2] - xjs[2][j]);
+
+        /* loop over the left particles */
+        for ( j = count_j-1 ; j >= jlo ; j-- ) {
+
+            /* is this within the cutoff? */
+            r2 = r2s[j];
+            if ( r2 > cutoff2 )
+                continue;
+
+            /* fetch the potential, if any, and check its range */
+            pot = pots[ pioff + typejs[j] ];
+            if ( pot == NULL || r2 > pot->b * pot->b )
+                continue;
+
+            /* get the distance vector between both particles */
+            dx[0] = pix[0] - xjs[0][j];
+            dx[1] = pix[1] - xjs[1][j];
+            dx[2] = pix[2] - xjs[2][j];
+
+            /* is this pair excluded? The particles are in the same order
+               as in the cells. */
+            if ( excl_i && engine_excluded( eng , &cell_i->parts[pid] , &cell_j->parts[ jparts[j] >> 16 ] ) )
+                continue;
+
+            /* evaluate the interaction */
+            potential_eval_kind<kind>( pot , r2 , &e , &f );
+
+            /* update the forces */
+            for ( k = 0 ; k < 3 ; k++ ) {
+                w = f * dx[k];
+                pif[k] -= w;
+                fjs[k][j] += w;
+                }
+
+            /* tabulate the energy */
+            epot += e;
+
+            }
+
+        /* store the accumulated force on the i-th particle */
+        for ( k = 0 ; k < 3 ; k++ )
+            fi[k][pid] += pif[k];
+
+        } /* loop over all particles */
+
+    /* Add the forces on the particles of cell_j back in their order. */
+    for ( j = jmin ; j < count_j ; j++ ) {
+        pjd = jparts[j] >> 16;
+        for ( k = 0 ; k < 3 ; k++ )
+            fj[k][pjd] += fjs[k][j];
+        }
+
+    /* Store the potential energy to cell_i. */
+    if ( cell_j->flags & cell_flag_ghost || cell_i->flags & cell_flag_ghost )
+        cell_i->epot += 0.5 * epot;
+    else
+        cell_i->epot += epot;
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Compute the self-interactions for the given cell using the
+ *      structure-of-arrays particle buffers.
+ *
+ * @param r The #runner computing the pair.
+ * @param c The cell.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Same as #runner_doself, but reads the positions and types from, and
+ * accumulates the pairwise forces into, the SoA buffers set up by
+ * #space_cell_soa_pack.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
+ */
+
+template <int kind> __attribute__ ((flatten)) static int runner_doself_soa_kind ( struct runner *r , struct space_cell *c ) {
+
+    struct space *s;
+    int count, i, j, k;
+    double epot = 0.0;
+    struct MxPotential *pot, **pots;
+    struct engine *eng;
+    int emt, pioff, excl_i;
+    FPTYPE cutoff2, r2, w;
+    FPTYPE *x[3], *fp[3];
+    int *type;
+    FPTYPE pix[3], pif[3], dx[3];
+    FPTYPE e, f;
+
+    /* break early if the cell is empty */
+    count = c->count;
+    if ( count == 0 )
+        return runner_err_ok;
+
+    /* get some useful data */
+    eng = r->e;
+    emt = eng->max_type;
+    s = &(eng->s);
+    pots = eng->p;
+    cutoff2 = s->cutoff2;
+    for ( k = 0 ; k < 3 ; k++ ) {
+        x[k] = c->soa_x[k];
+        fp[k] = c->soa_f[k];
+        }
+    type = c->soa_typeId;
+
+    /* loop over all particles */
+    for ( i = 1 ; i < count ; i++ ) {
+
+        /* get the particle */
+        for ( k = 0 ; k < 3 ; k++ ) {
+            pix[k] = x[k][i];
+            pif[k] = FPTYPE_ZERO;
+            }
+        pioff = type[i] * emt;
+        excl_i = c->parts[i].flags & PARTICLE_FLAG_EXCLUDED;
+
+        /* loop over all other particles */
+        for ( j = 0 ; j < i ; j++ ) {
+
+            /* fetch the potential, if any */
+            pot = pots[ pioff + type[j] ];
+            if ( pot == NULL )
+                continue;
+
+            /* get the distance between both particles */
+            dx[0] = pix[0] - x[0][j];
+            dx[1] = pix[1] - x[1][j];
+            dx[2] = pix[2] - x[2][j];
+            r2 = dx[0]*dx[0] + dx[1]*dx[1] + dx[2]*dx[2];
+
+            /* is this within cutoff? */
+            if ( r2 > cutoff2 || r2 > pot->b * pot->b )
+                continue;
+
+            /* is this pair excluded? */
+            if ( excl_i && engine_excluded( eng , &c->parts[i] , &c->parts[j] ) )
+                continue;
+
+            /* evaluate the interaction */
+            potential_eval_kind<kind>( pot , r2 , &e , &f );
+
+            /* update the forces */
+            for ( k = 0 ; k < 3 ; k++ ) {
+                w = f * dx[k];
+                pif[k] -= w;
+                fp[k][j] += w;
+                }
+
+            /* tabulate the energy */
+            epot += e;
+
+            } /* loop over all other particles */
+
+        /* store the accumulated force on the i-th particle */
+        for ( k = 0 ; k < 3 ; k++ )
+            fp[k][i] += pif[k];
+
+        } /* loop over all particles */
+
+    /* Store the potential energy to c. */
+    c->epot += epot;
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair.
+ *
+ * Calls the instance of #runner_dopair_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+int runner_dopair ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_dopair_kind , ( r , cell_i , cell_j , sid ) );
+
+    }
+
+
+/**
+ * @brief Compute the self-interactions for the given cell.
+ *
+ * Calls the instance of #runner_doself_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+int runner_doself ( struct runner *r , struct space_cell *c ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_doself_kind , ( r , c ) );
+
+    }
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair.
+ *
+ * Calls the instance of #runner_dopair_unsorted_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+int runner_dopair_unsorted ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_dopair_unsorted_kind , ( r , cell_i , cell_j ) );
+
+    }
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair using the
+ *      structure-of-arrays particle buffers.
+ *
+ * Calls the instance of #runner_dopair_soa_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+int runner_dopair_soa ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_dopair_soa_kind , ( r , cell_i , cell_j , sid ) );
+
+    }
+
+
+/**
+ * @brief Compute the self-interactions for the given cell using the
+ *      structure-of-arrays particle buffers.
+ *
+ * Calls the instance of #runner_doself_soa_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+int runner_doself_soa ( struct runner *r , struct space_cell *c ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_doself_soa_kind , ( r , c ) );
+
+    }
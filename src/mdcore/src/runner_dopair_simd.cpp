@@ -0,0 +1,826 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2012 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/* Include configuration header */
+#include "mdcore_config.h"
+
+/* Include some standard header files */
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <limits.h>
+
+/* Include some conditional headers. */
+#ifdef WITH_MPI
+    #include <mpi.h>
+#endif
+
+/* Include local headers */
+#include "cycle.h"
+#include "errs.h"
+#include "fptype.h"
+#include "lock.h"
+#include <MxParticle.h>
+#include <space_cell.h>
+#include "space.h"
+#include <MxPotential.h>
+#include "potential_eval.h"
+#include "engine.h"
+#include "engine_excluded.h"
+#include "runner.h"
+#include "MxForce.h"
+
+/* the error macro. */
+#define error(id)				( runner_err = errs_register( id , runner_err_msg[-(id)] , __LINE__ , __FUNCTION__ , __FILE__ ) )
+
+/* list of error messages. */
+extern const char *runner_err_msg[];
+
+
+/**
+ * @brief Find the widest pair kernel supported by the current CPU.
+ *
+ * @return One of #runner_simd_none, #runner_simd_avx2 or #runner_simd_avx512.
+ */
+
+int runner_simd_detect ( void ) {
+
+#ifdef RUNNER_SIMD
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx512f" ) )
+        return runner_simd_avx512;
+    if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+        return runner_simd_avx2;
+#endif
+
+    return runner_simd_none;
+
+    }
+
+
+#ifdef RUNNER_SIMD
+
+/**
+ * @brief Evaluate a full queue of eight interactions (AVX2).
+ *
+ * @param potq The potentials of each interaction.
+ * @param r2q The squared distances of each interaction.
+ * @param dxq The distance vectors of each interaction, by component.
+ * @param effa The forces to which @c f*dx is added.
+ * @param effb The forces from which @c f*dx is subtracted.
+ * @param count The number of valid entries, the remaining ones must be
+ *      padded with a valid potential and distance.
+ * @param epot Pointer to the potential energy accumulator.
+ *
+ * The potentials are evaluated with their closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
+ */
+
+template <int kind> __attribute__ ((always_inline,target("avx2,fma"))) inline static void runner_flush_8single_avx2 ( struct MxPotential **potq , float *r2q , float (*dxq)[8] , FPTYPE **effa , FPTYPE **effb , int count , double *epot ) {
+
+    int l, k;
+    float e[8] __attribute__ ((aligned (32)));
+    float f[8] __attribute__ ((aligned (32)));
+    float w[3][8] __attribute__ ((aligned (32)));
+    __m256 fv;
+
+    /* evaluate the potentials */
+    potential_eval_vec_8single_avx2_kind<kind>( potq , r2q , e , f );
+
+    /* update the forces and the energy */
+    fv = _mm256_load_ps( f );
+    for ( k = 0 ; k < 3 ; k++ )
+        _mm256_store_ps( w[k] , _mm256_mul_ps( fv , _mm256_load_ps( dxq[k] ) ) );
+    for ( l = 0 ; l < count ; l++ ) {
+        *epot += e[l];
+        for ( k = 0 ; k < 3 ; k++ ) {
+            effa[l][k] += w[k][l];
+            effb[l][k] -= w[k][l];
+            }
+        }
+
+    }
+
+
+/**
+ * @brief Evaluate a full queue of sixteen interactions (AVX-512).
+ *
+ * Same as #runner_flush_8single_avx2, but sixteen wide.
+ */
+
+template <int kind> __attribute__ ((always_inline,target("avx512f,avx2,fma"))) inline static void runner_flush_16single_avx512 ( struct MxPotential **potq , float *r2q , float (*dxq)[16] , FPTYPE **effa , FPTYPE **effb , int count , double *epot ) {
+
+    int l, k;
+    float e[16] __attribute__ ((aligned (64)));
+    float f[16] __attribute__ ((aligned (64)));
+    float w[3][16] __attribute__ ((aligned (64)));
+    __m512 fv;
+
+    /* evaluate the potentials */
+    potential_eval_vec_16single_avx512_kind<kind>( potq , r2q , e , f );
+
+    /* update the forces and the energy */
+    fv = _mm512_load_ps( f );
+    for ( k = 0 ; k < 3 ; k++ )
+        _mm512_store_ps( w[k] , _mm512_mul_ps( fv , _mm512_load_ps( dxq[k] ) ) );
+    for ( l = 0 ; l < count ; l++ ) {
+        *epot += e[l];
+        for ( k = 0 ; k < 3 ; k++ ) {
+            effa[l][k] += w[k][l];
+            effb[l][k] -= w[k][l];
+            }
+        }
+
+    }
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair (AVX2).
+ *
+ * @param r The #runner computing the pair.
+ * @param cell_i The first cell.
+ * @param cell_j The second cell.
+ * @param sid The sort ID of the pair.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Same as #runner_dopair, but the distances to the particles in @c cell_j
+ * are computed eight at a time from gathered positions, and the
+ * interactions within the cutoff are queued and evaluated eight at a time
+ * with #potential_eval_vec_8single_avx2.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
+ */
+
+template <int kind> __attribute__ ((target("avx2,fma"))) static int runner_dopair_avx2_kind ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+
+    struct MxParticle *part_i, *part_j, *parts_i, *parts_j;
+    struct space *s;
+    struct engine *eng;
+    struct MxPotential *pot, **pots;
+    struct MxPotential *potq[8];
+    FPTYPE *effa[8], *effb[8];
+    int i, j, l, n, jlo, pid, emt, pioff, dmaxdist, dnshift, count_i, count_j, mask, icount = 0;
+    int jid[8] __attribute__ ((aligned (32)));
+    float r2l[8] __attribute__ ((aligned (32)));
+    float dxl[3][8] __attribute__ ((aligned (32)));
+    float r2q[8] __attribute__ ((aligned (32)));
+    float dxq[3][8] __attribute__ ((aligned (32)));
+    unsigned int *iparts, *jparts;
+    FPTYPE cutoff, cutoff2, dscale, shift[3], nshift, bias;
+    __m256 pix, piy, piz, dx, dy, dz, r2;
+    __m256i off, lanes;
+    double epot = 0.0;
+    FPTYPE *eff = runner_fbuf( r );
+
+    /* break early if one of the cells is empty */
+    if ( cell_i->count == 0 || cell_j->count == 0 )
+        return runner_err_ok;
+
+    /* get the space and cutoff */
+    eng = r->e;
+    emt = eng->max_type;
+    s = &(eng->s);
+    pots = eng->p;
+    cutoff = s->cutoff;
+    cutoff2 = cutoff*cutoff;
+    bias = sqrt( s->h[0]*s->h[0] + s->h[1]*s->h[1] + s->h[2]*s->h[2] );
+    dscale = (FPTYPE)SHRT_MAX / (2 * bias );
+    dmaxdist = 2 + dscale * (cutoff + 2*s->maxdx);
+    lanes = _mm256_setr_epi32( 0 , 1 , 2 , 3 , 4 , 5 , 6 , 7 );
+
+    /* Get the sort ID. */
+    sid = space_getsid( s , &cell_i , &cell_j , shift );
+
+    /* Get the counts and parts. */
+    count_i = cell_i->count;
+    count_j = cell_j->count;
+    parts_i = cell_i->parts;
+    parts_j = cell_j->parts;
+
+    /* Get the discretized shift norm. */
+    nshift = sqrt( shift[0]*shift[0] + shift[1]*shift[1] + shift[2]*shift[2] );
+    dnshift = dscale * nshift;
+
+    /* Get the pointers to the left and right particle data. */
+    iparts = &cell_i->sortlist[ count_i * sid ];
+    jparts = &cell_j->sortlist[ count_j * sid ];
+
+    /* loop over the sorted list of particles in i */
+    for ( i = 0 ; i < count_i ; i++ ) {
+
+        /* Quit early? */
+        if ( (int)( jparts[count_j-1] & 0xffff ) + dnshift - (int)( iparts[i] & 0xffff ) > dmaxdist )
+            break;
+
+        /* get a handle on this particle */
+        pid = iparts[i] >> 16;
+        part_i = &( parts_i[pid] );
+        pix = _mm256_set1_ps( part_i->x[0] - shift[0] );
+        piy = _mm256_set1_ps( part_i->x[1] - shift[1] );
+        piz = _mm256_set1_ps( part_i->x[2] - shift[2] );
+        pioff = part_i->typeId * emt;
+
+        /* find the first particle in j within range. */
+        for ( jlo = count_j-1 ; jlo >= 0 && (int)( jparts[jlo] & 0xffff ) + dnshift - (int)( iparts[i] & 0xffff ) < dmaxdist ; jlo-- );
+
+        /* loop over the left particles, eight at a time */
+        for ( j = jlo + 1 ; j < count_j ; j += 8 ) {
+
+            /* get the particle offsets, padding with the first one */
+            n = ( count_j - j < 8 ) ? count_j - j : 8;
+            for ( l = 0 ; l < 8 ; l++ )
+                jid[l] = jparts[ j + ( l < n ? l : 0 ) ] >> 16;
+            off = _mm256_mullo_epi32( _mm256_load_si256( (__m256i *)jid ) , _mm256_set1_epi32( sizeof(struct MxParticle) ) );
+
+            /* get the distance between both particles */
+            dx = _mm256_sub_ps( pix , _mm256_i32gather_ps( &parts_j[0].x[0] , off , 1 ) );
+            dy = _mm256_sub_ps( piy , _mm256_i32gather_ps( &parts_j[0].x[1] , off , 1 ) );
+            dz = _mm256_sub_ps( piz , _mm256_i32gather_ps( &parts_j[0].x[2] , off , 1 ) );
+            r2 = _mm256_fmadd_ps( dx , dx , _mm256_fmadd_ps( dy , dy , _mm256_mul_ps( dz , dz ) ) );
+
+            /* which of these are within the cutoff? */
+            mask = _mm256_movemask_ps( _mm256_and_ps( _mm256_cmp_ps( r2 , _mm256_set1_ps( cutoff2 ) , _CMP_LE_OQ ) ,
+                                                      _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( n ) , lanes ) ) ) );
+            if ( mask == 0 )
+                continue;
+            _mm256_store_ps( r2l , r2 );
+            _mm256_store_ps( dxl[0] , dx );
+            _mm256_store_ps( dxl[1] , dy );
+            _mm256_store_ps( dxl[2] , dz );
+
+            /* add the interactions to the queue. */
+            while ( mask ) {
+                l = __builtin_ctz( mask );
+                mask &= mask - 1;
+                part_j = &( parts_j[ jid[l] ] );
+
+                /* fetch the potential, if any */
+                pot = pots[ pioff + part_j->typeId ];
+                if ( pot == NULL )
+                    continue;
+
+                /* is this pair excluded? */
+                if ( engine_excluded( eng , part_i , part_j ) )
+                    continue;
+
+                /* pif -= w and pjf += w, as in runner_doself */
+                potq[icount] = pot;
+                r2q[icount] = r2l[l];
+                dxq[0][icount] = dxl[0][l];
+                dxq[1][icount] = dxl[1][l];
+                dxq[2][icount] = dxl[2][l];
+                effa[icount] = runner_pf( eff , part_j );
+                effb[icount] = runner_pf( eff , part_i );
+                icount += 1;
+
+                /* evaluate the interactions if the queue is full. */
+                if ( icount == 8 ) {
+                    runner_flush_8single_avx2<kind>( potq , r2q , dxq , effa , effb , 8 , &epot );
+                    icount = 0;
+                    }
+
+                }
+
+            }
+
+        } /* loop over all particles */
+
+    /* are there any leftovers? */
+    if ( icount > 0 ) {
+        for ( l = icount ; l < 8 ; l++ ) {
+            potq[l] = potq[0];
+            r2q[l] = r2q[0];
+            }
+        runner_flush_8single_avx2<kind>( potq , r2q , dxq , effa , effb , icount , &epot );
+        }
+
+    /* Store the potential energy to cell_i. */
+    if ( cell_j->flags & cell_flag_ghost || cell_i->flags & cell_flag_ghost )
+        runner_epot( r , eff , cell_i ) += 0.5 * epot;
+    else
+        runner_epot( r , eff , cell_i ) += epot;
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Compute the self-interactions for the given cell (AVX2).
+ *
+ * @param r The #runner computing the pair.
+ * @param c The cell.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Same as #runner_doself, but with the distances computed and the
+ * interactions evaluated eight at a time.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
+ */
+
+template <int kind> __attribute__ ((target("avx2,fma"))) static int runner_doself_avx2_kind ( struct runner *r , struct space_cell *c ) {
+
+    struct MxParticle *part_i, *part_j, *parts;
+    struct space *s;
+    struct engine *eng;
+    struct MxPotential *pot, **pots;
+    struct MxPotential *potq[8];
+    FPTYPE *effa[8], *effb[8];
+    int i, j, l, n, count, emt, pioff, mask, icount = 0;
+    float r2l[8] __attribute__ ((aligned (32)));
+    float dxl[3][8] __attribute__ ((aligned (32)));
+    float r2q[8] __attribute__ ((aligned (32)));
+    float dxq[3][8] __attribute__ ((aligned (32)));
+    FPTYPE cutoff2;
+    __m256 pix, piy, piz, dx, dy, dz, r2;
+    __m256i off, lanes, stride;
+    double epot = 0.0;
+    FPTYPE *eff = runner_fbuf( r );
+
+    /* break early if the cell is empty */
+    count = c->count;
+    if ( count == 0 )
+        return runner_err_ok;
+
+    /* get some useful data */
+    eng = r->e;
+    emt = eng->max_type;
+    s = &(eng->s);
+    pots = eng->p;
+    cutoff2 = s->cutoff2;
+    parts = c->parts;
+    lanes = _mm256_setr_epi32( 0 , 1 , 2 , 3 , 4 , 5 , 6 , 7 );
+    stride = _mm256_set1_epi32( sizeof(struct MxParticle) );
+
+    /* loop over all particles */
+    for ( i = 1 ; i < count ; i++ ) {
+
+        /* get the particle */
+        part_i = &( parts[i] );
+        pix = _mm256_set1_ps( part_i->x[0] );
+        piy = _mm256_set1_ps( part_i->x[1] );
+        piz = _mm256_set1_ps( part_i->x[2] );
+        pioff = part_i->typeId * emt;
+
+        /* loop over all other particles, eight at a time */
+        for ( j = 0 ; j < i ; j += 8 ) {
+
+            /* get the particle offsets, the lanes past i are masked */
+            n = ( i - j < 8 ) ? i - j : 8;
+            off = _mm256_mullo_epi32( _mm256_min_epi32( _mm256_add_epi32( _mm256_set1_epi32( j ) , lanes ) , _mm256_set1_epi32( i - 1 ) ) , stride );
+
+            /* get the distance between both particles */
+            dx = _mm256_sub_ps( pix , _mm256_i32gather_ps( &parts[0].x[0] , off , 1 ) );
+            dy = _mm256_sub_ps( piy , _mm256_i32gather_ps( &parts[0].x[1] , off , 1 ) );
+            dz = _mm256_sub_ps( piz , _mm256_i32gather_ps( &parts[0].x[2] , off , 1 ) );
+            r2 = _mm256_fmadd_ps( dx , dx , _mm256_fmadd_ps( dy , dy , _mm256_mul_ps( dz , dz ) ) );
+
+            /* which of these are within the cutoff? */
+            mask = _mm256_movemask_ps( _mm256_and_ps( _mm256_cmp_ps( r2 , _mm256_set1_ps( cutoff2 ) , _CMP_LE_OQ ) ,
+                                                      _mm256_castsi256_ps( _mm256_cmpgt_epi32( _mm256_set1_epi32( n ) , lanes ) ) ) );
+            if ( mask == 0 )
+                continue;
+            _mm256_store_ps( r2l , r2 );
+            _mm256_store_ps( dxl[0] , dx );
+            _mm256_store_ps( dxl[1] , dy );
+            _mm256_store_ps( dxl[2] , dz );
+
+            /* add the interactions to the queue. */
+            while ( mask ) {
+                l = __builtin_ctz( mask );
+                mask &= mask - 1;
+                part_j = &( parts[ j + l ] );
+
+                /* fetch the potential, if any, and check its cutoff */
+                pot = pots[ pioff + part_j->typeId ];
+                if ( pot == NULL || r2l[l] > pot->b * pot->b )
+                    continue;
+
+                /* is this pair excluded? */
+                if ( engine_excluded( eng , part_i , part_j ) )
+                    continue;
+
+                /* pif -= w and pjf += w, as in runner_doself */
+                potq[icount] = pot;
+                r2q[icount] = r2l[l];
+                dxq[0][icount] = dxl[0][l];
+                dxq[1][icount] = dxl[1][l];
+                dxq[2][icount] = dxl[2][l];
+                effa[icount] = runner_pf( eff , part_j );
+                effb[icount] = runner_pf( eff , part_i );
+                icount += 1;
+
+                /* evaluate the interactions if the queue is full. */
+                if ( icount == 8 ) {
+                    runner_flush_8single_avx2<kind>( potq , r2q , dxq , effa , effb , 8 , &epot );
+                    icount = 0;
+                    }
+
+                }
+
+            } /* loop over all other particles */
+
+        } /* loop over all particles */
+
+    /* are there any leftovers? */
+    if ( icount > 0 ) {
+        for ( l = icount ; l < 8 ; l++ ) {
+            potq[l] = potq[0];
+            r2q[l] = r2q[0];
+            }
+        runner_flush_8single_avx2<kind>( potq , r2q , dxq , effa , effb , icount , &epot );
+        }
+
+    /* Store the potential energy to c. */
+    runner_epot( r , eff , c ) += epot;
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair (AVX-512).
+ *
+ * @param r The #runner computing the pair.
+ * @param cell_i The first cell.
+ * @param cell_j The second cell.
+ * @param sid The sort ID of the pair.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Same as #runner_dopair_avx2, but sixteen wide.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
+ */
+
+template <int kind> __attribute__ ((target("avx512f,avx2,fma"))) static int runner_dopair_avx512_kind ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+
+    struct MxParticle *part_i, *part_j, *parts_i, *parts_j;
+    struct space *s;
+    struct engine *eng;
+    struct MxPotential *pot, **pots;
+    struct MxPotential *potq[16];
+    FPTYPE *effa[16], *effb[16];
+    int i, j, l, n, jlo, pid, emt, pioff, dmaxdist, dnshift, count_i, count_j, mask, icount = 0;
+    int jid[16] __attribute__ ((aligned (64)));
+    float r2l[16] __attribute__ ((aligned (64)));
+    float dxl[3][16] __attribute__ ((aligned (64)));
+    float r2q[16] __attribute__ ((aligned (64)));
+    float dxq[3][16] __attribute__ ((aligned (64)));
+    unsigned int *iparts, *jparts;
+    FPTYPE cutoff, cutoff2, dscale, shift[3], nshift, bias;
+    __m512 pix, piy, piz, dx, dy, dz, r2;
+    __m512i off;
+    double epot = 0.0;
+    FPTYPE *eff = runner_fbuf( r );
+
+    /* break early if one of the cells is empty */
+    if ( cell_i->count == 0 || cell_j->count == 0 )
+        return runner_err_ok;
+
+    /* get the space and cutoff */
+    eng = r->e;
+    emt = eng->max_type;
+    s = &(eng->s);
+    pots = eng->p;
+    cutoff = s->cutoff;
+    cutoff2 = cutoff*cutoff;
+    bias = sqrt( s->h[0]*s->h[0] + s->h[1]*s->h[1] + s->h[2]*s->h[2] );
+    dscale = (FPTYPE)SHRT_MAX / (2 * bias );
+    dmaxdist = 2 + dscale * (cutoff + 2*s->maxdx);
+
+    /* Get the sort ID. */
+    sid = space_getsid( s , &cell_i , &cell_j , shift );
+
+    /* Get the counts and parts. */
+    count_i = cell_i->count;
+    count_j = cell_j->count;
+    parts_i = cell_i->parts;
+    parts_j = cell_j->parts;
+
+    /* Get the discretized shift norm. */
+    nshift = sqrt( shift[0]*shift[0] + shift[1]*shift[1] + shift[2]*shift[2] );
+    dnshift = dscale * nshift;
+
+    /* Get the pointers to the left and right particle data. */
+    iparts = &cell_i->sortlist[ count_i * sid ];
+    jparts = &cell_j->sortlist[ count_j * sid ];
+
+    /* loop over the sorted list of particles in i */
+    for ( i = 0 ; i < count_i ; i++ ) {
+
+        /* Quit early? */
+        if ( (int)( jparts[count_j-1] & 0xffff ) + dnshift - (int)( iparts[i] & 0xffff ) > dmaxdist )
+            break;
+
+        /* get a handle on this particle */
+        pid = iparts[i] >> 16;
+        part_i = &( parts_i[pid] );
+        pix = _mm512_set1_ps( part_i->x[0] - shift[0] );
+        piy = _mm512_set1_ps( part_i->x[1] - shift[1] );
+        piz = _mm512_set1_ps( part_i->x[2] - shift[2] );
+        pioff = part_i->typeId * emt;
+
+        /* find the first particle in j within range. */
+        for ( jlo = count_j-1 ; jlo >= 0 && (int)( jparts[jlo] & 0xffff ) + dnshift - (int)( iparts[i] & 0xffff ) < dmaxdist ; jlo-- );
+
+        /* loop over the left particles, sixteen at a time */
+        for ( j = jlo + 1 ; j < count_j ; j += 16 ) {
+
+            /* get the particle offsets, padding with the first one */
+            n = ( count_j - j < 16 ) ? count_j - j : 16;
+            for ( l = 0 ; l < 16 ; l++ )
+                jid[l] = jparts[ j + ( l < n ? l : 0 ) ] >> 16;
+            off = _mm512_mullo_epi32( _mm512_load_si512( jid ) , _mm512_set1_epi32( sizeof(struct MxParticle) ) );
+
+            /* get the distance between both particles */
+            dx = _mm512_sub_ps( pix , _mm512_i32gather_ps( off , &parts_j[0].x[0] , 1 ) );
+            dy = _mm512_sub_ps( piy , _mm512_i32gather_ps( off , &parts_j[0].x[1] , 1 ) );
+            dz = _mm512_sub_ps( piz , _mm512_i32gather_ps( off , &parts_j[0].x[2] , 1 ) );
+            r2 = _mm512_fmadd_ps( dx , dx , _mm512_fmadd_ps( dy , dy , _mm512_mul_ps( dz , dz ) ) );
+
+            /* which of these are within the cutoff? */
+            mask = _mm512_cmp_ps_mask( r2 , _mm512_set1_ps( cutoff2 ) , _CMP_LE_OQ ) & ( ( 1u << n ) - 1 );
+            if ( mask == 0 )
+                continue;
+            _mm512_store_ps( r2l , r2 );
+            _mm512_store_ps( dxl[0] , dx );
+            _mm512_store_ps( dxl[1] , dy );
+            _mm512_store_ps( dxl[2] , dz );
+
+            /* add the interactions to the queue. */
+            while ( mask ) {
+                l = __builtin_ctz( mask );
+                mask &= mask - 1;
+                part_j = &( parts_j[ jid[l] ] );
+
+                /* fetch the potential, if any */
+                pot = pots[ pioff + part_j->typeId ];
+                if ( pot == NULL )
+                    continue;
+
+                /* is this pair excluded? */
+                if ( engine_excluded( eng , part_i , part_j ) )
+                    continue;
+
+                /* pif -= w and pjf += w, as in runner_doself */
+                potq[icount] = pot;
+                r2q[icount] = r2l[l];
+                dxq[0][icount] = dxl[0][l];
+                dxq[1][icount] = dxl[1][l];
+                dxq[2][icount] = dxl[2][l];
+                effa[icount] = runner_pf( eff , part_j );
+                effb[icount] = runner_pf( eff , part_i );
+                icount += 1;
+
+                /* evaluate the interactions if the queue is full. */
+                if ( icount == 16 ) {
+                    runner_flush_16single_avx512<kind>( potq , r2q , dxq , effa , effb , 16 , &epot );
+                    icount = 0;
+                    }
+
+                }
+
+            }
+
+        } /* loop over all particles */
+
+    /* are there any leftovers? */
+    if ( icount > 0 ) {
+        for ( l = icount ; l < 16 ; l++ ) {
+            potq[l] = potq[0];
+            r2q[l] = r2q[0];
+            }
+        runner_flush_16single_avx512<kind>( potq , r2q , dxq , effa , effb , icount , &epot );
+        }
+
+    /* Store the potential energy to cell_i. */
+    if ( cell_j->flags & cell_flag_ghost || cell_i->flags & cell_flag_ghost )
+        runner_epot( r , eff , cell_i ) += 0.5 * epot;
+    else
+        runner_epot( r , eff , cell_i ) += epot;
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Compute the self-interactions for the given cell (AVX-512).
+ *
+ * @param r The #runner computing the pair.
+ * @param c The cell.
+ *
+ * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Same as #runner_doself_avx2, but sixteen wide.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
+ */
+
+template <int kind> __attribute__ ((target("avx512f,avx2,fma"))) static int runner_doself_avx512_kind ( struct runner *r , struct space_cell *c ) {
+
+    struct MxParticle *part_i, *part_j, *parts;
+    struct space *s;
+    struct engine *eng;
+    struct MxPotential *pot, **pots;
+    struct MxPotential *potq[16];
+    FPTYPE *effa[16], *effb[16];
+    int i, j, l, n, count, emt, pioff, mask, icount = 0;
+    float r2l[16] __attribute__ ((aligned (64)));
+    float dxl[3][16] __attribute__ ((aligned (64)));
+    float r2q[16] __attribute__ ((aligned (64)));
+    float dxq[3][16] __attribute__ ((aligned (64)));
+    FPTYPE cutoff2;
+    __m512 pix, piy, piz, dx, dy, dz, r2;
+    __m512i off, lanes, stride;
+    double epot = 0.0;
+    FPTYPE *eff = runner_fbuf( r );
+
+    /* break early if the cell is empty */
+    count = c->count;
+    if ( count == 0 )
+        return runner_err_ok;
+
+    /* get some useful data */
+    eng = r->e;
+    emt = eng->max_type;
+    s = &(eng->s);
+    pots = eng->p;
+    cutoff2 = s->cutoff2;
+    parts = c->parts;
+    lanes = _mm512_setr_epi32( 0 , 1 , 2 , 3 , 4 , 5 , 6 , 7 , 8 , 9 , 10 , 11 , 12 , 13 , 14 , 15 );
+    stride = _mm512_set1_epi32( sizeof(struct MxParticle) );
+
+    /* loop over all particles */
+    for ( i = 1 ; i < count ; i++ ) {
+
+        /* get the particle */
+        part_i = &( parts[i] );
+        pix = _mm512_set1_ps( part_i->x[0] );
+        piy = _mm512_set1_ps( part_i->x[1] );
+        piz = _mm512_set1_ps( part_i->x[2] );
+        pioff = part_i->typeId * emt;
+
+        /* loop over all other particles, sixteen at a time */
+        for ( j = 0 ; j < i ; j += 16 ) {
+
+            /* get the particle offsets, the lanes past i are masked */
+            n = ( i - j < 16 ) ? i - j : 16;
+            off = _mm512_mullo_epi32( _mm512_min_epi32( _mm512_add_epi32( _mm512_set1_epi32( j ) , lanes ) , _mm512_set1_epi32( i - 1 ) ) , stride );
+
+            /* get the distance between both particles */
+            dx = _mm512_sub_ps( pix , _mm512_i32gather_ps( off , &parts[0].x[0] , 1 ) );
+            dy = _mm512_sub_ps( piy , _mm512_i32gather_ps( off , &parts[0].x[1] , 1 ) );
+            dz = _mm512_sub_ps( piz , _mm512_i32gather_ps( off , &parts[0].x[2] , 1 ) );
+            r2 = _mm512_fmadd_ps( dx , dx , _mm512_fmadd_ps( dy , dy , _mm512_mul_ps( dz , dz ) ) );
+
+            /* which of these are within the cutoff? */
+            mask = _mm512_cmp_ps_mask( r2 , _mm512_set1_ps( cutoff2 ) , _CMP_LE_OQ ) & ( ( 1u << n ) - 1 );
+            if ( mask == 0 )
+                continue;
+            _mm512_store_ps( r2l , r2 );
+            _mm512_store_ps( dxl[0] , dx );
+            _mm512_store_ps( dxl[1] , dy );
+            _mm512_store_ps( dxl[2] , dz );
+
+            /* add the interactions to the queue. */
+            while ( mask ) {
+                l = __builtin_ctz( mask );
+                mask &= mask - 1;
+                part_j = &( parts[ j + l ] );
+
+                /* fetch the potential, if any, and check its cutoff */
+                pot = pots[ pioff + part_j->typeId ];
+                if ( pot == NULL || r2l[l] > pot->b * pot->b )
+                    continue;
+
+                /* is this pair excluded? */
+                if ( engine_excluded( eng , part_i , part_j ) )
+                    continue;
+
+                /* pif -= w and pjf += w, as in runner_doself */
+                potq[icount] = pot;
+                r2q[icount] = r2l[l];
+                dxq[0][icount] = dxl[0][l];
+                dxq[1][icount] = dxl[1][l];
+                dxq[2][icount] = dxl[2][l];
+                effa[icount] = runner_pf( eff , part_j );
+                effb[icount] = runner_pf( eff , part_i );
+                icount += 1;
+
+                /* evaluate the interactions if the queue is full. */
+                if ( icount == 16 ) {
+                    runner_flush_16single_avx512<kind>( potq , r2q , dxq , effa , effb , 16 , &epot );
+                    icount = 0;
+                    }
+
+                }
+
+            } /* loop over all other particles */
+
+        } /* loop over all particles */
+
+    /* are there any leftovers? */
+    if ( icount > 0 ) {
+        for ( l = icount ; l < 16 ; l++ ) {
+            potq[l] = potq[0];
+            r2q[l] = r2q[0];
+            }
+        runner_flush_16single_avx512<kind>( potq , r2q , dxq , effa , effb , icount , &epot );
+        }
+
+    /* Store the potential energy to c. */
+    runner_epot( r , eff , c ) += epot;
+
+    /* since nothing bad happened to us... */
+    return runner_err_ok;
+
+    }
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair (AVX2).
+ *
+ * Calls the instance of #runner_dopair_avx2_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+__attribute__ ((target("avx2,fma"))) int runner_dopair_avx2 ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_dopair_avx2_kind , ( r , cell_i , cell_j , sid ) );
+
+    }
+
+
+/**
+ * @brief Compute the self-interactions for the given cell (AVX2).
+ *
+ * Calls the instance of #runner_doself_avx2_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+__attribute__ ((target("avx2,fma"))) int runner_doself_avx2 ( struct runner *r , struct space_cell *c ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_doself_avx2_kind , ( r , c ) );
+
+    }
+
+
+/**
+ * @brief Compute the pairwise interactions for the given pair (AVX-512).
+ *
+ * Calls the instance of #runner_dopair_avx512_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+__attribute__ ((target("avx512f,avx2,fma"))) int runner_dopair_avx512 ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , int sid ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_dopair_avx512_kind , ( r , cell_i , cell_j , sid ) );
+
+    }
+
+
+/**
+ * @brief Compute the self-interactions for the given cell (AVX-512).
+ *
+ * Calls the instance of #runner_doself_avx512_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+__attribute__ ((target("avx512f,avx2,fma"))) int runner_doself_avx512 ( struct runner *r , struct space_cell *c ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_doself_avx512_kind , ( r , c ) );
+
+    }
+
+#endif
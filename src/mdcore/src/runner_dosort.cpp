@@ -130,11 +130,16 @@ __attribute__ ((flatten)) int runner_dosort ( struct runner *r , struct space_ce
         iparts = &c->sortlist[ count * sid ];
 
         /* start by filling the particle ids and dists */
-        for ( i = 0 ; i < count ; i++ ) {
-            p = &( parts[i] );
-            iparts[i] = (i << 16) |
-                (unsigned int)( dscale * ( bias + p->x[0]*shiftn[0] + p->x[1]*shiftn[1] + p->x[2]*shiftn[2] ) );
-        }
+        if ( c->flags & cell_flag_soa )
+            for ( i = 0 ; i < count ; i++ )
+                iparts[i] = (i << 16) |
+                    (unsigned int)( dscale * ( bias + c->soa_x[0][i]*shiftn[0] + c->soa_x[1][i]*shiftn[1] + c->soa_x[2][i]*shiftn[2] ) );
+        else
+            for ( i = 0 ; i < count ; i++ ) {
+                p = &( parts[i] );
+                iparts[i] = (i << 16) |
+                    (unsigned int)( dscale * ( bias + p->x[0]*shiftn[0] + p->x[1]*shiftn[1] + p->x[2]*shiftn[2] ) );
+            }
 
         /* Sort this data in descending order. */
         runner_sort_descending( iparts , count );
@@ -56,6 +56,7 @@
 #include <MxPotential.h>
 #include "potential_eval.h"
 #include "engine.h"
+#include "engine_excluded.h"
 #include "runner.h"
 
 
@@ -73,616 +74,271 @@
 extern const char *runner_err_msg[];
 extern unsigned int runner_rcount;
 
+/**
+ * @brief Get the shifts of the cells paired with the given cell.
+ *
+ * @param s The #space.
+ * @param c The #cell.
+ * @param cells Array in which to store pointers to the paired cells.
+ * @param shift Array in which to store the vectors from the origin of
+ *      @c c to those of the paired cells, three per cell.
+ *
+ * @return The number of cells paired with @c c (see #space_verlet_init).
+ */
+
+int runner_verlet_cells ( struct space *s , struct space_cell *c , struct space_cell **cells , FPTYPE *shift ) {
+
+    int l, k, first, nr_cells;
+    struct space_cell *cj;
+
+    first = s->verlet_celloffset[ c - s->cells ];
+    nr_cells = s->verlet_celloffset[ c - s->cells + 1 ] - first;
+
+    for ( l = 0 ; l < nr_cells ; l++ ) {
+        cells[l] = cj = &( s->cells[ s->verlet_cellpairs[ first + l ] ] );
+        for ( k = 0 ; k < 3 ; k++ ) {
+            shift[3*l+k] = cj->origin[k] - c->origin[k];
+            if ( shift[3*l+k] * 2 > s->dim[k] )
+                shift[3*l+k] -= s->dim[k];
+            else if ( shift[3*l+k] * 2 < -s->dim[k] )
+                shift[3*l+k] += s->dim[k];
+            }
+        }
+
+    return nr_cells;
+
+    }
+
 
 /**
- * @brief Compute the interactions between the particles in the given
- *        space_cell using the verlet list.
+ * @brief Re-build the neighbour list of the particles in the given cell.
  *
  * @param r The #runner.
- * @param c The #cell containing the particles to traverse.
- * @param f A pointer to an array of #FPTYPE in which to aggregate the
- *        interaction forces.
- * 
+ * @param c The #cell containing the particles.
+ *
  * @return #runner_err_ok or <0 on error (see #runner_err)
+ *
+ * Stores, for every particle in @c c, all particles in the cells paired
+ * with @c c that are within the cutoff plus the skin of the #space and
+ * with which it has a potential and no exclusion (see #engine_excluded).
+ * Within @c c itself, only the particles
+ * preceding it are stored, such that every pair appears only once.
+ * The list of @c c only grows, by #space_verlet_grow at a time.
  */
- 
-__attribute__ ((flatten)) int runner_verlet_eval ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
 
-    struct space *s;
-    struct MxParticle *part_i, *part_j;
-    struct verlet_entry *verlet_list;
-    struct MxPotential *pot;
-    int pid, i, j, k, nrpairs;
-    FPTYPE pix[4], pjx[4];
-    FPTYPE cutoff2, r2, dx[4], w, h[3];
-    double epot = 0.0;
-#if defined(VECTORIZE)
-    struct MxPotential *potq[VEC_SIZE];
-    int icount = 0, l;
-    FPTYPE *effi[VEC_SIZE], *effj[VEC_SIZE], *pif;
-    FPTYPE r2q[VEC_SIZE] __attribute__ ((aligned (16)));
-    FPTYPE ee[VEC_SIZE] __attribute__ ((aligned (16)));
-    FPTYPE eff[VEC_SIZE] __attribute__ ((aligned (16)));
-    FPTYPE dxq[VEC_SIZE*3];
-#else
-    FPTYPE ee, eff;
-#endif
+int runner_verlet_build ( struct runner *r , struct space_cell *c ) {
+
+    struct engine *eng = r->e;
+    struct space *s = &eng->s;
+    struct space_cell *cells[space_verlet_maxcells];
+    struct MxParticle *part_i, *part_j, *parts_j;
+    struct MxPotential **pots = eng->p;
+    int i, j, k, l, nr_cells, count, count_j, emt, pioff, ind, size;
+    unsigned int *nlist;
+    FPTYPE shift[3*space_verlet_maxcells];
+    FPTYPE rl, rl2, r2, pix[4], dx[4];
+
+    /* Is the cell too crowded for the list entries? */
+    count = c->count;
+    if ( count > ( 1 << space_verlet_pidbits ) )
+        return error(runner_err_verlet_overflow);
+
+    /* Make sure there is room for the offsets. */
+    if ( c->nlist_offset_size < count + 1 ) {
+        free( c->nlist_offset );
+        size = space_verlet_grow * count + 1;
+        if ( ( c->nlist_offset = (int *)malloc( sizeof(int) * size ) ) == NULL )
+            return error(runner_err_malloc);
+        c->nlist_offset_size = size;
+        }
 
-    /* Get a direct pointer on the space and some other useful things. */
-    s = &(r->e->s);
-    cutoff2 = s->cutoff2;
-    h[0] = s->h[0]; h[1] = s->h[1]; h[2] = s->h[2];
+    /* Get the paired cells and the list radius. */
+    nr_cells = runner_verlet_cells( s , c , cells , shift );
+    for ( l = 0 ; l < nr_cells ; l++ )
+        if ( cells[l]->count > ( 1 << space_verlet_pidbits ) )
+            return error(runner_err_verlet_overflow);
+    rl = s->cutoff + s->verlet_skin;
+    rl2 = rl * rl;
+    emt = eng->max_type;
     pix[3] = FPTYPE_ZERO;
-    pjx[3] = FPTYPE_ZERO;
-    
-    /* Loop over all entries. */
-    for ( i = 0 ; i < c->count ; i++ ) {
-    
+
+    /* Loop over the particles in this cell. */
+    nlist = c->nlist;
+    for ( ind = 0 , i = 0 ; i < count ; i++ ) {
+
         /* Get a hold of the ith particle. */
         part_i = &( c->parts[i] );
-        pid = part_i->id;
-        verlet_list = &( s->verlet_list[ pid * space_verlet_maxpairs ] );
-        pix[0] = part_i->x[0];
-        pix[1] = part_i->x[1];
-        pix[2] = part_i->x[2];
-        nrpairs = s->verlet_nrpairs[ pid ];
-        #if defined(VECTORIZE)
-            pif = &( f_out[ pid*4 ] );
-        #endif
-        
-        /* loop over all other particles */
-        for ( j = 0 ; j < nrpairs ; j++ ) {
-
-            /* get the other particle */
-            part_j = verlet_list[j].p;
+        pioff = part_i->typeId * emt;
+        c->nlist_offset[i] = ind;
 
-            /* get the distance between both particles */
+        /* Loop over the paired cells, only look at the preceding
+           particles in the cell itself. */
+        for ( l = 0 ; l < nr_cells ; l++ ) {
+
+            parts_j = cells[l]->parts;
+            count_j = ( l == 0 ) ? i : cells[l]->count;
             for ( k = 0 ; k < 3 ; k++ )
-                pjx[k] = part_j->x[k] + verlet_list[j].shift[k]*h[k];
-            r2 = fptype_r2( pix , pjx , dx );
+                pix[k] = part_i->x[k] - shift[3*l+k];
 
-            /* is this within cutoff? */
-            if ( r2 > cutoff2 )
-                continue;
-            // runner_rcount += 1;
-                
-            /* fetch the potential, should be non-NULL by design! */
-            pot = verlet_list[j].pot;
-
-            #ifdef VECTORIZE
-                /* add this interaction to the interaction queue. */
-                r2q[icount] = r2;
-                dxq[icount*3] = dx[0];
-                dxq[icount*3+1] = dx[1];
-                dxq[icount*3+2] = dx[2];
-                effi[icount] = pif;
-                effj[icount] = &( f_out[part_j->id*4] );
-                potq[icount] = pot;
-                icount += 1;
-
-                /* evaluate the interactions if the queue is full. */
-                if ( icount == VEC_SIZE ) {
-
-                    #if defined(FPTYPE_SINGLE)
-                        #if VEC_SIZE==8
-                        potential_eval_vec_8single( potq , r2q , ee , eff );
-                        #else
-                        potential_eval_vec_4single( potq , r2q , ee , eff );
-                        #endif
-                    #elif defined(FPTYPE_DOUBLE)
-                        #if VEC_SIZE==4
-                        potential_eval_vec_4double( potq , r2q , ee , eff );
-                        #else
-                        potential_eval_vec_2double( potq , r2q , ee , eff );
-                        #endif
-                    #endif
-
-                    /* update the forces and the energy */
-                    for ( l = 0 ; l < VEC_SIZE ; l++ ) {
-                        epot += ee[l];
-                        for ( k = 0 ; k < 3 ; k++ ) {
-                            w = eff[l] * dxq[l*3+k];
-                            effi[l][k] -= w;
-                            effj[l][k] += w;
-                            }
-                        }
-
-                    /* re-set the counter. */
-                    icount = 0;
+            for ( j = 0 ; j < count_j ; j++ ) {
 
-                    }
-            #else
-                /* evaluate the interaction */
-                #ifdef EXPLICIT_POTENTIALS
-                    potential_eval_expl( pot , r2 , &ee , &eff );
-                #else
-                    potential_eval( pot , r2 , &ee , &eff );
-                #endif
-
-                /* update the forces */
-                for ( k = 0 ; k < 3 ; k++ ) {
-                    w = eff * dx[k];
-                    f_out[i*4+k] -= w;
-                    f_out[part_j->id*4+k] += w;
-                    }
+                /* get the other particle */
+                part_j = &( parts_j[j] );
 
-                /* tabulate the energy */
-                epot += ee;
-            #endif
+                /* is this within the list radius? */
+                r2 = fptype_r2( pix , part_j->x , dx );
+                if ( r2 > rl2 )
+                    continue;
 
-            } /* loop over all other particles */
-            
-        }
-        
-    #if defined(VECTORIZE)
-        /* are there any leftovers? */
-        if ( icount > 0 ) {
-
-            /* copy the first potential to the last entries */
-            for ( k = icount ; k < VEC_SIZE ; k++ ) {
-                potq[k] = potq[0];
-                r2q[k] = r2q[0];
-                }
+                /* only keep pairs with a potential */
+                if ( pots[ pioff + part_j->typeId ] == NULL )
+                    continue;
+
+                /* and that are not excluded */
+                if ( engine_excluded( eng , part_i , part_j ) )
+                    continue;
 
-            /* evaluate the potentials */
-            #if defined(VEC_SINGLE)
-                #if VEC_SIZE==8
-                potential_eval_vec_8single( potq , r2q , ee , eff );
-                #else
-                potential_eval_vec_4single( potq , r2q , ee , eff );
-                #endif
-            #elif defined(VEC_DOUBLE)
-                #if VEC_SIZE==4
-                potential_eval_vec_4double( potq , r2q , ee , eff );
-                #else
-                potential_eval_vec_2double( potq , r2q , ee , eff );
-                #endif
-            #endif
-
-            /* for each entry, update the forces and energy */
-            for ( l = 0 ; l < icount ; l++ ) {
-                epot += ee[l];
-                for ( k = 0 ; k < 3 ; k++ ) {
-                    w = eff[l] * dxq[l*3+k];
-                    effi[l][k] -= w;
-                    effj[l][k] += w;
+                /* make room if needed and store the entry. */
+                if ( ind == c->nlist_size ) {
+                    size = space_verlet_grow * c->nlist_size + count;
+                    if ( ( nlist = (unsigned int *)realloc( c->nlist , sizeof(unsigned int) * size ) ) == NULL )
+                        return error(runner_err_malloc);
+                    c->nlist = nlist;
+                    c->nlist_size = size;
                     }
+                nlist[ind] = space_verlet_entry( l , j );
+                ind += 1;
+
                 }
 
             }
-    #endif
-        
-    /* Store the accumulated potential energy. */
-    r->epot += epot;
 
-    /* All has gone well. */
+        }
+
+    /* Close the last row. */
+    c->nlist_offset[count] = ind;
+    c->nlist_count = count;
+
+    /* since nothing bad happened to us... */
     return runner_err_ok;
 
     }
-    
-    
+
+
 /**
- * @brief Fill in the Verlet list entries for the given space_cell pair.
- * 
- * @param r The #runner computing the pair.
- * @param cell_i The first cell.
- * @param cell_j The second cell.
- * @param pshift A pointer to an array of three floating point values containing
- *      the vector separating the centers of @c cell_i and @c cell_j.
+ * @brief Compute the interactions between the particles in the given
+ *        space_cell using the verlet list.
+ *
+ * @param r The #runner.
+ * @param c The #cell containing the particles to traverse.
+ * @param f_out A pointer to an array of #FPTYPE, four per particle ID,
+ *        in which to aggregate the forces on particles in other cells.
  *
  * @return #runner_err_ok or <0 on error (see #runner_err)
  *
+ * The forces on the particles in @c c are added to the particles directly,
+ * since only one #runner traverses any given cell. The potential energy
+ * goes to the cell, pairs with ghost cells count half.
+ *
+ * All the potentials are evaluated with the closed form @c kind, or
+ * interpolated if @c kind is #potential_kind_table.
  */
- 
-__attribute__ ((flatten)) int runner_verlet_fill ( struct runner *r , struct space_cell *cell_i , struct space_cell *cell_j , FPTYPE *pshift ) {
 
+template <int kind> __attribute__ ((flatten)) static int runner_verlet_eval_kind ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
+
+    struct engine *eng = r->e;
+    struct space *s = &eng->s;
+    struct space_cell *cells[space_verlet_maxcells];
     struct MxParticle *part_i, *part_j;
-    struct space *s;
-    int count = 0;
-    int i, j, k;
-    struct MxParticle *parts_i, *parts_j;
-    struct MxPotential *pot, **pots;
-    struct engine *eng;
-    int emt, pioff, count_i, count_j;
-    FPTYPE cutoff, cutoff2, skin, skin2, r2, dx[4], w;
-    FPTYPE dscale;
-    FPTYPE shift[3], inshift, nshift;
-    FPTYPE pix[4], *pif;
-    int pid, pind, ishift[3];
-    unsigned int *parts, dskin;
-    struct verlet_entry *vbuff;
-    double epot = 0.0;
-#if defined(VECTORIZE)
-    struct MxPotential *potq[VEC_SIZE];
-    int icount = 0, l;
-    FPTYPE *effi[VEC_SIZE], *effj[VEC_SIZE];
-    FPTYPE r2q[VEC_SIZE] __attribute__ ((aligned (16)));
-    FPTYPE e[VEC_SIZE] __attribute__ ((aligned (16)));
-    FPTYPE f[VEC_SIZE] __attribute__ ((aligned (16)));
-    FPTYPE dxq[VEC_SIZE*3];
-#else
-    FPTYPE e, f;
-#endif
-    
-    /* break early if one of the cells is empty */
-    count_i = cell_i->count;
-    count_j = cell_j->count;
-    if ( count_i == 0 || count_j == 0 || ( cell_i == cell_j && count_i < 2 ) )
-        return runner_err_ok;
-    
-    /* get the space and cutoff */
-    eng = r->e;
+    struct MxPotential *pot, **pots = eng->p;
+    int i, k, l, n, last, nr_cells, emt, pioff;
+    unsigned int entry, *nlist = c->nlist;
+    FPTYPE shift[3*space_verlet_maxcells];
+    FPTYPE cutoff2, r2, w, e, f, pix[4], dx[4], fi[3], *pjf;
+    double epot[space_verlet_maxcells];
+
+    /* Was the list built for these particles? */
+    if ( c->nlist_count != c->count )
+        return error(runner_err_verlet_stale);
+
+    /* Get the paired cells and some other useful things. */
+    nr_cells = runner_verlet_cells( s , c , cells , shift );
+    for ( l = 0 ; l < nr_cells ; l++ )
+        epot[l] = 0.0;
+    cutoff2 = s->cutoff2;
     emt = eng->max_type;
-    s = &(eng->s);
-    pots = eng->p;
-    skin = fmin( s->h[0] , fmin( s->h[1] , s->h[2] ) );
-    skin2 = skin * skin;
-    cutoff = s->cutoff;
-    cutoff2 = cutoff*cutoff;
-    dscale = (FPTYPE)SHRT_MAX / ( 3 * sqrt( s->h[0]*s->h[0] + s->h[1]*s->h[1] + s->h[2]*s->h[2] ) );
-    dskin = 1 + dscale*skin;
     pix[3] = FPTYPE_ZERO;
-    
-    /* Make local copies of the parts if requested. */
-    if ( r->e->flags & engine_flag_localparts ) {
-    
-        /* set pointers to the particle lists */
-        parts_i = (MxParticle *)alloca( sizeof(MxParticle) * count_i );
-        memcpy( parts_i , cell_i->parts , sizeof(MxParticle) * count_i );
-        if ( cell_i != cell_j ) {
-            parts_j = (MxParticle *)alloca( sizeof(MxParticle) * count_j );
-            memcpy( parts_j , cell_j->parts , sizeof(MxParticle) * count_j );
-            }
-        else
-            parts_j = parts_i;
-        }
-        
-    else {
-        parts_i = cell_i->parts;
-        parts_j = cell_j->parts;
-        }
-        
-    /* Is this a self interaction? */
-    if ( cell_i == cell_j ) {
-    
-        /* loop over all particles */
-        for ( i = 1 ; i < count_i ; i++ ) {
-        
-            /* get the particle */
-            part_i = &(parts_i[i]);
-            pix[0] = part_i->x[0];
-            pix[1] = part_i->x[1];
-            pix[2] = part_i->x[2];
-            pioff = part_i->typeId * emt;
-            pid = part_i->id;
-            pind = s->verlet_nrpairs[ pid ];
-            vbuff = &(s->verlet_list[ pid * space_verlet_maxpairs ]);
-            pif = &( part_i->f[0] );
-        
-            /* loop over all other particles */
-            for ( j = 0 ; j < i ; j++ ) {
-            
-                /* get the other particle */
-                part_j = &(parts_j[j]);
-                
-                /* get the distance between both particles */
-                r2 = fptype_r2( pix , part_j->x , dx );
-                    
-                /* is this within cutoff? */
-                if ( r2 > skin2 )
-                    continue;
-                /* runner_rcount += 1; */
-                    
-                /* fetch the potential, if any */
-                pot = pots[ pioff + part_j->typeId ];
-                if ( pot == NULL )
-                    continue;
-                    
-                /* Add this pair to the verlet list. */
-                vbuff[pind].shift[0] = 0;
-                vbuff[pind].shift[1] = 0;
-                vbuff[pind].shift[2] = 0;
-                vbuff[pind].pot = pot;
-                vbuff[pind].p = &(cell_j->parts[j]);
-                pind += 1;
-                    
-                /* is this within cutoff? */
-                if ( r2 > cutoff2 )
-                    continue;
-                // runner_rcount += 1;
-
-                #if defined(VECTORIZE)
-                    /* add this interaction to the interaction queue. */
-                    r2q[icount] = r2;
-                    dxq[icount*3] = dx[0];
-                    dxq[icount*3+1] = dx[1];
-                    dxq[icount*3+2] = dx[2];
-                    effi[icount] = pif;
-                    effj[icount] = part_j->f;
-                    potq[icount] = pot;
-                    icount += 1;
-
-                    /* evaluate the interactions if the queue is full. */
-                    if ( icount == VEC_SIZE ) {
-
-                        #if defined(FPTYPE_SINGLE)
-                            #if VEC_SIZE==8
-                            potential_eval_vec_8single( potq , r2q , e , f );
-                            #else
-                            potential_eval_vec_4single( potq , r2q , e , f );
-                            #endif
-                        #elif defined(FPTYPE_DOUBLE)
-                            #if VEC_SIZE==4
-                            potential_eval_vec_4double( potq , r2q , e , f );
-                            #else
-                            potential_eval_vec_2double( potq , r2q , e , f );
-                            #endif
-                        #endif
-
-                        /* update the forces and the energy */
-                        for ( l = 0 ; l < VEC_SIZE ; l++ ) {
-                            epot += e[l];
-                            for ( k = 0 ; k < 3 ; k++ ) {
-                                w = f[l] * dxq[l*3+k];
-                                effi[l][k] -= w;
-                                effj[l][k] += w;
-                                }
-                            }
-
-                        /* re-set the counter. */
-                        icount = 0;
-
-                        }
-                #else
-                    /* evaluate the interaction */
-                    #ifdef EXPLICIT_POTENTIALS
-                        potential_eval_expl( pot , r2 , &e , &f );
-                    #else
-                        potential_eval( pot , r2 , &e , &f );
-                    #endif
-
-                    /* update the forces */
-                    for ( k = 0 ; k < 3 ; k++ ) {
-                        w = f * dx[k];
-                        pif[k] -= w;
-                        part_j->f[k] += w;
-                        }
-
-                    /* tabulate the energy */
-                    epot += e;
-                #endif
-
-                } /* loop over all other particles */
-                
-            /* Adjust verlet_nrpairs. */
-            if ( ( s->verlet_nrpairs[pid] = pind ) > space_verlet_maxpairs )
-                return error(runner_err_verlet_overflow);
-        
-            } /* loop over all particles */
-    
-        }
-        
-    /* No, genuine pair. */
-    else {
-    
-        /* Get the integer shift. */
-        ishift[0] = round( pshift[0] * s->ih[0] );
-        ishift[1] = round( pshift[1] * s->ih[1] );
-        ishift[2] = round( pshift[2] * s->ih[2] );
-        
-        /* Allocate work arrays on stack. */
-        if ( ( parts = (unsigned int*)alloca( sizeof(unsigned int) * (count_i + count_j) ) ) == NULL )
-            return error(runner_err_malloc);
-        
-        /* start by filling the particle ids of both cells into ind and d */
-        nshift = sqrt( pshift[0]*pshift[0] + pshift[1]*pshift[1] + pshift[2]*pshift[2] );
-        inshift = 1.0 / nshift;
-        shift[0] = pshift[0]*inshift; shift[1] = pshift[1]*inshift; shift[2] = pshift[2]*inshift;
-        for ( i = 0 ; i < count_i ; i++ ) {
-            part_i = &( parts_i[i] );
-            parts[count] = (i << 16) |
-                (unsigned int)( dscale * ( nshift + part_i->x[0]*shift[0] + part_i->x[1]*shift[1] + part_i->x[2]*shift[2] ) );
-            count += 1;
-            }
-        for ( i = 0 ; i < count_j ; i++ ) {
-            part_i = &( parts_j[i] );
-            parts[count] = (i << 16) |
-                (unsigned int)( dscale * ( nshift + (part_i->x[0]+pshift[0])*shift[0] + (part_i->x[1]+pshift[1])*shift[1] + (part_i->x[2]+pshift[2])*shift[2] ) );
-            count += 1;
-            }
 
-        /* Sort parts in cell_i in decreasing order. */
-        runner_sort_descending( parts , count_i );
+    /* Loop over all entries. */
+    for ( i = 0 ; i < c->count ; i++ ) {
 
-        /* Sort parts in cell_j in increasing order. */
-        runner_sort_ascending( &parts[count_i] , count_j );
+        /* Get a hold of the ith particle. */
+        part_i = &( c->parts[i] );
+        pioff = part_i->typeId * emt;
+        fi[0] = fi[1] = fi[2] = FPTYPE_ZERO;
 
+        /* loop over its neighbours */
+        last = c->nlist_offset[i+1];
+        for ( n = c->nlist_offset[i] ; n < last ; n++ ) {
 
-        /* loop over the sorted list of particles in i */
-        for ( i = 0 ; i < count_i ; i++ ) {
+            /* unpack the entry */
+            entry = nlist[n];
+            l = entry >> space_verlet_pidbits;
+            part_j = &( cells[l]->parts[ entry & ( ( 1u << space_verlet_pidbits ) - 1 ) ] );
 
-            /* Quit early? */
-            if ( (parts[count_i] & 0xffff) - (parts[i] & 0xffff) > dskin )
-                break;
+            /* get the distance between both particles */
+            for ( k = 0 ; k < 3 ; k++ )
+                pix[k] = part_i->x[k] - shift[3*l+k];
+            r2 = fptype_r2( pix , part_j->x , dx );
 
-            /* get a handle on this particle */
-            part_i = &( parts_i[ parts[i] >> 16 ] );
-            pix[0] = part_i->x[0] - pshift[0];
-            pix[1] = part_i->x[1] - pshift[1];
-            pix[2] = part_i->x[2] - pshift[2];
-            pioff = part_i->typeId * emt;
-            pif = &( part_i->f[0] );
-            pid = part_i->id;
-            pind = s->verlet_nrpairs[ pid ];
-            vbuff = &(s->verlet_list[ pid * space_verlet_maxpairs ]);
+            /* is this within cutoff? */
+            if ( r2 > cutoff2 )
+                continue;
 
-            /* loop over the left particles */
-            for ( j = 0 ; j < count_j && (parts[count_i+j] & 0xffff) - (parts[i] & 0xffff) < dskin ; j++ ) {
+            /* fetch the potential, should be non-NULL by design! */
+            pot = pots[ pioff + part_j->typeId ];
 
-                /* get a handle on the second particle */
-                part_j = &( parts_j[ parts[count_i+j] >> 16 ] );
-                    
-                /* get the distance between both particles */
-                r2 = fptype_r2( pix , part_j->x , dx );
+            /* evaluate the interaction */
+            potential_eval_kind<kind>( pot , r2 , &e , &f );
 
-                /* is this within cutoff? */
-                if ( r2 > skin2 )
-                    continue;
-                /* runner_rcount += 1; */
+            /* update the forces, particles in this cell are ours */
+            pjf = ( l == 0 ) ? part_j->f : &( f_out[ 4*part_j->id ] );
+            for ( k = 0 ; k < 3 ; k++ ) {
+                w = f * dx[k];
+                fi[k] -= w;
+                pjf[k] += w;
+                }
 
-                /* fetch the potential, if any */
-                pot = pots[ pioff + part_j->typeId ];
-                if ( pot == NULL )
-                    continue;
+            /* tabulate the energy */
+            epot[l] += e;
 
-                /* Add this pair to the verlet list. */
-                vbuff[pind].shift[0] = ishift[0];
-                vbuff[pind].shift[1] = ishift[1];
-                vbuff[pind].shift[2] = ishift[2];
-                vbuff[pind].pot = pot;
-                vbuff[pind].p = &( cell_j->parts[ parts[count_i+j] >> 16 ] );
-                pind += 1;
+            } /* loop over all other particles */
 
-                /* is this within cutoff? */
-                if ( r2 > cutoff2 )
-                    continue;
-                // runner_rcount += 1;
-
-                #if defined(VECTORIZE)
-                    /* add this interaction to the interaction queue. */
-                    r2q[icount] = r2;
-                    dxq[icount*3] = dx[0];
-                    dxq[icount*3+1] = dx[1];
-                    dxq[icount*3+2] = dx[2];
-                    effi[icount] = pif;
-                    effj[icount] = part_j->f;
-                    potq[icount] = pot;
-                    icount += 1;
-
-                    /* evaluate the interactions if the queue is full. */
-                    if ( icount == VEC_SIZE ) {
-
-                        #if defined(FPTYPE_SINGLE)
-                            #if VEC_SIZE==8
-                            potential_eval_vec_8single( potq , r2q , e , f );
-                            #else
-                            potential_eval_vec_4single( potq , r2q , e , f );
-                            #endif
-                        #elif defined(FPTYPE_DOUBLE)
-                            #if VEC_SIZE==4
-                            potential_eval_vec_4double( potq , r2q , e , f );
-                            #else
-                            potential_eval_vec_2double( potq , r2q , e , f );
-                            #endif
-                        #endif
-
-                        /* update the forces and the energy */
-                        for ( l = 0 ; l < VEC_SIZE ; l++ ) {
-                            epot += e[l];
-                            for ( k = 0 ; k < 3 ; k++ ) {
-                                w = f[l] * dxq[l*3+k];
-                                effi[l][k] -= w;
-                                effj[l][k] += w;
-                                }
-                            }
-
-                        /* re-set the counter. */
-                        icount = 0;
-
-                        }
-                #else
-                    /* evaluate the interaction */
-                    #ifdef EXPLICIT_POTENTIALS
-                        potential_eval_expl( pot , r2 , &e , &f );
-                    #else
-                        potential_eval( pot , r2 , &e , &f );
-                    #endif
-
-                    /* update the forces */
-                    for ( k = 0 ; k < 3 ; k++ ) {
-                        w = f * dx[k];
-                        pif[k] -= w;
-                        part_j->f[k] += w;
-                        }
-
-                    /* tabulate the energy */
-                    epot += e;
-                #endif
-
-                } /* loop over particles in cell_j. */
-
-            /* Adjust verlet_nrpairs. */
-            if ( ( s->verlet_nrpairs[pid] = pind ) > space_verlet_maxpairs )
-                return error(runner_err_verlet_overflow);
-        
-            } /* loop over all particles in cell_i. */
+        for ( k = 0 ; k < 3 ; k++ )
+            part_i->f[k] += fi[k];
 
         }
-        
-    #if defined(VECTORIZE)
-        /* are there any leftovers? */
-        if ( icount > 0 ) {
-
-            /* copy the first potential to the last entries */
-            for ( k = icount ; k < VEC_SIZE ; k++ ) {
-                potq[k] = potq[0];
-                r2q[k] = r2q[0];
-                }
 
-            /* evaluate the potentials */
-            #if defined(VEC_SINGLE)
-                #if VEC_SIZE==8
-                potential_eval_vec_8single( potq , r2q , e , f );
-                #else
-                potential_eval_vec_4single( potq , r2q , e , f );
-                #endif
-            #elif defined(VEC_DOUBLE)
-                #if VEC_SIZE==4
-                potential_eval_vec_4double( potq , r2q , e , f );
-                #else
-                potential_eval_vec_2double( potq , r2q , e , f );
-                #endif
-            #endif
-
-            /* for each entry, update the forces and energy */
-            for ( l = 0 ; l < icount ; l++ ) {
-                epot += e[l];
-                for ( k = 0 ; k < 3 ; k++ ) {
-                    w = f[l] * dxq[l*3+k];
-                    effi[l][k] -= w;
-                    effj[l][k] += w;
-                    }
-                }
+    /* Store the accumulated potential energy. */
+    for ( l = 0 ; l < nr_cells ; l++ )
+        c->epot += ( cells[l]->flags & cell_flag_ghost ) ? 0.5 * epot[l] : epot[l];
 
-            }
-    #endif
-        
-    /* Store the potential energy to cell_i. */
-    if ( cell_j->flags & cell_flag_ghost || cell_i->flags & cell_flag_ghost )
-        cell_i->epot += 0.5 * epot;
-    else
-        cell_i->epot += epot;
-        
-    /* Write local data back if needed. */
-    if ( r->e->flags & engine_flag_localparts ) {
-    
-        /* copy the particle data back */
-        for ( i = 0 ; i < count_i ; i++ ) {
-            cell_i->parts[i].f[0] = parts_i[i].f[0];
-            cell_i->parts[i].f[1] = parts_i[i].f[1];
-            cell_i->parts[i].f[2] = parts_i[i].f[2];
-            }
-        if ( cell_i != cell_j )
-            for ( i = 0 ; i < count_j ; i++ ) {
-                cell_j->parts[i].f[0] = parts_j[i].f[0];
-                cell_j->parts[i].f[1] = parts_j[i].f[1];
-                cell_j->parts[i].f[2] = parts_j[i].f[2];
-                }
-        }
-        
-    /* since nothing bad happened to us... */
+    /* All has gone well. */
     return runner_err_ok;
 
     }
-    
-    
+
+
+/**
+ * @brief Compute the interactions between the particles in the given
+ *        space_cell using the verlet list.
+ *
+ * Calls the instance of #runner_verlet_eval_kind for the closed form
+ * shared by all the potentials of the #engine.
+ */
+
+int runner_verlet_eval ( struct runner *r , struct space_cell *c , FPTYPE *f_out ) {
+
+    potential_kind_dispatch( r->e->pot_kind , runner_verlet_eval_kind , ( r , c , f_out ) );
+
+    }
@@ -140,6 +140,7 @@ int space_flush_ghosts ( struct space *s ) {
             s->nr_parts -= s->cells[cid].count;
             s->cells[cid].count = 0;
         }
+    s->parts_moved = 1;
 
     /* done for now. */
     return space_err_ok;
@@ -169,6 +170,7 @@ int space_flush ( struct space *s ) {
 
     /* Set the nr of parts to zero. */
     s->nr_parts = 0;
+    s->parts_moved = 1;
 
     /* done for now. */
     return space_err_ok;
@@ -177,19 +179,20 @@ int space_flush ( struct space *s ) {
 
 
 /**
- * @brief Prepare the space before a time step.
+ * @brief Prepare the tasks and counters of the space before a time step.
  *
  * @param s A pointer to the #space to prepare.
  *
  * @return #space_err_ok or < 0 on error (see #space_err)
  *
- * Initializes a #space for a single time step. This routine runs
- * through the particles and sets their forces to zero.
+ * Same as #space_prepare, but leaves the particle forces untouched.
+ * Used when the forces are already cleared at the end of the previous
+ * step by the integration tasks (see #space_addtasks_integrate).
  */
 
-int space_prepare ( struct space *s ) {
+int space_prepare_tasks ( struct space *s ) {
 
-    int pid, cid, j, k;
+    int j, k;
 
     /* re-set some counters. */
     s->nr_swaps = 0;
@@ -206,12 +209,45 @@ int space_prepare ( struct space *s ) {
         for ( j = 0 ; j < s->tasks[k].nr_unlock ; j++ )
             s->tasks[k].unlock[j]->wait += 1;
 
-    /* run through the cells and re-set the potential energy and forces */
+    /* run through the cells and re-set the potential energy */
+    for ( j = 0 ; j < s->nr_marked ; j++ )
+        s->cells[ s->cid_marked[j] ].epot = 0.0;
+
+    /* what else could happen? */
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Prepare the space before a time step.
+ *
+ * @param s A pointer to the #space to prepare.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err)
+ *
+ * Initializes a #space for a single time step. This routine runs
+ * through the particles and sets their forces to zero.
+ */
+
+int space_prepare ( struct space *s ) {
+
+    int pid, cid, j, k;
+
+    /* re-set the counters, waits and cell energies. */
+    if ( space_prepare_tasks( s ) < 0 )
+        return error(space_err);
+
+    /* run through the cells and re-set the forces */
     for ( j = 0 ; j < s->nr_marked ; j++ ) {
         cid = s->cid_marked[j];
-        s->cells[cid].epot = 0.0;
         if ( s->cells[cid].flags & cell_flag_ghost )
             continue;
+        if ( s->cells[cid].flags & cell_flag_soa ) {
+            for ( k = 0 ; k < 3 ; k++ )
+                bzero( s->cells[cid].soa_f[k] , sizeof(FPTYPE) * s->cells[cid].count );
+            continue;
+        }
         for ( pid = 0 ; pid < s->cells[cid].count ; pid++ )
             for ( k = 0 ; k < 3 ; k++ )
                 s->cells[cid].parts[pid].f[k] = 0.0;
@@ -223,6 +259,108 @@ int space_prepare ( struct space *s ) {
 }
 
 
+/**
+ * @brief Store the positions, velocities and forces of the particles in
+ *      the structure-of-arrays buffers of the cells from now on.
+ *
+ * @param s The #space.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * Every cell gets #cell_flag_soa and its particle records are copied to
+ * its SoA buffers. From then on, the @c x, @c v and @c f of the records
+ * in the cells are stale, and have to be accessed through
+ * #space_getpos, #space_getvel, #space_getforce and their setters, or
+ * made current with #space_soa_unpack.
+ */
+
+int space_soa_init ( struct space *s ) {
+
+    int cid;
+
+    if ( s == NULL )
+        return error(space_err_null);
+
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+        if ( space_cell_soa_pack( &s->cells[cid] ) < 0 )
+            return error(space_err_cell);
+        s->cells[cid].flags |= cell_flag_soa;
+    }
+    s->soa = 1;
+
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Copy the particle records of all cells to their
+ *      structure-of-arrays buffers.
+ *
+ * @param s The #space.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * Takes back the changes made to the records after #space_soa_unpack,
+ * e.g. by the bonded interactions or the constraints.
+ */
+
+int space_soa_pack ( struct space *s ) {
+
+    int cid, err = space_err_ok;
+
+    if ( s == NULL )
+        return error(space_err_null);
+    if ( !s->soa )
+        return space_err_ok;
+
+#pragma omp parallel for schedule(static), private(cid)
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+        if ( space_cell_soa_pack( &s->cells[cid] ) < 0 )
+            err = space_err_cell;
+
+    if ( err < 0 )
+        return error(err);
+
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Copy the positions, velocities and forces in the
+ *      structure-of-arrays buffers of all cells to their particle records.
+ *
+ * @param s The #space.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * Used before code that works on the records directly. If that code
+ * changes them, they have to be copied back with #space_soa_pack.
+ */
+
+int space_soa_unpack ( struct space *s ) {
+
+    int cid, err = space_err_ok;
+
+    if ( s == NULL )
+        return error(space_err_null);
+    if ( !s->soa )
+        return space_err_ok;
+
+#pragma omp parallel for schedule(static), private(cid)
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+        if ( space_cell_soa_unpack( &s->cells[cid] ) < 0 )
+            err = space_err_cell;
+
+    if ( err < 0 )
+        return error(err);
+
+    return space_err_ok;
+
+}
+
+
 /**
  * @brief Run through the cells of a #space and make sure every particle is in
  * its place.
@@ -238,8 +376,8 @@ int space_prepare ( struct space *s ) {
 
 int space_shuffle ( struct space *s ) {
 
-    int k, cid, pid, delta[3];
-    FPTYPE h[3];
+    int k, cid, pid, soa, delta[3];
+    FPTYPE h[3], x;
     struct space_cell *c, *c_dest;
     struct MxParticle *p;
 
@@ -247,18 +385,23 @@ int space_shuffle ( struct space *s ) {
     for ( k = 0 ; k < 3 ; k++ )
         h[k] = s->h[k];
 
-#pragma omp parallel for schedule(static), private(cid,c,pid,p,k,delta,c_dest)
+#pragma omp parallel for schedule(static), private(cid,c,pid,p,k,delta,c_dest,soa,x)
     for ( cid = 0 ; cid < s->nr_marked ; cid++ ) {
         c = &(s->cells[ s->cid_marked[cid] ]);
+        soa = c->flags & cell_flag_soa;
         pid = 0;
         while ( pid < c->count ) {
 
             p = &( c->parts[pid] );
-            for ( k = 0 ; k < 3 ; k++ )
-                delta[k] = __builtin_isgreaterequal( p->x[k] , h[k] ) - __builtin_isless( p->x[k] , 0.0 );
+            for ( k = 0 ; k < 3 ; k++ ) {
+                x = soa ? c->soa_x[k][pid] : p->x[k];
+                delta[k] = __builtin_isgreaterequal( x , h[k] ) - __builtin_isless( x , 0.0 );
+            }
 
             /* do we have to move this particle? */
             if ( ( delta[0] != 0 ) || ( delta[1] != 0 ) || ( delta[2] != 0 ) ) {
+                if ( soa )
+                    space_cell_soa_get( c , pid );
                 for ( k = 0 ; k < 3 ; k++ )
                     p->x[k] -= delta[k] * h[k];
                 c_dest = &( s->cells[ space_cellid( s ,
@@ -278,9 +421,12 @@ int space_shuffle ( struct space *s ) {
                 }
 
                 s->celllist[ p->id ] = c_dest;
+                s->parts_moved = 1;
                 c->count -= 1;
                 if ( pid < c->count ) {
                     c->parts[pid] = c->parts[c->count];
+                    if ( soa )
+                        space_cell_soa_move( c , pid , c->count );
                     s->partlist[ c->parts[pid].id ] = &( c->parts[pid] );
                 }
             }
@@ -310,8 +456,8 @@ int space_shuffle ( struct space *s ) {
 
 int space_shuffle_local ( struct space *s ) {
 
-    int k, cid, pid, delta[3];
-    FPTYPE h[3];
+    int k, cid, pid, soa, delta[3];
+    FPTYPE h[3], x;
     struct space_cell *c, *c_dest;
     struct MxParticle *p;
 
@@ -319,18 +465,23 @@ int space_shuffle_local ( struct space *s ) {
     for ( k = 0 ; k < 3 ; k++ )
         h[k] = s->h[k];
 
-#pragma omp parallel for schedule(static), private(cid,c,pid,p,k,delta,c_dest)
+#pragma omp parallel for schedule(static), private(cid,c,pid,p,k,delta,c_dest,soa,x)
     for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
         c = &(s->cells[ s->cid_real[cid] ]);
+        soa = c->flags & cell_flag_soa;
         pid = 0;
         while ( pid < c->count ) {
 
             p = &( c->parts[pid] );
-            for ( k = 0 ; k < 3 ; k++ )
-                delta[k] = __builtin_isgreaterequal( p->x[k] , h[k] ) - __builtin_isless( p->x[k] , 0.0 );
+            for ( k = 0 ; k < 3 ; k++ ) {
+                x = soa ? c->soa_x[k][pid] : p->x[k];
+                delta[k] = __builtin_isgreaterequal( x , h[k] ) - __builtin_isless( x , 0.0 );
+            }
 
             /* do we have to move this particle? */
             if ( ( delta[0] != 0 ) || ( delta[1] != 0 ) || ( delta[2] != 0 ) ) {
+                if ( soa )
+                    space_cell_soa_get( c , pid );
 
                 for ( k = 0 ; k < 3 ; k++ )
                     p->x[k] -= delta[k] * h[k];
@@ -350,10 +501,13 @@ int space_shuffle_local ( struct space *s ) {
                     s->celllist[ p->id ] = NULL;
                 }
                 s->celllist[ p->id ] = c_dest;
+                s->parts_moved = 1;
 
                 c->count -= 1;
                 if ( pid < c->count ) {
                     c->parts[pid] = c->parts[c->count];
+                    if ( soa )
+                        space_cell_soa_move( c , pid , c->count );
                     s->partlist[ c->parts[pid].id ] = &( c->parts[pid] );
                 }
             }
@@ -414,15 +568,21 @@ int space_addpart ( struct space *s , struct MxParticle *p , double *x, struct M
     /* get the appropriate cell */
     c = &( s->cells[ space_cellid(s,ind[0],ind[1],ind[2]) ] );
 
-    /* make the particle position local */
-    for ( k = 0 ; k < 3 ; k++ )
+    /* make the particle position local, start without any forces */
+    for ( k = 0 ; k < 3 ; k++ ) {
         p->x[k] = x[k] - c->origin[k];
+        p->f[k] = 0.0;
+    }
 
     /* delegate the particle to the cell */
     if ( ( s->partlist[p->id] = space_cell_add( c , p , s->partlist ) ) == NULL )
         return error(space_err_cell);
     
     s->celllist[p->id] = c;
+    s->parts_moved = 1;
+
+    /* The neighbour lists no longer match the cells. */
+    s->verlet_rebuild = 1;
     
     if(result) {
         *result = s->partlist[p->id];
@@ -445,9 +605,20 @@ int space_addpart ( struct space *s , struct MxParticle *p , double *x, struct M
  *
  */
 
+/**
+ * @brief Get the global position of a particle.
+ *
+ * @param s The #space.
+ * @param id The particle ID.
+ * @param x An array of three #FPTYPE for the position.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ */
+
 int space_getpos ( struct space *s , int id , FPTYPE *x ) {
 
-    int k;
+    int k, pid;
+    struct space_cell *c;
 
     /* Sanity check. */
     if ( s == NULL || x == NULL )
@@ -456,17 +627,34 @@ int space_getpos ( struct space *s , int id , FPTYPE *x ) {
         return error(space_err_range);
 
     /* Copy the position to x. */
+    c = s->celllist[id];
+    pid = s->partlist[id] - c->parts;
     for ( k = 0 ; k < 3 ; k++ )
-        x[k] = s->partlist[id]->x[k] + s->celllist[id]->origin[k];
+        x[k] = ( ( c->flags & cell_flag_soa ) ? c->soa_x[k][pid] : s->partlist[id]->x[k] ) + c->origin[k];
 
     /* All is well... */
     return space_err_ok;
 
 }
 
+
+/**
+ * @brief Set the global position of a particle.
+ *
+ * @param s The #space.
+ * @param id The particle ID.
+ * @param x An array of three #FPTYPE with the new position.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * The particle is only moved to the cell of its new position by the next
+ * shuffle, see #space_shuffle.
+ */
+
 int space_setpos ( struct space *s , int id , FPTYPE *x ) {
 
-    int k;
+    int k, pid;
+    struct space_cell *c;
 
     /* Sanity check. */
     if ( s == NULL || x == NULL )
@@ -475,8 +663,13 @@ int space_setpos ( struct space *s , int id , FPTYPE *x ) {
         return error(space_err_range);
 
     /* Copy the position to x. */
+    c = s->celllist[id];
+    pid = s->partlist[id] - c->parts;
     for ( k = 0 ; k < 3 ; k++ )
-        s->partlist[id]->x[k] = x[k] - s->celllist[id]->origin[k];
+        if ( c->flags & cell_flag_soa )
+            c->soa_x[k][pid] = x[k] - c->origin[k];
+        else
+            s->partlist[id]->x[k] = x[k] - c->origin[k];
 
     /* All is well... */
     return space_err_ok;
@@ -484,6 +677,168 @@ int space_setpos ( struct space *s , int id , FPTYPE *x ) {
 }
 
 
+/**
+ * @brief Get the velocity of a particle.
+ *
+ * @param s The #space.
+ * @param id The particle ID.
+ * @param v An array of three #FPTYPE for the velocity.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ */
+
+int space_getvel ( struct space *s , int id , FPTYPE *v ) {
+
+    int k, pid;
+    struct space_cell *c;
+
+    /* Sanity check. */
+    if ( s == NULL || v == NULL )
+        return error(space_err_null);
+    if ( id >= s->nr_parts )
+        return error(space_err_range);
+
+    c = s->celllist[id];
+    pid = s->partlist[id] - c->parts;
+    for ( k = 0 ; k < 3 ; k++ )
+        v[k] = ( c->flags & cell_flag_soa ) ? c->soa_v[k][pid] : s->partlist[id]->v[k];
+
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Set the velocity of a particle.
+ *
+ * @param s The #space.
+ * @param id The particle ID.
+ * @param v An array of three #FPTYPE with the new velocity.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ */
+
+int space_setvel ( struct space *s , int id , FPTYPE *v ) {
+
+    int k, pid;
+    struct space_cell *c;
+
+    /* Sanity check. */
+    if ( s == NULL || v == NULL )
+        return error(space_err_null);
+    if ( id >= s->nr_parts )
+        return error(space_err_range);
+
+    c = s->celllist[id];
+    pid = s->partlist[id] - c->parts;
+    for ( k = 0 ; k < 3 ; k++ )
+        if ( c->flags & cell_flag_soa )
+            c->soa_v[k][pid] = v[k];
+        else
+            s->partlist[id]->v[k] = v[k];
+
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Get the force on a particle.
+ *
+ * @param s The #space.
+ * @param id The particle ID.
+ * @param f An array of three #FPTYPE for the force.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ */
+
+int space_getforce ( struct space *s , int id , FPTYPE *f ) {
+
+    int k, pid;
+    struct space_cell *c;
+
+    /* Sanity check. */
+    if ( s == NULL || f == NULL )
+        return error(space_err_null);
+    if ( id >= s->nr_parts )
+        return error(space_err_range);
+
+    c = s->celllist[id];
+    pid = s->partlist[id] - c->parts;
+    for ( k = 0 ; k < 3 ; k++ )
+        f[k] = ( c->flags & cell_flag_soa ) ? c->soa_f[k][pid] : s->partlist[id]->f[k];
+
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Set the force on a particle.
+ *
+ * @param s The #space.
+ * @param id The particle ID.
+ * @param f An array of three #FPTYPE with the new force.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ */
+
+int space_setforce ( struct space *s , int id , FPTYPE *f ) {
+
+    int k, pid;
+    struct space_cell *c;
+
+    /* Sanity check. */
+    if ( s == NULL || f == NULL )
+        return error(space_err_null);
+    if ( id >= s->nr_parts )
+        return error(space_err_range);
+
+    c = s->celllist[id];
+    pid = s->partlist[id] - c->parts;
+    for ( k = 0 ; k < 3 ; k++ )
+        if ( c->flags & cell_flag_soa )
+            c->soa_f[k][pid] = f[k];
+        else
+            s->partlist[id]->f[k] = f[k];
+
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Set the type of a particle.
+ *
+ * @param s The #space.
+ * @param id The particle ID.
+ * @param typeId The new type.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ */
+
+int space_settype ( struct space *s , int id , int typeId ) {
+
+    int pid;
+    struct space_cell *c;
+
+    /* Sanity check. */
+    if ( s == NULL )
+        return error(space_err_null);
+    if ( id >= s->nr_parts )
+        return error(space_err_range);
+
+    c = s->celllist[id];
+    pid = s->partlist[id] - c->parts;
+    s->partlist[id]->typeId = typeId;
+    if ( c->flags & cell_flag_soa )
+        c->soa_typeId[pid] = typeId;
+
+    return space_err_ok;
+
+}
+
+
 /**
  * @brief Add a task to the given space.
  *
@@ -517,6 +872,7 @@ struct task *space_addtask ( struct space *s , int type , int subtype , int flag
     /* Init some other values. */
     t->wait = 0;
     t->nr_unlock = 0;
+    t->cost = 0.0;
 
     /* Increase the task counter. */
     s->nr_tasks += 1;
@@ -528,127 +884,132 @@ struct task *space_addtask ( struct space *s , int type , int subtype , int flag
 
 
 /**
- * @brief Initialize the space with the given dimensions.
+ * @brief Add a single-body force task to each real cell.
  *
- * @param s The #space to initialize.
- * @param origin Pointer to an array of three doubles specifying the origin
- *      of the rectangular domain.
- * @param dim Pointer to an array of three doubles specifying the length
- *      of the rectangular domain along each dimension.
- * @param L The minimum cell edge length, in each dimension.
- * @param cutoff A double-precision value containing the maximum cutoff lenght
- *      that will be used in the potentials.
- * @param period Unsigned integer containing the flags #space_periodic_x,
- *      #space_periodic_y and/or #space_periodic_z or #space_periodic_full.
+ * @param s The #space.
  *
- * @return #space_err_ok or <0 on error (see #space_err).
- * 
- * This routine initializes the fields of the #space @c s, creates the cells and
- * generates the cell-pair list.
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * The tasks have no dependencies of their own, but the integration task
+ * of the cell, if any, depends on them. Calling this function more than
+ * once has no effect.
  */
 
-int space_init ( struct space *s , const double *origin , const double *dim ,
-        double *L , double cutoff , unsigned int period ) {
+int space_addtasks_singlebody ( struct space *s ) {
 
-    int i, j, k, l[3], ii, jj, kk;
-    int id1, id2, sid;
-    double o[3], lh[3];
-    struct space_cell *ci, *cj;
+    int k;
+    struct task *t;
+    struct space_cell *c;
 
-    /* check inputs */
-    if ( s == NULL || origin == NULL || dim == NULL || L == NULL )
+    /* check input */
+    if ( s == NULL )
         return error(space_err_null);
 
-    /* Clear the space. */
-    bzero( s , sizeof(struct space) );
+    /* Already done? */
+    for ( k = 0 ; k < s->nr_tasks ; k++ )
+        if ( s->tasks[k].type == task_type_singlebody )
+            return space_err_ok;
 
-    /* set origin and compute the dimensions */
-    for ( i = 0 ; i < 3 ; i++ ) {
-        s->origin[i] = origin[i];
-        s->dim[i] = dim[i];
-        s->cdim[i] = floor( dim[i] / L[i] );
+    /* Add a task to each real cell. */
+    for ( k = 0 ; k < s->nr_real ; k++ ) {
+        c = &s->cells[ s->cid_real[k] ];
+        if ( ( t = space_addtask( s , task_type_singlebody , task_subtype_none , 0 , s->cid_real[k] , -1 ) ) == NULL )
+            return error(space_err);
+        if ( c->integrate != NULL && task_addunlock( t , c->integrate ) != 0 )
+            return error(space_err_task);
     }
 
-    /* remember the cutoff */
-    s->cutoff = cutoff;
-    s->cutoff2 = cutoff*cutoff;
+    /* All is well... */
+    return space_err_ok;
 
-    /* set the periodicity */
-    s->period = period;
+}
 
-    /* allocate the cells */
-    s->nr_cells = s->cdim[0] * s->cdim[1] * s->cdim[2];
-    s->cells = (struct space_cell *)malloc( sizeof(struct space_cell) * s->nr_cells );
-    if ( s->cells == NULL )
-        return error(space_err_malloc);
 
-    /* get the dimensions of each cell */
-    for ( i = 0 ; i < 3 ; i++ ) {
-        s->h[i] = s->dim[i] / s->cdim[i];
-        s->ih[i] = 1.0 / s->h[i];
+/**
+ * @brief Add an integration task to each real cell.
+ *
+ * @param s The #space.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * The integration task of a cell depends on its sort task and on every
+ * self, pair and single-body task involving it, i.e. it only becomes ready
+ * once all the non-bonded forces on the cell's particles have been computed.
+ * Calling this function more than once has no effect.
+ */
+
+int space_addtasks_integrate ( struct space *s ) {
+
+    int k, nr_tasks;
+    struct task *t;
+    struct space_cell *c;
+
+    /* check input */
+    if ( s == NULL )
+        return error(space_err_null);
+
+    /* Already done? */
+    for ( k = 0 ; k < s->nr_tasks ; k++ )
+        if ( s->tasks[k].type == task_type_integrate )
+            return space_err_ok;
+
+    /* Add a task to each real cell, after its sort. */
+    nr_tasks = s->nr_tasks;
+    for ( k = 0 ; k < s->nr_real ; k++ ) {
+        c = &s->cells[ s->cid_real[k] ];
+        if ( ( c->integrate = space_addtask( s , task_type_integrate , task_subtype_none , 0 , s->cid_real[k] , -1 ) ) == NULL )
+            return error(space_err);
+        if ( task_addunlock( c->sort , c->integrate ) != 0 )
+            return error(space_err_task);
     }
-    /* initialize the cells  */
-    for ( l[0] = 0 ; l[0] < s->cdim[0] ; l[0]++ ) {
-        o[0] = origin[0] + l[0] * s->h[0];
-        for ( l[1] = 0 ; l[1] < s->cdim[1] ; l[1]++ ) {
-            o[1] = origin[1] + l[1] * s->h[1];
-            for ( l[2] = 0 ; l[2] < s->cdim[2] ; l[2]++ ) {
-                o[2] = origin[2] + l[2] * s->h[2];
-                if ( space_cell_init( &(s->cells[space_cellid(s,l[0],l[1],l[2])]) , l , o , s->h ) < 0 )
-                    return error(space_err_cell);
-            }
-        }
+
+    /* Make each integration depend on the tasks computing its forces. */
+    for ( k = 0 ; k < nr_tasks ; k++ ) {
+        t = &s->tasks[k];
+        if ( t->type != task_type_self && t->type != task_type_pair && t->type != task_type_singlebody )
+            continue;
+        if ( s->cells[ t->i ].integrate != NULL &&
+                task_addunlock( t , s->cells[ t->i ].integrate ) != 0 )
+            return error(space_err_task);
+        if ( t->type == task_type_pair && s->cells[ t->j ].integrate != NULL &&
+                task_addunlock( t , s->cells[ t->j ].integrate ) != 0 )
+            return error(space_err_task);
     }
 
-    /* Make ghost layers if needed. */
-    if ( s->period & space_periodic_ghost_x )
-        for ( i = 0 ; i < s->cdim[0] ; i++ )
-            for ( j = 0 ; j < s->cdim[1] ; j++ ) {
-                s->cells[ space_cellid(s,i,j,0) ].flags |= cell_flag_ghost;
-                s->cells[ space_cellid(s,i,j,s->cdim[2]-1) ].flags |= cell_flag_ghost;
-            }
-    if ( s->period & space_periodic_ghost_y )
-        for ( i = 0 ; i < s->cdim[0] ; i++ )
-            for ( j = 0 ; j < s->cdim[2] ; j++ ) {
-                s->cells[ space_cellid(s,i,0,j) ].flags |= cell_flag_ghost;
-                s->cells[ space_cellid(s,i,s->cdim[1]-1,j) ].flags |= cell_flag_ghost;
-            }
-    if ( s->period & space_periodic_ghost_z )
-        for ( i = 0 ; i < s->cdim[1] ; i++ )
-            for ( j = 0 ; j < s->cdim[2] ; j++ ) {
-                s->cells[ space_cellid(s,0,i,j) ].flags |= cell_flag_ghost;
-                s->cells[ space_cellid(s,s->cdim[0]-1,i,j) ].flags |= cell_flag_ghost;
-            }
+    /* All is well... */
+    return space_err_ok;
 
-    /* Allocate buffers for the cid lists. */
-    if ( ( s->cid_real = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL ||
-            ( s->cid_ghost = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL ||
-            ( s->cid_marked = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL )
-        return error(space_err_malloc);
+}
 
-    /* Fill the cid lists with marked, local and ghost cells. */
-    s->nr_real = 0; s->nr_ghost = 0; s->nr_marked = 0;
-    for ( k = 0 ; k < s->nr_cells ; k++ ) {
-        s->cells[k].flags |= cell_flag_marked;
-        s->cid_marked[ s->nr_marked++ ] = k;
-        if ( s->cells[k].flags & cell_flag_ghost ) {
-            s->cells[k].id = -s->nr_cells;
-            s->cid_ghost[ s->nr_ghost++ ] = k;
-        }
-        else {
-            s->cells[k].id = s->nr_real;
-            s->cid_real[ s->nr_real++ ] = k;
-        }
-    }
 
-    /* Get the span of the cells we will search for pairs. */
-    for ( k = 0 ; k < 3 ; k++ )
-        s->span[k] = ceil( cutoff * s->ih[k] );
+/**
+ * @brief Make the self, pair and sort tasks of a #space.
+ *
+ * @param s The #space.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * Any previous tasks are dropped. Each real cell gets a self task and a
+ * pair task with each neighbouring cell within the cutoff, ghost cells
+ * only appearing as the second cell of a pair, and every cell gets a
+ * sort task unlocking its pairs. Called by #space_init and again when
+ * the ghost cells change, e.g. after #engine_balance.
+ */
 
-    /* allocate the tasks array (pessimistic guess) */
-    s->tasks_size = s->nr_cells * ( (2*s->span[0] + 1) * (2*s->span[1] + 1) * (2*s->span[2] + 1) + 1 );
-    if ( ( s->tasks = (struct task *)malloc( sizeof(struct task) * s->tasks_size ) ) == NULL )
-        return error(space_err_malloc);
+int space_maketasks ( struct space *s ) {
+
+    int i, j, k, l[3], ii, jj, kk;
+    int id1, id2, sid;
+    double lh[3];
+    struct space_cell *ci, *cj;
+
+    /* check inputs */
+    if ( s == NULL || s->tasks == NULL )
+        return error(space_err_null);
+
+    /* Drop the old tasks. */
+    for ( k = 0 ; k < s->nr_cells ; k++ )
+        s->cells[k].integrate = NULL;
 
     /* fill the cell pairs array */
     s->nr_tasks = 0;
@@ -771,13 +1132,145 @@ int space_init ( struct space *s , const double *origin , const double *dim ,
             s->cells[ s->tasks[k].j ].sort->flags |= 1 << s->tasks[k].flags;
         }
 
+    /* All done! */
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Initialize the space with the given dimensions.
+ *
+ * @param s The #space to initialize.
+ * @param origin Pointer to an array of three doubles specifying the origin
+ *      of the rectangular domain.
+ * @param dim Pointer to an array of three doubles specifying the length
+ *      of the rectangular domain along each dimension.
+ * @param L The minimum cell edge length, in each dimension.
+ * @param cutoff A double-precision value containing the maximum cutoff lenght
+ *      that will be used in the potentials.
+ * @param period Unsigned integer containing the flags #space_periodic_x,
+ *      #space_periodic_y and/or #space_periodic_z or #space_periodic_full.
+ *
+ * @return #space_err_ok or <0 on error (see #space_err).
+ * 
+ * This routine initializes the fields of the #space @c s, creates the cells and
+ * generates the cell-pair list.
+ */
+
+int space_init ( struct space *s , const double *origin , const double *dim ,
+        double *L , double cutoff , unsigned int period ) {
+
+    int i, j, k, l[3];
+    double o[3];
+
+    /* check inputs */
+    if ( s == NULL || origin == NULL || dim == NULL || L == NULL )
+        return error(space_err_null);
+
+    /* Clear the space. */
+    bzero( s , sizeof(struct space) );
+
+    /* set origin and compute the dimensions */
+    for ( i = 0 ; i < 3 ; i++ ) {
+        s->origin[i] = origin[i];
+        s->dim[i] = dim[i];
+        s->cdim[i] = floor( dim[i] / L[i] );
+    }
+
+    /* remember the cutoff */
+    s->cutoff = cutoff;
+    s->cutoff2 = cutoff*cutoff;
+
+    /* set the periodicity */
+    s->period = period;
+
+    /* allocate the cells */
+    s->nr_cells = s->cdim[0] * s->cdim[1] * s->cdim[2];
+    s->cells = (struct space_cell *)malloc( sizeof(struct space_cell) * s->nr_cells );
+    if ( s->cells == NULL )
+        return error(space_err_malloc);
+
+    /* get the dimensions of each cell */
+    for ( i = 0 ; i < 3 ; i++ ) {
+        s->h[i] = s->dim[i] / s->cdim[i];
+        s->ih[i] = 1.0 / s->h[i];
+    }
+    /* initialize the cells  */
+    for ( l[0] = 0 ; l[0] < s->cdim[0] ; l[0]++ ) {
+        o[0] = origin[0] + l[0] * s->h[0];
+        for ( l[1] = 0 ; l[1] < s->cdim[1] ; l[1]++ ) {
+            o[1] = origin[1] + l[1] * s->h[1];
+            for ( l[2] = 0 ; l[2] < s->cdim[2] ; l[2]++ ) {
+                o[2] = origin[2] + l[2] * s->h[2];
+                if ( space_cell_init( &(s->cells[space_cellid(s,l[0],l[1],l[2])]) , l , o , s->h ) < 0 )
+                    return error(space_err_cell);
+            }
+        }
+    }
+
+    /* Make ghost layers if needed. */
+    if ( s->period & space_periodic_ghost_x )
+        for ( i = 0 ; i < s->cdim[0] ; i++ )
+            for ( j = 0 ; j < s->cdim[1] ; j++ ) {
+                s->cells[ space_cellid(s,i,j,0) ].flags |= cell_flag_ghost;
+                s->cells[ space_cellid(s,i,j,s->cdim[2]-1) ].flags |= cell_flag_ghost;
+            }
+    if ( s->period & space_periodic_ghost_y )
+        for ( i = 0 ; i < s->cdim[0] ; i++ )
+            for ( j = 0 ; j < s->cdim[2] ; j++ ) {
+                s->cells[ space_cellid(s,i,0,j) ].flags |= cell_flag_ghost;
+                s->cells[ space_cellid(s,i,s->cdim[1]-1,j) ].flags |= cell_flag_ghost;
+            }
+    if ( s->period & space_periodic_ghost_z )
+        for ( i = 0 ; i < s->cdim[1] ; i++ )
+            for ( j = 0 ; j < s->cdim[2] ; j++ ) {
+                s->cells[ space_cellid(s,0,i,j) ].flags |= cell_flag_ghost;
+                s->cells[ space_cellid(s,s->cdim[0]-1,i,j) ].flags |= cell_flag_ghost;
+            }
+
+    /* Allocate buffers for the cid lists. */
+    if ( ( s->cid_real = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL ||
+            ( s->cid_ghost = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL ||
+            ( s->cid_marked = (int *)malloc( sizeof(int) * s->nr_cells ) ) == NULL )
+        return error(space_err_malloc);
+
+    /* Fill the cid lists with marked, local and ghost cells. */
+    s->nr_real = 0; s->nr_ghost = 0; s->nr_marked = 0;
+    for ( k = 0 ; k < s->nr_cells ; k++ ) {
+        s->cells[k].flags |= cell_flag_marked;
+        s->cid_marked[ s->nr_marked++ ] = k;
+        if ( s->cells[k].flags & cell_flag_ghost ) {
+            s->cells[k].id = -s->nr_cells;
+            s->cid_ghost[ s->nr_ghost++ ] = k;
+        }
+        else {
+            s->cells[k].id = s->nr_real;
+            s->cid_real[ s->nr_real++ ] = k;
+        }
+    }
+
+    /* Get the span of the cells we will search for pairs. */
+    for ( k = 0 ; k < 3 ; k++ )
+        s->span[k] = ceil( cutoff * s->ih[k] );
+
+    /* allocate the tasks array (pessimistic guess, leaves room for a sort,
+       a single-body and an integration task per cell) */
+    s->tasks_size = s->nr_cells * ( (2*s->span[0] + 1) * (2*s->span[1] + 1) * (2*s->span[2] + 1) + 3 );
+    if ( ( s->tasks = (struct task *)malloc( sizeof(struct task) * s->tasks_size ) ) == NULL )
+        return error(space_err_malloc);
+
+    /* Make the pair, self and sort tasks. */
+    if ( space_maketasks( s ) < 0 )
+        return error(space_err);
+
     /* allocate and init the taboo-list */
     if ( (s->cells_taboo = (char *)malloc( sizeof(char) * s->nr_cells )) == NULL )
         return error(space_err_malloc);
     bzero( s->cells_taboo , sizeof(char) * s->nr_cells );
-    if ( (s->cells_owner = (char *)malloc( sizeof(char) * s->nr_cells )) == NULL )
+    if ( (s->cells_owner = (int *)malloc( sizeof(int) * s->nr_cells )) == NULL )
         return error(space_err_malloc);
-    bzero( s->cells_owner , sizeof(char) * s->nr_cells );
+    bzero( s->cells_owner , sizeof(int) * s->nr_cells );
 
     /* allocate the initial partlist */
     if ( ( s->partlist = (struct MxParticle **)malloc( sizeof(struct MxParticle *) * space_partlist_incr ) ) == NULL )
@@ -792,15 +1285,130 @@ int space_init ( struct space *s , const double *origin , const double *dim ,
             pthread_cond_init( &s->tasks_avail , NULL ) != 0 )
         return error(space_err_pthread);
 
-    /* Init the Verlet table (NULL for now). */
+    /* Init the Verlet table (NULL for now), the skin is whatever the
+       cells leave beyond the cutoff. */
     s->verlet_rebuild = 1;
+    s->parts_moved = 1;
     s->maxdx = 0.0;
+    s->verlet_skin = fmin( s->h[0] , fmin( s->h[1] , s->h[2] ) ) - cutoff;
+    s->verlet_clustersize = space_cluster_maxsize;
+
+    /* Keep the cells in lexicographic order until told otherwise. */
+    s->sfc = space_sfc_none;
 
     /* all is well that ends well... */
     return space_err_ok;
 
 }
 
+
+/**
+ * @brief Re-build the cells and tasks of a #space for a new cell size and
+ *      cutoff, keeping its particles.
+ *
+ * @param s The #space.
+ * @param L The minimum cell edge length, in each dimension.
+ * @param cutoff The new cutoff.
+ *
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * The cells and the tasks are re-made as in #space_init and the particles
+ * are moved to their new cells, keeping their IDs. Tasks added after
+ * #space_init, e.g. by #space_addtasks_singlebody, have to be added again.
+ * The Verlet skin is kept if the new cells leave room for it and the
+ * cells are ordered along the same space-filling curve, if any. Spaces
+ * with ghost cells, e.g. split over several nodes, cannot be re-gridded.
+ */
+
+int space_regrid ( struct space *s , double *L , double cutoff ) {
+
+    struct space old;
+    struct space_cell *c;
+    struct MxParticle *parts;
+    double *x;
+    int cid, pid, k, n = 0, ind[3];
+
+    /* check inputs */
+    if ( s == NULL || L == NULL )
+        return error(space_err_null);
+    if ( s->nr_ghost > 0 )
+        return error(space_err_range);
+
+    /* Collect the particles and their global positions. */
+    if ( ( parts = (struct MxParticle *)malloc( sizeof(struct MxParticle) * ( s->nr_parts + 1 ) ) ) == NULL ||
+         ( x = (double *)malloc( sizeof(double) * 3 * ( s->nr_parts + 1 ) ) ) == NULL )
+        return error(space_err_malloc);
+    for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+        c = &s->cells[ s->cid_real[cid] ];
+        if ( space_cell_soa_unpack( c ) < 0 )
+            return error(space_err_cell);
+        for ( pid = 0 ; pid < c->count ; pid++ ) {
+            parts[n] = c->parts[pid];
+            for ( k = 0 ; k < 3 ; k++ )
+                x[ 3*n + k ] = c->origin[k] + c->parts[pid].x[k];
+            n += 1;
+        }
+    }
+
+    /* Free the old cells and tasks. */
+    old = *s;
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+        if ( space_cell_free( &s->cells[cid] ) < 0 )
+            return error(space_err_cell);
+    free( s->cells );
+    free( s->cid_real ); free( s->cid_ghost ); free( s->cid_marked );
+    free( s->tasks );
+    free( s->cells_taboo ); free( s->cells_owner );
+    free( s->verlet_celloffset ); free( s->verlet_cellpairs );
+    free( s->tuples );
+    pthread_mutex_destroy( &s->tasks_mutex );
+    pthread_cond_destroy( &s->tasks_avail );
+
+    /* Make the new cells and tasks, but keep the particle lists. */
+    if ( space_init( s , old.origin , old.dim , L , cutoff , old.period ) < 0 )
+        return error(space_err);
+    s->ob_base = old.ob_base;
+    free( s->partlist );
+    free( s->celllist );
+    s->partlist = old.partlist;
+    s->celllist = old.celllist;
+    s->nr_parts = old.nr_parts;
+    s->size_parts = old.size_parts;
+    for ( k = 0 ; k < s->nr_parts ; k++ ) {
+        s->partlist[k] = NULL;
+        s->celllist[k] = NULL;
+    }
+    if ( old.soa && space_soa_init( s ) < 0 )
+        return error(space_err);
+
+    /* Put the particles back. */
+    for ( k = 0 ; k < n ; k++ ) {
+        for ( pid = 0 ; pid < 3 ; pid++ ) {
+            ind[pid] = ( x[ 3*k + pid ] - s->origin[pid] ) * s->ih[pid];
+            ind[pid] = ( ind[pid] < 0 ) ? 0 : ( ind[pid] >= s->cdim[pid] ) ? s->cdim[pid] - 1 : ind[pid];
+        }
+        c = &s->cells[ space_cellid( s , ind[0] , ind[1] , ind[2] ) ];
+        for ( pid = 0 ; pid < 3 ; pid++ )
+            parts[k].x[pid] = x[ 3*k + pid ] - c->origin[pid];
+        if ( space_cell_add( c , &parts[k] , s->partlist ) == NULL )
+            return error(space_err_cell);
+        s->celllist[ parts[k].id ] = c;
+    }
+    free( parts );
+    free( x );
+
+    /* Keep what settings still apply. */
+    s->verlet_skin = fmin( s->verlet_skin , old.verlet_skin );
+    s->verlet_clustersize = old.verlet_clustersize;
+    s->verlet_nr_rebuilds = old.verlet_nr_rebuilds;
+    if ( old.sfc != space_sfc_none && space_sfc_order( s , old.sfc ) < 0 )
+        return error(space_err);
+
+    /* All done! */
+    return space_err_ok;
+
+}
+
 /**
  * @brief Get the next free #celltuple from the space.
  *
@@ -934,143 +1542,393 @@ int space_getcell ( struct space *s , struct space_cell **out ) {
 
 
 /**
- * @brief Collect forces and potential energies
+ * @brief Free the cells involved in the current pair.
+ *
+ * @param s The #space to operate on.
+ * @param ci ID of the first cell.
+ * @param cj ID of the second cell.
+ *
+ * @returns #space_err_ok or < 0 on error (see #space_err).
+ *
+ * Decreases the taboo-counter of the cells involved in the pair
+ * and signals any #runner that might be waiting.
+ * Note that only a single waiting #runner is released per released cell
+ * and therefore, if two different cells become free, the condition
+ * @c cellpairs_avail is signaled twice.
+ */
+
+int space_releasepair ( struct space *s , int ci , int cj ) {
+
+    /* release the cells in the given pair */
+    if ( --(s->cells_taboo[ ci ]) == 0 )
+        if (pthread_cond_signal(&s->cellpairs_avail) != 0)
+            return error(space_err_pthread);
+    if ( --(s->cells_taboo[ cj ]) == 0 )
+        if (pthread_cond_signal(&s->cellpairs_avail) != 0)
+            return error(space_err_pthread);
+
+    /* all is well... */
+    return space_err_ok;
+
+}
+
+/**
+ * @brief Initialize the Verlet-list data structures.
  *
  * @param s The #space.
- * @param maxcount The maximum number of entries.
- * @param from Pointer to an integer which will contain the index to the
- *        first entry on success.
- * @param to Pointer to an integer which will contain the index to the
- *        last entry on success.
  *
- * @return The number of entries returned or < 0 on error (see #space_err).
+ * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * Collects, for every cell, the cells with which it shares a pair task,
+ * starting with the cell itself. Each pair is assigned to only one of
+ * its cells, preferably a real one, which then holds the neighbour list
+ * entries of both cells' particles for that pair. Has to be called after
+ * the tasks have been made and forces a rebuild of the neighbour lists.
  */
 
-int space_verlet_force ( struct space *s , FPTYPE *f , double epot ) {
+int space_verlet_init ( struct space *s ) {
 
-    int cid, pid, k, ind;
-    struct space_cell *c;
-    struct MxParticle *p;
-    int nr_cells = s->nr_cells, *scells;
+    int k, cid, ci, cj, *count;
+    struct task *t;
 
-    /* Allocate a buffer to mix-up the cells. */
-    if ( ( scells = (int *)alloca( sizeof(int) * nr_cells ) ) == NULL )
+    /* Check input for nonsense. */
+    if ( s == NULL )
+        return error(space_err_null);
+
+    /* (Re)allocate the cell pairs. */
+    free( s->verlet_celloffset );
+    free( s->verlet_cellpairs );
+    if ( ( s->verlet_celloffset = (int *)malloc( sizeof(int) * (s->nr_cells + 1) ) ) == NULL ||
+         ( count = (int *)alloca( sizeof(int) * s->nr_cells ) ) == NULL )
         return error(space_err_malloc);
 
-    /* Mix-up the order of the cells. */
-    for ( k = 0 ; k < nr_cells ; k++ )
-        scells[k] = k;
-    for ( k = 0 ; k < nr_cells ; k++ ) {
-        cid = rand() % nr_cells;
-        pid = scells[k]; scells[k] = scells[cid]; scells[cid] = pid;
-    }
+    /* Count the pairs of each cell, including the cell itself. */
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+        count[cid] = 1;
+    for ( k = 0 ; k < s->nr_tasks ; k++ ) {
+        t = &s->tasks[k];
+        if ( t->type != task_type_pair )
+            continue;
+        ci = ( s->cells[t->i].flags & cell_flag_ghost ) ? t->j : t->i;
+        count[ci] += 1;
+        }
 
-    /* Loop over the cells. */
-    for ( cid = 0 ; cid < nr_cells ; cid++ ) {
+    /* Turn the counts into offsets. */
+    s->verlet_celloffset[0] = 0;
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+        if ( count[cid] > space_verlet_maxcells )
+            return error(space_err_range);
+        s->verlet_celloffset[cid+1] = s->verlet_celloffset[cid] + count[cid];
+        }
 
-        /* Get a pointer on the cell. */
-        c = &(s->cells[scells[cid]]);
+    /* Fill in the pairs. */
+    if ( ( s->verlet_cellpairs = (int *)malloc( sizeof(int) * s->verlet_celloffset[ s->nr_cells ] ) ) == NULL )
+        return error(space_err_malloc);
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+        s->verlet_cellpairs[ s->verlet_celloffset[cid] ] = cid;
+        count[cid] = 1;
+        }
+    for ( k = 0 ; k < s->nr_tasks ; k++ ) {
+        t = &s->tasks[k];
+        if ( t->type != task_type_pair )
+            continue;
+        if ( s->cells[t->i].flags & cell_flag_ghost ) {
+            ci = t->j; cj = t->i;
+            }
+        else {
+            ci = t->i; cj = t->j;
+            }
+        s->verlet_cellpairs[ s->verlet_celloffset[ci] + count[ci] ] = cj;
+        count[ci] += 1;
+        }
 
-        /* Get a lock on the cell. */
-        if ( pthread_mutex_lock( &c->cell_mutex ) != 0 )
-            return error(space_err_pthread);
+    /* We have to re-build the list now. */
+    s->verlet_rebuild = 1;
 
-        for ( pid = 0 ; pid < c->count ; pid++ ) {
-            p = &(c->parts[pid]);
-            ind = 4 * p->id;
-            for ( k = 0 ; k < 3 ; k++ )
-                p->f[k] += f[ ind + k ];
+    /* All done! */
+    return space_err_ok;
+
+}
+
+
+/**
+ * @brief Compute the position of a point along a space-filling curve.
+ *
+ * @param curve The curve, either #space_sfc_morton or #space_sfc_hilbert.
+ * @param bits The number of bits per dimension, at most #space_sfc_maxbits.
+ * @param x The three integer coordinates of the point, each smaller
+ *      than @c 1 << @c bits.
+ *
+ * @return The index of @c x along the curve.
+ *
+ * The Hilbert index is obtained by transforming the coordinates with
+ * Skilling's algorithm (J. Skilling, AIP Conf. Proc. 707, 381 (2004)),
+ * after which, for either curve, the bits of the coordinates are
+ * interleaved from the most significant one down, @c x[0] first.
+ */
+
+unsigned int space_sfc_key ( int curve , int bits , const unsigned int *x ) {
+
+    unsigned int X[3], M, P, Q, t, key = 0;
+    int b, i;
+
+    for ( i = 0 ; i < 3 ; i++ )
+        X[i] = x[i];
+
+    /* Transform the coordinates to the transposed Hilbert index. */
+    if ( curve == space_sfc_hilbert && bits > 0 ) {
+        M = 1u << ( bits - 1 );
+        for ( Q = M ; Q > 1 ; Q >>= 1 ) {
+            P = Q - 1;
+            for ( i = 0 ; i < 3 ; i++ )
+                if ( X[i] & Q )
+                    X[0] ^= P;
+                else {
+                    t = ( X[0] ^ X[i] ) & P;
+                    X[0] ^= t; X[i] ^= t;
+                    }
+            }
+        for ( i = 1 ; i < 3 ; i++ )
+            X[i] ^= X[i-1];
+        for ( t = 0 , Q = M ; Q > 1 ; Q >>= 1 )
+            if ( X[2] & Q )
+                t ^= Q - 1;
+        for ( i = 0 ; i < 3 ; i++ )
+            X[i] ^= t;
         }
 
-        /* Release the cells mutex */
-        if ( pthread_mutex_unlock( &c->cell_mutex ) != 0 )
-            return error(space_err_pthread);
+    /* Interleave the bits. */
+    for ( b = bits - 1 ; b >= 0 ; b-- )
+        for ( i = 0 ; i < 3 ; i++ )
+            key = ( key << 1 ) | ( ( X[i] >> b ) & 1 );
 
-    }
+    return key;
 
-    /* Add the potential energy to the space's potential energy. */
-    if ( pthread_mutex_lock( &s->verlet_force_mutex ) != 0 )
-        return error(space_err_pthread);
-    s->epot += epot;
-    if ( pthread_mutex_unlock( &s->verlet_force_mutex ) != 0 )
-        return error(space_err_pthread);
+}
 
-    /* Relax. */
-    return space_err_ok;
+
+/**
+ * @brief Compare two 64-bit sort keys, for @c qsort.
+ */
+
+static int space_sfc_cmp ( const void *a , const void *b ) {
+
+    unsigned long long ka = *(const unsigned long long *)a, kb = *(const unsigned long long *)b;
+
+    return ( ka > kb ) - ( ka < kb );
 
 }
 
 
 /**
- * @brief Free the cells involved in the current pair.
+ * @brief Sort a list of cell ids by their cell's curve key.
+ */
+
+static void space_sfc_sortcids ( int *cids , int n , const unsigned int *keys , unsigned long long *buff ) {
+
+    int k;
+
+    for ( k = 0 ; k < n ; k++ )
+        buff[k] = ( (unsigned long long)keys[ cids[k] ] << 32 ) | (unsigned int)cids[k];
+    qsort( buff , n , sizeof(unsigned long long) , space_sfc_cmp );
+    for ( k = 0 ; k < n ; k++ )
+        cids[k] = (int)( buff[k] & 0xffffffffu );
+
+}
+
+
+/**
+ * @brief Order the cell lists and the tasks of a #space along a
+ *      space-filling curve.
  *
- * @param s The #space to operate on.
- * @param ci ID of the first cell.
- * @param cj ID of the second cell.
+ * @param s The #space.
+ * @param curve The curve, either #space_sfc_morton or #space_sfc_hilbert,
+ *      or #space_sfc_none to leave the current order as is.
  *
- * @returns #space_err_ok or < 0 on error (see #space_err).
+ * @return #space_err_ok or < 0 on error (see #space_err).
  *
- * Decreases the taboo-counter of the cells involved in the pair
- * and signals any #runner that might be waiting.
- * Note that only a single waiting #runner is released per released cell
- * and therefore, if two different cells become free, the condition
- * @c cellpairs_avail is signaled twice.
+ * The cells themselves stay where they are, since they are addressed
+ * by #space_cellid, but the real, ghost and marked cell lists are sorted
+ * by the curve key of each cell's location and the tasks by the key of
+ * their first cell, keeping the relative order of the tasks of a cell.
+ * Runners that process consecutive cells or tasks thus work on nearby
+ * cells. The dependencies and the tasks' cells are re-linked to the new
+ * task array. The curve is also used by #space_sfc_sortparts.
  */
 
-int space_releasepair ( struct space *s , int ci , int cj ) {
+int space_sfc_order ( struct space *s , int curve ) {
 
-    /* release the cells in the given pair */
-    if ( --(s->cells_taboo[ ci ]) == 0 )
-        if (pthread_cond_signal(&s->cellpairs_avail) != 0)
-            return error(space_err_pthread);
-    if ( --(s->cells_taboo[ cj ]) == 0 )
-        if (pthread_cond_signal(&s->cellpairs_avail) != 0)
-            return error(space_err_pthread);
+    int k, j, cid, bits, *inv;
+    unsigned int *keys, x[3];
+    unsigned long long *buff;
+    struct task *tasks, *t;
 
-    /* all is well... */
+    /* Check input for nonsense. */
+    if ( s == NULL )
+        return error(space_err_null);
+    if ( curve < space_sfc_none || curve > space_sfc_hilbert )
+        return error(space_err_range);
+
+    /* Nothing to do? */
+    s->sfc = curve;
+    if ( curve == space_sfc_none )
+        return space_err_ok;
+
+    /* Get enough bits for the largest dimension. */
+    for ( bits = 0 ; bits < space_sfc_maxbits ; bits++ )
+        if ( ( 1 << bits ) >= s->cdim[0] && ( 1 << bits ) >= s->cdim[1] && ( 1 << bits ) >= s->cdim[2] )
+            break;
+
+    /* Get the key of each cell. */
+    if ( ( keys = (unsigned int *)malloc( sizeof(unsigned int) * s->nr_cells ) ) == NULL ||
+         ( buff = (unsigned long long *)malloc( sizeof(unsigned long long) * ( s->nr_cells > s->nr_tasks ? s->nr_cells : s->nr_tasks ) ) ) == NULL ||
+         ( inv = (int *)malloc( sizeof(int) * ( s->nr_tasks + 1 ) ) ) == NULL )
+        return error(space_err_malloc);
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+        for ( k = 0 ; k < 3 ; k++ )
+            x[k] = s->cells[cid].loc[k] & ( ( 1u << bits ) - 1 );
+        keys[cid] = space_sfc_key( curve , bits , x );
+        }
+
+    /* Sort the cell lists and re-number the real cells. */
+    space_sfc_sortcids( s->cid_real , s->nr_real , keys , buff );
+    space_sfc_sortcids( s->cid_ghost , s->nr_ghost , keys , buff );
+    space_sfc_sortcids( s->cid_marked , s->nr_marked , keys , buff );
+    for ( k = 0 ; k < s->nr_real ; k++ )
+        s->cells[ s->cid_real[k] ].id = k;
+
+    /* Sort the tasks by the key of their first cell. */
+    for ( k = 0 ; k < s->nr_tasks ; k++ )
+        buff[k] = ( (unsigned long long)( s->tasks[k].i >= 0 ? keys[ s->tasks[k].i ] : 0 ) << 32 ) | (unsigned int)k;
+    qsort( buff , s->nr_tasks , sizeof(unsigned long long) , space_sfc_cmp );
+
+    /* Copy them to a new array, remembering where each one went. */
+    if ( ( tasks = (struct task *)malloc( sizeof(struct task) * s->tasks_size ) ) == NULL )
+        return error(space_err_malloc);
+    for ( k = 0 ; k < s->nr_tasks ; k++ ) {
+        j = (int)( buff[k] & 0xffffffffu );
+        tasks[k] = s->tasks[j];
+        inv[j] = k;
+        }
+
+    /* Re-link the dependencies and the cells' tasks. */
+    for ( k = 0 ; k < s->nr_tasks ; k++ ) {
+        t = &tasks[k];
+        for ( j = 0 ; j < t->nr_unlock ; j++ )
+            t->unlock[j] = &tasks[ inv[ t->unlock[j] - s->tasks ] ];
+        }
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+        if ( s->cells[cid].sort != NULL )
+            s->cells[cid].sort = &tasks[ inv[ s->cells[cid].sort - s->tasks ] ];
+        if ( s->cells[cid].integrate != NULL )
+            s->cells[cid].integrate = &tasks[ inv[ s->cells[cid].integrate - s->tasks ] ];
+        }
+
+    /* Swap the task arrays and clean up. */
+    free( s->tasks );
+    s->tasks = tasks;
+    free( keys );
+    free( buff );
+    free( inv );
+
+    /* All done! */
     return space_err_ok;
 
 }
 
+
 /**
- * @brief Initialize the Verlet-list data structures.
+ * @brief Sort the particles of each real cell along the curve of the
+ *      #space, see #space_sfc_order.
  *
  * @param s The #space.
  *
  * @return #space_err_ok or < 0 on error (see #space_err).
+ *
+ * The key of each particle is its position on a grid of
+ * @c 1 << #space_sfc_partbits points per dimension spanning its cell.
+ * The particles are sorted by insertion, which is cheap as long as they
+ * have not moved much since the last sort, and #space::partlist is
+ * updated accordingly. Any data indexed by the particles' position in
+ * their cell, e.g. the sorted lists or the neighbour lists, has to be
+ * re-built afterwards.
  */
 
-int space_verlet_init ( struct space *s , int list_global ) {
+int space_sfc_sortparts ( struct space *s ) {
+
+    int cid, pid, j, d, k, count, size = 0, res = space_err_ok;
+    unsigned int *keys = NULL, key, x[3];
+    FPTYPE scale[3];
+    struct space_cell *c;
+    struct MxParticle p;
 
     /* Check input for nonsense. */
     if ( s == NULL )
         return error(space_err_null);
+    if ( s->sfc == space_sfc_none )
+        return space_err_ok;
 
-    /* Allocate the parts and nrpairs lists if necessary. */
-    if ( list_global && s->verlet_size < s->nr_parts ) {
+    for ( k = 0 ; k < 3 ; k++ )
+        scale[k] = ( 1 << space_sfc_partbits ) * s->ih[k];
+
+#pragma omp parallel private(cid,c,pid,j,d,k,count,key,x,p) firstprivate(keys,size)
+    {
+#pragma omp for schedule(static)
+        for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+            c = &( s->cells[ s->cid_real[cid] ] );
+            if ( ( count = c->count ) < 2 )
+                continue;
 
-        printf("space_verlet_init: (re)allocating verlet lists...\n");
+            /* Get a large enough key buffer. */
+            if ( size < count ) {
+                free( keys );
+                size = count + count/4;
+                if ( ( keys = (unsigned int *)malloc( sizeof(unsigned int) * size ) ) == NULL ) {
+                    size = 0;
+#pragma omp atomic write
+                    res = space_err_malloc;
+                    continue;
+                    }
+                }
 
-        /* Free old lists if necessary. */
-        if ( s->verlet_list != NULL )
-            free( s->verlet_list );
-        if ( s->verlet_nrpairs != NULL )
-            free( s->verlet_nrpairs );
+            /* Sort the records along with their positions, velocities
+               and forces. */
+            space_cell_soa_unpack( c );
 
-        /* Allocate new arrays. */
-        s->verlet_size = 1.1 * s->nr_parts;
-        if ( ( s->verlet_list = (struct verlet_entry *)malloc( sizeof(struct verlet_entry) * s->verlet_size * space_verlet_maxpairs ) ) == NULL )
-            return error(space_err_malloc);
-        if ( ( s->verlet_nrpairs = (int *)malloc( sizeof(int) * s->verlet_size ) ) == NULL )
-            return error(space_err_malloc);
+            /* Get the particle keys. */
+            for ( pid = 0 ; pid < count ; pid++ ) {
+                for ( d = 0 ; d < 3 ; d++ ) {
+                    k = c->parts[pid].x[d] * scale[d];
+                    x[d] = ( k < 0 ) ? 0 : ( k >= ( 1 << space_sfc_partbits ) ) ? ( 1 << space_sfc_partbits ) - 1 : k;
+                    }
+                keys[pid] = space_sfc_key( s->sfc , space_sfc_partbits , x );
+                }
+
+            /* Insertion-sort the particles by their keys. */
+            for ( pid = 1 ; pid < count ; pid++ ) {
+                if ( keys[pid-1] <= keys[pid] )
+                    continue;
+                key = keys[pid]; p = c->parts[pid];
+                for ( j = pid ; j > 0 && keys[j-1] > key ; j-- ) {
+                    keys[j] = keys[j-1];
+                    c->parts[j] = c->parts[j-1];
+                    }
+                keys[j] = key; c->parts[j] = p;
+                }
 
-        /* We have to re-build the list now. */
-        s->verlet_rebuild = 1;
+            /* Point the partlist to the new locations. */
+            for ( pid = 0 ; pid < count ; pid++ )
+                s->partlist[ c->parts[pid].id ] = &( c->parts[pid] );
+            if ( c->flags & cell_flag_soa )
+                space_cell_soa_pack( c );
 
+            }
+        free( keys );
     }
 
-    /* re-set the Verlet list index. */
-    s->verlet_next = 0;
+    /* Did anything go wrong? */
+    if ( res != space_err_ok )
+        return error(res);
 
     /* All done! */
     return space_err_ok;
@@ -141,6 +141,243 @@ int space_cell_flush ( struct space_cell *c , struct MxParticle **partlist , str
 }
 
 
+/**
+ * @brief Re-allocate the structure-of-arrays buffers of a #cell for at
+ *      least @c size parts, keeping the first @c c->count entries.
+ *
+ * @param c The #cell.
+ * @param size The minimum number of entries.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ */
+
+static int space_cell_soa_realloc ( struct space_cell *c , int size ) {
+
+	int k, size_new;
+	FPTYPE *temp, *temp_old = c->soa_x[0];
+	int *temp_type;
+
+	/* Each of the nine component arrays starts on a cell_partalign
+	   boundary. */
+	size_new = align_ceil( size * sizeof(FPTYPE) ) / sizeof(FPTYPE);
+	if ( posix_memalign( (void **)&temp , cell_partalign , sizeof(FPTYPE) * 9 * size_new ) != 0 ||
+		 posix_memalign( (void **)&temp_type , cell_partalign , align_ceil( sizeof(int) * size_new ) ) != 0 )
+		return error(cell_err_malloc);
+
+	/* Copy the entries we have and swap the buffers. */
+	for ( k = 0 ; k < 3 ; k++ ) {
+		if ( temp_old != NULL ) {
+			memcpy( &temp[ k * size_new ] , c->soa_x[k] , sizeof(FPTYPE) * c->count );
+			memcpy( &temp[ ( 3 + k ) * size_new ] , c->soa_v[k] , sizeof(FPTYPE) * c->count );
+			memcpy( &temp[ ( 6 + k ) * size_new ] , c->soa_f[k] , sizeof(FPTYPE) * c->count );
+		}
+		c->soa_x[k] = &temp[ k * size_new ];
+		c->soa_v[k] = &temp[ ( 3 + k ) * size_new ];
+		c->soa_f[k] = &temp[ ( 6 + k ) * size_new ];
+	}
+	if ( temp_old != NULL )
+		memcpy( temp_type , c->soa_typeId , sizeof(int) * c->count );
+	free( temp_old );
+	free( c->soa_typeId );
+	c->soa_typeId = temp_type;
+	c->soa_size = size_new;
+
+	/* all is well... */
+	return cell_err_ok;
+
+}
+
+
+/**
+ * @brief Copy the positions, velocities, forces and types of the parts
+ *      of a #cell to its structure-of-arrays buffers.
+ *
+ * @param c The #cell.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ *
+ * The SoA buffers are grown to hold at least @c c->size parts.
+ */
+
+int space_cell_soa_pack ( struct space_cell *c ) {
+
+	int pid;
+
+	/* check inputs */
+	if ( c == NULL )
+		return error(cell_err_null);
+
+	/* Is there sufficient room for these particles? */
+	if ( c->soa_size < c->size && space_cell_soa_realloc( c , c->size ) < 0 )
+		return error(cell_err);
+
+	/* Scatter the particle data. */
+	for ( pid = 0 ; pid < c->count ; pid++ )
+		space_cell_soa_put( c , pid );
+
+	/* all is well... */
+	return cell_err_ok;
+
+}
+
+
+/**
+ * @brief Copy the positions, velocities and forces in the
+ *      structure-of-arrays buffers of a #cell back to its parts.
+ *
+ * @param c The #cell.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ */
+
+int space_cell_soa_unpack ( struct space_cell *c ) {
+
+	int pid;
+
+	/* check inputs */
+	if ( c == NULL )
+		return error(cell_err_null);
+
+	/* Are the records the storage anyway? */
+	if ( !( c->flags & cell_flag_soa ) )
+		return cell_err_ok;
+
+	/* Gather the particle data. */
+	for ( pid = 0 ; pid < c->count ; pid++ )
+		space_cell_soa_get( c , pid );
+
+	/* all is well... */
+	return cell_err_ok;
+
+}
+
+
+/**
+ * @brief Copy the position, velocity and force of a single part of a
+ *      #cell with #cell_flag_soa from the SoA buffers to its record.
+ *
+ * @param c The #cell.
+ * @param pid The index of the part in @c c->parts.
+ */
+
+void space_cell_soa_get ( struct space_cell *c , int pid ) {
+
+	struct MxParticle *p = &c->parts[pid];
+	int k;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		p->x[k] = c->soa_x[k][pid];
+		p->v[k] = c->soa_v[k][pid];
+		p->f[k] = c->soa_f[k][pid];
+	}
+
+}
+
+
+/**
+ * @brief Copy the position, velocity, force and type of a single part
+ *      of a #cell with #cell_flag_soa from its record to the SoA buffers.
+ *
+ * @param c The #cell.
+ * @param pid The index of the part in @c c->parts.
+ */
+
+void space_cell_soa_put ( struct space_cell *c , int pid ) {
+
+	struct MxParticle *p = &c->parts[pid];
+	int k;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		c->soa_x[k][pid] = p->x[k];
+		c->soa_v[k][pid] = p->v[k];
+		c->soa_f[k][pid] = p->f[k];
+	}
+	c->soa_typeId[pid] = p->typeId;
+
+}
+
+
+/**
+ * @brief Copy an entry of the SoA buffers of a #cell to another, e.g.
+ *      when the last part fills the place of one that left.
+ *
+ * @param c The #cell.
+ * @param dst The index of the entry to overwrite.
+ * @param src The index of the entry to copy.
+ */
+
+void space_cell_soa_move ( struct space_cell *c , int dst , int src ) {
+
+	int k;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		c->soa_x[k][dst] = c->soa_x[k][src];
+		c->soa_v[k][dst] = c->soa_v[k][src];
+		c->soa_f[k][dst] = c->soa_f[k][src];
+	}
+	c->soa_typeId[dst] = c->soa_typeId[src];
+
+}
+
+
+/**
+ * @brief Re-allocate the particle, incomming and sortlist buffers of a
+ *      #cell from the calling thread.
+ *
+ * @param c The #cell.
+ * @param partlist A pointer to the partlist to set the part indices.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ *
+ * The contents of the buffers are copied by the calling thread, i.e. on
+ * systems with a first-touch policy the new pages end up on the memory
+ * node of the CPU it runs on.
+ */
+
+int space_cell_rehome ( struct space_cell *c , struct MxParticle **partlist ) {
+
+	struct MxParticle *temp, *temp_in;
+	unsigned int *temp_sort = NULL;
+	int k;
+
+	/* check inputs */
+	if ( c == NULL )
+		return error(cell_err_null);
+
+	/* Get the new buffers. */
+	if ( posix_memalign( (void **)&temp , cell_partalign , align_ceil( sizeof(struct MxParticle) * c->size ) ) != 0 ||
+		 posix_memalign( (void **)&temp_in , cell_partalign , align_ceil( sizeof(struct MxParticle) * c->incomming_size ) ) != 0 ||
+		 ( c->sortlist != NULL && ( temp_sort = (unsigned int *)malloc( sizeof(unsigned int) * 13 * c->size ) ) == NULL ) )
+		return error(cell_err_malloc);
+
+	/* Copy the data and swap the buffers. */
+	memcpy( temp , c->parts , sizeof(struct MxParticle) * c->count );
+	memcpy( temp_in , c->incomming , sizeof(struct MxParticle) * c->incomming_count );
+	free( c->parts );
+	free( c->incomming );
+	c->parts = temp;
+	c->incomming = temp_in;
+	if ( c->sortlist != NULL ) {
+		memcpy( temp_sort , c->sortlist , sizeof(unsigned int) * 13 * c->count );
+		free( c->sortlist );
+		c->sortlist = temp_sort;
+	}
+
+	/* Same for the SoA buffers, if any. */
+	if ( c->soa_size > 0 && space_cell_soa_realloc( c , c->soa_size ) < 0 )
+		return error(cell_err);
+
+	/* Point the partlist to the new locations. */
+	if ( partlist != NULL )
+		for ( k = 0 ; k < c->count ; k++ )
+			partlist[ c->parts[k].id ] = &( c->parts[k] );
+
+	/* all is well... */
+	return cell_err_ok;
+
+}
+
+
 /**
  * @brief Load a block of particles to the cell.
  *
@@ -181,10 +418,15 @@ int space_cell_load ( struct space_cell *c , struct MxParticle *parts , int nr_p
 			if ( ( c->sortlist = (unsigned int *)malloc( sizeof(unsigned int) * 13 * c->size ) ) == NULL )
 				return error(cell_err_malloc);
 		}
+		if ( ( c->flags & cell_flag_soa ) && space_cell_soa_realloc( c , c->size ) < 0 )
+			return error(cell_err);
 	}
 
 	/* Copy the new particles in. */
 	memcpy( &( c->parts[c->count] ) , parts , sizeof(struct MxParticle) * nr_parts );
+	if ( c->flags & cell_flag_soa )
+		for ( k = c->count ; k < c->count + nr_parts ; k++ )
+			space_cell_soa_put( c , k );
 
 	/* Link them in the partlist. */
 	if ( partlist != NULL )
@@ -374,10 +616,16 @@ struct MxParticle *space_cell_add ( struct space_cell *c , struct MxParticle *p
 				return NULL;
 			}
 		}
+		if ( ( c->flags & cell_flag_soa ) && space_cell_soa_realloc( c , c->size ) < 0 ) {
+			error(cell_err);
+			return NULL;
+		}
 	}
 
 	/* store this particle */
 	c->parts[c->count] = *p;
+	if ( c->flags & cell_flag_soa )
+		space_cell_soa_put( c , c->count );
 	if ( partlist != NULL )
 		partlist[ p->id ] = &c->parts[ c->count ];
 
@@ -393,6 +641,48 @@ struct MxParticle *space_cell_add ( struct space_cell *c , struct MxParticle *p
 }
 
 
+/**
+ * @brief Free all the buffers of a cell.
+ *
+ * @param c The #cell to free.
+ *
+ * @return #cell_err_ok or < 0 on error (see #cell_err).
+ *
+ * The particles of the cell are lost, the cell has to be re-initialized
+ * with #space_cell_init before it can be used again.
+ */
+
+int space_cell_free ( struct space_cell *c ) {
+
+	/* check inputs */
+	if ( c == NULL )
+		return error(cell_err_null);
+
+	/* Free the particle data. */
+	free( c->parts ); c->parts = NULL;
+	free( c->incomming ); c->incomming = NULL;
+	free( c->sortlist ); c->sortlist = NULL;
+	free( c->oldx ); c->oldx = NULL;
+	free( c->soa_x[0] ); free( c->soa_typeId );
+	c->size = c->count = c->incomming_size = c->incomming_count = 0;
+	c->oldx_size = c->soa_size = 0;
+
+	/* Free the neighbour lists and clusters. */
+	free( c->nlist ); free( c->nlist_offset );
+	free( c->clu_x ); free( c->clu_bb ); free( c->clu_pid ); free( c->clu_typeId ); free( c->clu_excl );
+	free( c->clu_list ); free( c->clu_offset );
+
+	/* Release the mutex and condition. */
+	if ( pthread_mutex_destroy( &c->cell_mutex ) != 0 ||
+		 pthread_cond_destroy( &c->cell_cond ) != 0 )
+		return error(cell_err_pthread);
+
+	/* all is well... */
+	return cell_err_ok;
+
+}
+
+
 /**
  * @brief Initialize the given cell.
  *
@@ -445,6 +735,40 @@ int space_cell_init ( struct space_cell *c , int *loc , double *origin , double
 	c->incomming_size = cell_incr;
 	c->incomming_count = 0;
 
+	/* The SoA buffers are only allocated on demand. */
+	for ( i = 0 ; i < 3 ; i++ ) {
+		c->soa_x[i] = NULL;
+		c->soa_v[i] = NULL;
+		c->soa_f[i] = NULL;
+	}
+	c->soa_typeId = NULL;
+	c->soa_size = 0;
+
+	/* Neither are the neighbour lists. */
+	c->nlist = NULL;
+	c->nlist_offset = NULL;
+	c->nlist_size = 0;
+	c->nlist_offset_size = 0;
+	c->nlist_count = 0;
+
+	/* Nor the clusters. */
+	c->clu_x = NULL;
+	c->clu_bb = NULL;
+	c->clu_pid = NULL;
+	c->clu_typeId = NULL;
+	c->clu_excl = NULL;
+	c->nr_clusters = 0;
+	c->clu_size = 0;
+	c->clu_nparts = 0;
+	c->clu_alloc = 0;
+	c->clu_list = NULL;
+	c->clu_offset = NULL;
+	c->clu_list_size = 0;
+	c->clu_offset_size = 0;
+
+	/* No integration task unless the engine asks for one. */
+	c->integrate = NULL;
+
 	/* all is well... */
 	return cell_err_ok;
 
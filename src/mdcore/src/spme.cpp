@@ -1,20 +1,20 @@
 /*******************************************************************************
  * This file is part of mdcore.
  * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
- * 
+ *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Lesser General Public License as published
  * by the Free Software Foundation, either version 3 of the License, or
  * (at your option) any later version.
- * 
+ *
  * This program is distributed in the hope that it will be useful,
  * but WITHOUT ANY WARRANTY; without even the implied warranty of
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
- * 
+ *
  * You should have received a copy of the GNU Lesser General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
- * 
+ *
  ******************************************************************************/
 
 
@@ -23,7 +23,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
-#include <alloca.h>
 #include <pthread.h>
 #include <math.h>
 
@@ -36,18 +35,15 @@
     #include <mpi.h>
 #endif
 
-/* I will need fftw for this. */
-#include <complex.h>
-#ifdef HAVE_FFTW3
-#include <fftw3.h>
-#endif
-
 /* include local headers */
 #include "errs.h"
 #include "fptype.h"
 #include "lock.h"
 #include <MxParticle.h>
 #include <space_cell.h>
+#include "task.h"
+#include "space.h"
+#include <MxPotential.h>
 #include "spme.h"
 
 #pragma clang diagnostic ignored "-Wwritable-strings"
@@ -65,311 +61,895 @@ const char *spme_err_msg[5] = {
 	"Nothing bad happened.",
     "An unexpected NULL pointer was encountered.",
     "A call to malloc failed, probably due to insufficient memory.",
-    "SMPE not available, mdcore was not compiled with fftw3.",
-    "An error occured when calling an fftw3 funciton."
+    "One or more values were outside of the allowed range.",
+    "An error occured when calling a task function."
 	};
 
-/* B-spline coeffs. */
-float spme_coeffs[12] = { 2.0f/3.0f , 0.0f , -1.0f , 0.5f ,
-                          4.0f/3.0f , -2.0f , 1.0f , -1.0f/6.0f ,
-                          0.0f , 0.0f , 0.0f , 0.0f };
-                          
-                        
+
 /**
- * @brief Do the convolution stuff.
- * 
- * @param s The #spme.
+ * @brief Set up a one-dimensional FFT.
+ *
+ * @param f The #spme_fft.
+ * @param n The length of the transform.
+ *
+ * @return #spme_err_ok or < 0 on error (see #spme_err).
+ *
+ * The length is split into factors of four first, since those have the
+ * cheapest butterflies, and then into its remaining prime factors.
  */
- 
-int spme_doconv ( struct spme *s ) {
-
-#ifdef HAVE_FFTW3
-    int k, N = s->dim[0]*s->dim[1]*s->dim[2];
-    float scale = 1.0f / N;
-    fftwf_complex *T = s->T;
-
-    /* Execute the forward plan. */
-    fftwf_execute( s->fwplan );
-    
-    /* Multiply \hat{Q} with theta. */
-    for ( k = 0 ; k < N ; k++ )
-        T[k] *= s->theta[k];
-        
-    /* Reset Q. */
-    bzero( s->Q , sizeof(float) * N );
-    
-    /* Execute the backward plan. */
-    fftwf_execute( s->bwplan );
-    
-    /* Scale the result back. */
-    for ( k = 0 ; k < N ; k++ )
-        s->E[k] *= scale;
+
+static int spme_fft_init ( struct spme_fft *f , int n ) {
+
+    int k, r, m = n;
+
+    /* Get the factors. */
+    f->n = n;
+    f->nr_factors = 0;
+    while ( m % 4 == 0 && f->nr_factors < spme_fft_maxfactors ) {
+        f->factors[ f->nr_factors++ ] = 4;
+        m /= 4;
+        }
+    for ( r = 2 ; m > 1 && r < spme_fft_maxfactors && f->nr_factors < spme_fft_maxfactors ; r++ )
+        while ( m % r == 0 && f->nr_factors < spme_fft_maxfactors ) {
+            f->factors[ f->nr_factors++ ] = r;
+            m /= r;
+            }
+
+    /* Large prime factors are not worth it. */
+    if ( m > 1 )
+        return error(spme_err_range);
+
+    /* Tabulate the roots of unity. */
+    if ( ( f->w = (float *)malloc( sizeof(float) * 2 * n ) ) == NULL )
+        return error(spme_err_malloc);
+    for ( k = 0 ; k < n ; k++ ) {
+        f->w[2*k] = cos( 2*M_PI*k/n );
+        f->w[2*k+1] = -sin( 2*M_PI*k/n );
+        }
 
     return spme_err_ok;
-    
-#else
-    return error(smpe_err_nofftw3);
-#endif
 
     }
 
 
 /**
- * @brief Compute the interactions between the particles and grid
+ * @brief Transform a batch of sequences.
  *
- * @param spme The #spme object.
- * @param cp The #cell containing the parts
- * @param cg The #cell containing the grid
- * @param shift The shift vector from @c cp to @c cg.
+ * @param f The #spme_fft.
+ * @param x The data, interleaved complex, where element @c k of sequence
+ *      @c b is at @c x[2*(b + B*k)].
+ * @param y Scratch space of the same size as @c x.
+ * @param B The number of sequences.
+ * @param sign -1 for the forward, +1 for the (unscaled) backward transform.
  *
+ * A self-sorting (Stockham) transform, so no bit reversal is needed. The
+ * innermost loops run over the sequences of the batch and the butterflies
+ * of the previous passes, i.e. over contiguous data, and vectorize.
  */
- 
-void spme_iact ( struct spme * s , struct space_cell * cp , struct space_cell * cg ) {
-
-#ifdef HAVE_FFTW3
-    int j, k, pid, ind[3], dim[3];
-    struct part *restrict p, *restrict parts = cp->parts;
-    FPTYPE shift[3], px[3], ih[3];
-    float q;
-    fftwf_complex *Q, *E;
-    float x[ 3*spme_gpc ], b[ 3*spme_gpc ], dbdx[ 3*spme_gpc ];
-    int minx[3], maxx[3], off[3], count;
-    
-    /* Compute the pshift. */
-    for ( k = 0 ; k < 3 ; k++ ) {
-        shift[k] = cp->origin[k] - cg->origin[k];
-        if ( shift[k] * 2 > s->dim[k] )
-            shift[k] -= s->dim[k];
-        else if ( shift[k] * 2 < -s->dim[k] )
-            shift[k] += s->dim[k];
+
+static void spme_fft_exec ( const struct spme_fft *f , float *x , float *y , int B , int sign ) {
+
+    int n = f->n, S = 1, s, m, r, l, p, j, k, t, ind;
+    float *in = x, *out = y, *temp;
+    const float *a0, *a1, *a2, *a3;
+    float *b0, *b1, *b2, *b3;
+    float wr[ spme_fft_maxfactors ], wi[ spme_fft_maxfactors ];
+    float ar, ai, br, bi, cr, ci, dr, di, er, ei;
+
+    for ( l = 0 ; l < f->nr_factors ; l++ ) {
+
+        r = f->factors[l];
+        m = n / ( S * r );
+        s = S * B;
+
+        for ( p = 0 ; p < m ; p++ ) {
+
+            /* The twiddle factors of this butterfly. */
+            for ( k = 0 ; k < r ; k++ ) {
+                ind = p * k * S;
+                wr[k] = f->w[2*ind];
+                wi[k] = -sign * f->w[2*ind+1];
+                }
+
+            if ( r == 2 ) {
+                a0 = &in[ 2*s*p ]; a1 = &in[ 2*s*(p+m) ];
+                b0 = &out[ 2*s*(2*p) ]; b1 = &out[ 2*s*(2*p+1) ];
+                for ( t = 0 ; t < s ; t++ ) {
+                    ar = a0[2*t]; ai = a0[2*t+1];
+                    br = a1[2*t]; bi = a1[2*t+1];
+                    b0[2*t] = ar + br; b0[2*t+1] = ai + bi;
+                    cr = ar - br; ci = ai - bi;
+                    b1[2*t] = cr*wr[1] - ci*wi[1];
+                    b1[2*t+1] = cr*wi[1] + ci*wr[1];
+                    }
+                }
+            else if ( r == 4 ) {
+                a0 = &in[ 2*s*p ]; a1 = &in[ 2*s*(p+m) ];
+                a2 = &in[ 2*s*(p+2*m) ]; a3 = &in[ 2*s*(p+3*m) ];
+                b0 = &out[ 2*s*(4*p) ]; b1 = &out[ 2*s*(4*p+1) ];
+                b2 = &out[ 2*s*(4*p+2) ]; b3 = &out[ 2*s*(4*p+3) ];
+                for ( t = 0 ; t < s ; t++ ) {
+                    ar = a0[2*t] + a2[2*t]; ai = a0[2*t+1] + a2[2*t+1];
+                    br = a0[2*t] - a2[2*t]; bi = a0[2*t+1] - a2[2*t+1];
+                    cr = a1[2*t] + a3[2*t]; ci = a1[2*t+1] + a3[2*t+1];
+                    /* Multiply a1 - a3 by the fourth root of unity. */
+                    dr = -sign * ( a1[2*t+1] - a3[2*t+1] );
+                    di = sign * ( a1[2*t] - a3[2*t] );
+                    b0[2*t] = ar + cr; b0[2*t+1] = ai + ci;
+                    er = br + dr; ei = bi + di;
+                    b1[2*t] = er*wr[1] - ei*wi[1]; b1[2*t+1] = er*wi[1] + ei*wr[1];
+                    er = ar - cr; ei = ai - ci;
+                    b2[2*t] = er*wr[2] - ei*wi[2]; b2[2*t+1] = er*wi[2] + ei*wr[2];
+                    er = br - dr; ei = bi - di;
+                    b3[2*t] = er*wr[3] - ei*wi[3]; b3[2*t+1] = er*wi[3] + ei*wr[3];
+                    }
+                }
+            else {
+                /* Any other radix, as a plain DFT of length r. */
+                for ( k = 0 ; k < r ; k++ ) {
+                    b0 = &out[ 2*s*(r*p+k) ];
+                    for ( t = 0 ; t < s ; t++ ) {
+                        er = 0.0f; ei = 0.0f;
+                        for ( j = 0 ; j < r ; j++ ) {
+                            a0 = &in[ 2*s*(p+j*m) ];
+                            ind = ( ( j * k ) % r ) * ( n / r );
+                            cr = f->w[2*ind]; ci = -sign * f->w[2*ind+1];
+                            er += a0[2*t]*cr - a0[2*t+1]*ci;
+                            ei += a0[2*t]*ci + a0[2*t+1]*cr;
+                            }
+                        b0[2*t] = er*wr[k] - ei*wi[k];
+                        b0[2*t+1] = er*wi[k] + ei*wr[k];
+                        }
+                    }
+                }
+
+            }
+
+        /* The output is the input of the next pass. */
+        temp = in; in = out; out = temp;
+        S *= r;
+
         }
 
-    /* Get the origin of the grid in cg. */
-    for ( k = 0 ; k < 3 ; k++ ) {
-        dim[k] = s->dim[k];
-        ih[k] = s->ih[k];
-        ind[k] = cg->loc[k] * spme_gpc;
+    /* Did we end up in the scratch space? */
+    if ( in != x )
+        memcpy( x , in , sizeof(float) * 2 * n * B );
+
+    }
+
+
+/**
+ * @brief Transform a range of planes of the grid along its second and
+ *      third dimension.
+ *
+ * @param s The #spme.
+ * @param p0 The first plane.
+ * @param p1 One past the last plane.
+ * @param sign -1 for the forward, +1 for the backward transform.
+ * @param work Scratch space, see #spme_work.
+ *
+ * The lines along the third dimension are transposed into the scratch
+ * space in blocks of #spme_fft_block, so that they can be transformed
+ * together, the lines along the second dimension are transformed in place.
+ */
+
+void spme_fft2d ( struct spme *s , int p0 , int p1 , int sign , float *work ) {
+
+    int x, y0, nb, b, z, K1 = s->dim[1], K2 = s->dim[2];
+    float *P, *buff = work, *temp = &work[ 2 * K2 * spme_fft_block ];
+
+    for ( x = p0 ; x < p1 ; x++ ) {
+
+        P = &s->Q[ 2 * x * K1 * K2 ];
+
+        /* Backward transforms go the other way around. */
+        if ( sign > 0 )
+            spme_fft_exec( &s->fft[1] , P , work , K2 , sign );
+
+        /* Lines along the third dimension, a block at a time. */
+        for ( y0 = 0 ; y0 < K1 ; y0 += spme_fft_block ) {
+            nb = ( K1 - y0 < spme_fft_block ) ? K1 - y0 : spme_fft_block;
+            for ( b = 0 ; b < nb ; b++ )
+                for ( z = 0 ; z < K2 ; z++ ) {
+                    buff[ 2*(z*nb+b) ] = P[ 2*((y0+b)*K2+z) ];
+                    buff[ 2*(z*nb+b)+1 ] = P[ 2*((y0+b)*K2+z)+1 ];
+                    }
+            spme_fft_exec( &s->fft[2] , buff , temp , nb , sign );
+            for ( b = 0 ; b < nb ; b++ )
+                for ( z = 0 ; z < K2 ; z++ ) {
+                    P[ 2*((y0+b)*K2+z) ] = buff[ 2*(z*nb+b) ];
+                    P[ 2*((y0+b)*K2+z)+1 ] = buff[ 2*(z*nb+b)+1 ];
+                    }
+            }
+
+        /* Lines along the second dimension, all of the plane at once. */
+        if ( sign < 0 )
+            spme_fft_exec( &s->fft[1] , P , work , K2 , sign );
+
         }
-    Q = &s->Q[ ind[2] + dim[2]*( ind[1] + dim[1]*ind[0] ) ];
-    E = &s->E[ ind[2] + dim[2]*( ind[1] + dim[1]*ind[0] ) ];
-
-    /* Loop over the parts in cp. */
-    for ( pid = 0 ; pid < cp->count ; pid++ ) {
-    
-        /* Get the particle. */
-        p = &parts[pid];
-        
-        /* Does this particle even have a charge? */
-        q = p->q;
-        if ( q == 0.0f )
-            continue;
-        
-        /* Get the location (normalized) */
-        for ( k = 0 ; k < 3 ; k++ ) {
-            px[k] = ( p->x[k] + shift[k] ) * ih[k];
-            minx[k] = px[k] - spme_gpc/2 + 0.5f;
-            maxx[k] = minx[k] + 3;
-            minx[k] = ( minx[k] < 0 ) ? 0 : minx[k];
-            maxx[k] = ( maxx[k] > spme_gpc-1 ) ? spme_gpc-1 : maxx[k];
+
+    }
+
+
+/**
+ * @brief Transform a block of lines along the first dimension, apply the
+ *      influence function, and transform them back.
+ *
+ * @param s The #spme.
+ * @param b The block, see #spme_maketasks.
+ * @param work Scratch space, see #spme_work.
+ *
+ * @return The reciprocal-space energy of the block.
+ *
+ * Has to run once all the planes have been transformed forward with
+ * #spme_fft2d. The lines are copied into the scratch space so that
+ * they can be transformed together.
+ */
+
+double spme_convolve ( struct spme *s , int b , float *work ) {
+
+    int x, q, q0 = s->blocks[b], B = s->blocks[b+1] - q0;
+    int K0 = s->dim[0], N = s->dim[1] * s->dim[2];
+    float *buff = work, *temp = &work[ 2 * K0 * B ], *Q, *theta;
+    double epot = 0.0;
+
+    /* Get the lines. */
+    for ( x = 0 ; x < K0 ; x++ ) {
+        Q = &s->Q[ 2 * ( x*N + q0 ) ];
+        memcpy( &buff[ 2*x*B ] , Q , sizeof(float) * 2 * B );
+        }
+
+    /* Transform, scale, and transform back. */
+    spme_fft_exec( &s->fft[0] , buff , temp , B , -1 );
+    for ( x = 0 ; x < K0 ; x++ ) {
+        theta = &s->theta[ x*N + q0 ];
+        Q = &buff[ 2*x*B ];
+        for ( q = 0 ; q < B ; q++ ) {
+            epot += theta[q] * ( Q[2*q]*Q[2*q] + Q[2*q+1]*Q[2*q+1] );
+            Q[2*q] *= theta[q];
+            Q[2*q+1] *= theta[q];
             }
-            
-        /* Fill the distance vectors in each dimension. */
-        for ( count = 0 , k = 0 ; k < 3 ; k++ ) {
-            off[k] = count;
-            for ( j = minx[k] ; j <= maxx[k] ; j++ ) {
-                x[count] = fabsf( px[k] - j );
-                count += 1;
-                }
+        }
+    spme_fft_exec( &s->fft[0] , buff , temp , B , 1 );
+
+    /* Put them back. */
+    for ( x = 0 ; x < K0 ; x++ ) {
+        Q = &s->Q[ 2 * ( x*N + q0 ) ];
+        memcpy( Q , &buff[ 2*x*B ] , sizeof(float) * 2 * B );
+        }
+
+    return 0.5 * epot;
+
+    }
+
+
+/**
+ * @brief Evaluate the B-splines and their derivatives for a set of
+ *      particles.
+ *
+ * @param order The order of the B-splines.
+ * @param w The fractional part of each particle's grid coordinate.
+ * @param N The number of particles.
+ * @param b Array of size @c order*N in which to store @f$ M_n(w+t) @f$
+ *      for each particle at @c b[t*N+i].
+ * @param dbdx Array of the same size in which to store the derivatives,
+ *      or @c NULL.
+ *
+ * Grid point @c base-t gets the weight @c b[t*N+i], where @c base is the
+ * integer part of the grid coordinate. The splines are built up one
+ * order at a time with the particles in the innermost loop, which
+ * vectorizes.
+ */
+
+void spme_bspline ( int order , const float *w , int N , float *b , float *dbdx ) {
+
+    int i, k, t;
+    float div;
+
+    /* Order one. */
+    for ( i = 0 ; i < N ; i++ )
+        b[i] = 1.0f;
+    for ( t = 1 ; t < order ; t++ )
+        for ( i = 0 ; i < N ; i++ )
+            b[t*N+i] = 0.0f;
+
+    for ( k = 2 ; k <= order ; k++ ) {
+
+        /* The derivative only needs the previous order. */
+        if ( k == order && dbdx != NULL ) {
+            for ( i = 0 ; i < N ; i++ )
+                dbdx[i] = b[i];
+            for ( t = 1 ; t < order ; t++ )
+                for ( i = 0 ; i < N ; i++ )
+                    dbdx[t*N+i] = b[t*N+i] - b[(t-1)*N+i];
             }
-            
-        if ( count == 0 )
-            continue;
-                
-        /* Evaluate the b-spline components. */
-        spme_bspline( x , count , b , dbdx );
-            
-        /* Loop over the grid points in cg. */
-        for ( ind[0] = minx[0] ; ind[0] <= maxx[0] ; ind[0]++ )
-            for ( ind[1] = minx[1] ; ind[1] <= maxx[1] ; ind[1]++ )
-                for ( ind[2] = minx[2] ; ind[2] <= maxx[2] ; ind[2]++ ) {
-                
-                    /* Apply the interaction to the grid. */
-                    Q[ ind[2] + dim[2]*( ind[1] + dim[1]*ind[0] ) ] += q * b[ off[0] + ind[0]-minx[0] ] * b[ off[1] + ind[1]-minx[1] ] * b[ off[2] + ind[2]-minx[2] ];
-                    
-                    /* Apply the interaction to the particle. */
-                    for ( k = 0 ; k < 3 ; k++ )
-                        p->f[k] += q * E[ ind[2] + dim[2]*( ind[1] + dim[1]*ind[0] ) ] * dbdx[ off[k] + ind[k]-minx[k] ] * ih[k];
-                
-                    } /* loop over grid cells. */
-    
-        } /* loop over parts in cp. */
 
-#endif
+        /* Work down so that b[t-1] is still of the previous order. */
+        div = 1.0f / ( k - 1 );
+        for ( t = k-1 ; t > 0 ; t-- )
+            for ( i = 0 ; i < N ; i++ )
+                b[t*N+i] = div * ( ( w[i] + t ) * b[t*N+i] + ( k - w[i] - t ) * b[(t-1)*N+i] );
+        for ( i = 0 ; i < N ; i++ )
+            b[i] = div * w[i] * b[i];
+
+        }
+
+    }
+
+
+/**
+ * @brief Get the grid coordinates and B-splines of a chunk of particles.
+ */
+
+static void spme_weights ( struct spme *s , struct space_cell *c , int first , int count ,
+    int base[3][spme_chunk] , float b[3][spme_maxorder*spme_chunk] , float db[3][spme_maxorder*spme_chunk] ) {
+
+    int i, k, K;
+    double u, fl;
+    float w[spme_chunk];
+
+    for ( k = 0 ; k < 3 ; k++ ) {
+        K = s->dim[k];
+        for ( i = 0 ; i < count ; i++ ) {
+            u = ( c->origin[k] - s->origin[k] + c->parts[first+i].x[k] ) * s->ih[k];
+            fl = floor( u );
+            w[i] = u - fl;
+            base[k][i] = (int)fl % K;
+            if ( base[k][i] < 0 )
+                base[k][i] += K;
+            }
+        spme_bspline( s->order , w , count , b[k] , ( db != NULL ) ? db[k] : NULL );
+        }
 
     }
 
 
 /**
- * @brief Evaluate the B-spline and its derivatives at the given points
+ * @brief Spread the charges of a cell over the grid.
  *
- * @param x The distances, normalized.
- * @param N The number of points.
- * @param b A vector in which to store the B-splines.
- * @param dbdx A vector in which to store the derivative.
+ * @param s The #spme.
+ * @param c The #space_cell.
+ * @param p0 The first grid plane to spread to.
+ * @param p1 One past the last grid plane to spread to.
  *
+ * Only the grid points in planes @c p0 to @c p1 of the first dimension
+ * are touched, so that several slabs can be filled at the same time.
+ * The charges are added, the planes have to be cleared first.
  */
- 
-void spme_bspline ( float *x , int N , float *b , float *dbdx ) {
-
-    int i, k, ival[N];
-    
-    /* Get the interval for each component. */
-    for ( k = 0 ; k < N ; k++ )
-        ival[k] = fminf( x[k] , 2.0f );
-        
-    /* Init the horner scheme. */
-    for ( k = 0 ; k < N ; k++ ) {
-        b[k] = spme_coeffs[ 4*ival[k] + 3 ];
-        dbdx[k] = 0.0f;
+
+void spme_spread ( struct spme *s , struct space_cell *c , int p0 , int p1 ) {
+
+    int first, count, i, ix, iy, iz, gx, gy, gz, n = s->order;
+    int K0 = s->dim[0], K1 = s->dim[1], K2 = s->dim[2];
+    int base[3][spme_chunk];
+    float b[3][spme_maxorder*spme_chunk], q, bx, bxy, *row;
+
+    for ( first = 0 ; first < c->count ; first += spme_chunk ) {
+
+        count = ( c->count - first < spme_chunk ) ? c->count - first : spme_chunk;
+        spme_weights( s , c , first , count , base , b , NULL );
+
+        for ( i = 0 ; i < count ; i++ ) {
+
+            /* Does this particle even have a charge? */
+            if ( ( q = c->parts[first+i].q ) == 0.0f )
+                continue;
+
+            for ( ix = 0 ; ix < n ; ix++ ) {
+                gx = base[0][i] - ix;
+                if ( gx < 0 )
+                    gx += K0;
+                if ( gx < p0 || gx >= p1 )
+                    continue;
+                bx = q * b[0][ix*count+i];
+                for ( iy = 0 ; iy < n ; iy++ ) {
+                    gy = base[1][i] - iy;
+                    if ( gy < 0 )
+                        gy += K1;
+                    row = &s->Q[ 2 * ( gx*K1 + gy ) * K2 ];
+                    bxy = bx * b[1][iy*count+i];
+                    for ( iz = 0 ; iz < n ; iz++ ) {
+                        gz = base[2][i] - iz;
+                        if ( gz < 0 )
+                            gz += K2;
+                        row[2*gz] += bxy * b[2][iz*count+i];
+                        }
+                    }
+                }
+
+            }
+
         }
-        
-    /* Evaluate the polynomial and its derivative. */
-    for ( i = 2 ; i >= 0 ; i-- )
-        for ( k = 0 ; k < N ; k++ ) {
-            dbdx[k] = dbdx[k] * x[k] + b[k];
-            b[k] = b[k] * x[k] + spme_coeffs[ 4*ival[k] + i ];
+
+    }
+
+
+/**
+ * @brief Interpolate the reciprocal-space forces onto the particles of
+ *      a cell.
+ *
+ * @param s The #spme.
+ * @param c The #space_cell.
+ *
+ * Has to run once the convolution is done and the planes have been
+ * transformed back. Writes to the particle forces, so the cell has to
+ * be locked.
+ */
+
+void spme_gather ( struct spme *s , struct space_cell *c ) {
+
+    int first, count, i, ix, iy, iz, gx, gy, gz, n = s->order;
+    int K0 = s->dim[0], K1 = s->dim[1], K2 = s->dim[2];
+    int base[3][spme_chunk];
+    float b[3][spme_maxorder*spme_chunk], db[3][spme_maxorder*spme_chunk];
+    float q, fx, fy, fz, sz, dsz, *row;
+    struct MxParticle *p;
+
+    for ( first = 0 ; first < c->count ; first += spme_chunk ) {
+
+        count = ( c->count - first < spme_chunk ) ? c->count - first : spme_chunk;
+        spme_weights( s , c , first , count , base , b , db );
+
+        for ( i = 0 ; i < count ; i++ ) {
+
+            /* Does this particle even have a charge? */
+            p = &c->parts[first+i];
+            if ( ( q = p->q ) == 0.0f )
+                continue;
+
+            fx = 0.0f; fy = 0.0f; fz = 0.0f;
+            for ( ix = 0 ; ix < n ; ix++ ) {
+                gx = base[0][i] - ix;
+                if ( gx < 0 )
+                    gx += K0;
+                for ( iy = 0 ; iy < n ; iy++ ) {
+                    gy = base[1][i] - iy;
+                    if ( gy < 0 )
+                        gy += K1;
+                    row = &s->Q[ 2 * ( gx*K1 + gy ) * K2 ];
+                    sz = 0.0f; dsz = 0.0f;
+                    for ( iz = 0 ; iz < n ; iz++ ) {
+                        gz = base[2][i] - iz;
+                        if ( gz < 0 )
+                            gz += K2;
+                        sz += row[2*gz] * b[2][iz*count+i];
+                        dsz += row[2*gz] * db[2][iz*count+i];
+                        }
+                    fx += db[0][ix*count+i] * b[1][iy*count+i] * sz;
+                    fy += b[0][ix*count+i] * db[1][iy*count+i] * sz;
+                    fz += b[0][ix*count+i] * b[1][iy*count+i] * dsz;
+                    }
+                }
+
+            p->f[0] -= q * fx * s->ih[0];
+            p->f[1] -= q * fy * s->ih[1];
+            p->f[2] -= q * fz * s->ih[2];
+
             }
-            
+
+        }
+
     }
-    
-    
+
+
 /**
- * @breif Recursive definition of the cardinal B-spline
+ * @brief Recursive definition of the cardinal B-spline
  *
  * @param k B-spline order.
  * @param x Point at which the function will be evaluated.
  */
- 
-float spme_M ( int k , float x ) {
 
-#ifdef HAVE_FFTW3
+static double spme_M ( int k , double x ) {
+
     /* Lowest order? */
-    if ( k == 1 ) {
-    
-        /* In the house? */
-        if ( x >= 0.0f && x <= 1.0f )
-            return 1.0f;
-        else
-            return 0.0f;
-    
-        }
-        
+    if ( k == 1 )
+        return ( x >= 0.0 && x < 1.0 ) ? 1.0 : 0.0;
+
     /* Otherwise, recurse. */
-    else
-        return x / (k - 1) * spme_M( k-1 , x ) + (k - x) / (k - 1) * spme_M( k-1 , x - 1.0f );
-#else
-    return error(smpe_err_nofftw3);
-#endif
+    return ( x * spme_M( k-1 , x ) + ( k - x ) * spme_M( k-1 , x - 1.0 ) ) / ( k - 1 );
 
     }
-    
-    
+
+
 /**
- * @brief Sort the cell pairs in a spme according to their direction.
+ * @brief Initialize a #spme.
  *
  * @param s The #spme data structure.
+ * @param origin The origin of the periodic box.
  * @param dim The SPME grid dimensions.
  * @param h The grid spacing in each dimension.
+ * @param kappa The Ewald splitting parameter, as used for the real-space
+ *      part (see #potential_create_Ewald).
+ * @param order The order of the B-splines.
  *
  * @return #spme_err_ok or < 0 on error (see #spme_err).
+ *
+ * The grid dimensions can be any product of small primes, the transforms
+ * are fastest for powers of two.
  */
- 
-int spme_init ( struct spme *s , int *dim , float *h , float kappa ) {
 
-#ifdef HAVE_FFTW3
-    int i, j, k, l, size;
-    float v, m[3], m2, kappa2 = kappa*kappa;
-    fftwf_complex bc[3];
-    float b[3], w[3];
-    float x[ spme_order-1 ], mx[ spme_order-1 ], dmdx[ spme_order-1 ];
+int spme_init ( struct spme *s , double *origin , int *dim , double *h , double kappa , int order ) {
+
+    int i, j, k, l, d, N;
+    double m[3], m2, v, re, im, mx[ spme_maxorder ], *bsp[3];
 
     /* Sanity check. */
-    if ( s == NULL || dim == NULL || h == NULL )
+    if ( s == NULL || origin == NULL || dim == NULL || h == NULL )
         return error(spme_err_null);
+    if ( order < 2 || order > spme_maxorder || kappa <= 0.0 )
+        return error(spme_err_range);
+    for ( k = 0 ; k < 3 ; k++ )
+        if ( dim[k] < order || h[k] <= 0.0 )
+            return error(spme_err_range);
+
+    /* Start from scratch. */
+    bzero( s , sizeof(struct spme) );
 
-    /* Set the dimensions. */
-    s->dim[0] = dim[0];
-    s->dim[1] = dim[1];
-    s->dim[2] = dim[2];
-    
-    /* Set the spacing. */
-    s->h[0] = h[0]; s->ih[0] = 1.0f / h[0]; w[0] = s->ih[0] / dim[0];
-    s->h[1] = h[1]; s->ih[1] = 1.0f / h[1]; w[1] = s->ih[1] / dim[1];
-    s->h[2] = h[2]; s->ih[2] = 1.0f / h[2]; w[2] = s->ih[2] / dim[2];
-    
-    /* Store kappa. */
+    /* Set the dimensions and spacing. */
+    for ( k = 0 ; k < 3 ; k++ ) {
+        s->dim[k] = dim[k];
+        s->origin[k] = origin[k];
+        s->h[k] = h[k];
+        s->ih[k] = 1.0 / h[k];
+        if ( spme_fft_init( &s->fft[k] , dim[k] ) < 0 )
+            return error(spme_err);
+        }
+    s->order = order;
     s->kappa = kappa;
-    
+
     /* Allocate the grids. */
-    size = dim[0] * dim[1] * dim[2];
-    if ( posix_memalign( (void **)&s->Q , 16 , sizeof(fftwf_complex) * size ) != 0 ||
-         posix_memalign( (void **)&s->T , 16 , sizeof(fftwf_complex) * size ) != 0 ||
-         posix_memalign( (void **)&s->theta , 16 , sizeof(float) * size ) != 0 ||
-         posix_memalign( (void **)&s->E , 16 , sizeof(fftwf_complex) * size ) != 0 )
+    N = dim[0] * dim[1] * dim[2];
+    if ( posix_memalign( (void **)&s->Q , 64 , sizeof(float) * 2 * N ) != 0 ||
+         posix_memalign( (void **)&s->theta , 64 , sizeof(float) * N ) != 0 )
         return error(spme_err_malloc);
-        
-    /* Init the grids. */
-    bzero( s->Q , sizeof(float) * size );
-    bzero( s->E , sizeof(float) * size );
-    
-    /* Pre-compute the b-splines at the integers. */
-    for ( k = 0 ; k <= spme_order-2 ; k++ )
-        x[k] = abs( k + 1 - spme_order/2 );
-    spme_bspline( x , spme_order-1 , mx , dmdx );
-        
-    /* Fill theta (reciprocal space). */
-    v = 1.0f / ( M_PI * dim[0]*h[0] * dim[1]*h[1] * dim[2]*h[2] );
+    bzero( s->Q , sizeof(float) * 2 * N );
+
+    /* The B-splines at the integers. */
+    for ( l = 0 ; l < order-1 ; l++ )
+        mx[l] = spme_M( order , l + 1 );
+
+    /* The moduli of the Euler exponential splines in each dimension. */
+    for ( d = 0 ; d < 3 ; d++ ) {
+        if ( ( bsp[d] = (double *)alloca( sizeof(double) * dim[d] ) ) == NULL )
+            return error(spme_err_malloc);
+        for ( i = 0 ; i < dim[d] ; i++ ) {
+            re = 0.0; im = 0.0;
+            for ( l = 0 ; l < order-1 ; l++ ) {
+                re += mx[l] * cos( 2*M_PI*i*l/dim[d] );
+                im += mx[l] * sin( 2*M_PI*i*l/dim[d] );
+                }
+            bsp[d][i] = ( re*re + im*im > 1.0e-7 ) ? 1.0 / ( re*re + im*im ) : -1.0;
+            }
+        /* Odd orders have a zero at the Nyquist frequency, fill it in. */
+        for ( i = 0 ; i < dim[d] ; i++ )
+            if ( bsp[d][i] < 0.0 )
+                bsp[d][i] = 0.5 * ( bsp[d][ (i+dim[d]-1) % dim[d] ] + bsp[d][ (i+1) % dim[d] ] );
+        }
+
+    /* Fill theta (reciprocal space). The convolution scales by it twice
+       the energy's prefactor, since the potential is the derivative. */
+    v = potential_escale / ( M_PI * dim[0]*h[0] * dim[1]*h[1] * dim[2]*h[2] );
     for ( i = 0 ; i < dim[0] ; i++ )
         for ( j = 0 ; j < dim[1] ; j++ )
             for ( k = 0 ; k < dim[2] ; k++ ) {
-            
-                /* Compute the Euler exponential splines. */
-                bc[0] = 0.0; bc[1] = 0.0; bc[2] = 0.0;
-                for ( l = 0 ; l <= spme_order-2 ; l++ ) {
-                    bc[0] += mx[l] * cexpf( 2*M_PI*i*l/dim[0]*I );
-                    bc[1] += mx[l] * cexpf( 2*M_PI*j*l/dim[1]*I );
-                    bc[2] += mx[l] * cexpf( 2*M_PI*k*l/dim[2]*I );
-                    }
-                b[0] = cabsf( cexpf( 2*M_PI*I*(spme_order-1)*i/dim[0] ) / bc[0] );
-                b[1] = cabsf( cexpf( 2*M_PI*I*(spme_order-1)*j/dim[1] ) / bc[1] );
-                b[2] = cabsf( cexpf( 2*M_PI*I*(spme_order-1)*k/dim[2] ) / bc[2] );
-                
-                /* Get the corrected values for m. */
-                m[0] = ( (i > dim[0]/2) ? i - dim[0] : i ) * w[0];
-                m[1] = ( (j > dim[1]/2) ? j - dim[1] : j ) * w[1];
-                m[2] = ( (k > dim[2]/2) ? k - dim[2] : k ) * w[2];
+                m[0] = ( ( 2*i > dim[0] ) ? i - dim[0] : i ) / ( dim[0] * h[0] );
+                m[1] = ( ( 2*j > dim[1] ) ? j - dim[1] : j ) / ( dim[1] * h[1] );
+                m[2] = ( ( 2*k > dim[2] ) ? k - dim[2] : k ) / ( dim[2] * h[2] );
                 m2 = m[0]*m[0] + m[1]*m[1] + m[2]*m[2];
-                
-                /* Fill theta. */
-                s->theta[ k + dim[2]*(j + dim[1]*i) ] = b[0]*b[0] * b[1]*b[1] * b[2]*b[2] * v * expf( -M_PI*M_PI / kappa2 * m2 ) / m2;
-                
-                /* Catch problems on the grid. */
-                if ( !isfinite( s->theta[ k + dim[2]*(j + dim[1]*i) ] ) )
-                    s->theta[ k + dim[2]*(j + dim[1]*i) ] = 0.0f;
-                
+                s->theta[ k + dim[2]*(j + dim[1]*i) ] = ( m2 > 0.0 ) ?
+                    v * exp( -M_PI*M_PI * m2 / ( kappa*kappa ) ) / m2 * bsp[0][i] * bsp[1][j] * bsp[2][k] : 0.0f;
                 }
-                
-    /* Init the plans. */
-    if ( ( s->fwplan = fftwf_plan_dft_3d( dim[0] , dim[1] , dim[2] , s->Q , s->T , FFTW_FORWARD , FFTW_ESTIMATE ) ) == NULL )
-        return error(spme_err_fftw);
-    if ( ( s->bwplan = fftwf_plan_dft_3d( dim[0] , dim[1] , dim[2] , s->T , s->E , FFTW_BACKWARD , FFTW_ESTIMATE ) ) == NULL )
-        return error(spme_err_fftw);
-                
+
     /* We're on a roll. */
     return spme_err_ok;
-#else
-    return error(smpe_err_nofftw3);
-#endif
 
     }
 
+
+/**
+ * @brief Free the memory held by a #spme.
+ *
+ * @param s The #spme.
+ */
+
+void spme_free ( struct spme *s ) {
+
+    int k;
+
+    if ( s == NULL )
+        return;
+
+    free( s->Q );
+    free( s->theta );
+    for ( k = 0 ; k < 3 ; k++ )
+        free( s->fft[k].w );
+    free( s->tasks );
+    free( s->slabs );
+    free( s->blocks );
+    free( s->layer_lo );
+    free( s->layer_hi );
+    for ( k = 0 ; k < s->nr_work ; k++ )
+        free( s->work[k] );
+    free( s->work );
+    free( s->epot_block );
+    bzero( s , sizeof(struct spme) );
+
+    }
+
+
+/**
+ * @brief Get the scratch space of a runner.
+ *
+ * @param s The #spme.
+ * @param rid The runner ID.
+ *
+ * @return A pointer to @c work_size floats, or @c NULL on error.
+ *
+ * The space is allocated the first time it is asked for, by the runner
+ * that uses it, so it lives close to that runner.
+ */
+
+float *spme_work ( struct spme *s , int rid ) {
+
+    if ( rid < 0 || rid >= s->nr_work ) {
+        error(spme_err_range);
+        return NULL;
+        }
+
+    if ( s->work[rid] == NULL &&
+         posix_memalign( (void **)&s->work[rid] , 64 , sizeof(float) * s->work_size ) != 0 ) {
+        s->work[rid] = NULL;
+        error(spme_err_malloc);
+        return NULL;
+        }
+
+    return s->work[rid];
+
+    }
+
+
+/**
+ * @brief Check if the particles of a layer of cells reach a range of
+ *      grid planes.
+ *
+ * @param s The #spme.
+ * @param layer The index of the cells along the first dimension.
+ * @param p0 The first grid plane.
+ * @param p1 One past the last grid plane.
+ *
+ * @return 1 if they do, 0 otherwise.
+ */
+
+int spme_layer_hits ( struct spme *s , int layer , int p0 , int p1 ) {
+
+    int K = s->dim[0], lo = s->layer_lo[layer], hi = s->layer_hi[layer], a, b;
+
+    if ( hi - lo + 1 >= K )
+        return 1;
+    a = ( ( lo % K ) + K ) % K;
+    b = a + hi - lo;
+
+    return ( a < p1 && b >= p0 ) || ( b >= K && b - K >= p0 );
+
+    }
+
+
+/**
+ * @brief Make the reciprocal-space tasks for a cell grid.
+ *
+ * @param s The #spme.
+ * @param sp The #space whose cells are used.
+ * @param nr_runners The number of runners that will run the tasks.
+ * @param margin How far the particles may have left their cells since
+ *      they were last sorted into them.
+ *
+ * @return #spme_err_ok or < 0 on error (see #spme_err).
+ *
+ * The grid is cut into slabs of planes along the first dimension. Each
+ * slab gets a task spreading the charges of the cells that reach it, and
+ * a task transforming its planes, which unlocks the tasks convolving the
+ * blocks of lines along the first dimension. Those unlock the backward
+ * transforms of the slabs, which release the layers of cells they
+ * reach, which in turn unlock one task per row of cells interpolating
+ * the forces. None of the tasks lock any cells except the last, so they
+ * can run alongside the pair tasks.
+ */
+
+int spme_maketasks ( struct spme *s , struct space *sp , int nr_runners , double margin ) {
+
+    int k, i, j, nr_layers, nr_rows, nr_split, B, K0 = s->dim[0], N = s->dim[1] * s->dim[2];
+    struct task *spread, *forward, *conv, *backward, *layer, *gather, *t;
+
+    /* Sanity check. */
+    if ( s == NULL || sp == NULL )
+        return error(spme_err_null);
+    nr_layers = sp->cdim[0];
+    nr_rows = sp->cdim[0] * sp->cdim[1];
+    if ( nr_layers > task_max_unlock || sp->cdim[1] > task_max_unlock )
+        return error(spme_err_range);
+
+    /* Cut the grid into slabs and the lines into blocks, about two
+       of each per runner. */
+    nr_split = ( nr_runners > 0 ) ? 2 * nr_runners : 1;
+    s->nr_slabs = ( nr_split < K0 ) ? nr_split : K0;
+    if ( s->nr_slabs > spme_maxslabs )
+        s->nr_slabs = spme_maxslabs;
+    s->nr_blocks = ( nr_split < N ) ? nr_split : N;
+    if ( s->nr_blocks > spme_maxslabs )
+        s->nr_blocks = spme_maxslabs;
+    free( s->slabs ); free( s->blocks ); free( s->epot_block );
+    if ( ( s->slabs = (int *)malloc( sizeof(int) * ( s->nr_slabs + 1 ) ) ) == NULL ||
+         ( s->blocks = (int *)malloc( sizeof(int) * ( s->nr_blocks + 1 ) ) ) == NULL ||
+         ( s->epot_block = (double *)calloc( s->nr_blocks , sizeof(double) ) ) == NULL )
+        return error(spme_err_malloc);
+    for ( k = 0 ; k <= s->nr_slabs ; k++ )
+        s->slabs[k] = k * K0 / s->nr_slabs;
+    for ( B = 0 , k = 0 ; k <= s->nr_blocks ; k++ ) {
+        s->blocks[k] = (long)k * N / s->nr_blocks;
+        if ( k > 0 && s->blocks[k] - s->blocks[k-1] > B )
+            B = s->blocks[k] - s->blocks[k-1];
+        }
+
+    /* Which planes can the particles of each layer of cells reach? */
+    free( s->layer_lo ); free( s->layer_hi );
+    if ( ( s->layer_lo = (int *)malloc( sizeof(int) * nr_layers ) ) == NULL ||
+         ( s->layer_hi = (int *)malloc( sizeof(int) * nr_layers ) ) == NULL )
+        return error(spme_err_malloc);
+    for ( k = 0 ; k < nr_layers ; k++ ) {
+        s->layer_lo[k] = (int)floor( ( k * sp->h[0] - margin ) * s->ih[0] ) - ( s->order - 1 );
+        s->layer_hi[k] = (int)floor( ( ( k + 1 ) * sp->h[0] + margin ) * s->ih[0] );
+        }
+
+    /* Make room for the scratch space of each runner. */
+    for ( k = 0 ; k < s->nr_work ; k++ )
+        free( s->work[k] );
+    free( s->work );
+    s->nr_work = ( nr_runners > 0 ) ? nr_runners : 1;
+    if ( ( s->work = (float **)calloc( s->nr_work , sizeof(float *) ) ) == NULL )
+        return error(spme_err_malloc);
+    s->work_size = 2 * K0 * B;
+    if ( s->work_size < N )
+        s->work_size = N;
+    if ( s->work_size < 2 * s->dim[2] * spme_fft_block )
+        s->work_size = 2 * s->dim[2] * spme_fft_block;
+    s->work_size *= 2;
+
+    /* Make the tasks. */
+    free( s->tasks );
+    s->nr_tasks = 3 * s->nr_slabs + s->nr_blocks + nr_layers + nr_rows;
+    if ( ( s->tasks = (struct task *)calloc( s->nr_tasks , sizeof(struct task) ) ) == NULL )
+        return error(spme_err_malloc);
+    spread = s->tasks;
+    forward = &spread[ s->nr_slabs ];
+    conv = &forward[ s->nr_slabs ];
+    backward = &conv[ s->nr_blocks ];
+    layer = &backward[ s->nr_slabs ];
+    gather = &layer[ nr_layers ];
+    for ( k = 0 ; k < s->nr_tasks ; k++ ) {
+        t = &s->tasks[k];
+        t->type = task_type_spme;
+        t->subtype = task_subtype_spme;
+        t->j = -1;
+        }
+    for ( k = 0 ; k < s->nr_slabs ; k++ ) {
+        spread[k].flags = spme_task_spread; spread[k].i = k;
+        forward[k].flags = spme_task_forward; forward[k].i = k;
+        backward[k].flags = spme_task_backward; backward[k].i = k;
+        }
+    for ( k = 0 ; k < s->nr_blocks ; k++ ) {
+        conv[k].flags = spme_task_convolve; conv[k].i = k;
+        }
+    for ( k = 0 ; k < nr_layers ; k++ ) {
+        layer[k].flags = spme_task_layer; layer[k].i = k;
+        }
+    for ( i = 0 ; i < nr_layers ; i++ )
+        for ( j = 0 ; j < sp->cdim[1] ; j++ ) {
+            t = &gather[ i*sp->cdim[1] + j ];
+            t->flags = spme_task_gather; t->i = i; t->j = j;
+            }
+
+    /* Link them up. */
+    for ( k = 0 ; k < s->nr_slabs ; k++ ) {
+        if ( task_addunlock( &spread[k] , &forward[k] ) != 0 )
+            return error(spme_err_task);
+        for ( i = 0 ; i < s->nr_blocks ; i++ )
+            if ( task_addunlock( &forward[k] , &conv[i] ) != 0 )
+                return error(spme_err_task);
+        for ( i = 0 ; i < nr_layers ; i++ )
+            if ( spme_layer_hits( s , i , s->slabs[k] , s->slabs[k+1] ) &&
+                 task_addunlock( &backward[k] , &layer[i] ) != 0 )
+                return error(spme_err_task);
+        }
+    for ( k = 0 ; k < s->nr_blocks ; k++ )
+        for ( i = 0 ; i < s->nr_slabs ; i++ )
+            if ( task_addunlock( &conv[k] , &backward[i] ) != 0 )
+                return error(spme_err_task);
+    for ( i = 0 ; i < nr_layers ; i++ )
+        for ( j = 0 ; j < sp->cdim[1] ; j++ )
+            if ( task_addunlock( &layer[i] , &gather[ i*sp->cdim[1] + j ] ) != 0 )
+                return error(spme_err_task);
+
+    /* Remember what they were made for. */
+    for ( k = 0 ; k < 3 ; k++ )
+        s->cdim[k] = sp->cdim[k];
+    s->margin = margin;
+
+    /* All is well... */
+    return spme_err_ok;
+
+    }
+
+
+/**
+ * @brief Re-set the wait counters of the reciprocal-space tasks.
+ *
+ * @param s The #spme.
+ *
+ * @return #spme_err_ok or < 0 on error (see #spme_err).
+ */
+
+int spme_prepare ( struct spme *s ) {
+
+    int j, k;
+
+    if ( s == NULL )
+        return error(spme_err_null);
+
+    for ( k = 0 ; k < s->nr_tasks ; k++ )
+        s->tasks[k].wait = 0;
+    for ( k = 0 ; k < s->nr_tasks ; k++ )
+        for ( j = 0 ; j < s->tasks[k].nr_unlock ; j++ )
+            s->tasks[k].unlock[j]->wait += 1;
+
+    return spme_err_ok;
+
+    }
+
+
+/**
+ * @brief Get the reciprocal-space energy of the last convolution.
+ *
+ * @param s The #spme.
+ */
+
+double spme_energy ( struct spme *s ) {
+
+    int k;
+    double epot = 0.0;
+
+    for ( k = 0 ; k < s->nr_blocks ; k++ )
+        epot += s->epot_block[k];
+
+    return epot;
+
+    }
+
+
+/**
+ * @brief Do the convolution stuff.
+ *
+ * @param s The #spme.
+ *
+ * @return The reciprocal-space energy, or < 0 on error (see #spme_err).
+ *
+ * Transforms the whole grid, once the charges have been spread, and back,
+ * on the calling thread. Needs the blocks and scratch space of
+ * #spme_maketasks.
+ */
+
+double spme_doconv ( struct spme *s ) {
+
+    int k;
+    float *work;
+
+    if ( ( work = spme_work( s , 0 ) ) == NULL )
+        return error(spme_err);
+
+    spme_fft2d( s , 0 , s->dim[0] , -1 , work );
+    for ( k = 0 ; k < s->nr_blocks ; k++ )
+        s->epot_block[k] = spme_convolve( s , k , work );
+    spme_fft2d( s , 0 , s->dim[0] , 1 , work );
+
+    return spme_energy( s );
+
+    }
@@ -0,0 +1,178 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the re-partitioning of the cells over the MPI nodes
+   (engine_flag_balance) on two or more ranks: with the first node made
+   to look busier, cells move off it, every cell is owned by exactly one
+   node that all nodes agree on, every particle is owned by exactly one
+   node, and the forces, positions and energy after the move match a run
+   on a single node. */
+
+#include "testsys.h"
+
+
+/* Number of steps before and after the re-partition. */
+#define nr_steps                         10
+
+/* The measured load of the first node's tasks, against 1 for the others. */
+#define balance_skew                     3.0
+
+
+/**
+ * @brief Check that every cell is owned by one node, the same on all
+ *      nodes, and that the real cells are those of this node.
+ *
+ * @param e The #engine.
+ * @param counts An array of @c e->nr_nodes ints in which to store the
+ *      number of cells of each node.
+ */
+
+static int balance_cells ( struct engine *e , int *counts ) {
+
+    struct space *s = &e->s;
+    int *lo, *hi, cid, nr_real, bad = 0;
+
+    lo = (int *)malloc( sizeof(int) * s->nr_cells );
+    hi = (int *)malloc( sizeof(int) * s->nr_cells );
+    bzero( counts , sizeof(int) * e->nr_nodes );
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ ) {
+        lo[cid] = hi[cid] = s->cells[cid].nodeID;
+        if ( lo[cid] < 0 || lo[cid] >= e->nr_nodes )
+            bad += 1;
+        else
+            counts[ lo[cid] ] += 1;
+        if ( ( s->cells[cid].nodeID == e->nodeID ) == ( ( s->cells[cid].flags & cell_flag_ghost ) != 0 ) )
+            bad += 1;
+    }
+    MPI_Allreduce( MPI_IN_PLACE , lo , s->nr_cells , MPI_INT , MPI_MIN , e->comm );
+    MPI_Allreduce( MPI_IN_PLACE , hi , s->nr_cells , MPI_INT , MPI_MAX , e->comm );
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+        if ( lo[cid] != hi[cid] )
+            bad += 1;
+    MPI_Allreduce( &s->nr_real , &nr_real , 1 , MPI_INT , MPI_SUM , e->comm );
+    if ( nr_real != s->nr_cells )
+        bad += 1;
+
+    free( lo ); free( hi );
+    printf( "balance[%i]: %i real cells, %i of %i over all nodes, %i bad.\n" ,
+        e->nodeID , s->nr_real , nr_real , s->nr_cells , bad );
+    return bad;
+
+}
+
+
+/**
+ * @brief Check that every particle is owned by exactly one node.
+ */
+
+static int balance_parts ( struct engine *e , const int *count ) {
+
+    int pid, bad = 0;
+
+    for ( pid = 0 ; pid < e->s.nr_parts ; pid++ )
+        if ( count[pid] != 1 )
+            bad += 1;
+
+    printf( "balance[%i]: %i of %i particles not owned by exactly one node.\n" ,
+        e->nodeID , bad , e->s.nr_parts );
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = 14*14*14, nr_nodes, rank, nr_moved, k, bad = 0;
+    int *count, *before, *after;
+    double *f_ref, *f_mpi, *x_ref, *x_mpi, epot_ref, epot_mpi, imbalance;
+
+    if ( MPI_Init( &argc , &argv ) != MPI_SUCCESS ||
+         MPI_Comm_size( MPI_COMM_WORLD , &nr_nodes ) != MPI_SUCCESS ||
+         MPI_Comm_rank( MPI_COMM_WORLD , &rank ) != MPI_SUCCESS )
+        return 1;
+    if ( nr_nodes < 2 ) {
+        printf( "balance: needs at least two ranks.\n" );
+        MPI_Finalize();
+        return 1;
+    }
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_mpi = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_mpi = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    count = (int *)malloc( sizeof(int) * nr_parts );
+    before = (int *)malloc( sizeof(int) * nr_nodes );
+    after = (int *)malloc( sizeof(int) * nr_nodes );
+
+    /* The reference, on each node by itself. */
+    testsys_check( testsys_init( e , engine_flag_none , 14 , testsys_width , testsys_cutoff ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < 2 * nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_forces( e , f_ref );
+    testsys_positions( e , x_ref );
+    epot_ref = e->s.epot;
+    testsys_check( engine_finalize( e ) );
+
+    /* The same system split over the nodes. */
+    testsys_check( testsys_init( e , engine_flag_mpi | engine_flag_balance , 14 , testsys_width , testsys_cutoff ) );
+    testsys_check( engine_split_bisect( e , nr_nodes ) );
+    testsys_check( engine_split( e ) );
+    testsys_check( engine_balance_set( e , 1000 * nr_steps , engine_balance_tol ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    bad += balance_cells( e , before );
+
+    /* Make the first node look busier and re-partition. */
+    for ( k = 0 ; k < e->s.nr_tasks ; k++ )
+        e->s.tasks[k].cost = ( rank == 0 ) ? balance_skew : 1.0;
+    testsys_check( engine_balance( e ) );
+    testsys_check( engine_balance_stats( e , &imbalance , NULL , &nr_moved ) );
+    printf( "balance[%i]: imbalance %.3f, %i cells moved.\n" , rank , imbalance , nr_moved );
+    if ( imbalance <= engine_balance_tol || nr_moved < 1 )
+        bad += 1;
+    bad += balance_cells( e , after );
+    if ( after[0] >= before[0] )
+        bad += 1;
+    testsys_check( testsys_gather( e , x_mpi , f_mpi , count ) );
+    bad += balance_parts( e , count );
+
+    /* Carry on with the new partition. */
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_check( testsys_gather( e , x_mpi , f_mpi , count ) );
+    bad += balance_parts( e , count );
+    MPI_Allreduce( &e->s.epot , &epot_mpi , 1 , MPI_DOUBLE , MPI_SUM , MPI_COMM_WORLD );
+    bad += testsys_compare( "balance forces" , f_ref , f_mpi , 3 * nr_parts , 1.0e-4 );
+    testsys_image( x_ref , x_mpi , nr_parts , testsys_width );
+    bad += testsys_compare( "balance positions" , x_ref , x_mpi , 3 * nr_parts , 1.0e-5 );
+    bad += testsys_compare( "balance energy" , &epot_ref , &epot_mpi , 1 , 1.0e-4 );
+    testsys_check( engine_finalize( e ) );
+
+    /* Fail on all nodes if any one failed. */
+    MPI_Allreduce( MPI_IN_PLACE , &bad , 1 , MPI_INT , MPI_SUM , MPI_COMM_WORLD );
+    free( f_ref ); free( f_mpi ); free( x_ref ); free( x_mpi );
+    free( count ); free( before ); free( after );
+    MPI_Finalize();
+    return bad != 0;
+
+}
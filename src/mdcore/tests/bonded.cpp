@@ -0,0 +1,127 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks that the bonds, angles and dihedrals stay sorted by the Morton
+   rank of the cell of their first particle while the particles move
+   between cells, and that their forces and energy match the formulas of
+   their potentials. */
+
+#include "testsys.h"
+
+
+/* Particles per box side and number of steps. */
+#define bonded_n                         14
+#define bonded_steps                     100
+
+
+/**
+ * @brief Check the order of the bonded interactions after a step.
+ *
+ * @param e The #engine.
+ *
+ * @return The number of problems found.
+ *
+ * Each kind but the exclusions must be sorted by its keys, each key must
+ * be the rank of the cell of the first particle, and the handles must
+ * follow their interactions.
+ */
+
+static int bonded_sorted ( struct engine *e ) {
+
+    struct space *s = &e->s;
+    int kind, k, N, *ids, bad = 0;
+
+    for ( kind = engine_bonded_bond ; kind < engine_bonded_last ; kind++ ) {
+        N = ( kind == engine_bonded_bond ) ? e->nr_bonds : ( kind == engine_bonded_angle ) ? e->nr_angles : e->nr_dihedrals;
+        if ( e->bonded_nr_sorted[kind] != N || e->bonded_nr_local[kind] != N ) {
+            printf( "bonded: %i of %i interactions of kind %i sorted, %i local.\n" ,
+                e->bonded_nr_sorted[kind] , N , kind , e->bonded_nr_local[kind] );
+            bad += 1;
+            continue;
+        }
+        for ( k = 0 ; k < N ; k++ ) {
+            ids = ( kind == engine_bonded_bond ) ? &e->bonds[k].i : ( kind == engine_bonded_angle ) ? &e->angles[k].i : &e->dihedrals[k].i;
+            if ( e->bonded_keys[kind][k] != e->bonded_rank[ s->celllist[ ids[0] ] - s->cells ] ||
+                 ( k > 0 && e->bonded_keys[kind][k] < e->bonded_keys[kind][k-1] ) ||
+                 e->bonded_pos[kind][ e->bonded_hid[kind][k] ] != k )
+                bad += 1;
+        }
+    }
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = bonded_n * bonded_n * bonded_n, step, k, moved = 0, bad = 0;
+    double *f_ref, *f, epot_ref, epot;
+    char what[100];
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* Bonded interactions only, with the particles moving fast enough to
+       change cells. */
+    testsys_check( testsys_init( e , engine_flag_none , bonded_n , testsys_width , testsys_cutoff ) );
+    testsys_check( testsys_bonded( e , bonded_n , 0 ) );
+    for ( k = 0 ; k < nr_parts ; k++ )
+        for ( step = 0 ; step < 3 ; step++ )
+            e->s.partlist[k]->v[step] *= 3.0;
+    testsys_check( engine_start( e , 2 , 2 ) );
+
+    for ( step = 0 ; step < bonded_steps ; step++ ) {
+
+        /* The reference at the positions of this step. */
+        if ( step == 0 || step == bonded_steps - 1 ) {
+            bzero( f_ref , sizeof(double) * 3 * nr_parts );
+            epot_ref = 0.0;
+            testsys_bonded_brute( e , f_ref , &epot_ref );
+        }
+
+        /* Sort the lists for the new cells of the particles. */
+        testsys_check( engine_step( e ) );
+        moved += ( e->s.parts_moved != 0 );
+        testsys_check( engine_bonded_sort( e ) );
+        bad += bonded_sorted( e );
+
+        if ( step == 0 || step == bonded_steps - 1 ) {
+            testsys_forces( e , f );
+            epot = e->s.epot;
+            snprintf( what , sizeof(what) , "bonded forces at step %i" , step );
+            bad += testsys_compare( what , f_ref , f , 3 * nr_parts , 1.0e-4 );
+            snprintf( what , sizeof(what) , "bonded energy at step %i" , step );
+            bad += testsys_compare( what , &epot_ref , &epot , 1 , 1.0e-4 );
+        }
+
+    }
+    testsys_check( engine_finalize( e ) );
+
+    /* Make sure the incremental sort had some work to do. */
+    printf( "bonded: particles changed cells in %i of %i steps, %i bad results.\n" , moved , bonded_steps , bad );
+    if ( moved < bonded_steps / 2 )
+        bad += 1;
+
+    free( f_ref ); free( f );
+    return bad != 0;
+
+}
@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the bonded interactions shared between the runners by cell
+   (engine_flag_parbonded, and engine_flag_sets with runners): the forces
+   and energy against the formulas of the potentials, also right after
+   interactions were added and removed, which must not undo the split. */
+
+#include "testsys.h"
+
+
+/* Particles per box side, runners and steps. */
+#define share_n                          14
+#define share_runners                    4
+#define share_steps                      60
+
+
+/**
+ * @brief Remove every third bond, angle and dihedral and add some new
+ *      bonds.
+ *
+ * @param e The #engine, set up with #testsys_bonded.
+ */
+
+static int share_edit ( struct engine *e ) {
+
+    int kind, hid, pid, nr_handles;
+
+    for ( kind = engine_bonded_bond ; kind < engine_bonded_last ; kind++ ) {
+        nr_handles = e->bonded_nr_handles[kind];
+        for ( hid = 0 ; hid < nr_handles ; hid += 3 )
+            testsys_check( engine_bonded_remove( e , kind , hid ) );
+    }
+    for ( pid = 0 ; pid < share_n * share_n * share_n ; pid += 5 )
+        testsys_check( engine_bond_add( e , pid , ( pid + share_n ) % ( share_n * share_n * share_n ) ) );
+
+    return 0;
+
+}
+
+
+/**
+ * @brief Take some steps and compare the forces to the reference.
+ *
+ * @param flags The #engine flags.
+ * @param f_ref An array for the reference forces.
+ * @param f An array for the forces.
+ */
+
+static int share_run ( unsigned int flags , double *f_ref , double *f ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = share_n * share_n * share_n, step, bad = 0;
+    double epot_ref, epot;
+    char what[100];
+
+    testsys_check( testsys_init( e , flags , share_n , testsys_width , testsys_cutoff ) );
+    testsys_check( testsys_bonded( e , share_n , 0 ) );
+    testsys_check( engine_start( e , share_runners , share_runners ) );
+
+    for ( step = 0 ; step < share_steps ; step++ ) {
+
+        /* Change the topology half-way, the lists stay sorted and shared. */
+        if ( step == share_steps / 2 ) {
+            if ( share_edit( e ) != 0 )
+                return 1;
+            if ( !e->bonded_sorted || !e->bonded_split ) {
+                printf( "bondshare: editing the topology dropped the split.\n" );
+                bad += 1;
+            }
+        }
+
+        if ( step == 0 || step == share_steps / 2 || step == share_steps - 1 ) {
+            bzero( f_ref , sizeof(double) * 3 * nr_parts );
+            epot_ref = 0.0;
+            testsys_bonded_brute( e , f_ref , &epot_ref );
+        }
+
+        testsys_check( engine_step( e ) );
+
+        if ( step == 0 || step == share_steps / 2 || step == share_steps - 1 ) {
+            testsys_forces( e , f );
+            epot = e->s.epot;
+            snprintf( what , sizeof(what) , "%s forces at step %i" , ( flags & engine_flag_sets ) ? "sets" : "parbonded" , step );
+            bad += testsys_compare( what , f_ref , f , 3 * nr_parts , 1.0e-4 );
+            snprintf( what , sizeof(what) , "%s energy at step %i" , ( flags & engine_flag_sets ) ? "sets" : "parbonded" , step );
+            bad += testsys_compare( what , &epot_ref , &epot , 1 , 1.0e-4 );
+        }
+
+    }
+
+    /* Did the runners share the work? */
+    if ( e->bonded_nr_shares != share_runners || !e->bonded_split ) {
+        printf( "bondshare: the interactions were not shared between the runners.\n" );
+        bad += 1;
+    }
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    int nr_parts = share_n * share_n * share_n, bad = 0;
+    double *f_ref, *f;
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    bad += share_run( engine_flag_parbonded , f_ref , f );
+    bad += share_run( engine_flag_sets , f_ref , f );
+
+    free( f_ref ); free( f );
+    return bad != 0;
+
+}
@@ -0,0 +1,110 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the batched AVX2 and AVX-512 kernels of the bonds, angles and
+   dihedrals against the scalar kernels and the formulas of the
+   potentials, both updating the particles directly and through the
+   force buffers of the runners' shares, and that engine_flag_simd picks
+   the widest flavour the CPU supports. Flavours the CPU does not
+   support are skipped. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/* Particles per box side. */
+#define bondsimd_n                       14
+
+
+/**
+ * @brief Run one step with the given bonded kernels and collect the
+ *      forces and energy.
+ *
+ * @param flags The #engine flags.
+ * @param simd The bonded kernels to use, see #runner_simd_detect.
+ * @param nr_runners The number of runners.
+ * @param f An array for the forces.
+ * @param epot Where to store the potential energy.
+ */
+
+static int bondsimd_step ( unsigned int flags , int simd , int nr_runners , double *f , double *epot ) {
+
+    struct engine *e = &_Engine;
+
+    testsys_check( testsys_init( e , flags , bondsimd_n , testsys_width , testsys_cutoff ) );
+    testsys_check( testsys_bonded( e , bondsimd_n , 0 ) );
+    testsys_check( engine_start( e , nr_runners , nr_runners ) );
+    if ( e->bonded_simd != ( ( flags & engine_flag_simd ) ? runner_simd_detect() : runner_simd_none ) ) {
+        printf( "bondsimd: engine_start picked the bonded kernels %i.\n" , e->bonded_simd );
+        return 1;
+    }
+    e->bonded_simd = simd;
+    testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    *epot = e->s.epot;
+    testsys_check( engine_finalize( e ) );
+
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    const char *names[] = { "scalar" , "avx2" , "avx512" };
+    int nr_parts = bondsimd_n * bondsimd_n * bondsimd_n, simd, shared, bad = 0;
+    double *f_ref, *f_scalar, *f_simd, epot_ref = 0.0, epot_scalar, epot_simd;
+    char what[100];
+
+    f_ref = (double *)calloc( 3 * nr_parts , sizeof(double) );
+    f_scalar = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_simd = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* The formulas. */
+    testsys_check( testsys_init( e , engine_flag_none , bondsimd_n , testsys_width , testsys_cutoff ) );
+    testsys_check( testsys_bonded( e , bondsimd_n , 0 ) );
+    testsys_bonded_brute( e , f_ref , &epot_ref );
+    testsys_check( engine_finalize( e ) );
+
+    for ( shared = 0 ; shared < 2 ; shared++ ) {
+
+        if ( bondsimd_step( shared ? engine_flag_parbonded : engine_flag_none , runner_simd_none , shared ? 4 : 1 , f_scalar , &epot_scalar ) != 0 )
+            return 1;
+        snprintf( what , sizeof(what) , "scalar%s forces" , shared ? " shared" : "" );
+        bad += testsys_compare( what , f_ref , f_scalar , 3 * nr_parts , 1.0e-4 );
+
+        for ( simd = runner_simd_avx2 ; simd <= runner_simd_detect() ; simd++ ) {
+            if ( bondsimd_step( engine_flag_simd | ( shared ? engine_flag_parbonded : 0 ) , simd , shared ? 4 : 1 , f_simd , &epot_simd ) != 0 )
+                return 1;
+            snprintf( what , sizeof(what) , "%s%s forces" , names[simd] , shared ? " shared" : "" );
+            bad += testsys_compare( what , f_ref , f_simd , 3 * nr_parts , 1.0e-4 );
+            snprintf( what , sizeof(what) , "%s%s forces vs scalar" , names[simd] , shared ? " shared" : "" );
+            bad += testsys_compare( what , f_scalar , f_simd , 3 * nr_parts , 1.0e-5 );
+            snprintf( what , sizeof(what) , "%s%s energy" , names[simd] , shared ? " shared" : "" );
+            bad += testsys_compare( what , &epot_ref , &epot_simd , 1 , 1.0e-4 );
+        }
+
+    }
+
+    free( f_ref ); free( f_scalar ); free( f_simd );
+    return bad != 0;
+
+}
@@ -0,0 +1,228 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the on-disk potential table cache: a table stored and loaded
+   back is the same as a freshly fitted one and is really read from the
+   file, a damaged cache file is refitted, and a large table, fitted on
+   several threads, matches the potential to its tolerance. Tables
+   created in a batch stay pending until potential_batch_end fits them
+   together, or potential_build fits one of them, and are then the same
+   as those created one at a time, also when stored in the cache. */
+
+#include <unistd.h>
+#include <dirent.h>
+#include "testsys.h"
+
+
+/* Compare two tables entry by entry. */
+static int cache_same ( const char *what , struct MxPotential *p , struct MxPotential *q ) {
+
+    if ( p == NULL || q == NULL ) {
+        errs_dump( stdout );
+        return 1;
+    }
+    if ( p->n != q->n || p->a != q->a || p->b != q->b ||
+         memcmp( p->alpha , q->alpha , sizeof(p->alpha) ) != 0 ||
+         memcmp( p->c , q->c , sizeof(FPTYPE) * ( p->n + 1 ) * potential_chunk ) != 0 ) {
+        printf( "cache: the %s table differs.\n" , what );
+        return 1;
+    }
+    return 0;
+
+}
+
+
+/* Find the cache file, return the number of files. */
+static int cache_files ( const char *dir , char *path , size_t size ) {
+
+    DIR *d;
+    struct dirent *de;
+    int count = 0;
+
+    if ( ( d = opendir( dir ) ) == NULL )
+        return -1;
+    while ( ( de = readdir( d ) ) != NULL )
+        if ( de->d_name[0] != '.' ) {
+            snprintf( path , size , "%s/%s" , dir , de->d_name );
+            count += 1;
+        }
+    closedir( d );
+    return count;
+
+}
+
+
+/* Number of tables in the batch. */
+#define cache_batch                      12
+
+
+/* Create the i-th table of a batch, of different forms. */
+static struct MxPotential *cache_create ( int i ) {
+
+    double s = 1.0 + 0.05 * i;
+
+    switch ( i % 3 ) {
+        case 0: return potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 * s , 6.1545e-03 * s , 1.0e-3 );
+        case 1: return potential_create_LJ126_Ewald( 0.275 , 1.0 , 9.5075e-06 * s , 6.1545e-03 , 0.4 * s , 3.0 , 1.0e-3 );
+        default: return potential_create_Coulomb( 0.1 , 1.0 , 0.4 * s , 1.0e-3 );
+    }
+
+}
+
+
+/* Create a batch of tables, check they are pending and compare them
+   to the references once fitted. */
+static int cache_batch_check ( struct MxPotential **p_ref , const char *dir ) {
+
+    struct MxPotential *p[cache_batch], *p_one;
+    char path[1024];
+    int i, bad = 0;
+
+    setenv( potential_cache_env , dir , 1 );
+    testsys_check( potential_batch_begin() );
+    for ( i = 0 ; i < cache_batch ; i++ ) {
+        if ( ( p[i] = cache_create( i ) ) == NULL ) {
+            errs_dump( stdout );
+            return 1;
+        }
+        if ( !( p[i]->flags & potential_flag_pending ) || p[i]->c != NULL ||
+             p[i]->a != p_ref[i]->a || p[i]->b != p_ref[i]->b ) {
+            printf( "cache: table %i of the batch is not pending.\n" , i );
+            bad += 1;
+        }
+    }
+
+    /* Fit one of them on its own. */
+    p_one = p[cache_batch/2];
+    testsys_check( potential_build( p_one ) );
+    if ( p_one->flags & potential_flag_pending )
+        bad += 1;
+    bad += cache_same( "built" , p_ref[cache_batch/2] , p_one );
+
+    /* Fit the rest together. */
+    testsys_check( potential_batch_end() );
+    for ( i = 0 ; i < cache_batch ; i++ ) {
+        if ( p[i]->flags & potential_flag_pending )
+            bad += 1;
+        bad += cache_same( "batched" , p_ref[i] , p[i] );
+    }
+
+    /* Creating tables after the batch fits them right away. */
+    if ( ( p_one = cache_create( 0 ) ) == NULL || p_one->flags & potential_flag_pending )
+        bad += 1;
+    else
+        bad += cache_same( "unbatched" , p_ref[0] , p_one );
+
+    /* Every table of the batch went to the cache. */
+    if ( strcmp( dir , "off" ) != 0 && cache_files( dir , path , sizeof(path) ) != cache_batch ) {
+        printf( "cache: expected %i tables in %s.\n" , cache_batch , dir );
+        bad += 1;
+    }
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    char dir[] = "mdcore_cache_XXXXXX", path[1024];
+    struct MxPotential *p_ref, *p_stored, *p_loaded, *p_damaged, *p_batch[cache_batch];
+    double r, err, emax;
+    FPTYPE ee, ff, mark = 12345.0;
+    FILE *file;
+    int i, bad = 0;
+
+    if ( mkdtemp( dir ) == NULL ) {
+        printf( "cache: could not create a cache directory.\n" );
+        return 1;
+    }
+
+    /* The reference, without the cache. */
+    setenv( potential_cache_env , "off" , 1 );
+    p_ref = potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 , 6.1545e-03 , 1.0e-3 );
+
+    /* Store it and read it back. */
+    setenv( potential_cache_env , dir , 1 );
+    p_stored = potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 , 6.1545e-03 , 1.0e-3 );
+    if ( cache_files( dir , path , sizeof(path) ) != 1 ) {
+        printf( "cache: expected one table in %s.\n" , dir );
+        bad += 1;
+    }
+    p_loaded = potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 , 6.1545e-03 , 1.0e-3 );
+    bad += cache_same( "stored" , p_ref , p_stored );
+    bad += cache_same( "loaded" , p_ref , p_loaded );
+
+    /* Mark the last coefficient in the file, to see that it is read. */
+    if ( ( file = fopen( path , "r+b" ) ) == NULL ||
+         fseek( file , -(long)sizeof(FPTYPE) , SEEK_END ) != 0 ||
+         fwrite( &mark , sizeof(FPTYPE) , 1 , file ) != 1 ||
+         fclose( file ) != 0 )
+        bad += 1;
+    p_loaded = potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 , 6.1545e-03 , 1.0e-3 );
+    if ( p_loaded == NULL || p_loaded->c[ ( p_loaded->n + 1 ) * potential_chunk - 1 ] != mark ) {
+        printf( "cache: the table was not read from the cache.\n" );
+        bad += 1;
+    }
+
+    /* Cut the file short, the table must be fitted again. */
+    if ( truncate( path , 100 ) != 0 )
+        bad += 1;
+    p_damaged = potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 , 6.1545e-03 , 1.0e-3 );
+    bad += cache_same( "refitted" , p_ref , p_damaged );
+
+    /* Clean up. */
+    if ( cache_files( dir , path , sizeof(path) ) == 1 )
+        remove( path );
+
+    /* A batch of tables, without and with the cache. */
+    setenv( potential_cache_env , "off" , 1 );
+    for ( i = 0 ; i < cache_batch ; i++ )
+        if ( ( p_batch[i] = cache_create( i ) ) == NULL ) {
+            errs_dump( stdout );
+            return 1;
+        }
+    bad += cache_batch_check( p_batch , "off" );
+    bad += cache_batch_check( p_batch , dir );
+    bad += cache_batch_check( p_batch , dir );
+    while ( cache_files( dir , path , sizeof(path) ) > 0 )
+        remove( path );
+    rmdir( dir );
+
+    /* A table with many intervals, which is fitted in parallel. */
+    setenv( potential_cache_env , "off" , 1 );
+    if ( ( p_ref = potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 , 6.1545e-03 , 1.0e-5 ) ) == NULL ) {
+        errs_dump( stdout );
+        return 1;
+    }
+    for ( err = emax = 0.0 , i = 0 ; i < 10000 ; i++ ) {
+        r = 0.275 + 0.725 * ( i + 0.5 ) / 10000;
+        potential_eval( p_ref , r*r , &ee , &ff );
+        err = fmax( err , fabs( ee - potential_LJ126( r , 9.5075e-06 , 6.1545e-03 ) ) );
+        emax = fmax( emax , fabs( potential_LJ126( r , 9.5075e-06 , 6.1545e-03 ) ) );
+    }
+    printf( "cache: %i intervals, max. relative error %e.\n" , p_ref->n , err / emax );
+    if ( p_ref->n < potential_parallel_min || err > 1.0e-5 * emax )
+        bad += 1;
+
+    printf( "cache: %i bad results.\n" , bad );
+    return bad != 0;
+
+}
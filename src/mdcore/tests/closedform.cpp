@@ -0,0 +1,126 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the closed-form potentials: potential_eval_kind against the
+   plain formulas and against the interpolated tables, and the forces and
+   energy of a step with the closed-form LJ kernels against a sum over all
+   pairs in double precision. */
+
+#include "testsys.h"
+
+
+/**
+ * @brief Compare the closed form of a potential to a reference and to
+ *      its table over @f$[a,b]@f$.
+ *
+ * @param name A name for the output.
+ * @param p The #potential, of kind @c kind.
+ * @param ref The energy and its derivative.
+ */
+
+template <int kind> static int closed_check ( const char *name , struct MxPotential *p ,
+        void (*ref)( double r , double *v , double *dv ) ) {
+
+    double r, v, dv, emax = 0.0, fmax_ = 0.0, err[4] = { 0.0 , 0.0 , 0.0 , 0.0 };
+    FPTYPE ee, ff, te, tf;
+    int i, bad = 0;
+
+    if ( p == NULL ) {
+        errs_dump( stdout );
+        return 1;
+    }
+    if ( p->kind != kind ) {
+        printf( "closedform: %s has kind %i instead of %i.\n" , name , p->kind , kind );
+        return 1;
+    }
+
+    for ( i = 0 ; i < 1000 ; i++ ) {
+        r = p->a + ( p->b - p->a ) * ( i + 0.5 ) / 1000;
+        ref( r , &v , &dv );
+        potential_eval_kind<kind>( p , r*r , &ee , &ff );
+        potential_eval_kind<potential_kind_table>( p , r*r , &te , &tf );
+        emax = fmax( emax , fabs( v ) );
+        fmax_ = fmax( fmax_ , fabs( dv ) );
+        err[0] = fmax( err[0] , fabs( ee - v ) );
+        err[1] = fmax( err[1] , fabs( ff * r - dv ) );
+        err[2] = fmax( err[2] , fabs( te - ee ) );
+        err[3] = fmax( err[3] , fabs( ( tf - ff ) * r ) );
+    }
+    printf( "closedform: %s energy/force error %e %e, table difference %e %e (relative).\n" , name ,
+        err[0] / emax , err[1] / fmax_ , err[2] / emax , err[3] / fmax_ );
+
+    /* The closed form should be exact up to round-off, the tables up to
+       their fit. */
+    if ( err[0] > 1.0e-5 * emax || err[1] > 1.0e-5 * fmax_ )
+        bad += 1;
+    if ( err[2] > 1.0e-3 * emax || err[3] > 1.0e-2 * fmax_ )
+        bad += 1;
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    double *f_ref, *f_closed, epot_ref, epot_closed;
+    int nr_parts, bad = 0;
+
+    /* Single potentials. */
+    bad += closed_check<potential_kind_LJ126>( "LJ126" ,
+        potential_create_LJ126( 0.275 , 1.0 , 9.5075e-06 , 6.1545e-03 , 1.0e-4 ) ,
+        []( double r , double *v , double *dv ) {
+            *v = potential_LJ126( r , 9.5075e-06 , 6.1545e-03 );
+            *dv = potential_LJ126_p( r , 9.5075e-06 , 6.1545e-03 ); } );
+    bad += closed_check<potential_kind_Coulomb>( "Coulomb" ,
+        potential_create_Coulomb( 0.1 , 1.0 , 0.5 , 1.0e-4 ) ,
+        []( double r , double *v , double *dv ) {
+            *v = potential_escale * 0.5 * ( 1.0 / r - 1.0 );
+            *dv = -potential_escale * 0.5 / ( r * r ); } );
+    bad += closed_check<potential_kind_harmonic>( "harmonic" ,
+        potential_create_harmonic( 0.1 , 1.0 , 3.0 , 0.6 , 1.0e-4 ) ,
+        []( double r , double *v , double *dv ) {
+            *v = 3.0 * ( r - 0.6 ) * ( r - 0.6 );
+            *dv = 6.0 * ( r - 0.6 ); } );
+
+    /* The pair kernels with the closed form, against all pairs. */
+    testsys_check( testsys_init( e , engine_flag_none , 14 , testsys_width , testsys_cutoff ) );
+    if ( e->pot_kind != potential_kind_LJ126 ) {
+        printf( "closedform: the engine does not use the LJ closed form.\n" );
+        return 1;
+    }
+    nr_parts = e->s.nr_parts;
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_closed = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    testsys_brute( e , f_ref , &epot_ref , 1 );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    testsys_check( engine_step( e ) );
+    testsys_forces( e , f_closed );
+    epot_closed = e->s.epot;
+    testsys_check( engine_finalize( e ) );
+
+    bad += testsys_compare( "closed-form forces" , f_ref , f_closed , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "closed-form energy" , &epot_ref , &epot_closed , 1 , 1.0e-4 );
+
+    free( f_ref ); free( f_closed );
+    return bad != 0;
+
+}
@@ -0,0 +1,161 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the cluster-pair tiles (engine_flag_cluster) against the
+   cell-pair kernels, for both cluster sizes and for the scalar and SIMD
+   tiles, over enough steps for the clusters to be re-formed, and that
+   the clusters of each cell hold each of its particles once, within
+   half the skin of the bounding box they were formed with. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/* Number of steps, and the skin, small enough for a few rebuilds. */
+#define nr_steps                         100
+#define cluster_skin                     0.05
+
+
+/**
+ * @brief Check the clusters of the real cells.
+ *
+ * @param e The #engine.
+ * @param size The number of particles per cluster.
+ *
+ * @return The number of cells with bad clusters.
+ */
+
+static int cluster_check ( struct engine *e , int size ) {
+
+    struct space *s = &e->s;
+    struct space_cell *c;
+    int cid, k, m, d, pid, *seen, bad = 0;
+
+    for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+        c = &s->cells[ s->cid_real[cid] ];
+        if ( c->clu_size != size || c->nr_clusters != ( c->clu_nparts + size - 1 ) / size ) {
+            bad += 1;
+            continue;
+        }
+        seen = (int *)calloc( c->clu_nparts + 1 , sizeof(int) );
+        for ( k = 0 ; k < c->nr_clusters ; k++ )
+            for ( m = 0 ; m < size ; m++ ) {
+                if ( ( pid = c->clu_pid[ k*size + m ] ) < 0 )
+                    continue;
+                seen[ ( pid < c->clu_nparts ) ? pid : c->clu_nparts ] += 1;
+                for ( d = 0 ; d < 3 ; d++ )
+                    if ( c->clu_x[ (3*k + d)*size + m ] < c->clu_bb[ 6*k + d ] - 0.5 * cluster_skin ||
+                         c->clu_x[ (3*k + d)*size + m ] > c->clu_bb[ 6*k + 3 + d ] + 0.5 * cluster_skin )
+                        seen[ c->clu_nparts ] += 1;
+            }
+        for ( pid = 0 ; pid < c->clu_nparts && seen[pid] == 1 ; pid++ );
+        bad += ( pid < c->clu_nparts || seen[ c->clu_nparts ] != 0 );
+        free( seen );
+    }
+
+    return bad;
+
+}
+
+
+/**
+ * @brief Take a few steps and collect the last forces, the positions
+ *      and the energy.
+ *
+ * @param flags The #engine flags.
+ * @param size The number of particles per cluster.
+ * @param simd The tile kernels to use, see #runner_simd_detect.
+ * @param f An array for the forces.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int cluster_run ( unsigned int flags , int size , int simd , double *f , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    int k, nr_rebuilds;
+    long nr_entries;
+
+    /* Cells wide enough for the cutoff and the default skin. */
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , 1.2 * testsys_cutoff ) );
+    if ( flags & engine_flag_cluster ) {
+        testsys_check( engine_verlet_setskin( e , cluster_skin ) );
+        testsys_check( engine_cluster_setsize( e , size ) );
+    }
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < e->nr_runners ; k++ )
+        e->runners[k].simd = simd;
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    testsys_positions( e , x );
+    *epot = e->s.epot;
+
+    if ( flags & engine_flag_cluster ) {
+        testsys_check( engine_verlet_stats( e , &nr_rebuilds , NULL , NULL , &nr_entries ) );
+        printf( "cluster: %i rebuilds, %li cluster pairs.\n" , nr_rebuilds , nr_entries );
+        if ( nr_rebuilds < 2 || nr_entries <= 0 ) {
+            printf( "cluster: the clusters were not re-formed.\n" );
+            return 1;
+        }
+        if ( ( k = cluster_check( e , size ) ) != 0 ) {
+            printf( "cluster: %i cells with bad %ix%i clusters.\n" , k , size , size );
+            return 1;
+        }
+    }
+    testsys_check( engine_finalize( e ) );
+
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    const char *names[] = { "scalar" , "avx2" , "avx512" };
+    int nr_parts = 14*14*14, size, simd, bad = 0;
+    double *f_ref, *f_clu, *x_ref, *x_clu, epot_ref, epot_clu;
+    char what[100];
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_clu = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_clu = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    if ( cluster_run( engine_flag_none , 0 , runner_simd_none , f_ref , x_ref , &epot_ref ) != 0 )
+        return 1;
+
+    for ( size = 4 ; size <= 8 ; size += 4 )
+        for ( simd = runner_simd_none ; simd <= runner_simd_detect() ; simd++ ) {
+            if ( cluster_run( engine_flag_cluster , size , simd , f_clu , x_clu , &epot_clu ) != 0 )
+                return 1;
+            snprintf( what , sizeof(what) , "%s %ix%i forces" , names[simd] , size , size );
+            bad += testsys_compare( what , f_ref , f_clu , 3 * nr_parts , 1.0e-4 );
+            testsys_image( x_ref , x_clu , nr_parts , testsys_width );
+            snprintf( what , sizeof(what) , "%s %ix%i positions" , names[simd] , size , size );
+            bad += testsys_compare( what , x_ref , x_clu , 3 * nr_parts , 1.0e-5 );
+            snprintf( what , sizeof(what) , "%s %ix%i energy" , names[simd] , size , size );
+            bad += testsys_compare( what , &epot_ref , &epot_clu , 1 , 1.0e-4 );
+        }
+
+    free( f_ref ); free( f_clu ); free( x_ref ); free( x_clu );
+    return bad != 0;
+
+}
@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the work-stealing deques: LIFO pops and FIFO steals, that every
+   task is taken exactly once when thieves race the owner, and that the
+   forces of a step on runners stealing each other's tasks match a sum
+   over all pairs. */
+
+#include <pthread.h>
+#include "testsys.h"
+#include "deque.h"
+
+
+/* Number of tasks and thieves in the race. */
+#define nr_tasks                         100000
+#define nr_thieves                       3
+
+
+/* The shared state of the race. */
+static struct deque dq;
+static struct task tasks[ nr_tasks ];
+static int taken[ nr_tasks ];
+static volatile int done = 0;
+
+
+/* Steal tasks until the owner is done. */
+static void *thief ( void *data ) {
+
+    struct task *t;
+
+    while ( !__atomic_load_n( &done , __ATOMIC_ACQUIRE ) )
+        if ( ( t = deque_steal( &dq ) ) != NULL )
+            __atomic_add_fetch( &taken[ t - tasks ] , 1 , __ATOMIC_RELAXED );
+
+    return NULL;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    pthread_t thieves[ nr_thieves ];
+    struct task *t;
+    double *f_ref, *f_dq, epot_ref, epot_dq;
+    int k, next, nr_parts, bad = 0;
+
+    /* Sequential order and capacity. */
+    if ( deque_init( &dq , 16 ) != deque_err_ok ) {
+        errs_dump( stdout );
+        return 1;
+    }
+    for ( k = 0 ; k < 16 ; k++ )
+        if ( !deque_push( &dq , &tasks[k] ) )
+            bad += 1;
+    if ( deque_push( &dq , &tasks[16] ) )
+        bad += 1;
+    if ( deque_pop( &dq ) != &tasks[15] || deque_steal( &dq ) != &tasks[0] )
+        bad += 1;
+    for ( k = 1 ; k < 15 ; k++ )
+        if ( deque_steal( &dq ) != &tasks[k] )
+            bad += 1;
+    if ( deque_pop( &dq ) != NULL || deque_steal( &dq ) != NULL )
+        bad += 1;
+    deque_free( &dq );
+    printf( "deque: %i bad results in the sequential checks.\n" , bad );
+
+    /* Race the thieves, pushing in bursts and popping some back. */
+    if ( deque_init( &dq , 256 ) != deque_err_ok ) {
+        errs_dump( stdout );
+        return 1;
+    }
+    for ( k = 0 ; k < nr_thieves ; k++ )
+        if ( pthread_create( &thieves[k] , NULL , thief , NULL ) != 0 )
+            return 1;
+    for ( next = 0 ; next < nr_tasks ; ) {
+        while ( next < nr_tasks && deque_push( &dq , &tasks[next] ) )
+            next += 1;
+        for ( k = 0 ; k < 64 && ( t = deque_pop( &dq ) ) != NULL ; k++ )
+            __atomic_add_fetch( &taken[ t - tasks ] , 1 , __ATOMIC_RELAXED );
+    }
+    while ( ( t = deque_pop( &dq ) ) != NULL )
+        __atomic_add_fetch( &taken[ t - tasks ] , 1 , __ATOMIC_RELAXED );
+    __atomic_store_n( &done , 1 , __ATOMIC_RELEASE );
+    for ( k = 0 ; k < nr_thieves ; k++ )
+        pthread_join( thieves[k] , NULL );
+    deque_free( &dq );
+    for ( next = 0 , k = 0 ; k < nr_tasks ; k++ )
+        if ( taken[k] != 1 )
+            next += 1;
+    printf( "deque: %i of %i tasks not taken exactly once.\n" , next , nr_tasks );
+    bad += next;
+
+    /* Several runners stealing from each other, against all pairs. */
+    testsys_check( testsys_init( e , engine_flag_none , 14 , testsys_width , testsys_cutoff ) );
+    nr_parts = e->s.nr_parts;
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_dq = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    testsys_brute( e , f_ref , &epot_ref , 1 );
+    testsys_check( engine_start( e , 4 , 4 ) );
+    testsys_check( engine_step( e ) );
+    testsys_forces( e , f_dq );
+    epot_dq = e->s.epot;
+    testsys_check( engine_finalize( e ) );
+
+    bad += testsys_compare( "4 runners forces" , f_ref , f_dq , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "4 runners energy" , &epot_ref , &epot_dq , 1 , 1.0e-4 );
+
+    free( f_ref ); free( f_dq );
+    return bad != 0;
+
+}
@@ -0,0 +1,55 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the forces of the sorted scalar cell-pair kernel (runner_dopair)
+   against a sum over all pairs. A wrong sign on either side of the pairs
+   across cells shows up in the forces, not in the energy. */
+
+#include "testsys.h"
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    double *f_ref, *f, epot_ref, epot;
+    int nr_parts, bad = 0;
+
+    testsys_check( testsys_init( e , engine_flag_none , 14 , testsys_width , testsys_cutoff ) );
+    nr_parts = e->s.nr_parts;
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* The reference at the initial positions. */
+    testsys_brute( e , f_ref , &epot_ref , 1 );
+
+    /* One step with the default kernels. */
+    testsys_check( engine_start( e , 2 , 2 ) );
+    testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    epot = e->s.epot;
+    testsys_check( engine_finalize( e ) );
+
+    bad += testsys_compare( "dopair forces" , f_ref , f , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "dopair energy" , &epot_ref , &epot , 1 , 1.0e-4 );
+
+    free( f_ref ); free( f );
+    return bad != 0;
+
+}
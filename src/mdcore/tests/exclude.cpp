@@ -0,0 +1,282 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks that the non-bonded kernels skip the excluded pairs: the forces
+   and energy of each flavour of the kernels, with exclusions added both
+   before the first step and between steps, against a sum over all pairs
+   without the excluded ones. Also checks that the reciprocal-space part
+   of SPME takes out the smooth part erf(kappa*r)/r of the excluded pairs. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/* Particles per box side and skin of the neighbour lists. */
+#define exclude_n                        14
+#define exclude_skin                     0.05
+
+/* Splitting parameter of the SPME check. */
+#define exclude_kappa                    2.5
+
+
+/** A flavour of the non-bonded kernels. */
+struct exclude_kernel {
+    const char *name;
+    unsigned int flags;
+    int size, simd;
+};
+
+static const struct exclude_kernel exclude_kernels[] = {
+    { "cell-pair" , engine_flag_none , 0 , runner_simd_none } ,
+    { "unsorted" , engine_flag_unsorted , 0 , runner_simd_none } ,
+    { "soa" , engine_flag_soa , 0 , runner_simd_none } ,
+    { "avx2" , engine_flag_simd , 0 , runner_simd_avx2 } ,
+    { "avx512" , engine_flag_simd , 0 , runner_simd_avx512 } ,
+    { "nolock" , engine_flag_nolock , 0 , runner_simd_none } ,
+    { "verlet list" , engine_flag_verlet_list , 0 , runner_simd_none } ,
+    { "cluster 4" , engine_flag_cluster , 4 , runner_simd_none } ,
+    { "cluster 8" , engine_flag_cluster , 8 , runner_simd_none } ,
+    { "cluster 8 avx2" , engine_flag_cluster , 8 , runner_simd_avx2 } ,
+    { "cluster 8 avx512" , engine_flag_cluster , 8 , runner_simd_avx512 } ,
+    };
+
+
+/**
+ * @brief Add exclusions and remember them.
+ *
+ * @param e The #engine.
+ * @param later Add the ones for between the steps: each third particle
+ *      with its neighbour along @c y. Otherwise each particle with its
+ *      neighbours along @c x and along the diagonal of @c x and @c y.
+ * @param pairs An array in which to append the pairs.
+ * @param nr_pairs The number of pairs in @c pairs.
+ *
+ * All the pairs are within the cutoff and none are repeated.
+ */
+
+static int exclude_add ( struct engine *e , int later , int *pairs , int *nr_pairs ) {
+
+    int n = exclude_n, pid, a, b, c, pjd[2], k;
+
+    for ( pid = 0 ; pid < n*n*n ; pid++ ) {
+        a = pid % n; b = ( pid / n ) % n; c = pid / n / n;
+        if ( later ) {
+            if ( pid % 3 != 0 )
+                continue;
+            pjd[0] = a + n * ( ( b + 1 ) % n + n * c );
+            pjd[1] = -1;
+        }
+        else {
+            pjd[0] = ( a + 1 ) % n + n * ( b + n * c );
+            pjd[1] = ( a + 1 ) % n + n * ( ( b + 1 ) % n + n * c );
+        }
+        for ( k = 0 ; k < 2 && pjd[k] >= 0 ; k++ ) {
+            testsys_check( engine_exclusion_add( e , pid , pjd[k] ) );
+            pairs[ 2*(*nr_pairs) ] = pid;
+            pairs[ 2*(*nr_pairs) + 1 ] = pjd[k];
+            *nr_pairs += 1;
+        }
+    }
+
+    return 0;
+
+}
+
+
+/**
+ * @brief The forces and energy over all pairs but the excluded ones.
+ *
+ * @param e The #engine.
+ * @param pairs The excluded pairs.
+ * @param nr_pairs The number of excluded pairs.
+ * @param f An array for the forces.
+ * @param epot Where to store the potential energy.
+ *
+ * Sums over all pairs with #testsys_brute and takes out the excluded
+ * ones in double precision.
+ */
+
+static void exclude_brute ( struct engine *e , const int *pairs , int nr_pairs , double *f , double *epot ) {
+
+    int i, j, k, l;
+    double *x = (double *)malloc( sizeof(double) * 3 * e->s.nr_parts ), dx[3], r2, r, w;
+    struct MxPotential *pot;
+
+    testsys_brute( e , f , epot , 1 );
+    testsys_positions( e , x );
+    for ( l = 0 ; l < nr_pairs ; l++ ) {
+        i = pairs[2*l]; j = pairs[2*l+1];
+        pot = e->p[ e->s.partlist[i]->typeId * e->max_type + e->s.partlist[j]->typeId ];
+        for ( r2 = 0.0 , k = 0 ; k < 3 ; k++ ) {
+            dx[k] = x[ 3*i + k ] - x[ 3*j + k ];
+            dx[k] -= e->s.dim[k] * round( dx[k] / e->s.dim[k] );
+            r2 += dx[k] * dx[k];
+        }
+        if ( pot == NULL || r2 >= e->s.cutoff * e->s.cutoff || r2 >= pot->b * pot->b )
+            continue;
+        r = sqrt( r2 );
+        *epot -= potential_LJ126( r , pot->params[0] , pot->params[1] );
+        w = potential_LJ126_p( r , pot->params[0] , pot->params[1] ) / r;
+        for ( k = 0 ; k < 3 ; k++ ) {
+            f[ 3*i + k ] += w * dx[k];
+            f[ 3*j + k ] -= w * dx[k];
+        }
+    }
+
+    free( x );
+
+}
+
+
+/**
+ * @brief Take two steps with one flavour of the kernels, adding
+ *      exclusions before each, and compare to the reference.
+ *
+ * @param kernel The flavour of the kernels.
+ * @param pairs An array for the excluded pairs.
+ * @param f_ref An array for the reference forces.
+ * @param f An array for the forces.
+ */
+
+static int exclude_run ( const struct exclude_kernel *kernel , int *pairs , double *f_ref , double *f ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = exclude_n * exclude_n * exclude_n, nr_pairs = 0, step, k, bad = 0;
+    double epot_ref, epot;
+    char what[100];
+
+    /* Cells wide enough for the cutoff and the skin. */
+    testsys_check( testsys_init( e , kernel->flags , exclude_n , testsys_width , 1.2 * testsys_cutoff ) );
+    if ( kernel->flags & ( engine_flag_verlet_list | engine_flag_cluster ) )
+        testsys_check( engine_verlet_setskin( e , exclude_skin ) );
+    if ( kernel->flags & engine_flag_cluster )
+        testsys_check( engine_cluster_setsize( e , kernel->size ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < e->nr_runners ; k++ )
+        e->runners[k].simd = kernel->simd;
+
+    for ( step = 0 ; step < 2 ; step++ ) {
+
+        /* The second batch comes after the neighbour lists were built. */
+        if ( exclude_add( e , step , pairs , &nr_pairs ) != 0 )
+            return 1;
+        exclude_brute( e , pairs , nr_pairs , f_ref , &epot_ref );
+        testsys_check( engine_step( e ) );
+        testsys_forces( e , f );
+        epot = e->s.epot;
+
+        snprintf( what , sizeof(what) , "%s forces with %i exclusions" , kernel->name , nr_pairs );
+        bad += testsys_compare( what , f_ref , f , 3 * nr_parts , 1.0e-4 );
+        snprintf( what , sizeof(what) , "%s energy with %i exclusions" , kernel->name , nr_pairs );
+        bad += testsys_compare( what , &epot_ref , &epot , 1 , 1.0e-4 );
+
+    }
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+/**
+ * @brief Take one step with SPME alone and get the forces and energy.
+ *
+ * @param pairs The pairs to exclude, or @c NULL.
+ * @param f An array for the forces.
+ * @param epot Where to store the potential energy.
+ */
+
+static int exclude_spme ( int *pairs , double *f , double *epot ) {
+
+    struct engine *e = &_Engine;
+    int nr_pairs = 0, k;
+
+    testsys_check( testsys_init( e , engine_flag_none , exclude_n , testsys_width , testsys_cutoff ) );
+    for ( k = 0 ; k < e->max_type * e->max_type ; k++ )
+        e->p[k] = NULL;
+    if ( pairs != NULL && exclude_add( e , 0 , pairs , &nr_pairs ) != 0 )
+        return 1;
+    testsys_check( engine_spme_set( e , exclude_kappa , NULL , 6 ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    *epot = e->s.epot;
+    testsys_check( engine_finalize( e ) );
+
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = exclude_n * exclude_n * exclude_n, nr_pairs = 0, i, j, k, l, bad = 0;
+    double *f_ref, *f, *f_none, *x, epot_ref = 0.0, epot, epot_none, dx[3], r2, r, kr, qq, w;
+    int *pairs;
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_none = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    pairs = (int *)malloc( sizeof(int) * 6 * nr_parts );
+
+    /* Each flavour of the kernels the CPU can run. */
+    for ( k = 0 ; k < (int)( sizeof(exclude_kernels) / sizeof(struct exclude_kernel) ) ; k++ )
+        if ( exclude_kernels[k].simd <= runner_simd_detect() )
+            bad += exclude_run( &exclude_kernels[k] , pairs , f_ref , f );
+
+    /* SPME with and without the exclusions differ by the smooth part of
+       the excluded pairs' interaction. */
+    if ( exclude_spme( NULL , f_none , &epot_none ) != 0 ||
+         exclude_spme( pairs , f , &epot ) != 0 )
+        return 1;
+    testsys_check( testsys_init( e , engine_flag_none , exclude_n , testsys_width , testsys_cutoff ) );
+    testsys_positions( e , x );
+    if ( exclude_add( e , 0 , pairs , &nr_pairs ) != 0 )
+        return 1;
+    bzero( f_ref , sizeof(double) * 3 * nr_parts );
+    for ( l = 0 ; l < nr_pairs ; l++ ) {
+        i = pairs[2*l]; j = pairs[2*l+1];
+        for ( r2 = 0.0 , k = 0 ; k < 3 ; k++ ) {
+            dx[k] = x[ 3*i + k ] - x[ 3*j + k ];
+            dx[k] -= e->s.dim[k] * round( dx[k] / e->s.dim[k] );
+            r2 += dx[k] * dx[k];
+        }
+        r = sqrt( r2 ); kr = exclude_kappa * r;
+        qq = potential_escale * e->s.partlist[i]->q * e->s.partlist[j]->q;
+        epot_ref -= qq * erf( kr ) / r;
+        w = qq * ( 2.0 * exclude_kappa / sqrt( M_PI ) * exp( -kr*kr ) - erf( kr ) / r ) / r2;
+        for ( k = 0 ; k < 3 ; k++ ) {
+            f_ref[ 3*i + k ] += w * dx[k];
+            f_ref[ 3*j + k ] -= w * dx[k];
+        }
+    }
+    testsys_check( engine_finalize( e ) );
+    for ( k = 0 ; k < 3*nr_parts ; k++ )
+        f[k] -= f_none[k];
+    epot -= epot_none;
+    bad += testsys_compare( "spme exclusion forces" , f_ref , f , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "spme exclusion energy" , &epot_ref , &epot , 1 , 1.0e-4 );
+
+    free( f_ref ); free( f ); free( f_none ); free( x ); free( pairs );
+    return bad != 0;
+
+}
@@ -0,0 +1,151 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the expression compiler: parsing and evaluation against plain
+   C++, shared sub-expressions and folded constants, symbolic derivatives
+   against finite differences, the chunked
+   evaluation against the single one, parse errors, and a potential built
+   from an expression against the closed-form Lennard-Jones potential. */
+
+#include <stdexcept>
+#include "testsys.h"
+#include "MxExpr.h"
+
+
+/* An expression in x and y and what it should evaluate to. */
+struct expr_case {
+    const char *src;
+    double (*ref)( double x , double y );
+};
+
+static const struct expr_case cases[] = {
+    { "x + 2*y" , []( double x , double y ) { return x + 2*y; } },
+    { "-x^2 + y/3" , []( double x , double y ) { return -x*x + y/3; } },
+    { "x**3 - pow(y, 2)" , []( double x , double y ) { return x*x*x - y*y; } },
+    { "exp(-x) * sin(y)" , []( double x , double y ) { return exp(-x) * sin(y); } },
+    { "sqrt(abs(x)) + cos(x*y)" , []( double x , double y ) { return sqrt(fabs(x)) + cos(x*y); } },
+    { "tanh(x) - log(y)" , []( double x , double y ) { return tanh(x) - log(y); } },
+    { "k * (x - x0) / (1 + 2*3)" , []( double x , double y ) { return 2.5 * ( x - 0.75 ) / 7; } },
+    { "(x - y) * (x - y) / x" , []( double x , double y ) { return ( x - y ) * ( x - y ) / x; } },
+};
+
+static const char *errors[] = { "x +" , "(x" , "foo(x)" , "z" , "x y" , "" };
+
+
+int main ( int argc , char *argv[] ) {
+
+    std::map<std::string, double> consts = { { "k" , 2.5 } , { "x0" , 0.75 } };
+    const int nr_cases = sizeof(cases) / sizeof(struct expr_case);
+    const int nr_errors = sizeof(errors) / sizeof(const char *);
+    const int n = 3 * MXEXPR_CHUNK + 5;
+    const double h = 1.0e-5;
+    double vals[2], lo[2], hi[2], v, fd, dv, r, err_e, err_f, emax, fmax_;
+    FPTYPE x[n], y, out[2][n], ee, ff;
+    const FPTYPE *in[2] = { x , &y };
+    FPTYPE *outs[2] = { out[0] , out[1] };
+    int in_stride[2] = { 1 , 0 };
+    int c, i, k, nodes[2], bad = 0;
+
+    MxExpr expr( { "x" , "y" } , consts );
+
+    /* Values and derivatives. */
+    for ( c = 0 ; c < nr_cases ; c++ ) {
+        nodes[0] = expr.parse( cases[c].src );
+        nodes[1] = expr.derivative( nodes[0] , 0 );
+        if ( expr.parse( cases[c].src ) != nodes[0] ) {
+            printf( "expr: \"%s\" was not shared.\n" , cases[c].src );
+            bad += 1;
+        }
+        for ( i = 0 ; i < 20 ; i++ ) {
+            vals[0] = 0.2 + 0.15 * i; vals[1] = 2.1 - 0.1 * i;
+            v = cases[c].ref( vals[0] , vals[1] );
+            if ( fabs( expr.eval( nodes[0] , vals ) - v ) > 1.0e-12 * ( 1 + fabs( v ) ) ) {
+                printf( "expr: \"%s\" is %e instead of %e.\n" , cases[c].src , expr.eval( nodes[0] , vals ) , v );
+                bad += 1;
+            }
+            lo[0] = vals[0] - h; hi[0] = vals[0] + h; lo[1] = hi[1] = vals[1];
+            fd = ( cases[c].ref( hi[0] , hi[1] ) - cases[c].ref( lo[0] , lo[1] ) ) / ( 2*h );
+            dv = expr.eval( nodes[1] , vals );
+            if ( fabs( dv - fd ) > 1.0e-6 * ( 1 + fabs( fd ) ) ) {
+                printf( "expr: d/dx \"%s\" is %e instead of %e.\n" , cases[c].src , dv , fd );
+                bad += 1;
+            }
+        }
+
+        /* The chunked evaluation adds to what is in the output. */
+        y = 1.3;
+        for ( i = 0 ; i < n ; i++ ) {
+            x[i] = 0.2 + 2.0 * i / n;
+            out[0][i] = out[1][i] = 1.0;
+        }
+        expr.eval_span( n , nodes , 2 , in , in_stride , outs , 1 );
+        for ( i = 0 ; i < n ; i++ ) {
+            vals[0] = x[i]; vals[1] = y;
+            for ( k = 0 ; k < 2 ; k++ ) {
+                v = 1.0 + expr.eval( nodes[k] , vals );
+                if ( fabs( out[k][i] - v ) > 1.0e-5 * ( 1 + fabs( v ) ) ) {
+                    printf( "expr: eval_span of node %i of \"%s\" is %e instead of %e.\n" , k , cases[c].src , out[k][i] , v );
+                    bad += 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Constants are folded and equal sub-expressions shared. */
+    if ( expr.parse( "(6/2 + 4) * x" ) != expr.parse( "7 * x" ) ||
+         expr.parse( "(1 + 2*3) * x + exp(-x)" ) != expr.parse( "7*x + exp(0 - x)" ) ) {
+        printf( "expr: constants were not folded or sub-expressions not shared.\n" );
+        bad += 1;
+    }
+
+    /* Parse errors. */
+    for ( c = 0 ; c < nr_errors ; c++ ) {
+        try {
+            expr.parse( errors[c] );
+            printf( "expr: \"%s\" did not throw.\n" , errors[c] );
+            bad += 1;
+        }
+        catch ( const std::invalid_argument & ) { }
+    }
+    printf( "expr: %i bad results.\n" , bad );
+
+    /* An interpolated Lennard-Jones potential from an expression. */
+    MxExpr lj( { "r" } , { { "A" , 9.5075e-06 } , { "B" , 6.1545e-03 } } );
+    struct MxPotential *pot = potential_create_expression( &lj , lj.parse( "A / r^12 - B / r^6" ) , 0.275 , 1.0 , 1.0e-5 );
+    if ( pot == NULL ) {
+        errs_dump( stdout );
+        return 1;
+    }
+    for ( emax = fmax_ = err_e = err_f = 0.0 , i = 0 ; i < 1000 ; i++ ) {
+        r = 0.28 + 0.72 * i / 1000;
+        potential_eval( pot , r*r , &ee , &ff );
+        emax = fmax( emax , fabs( potential_LJ126( r , 9.5075e-06 , 6.1545e-03 ) ) );
+        fmax_ = fmax( fmax_ , fabs( potential_LJ126_p( r , 9.5075e-06 , 6.1545e-03 ) ) );
+        err_e = fmax( err_e , fabs( ee - potential_LJ126( r , 9.5075e-06 , 6.1545e-03 ) ) );
+        err_f = fmax( err_f , fabs( ff * r - potential_LJ126_p( r , 9.5075e-06 , 6.1545e-03 ) ) );
+    }
+    printf( "expr: potential error %e, force error %e (relative).\n" , err_e / emax , err_f / fmax_ );
+    if ( err_e > 1.0e-3 * emax || err_f > 1.0e-3 * fmax_ )
+        bad += 1;
+
+    return bad != 0;
+
+}
@@ -0,0 +1,106 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the fused integration (engine_flag_fused) against the separate
+   advance pass: the positions and energy after a few steps, over which
+   particles move to other cells, and that the fused tasks leave the
+   forces cleared for the next step. The forces themselves are therefore
+   not compared. */
+
+#include "testsys.h"
+
+
+/* Number of steps, and the velocity scale, enough for particles to
+   change cells. */
+#define nr_steps                         20
+#define fused_vscale                     20.0
+
+
+/**
+ * @brief Take a few steps and collect the positions and energy.
+ *
+ * @param flags The #engine flags.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ * @param moved Where to store the number of particles that changed cells.
+ * @param nr_forces Where to store the number of non-zero forces.
+ */
+
+static int fused_run ( unsigned int flags , double *x , double *epot , int *moved , int *nr_forces ) {
+
+    struct engine *e = &_Engine;
+    struct space_cell **cells;
+    int k, pid;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    if ( ( e->flags & engine_flag_fused ) != ( flags & engine_flag_fused ) ) {
+        printf( "fused: engine_flag_fused was not kept.\n" );
+        return 1;
+    }
+    cells = (struct space_cell **)malloc( sizeof(struct space_cell *) * e->s.nr_parts );
+    for ( pid = 0 ; pid < e->s.nr_parts ; pid++ ) {
+        for ( k = 0 ; k < 3 ; k++ )
+            e->s.partlist[pid]->v[k] *= fused_vscale;
+        cells[pid] = e->s.celllist[pid];
+    }
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_positions( e , x );
+    *epot = e->s.epot;
+    for ( *moved = *nr_forces = 0 , pid = 0 ; pid < e->s.nr_parts ; pid++ ) {
+        *moved += ( e->s.celllist[pid] != cells[pid] );
+        for ( k = 0 ; k < 3 ; k++ )
+            *nr_forces += ( e->s.partlist[pid]->f[k] != 0.0f );
+    }
+    free( cells );
+    testsys_check( engine_finalize( e ) );
+
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    int nr_parts = 14*14*14, moved, nr_forces, bad = 0;
+    double *x_ref, *x_fused, epot_ref, epot_fused;
+
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_fused = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    if ( fused_run( engine_flag_none , x_ref , &epot_ref , &moved , &nr_forces ) != 0 )
+        return 1;
+    if ( nr_forces == 0 ) {
+        printf( "fused: the separate pass left no forces.\n" );
+        bad += 1;
+    }
+    if ( fused_run( engine_flag_fused , x_fused , &epot_fused , &moved , &nr_forces ) != 0 )
+        return 1;
+    printf( "fused: %i particles changed cells, %i non-zero forces left.\n" , moved , nr_forces );
+    bad += ( moved < nr_parts / 8 || nr_forces != 0 );
+
+    bad += testsys_compare( "fused positions" , x_ref , x_fused , 3 * nr_parts , 1.0e-5 );
+    bad += testsys_compare( "fused energy" , &epot_ref , &epot_fused , 1 , 1.0e-4 );
+
+    free( x_ref ); free( x_fused );
+    return bad != 0;
+
+}
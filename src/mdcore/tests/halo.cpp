@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the overlap of the halo exchange with the interior tasks
+   (engine_flag_async with runners) on two or more ranks: the tasks on
+   the ghost cells are held back while the exchange is in flight, and
+   the forces, positions and energy match both the blocking exchange and
+   a run on a single node. */
+
+#include "testsys.h"
+
+
+/* Number of steps. */
+#define nr_steps                         20
+
+
+/**
+ * @brief Take a few steps and collect the last forces, the positions
+ *      and the energy over all nodes.
+ *
+ * @param flags The #engine flags.
+ * @param f An array for the forces.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int halo_run ( unsigned int flags , double *f , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    int nr_nodes, k, nr_held = 0, bad = 0, *count;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    if ( flags & engine_flag_mpi ) {
+        MPI_Comm_size( MPI_COMM_WORLD , &nr_nodes );
+        testsys_check( engine_split_bisect( e , nr_nodes ) );
+        testsys_check( engine_split( e ) );
+    }
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < nr_steps ; k++ ) {
+        testsys_check( engine_step( e ) );
+        nr_held += e->nr_halo;
+    }
+
+    /* Collect the results of all nodes. */
+    if ( flags & engine_flag_mpi ) {
+        count = (int *)malloc( sizeof(int) * e->s.nr_parts );
+        testsys_check( testsys_gather( e , x , f , count ) );
+        for ( k = 0 ; k < e->s.nr_parts ; k++ )
+            if ( count[k] != 1 )
+                bad += 1;
+        free( count );
+        MPI_Allreduce( &e->s.epot , epot , 1 , MPI_DOUBLE , MPI_SUM , MPI_COMM_WORLD );
+    }
+    else {
+        testsys_forces( e , f );
+        testsys_positions( e , x );
+        *epot = e->s.epot;
+    }
+
+    /* Were the ghost tasks held back, and only when overlapping? */
+    printf( "halo[%i]: %i tasks held back over %i steps, %i particles lost or doubled.\n" ,
+        e->nodeID , nr_held , nr_steps , bad );
+    if ( ( nr_held > 0 ) != ( ( flags & engine_flag_async ) != 0 ) )
+        bad += 1;
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    int nr_parts = 14*14*14, nr_nodes, bad = 0;
+    double *f_ref, *f_mpi, *x_ref, *x_mpi, epot_ref, epot_mpi;
+
+    if ( MPI_Init( &argc , &argv ) != MPI_SUCCESS ||
+         MPI_Comm_size( MPI_COMM_WORLD , &nr_nodes ) != MPI_SUCCESS )
+        return 1;
+    if ( nr_nodes < 2 ) {
+        printf( "halo: needs at least two ranks.\n" );
+        MPI_Finalize();
+        return 1;
+    }
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_mpi = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_mpi = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* The reference, on each node by itself. */
+    if ( halo_run( engine_flag_none , f_ref , x_ref , &epot_ref ) != 0 )
+        return 1;
+
+    /* The blocking exchange. */
+    bad += halo_run( engine_flag_mpi , f_mpi , x_mpi , &epot_mpi );
+    bad += testsys_compare( "blocking forces" , f_ref , f_mpi , 3 * nr_parts , 1.0e-4 );
+    testsys_image( x_ref , x_mpi , nr_parts , testsys_width );
+    bad += testsys_compare( "blocking positions" , x_ref , x_mpi , 3 * nr_parts , 1.0e-5 );
+    bad += testsys_compare( "blocking energy" , &epot_ref , &epot_mpi , 1 , 1.0e-4 );
+
+    /* The exchange overlapped with the interior tasks. */
+    bad += halo_run( engine_flag_mpi | engine_flag_async , f_mpi , x_mpi , &epot_mpi );
+    bad += testsys_compare( "overlapped forces" , f_ref , f_mpi , 3 * nr_parts , 1.0e-4 );
+    testsys_image( x_ref , x_mpi , nr_parts , testsys_width );
+    bad += testsys_compare( "overlapped positions" , x_ref , x_mpi , 3 * nr_parts , 1.0e-5 );
+    bad += testsys_compare( "overlapped energy" , &epot_ref , &epot_mpi , 1 , 1.0e-4 );
+
+    /* Fail on all nodes if any one failed. */
+    MPI_Allreduce( MPI_IN_PLACE , &bad , 1 , MPI_INT , MPI_SUM , MPI_COMM_WORLD );
+    free( f_ref ); free( f_mpi ); free( x_ref ); free( x_mpi );
+    MPI_Finalize();
+    return bad != 0;
+
+}
@@ -0,0 +1,251 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the handles of the bonded interactions: interactions added and
+   removed at random between steps, with the lists sorted and shared
+   between the runners, are found at the position engine_bonded_lookup
+   gives, engine_bonded_adjacent lists exactly the interactions of each
+   particle, freed handles are reused, and the forces match the formulas
+   of the potentials for the interactions that are left. */
+
+#include "testsys.h"
+#include "exclusion.h"
+
+
+/* Particles per box side, rounds of edits, and removals and additions
+   per kind and round. */
+#define handles_n                        14
+#define handles_rounds                   5
+#define handles_remove                   300
+#define handles_add                      200
+
+/* Room for the handles of each kind. */
+#define handles_max                      ( 2 * handles_n * handles_n * handles_n )
+
+
+/* What each handle should point to, or -1 if it is free. */
+static int shadow[ engine_bonded_last ][ handles_max ][4];
+static int alive[ engine_bonded_last ][ handles_max ];
+
+
+/**
+ * @brief Add an interaction along the staircase of a particle, see
+ *      #testsys_bonded, and remember it.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction.
+ * @param pid The first particle.
+ *
+ * @return The handle, or < 0 on error.
+ */
+
+static int handles_add_one ( struct engine *e , int kind , int pid ) {
+
+    int n = handles_n, a = pid % n, b = ( pid / n ) % n, c = pid / n / n, ids[4], hid, k;
+
+    ids[0] = pid;
+    ids[1] = ( a + 1 ) % n + n * ( b + n * c );
+    ids[2] = ( a + 1 ) % n + n * ( ( b + 1 ) % n + n * c );
+    ids[3] = ( a + 1 ) % n + n * ( ( b + 1 ) % n + n * ( ( c + 1 ) % n ) );
+    switch ( kind ) {
+        case engine_bonded_exclusion:
+            hid = engine_exclusion_add( e , ids[1] , ids[0] );
+            ids[0] = ( pid < ids[1] ) ? pid : ids[1];
+            ids[1] = ( pid < ids[1] ) ? ids[1] : pid;
+            break;
+        case engine_bonded_bond:
+            hid = engine_bond_add( e , ids[0] , ids[1] );
+            break;
+        case engine_bonded_angle:
+            hid = engine_angle_add( e , ids[0] , ids[1] , ids[2] , e->nr_anglepots - 1 );
+            break;
+        default:
+            hid = engine_dihedral_add( e , ids[0] , ids[1] , ids[2] , ids[3] , e->nr_dihedralpots - 1 );
+    }
+    if ( hid < 0 || hid >= handles_max || alive[kind][hid] )
+        return -1;
+    for ( k = 0 ; k < 4 ; k++ )
+        shadow[kind][hid][k] = ids[k];
+    alive[kind][hid] = 1;
+
+    return hid;
+
+}
+
+
+/**
+ * @brief Check the handles of one kind of interaction against what they
+ *      should point to.
+ *
+ * @param e The #engine.
+ * @param kind The kind of interaction.
+ *
+ * @return The number of problems found.
+ */
+
+static int handles_check ( struct engine *e , int kind ) {
+
+    int nr_ids[ engine_bonded_last ] = { 2 , 2 , 3 , 4 };
+    int hid, k, j, pos, count = 0, nr_adj, bad = 0, *ids, *hids, *nr_expect;
+
+    /* Each live handle points to its interaction, the others are free. */
+    for ( hid = 0 ; hid < handles_max ; hid++ ) {
+        if ( !alive[kind][hid] ) {
+            if ( hid < e->bonded_nr_handles[kind] && e->bonded_pos[kind][hid] >= 0 )
+                bad += 1;
+            continue;
+        }
+        count += 1;
+        if ( ( pos = engine_bonded_lookup( e , kind , hid ) ) < 0 ) {
+            bad += 1;
+            continue;
+        }
+        switch ( kind ) {
+            case engine_bonded_exclusion: ids = &e->exclusions[pos].i; break;
+            case engine_bonded_bond: ids = &e->bonds[pos].i; break;
+            case engine_bonded_angle: ids = &e->angles[pos].i; break;
+            default: ids = &e->dihedrals[pos].i;
+        }
+        for ( k = 0 ; k < nr_ids[kind] ; k++ )
+            if ( ids[k] != shadow[kind][hid][k] )
+                bad += 1;
+    }
+    k = ( kind == engine_bonded_exclusion ) ? e->nr_exclusions : ( kind == engine_bonded_bond ) ? e->nr_bonds :
+        ( kind == engine_bonded_angle ) ? e->nr_angles : e->nr_dihedrals;
+    if ( k != count ) {
+        printf( "handles: %i interactions of kind %i instead of %i.\n" , k , kind , count );
+        bad += 1;
+    }
+
+    /* Each particle lists the live interactions it is part of. */
+    hids = (int *)malloc( sizeof(int) * handles_max );
+    nr_expect = (int *)calloc( e->s.nr_parts , sizeof(int) );
+    for ( hid = 0 ; hid < handles_max ; hid++ )
+        if ( alive[kind][hid] )
+            for ( k = 0 ; k < nr_ids[kind] ; k++ )
+                nr_expect[ shadow[kind][hid][k] ] += 1;
+    for ( k = 0 ; k < e->s.nr_parts ; k++ ) {
+        nr_adj = engine_bonded_adjacent( e , kind , k , hids , handles_max );
+        if ( nr_adj != nr_expect[k] )
+            bad += 1;
+        for ( j = 0 ; j < nr_adj && j < handles_max ; j++ ) {
+            for ( pos = 0 ; pos < nr_ids[kind] && shadow[kind][ hids[j] ][pos] != k ; pos++ );
+            if ( !alive[kind][ hids[j] ] || pos == nr_ids[kind] )
+                bad += 1;
+        }
+    }
+    free( hids ); free( nr_expect );
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = handles_n * handles_n * handles_n, round, kind, k, hid, last, bad = 0;
+    unsigned int seed = testsys_seed;
+    double *f_ref, *f, epot_ref, epot;
+    char what[100];
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* The bonded interactions alone, shared between the runners, and
+       one exclusion per bond. */
+    testsys_check( testsys_init( e , engine_flag_parbonded , handles_n , testsys_width , testsys_cutoff ) );
+    testsys_check( testsys_bonded( e , handles_n , 0 ) );
+    for ( k = 0 ; k < nr_parts ; k++ ) {
+        for ( kind = engine_bonded_bond ; kind < engine_bonded_last ; kind++ )
+            alive[kind][k] = 1;
+        memcpy( shadow[engine_bonded_bond][k] , &e->bonds[k].i , sizeof(int) * 2 );
+        memcpy( shadow[engine_bonded_angle][k] , &e->angles[k].i , sizeof(int) * 3 );
+        memcpy( shadow[engine_bonded_dihedral][k] , &e->dihedrals[k].i , sizeof(int) * 4 );
+    }
+    for ( k = 0 ; k < nr_parts ; k++ )
+        if ( handles_add_one( e , engine_bonded_exclusion , k ) != k ) {
+            printf( "handles: exclusion %i did not get handle %i.\n" , k , k );
+            return 1;
+        }
+    for ( kind = 0 ; kind < engine_bonded_last ; kind++ )
+        bad += handles_check( e , kind );
+    testsys_check( engine_start( e , 4 , 4 ) );
+
+    for ( round = 0 ; round < handles_rounds ; round++ ) {
+
+        /* Let the lists get sorted and shared, or not, before editing. */
+        if ( round > 0 )
+            testsys_check( engine_step( e ) );
+
+        for ( kind = 0 ; kind < engine_bonded_last ; kind++ ) {
+
+            /* Remove some at random, a removed handle is gone. */
+            for ( k = 0 ; k < handles_remove ; k++ ) {
+                do {
+                    hid = rand_r( &seed ) % e->bonded_nr_handles[kind];
+                } while ( !alive[kind][hid] );
+                testsys_check( engine_bonded_remove( e , kind , hid ) );
+                alive[kind][hid] = 0;
+                last = hid;
+            }
+            if ( engine_bonded_remove( e , kind , last ) >= 0 || engine_bonded_lookup( e , kind , last ) >= 0 ) {
+                printf( "handles: removed handle %i of kind %i is still there.\n" , last , kind );
+                bad += 1;
+            }
+
+            /* Add some back, which re-use the freed handles first. */
+            for ( k = 0 ; k < handles_add ; k++ ) {
+                if ( ( hid = handles_add_one( e , kind , rand_r( &seed ) % nr_parts ) ) < 0 ) {
+                    printf( "handles: adding an interaction of kind %i failed.\n" , kind );
+                    return 1;
+                }
+                if ( hid >= nr_parts ) {
+                    printf( "handles: new handle %i of kind %i while others were free.\n" , hid , kind );
+                    bad += 1;
+                }
+            }
+
+            bad += handles_check( e , kind );
+
+        }
+        printf( "handles: %i bad results after round %i.\n" , bad , round );
+
+        /* The forces of what is left. */
+        bzero( f_ref , sizeof(double) * 3 * nr_parts );
+        epot_ref = 0.0;
+        testsys_bonded_brute( e , f_ref , &epot_ref );
+        testsys_check( engine_step( e ) );
+        testsys_forces( e , f );
+        epot = e->s.epot;
+        snprintf( what , sizeof(what) , "forces after round %i" , round );
+        bad += testsys_compare( what , f_ref , f , 3 * nr_parts , 1.0e-4 );
+        snprintf( what , sizeof(what) , "energy after round %i" , round );
+        bad += testsys_compare( what , &epot_ref , &epot , 1 , 1.0e-4 );
+        for ( kind = 0 ; kind < engine_bonded_last ; kind++ )
+            bad += handles_check( e , kind );
+
+    }
+    testsys_check( engine_finalize( e ) );
+
+    free( f_ref ); free( f );
+    return bad != 0;
+
+}
@@ -0,0 +1,210 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the kinetic energy and momentum summed by the runners in the
+   advance pass against a serial sweep over the cells, with and without
+   the fused integration, the temperature derived from them against one
+   taken directly from the particles, and that the kinetic energy of a
+   step with rigid constraints is taken after the constraints are
+   resolved. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/**
+ * @brief Sum up the kinetic energy and momentum of the particles in the
+ *      real cells.
+ *
+ * @param e The #engine.
+ * @param sums An array of four doubles for the kinetic energy and the
+ *      momentum.
+ */
+
+void kinetic_direct ( struct engine *e , double *sums ) {
+
+    struct space *s = &e->s;
+    struct space_cell *c;
+    struct MxParticle *p;
+    double m;
+    int cid, pid, k;
+
+    bzero( sums , sizeof(double) * 4 );
+    for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+        c = &s->cells[ s->cid_real[cid] ];
+        for ( pid = 0 ; pid < c->count ; pid++ ) {
+            p = &c->parts[pid];
+            m = e->types[ p->typeId ].mass;
+            for ( k = 0 ; k < 3 ; k++ ) {
+                sums[0] += 0.5 * m * p->v[k] * p->v[k];
+                sums[k+1] += m * p->v[k];
+            }
+        }
+    }
+
+}
+
+
+/**
+ * @brief Constrain neighbouring particles along the lattice rows to the
+ *      lattice spacing and check the kinetic energy of a few steps.
+ *
+ * @param e The #engine.
+ * @param n The number of particles per box side.
+ *
+ * @return The number of failed checks, or one on error.
+ */
+
+int kinetic_rigid ( struct engine *e , int n ) {
+
+    double h = testsys_width / n, ref[4], sums[4];
+    int pid, r, k, step, bad = 0;
+
+    testsys_check( testsys_init( e , engine_flag_shake , n , testsys_width , testsys_cutoff ) );
+    for ( pid = 0 ; pid < n*n*n ; pid += 2 )
+        if ( pid % n < n - 1 )
+            testsys_check( engine_rigid_add( e , pid , pid + 1 , h ) );
+    if ( e->nr_rigids == 0 ) {
+        printf( "kinetic: no rigid constraints were added.\n" );
+        return 1;
+    }
+    testsys_check( engine_start( e , 3 , 3 ) );
+
+    for ( step = 0 ; step < 5 ; step++ ) {
+        testsys_check( engine_step( e ) );
+
+        /* The kinetic energy of the step is that of the constrained
+           velocities. */
+        kinetic_direct( e , ref );
+        sums[0] = e->ekin;
+        for ( k = 0 ; k < 3 ; k++ )
+            sums[k+1] = e->momentum[k];
+        bad += testsys_compare( "constrained kinetic energy" , ref , sums , 1 , 1.0e-6 );
+        for ( k = 1 ; k < 4 ; k++ )
+            if ( fabs( ref[k] - sums[k] ) > 1.0e-6 * ref[0] ) {
+                printf( "kinetic: constrained momentum %i is %e instead of %e.\n" , k-1 , sums[k] , ref[k] );
+                bad += 1;
+            }
+
+        /* The runners summed up the velocities before the constraints,
+           which must have changed them for this test to mean anything. */
+        sums[0] = 0.0;
+        for ( r = 0 ; r < e->nr_runners ; r++ )
+            for ( k = 0 ; k < e->max_type ; k++ )
+                sums[0] += 0.5 * e->runners[r].sums[ k * runner_nrsums + runner_sum_ekin ];
+        if ( fabs( sums[0] - ref[0] ) < 1.0e-4 * ref[0] ) {
+            printf( "kinetic: the constraints did not change the kinetic energy in step %i.\n" , step );
+            bad += 1;
+        }
+    }
+
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+/**
+ * @brief Compute the temperature without the center of mass motion
+ *      directly from the particles.
+ */
+
+static double kinetic_temperature ( struct engine *e ) {
+
+    struct MxParticle *p;
+    double m, ekin = 0.0, mass = 0.0, mom[3] = { 0.0 , 0.0 , 0.0 };
+    int pid, k;
+
+    for ( pid = 0 ; pid < e->s.nr_parts ; pid++ ) {
+        p = e->s.partlist[pid];
+        m = engine::types[ p->typeId ].mass;
+        mass += m;
+        for ( k = 0 ; k < 3 ; k++ ) {
+            ekin += 0.5 * m * p->v[k] * p->v[k];
+            mom[k] += m * p->v[k];
+        }
+    }
+
+    ekin -= 0.5 * ( mom[0]*mom[0] + mom[1]*mom[1] + mom[2]*mom[2] ) / mass;
+    return 2.0 * ekin / ( 3.0 * ( e->s.nr_parts - 1 ) );
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    unsigned int flags[2] = { engine_flag_none , engine_flag_fused };
+    double ref[4], sums[4], temp, temp_ref;
+    long sums_time;
+    int k, m, bad = 0;
+
+    for ( m = 0 ; m < 2 ; m++ ) {
+
+        testsys_check( testsys_init( e , flags[m] , 14 , testsys_width , testsys_cutoff ) );
+        testsys_check( engine_start( e , 3 , 3 ) );
+        for ( k = 0 ; k < 5 ; k++ )
+            testsys_check( engine_step( e ) );
+
+        /* The sums of the runners. */
+        if ( e->sums_time != e->time ) {
+            printf( "kinetic: the runners did not sum up the last step.\n" );
+            bad += 1;
+        }
+        engine_kinetic_energy( e );
+        sums[0] = e->ekin;
+        for ( k = 0 ; k < 3 ; k++ )
+            sums[k+1] = e->momentum[k];
+        if ( e->ekin_count != e->s.nr_parts ) {
+            printf( "kinetic: the runners counted %li of %i particles.\n" , e->ekin_count , e->s.nr_parts );
+            bad += 1;
+        }
+        temp = engine_temperature( e );
+        temp_ref = kinetic_temperature( e );
+
+        /* The serial sweep. */
+        sums_time = e->sums_time;
+        e->sums_time = -1;
+        engine_kinetic_energy( e );
+        ref[0] = e->ekin;
+        for ( k = 0 ; k < 3 ; k++ )
+            ref[k+1] = e->momentum[k];
+        e->sums_time = sums_time;
+
+        /* The momenta are compared relative to the kinetic energy, since
+           they nearly cancel. */
+        bad += testsys_compare( m ? "fused kinetic energy" : "kinetic energy" , ref , sums , 1 , 1.0e-6 );
+        for ( k = 1 ; k < 4 ; k++ )
+            if ( fabs( ref[k] - sums[k] ) > 1.0e-6 * ref[0] ) {
+                printf( "kinetic: momentum %i is %e instead of %e.\n" , k-1 , sums[k] , ref[k] );
+                bad += 1;
+            }
+        bad += testsys_compare( m ? "fused temperature" : "temperature" , &temp_ref , &temp , 1 , 1.0e-6 );
+
+        testsys_check( engine_finalize( e ) );
+
+    }
+
+    bad += kinetic_rigid( e , 14 );
+
+    return bad != 0;
+
+}
@@ -0,0 +1,154 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the migration of particles between cells through the runners'
+   outgoing buffers: after many steps with fast particles, every particle
+   is still there, once, in the cell it lies in, the buffers were used
+   and are empty again, and the positions and energy on several runners
+   match those on a single runner, with the separate and the fused
+   integration and with the cells welcomed by their NUMA owners. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/* Number of steps, and the velocity scale, enough for many particles
+   to change cells. */
+#define nr_steps                         200
+#define migrate_vscale                   5.0
+
+
+/**
+ * @brief Check that every particle is in exactly one cell, the one it
+ *      lies in, and that the particle and cell lists point to it.
+ *
+ * @param s The #space.
+ * @param cells The cell of each particle at the start.
+ */
+
+static int migrate_check ( struct space *s , const int *cells ) {
+
+    struct space_cell *c;
+    struct MxParticle *p;
+    int cid, pid, k, count = 0, moved = 0, bad = 0;
+    int *seen = (int *)calloc( s->nr_parts , sizeof(int) );
+
+    for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+        c = &s->cells[ s->cid_real[cid] ];
+        for ( pid = 0 ; pid < c->count ; pid++ ) {
+            p = &c->parts[pid];
+            count += 1;
+            if ( p->id < 0 || p->id >= s->nr_parts || seen[ p->id ]++ ) {
+                bad += 1;
+                continue;
+            }
+            for ( k = 0 ; k < 3 ; k++ )
+                if ( p->x[k] < 0.0 || p->x[k] >= s->h[k] )
+                    bad += 1;
+            if ( s->partlist[ p->id ] != p || s->celllist[ p->id ] != c )
+                bad += 1;
+            if ( c - s->cells != cells[ p->id ] )
+                moved += 1;
+        }
+    }
+
+    printf( "migrate: %i of %i particles in %i cells, %i changed cells, %i bad.\n" ,
+        count , s->nr_parts , s->nr_real , moved , bad );
+    free( seen );
+    return bad + ( count != s->nr_parts ) + ( moved < s->nr_parts / 4 );
+
+}
+
+
+/**
+ * @brief Take many fast steps and collect the positions and energy.
+ *
+ * @param flags The #engine flags.
+ * @param nr_runners The number of runners.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int migrate_run ( unsigned int flags , int nr_runners , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    struct space *s = &e->s;
+    int *cells, k, j, pid, used, bad;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    cells = (int *)malloc( sizeof(int) * s->nr_parts );
+    for ( pid = 0 ; pid < s->nr_parts ; pid++ ) {
+        for ( k = 0 ; k < 3 ; k++ )
+            s->partlist[pid]->v[k] *= migrate_vscale;
+        cells[pid] = s->celllist[pid] - s->cells;
+    }
+
+    testsys_check( engine_start( e , nr_runners , nr_runners ) );
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_positions( e , x );
+    *epot = s->epot;
+
+    bad = migrate_check( s , cells );
+
+    /* The particles went through the runners' buffers, which are empty
+       again. */
+    for ( used = 0 , k = 0 ; k < e->nr_runners ; k++ )
+        for ( j = 0 ; j < e->nr_runners ; j++ ) {
+            bad += ( e->runners[k].out[j].count != 0 );
+            used += ( e->runners[k].out[j].size > 0 );
+        }
+    printf( "migrate: %i of %i outgoing buffers used.\n" , used , e->nr_runners * e->nr_runners );
+    bad += ( used == 0 );
+    testsys_check( engine_finalize( e ) );
+    free( cells );
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    unsigned int flags[3] = { engine_flag_none , engine_flag_fused , engine_flag_numa };
+    const char *names[3] = { "runners" , "fused runners" , "numa runners" };
+    int nr_parts = 14*14*14, k, bad = 0;
+    double *x_ref, *x_run, epot_ref, epot_run;
+    char what[100];
+
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_run = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    if ( migrate_run( engine_flag_none , 1 , x_ref , &epot_ref ) != 0 )
+        return 1;
+
+    for ( k = 0 ; k < 3 ; k++ ) {
+        bad += migrate_run( flags[k] , 4 , x_run , &epot_run );
+        testsys_image( x_ref , x_run , nr_parts , testsys_width );
+        snprintf( what , sizeof(what) , "%s positions" , names[k] );
+        bad += testsys_compare( what , x_ref , x_run , 3 * nr_parts , 1.0e-4 );
+        snprintf( what , sizeof(what) , "%s energy" , names[k] );
+        bad += testsys_compare( what , &epot_ref , &epot_run , 1 , 1.0e-4 );
+    }
+
+    free( x_ref ); free( x_run );
+    return bad != 0;
+
+}
@@ -0,0 +1,122 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the lock-free task mode (engine_flag_nolock), where the kernels
+   write to per-runner force buffers that are merged after the tasks,
+   against the default locked mode, for the scalar and SIMD kernels and
+   over a few steps so that the merged forces are integrated. Also checks
+   that the runners' energies add up to the non-bonded energy, and that
+   the flag turns off the modes writing per-cell copies. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/* Number of steps and runners. */
+#define nr_steps                         10
+#define nolock_runners                   4
+
+
+/**
+ * @brief Take a few steps and collect the last forces, the positions
+ *      and the energy.
+ *
+ * @param flags The #engine flags.
+ * @param simd The pair kernels to use, see #runner_simd_detect.
+ * @param f An array for the forces.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int nolock_run ( unsigned int flags , int simd , double *f , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    double epot_runners;
+    int k;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    if ( ( e->flags & engine_flag_nolock ) != ( flags & engine_flag_nolock ) ) {
+        printf( "nolock: engine_flag_nolock was not kept.\n" );
+        return 1;
+    }
+    if ( ( e->flags & engine_flag_nolock ) && ( e->flags & ( engine_flag_soa | engine_flag_fused ) ) ) {
+        printf( "nolock: engine_flag_soa or engine_flag_fused was kept.\n" );
+        return 1;
+    }
+    testsys_check( engine_start( e , nolock_runners , nolock_runners ) );
+    for ( k = 0 ; k < e->nr_runners ; k++ )
+        e->runners[k].simd = simd;
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    testsys_positions( e , x );
+    *epot = e->s.epot;
+
+    if ( e->flags & engine_flag_nolock ) {
+        for ( epot_runners = 0.0 , k = 0 ; k < e->nr_runners ; k++ ) {
+            epot_runners += e->runners[k].epot;
+            if ( e->runners[k].eff_size < 4 * e->s.nr_parts ) {
+                printf( "nolock: runner %i has no force buffer.\n" , k );
+                return 1;
+            }
+        }
+        if ( fabs( epot_runners - e->s.epot_nonbond ) > 1.0e-6 * fabs( e->s.epot_nonbond ) ) {
+            printf( "nolock: the runners' energies add up to %e, not %e.\n" , epot_runners , e->s.epot_nonbond );
+            return 1;
+        }
+    }
+    testsys_check( engine_finalize( e ) );
+
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    const char *names[] = { "scalar" , "avx2" , "avx512" };
+    int nr_parts = 14*14*14, simd, bad = 0;
+    double *f_ref, *f_nl, *x_ref, *x_nl, epot_ref, epot_nl;
+    char what[100];
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_nl = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_nl = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    if ( nolock_run( engine_flag_none , runner_simd_none , f_ref , x_ref , &epot_ref ) != 0 )
+        return 1;
+
+    for ( simd = runner_simd_none ; simd <= runner_simd_detect() ; simd++ ) {
+        if ( nolock_run( engine_flag_nolock | ( simd ? engine_flag_simd : ( engine_flag_soa | engine_flag_fused ) ) , simd , f_nl , x_nl , &epot_nl ) != 0 )
+            return 1;
+        snprintf( what , sizeof(what) , "%s nolock forces" , names[simd] );
+        bad += testsys_compare( what , f_ref , f_nl , 3 * nr_parts , 1.0e-4 );
+        testsys_image( x_ref , x_nl , nr_parts , testsys_width );
+        snprintf( what , sizeof(what) , "%s nolock positions" , names[simd] );
+        bad += testsys_compare( what , x_ref , x_nl , 3 * nr_parts , 1.0e-5 );
+        snprintf( what , sizeof(what) , "%s nolock energy" , names[simd] );
+        bad += testsys_compare( what , &epot_ref , &epot_nl , 1 , 1.0e-4 );
+    }
+
+    free( f_ref ); free( f_nl ); free( x_ref ); free( x_nl );
+    return bad != 0;
+
+}
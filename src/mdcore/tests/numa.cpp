@@ -0,0 +1,139 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the NUMA-aware mode (engine_flag_numa): that it pins the
+   runners (engine_flag_affinity), that the real cells are owned by the
+   runners in contiguous blocks along the curve order, that the particle
+   reads are counted, and that the forces, positions and energy match the
+   default mode. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/* Number of steps and runners. */
+#define nr_steps                         ( 2 * space_sfc_resort )
+#define numa_runners                     4
+
+
+/**
+ * @brief Check the cell owners and the read counts.
+ *
+ * @param e The #engine.
+ */
+
+static int numa_check ( struct engine *e ) {
+
+    struct space *s = &e->s;
+    int k, rid, last = 0, nr_sockets, bad = 0;
+    int counts[ numa_runners ] = { 0 };
+    double local, remote;
+
+    if ( !( e->flags & engine_flag_affinity ) ) {
+        printf( "numa: engine_flag_numa does not imply engine_flag_affinity.\n" );
+        bad += 1;
+    }
+    for ( k = 0 ; k < s->nr_real ; k++ ) {
+        rid = s->cells_owner[ s->cid_real[k] ];
+        if ( rid < last || rid >= e->nr_runners )
+            bad += 1;
+        else
+            counts[ rid ] += 1;
+        last = rid;
+    }
+    for ( k = 0 ; k < e->nr_runners ; k++ )
+        if ( counts[k] == 0 ) {
+            printf( "numa: runner %i owns no cells.\n" , k );
+            bad += 1;
+        }
+
+    testsys_check( engine_numa_stats( e , &nr_sockets , &local , &remote ) );
+    printf( "numa: %i sockets, %.3e bytes local, %.3e bytes remote.\n" , nr_sockets , local , remote );
+    if ( nr_sockets < 1 || local + remote <= 0.0 )
+        bad += 1;
+
+    printf( "numa: %i bad cell owners or counts.\n" , bad );
+    return bad;
+
+}
+
+
+/**
+ * @brief Take a few steps and collect the last forces, the positions
+ *      and the energy.
+ *
+ * @param flags The #engine flags.
+ * @param f An array for the forces.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int numa_run ( unsigned int flags , double *f , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    int k, bad = 0;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    testsys_check( engine_start( e , numa_runners , numa_runners ) );
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    testsys_positions( e , x );
+    *epot = e->s.epot;
+    if ( flags & engine_flag_numa )
+        bad += numa_check( e );
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    unsigned int flags[2] = { engine_flag_numa , engine_flag_numa | engine_flag_hilbert };
+    const char *names[2] = { "numa" , "numa hilbert" };
+    int nr_parts = 14*14*14, k, bad = 0;
+    double *f_ref, *f_numa, *x_ref, *x_numa, epot_ref, epot_numa;
+    char what[100];
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_numa = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_numa = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    if ( numa_run( engine_flag_none , f_ref , x_ref , &epot_ref ) != 0 )
+        return 1;
+
+    for ( k = 0 ; k < 2 ; k++ ) {
+        bad += numa_run( flags[k] , f_numa , x_numa , &epot_numa );
+        snprintf( what , sizeof(what) , "%s forces" , names[k] );
+        bad += testsys_compare( what , f_ref , f_numa , 3 * nr_parts , 1.0e-4 );
+        testsys_image( x_ref , x_numa , nr_parts , testsys_width );
+        snprintf( what , sizeof(what) , "%s positions" , names[k] );
+        bad += testsys_compare( what , x_ref , x_numa , 3 * nr_parts , 1.0e-5 );
+        snprintf( what , sizeof(what) , "%s energy" , names[k] );
+        bad += testsys_compare( what , &epot_ref , &epot_numa , 1 , 1.0e-4 );
+    }
+
+    free( f_ref ); free( f_numa ); free( x_ref ); free( x_numa );
+    return bad != 0;
+
+}
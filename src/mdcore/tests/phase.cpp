@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the runner pool barrier: every runner runs every phase exactly
+   once, a failing runner makes engine_phase_run return an error instead
+   of hanging, and the pool is still usable afterwards. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/* Number of runners and phases. */
+#define nr_runners                       4
+#define nr_phases                        1000
+
+
+/* Count the calls of each runner. */
+static int count ( struct runner *r , void *data ) {
+
+    int *counts = (int *)data;
+
+    counts[ r->id ] += 1;
+    return 0;
+
+}
+
+
+/* Fail on the second runner. */
+static int fail ( struct runner *r , void *data ) {
+
+    return ( r->id == 1 ) ? -1 : 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    int counts[ nr_runners ] = { 0 };
+    int k, res, bad = 0;
+
+    testsys_check( testsys_init( e , engine_flag_none , 8 , testsys_width , testsys_cutoff ) );
+    testsys_check( engine_start( e , nr_runners , nr_runners ) );
+
+    /* Run many short phases back to back. */
+    for ( k = 0 ; k < nr_phases ; k++ )
+        testsys_check( engine_phase_run( e , count , counts ) );
+    for ( k = 0 ; k < nr_runners ; k++ )
+        if ( counts[k] != nr_phases ) {
+            printf( "phase: runner %i ran %i of %i phases.\n" , k , counts[k] , nr_phases );
+            bad += 1;
+        }
+
+    /* A failing phase is reported, and does not break the next one. */
+    if ( ( res = engine_phase_run( e , fail , NULL ) ) >= 0 ) {
+        printf( "phase: the failing phase returned %i.\n" , res );
+        bad += 1;
+    }
+    testsys_check( engine_phase_run( e , count , counts ) );
+    for ( k = 0 ; k < nr_runners ; k++ )
+        if ( counts[k] != nr_phases + 1 )
+            bad += 1;
+
+    /* The engine still steps. */
+    testsys_check( engine_step( e ) );
+    testsys_check( engine_finalize( e ) );
+
+    printf( "phase: %i bad results.\n" , bad );
+    return bad != 0;
+
+}
@@ -0,0 +1,211 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks re-gridding a running engine (engine_regrid) and picking the
+   grid from the potentials (engine_flag_autogrid): every particle ends up
+   in the cell it lies in, and the forces, positions and energy match a
+   run that stays on the same grid. A potential with a longer range makes
+   the grid be re-picked at the next step. */
+
+#include "testsys.h"
+
+
+/* Number of steps before and after the re-grid. */
+#define nr_steps                         20
+
+
+/**
+ * @brief Check that every particle is in exactly one cell, the one it
+ *      lies in, and that the particle and cell lists point to it.
+ *
+ * @param s The #space.
+ */
+
+static int regrid_check ( struct space *s ) {
+
+    struct space_cell *c;
+    struct MxParticle *p;
+    int cid, pid, k, count = 0, bad = 0;
+
+    for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+        c = &s->cells[ s->cid_real[cid] ];
+        for ( pid = 0 ; pid < c->count ; pid++ ) {
+            p = &c->parts[pid];
+            count += 1;
+            for ( k = 0 ; k < 3 ; k++ )
+                if ( p->x[k] < 0.0 || p->x[k] >= s->h[k] )
+                    bad += 1;
+            if ( p->id < 0 || p->id >= s->nr_parts || s->partlist[ p->id ] != p || s->celllist[ p->id ] != c )
+                bad += 1;
+        }
+    }
+
+    printf( "regrid: %i of %i particles in %ix%ix%i cells, %i bad.\n" ,
+        count , s->nr_parts , s->cdim[0] , s->cdim[1] , s->cdim[2] , bad );
+    return bad + ( count != s->nr_parts );
+
+}
+
+
+/**
+ * @brief Get the largest range of the #engine's potentials.
+ */
+
+static double regrid_range ( struct engine *e ) {
+
+    double cutoff = 0.0;
+    int k;
+
+    for ( k = 0 ; k < e->max_type * e->max_type ; k++ )
+        if ( e->p[k] != NULL )
+            cutoff = fmax( cutoff , e->p[k]->b );
+
+    return cutoff;
+
+}
+
+
+/**
+ * @brief Take a few steps, optionally re-grid, take the rest and
+ *      collect the last forces, the positions and the energy.
+ *
+ * @param flags The #engine flags.
+ * @param first The number of steps before the re-grid.
+ * @param L The cell edge length to re-grid to, or zero to stay.
+ * @param cutoff The cutoff to re-grid with, or the cutoff picked with
+ *      #engine_flag_autogrid on return.
+ * @param f An array for the forces.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int regrid_run ( unsigned int flags , int first , double *L , double *cutoff , double *f , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    double LL[3] = { *L , *L , *L };
+    int k, bad = 0;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+
+    /* The grid picked from the potentials fits their largest range. */
+    if ( flags & engine_flag_autogrid ) {
+        bad += regrid_check( &e->s );
+        if ( e->s.cutoff != regrid_range( e ) || e->s.h[0] < e->s.cutoff ) {
+            printf( "regrid: the cutoff is %e instead of %e.\n" , e->s.cutoff , regrid_range( e ) );
+            bad += 1;
+        }
+        *L = e->s.h[0];
+        *cutoff = e->s.cutoff;
+    }
+
+    for ( k = 0 ; k < 2 * nr_steps ; k++ ) {
+        if ( k == first && LL[0] > 0.0 ) {
+            testsys_check( engine_regrid( e , LL , *cutoff ) );
+            bad += regrid_check( &e->s );
+            if ( e->s.h[0] < LL[0] || e->s.cdim[0] != (int)( testsys_width / LL[0] ) ) {
+                printf( "regrid: the cells are %e wide instead of %e.\n" , e->s.h[0] , LL[0] );
+                bad += 1;
+            }
+        }
+        testsys_check( engine_step( e ) );
+    }
+    testsys_forces( e , f );
+    testsys_positions( e , x );
+    *epot = e->s.epot;
+    bad += regrid_check( &e->s );
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+/**
+ * @brief Check that a potential with a longer range re-picks the grid.
+ */
+
+static int regrid_longer ( void ) {
+
+    struct engine *e = &_Engine;
+    struct MxPotential *pot;
+    double cutoff = 1.5 * testsys_cutoff;
+    int bad = 0;
+
+    testsys_check( testsys_init( e , engine_flag_autogrid , 14 , testsys_width , testsys_cutoff ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    testsys_check( engine_step( e ) );
+    if ( ( pot = potential_create_LJ126( 0.275 , cutoff , 9.5075e-06 , 6.1545e-03 , 1.0e-3 ) ) == NULL )
+        return 1;
+    testsys_check( engine_addpot( e , pot , 0 , 0 ) );
+    if ( !e->autogrid_pending ) {
+        printf( "regrid: the longer range did not flag the grid.\n" );
+        bad += 1;
+    }
+    testsys_check( engine_step( e ) );
+    if ( e->autogrid_pending || e->s.cutoff != pot->b || e->s.h[0] < pot->b ) {
+        printf( "regrid: the grid was not re-picked for the cutoff %e.\n" , pot->b );
+        bad += 1;
+    }
+    bad += regrid_check( &e->s );
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    int nr_parts = 14*14*14, bad = 0;
+    double *f_ref, *f_grid, *x_ref, *x_grid, epot_ref, epot_grid, L, cutoff;
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_grid = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_grid = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* Coarser cells half-way through. */
+    L = 0.0; cutoff = testsys_cutoff;
+    if ( regrid_run( engine_flag_none , 0 , &L , &cutoff , f_ref , x_ref , &epot_ref ) != 0 )
+        return 1;
+    L = 2.0 * testsys_cutoff;
+    bad += regrid_run( engine_flag_none , nr_steps , &L , &cutoff , f_grid , x_grid , &epot_grid );
+    bad += testsys_compare( "regrid forces" , f_ref , f_grid , 3 * nr_parts , 1.0e-4 );
+    testsys_image( x_ref , x_grid , nr_parts , testsys_width );
+    bad += testsys_compare( "regrid positions" , x_ref , x_grid , 3 * nr_parts , 1.0e-5 );
+    bad += testsys_compare( "regrid energy" , &epot_ref , &epot_grid , 1 , 1.0e-4 );
+
+    /* The grid picked from the potentials, against the same grid and
+       cutoff set by hand, i.e. the timed probes leave no trace. */
+    L = 0.0;
+    bad += regrid_run( engine_flag_autogrid , 0 , &L , &cutoff , f_grid , x_grid , &epot_grid );
+    bad += regrid_run( engine_flag_none , 0 , &L , &cutoff , f_ref , x_ref , &epot_ref );
+    bad += testsys_compare( "autogrid forces" , f_ref , f_grid , 3 * nr_parts , 1.0e-4 );
+    testsys_image( x_ref , x_grid , nr_parts , testsys_width );
+    bad += testsys_compare( "autogrid positions" , x_ref , x_grid , 3 * nr_parts , 1.0e-5 );
+    bad += testsys_compare( "autogrid energy" , &epot_ref , &epot_grid , 1 , 1.0e-4 );
+
+    bad += regrid_longer();
+
+    free( f_ref ); free( f_grid ); free( x_ref ); free( x_grid );
+    return bad != 0;
+
+}
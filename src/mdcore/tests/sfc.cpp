@@ -0,0 +1,199 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the space-filling curves (engine_flag_morton, engine_flag_hilbert):
+   that the keys visit every point of a small grid once, with the Hilbert
+   curve only stepping to face neighbours, that the cells and particles
+   are ordered along the curve, and that the ordering does not change the
+   forces, positions or energy. */
+
+#include "testsys.h"
+
+
+/* Number of steps, enough for the particles to be re-sorted twice. */
+#define nr_steps                         ( 2 * space_sfc_resort )
+
+/* Number of bits per dimension of the key checks. */
+#define sfc_bits                         3
+
+
+/**
+ * @brief Check that the keys of a curve are a bijection of the grid, and
+ *      for the Hilbert curve, that consecutive keys are face neighbours.
+ *
+ * @param curve The curve, see #space_sfc_key.
+ */
+
+static int sfc_keys ( int curve ) {
+
+    int n = 1 << sfc_bits, nr_keys = n*n*n, k, j, dist, bad = 0;
+    unsigned int x[3], key, *pts;
+
+    pts = (unsigned int *)malloc( sizeof(unsigned int) * 3 * nr_keys );
+    for ( k = 0 ; k < 3 * nr_keys ; k++ )
+        pts[k] = n;
+
+    for ( x[0] = 0 ; x[0] < (unsigned int)n ; x[0]++ )
+        for ( x[1] = 0 ; x[1] < (unsigned int)n ; x[1]++ )
+            for ( x[2] = 0 ; x[2] < (unsigned int)n ; x[2]++ ) {
+                key = space_sfc_key( curve , sfc_bits , x );
+                if ( key >= (unsigned int)nr_keys || pts[ 3*key ] != (unsigned int)n ) {
+                    bad += 1;
+                    continue;
+                }
+                for ( j = 0 ; j < 3 ; j++ )
+                    pts[ 3*key + j ] = x[j];
+            }
+
+    /* The Morton key interleaves the bits, x[0] first. */
+    if ( curve == space_sfc_morton )
+        for ( k = 0 ; k < nr_keys ; k++ )
+            for ( j = 0 ; j < 3 ; j++ )
+                if ( pts[ 3*k + j ] != ( ( ( k >> ( 2 - j ) ) & 1 ) | ( ( ( k >> ( 5 - j ) ) & 1 ) << 1 ) | ( ( ( k >> ( 8 - j ) ) & 1 ) << 2 ) ) )
+                    bad += 1;
+
+    /* The Hilbert curve only steps to face neighbours. */
+    if ( curve == space_sfc_hilbert )
+        for ( k = 1 ; k < nr_keys ; k++ ) {
+            for ( dist = 0 , j = 0 ; j < 3 ; j++ )
+                dist += abs( (int)pts[ 3*k + j ] - (int)pts[ 3*(k-1) + j ] );
+            if ( dist != 1 )
+                bad += 1;
+        }
+
+    free( pts );
+    printf( "sfc: %i bad %s keys.\n" , bad , curve == space_sfc_hilbert ? "Hilbert" : "Morton" );
+    return bad;
+
+}
+
+
+/**
+ * @brief Check that the real cells and the particles in each cell are
+ *      ordered along the curve, and that the particle list is consistent.
+ *
+ * @param s The #space, with the particles freshly sorted.
+ */
+
+static int sfc_order ( struct space *s ) {
+
+    int cid, pid, k, bits, bad = 0;
+    unsigned int x[3], key, last_cell = 0, last_part;
+    struct space_cell *c;
+    FPTYPE scale[3];
+
+    for ( bits = 0 ; bits < space_sfc_maxbits ; bits++ )
+        if ( ( 1 << bits ) >= s->cdim[0] && ( 1 << bits ) >= s->cdim[1] && ( 1 << bits ) >= s->cdim[2] )
+            break;
+    for ( k = 0 ; k < 3 ; k++ )
+        scale[k] = ( 1 << space_sfc_partbits ) * s->ih[k];
+
+    for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+        c = &s->cells[ s->cid_real[cid] ];
+        for ( k = 0 ; k < 3 ; k++ )
+            x[k] = c->loc[k];
+        if ( ( key = space_sfc_key( s->sfc , bits , x ) ) < last_cell )
+            bad += 1;
+        last_cell = key;
+        for ( last_part = 0 , pid = 0 ; pid < c->count ; pid++ ) {
+            for ( k = 0 ; k < 3 ; k++ )
+                x[k] = fmin( fmax( (int)( c->parts[pid].x[k] * scale[k] ) , 0 ) , ( 1 << space_sfc_partbits ) - 1 );
+            if ( ( key = space_sfc_key( s->sfc , space_sfc_partbits , x ) ) < last_part )
+                bad += 1;
+            last_part = key;
+            if ( s->partlist[ c->parts[pid].id ] != &c->parts[pid] )
+                bad += 1;
+        }
+    }
+
+    printf( "sfc: %i cells or particles out of order.\n" , bad );
+    return bad;
+
+}
+
+
+/**
+ * @brief Take a few steps and collect the last forces, the positions
+ *      and the energy.
+ *
+ * @param flags The #engine flags.
+ * @param f An array for the forces.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int sfc_run ( unsigned int flags , double *f , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    int k, bad = 0;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    testsys_positions( e , x );
+    *epot = e->s.epot;
+
+    if ( flags & ( engine_flag_morton | engine_flag_hilbert ) ) {
+        testsys_check( space_sfc_sortparts( &e->s ) );
+        bad += sfc_order( &e->s );
+    }
+    testsys_check( engine_finalize( e ) );
+
+    return bad;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    unsigned int flags[2] = { engine_flag_morton , engine_flag_hilbert };
+    const char *names[2] = { "Morton" , "Hilbert" };
+    int nr_parts = 14*14*14, k, bad = 0;
+    double *f_ref, *f_sfc, *x_ref, *x_sfc, epot_ref, epot_sfc;
+    char what[100];
+
+    bad += sfc_keys( space_sfc_morton );
+    bad += sfc_keys( space_sfc_hilbert );
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_sfc = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_sfc = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    if ( sfc_run( engine_flag_none , f_ref , x_ref , &epot_ref ) != 0 )
+        return 1;
+
+    for ( k = 0 ; k < 2 ; k++ ) {
+        bad += sfc_run( flags[k] , f_sfc , x_sfc , &epot_sfc );
+        snprintf( what , sizeof(what) , "%s forces" , names[k] );
+        bad += testsys_compare( what , f_ref , f_sfc , 3 * nr_parts , 1.0e-4 );
+        testsys_image( x_ref , x_sfc , nr_parts , testsys_width );
+        snprintf( what , sizeof(what) , "%s positions" , names[k] );
+        bad += testsys_compare( what , x_ref , x_sfc , 3 * nr_parts , 1.0e-5 );
+        snprintf( what , sizeof(what) , "%s energy" , names[k] );
+        bad += testsys_compare( what , &epot_ref , &epot_sfc , 1 , 1.0e-4 );
+    }
+
+    free( f_ref ); free( f_sfc ); free( x_ref ); free( x_sfc );
+    return bad != 0;
+
+}
@@ -0,0 +1,159 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the AVX2 and AVX-512 pair kernels (engine_flag_simd): that the
+   flag makes the runners pick the widest flavour the CPU supports, that
+   each flavour adds the same forces as the scalar kernels on every self
+   and pair task, both for the closed-form potentials and the tables, and
+   that a step with the flag gives the forces and energy of a sum over
+   all pairs. Flavours the CPU does not support are skipped. */
+
+#include "testsys.h"
+#include "runner.h"
+
+
+/**
+ * @brief Run the self and pair tasks one by one with the scalar and the
+ *      given SIMD kernels and compare the forces they add.
+ *
+ * @param e The #engine, started and with sorted cells.
+ * @param simd The pair kernels to check, see #runner_simd_detect.
+ *
+ * The kernels evaluate the potentials as given by @c e->pot_kind.
+ *
+ * @return The number of tasks on which the kernels differ, or < 0 on
+ *      error.
+ */
+
+static int simd_tasks ( struct engine *e , int simd ) {
+
+    struct space *s = &e->s;
+    struct runner *r = &e->runners[0];
+    struct task *t;
+    struct space_cell *c[2];
+    double *f_ref, dmax, amax;
+    int tid, i, k, pid, nr_cells, nr_tasks = 0, bad = 0;
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * s->nr_parts );
+
+    for ( tid = 0 ; tid < s->nr_tasks ; tid++ ) {
+        t = &s->tasks[tid];
+        if ( t->type != task_type_self && t->type != task_type_pair )
+            continue;
+        c[0] = &s->cells[ t->i ];
+        nr_cells = ( t->type == task_type_pair ) ? 2 : 1;
+        if ( nr_cells == 2 )
+            c[1] = &s->cells[ t->j ];
+
+        /* The scalar kernel. */
+        for ( i = 0 ; i < nr_cells ; i++ )
+            for ( pid = 0 ; pid < c[i]->count ; pid++ )
+                for ( k = 0 ; k < 3 ; k++ )
+                    c[i]->parts[pid].f[k] = FPTYPE_ZERO;
+        if ( ( ( nr_cells == 1 ) ? runner_doself( r , c[0] ) : runner_dopair( r , c[0] , c[1] , t->flags ) ) < 0 )
+            return -1;
+        for ( i = 0 ; i < nr_cells ; i++ )
+            for ( pid = 0 ; pid < c[i]->count ; pid++ )
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    f_ref[ 3*c[i]->parts[pid].id + k ] = c[i]->parts[pid].f[k];
+                    c[i]->parts[pid].f[k] = FPTYPE_ZERO;
+                }
+
+        /* The SIMD kernel. */
+        if ( simd == runner_simd_avx512 ) {
+            if ( ( ( nr_cells == 1 ) ? runner_doself_avx512( r , c[0] ) : runner_dopair_avx512( r , c[0] , c[1] , t->flags ) ) < 0 )
+                return -1;
+        }
+        else if ( ( ( nr_cells == 1 ) ? runner_doself_avx2( r , c[0] ) : runner_dopair_avx2( r , c[0] , c[1] , t->flags ) ) < 0 )
+            return -1;
+
+        /* Compare the forces on the particles of the task. */
+        for ( dmax = amax = 0.0 , i = 0 ; i < nr_cells ; i++ )
+            for ( pid = 0 ; pid < c[i]->count ; pid++ )
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    amax = fmax( amax , fabs( f_ref[ 3*c[i]->parts[pid].id + k ] ) );
+                    dmax = fmax( dmax , fabs( f_ref[ 3*c[i]->parts[pid].id + k ] - c[i]->parts[pid].f[k] ) );
+                }
+        if ( dmax > 1.0e-4 * amax )
+            bad += 1;
+        nr_tasks += 1;
+    }
+
+    free( f_ref );
+    printf( "simd: the %s %s kernels differ on %i of %i tasks.\n" , ( simd == runner_simd_avx512 ) ? "avx512" : "avx2" ,
+        ( e->pot_kind == potential_kind_table ) ? "table" : "closed-form" , bad , nr_tasks );
+
+    return ( nr_tasks > 0 ) ? bad : 1;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    struct space *s = &e->s;
+    int nr_parts, simd, tid, k, res, kind, table, bad = 0;
+    double *f_ref, *f, epot_ref, epot;
+
+    testsys_check( testsys_init( e , engine_flag_simd , 14 , testsys_width , testsys_cutoff ) );
+    nr_parts = s->nr_parts;
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    testsys_brute( e , f_ref , &epot_ref , 1 );
+
+    /* The runners must pick the widest kernels. */
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < e->nr_runners ; k++ )
+        if ( e->runners[k].simd != runner_simd_detect() ) {
+            printf( "simd: runner %i uses the kernels %i, not %i.\n" , k , e->runners[k].simd , runner_simd_detect() );
+            bad += 1;
+        }
+
+    /* Each flavour against the scalar kernels, task by task, with the
+       closed-form potentials and with the tables. */
+    for ( tid = 0 ; tid < s->nr_tasks ; tid++ )
+        if ( s->tasks[tid].type == task_type_sort )
+            testsys_check( runner_dosort( &e->runners[0] , &s->cells[ s->tasks[tid].i ] , s->tasks[tid].flags ) );
+    kind = e->pot_kind;
+    for ( table = 0 ; table < 2 ; table++ ) {
+        if ( table )
+            e->pot_kind = potential_kind_table;
+        for ( simd = runner_simd_avx2 ; simd <= runner_simd_detect() ; simd++ ) {
+            if ( ( res = simd_tasks( e , simd ) ) < 0 ) {
+                errs_dump( stdout );
+                return 1;
+            }
+            bad += res;
+        }
+    }
+    e->pot_kind = kind;
+
+    /* A whole step against all pairs. */
+    testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    epot = s->epot;
+    testsys_check( engine_finalize( e ) );
+    bad += testsys_compare( "simd forces" , f_ref , f , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "simd energy" , &epot_ref , &epot , 1 , 1.0e-4 );
+
+    free( f_ref ); free( f );
+    return bad != 0;
+
+}
@@ -0,0 +1,151 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the batched single-body forces: a force given per particle and
+   the same force given per run of particles of a type must add the
+   expected force to each particle of the types they are bound to, from
+   one single-body task per real cell, which calls the batched version
+   once per cell and type. */
+
+#include "testsys.h"
+#include "MxForce.h"
+
+
+/* The friction coefficient and the constant push of the test force. */
+#define sb_friction                      0.3f
+#define sb_push                          0.01f
+
+
+/* The number of calls to the batched version. */
+static int sb_calls = 0;
+
+
+/* The per-particle version of the force. */
+static void sb_func ( struct MxForce *force , struct MxParticle *p , FPTYPE *f ) {
+
+    int k;
+
+    for ( k = 0 ; k < 3 ; k++ )
+        f[k] += -sb_friction * p->v[k] + sb_push * ( p->typeId + 1 );
+
+}
+
+
+/* The batched version of the same force. */
+static void sb_span ( struct MxForce *force , struct MxParticleType *type , int count ,
+        const FPTYPE *x , const FPTYPE *v , FPTYPE *f ) {
+
+    int k;
+
+    __atomic_add_fetch( &sb_calls , 1 , __ATOMIC_RELAXED );
+    for ( k = 0 ; k < 3*count ; k++ )
+        f[k] += -sb_friction * v[k] + sb_push * ( type->id + 1 );
+
+}
+
+
+/**
+ * @brief Run one step with the test force bound to types 0 and 2.
+ *
+ * @param mode 0 for no force, 1 for the per-particle and 2 for the
+ *      batched version.
+ * @param f An array for the forces.
+ * @param v An array for the velocities the forces were computed with.
+ * @param type An array for the particle types.
+ * @param nr_tasks Where to store the number of single-body tasks.
+ */
+
+static int sb_step ( int mode , double *f , double *v , int *type , int *nr_tasks ) {
+
+    struct engine *e = &_Engine;
+    struct MxForce force;
+    int pid, k;
+
+    bzero( &force , sizeof(struct MxForce) );
+    force.ob_refcnt = 1;
+    force.func = sb_func;
+    force.span = ( mode == 2 ) ? sb_span : NULL;
+
+    testsys_check( testsys_init( e , engine_flag_none , 14 , testsys_width , testsys_cutoff ) );
+    if ( mode > 0 ) {
+        testsys_check( engine_addforce1( e , &force , 0 ) );
+        testsys_check( engine_addforce1( e , &force , 2 ) );
+    }
+    for ( pid = 0 ; pid < e->s.nr_parts ; pid++ ) {
+        for ( k = 0 ; k < 3 ; k++ )
+            v[ 3*pid + k ] = e->s.partlist[pid]->v[k];
+        type[pid] = e->s.partlist[pid]->typeId;
+    }
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( *nr_tasks = 0 , k = 0 ; k < e->s.nr_tasks ; k++ )
+        *nr_tasks += ( e->s.tasks[k].type == task_type_singlebody );
+    if ( *nr_tasks != ( mode > 0 ? e->s.nr_real : 0 ) ) {
+        printf( "singlebody: %i single-body tasks for %i real cells.\n" , *nr_tasks , e->s.nr_real );
+        return 1;
+    }
+    sb_calls = 0;
+    testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    testsys_check( engine_finalize( e ) );
+
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    int nr_parts = 14*14*14, pid, k, *type, nr_tasks, bad = 0;
+    double *v, *f_none, *f_func, *f_span, *f_ref;
+
+    v = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_none = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_func = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_span = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    type = (int *)malloc( sizeof(int) * nr_parts );
+
+    if ( sb_step( 0 , f_none , v , type , &nr_tasks ) != 0 ||
+         sb_step( 1 , f_func , v , type , &nr_tasks ) != 0 ||
+         sb_step( 2 , f_span , v , type , &nr_tasks ) != 0 )
+        return 1;
+
+    /* Each single-body task calls the batched version at most once per
+       bound type. */
+    printf( "singlebody: %i batched calls from %i tasks.\n" , sb_calls , nr_tasks );
+    bad += ( sb_calls == 0 || sb_calls > 2 * nr_tasks );
+
+    /* The expected single-body forces, and what the engine added. */
+    for ( pid = 0 ; pid < nr_parts ; pid++ )
+        for ( k = 0 ; k < 3 ; k++ ) {
+            f_ref[ 3*pid + k ] = ( type[pid] == 1 ) ? 0.0 : -sb_friction * v[ 3*pid + k ] + sb_push * ( type[pid] + 1 );
+            f_func[ 3*pid + k ] -= f_none[ 3*pid + k ];
+            f_span[ 3*pid + k ] -= f_none[ 3*pid + k ];
+        }
+
+    /* The pair forces are much larger, so allow for their round-off. */
+    bad += testsys_compare( "per-particle force" , f_ref , f_func , 3 * nr_parts , 1.0e-3 );
+    bad += testsys_compare( "batched force" , f_ref , f_span , 3 * nr_parts , 1.0e-3 );
+    bad += testsys_compare( "batched against per-particle" , f_func , f_span , 3 * nr_parts , 1.0e-3 );
+
+    free( v ); free( f_none ); free( f_func ); free( f_span ); free( f_ref ); free( type );
+    return bad != 0;
+
+}
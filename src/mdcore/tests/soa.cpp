@@ -0,0 +1,180 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the structure-of-arrays particle storage (engine_flag_soa): the
+   cells keep the positions, velocities and forces in their SoA buffers,
+   the particle records go stale until space_soa_unpack, the accessors
+   and engine_unload see the current values, and many steps with fast
+   particles, which change cells, follow the same trajectory as with the
+   particle records as storage. */
+
+#include "testsys.h"
+
+
+/* Number of steps, and the velocity scale, enough for many particles
+   to change cells. */
+#define soa_steps                        50
+#define soa_vscale                       5.0
+
+
+/**
+ * @brief Take a few fast steps and collect the positions, velocities,
+ *      forces and energy through the accessors.
+ *
+ * @param flags The #engine flags.
+ * @param x, v, f Arrays for the positions, velocities and forces.
+ * @param epot Where to store the potential energy.
+ * @param moved Where to store the number of particles that changed cells.
+ *
+ * Leaves the engine running.
+ */
+
+static int soa_run ( unsigned int flags , double *x , double *v , double *f , double *epot , int *moved ) {
+
+    struct engine *e = &_Engine;
+    struct space *s = &e->s;
+    struct space_cell **cells;
+    FPTYPE buff[3];
+    int pid, k;
+
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , testsys_cutoff ) );
+    cells = (struct space_cell **)malloc( sizeof(struct space_cell *) * s->nr_parts );
+    for ( pid = 0 ; pid < s->nr_parts ; pid++ ) {
+        testsys_check( space_getvel( s , pid , buff ) );
+        for ( k = 0 ; k < 3 ; k++ )
+            buff[k] *= soa_vscale;
+        testsys_check( space_setvel( s , pid , buff ) );
+        cells[pid] = s->celllist[pid];
+    }
+
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < soa_steps ; k++ )
+        testsys_check( engine_step( e ) );
+
+    testsys_positions( e , x );
+    testsys_forces( e , f );
+    for ( *moved = 0 , pid = 0 ; pid < s->nr_parts ; pid++ ) {
+        testsys_check( space_getvel( s , pid , buff ) );
+        for ( k = 0 ; k < 3 ; k++ )
+            v[ 3*pid + k ] = buff[k];
+        *moved += ( s->celllist[pid] != cells[pid] );
+    }
+    *epot = s->epot;
+
+    free( cells );
+    return 0;
+
+}
+
+
+/**
+ * @brief Count the particles whose record differs from the accessors.
+ */
+
+static int soa_stale ( struct engine *e ) {
+
+    struct space *s = &e->s;
+    struct MxParticle *p;
+    FPTYPE x[3], v[3], f[3];
+    int pid, k, count = 0;
+
+    for ( pid = 0 ; pid < s->nr_parts ; pid++ ) {
+        p = s->partlist[pid];
+        space_getpos( s , pid , x );
+        space_getvel( s , pid , v );
+        space_getforce( s , pid , f );
+        for ( k = 0 ; k < 3 ; k++ )
+            if ( (FPTYPE)( p->x[k] + s->celllist[pid]->origin[k] ) != x[k] || p->v[k] != v[k] || p->f[k] != f[k] )
+                break;
+        count += ( k < 3 );
+    }
+
+    return count;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    struct space *s = &e->s;
+    int nr_parts = 14*14*14, cid, pid, k, moved, stale, bad = 0;
+    double *x_ref, *v_ref, *f_ref, *x, *v, *f, *x_out, epot_ref, epot;
+    FPTYPE buff[3], vel[3] = { 1.0 , 2.0 , 3.0 };
+
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    v_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    v = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_out = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* The reference, with the particle records as storage. */
+    if ( soa_run( engine_flag_none , x_ref , v_ref , f_ref , &epot_ref , &moved ) != 0 )
+        return 1;
+    testsys_check( engine_finalize( e ) );
+
+    /* The same steps with the particle data in the SoA buffers. */
+    if ( soa_run( engine_flag_soa , x , v , f , &epot , &moved ) != 0 )
+        return 1;
+    if ( !( e->flags & engine_flag_soa ) || !s->soa ) {
+        printf( "soa: engine_flag_soa was not kept.\n" );
+        return 1;
+    }
+    for ( cid = 0 ; cid < s->nr_cells ; cid++ )
+        if ( !( s->cells[cid].flags & cell_flag_soa ) || s->cells[cid].soa_size < s->cells[cid].count )
+            bad += 1;
+    printf( "soa: %i of %i particles changed cells, %i cells without SoA buffers.\n" , moved , nr_parts , bad );
+    bad += ( moved < nr_parts / 8 );
+
+    testsys_image( x_ref , x , nr_parts , testsys_width );
+    bad += testsys_compare( "soa positions" , x_ref , x , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "soa velocities" , v_ref , v , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "soa forces" , f_ref , f , 3 * nr_parts , 1.0e-3 );
+    bad += testsys_compare( "soa energy" , &epot_ref , &epot , 1 , 1.0e-4 );
+
+    /* The records are stale, engine_unload still sees the current data. */
+    stale = soa_stale( e );
+    printf( "soa: %i stale particle records after the steps.\n" , stale );
+    bad += ( stale < nr_parts / 2 );
+    testsys_check( engine_unload( e , x_out , NULL , NULL , NULL , NULL , NULL , NULL , NULL , nr_parts ) );
+    stale = soa_stale( e );
+    printf( "soa: %i stale particle records after engine_unload.\n" , stale );
+    bad += ( stale != 0 );
+
+    /* Setting a velocity only goes to the SoA buffers. */
+    pid = nr_parts / 2;
+    testsys_check( space_setvel( s , pid , vel ) );
+    testsys_check( space_getvel( s , pid , buff ) );
+    for ( k = 0 ; k < 3 ; k++ )
+        bad += ( buff[k] != vel[k] || s->partlist[pid]->v[k] == vel[k] );
+    testsys_check( space_soa_unpack( s ) );
+    for ( k = 0 ; k < 3 ; k++ )
+        bad += ( s->partlist[pid]->v[k] != vel[k] );
+
+    testsys_check( engine_finalize( e ) );
+    printf( "soa: %i bad.\n" , bad );
+
+    free( x_ref ); free( v_ref ); free( f_ref );
+    free( x ); free( v ); free( f ); free( x_out );
+    return bad != 0;
+
+}
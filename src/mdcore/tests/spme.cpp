@@ -0,0 +1,315 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the reciprocal-space electrostatics: the Stockham transforms and
+   the convolution against a plain three-dimensional DFT, and the forces
+   and energy SPME adds to a step, with the tasks run alongside the pair
+   tasks and in a pass of their own, against a direct Ewald sum over the
+   wave vectors. The grid work must be split over several tasks. */
+
+#include "testsys.h"
+#include "spme.h"
+
+
+/* The grid of the transform check, with radices 2, 3, 4, 5 and 7. */
+#define spme_test_K0                     12
+#define spme_test_K1                     20
+#define spme_test_K2                     14
+
+/* Particles per box side, splitting parameter and B-spline order of
+   the Ewald check. */
+#define spme_test_n                      8
+#define spme_test_kappa                  2.5
+#define spme_test_order                  6
+
+
+/**
+ * @brief Check the transforms and the convolution of #spme_doconv
+ *      against a plain DFT.
+ *
+ * @param e An #engine, of which only the cell grid is used.
+ *
+ * Fills the grid and the influence function with random numbers, so
+ * that the result depends on the phases of every transform, and
+ * compares it and the energy to @c IDFT(theta*DFT(Q)) and
+ * @c 0.5*sum(theta*|DFT(Q)|^2) in double precision.
+ */
+
+static int spme_check_fft ( struct engine *e ) {
+
+    int dim[3] = { spme_test_K0 , spme_test_K1 , spme_test_K2 }, N = dim[0] * dim[1] * dim[2];
+    int i, j, a, b, c, x, y, z, bad = 0;
+    double h[3], *w[3], *Q, *F, *ref, *res, pr, pi, qr, qi, epot_ref = 0.0, epot;
+    unsigned int seed = testsys_seed;
+    struct spme s;
+
+    for ( i = 0 ; i < 3 ; i++ )
+        h[i] = e->s.dim[i] / dim[i];
+    testsys_check( spme_init( &s , e->s.origin , dim , h , spme_test_kappa , spme_order ) );
+    testsys_check( spme_maketasks( &s , &e->s , 3 , 0.0 ) );
+
+    /* The roots of unity along each dimension. */
+    for ( i = 0 ; i < 3 ; i++ ) {
+        w[i] = (double *)malloc( sizeof(double) * 2 * dim[i] );
+        for ( j = 0 ; j < dim[i] ; j++ ) {
+            w[i][2*j] = cos( 2*M_PI*j/dim[i] );
+            w[i][2*j+1] = -sin( 2*M_PI*j/dim[i] );
+        }
+    }
+
+    /* Random data. */
+    Q = (double *)malloc( sizeof(double) * 2 * N );
+    F = (double *)malloc( sizeof(double) * 2 * N );
+    ref = (double *)malloc( sizeof(double) * 2 * N );
+    res = (double *)malloc( sizeof(double) * 2 * N );
+    for ( i = 0 ; i < N ; i++ ) {
+        s.Q[2*i] = Q[2*i] = (double)rand_r( &seed ) / RAND_MAX - 0.5;
+        s.Q[2*i+1] = Q[2*i+1] = (double)rand_r( &seed ) / RAND_MAX - 0.5;
+        s.theta[i] = (double)rand_r( &seed ) / RAND_MAX;
+    }
+
+    /* The forward DFT, scaled by theta. */
+    for ( a = 0 ; a < dim[0] ; a++ )
+        for ( b = 0 ; b < dim[1] ; b++ )
+            for ( c = 0 ; c < dim[2] ; c++ ) {
+                j = c + dim[2]*( b + dim[1]*a );
+                F[2*j] = 0.0; F[2*j+1] = 0.0;
+                for ( x = 0 ; x < dim[0] ; x++ )
+                    for ( y = 0 ; y < dim[1] ; y++ )
+                        for ( z = 0 ; z < dim[2] ; z++ ) {
+                            i = z + dim[2]*( y + dim[1]*x );
+                            pr = w[0][ 2*((a*x)%dim[0]) ]; pi = w[0][ 2*((a*x)%dim[0])+1 ];
+                            qr = pr * w[1][ 2*((b*y)%dim[1]) ] - pi * w[1][ 2*((b*y)%dim[1])+1 ];
+                            qi = pr * w[1][ 2*((b*y)%dim[1])+1 ] + pi * w[1][ 2*((b*y)%dim[1]) ];
+                            pr = qr * w[2][ 2*((c*z)%dim[2]) ] - qi * w[2][ 2*((c*z)%dim[2])+1 ];
+                            pi = qr * w[2][ 2*((c*z)%dim[2])+1 ] + qi * w[2][ 2*((c*z)%dim[2]) ];
+                            F[2*j] += Q[2*i] * pr - Q[2*i+1] * pi;
+                            F[2*j+1] += Q[2*i] * pi + Q[2*i+1] * pr;
+                        }
+                epot_ref += 0.5 * s.theta[j] * ( F[2*j]*F[2*j] + F[2*j+1]*F[2*j+1] );
+                F[2*j] *= s.theta[j];
+                F[2*j+1] *= s.theta[j];
+            }
+
+    /* The unscaled backward DFT. */
+    for ( x = 0 ; x < dim[0] ; x++ )
+        for ( y = 0 ; y < dim[1] ; y++ )
+            for ( z = 0 ; z < dim[2] ; z++ ) {
+                i = z + dim[2]*( y + dim[1]*x );
+                ref[2*i] = 0.0; ref[2*i+1] = 0.0;
+                for ( a = 0 ; a < dim[0] ; a++ )
+                    for ( b = 0 ; b < dim[1] ; b++ )
+                        for ( c = 0 ; c < dim[2] ; c++ ) {
+                            j = c + dim[2]*( b + dim[1]*a );
+                            pr = w[0][ 2*((a*x)%dim[0]) ]; pi = -w[0][ 2*((a*x)%dim[0])+1 ];
+                            qr = pr * w[1][ 2*((b*y)%dim[1]) ] + pi * w[1][ 2*((b*y)%dim[1])+1 ];
+                            qi = -pr * w[1][ 2*((b*y)%dim[1])+1 ] + pi * w[1][ 2*((b*y)%dim[1]) ];
+                            pr = qr * w[2][ 2*((c*z)%dim[2]) ] + qi * w[2][ 2*((c*z)%dim[2])+1 ];
+                            pi = -qr * w[2][ 2*((c*z)%dim[2])+1 ] + qi * w[2][ 2*((c*z)%dim[2]) ];
+                            ref[2*i] += F[2*j] * pr - F[2*j+1] * pi;
+                            ref[2*i+1] += F[2*j] * pi + F[2*j+1] * pr;
+                        }
+            }
+
+    /* The transforms under test. */
+    if ( ( epot = spme_doconv( &s ) ) < 0.0 ) {
+        errs_dump( stdout );
+        return 1;
+    }
+    for ( i = 0 ; i < 2*N ; i++ )
+        res[i] = s.Q[i];
+    bad += testsys_compare( "spme transforms" , ref , res , 2 * N , 1.0e-5 );
+    bad += testsys_compare( "spme convolution energy" , &epot_ref , &epot , 1 , 1.0e-5 );
+
+    for ( i = 0 ; i < 3 ; i++ )
+        free( w[i] );
+    free( Q ); free( F ); free( ref ); free( res );
+    spme_free( &s );
+
+    return bad;
+
+}
+
+
+/**
+ * @brief Compute the reciprocal-space forces and energy, and the
+ *      self-energy of the charges, as a direct sum over the wave vectors.
+ *
+ * @param e The #engine.
+ * @param f An array of @c 3*e->s.nr_parts doubles for the forces.
+ * @param epot Where to store the energy.
+ *
+ * The sum runs over all wave vectors @c m with integer components of
+ * up to @c nmax times the reciprocal box width, with @c nmax large enough
+ * that the Gaussian has decayed below double precision round-off.
+ */
+
+static void spme_ewald ( struct engine *e , double *f , double *epot ) {
+
+    int n = e->s.nr_parts, nmax, nn, i, k, m[3];
+    double *x, *ex[3], L[3], V, kappa = spme_test_kappa, mv[3], m2, g, sr, si, er, ei, tr, ti, q;
+    struct MxParticle *p;
+
+    for ( k = 0 ; k < 3 ; k++ )
+        L[k] = e->s.dim[k];
+    V = L[0] * L[1] * L[2];
+    nmax = (int)ceil( 6.0 * kappa * fmax( L[0] , fmax( L[1] , L[2] ) ) / M_PI );
+    nn = 2 * nmax + 1;
+
+    /* exp( 2 pi i m x / L ) of each particle for each m along each axis. */
+    x = (double *)malloc( sizeof(double) * 3 * n );
+    testsys_positions( e , x );
+    for ( k = 0 ; k < 3 ; k++ ) {
+        ex[k] = (double *)malloc( sizeof(double) * 2 * n * nn );
+        for ( i = 0 ; i < n ; i++ )
+            for ( m[0] = -nmax ; m[0] <= nmax ; m[0]++ ) {
+                ex[k][ 2*( i*nn + m[0] + nmax ) ] = cos( 2*M_PI * m[0] * x[3*i+k] / L[k] );
+                ex[k][ 2*( i*nn + m[0] + nmax ) + 1 ] = sin( 2*M_PI * m[0] * x[3*i+k] / L[k] );
+            }
+    }
+
+    bzero( f , sizeof(double) * 3 * n );
+    *epot = 0.0;
+    for ( m[0] = -nmax ; m[0] <= nmax ; m[0]++ )
+        for ( m[1] = -nmax ; m[1] <= nmax ; m[1]++ )
+            for ( m[2] = -nmax ; m[2] <= nmax ; m[2]++ ) {
+
+                for ( m2 = 0.0 , k = 0 ; k < 3 ; k++ ) {
+                    mv[k] = m[k] / L[k];
+                    m2 += mv[k] * mv[k];
+                }
+                if ( m2 == 0.0 )
+                    continue;
+                g = exp( -M_PI*M_PI * m2 / ( kappa*kappa ) ) / m2;
+
+                /* The structure factor. */
+                sr = 0.0; si = 0.0;
+                for ( i = 0 ; i < n ; i++ ) {
+                    p = e->s.partlist[i];
+                    tr = ex[0][ 2*( i*nn + m[0] + nmax ) ]; ti = ex[0][ 2*( i*nn + m[0] + nmax ) + 1 ];
+                    er = tr * ex[1][ 2*( i*nn + m[1] + nmax ) ] - ti * ex[1][ 2*( i*nn + m[1] + nmax ) + 1 ];
+                    ei = tr * ex[1][ 2*( i*nn + m[1] + nmax ) + 1 ] + ti * ex[1][ 2*( i*nn + m[1] + nmax ) ];
+                    sr += p->q * ( er * ex[2][ 2*( i*nn + m[2] + nmax ) ] - ei * ex[2][ 2*( i*nn + m[2] + nmax ) + 1 ] );
+                    si += p->q * ( er * ex[2][ 2*( i*nn + m[2] + nmax ) + 1 ] + ei * ex[2][ 2*( i*nn + m[2] + nmax ) ] );
+                }
+                *epot += g * ( sr*sr + si*si );
+
+                /* The force on each particle, from Im( conj(S) q e_i ). */
+                for ( i = 0 ; i < n ; i++ ) {
+                    q = e->s.partlist[i]->q;
+                    tr = ex[0][ 2*( i*nn + m[0] + nmax ) ]; ti = ex[0][ 2*( i*nn + m[0] + nmax ) + 1 ];
+                    er = tr * ex[1][ 2*( i*nn + m[1] + nmax ) ] - ti * ex[1][ 2*( i*nn + m[1] + nmax ) + 1 ];
+                    ei = tr * ex[1][ 2*( i*nn + m[1] + nmax ) + 1 ] + ti * ex[1][ 2*( i*nn + m[1] + nmax ) ];
+                    ti = er * ex[2][ 2*( i*nn + m[2] + nmax ) + 1 ] + ei * ex[2][ 2*( i*nn + m[2] + nmax ) ];
+                    tr = er * ex[2][ 2*( i*nn + m[2] + nmax ) ] - ei * ex[2][ 2*( i*nn + m[2] + nmax ) + 1 ];
+                    for ( k = 0 ; k < 3 ; k++ )
+                        f[ 3*i + k ] += 2.0 * g * q * mv[k] * ( sr * ti - si * tr );
+                }
+
+            }
+
+    /* The prefactors and the self-energy. */
+    *epot *= potential_escale / ( 2*M_PI * V );
+    for ( i = 0 ; i < 3*n ; i++ )
+        f[i] *= potential_escale / V;
+    for ( i = 0 ; i < n ; i++ ) {
+        q = e->s.partlist[i]->q;
+        *epot -= potential_escale * kappa / sqrt( M_PI ) * q * q;
+    }
+
+    for ( k = 0 ; k < 3 ; k++ )
+        free( ex[k] );
+    free( x );
+
+}
+
+
+/**
+ * @brief Take one step with and without SPME and get the difference.
+ *
+ * @param flags The #engine flags.
+ * @param nr_runners The number of runners.
+ * @param f An array for the difference of the forces.
+ * @param epot Where to store the difference of the energy.
+ */
+
+static int spme_step ( unsigned int flags , int nr_runners , double *f , double *epot ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = spme_test_n * spme_test_n * spme_test_n, k, on;
+    double *f_on = (double *)malloc( sizeof(double) * 3 * nr_parts ), epot_on = 0.0;
+
+    for ( on = 1 ; on >= 0 ; on-- ) {
+        testsys_check( testsys_init( e , flags , spme_test_n , testsys_width , testsys_cutoff ) );
+        if ( on )
+            testsys_check( engine_spme_set( e , spme_test_kappa , NULL , spme_test_order ) );
+        testsys_check( engine_start( e , nr_runners , nr_runners ) );
+        testsys_check( engine_step( e ) );
+        if ( on ) {
+            printf( "spme: %i tasks, %i slabs, %i blocks.\n" , e->spme->nr_tasks , e->spme->nr_slabs , e->spme->nr_blocks );
+            if ( e->spme->nr_slabs < 2 || e->spme->nr_blocks < 2 )
+                return 1;
+        }
+        testsys_forces( e , on ? f_on : f );
+        *( on ? &epot_on : epot ) = e->s.epot;
+        testsys_check( engine_finalize( e ) );
+    }
+
+    for ( k = 0 ; k < 3*nr_parts ; k++ )
+        f[k] = f_on[k] - f[k];
+    *epot = epot_on - *epot;
+
+    free( f_on );
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    struct engine *e = &_Engine;
+    int nr_parts = spme_test_n * spme_test_n * spme_test_n, bad = 0;
+    double *f_ref, *f_spme, epot_ref, epot_spme;
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_spme = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    /* The transforms, and the direct sum on the same particles. */
+    testsys_check( testsys_init( e , engine_flag_none , spme_test_n , testsys_width , testsys_cutoff ) );
+    bad += spme_check_fft( e );
+    spme_ewald( e , f_ref , &epot_ref );
+    testsys_check( engine_finalize( e ) );
+
+    /* The tasks alongside the pair tasks. */
+    if ( spme_step( engine_flag_none , 2 , f_spme , &epot_spme ) != 0 )
+        return 1;
+    bad += testsys_compare( "spme forces" , f_ref , f_spme , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "spme energy" , &epot_ref , &epot_spme , 1 , 1.0e-4 );
+
+    /* The tasks in a pass of their own. */
+    if ( spme_step( engine_flag_nolock , 2 , f_spme , &epot_spme ) != 0 )
+        return 1;
+    bad += testsys_compare( "spme pass forces" , f_ref , f_spme , 3 * nr_parts , 1.0e-4 );
+    bad += testsys_compare( "spme pass energy" , &epot_ref , &epot_spme , 1 , 1.0e-4 );
+
+    free( f_ref ); free( f_spme );
+    return bad != 0;
+
+}
@@ -0,0 +1,526 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* This file contains the test system shared by the mdcore tests: three
+   particle types with Lennard-Jones interactions on a jittered lattice in
+   a periodic box. The same seed always gives the same particles, so two
+   engines set up with different flags can be compared force by force. */
+
+#ifndef TESTS_TESTSYS_H_
+#define TESTS_TESTSYS_H_
+
+/* Include some standard headers. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* MPI headers. */
+#ifdef WITH_MPI
+    #include <mpi.h>
+#endif
+
+/* Include local headers. */
+#include "errs.h"
+#include "fptype.h"
+#include <MxParticle.h>
+#include <MxPotential.h>
+#include <space_cell.h>
+#include "task.h"
+#include "space.h"
+#include "bond.h"
+#include "angle.h"
+#include "dihedral.h"
+#include "engine.h"
+#include "potential_eval.h"
+
+
+/* Default test system parameters. */
+#define testsys_nr_types                 3
+#define testsys_width                    6.0
+#define testsys_cutoff                   1.0
+#define testsys_seed                     6178
+#define testsys_dt                       0.001
+
+/* Parameters of the bonded interactions, see #testsys_bonded. */
+#define testsys_bond_K                   50.0
+#define testsys_bond_r0                  0.4
+#define testsys_angle_K                  5.0
+#define testsys_angle_theta0             ( M_PI / 2 )
+#define testsys_dihedral_K               1.0
+#define testsys_dihedral_n               2
+#define testsys_bonded_tol               1.0e-5
+
+
+/* Bail out of main with the error stack if a call fails. */
+#define testsys_check(call) { if ( (call) < 0 ) { printf( "%s:%i: %s failed.\n" , __FILE__ , __LINE__ , #call ); errs_dump( stdout ); return 1; } }
+
+
+/**
+ * @brief Set-up the test system.
+ *
+ * @param e The #engine.
+ * @param flags The #engine flags.
+ * @param n The number of particles per box side.
+ * @param width The width of the periodic box.
+ * @param L The minimum cell width.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Places @c n^3 particles of random type on a jittered lattice, with
+ * random velocities, and adds a Lennard-Jones potential between each
+ * pair of types. The particle types are set up directly, without the
+ * Python type objects.
+ *
+ * With #engine_flag_mpi, every node adds all the particles and the
+ * engine is set up on @c MPI_COMM_WORLD, to be split by the caller.
+ */
+
+inline int testsys_init ( struct engine *e , unsigned int flags , int n , double width , double L ) {
+
+    double origin[3] = { 0.0 , 0.0 , 0.0 }, dim[3] = { width , width , width };
+    double cells[3] = { L , L , L }, x[3], h = width / n;
+    unsigned int seed = testsys_seed;
+    struct MxParticle p;
+    struct MxPotential *pot;
+    int i, j, k, pid;
+
+    /* Start from a clean engine. */
+    bzero( e , sizeof(struct engine) );
+#ifdef WITH_MPI
+    if ( flags & engine_flag_mpi ) {
+        if ( MPI_Comm_rank( MPI_COMM_WORLD , &i ) != MPI_SUCCESS ||
+             engine_init_mpi( e , origin , dim , cells , testsys_cutoff , space_periodic_full , testsys_nr_types , flags , MPI_COMM_WORLD , i ) < 0 )
+            return -1;
+    }
+    else
+#endif
+    if ( engine_init( e , origin , dim , cells , testsys_cutoff , space_periodic_full , testsys_nr_types , flags ) < 0 )
+        return -1;
+    e->dt = testsys_dt;
+
+    /* Set-up the particle types. */
+    if ( ( engine::types = (MxParticleType *)calloc( testsys_nr_types , sizeof(MxParticleType) ) ) == NULL )
+        return -1;
+    for ( k = 0 ; k < testsys_nr_types ; k++ ) {
+        engine::types[k].id = k;
+        engine::types[k].mass = 1.0 + k;
+        engine::types[k].imass = 1.0 / ( 1.0 + k );
+        engine::types[k].charge = ( k == 1 ) ? -1.0 : 1.0;
+    }
+    engine::nr_types = testsys_nr_types;
+    e->types = engine::types;
+
+    /* Add the potentials, with a different well depth for each pair. */
+    for ( i = 0 ; i < testsys_nr_types ; i++ )
+        for ( j = i ; j < testsys_nr_types ; j++ ) {
+            if ( ( pot = potential_create_LJ126( 0.275 , testsys_cutoff , 9.5075e-06 , 6.1545e-03 * ( 1 + i + j ) , 1.0e-3 ) ) == NULL )
+                return -1;
+            if ( engine_addpot( e , pot , i , j ) < 0 )
+                return -1;
+        }
+
+    /* Fill the lattice. */
+    bzero( &p , sizeof(struct MxParticle) );
+    for ( pid = 0 ; pid < n*n*n ; pid++ ) {
+        x[0] = h * ( pid % n + 0.5 );
+        x[1] = h * ( ( pid / n ) % n + 0.5 );
+        x[2] = h * ( pid / n / n + 0.5 );
+        for ( k = 0 ; k < 3 ; k++ ) {
+            x[k] += 0.1 * h * ( (double)rand_r( &seed ) / RAND_MAX - 0.5 );
+            p.v[k] = (double)rand_r( &seed ) / RAND_MAX - 0.5;
+        }
+        p.id = pid;
+        p.typeId = rand_r( &seed ) % testsys_nr_types;
+        p.q = engine::types[p.typeId].charge;
+        if ( engine_addpart( e , &p , x , NULL ) < 0 )
+            return -1;
+    }
+
+    /* All is well. */
+    return engine_err_ok;
+
+}
+
+
+/**
+ * @brief Copy the particle forces to an array, ordered by particle ID.
+ *
+ * @param e The #engine.
+ * @param f An array of @c 3*e->s.nr_parts doubles.
+ */
+
+inline void testsys_forces ( struct engine *e , double *f ) {
+
+    int pid, k;
+    FPTYPE buff[3];
+
+    for ( pid = 0 ; pid < e->s.nr_parts ; pid++ ) {
+        space_getforce( &e->s , pid , buff );
+        for ( k = 0 ; k < 3 ; k++ )
+            f[ 3*pid + k ] = buff[k];
+    }
+
+}
+
+
+/**
+ * @brief Copy the global particle positions to an array, ordered by
+ *      particle ID.
+ *
+ * @param e The #engine.
+ * @param x An array of @c 3*e->s.nr_parts doubles.
+ */
+
+inline void testsys_positions ( struct engine *e , double *x ) {
+
+    int pid, k;
+    FPTYPE buff[3];
+
+    for ( pid = 0 ; pid < e->s.nr_parts ; pid++ ) {
+        space_getpos( &e->s , pid , buff );
+        for ( k = 0 ; k < 3 ; k++ )
+            x[ 3*pid + k ] = buff[k];
+    }
+
+}
+
+
+#ifdef WITH_MPI
+/**
+ * @brief Collect the global positions and forces of the real particles
+ *      of all nodes, ordered by particle ID.
+ *
+ * @param e The #engine.
+ * @param x An array of @c 3*e->s.nr_parts doubles for the positions.
+ * @param f An array of @c 3*e->s.nr_parts doubles for the forces.
+ * @param count An array of @c e->s.nr_parts ints in which to store the
+ *      number of nodes that own each particle.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Must be called by all nodes.
+ */
+
+inline int testsys_gather ( struct engine *e , double *x , double *f , int *count ) {
+
+    struct space *s = &e->s;
+    struct space_cell *c;
+    struct MxParticle *p;
+    int cid, pid, k;
+
+    bzero( x , sizeof(double) * 3 * s->nr_parts );
+    bzero( f , sizeof(double) * 3 * s->nr_parts );
+    bzero( count , sizeof(int) * s->nr_parts );
+    for ( cid = 0 ; cid < s->nr_real ; cid++ ) {
+        c = &s->cells[ s->cid_real[cid] ];
+        for ( pid = 0 ; pid < c->count ; pid++ ) {
+            p = &c->parts[pid];
+            count[ p->id ] += 1;
+            for ( k = 0 ; k < 3 ; k++ ) {
+                x[ 3*p->id + k ] = p->x[k] + c->origin[k];
+                f[ 3*p->id + k ] = p->f[k];
+            }
+        }
+    }
+
+    if ( MPI_Allreduce( MPI_IN_PLACE , x , 3 * s->nr_parts , MPI_DOUBLE , MPI_SUM , e->comm ) != MPI_SUCCESS ||
+         MPI_Allreduce( MPI_IN_PLACE , f , 3 * s->nr_parts , MPI_DOUBLE , MPI_SUM , e->comm ) != MPI_SUCCESS ||
+         MPI_Allreduce( MPI_IN_PLACE , count , s->nr_parts , MPI_INT , MPI_SUM , e->comm ) != MPI_SUCCESS )
+        return -1;
+
+    return engine_err_ok;
+
+}
+#endif
+
+
+/**
+ * @brief Move positions to their periodic image closest to a reference.
+ *
+ * @param ref The reference positions.
+ * @param x The positions to move.
+ * @param n The number of particles.
+ * @param width The width of the periodic box.
+ *
+ * Two runs may wrap a particle on the box boundary differently, this
+ * makes their positions comparable.
+ */
+
+inline void testsys_image ( const double *ref , double *x , int n , double width ) {
+
+    int k;
+
+    for ( k = 0 ; k < 3*n ; k++ )
+        x[k] -= width * round( ( x[k] - ref[k] ) / width );
+
+}
+
+
+/**
+ * @brief Compute the non-bonded forces and energy over all pairs of
+ *      particles, in double precision.
+ *
+ * @param e The #engine.
+ * @param f An array of @c 3*e->s.nr_parts doubles for the forces.
+ * @param epot Where to store the potential energy.
+ * @param closed Evaluate the Lennard-Jones potentials from their
+ *      parameters instead of interpolating the tables.
+ *
+ * This is the reference the pair kernels are checked against. The
+ * periodic images are taken with the minimum image convention.
+ */
+
+inline void testsys_brute ( struct engine *e , double *f , double *epot , int closed ) {
+
+    int i, j, k, n = e->s.nr_parts;
+    double *x = (double *)malloc( sizeof(double) * 3 * n );
+    double dx[3], r2, r, v, w, cutoff2 = e->s.cutoff * e->s.cutoff;
+    struct MxPotential *pot;
+    FPTYPE ee, ff;
+
+    testsys_positions( e , x );
+    bzero( f , sizeof(double) * 3 * n );
+    *epot = 0.0;
+    for ( i = 0 ; i < n ; i++ )
+        for ( j = i + 1 ; j < n ; j++ ) {
+            pot = e->p[ e->s.partlist[i]->typeId * e->max_type + e->s.partlist[j]->typeId ];
+            if ( pot == NULL )
+                continue;
+            for ( r2 = 0.0 , k = 0 ; k < 3 ; k++ ) {
+                dx[k] = x[ 3*i + k ] - x[ 3*j + k ];
+                dx[k] -= e->s.dim[k] * round( dx[k] / e->s.dim[k] );
+                r2 += dx[k] * dx[k];
+            }
+            if ( r2 >= cutoff2 || r2 >= pot->b * pot->b )
+                continue;
+            if ( closed ) {
+                r = sqrt( r2 );
+                v = potential_LJ126( r , pot->params[0] , pot->params[1] );
+                w = potential_LJ126_p( r , pot->params[0] , pot->params[1] ) / r;
+            }
+            else {
+                potential_eval( pot , r2 , &ee , &ff );
+                v = ee; w = ff;
+            }
+            *epot += v;
+            for ( k = 0 ; k < 3 ; k++ ) {
+                f[ 3*i + k ] -= w * dx[k];
+                f[ 3*j + k ] += w * dx[k];
+            }
+        }
+
+    free( x );
+
+}
+
+
+/**
+ * @brief Add bonds, angles and dihedrals to the test system.
+ *
+ * @param e The #engine, set up with #testsys_init.
+ * @param n The number of particles per box side.
+ * @param pairs Keep the non-bonded potentials, otherwise the particles
+ *      only feel the bonded interactions.
+ *
+ * @return #engine_err_ok or < 0 on error (see #engine_err).
+ *
+ * Each particle starts a staircase through its lattice neighbours along
+ * @c x, @c y and @c z, wrapping around the box, with a bond over the
+ * first step, an angle over the first two and a dihedral over all
+ * three. The angles and dihedrals are close to right angles, away from
+ * the ends of their potentials' ranges, and many of the interactions
+ * cross cell and box boundaries.
+ */
+
+inline int testsys_bonded ( struct engine *e , int n , int pairs ) {
+
+    struct MxPotential *pot;
+    int pid, a, b, c, ids[4], k, apot, dpot;
+
+    /* Drop the non-bonded potentials? */
+    if ( !pairs )
+        for ( k = 0 ; k < e->max_type * e->max_type ; k++ )
+            e->p[k] = NULL;
+
+    /* The potentials. */
+    if ( ( pot = potential_create_harmonic( 0.1 , 1.0 , testsys_bond_K , testsys_bond_r0 , testsys_bonded_tol ) ) == NULL )
+        return -1;
+    for ( a = 0 ; a < testsys_nr_types ; a++ )
+        for ( b = a ; b < testsys_nr_types ; b++ )
+            if ( engine_bond_addpot( e , pot , a , b ) < 0 )
+                return -1;
+    if ( ( pot = potential_create_harmonic_angle( M_PI / 12 , 11 * M_PI / 12 , testsys_angle_K , testsys_angle_theta0 , testsys_bonded_tol ) ) == NULL ||
+         ( apot = engine_angle_addpot( e , pot ) ) < 0 )
+        return -1;
+    if ( ( pot = potential_create_harmonic_dihedral( testsys_dihedral_K , testsys_dihedral_n , 0.0 , testsys_bonded_tol ) ) == NULL ||
+         ( dpot = engine_dihedral_addpot( e , pot ) ) < 0 )
+        return -1;
+
+    /* The staircases. */
+    for ( pid = 0 ; pid < n*n*n ; pid++ ) {
+        a = pid % n; b = ( pid / n ) % n; c = pid / n / n;
+        ids[0] = pid;
+        ids[1] = ( a + 1 ) % n + n * ( b + n * c );
+        ids[2] = ( a + 1 ) % n + n * ( ( b + 1 ) % n + n * c );
+        ids[3] = ( a + 1 ) % n + n * ( ( b + 1 ) % n + n * ( ( c + 1 ) % n ) );
+        if ( engine_bond_add( e , ids[0] , ids[1] ) < 0 ||
+             engine_angle_add( e , ids[0] , ids[1] , ids[2] , apot ) < 0 ||
+             engine_dihedral_add( e , ids[0] , ids[1] , ids[2] , ids[3] , dpot ) < 0 )
+            return -1;
+    }
+
+    return engine_err_ok;
+
+}
+
+
+/**
+ * @brief The energy of one bonded interaction, from the formulas of its
+ *      potential.
+ *
+ * @param nr_ids The number of particles: 2 for a bond, 3 for an angle,
+ *      4 for a dihedral.
+ * @param y The positions of the particles, without periodic images.
+ */
+
+inline double testsys_bonded_energy ( int nr_ids , const double *y ) {
+
+    double a[3], b[3], c[3], n1[3], n2[3], r, cphi;
+    int k;
+
+    for ( k = 0 ; k < 3 ; k++ ) {
+        a[k] = y[3+k] - y[k];
+        if ( nr_ids > 2 )
+            b[k] = y[6+k] - y[3+k];
+        if ( nr_ids > 3 )
+            c[k] = y[9+k] - y[6+k];
+    }
+
+    /* A bond. */
+    if ( nr_ids == 2 ) {
+        r = sqrt( a[0]*a[0] + a[1]*a[1] + a[2]*a[2] );
+        return testsys_bond_K * ( r - testsys_bond_r0 ) * ( r - testsys_bond_r0 );
+    }
+
+    /* An angle, between the rays from the middle particle. */
+    if ( nr_ids == 3 ) {
+        r = -( a[0]*b[0] + a[1]*b[1] + a[2]*b[2] ) /
+            sqrt( ( a[0]*a[0] + a[1]*a[1] + a[2]*a[2] ) * ( b[0]*b[0] + b[1]*b[1] + b[2]*b[2] ) );
+        r = acos( r ) - testsys_angle_theta0;
+        return testsys_angle_K * r * r;
+    }
+
+    /* A dihedral, between the normals of the two planes. */
+    for ( k = 0 ; k < 3 ; k++ ) {
+        n1[k] = a[(k+1)%3] * b[(k+2)%3] - a[(k+2)%3] * b[(k+1)%3];
+        n2[k] = b[(k+1)%3] * c[(k+2)%3] - b[(k+2)%3] * c[(k+1)%3];
+    }
+    cphi = ( n1[0]*n2[0] + n1[1]*n2[1] + n1[2]*n2[2] ) /
+        sqrt( ( n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2] ) * ( n2[0]*n2[0] + n2[1]*n2[1] + n2[2]*n2[2] ) );
+    return testsys_dihedral_K * ( 1.0 + cos( testsys_dihedral_n * acos( cphi ) ) );
+
+}
+
+
+/**
+ * @brief Add the forces and energy of the bonds, angles and dihedrals,
+ *      in double precision.
+ *
+ * @param e The #engine, set up with #testsys_bonded.
+ * @param f An array of @c 3*e->s.nr_parts doubles to add the forces to.
+ * @param epot Where to add the potential energy.
+ *
+ * This is the reference the bonded kernels are checked against. The
+ * energies are computed from the formulas of the potentials and the
+ * forces by central differences, so neither the tables nor the
+ * derivatives of the kernels are used. Only the interactions currently
+ * in the engine's lists count.
+ */
+
+inline void testsys_bonded_brute ( struct engine *e , double *f , double *epot ) {
+
+    int n = e->s.nr_parts, nr_ids, t, N, i, j, k, *ids;
+    double *x = (double *)malloc( sizeof(double) * 3 * n ), y[12], d, ep, em, eps = 1.0e-6;
+
+    testsys_positions( e , x );
+    for ( nr_ids = 2 ; nr_ids <= 4 ; nr_ids++ ) {
+        N = ( nr_ids == 2 ) ? e->nr_bonds : ( nr_ids == 3 ) ? e->nr_angles : e->nr_dihedrals;
+        for ( t = 0 ; t < N ; t++ ) {
+            ids = ( nr_ids == 2 ) ? &e->bonds[t].i : ( nr_ids == 3 ) ? &e->angles[t].i : &e->dihedrals[t].i;
+
+            /* Take the images closest to the first particle. */
+            for ( i = 0 ; i < nr_ids ; i++ )
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    d = x[ 3*ids[i] + k ] - x[ 3*ids[0] + k ];
+                    y[ 3*i + k ] = x[ 3*ids[0] + k ] + d - e->s.dim[k] * round( d / e->s.dim[k] );
+                }
+            *epot += testsys_bonded_energy( nr_ids , y );
+
+            /* The forces by central differences. */
+            for ( j = 0 ; j < 3*nr_ids ; j++ ) {
+                d = y[j];
+                y[j] = d + eps; ep = testsys_bonded_energy( nr_ids , y );
+                y[j] = d - eps; em = testsys_bonded_energy( nr_ids , y );
+                y[j] = d;
+                f[ 3*ids[j/3] + j%3 ] -= ( ep - em ) / ( 2 * eps );
+            }
+        }
+    }
+
+    free( x );
+
+}
+
+
+/**
+ * @brief Compare two arrays relative to the largest entry of the first.
+ *
+ * @param what A name for the output.
+ * @param a The reference values.
+ * @param b The values to check.
+ * @param n The number of values.
+ * @param tol The largest acceptable relative difference.
+ *
+ * @return 0 if the arrays agree, 1 otherwise or if the reference is
+ *      all zero.
+ */
+
+inline int testsys_compare ( const char *what , const double *a , const double *b , int n , double tol ) {
+
+    double amax = 0.0, dmax = 0.0;
+    int k;
+
+    for ( k = 0 ; k < n ; k++ ) {
+        amax = fmax( amax , fabs( a[k] ) );
+        dmax = fmax( dmax , fabs( a[k] - b[k] ) );
+    }
+    if ( amax == 0.0 ) {
+        printf( "%s: the reference is zero.\n" , what );
+        return 1;
+    }
+    dmax /= amax;
+
+    printf( "%s: max. relative difference %e (tol %e).\n" , what , dmax , tol );
+    return !( dmax <= tol );
+
+}
+
+#endif /* TESTS_TESTSYS_H_ */
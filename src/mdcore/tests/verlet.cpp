@@ -0,0 +1,97 @@
+/*******************************************************************************
+ * This file is part of mdcore.
+ * Coypright (c) 2010 Pedro Gonnet (pedro.gonnet@durham.ac.uk)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+
+/* Checks the per-cell neighbour lists (engine_flag_verlet_list) against
+   the cell-pair kernels over enough steps for the lists to be re-built
+   as the particles move through the skin. */
+
+#include "testsys.h"
+
+
+/* Number of steps, and the skin, small enough for a few rebuilds. */
+#define nr_steps                         100
+#define verlet_skin                      0.05
+
+
+/**
+ * @brief Take a few steps and collect the last forces, the positions
+ *      and the energy.
+ *
+ * @param flags The #engine flags.
+ * @param f An array for the forces.
+ * @param x An array for the positions.
+ * @param epot Where to store the potential energy.
+ */
+
+static int verlet_run ( unsigned int flags , double *f , double *x , double *epot ) {
+
+    struct engine *e = &_Engine;
+    int k, nr_rebuilds;
+    long nr_entries;
+
+    /* Cells wide enough for the cutoff and the default skin. */
+    testsys_check( testsys_init( e , flags , 14 , testsys_width , 1.2 * testsys_cutoff ) );
+    if ( flags & engine_flag_verlet_list )
+        testsys_check( engine_verlet_setskin( e , verlet_skin ) );
+    testsys_check( engine_start( e , 2 , 2 ) );
+    for ( k = 0 ; k < nr_steps ; k++ )
+        testsys_check( engine_step( e ) );
+    testsys_forces( e , f );
+    testsys_positions( e , x );
+    *epot = e->s.epot;
+
+    if ( flags & engine_flag_verlet_list ) {
+        testsys_check( engine_verlet_stats( e , &nr_rebuilds , NULL , NULL , &nr_entries ) );
+        printf( "verlet: %i rebuilds, %li entries.\n" , nr_rebuilds , nr_entries );
+        if ( nr_rebuilds < 2 || nr_entries <= 0 ) {
+            printf( "verlet: the lists were not re-built.\n" );
+            return 1;
+        }
+    }
+    testsys_check( engine_finalize( e ) );
+
+    return 0;
+
+}
+
+
+int main ( int argc , char *argv[] ) {
+
+    int nr_parts = 14*14*14, bad = 0;
+    double *f_ref, *f_list, *x_ref, *x_list, epot_ref, epot_list;
+
+    f_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    f_list = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_ref = (double *)malloc( sizeof(double) * 3 * nr_parts );
+    x_list = (double *)malloc( sizeof(double) * 3 * nr_parts );
+
+    if ( verlet_run( engine_flag_none , f_ref , x_ref , &epot_ref ) != 0 ||
+         verlet_run( engine_flag_verlet_list , f_list , x_list , &epot_list ) != 0 )
+        return 1;
+
+    bad += testsys_compare( "verlet forces" , f_ref , f_list , 3 * nr_parts , 1.0e-4 );
+    testsys_image( x_ref , x_list , nr_parts , testsys_width );
+    bad += testsys_compare( "verlet positions" , x_ref , x_list , 3 * nr_parts , 1.0e-5 );
+    bad += testsys_compare( "verlet energy" , &epot_ref , &epot_list , 1 , 1.0e-4 );
+
+    free( f_ref ); free( f_list ); free( x_ref ); free( x_list );
+    return bad != 0;
+
+}
@@ -87,9 +87,7 @@ MxUniverseRendererOld& MxUniverseRendererOld::draw(Containers::Pointer<SceneGrap
     int i = 0;
     for (int cid = 0 ; cid < _Engine.s.nr_cells ; cid++ ) {
         for (int pid = 0 ; pid < _Engine.s.cells[cid].count ; pid++ ) {
-            vertexPtr[i].pos.x() = _Engine.s.cells[cid].origin[0] + _Engine.s.cells[cid].parts[pid].x[0];
-            vertexPtr[i].pos.y() = _Engine.s.cells[cid].origin[1] + _Engine.s.cells[cid].parts[pid].x[1];
-            vertexPtr[i].pos.z() = _Engine.s.cells[cid].origin[2] + _Engine.s.cells[cid].parts[pid].x[2];
+            space_getpos(&_Engine.s, _Engine.s.cells[cid].parts[pid].id, vertexPtr[i].pos.data());
             vertexPtr[i].index = _Engine.s.cells[cid].parts[pid].id;
 
             MxParticle *p  = &_Engine.s.cells[cid].parts[pid];